@@ -0,0 +1,61 @@
+/* Compares two result files of suite (or run_suite.sh) and fails if anything regressed more than the threshold */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+
+/* Our own lines only, {"name": "...", "unit": "...", "median": ..., ...} */
+std::map<std::string, std::pair<std::string, double>> load(const char *path) {
+    std::map<std::string, std::pair<std::string, double>> results;
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Error: cannot open " << path << std::endl;
+        exit(2);
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        char name[128], unit[32];
+        double median;
+        if (sscanf(line.c_str(), "{\"name\": \"%127[^\"]\", \"unit\": \"%31[^\"]\", \"median\": %lf", name, unit, &median) == 3) {
+            results[name] = {unit, median};
+        }
+    }
+    return results;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3 && argc != 4) {
+        std::cout << "Usage: compare before.json after.json [threshold_percent]" << std::endl;
+        return 2;
+    }
+
+    double threshold = argc == 4 ? atof(argv[3]) : 5.0;
+    auto before = load(argv[1]), after = load(argv[2]);
+
+    int regressions = 0;
+    for (auto &[name, result] : after) {
+        auto it = before.find(name);
+        if (it == before.end()) {
+            printf("%-36s %14.3f %-14s (new)\n", name.c_str(), result.second, result.first.c_str());
+            continue;
+        }
+
+        /* Every unit we report is higher is better, except memory, latency and cycles */
+        double change = (result.second - it->second.second) / it->second.second * 100;
+        bool lowerIsBetter = result.first == "B/socket" || result.first == "us" || result.first == "cycles";
+        bool regressed = (lowerIsBetter ? change : -change) > threshold;
+        regressions += regressed;
+
+        printf("%-36s %14.3f -> %14.3f %-14s %+7.1f%%%s\n", name.c_str(), it->second.second, result.second, result.first.c_str(), change, regressed ? "  REGRESSION" : "");
+    }
+    for (auto &[name, result] : before) {
+        if (!after.count(name)) {
+            printf("%-36s %14.3f %-14s (gone)\n", name.c_str(), result.second, result.first.c_str());
+        }
+    }
+
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+/* This is a pipelined HTTP GET benchmark much like WRK with a pipelining script.
+ * Responses are counted by their header terminators, so bodies must not contain CRLFCRLF (HelloWorld) */
+
+#include <libusockets.h>
+int SSL;
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char request[] = "GET / HTTP/1.1\r\n"
+                 "Host: server.example.com\r\n"
+                 "User-Agent: http_load_test\r\n"
+                 "Accept: */*\r\n\r\n";
+
+/* Pipeline depth copies of request */
+char *pipeline;
+int pipeline_length;
+int pipeline_depth;
+
+char *host;
+int port;
+int connections;
+
+int responses;
+
+struct http_socket {
+    /* How far we have streamed our pipeline */
+    int offset;
+
+    /* Responses we still wait for before sending another pipeline */
+    int outstanding_responses;
+
+    /* How much of CRLFCRLF the last chunk ended with */
+    int terminator_state;
+};
+
+/* We don't need any of these */
+void noop(struct us_loop_t *loop) {
+
+}
+
+void send_pipeline(struct us_socket_t *s) {
+    struct http_socket *http_socket = (struct http_socket *) us_socket_ext(SSL, s);
+
+    http_socket->outstanding_responses = pipeline_depth;
+    http_socket->offset = us_socket_write(SSL, s, pipeline, pipeline_length, 0);
+}
+
+void next_connection(struct us_socket_t *s) {
+    if (--connections) {
+        us_socket_context_connect(SSL, us_socket_context(SSL, s), host, port, NULL, 0, sizeof(struct http_socket));
+    } else {
+        printf("Running benchmark now...\n");
+
+        us_socket_timeout(SSL, s, LIBUS_TIMEOUT_GRANULARITY);
+    }
+}
+
+struct us_socket_t *on_http_socket_writable(struct us_socket_t *s) {
+    struct http_socket *http_socket = (struct http_socket *) us_socket_ext(SSL, s);
+
+    /* Stream whatever is remaining of the pipeline */
+    if (http_socket->offset < pipeline_length) {
+        http_socket->offset += us_socket_write(SSL, s, pipeline + http_socket->offset, pipeline_length - http_socket->offset, 0);
+    }
+
+    return s;
+}
+
+struct us_socket_t *on_http_socket_close(struct us_socket_t *s, int code, void *reason) {
+
+    printf("Closed!\n");
+
+    return s;
+}
+
+struct us_socket_t *on_http_socket_end(struct us_socket_t *s) {
+    return us_socket_close(SSL, s, 0, NULL);
+}
+
+struct us_socket_t *on_http_socket_data(struct us_socket_t *s, char *data, int length) {
+    struct http_socket *http_socket = (struct http_socket *) us_socket_ext(SSL, s);
+
+    /* Count header terminators, even those split over chunks */
+    const char terminator[] = "\r\n\r\n";
+    for (int i = 0; i < length; i++) {
+        if (data[i] == terminator[http_socket->terminator_state]) {
+            if (++http_socket->terminator_state == 4) {
+                http_socket->terminator_state = 0;
+                http_socket->outstanding_responses--;
+                responses++;
+            }
+        } else {
+            http_socket->terminator_state = data[i] == '\r';
+        }
+    }
+
+    if (http_socket->outstanding_responses == 0) {
+        send_pipeline(s);
+    } else if (http_socket->outstanding_responses < 0) {
+        /* This should never happen */
+        printf("ERROR: more responses than requests!\n");
+        exit(0);
+    }
+
+    return s;
+}
+
+struct us_socket_t *on_http_socket_open(struct us_socket_t *s, int is_client, char *ip, int ip_length) {
+    struct http_socket *http_socket = (struct http_socket *) us_socket_ext(SSL, s);
+
+    http_socket->terminator_state = 0;
+    send_pipeline(s);
+    next_connection(s);
+
+    return s;
+}
+
+struct us_socket_t *on_http_socket_timeout(struct us_socket_t *s) {
+    /* Print current statistics */
+    printf("Req/sec: %f\n", ((float)responses) / LIBUS_TIMEOUT_GRANULARITY);
+
+    responses = 0;
+    us_socket_timeout(SSL, s, LIBUS_TIMEOUT_GRANULARITY);
+
+    return s;
+}
+
+int main(int argc, char **argv) {
+
+    /* Parse host and port */
+    if (argc != 6) {
+        printf("Usage: connections host port ssl pipeline_depth\n");
+        return 0;
+    }
+
+    port = atoi(argv[3]);
+    host = malloc(strlen(argv[2]) + 1);
+    memcpy(host, argv[2], strlen(argv[2]) + 1);
+    connections = atoi(argv[1]);
+    SSL = atoi(argv[4]);
+    pipeline_depth = atoi(argv[5]);
+    if (pipeline_depth < 1) {
+        pipeline_depth = 1;
+    }
+
+    /* Lay out the pipeline */
+    pipeline_length = (int) (sizeof(request) - 1) * pipeline_depth;
+    pipeline = malloc(pipeline_length);
+    for (int i = 0; i < pipeline_depth; i++) {
+        memcpy(pipeline + i * (sizeof(request) - 1), request, sizeof(request) - 1);
+    }
+
+    /* Create the event loop */
+    struct us_loop_t *loop = us_create_loop(0, noop, noop, noop, 0);
+
+    /* Create a socket context for HTTP */
+    struct us_socket_context_options_t options = {};
+    struct us_socket_context_t *http_context = us_create_socket_context(SSL, loop, 0, options);
+
+    /* Set up event handlers */
+    us_socket_context_on_open(SSL, http_context, on_http_socket_open);
+    us_socket_context_on_data(SSL, http_context, on_http_socket_data);
+    us_socket_context_on_writable(SSL, http_context, on_http_socket_writable);
+    us_socket_context_on_close(SSL, http_context, on_http_socket_close);
+    us_socket_context_on_timeout(SSL, http_context, on_http_socket_timeout);
+    us_socket_context_on_end(SSL, http_context, on_http_socket_end);
+
+    /* Start making HTTP connections */
+    us_socket_context_connect(SSL, http_context, host, port, NULL, 0, sizeof(struct http_socket));
+
+    us_loop_run(loop);
+}
@@ -0,0 +1,188 @@
+/* Replays a capture (see src/TrafficCapture.h) against a server over loopback, every connection opened, written to
+ * and closed when it was in the capture, times speed. Responses are read and thrown away. Reports how late writes
+ * went out behind the capture, which grows once the server (or this replayer) falls behind:
+ *
+ * ./replay capture host port [speed = 1, 0 for as fast as possible] [-j] */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/TrafficCapture.h"
+
+struct Connection {
+    int fd = -1;
+    /* Writes not yet made with when they were due, what of the first was written */
+    std::vector<std::pair<std::string_view, uint64_t>> pending;
+    size_t offset = 0;
+    bool closing = false, shut = false;
+};
+
+static int connectTo(const char *host, const char *port) {
+    addrinfo hints = {}, *result;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &result)) {
+        return -1;
+    }
+    int fd = socket(result->ai_family, SOCK_STREAM, 0);
+    if (fd != -1 && connect(fd, result->ai_addr, result->ai_addrlen)) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd != -1) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s capture host port [speed] [-j]\n", argv[0]);
+        return 1;
+    }
+    double speed = argc > 4 && strcmp(argv[4], "-j") ? atof(argv[4]) : 1;
+    bool json = !strcmp(argv[argc - 1], "-j");
+
+    std::string capture;
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open %s!\n", argv[1]);
+        return 1;
+    }
+    char buffer[65536];
+    for (size_t length; (length = fread(buffer, 1, sizeof(buffer), file)); ) {
+        capture.append(buffer, length);
+    }
+    fclose(file);
+
+    std::string_view records = capture;
+    if (records.substr(0, uWS::TrafficCapture::MAGIC.length()) != uWS::TrafficCapture::MAGIC) {
+        fprintf(stderr, "Error: %s is not a capture!\n", argv[1]);
+        return 1;
+    }
+    records.remove_prefix(uWS::TrafficCapture::MAGIC.length());
+
+    std::vector<Connection> connections;
+    std::vector<uint64_t> lateness;
+    uint64_t bytesWritten = 0, bytesRead = 0;
+    auto began = std::chrono::steady_clock::now();
+    auto elapsed = [&]() {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - began).count();
+    };
+
+    uWS::TrafficCapture::Record record = {};
+    bool more = uWS::TrafficCapture::read(records, record);
+    for (;;) {
+        /* Everything due by now, connections opened as they come */
+        while (more && (!speed || (double) record.time / speed <= (double) elapsed())) {
+            if (record.connection >= connections.size()) {
+                connections.resize(record.connection + 1);
+            }
+            Connection &c = connections[record.connection];
+            if (record.type == uWS::TrafficCapture::OPEN) {
+                if ((c.fd = connectTo(argv[2], argv[3])) == -1) {
+                    fprintf(stderr, "Error: Could not connect to %s:%s!\n", argv[2], argv[3]);
+                    return 1;
+                }
+            } else if (c.fd != -1 && record.type == uWS::TrafficCapture::DATA) {
+                c.pending.push_back({record.data, (uint64_t) (speed ? (double) record.time / speed : 0)});
+            } else if (record.type == uWS::TrafficCapture::CLOSE) {
+                c.closing = true;
+            }
+            more = uWS::TrafficCapture::read(records, record);
+        }
+
+        /* Connections still open when the capture ended end with it */
+        if (!more) {
+            for (Connection &c : connections) {
+                c.closing = true;
+            }
+        }
+
+        /* Writes, then reads of whatever is open */
+        std::vector<pollfd> fds;
+        std::vector<Connection *> polled;
+        for (Connection &c : connections) {
+            if (c.fd == -1) {
+                continue;
+            }
+            if (c.closing && c.pending.empty() && !c.shut) {
+                shutdown(c.fd, SHUT_WR);
+                c.shut = true;
+            }
+            fds.push_back({c.fd, (short) (POLLIN | (c.pending.size() ? POLLOUT : 0)), 0});
+            polled.push_back(&c);
+        }
+        if (fds.empty() && !more) {
+            break;
+        }
+
+        int timeout = 10;
+        if (more && speed) {
+            double due = (double) record.time / speed - (double) elapsed();
+            timeout = due <= 0 ? 0 : std::min(10, (int) (due / 1000));
+        }
+        if (poll(fds.data(), fds.size(), timeout) <= 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            Connection &c = *polled[i];
+            if (fds[i].revents & POLLOUT) {
+                auto [data, due] = c.pending[0];
+                if (speed && !c.offset) {
+                    lateness.push_back(elapsed() - std::min<uint64_t>(elapsed(), due));
+                }
+                ssize_t written = write(c.fd, data.data() + c.offset, data.length() - c.offset);
+                if (written > 0) {
+                    bytesWritten += (uint64_t) written;
+                    if ((c.offset += (size_t) written) == data.length()) {
+                        c.pending.erase(c.pending.begin());
+                        c.offset = 0;
+                    }
+                }
+            }
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t got = read(c.fd, buffer, sizeof(buffer));
+                if (got > 0) {
+                    bytesRead += (uint64_t) got;
+                } else if (got == 0 || errno != EAGAIN) {
+                    /* The server closed, what it did not take is lost as it would have been */
+                    close(c.fd);
+                    c.fd = -1;
+                    c.pending.clear();
+                }
+            }
+        }
+    }
+
+    double seconds = (double) elapsed() / 1000000;
+    std::sort(lateness.begin(), lateness.end());
+    auto percentile = [&](double p) {
+        return lateness.empty() ? 0.0 : (double) lateness[std::min(lateness.size() - 1, (size_t) ((double) lateness.size() * p))] / 1000;
+    };
+
+    if (json) {
+        printf("{\"name\": \"replay\", \"unit\": \"s\", \"median\": %f}\n", seconds);
+        printf("{\"name\": \"replay write lateness p99\", \"unit\": \"ms\", \"median\": %f}\n", percentile(0.99));
+    } else {
+        printf("Replayed %zu connections, wrote %llu bytes and read %llu in %.3f seconds\n", connections.size(),
+            (unsigned long long) bytesWritten, (unsigned long long) bytesRead, seconds);
+        if (speed) {
+            printf("Writes went out late behind the capture by p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms\n",
+                percentile(0.5), percentile(0.99), percentile(0.999));
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Runs the microbenchmarks and the loopback scenarios, appending everything to one result file
+# (results/<commit>.json by default) that compare can diff against the one of another commit.
+# Needs the examples built in the root (make examples) and the load generators built here (make).
+#
+# DURATION=20 seconds per scenario, IDLE_SOCKETS=10000 (scale_test takes extra source IPs for 1M)
+
+cd "$(dirname "$0")" || exit 1
+
+OUT=${1:-results/$(git rev-parse --short HEAD).json}
+DURATION=${DURATION:-20}
+IDLE_SOCKETS=${IDLE_SOCKETS:-10000}
+
+mkdir -p "$(dirname "$OUT")"
+./suite > "$OUT" || exit 1
+
+result() {
+    if [ -n "$3" ]; then
+        printf '{"name": "%s", "unit": "%s", "median": %s}\n' "$1" "$2" "$3" >> "$OUT"
+    else
+        echo "Error: $1 reported nothing" >&2
+    fi
+}
+
+# Starts example $1 and waits for it to listen
+start_server() {
+    ../"$1" > /dev/null &
+    SERVER=$!
+    sleep 1
+}
+
+# The last rate a load generator printed in DURATION seconds
+last_rate() {
+    timeout "$DURATION" "$@" | grep -E "/sec" | tail -n 1 | awk '{print $NF}'
+}
+
+# Pipelined GET against HelloWorld
+start_server HelloWorld
+result http_pipelined_get_16 "req/s" "$(last_rate ./http_load_test 100 localhost 3000 0 16)"
+result http_get "req/s" "$(last_rate ./http_load_test 100 localhost 3000 0 1)"
+kill $SERVER
+
+# Echo of 1 kB messages, plain and compressed
+start_server EchoServer
+result ws_echo_1k "msg/s" "$(last_rate ./load_test 200 localhost 9001 0 0 1024)"
+result ws_echo_deflate "msg/s" "$(last_rate ./load_test 200 localhost 9001 0 1)"
+
+# Latency of 400 connections at 100 messages per second each, over 4 threads
+./ws_load_test -t 4 -c 400 -s 1024 -r 100 -w 2 -D "$DURATION" -j localhost 9001 | grep "^{" >> "$OUT"
+kill $SERVER
+
+# Every message to every one of 100 clients
+start_server BroadcastingEchoServer
+result ws_broadcast_100 "iterations/s" "$(last_rate ./broadcast_test 100 localhost 9001 0)"
+kill $SERVER
+
+# Memory per idle WebSocket
+start_server EchoServer
+BEFORE=$(awk '/VmRSS/ {print $2}' /proc/$SERVER/status)
+./scale_test "$IDLE_SOCKETS" localhost 9001 0 > /dev/null &
+CLIENT=$!
+sleep "$DURATION"
+AFTER=$(awk '/VmRSS/ {print $2}' /proc/$SERVER/status)
+kill $CLIENT $SERVER
+result ws_idle_memory "B/socket" "$(( (AFTER - BEFORE) * 1024 / IDLE_SOCKETS ))"
+
+cat "$OUT"
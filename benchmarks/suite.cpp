@@ -0,0 +1,291 @@
+/* This is the microbenchmark suite, one JSON object per line for compare.py to diff across commits */
+
+#define WIN32_EXPORT
+
+#include "../src/HttpParser.h"
+#include "../src/HttpRouter.h"
+#include "../src/WebSocketProtocol.h"
+#include "../src/TopicTree.h"
+#include "../src/PerMessageDeflate.h"
+#include "../src/WebSocketData.h"
+#include "../src/HttpResponseData.h"
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+
+/* Every benchmark runs ROUNDS rounds of at least ROUND_SECONDS each and we report the median of them */
+static constexpr int ROUNDS = 7;
+static constexpr double ROUND_SECONDS = 0.2;
+
+const char *filter = nullptr;
+bool failed = false;
+
+/* Runs f, which does some amount of work and returns how much, and prints work per second. False if filtered out */
+template <typename F>
+bool measure(const char *name, const char *unit, double scale, F f) {
+    if (filter && !strstr(name, filter)) {
+        return false;
+    }
+
+    std::vector<double> rates;
+    for (int round = 0; round < ROUNDS; round++) {
+        double work = 0, seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (seconds < ROUND_SECONDS) {
+            work += (double) f();
+            asm volatile("" ::: "memory");
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        rates.push_back(work / seconds / scale);
+    }
+    std::sort(rates.begin(), rates.end());
+
+    std::cout << std::fixed << "{\"name\": \"" << name << "\", \"unit\": \"" << unit << "\", \"median\": " << rates[ROUNDS / 2]
+        << ", \"min\": " << rates.front() << ", \"max\": " << rates.back() << "}" << std::endl;
+    return true;
+}
+
+void check(bool ok, const char *what) {
+    if (!ok) {
+        std::cerr << "Error: " << what << std::endl;
+        failed = true;
+    }
+}
+
+/* HTTP */
+void benchmarkHttpParser() {
+    /* Typical browser request, 16 pipelined */
+    std::string request = "GET /some/resource?q=123 HTTP/1.1\r\n"
+        "Host: server.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=0123456789abcdef0123456789abcdef\r\n\r\n";
+    std::string pipelined;
+    for (int i = 0; i < 16; i++) {
+        pipelined += request;
+    }
+    std::string buffer(pipelined.length() + 32, 'E');
+
+    uWS::HttpParser httpParser;
+    unsigned int requests = 0;
+    if (measure("http_parse_pipelined_get", "Mreq/s", 1e6, [&]() {
+        memcpy(buffer.data(), pipelined.data(), pipelined.length());
+        requests = 0;
+        httpParser.consumePostPadded(buffer.data(), (unsigned int) pipelined.length(), &httpParser, nullptr, [&requests](void *s, uWS::HttpRequest *req) -> void * {
+            requests += req->getHeader("host").length() != 0;
+            return s;
+        }, [](void *s, std::string_view, bool) -> void * {
+            return s;
+        });
+        return requests;
+    })) {
+        check(requests == 16, "http_parse_pipelined_get did not parse 16 requests");
+    }
+}
+
+void benchmarkRouter() {
+    uWS::HttpRouter<int> router;
+    unsigned int matched = 0;
+    /* A REST-ish API of 50 routes */
+    const char *resources[] = {"users", "posts", "comments", "likes", "tags", "images", "files", "groups", "events", "orders"};
+    for (const char *resource : resources) {
+        std::string base = std::string("/api/v1/") + resource;
+        router.add({"GET"}, base, [&matched](auto *) { matched++; return true; });
+        router.add({"POST"}, base, [&matched](auto *) { matched++; return true; });
+        router.add({"GET"}, base + "/:id", [&matched](auto *r) { matched += r->getParameters().first >= 0; return true; });
+        router.add({"DELETE"}, base + "/:id", [&matched](auto *) { matched++; return true; });
+        router.add({"GET"}, base + "/:id/*", [&matched](auto *) { matched++; return true; });
+    }
+
+    if (measure("router_route", "Mroutes/s", 1e6, [&]() {
+        router.route("GET", "/api/v1/orders/123");
+        router.route("POST", "/api/v1/users");
+        router.route("GET", "/api/v1/images/42/thumbnail/small");
+        router.route("DELETE", "/api/v1/likes/7");
+        return 4;
+    })) {
+        check(matched > 0, "router_route matched nothing");
+    }
+}
+
+/* WebSocket */
+struct Impl {
+    static bool refusePayloadLength(uint64_t length, uWS::WebSocketState<true> *, void *) {
+        return length > 16 * 1024 * 1024;
+    }
+
+    static bool setCompressed(uWS::WebSocketState<true> *, void *) {
+        return true;
+    }
+
+    static void forceClose(uWS::WebSocketState<true> *, void *, std::string_view = {}) {
+
+    }
+
+    static bool handleFragment(char *, size_t, unsigned int, int, bool, uWS::WebSocketState<true> *, void *user) {
+        (*(unsigned int *) user)++;
+        return false;
+    }
+};
+
+struct Kernels : uWS::WebSocketProtocol<true, Impl> {
+    using uWS::WebSocketProtocol<true, Impl>::unmaskInplace;
+};
+
+void benchmarkWebSocketParser() {
+    /* 64 masked binary frames of 1 kB */
+    std::string frame = std::string("\x82\xfe\x04\x00\x01\x02\x03\x04", 8) + std::string(1024, 'T');
+    std::string frames;
+    for (int i = 0; i < 64; i++) {
+        frames += frame;
+    }
+    std::string buffer(frames.length() + 32, 'E');
+
+    uWS::WebSocketState<true> state;
+    unsigned int messages = 0;
+    if (measure("ws_parse_1k_frames", "Mmsg/s", 1e6, [&]() {
+        memcpy(buffer.data(), frames.data(), frames.length());
+        messages = 0;
+        uWS::WebSocketProtocol<true, Impl>::consume(buffer.data(), (unsigned int) frames.length(), &state, &messages);
+        return messages;
+    })) {
+        check(messages == 64, "ws_parse_1k_frames did not parse 64 messages");
+    }
+}
+
+void benchmarkUnmask() {
+    char mask[4] = {1, 2, 3, 4};
+    std::vector<char> payload(65536 + 64, 'T');
+    measure("ws_unmask_64k", "GB/s", 1e9, [&]() {
+        Kernels::unmaskInplace(payload.data(), payload.data() + 65536, mask);
+        return 65536;
+    });
+}
+
+void benchmarkUtf8() {
+    /* Mostly ASCII with some two and three byte sequences, like most chat */
+    std::string text;
+    while (text.length() < 16384) {
+        text += "Hello world, this is mostly ASCII \xc3\xa5\xc3\xa4\xc3\xb6 and some \xe2\x82\xac signs. ";
+    }
+    bool valid = false;
+    if (measure("utf8_validate_16k", "GB/s", 1e9, [&]() {
+        valid = uWS::protocol::isValidUtf8((unsigned char *) text.data(), text.length());
+        return text.length();
+    })) {
+        check(valid, "utf8_validate_16k rejected valid text");
+    }
+}
+
+/* Pub/sub */
+void benchmarkTopicTree() {
+    for (unsigned int numSubscribers : {10u, 1000u}) {
+        unsigned int delivered = 0;
+        uWS::TopicTree<std::string, std::string_view> topicTree([&delivered](uWS::Subscriber *, std::string &, auto) {
+            delivered++;
+            return false;
+        });
+
+        /* Every subscriber in one common and one of 10 group topics */
+        std::vector<uWS::Subscriber *> subscribers;
+        for (unsigned int i = 0; i < numSubscribers; i++) {
+            uWS::Subscriber *s = topicTree.createSubscriber();
+            topicTree.subscribe(s, "all");
+            topicTree.subscribe(s, "group/" + std::to_string(i % 10));
+            subscribers.push_back(s);
+        }
+
+        std::string name = "topictree_publish_drain_" + std::to_string(numSubscribers);
+        if (measure(name.c_str(), "Mdeliveries/s", 1e6, [&]() {
+            delivered = 0;
+            for (int i = 0; i < 10; i++) {
+                topicTree.publish(nullptr, "all", "a message for everyone");
+                topicTree.publish(nullptr, "group/" + std::to_string(i), "a message for some");
+            }
+            topicTree.drain();
+            return delivered;
+        })) {
+            check(delivered == numSubscribers * 11, "topictree_publish_drain delivered the wrong amount");
+        }
+
+        for (uWS::Subscriber *s : subscribers) {
+            topicTree.freeSubscriber(s);
+        }
+    }
+}
+
+/* Compression */
+void benchmarkDeflate() {
+#ifndef UWS_NO_ZLIB
+    /* A typical JSON message of 1 kB */
+    std::string message;
+    for (int i = 0; message.length() < 1024; i++) {
+        message += "{\"id\":" + std::to_string(i) + ",\"type\":\"update\",\"price\":" + std::to_string(100 + i * 7 % 13) + ".25},";
+    }
+
+    uWS::ZlibContext zlibContext;
+    /* Like the shared streams of every loop */
+    uWS::DeflationStream deflationStream(uWS::DEDICATED_COMPRESSOR);
+    uWS::InflationStream inflationStream(uWS::DEDICATED_DECOMPRESSOR);
+    std::string compressed(deflationStream.deflate(&zlibContext, message, true));
+
+    measure("deflate_shared_1k", "MB/s", 1e6, [&]() {
+        return deflationStream.deflate(&zlibContext, message, true).length() ? message.length() : 0;
+    });
+
+    std::optional<std::string_view> inflated;
+    if (measure("inflate_shared_1k", "MB/s", 1e6, [&]() {
+        inflated = inflationStream.inflate(&zlibContext, compressed, 1024 * 1024, true);
+        return message.length();
+    })) {
+        check(inflated && *inflated == message, "inflate_shared_1k did not round trip");
+    }
+#endif
+}
+
+/* Memory, what every socket costs us before it does anything */
+void footprint(const char *name, size_t bytes) {
+    if (filter && !strstr(name, filter)) {
+        return;
+    }
+
+    std::cout << std::fixed << "{\"name\": \"" << name << "\", \"unit\": \"B/socket\", \"median\": " << (double) bytes
+        << ", \"min\": " << (double) bytes << ", \"max\": " << (double) bytes << "}" << std::endl;
+}
+
+void reportFootprint() {
+    footprint("sizeof_websocket_data", sizeof(uWS::WebSocketData));
+    footprint("sizeof_websocket_data_extension", sizeof(uWS::WebSocketDataExtension));
+    footprint("sizeof_http_response_data", sizeof(uWS::HttpResponseData<false>));
+    footprint("sizeof_backpressure", sizeof(uWS::BackPressure));
+    footprint("sizeof_subscriber", sizeof(uWS::Subscriber));
+#ifndef UWS_NO_ZLIB
+    footprint("sizeof_deflation_stream", sizeof(uWS::DeflationStream));
+    footprint("sizeof_inflation_stream", sizeof(uWS::InflationStream));
+#endif
+}
+
+int main(int argc, char **argv) {
+    /* Optionally only run benchmarks whose name contains argv[1] */
+    if (argc > 1) {
+        filter = argv[1];
+    }
+
+    benchmarkHttpParser();
+    benchmarkRouter();
+    benchmarkWebSocketParser();
+    benchmarkUnmask();
+    benchmarkUtf8();
+    benchmarkTopicTree();
+    benchmarkDeflate();
+    reportFootprint();
+
+    return failed;
+}
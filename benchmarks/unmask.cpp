@@ -0,0 +1,88 @@
+/* This is a throughput benchmark of the websocket unmasking kernels */
+
+#define WIN32_EXPORT
+
+#include "../src/WebSocketProtocol.h"
+
+#include <iostream>
+#include <chrono>
+
+/* We only reach for the static kernels, never the parser itself */
+struct Impl {};
+
+struct Kernels : uWS::WebSocketProtocol<true, Impl> {
+    using uWS::WebSocketProtocol<true, Impl>::unmaskImpreciseCopyMask;
+    using uWS::WebSocketProtocol<true, Impl>::unmaskInplace;
+};
+
+#if defined(UWS_UNMASK_DISPATCH)
+const char *kernel = uWS::CpuFeatures::get().avx512f ? "AVX-512" : (uWS::CpuFeatures::get().avx2 ? "AVX2" : "SSE2");
+#elif defined(UWS_UNMASK_SIMD_WIDTH) && defined(__AVX512F__)
+const char *kernel = "AVX-512";
+#elif defined(UWS_UNMASK_SIMD_WIDTH) && defined(__SSE2__)
+const char *kernel = "SSE2";
+#elif defined(UWS_UNMASK_SIMD_WIDTH) && defined(__ARM_NEON)
+const char *kernel = "NEON";
+#else
+const char *kernel = "scalar";
+#endif
+
+template <typename F>
+void measure(const char *name, unsigned int size, F f) {
+    /* Run for about the same amount of bytes no matter the frame size */
+    unsigned long long iterations = (4ull << 30) / size;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long i = 0; i < iterations; i++) {
+        f();
+        /* Do not let the compiler fold consecutive unmasks into each other */
+        asm volatile("" ::: "memory");
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::fixed << kernel << " " << name << " " << (size >> 10) << " kB: " << ((double) iterations * size / seconds / 1e9) << " GB/s" << std::endl;
+}
+
+int main() {
+    char mask[4] = {1, 2, 3, 4};
+
+    for (unsigned int size : {1024u, 65536u, 1048576u}) {
+        /* Room for the 14 byte header in front and imprecise overrun behind */
+        char *buffer = (char *) malloc(size + 64 + 64);
+        char *payload = buffer + 64;
+        memset(buffer, 'T', size + 64 + 64);
+
+        /* Verify against a byte-by-byte unmask first */
+        memcpy(payload - 4, mask, 4);
+        Kernels::unmaskImpreciseCopyMask<14>(payload, size);
+        for (unsigned int i = 0; i < size; i++) {
+            if ((payload - 14)[i] != ('T' ^ mask[i % 4])) {
+                std::cout << "Error: unmaskImpreciseCopyMask mismatch at " << i << std::endl;
+                return 1;
+            }
+        }
+        memset(buffer, 'T', size + 64 + 64);
+        Kernels::unmaskInplace(payload, payload + size, mask);
+        for (unsigned int i = 0; i < size; i++) {
+            if (payload[i] != ('T' ^ mask[i % 4])) {
+                std::cout << "Error: unmaskInplace mismatch at " << i << std::endl;
+                return 1;
+            }
+        }
+
+        /* Complete frames are unmasked while moved over their header */
+        measure("unmaskImpreciseCopyMask", size, [&]() {
+            memcpy(payload - 4, mask, 4);
+            Kernels::unmaskImpreciseCopyMask<14>(payload, size);
+        });
+
+        /* Continuations are unmasked in place */
+        measure("unmaskInplace", size, [&]() {
+            Kernels::unmaskInplace(payload, payload + size, mask);
+        });
+
+        free(buffer);
+    }
+
+    return 0;
+}
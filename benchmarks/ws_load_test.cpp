@@ -0,0 +1,484 @@
+/* This is a multi threaded WebSocket load generator reporting latency percentiles, much like WRK2.
+ *
+ * Every thread runs its own loop over its share of the connections. Messages carry the time they were meant to be sent
+ * at, not the time they were sent, so with a fixed rate (-r) a stalled server is charged for every message it held up
+ * (coordinated omission). Without a rate every publisher sends its next message as soon as it has its previous back.
+ *
+ * Sockets are SO_REUSEPORT and IP_BIND_ADDRESS_NO_PORT, optionally bound round robin to source addresses (-b),
+ * so that many source addresses take us past the 64k ephemeral ports of one. In pubsub mode (-p) only the first
+ * fraction of connections publish while all of them count what they receive, against a server publishing
+ * whatever it gets to everyone. */
+
+#include <libusockets.h>
+
+#include "../src/Metrics.h"
+#ifndef UWS_NO_ZLIB
+#include "../src/PerMessageDeflate.h"
+#endif
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+const int SSL = 0;
+
+/* Options */
+const char *host;
+int port;
+int threads = 1;
+int connections = 100;
+unsigned int messageSize = 64;
+double rate = 0;
+double publisherFraction = 1;
+bool useDeflate = false;
+int warmupSeconds = 5;
+int durationSeconds = 20;
+bool json = false;
+std::vector<sockaddr_storage> sourceAddresses;
+
+sockaddr_storage serverAddress;
+socklen_t serverAddressLength;
+
+/* Set once every thread is connected */
+std::atomic<int> readyThreads{0};
+std::atomic<uint64_t> startTime{0};
+
+uint64_t nanoseconds() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+struct Connection {
+    bool upgraded;
+    bool compressed;
+    bool publisher;
+    /* When the next message is meant to go out, and when the last one was */
+    uint64_t nextSend;
+    uint64_t lastSent;
+    /* Partial frames, whatever we could not write yet */
+    std::string *received;
+    std::string *unsent;
+};
+
+struct Worker {
+    int id;
+    us_loop_t *loop;
+    us_socket_context_t *context;
+    us_timer_t *timer;
+    std::vector<us_socket_t *> sockets;
+
+    uint64_t measureStart, measureEnd;
+    uint64_t interval;
+
+    /* What we measured */
+    uint64_t histogram[uWS::HistogramBuckets::NUM_BUCKETS] = {};
+    uint64_t received = 0, sent = 0, maxLatency = 0;
+
+#ifndef UWS_NO_ZLIB
+    uWS::ZlibContext zlibContext;
+    uWS::DeflationStream deflationStream{uWS::DEDICATED_COMPRESSOR};
+    uWS::InflationStream inflationStream{uWS::DEDICATED_DECOMPRESSOR};
+#endif
+
+    std::string payload;
+};
+
+thread_local Worker *worker;
+
+const char upgradeRequest[] = "GET / HTTP/1.1\r\n"
+                              "Upgrade: websocket\r\n"
+                              "Connection: Upgrade\r\n"
+                              "Sec-WebSocket-Key: x3JJHMbDL1EzLkh9GBhXDw==\r\n"
+                              "Host: server.example.com\r\n"
+                              "Sec-WebSocket-Version: 13\r\n";
+
+/* Shared compressor and decompressor on both ends, the way most servers run */
+const char deflateExtension[] = "Sec-WebSocket-Extensions: permessage-deflate; client_no_context_takeover; server_no_context_takeover\r\n";
+
+void flush(us_socket_t *s) {
+    Connection *c = (Connection *) us_socket_ext(SSL, s);
+    int written = us_socket_write(SSL, s, c->unsent->data(), (int) c->unsent->length(), 0);
+    c->unsent->erase(0, (size_t) (written > 0 ? written : 0));
+}
+
+void sendMessage(us_socket_t *s, uint64_t intendedTime) {
+    Connection *c = (Connection *) us_socket_ext(SSL, s);
+
+    /* Timestamp followed by filler */
+    memcpy(worker->payload.data(), &intendedTime, 8);
+    std::string_view payload = worker->payload;
+#ifndef UWS_NO_ZLIB
+    if (c->compressed) {
+        payload = worker->deflationStream.deflate(&worker->zlibContext, payload, true);
+    }
+#endif
+
+    /* Masked with a zero key, which leaves the payload as is */
+    char header[14] = {(char) (c->compressed ? 0xc2 : 0x82)};
+    size_t headerLength;
+    if (payload.length() < 126) {
+        header[1] = (char) (0x80 | payload.length());
+        headerLength = 6;
+    } else if (payload.length() < 65536) {
+        header[1] = (char) (0x80 | 126);
+        header[2] = (char) (payload.length() >> 8);
+        header[3] = (char) payload.length();
+        headerLength = 8;
+    } else {
+        header[1] = (char) (0x80 | 127);
+        for (int i = 0; i < 8; i++) {
+            header[2 + i] = (char) (payload.length() >> (56 - 8 * i));
+        }
+        headerLength = 14;
+    }
+
+    c->lastSent = intendedTime;
+    c->unsent->append(header, headerLength);
+    c->unsent->append(payload.data(), payload.length());
+    if (c->unsent->length() == headerLength + payload.length()) {
+        flush(s);
+    }
+    worker->sent++;
+}
+
+void record(uint64_t intendedTime) {
+    uint64_t now = nanoseconds();
+    if (intendedTime < worker->measureStart || now > worker->measureEnd) {
+        return;
+    }
+    uint64_t latency = now > intendedTime ? now - intendedTime : 0;
+    worker->histogram[uWS::HistogramBuckets::index(latency)]++;
+    worker->received++;
+    if (latency > worker->maxLatency) {
+        worker->maxLatency = latency;
+    }
+}
+
+/* Parses whatever whole frames the server sent us */
+void consumeFrames(us_socket_t *s) {
+    Connection *c = (Connection *) us_socket_ext(SSL, s);
+    std::string &buffer = *c->received;
+
+    size_t offset = 0;
+    while (buffer.length() - offset >= 2) {
+        unsigned char *frame = (unsigned char *) buffer.data() + offset;
+        uint64_t length = frame[1] & 127;
+        size_t headerLength = 2;
+        if (length == 126) {
+            headerLength = 4;
+        } else if (length == 127) {
+            headerLength = 10;
+        }
+        if (buffer.length() - offset < headerLength) {
+            break;
+        }
+        if (headerLength == 4) {
+            length = (uint64_t) frame[2] << 8 | frame[3];
+        } else if (headerLength == 10) {
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = length << 8 | frame[2 + i];
+            }
+        }
+        if (buffer.length() - offset < headerLength + length) {
+            break;
+        }
+
+        std::string_view payload((char *) frame + headerLength, length);
+        unsigned int opCode = frame[0] & 15;
+        if (opCode == 1 || opCode == 2) {
+#ifndef UWS_NO_ZLIB
+            if (frame[0] & 0x40) {
+                std::optional<std::string_view> inflated = worker->inflationStream.inflate(&worker->zlibContext, payload, 16 * 1024 * 1024, true);
+                payload = inflated.value_or(std::string_view());
+            }
+#endif
+            if (payload.length() >= 8) {
+                uint64_t intendedTime;
+                memcpy(&intendedTime, payload.data(), 8);
+                record(intendedTime);
+
+                /* Closed loop, the next one goes out as soon as we have our own back */
+                if (rate == 0 && c->publisher && intendedTime == c->lastSent) {
+                    sendMessage(s, nanoseconds());
+                }
+            }
+        }
+        offset += headerLength + length;
+    }
+    buffer.erase(0, offset);
+}
+
+us_socket_t *onData(us_socket_t *s, char *data, int length) {
+    Connection *c = (Connection *) us_socket_ext(SSL, s);
+    c->received->append(data, (size_t) length);
+
+    if (!c->upgraded) {
+        size_t end = c->received->find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return s;
+        }
+        c->compressed = useDeflate && c->received->substr(0, end).find("permessage-deflate") != std::string::npos;
+        c->received->erase(0, end + 4);
+        c->upgraded = true;
+
+        /* Spread the first messages over one interval */
+        uint64_t now = nanoseconds();
+        c->nextSend = now + (worker->interval ? (uint64_t) rand() % worker->interval : 0);
+        if (rate == 0 && c->publisher) {
+            sendMessage(s, now);
+        }
+    }
+
+    consumeFrames(s);
+    return s;
+}
+
+us_socket_t *onWritable(us_socket_t *s) {
+    flush(s);
+    return s;
+}
+
+us_socket_t *onClose(us_socket_t *s, int /*code*/, void * /*reason*/) {
+    Connection *c = (Connection *) us_socket_ext(SSL, s);
+    delete c->received;
+    delete c->unsent;
+
+    auto it = std::find(worker->sockets.begin(), worker->sockets.end(), s);
+    if (it != worker->sockets.end()) {
+        worker->sockets.erase(it);
+    }
+    return s;
+}
+
+us_socket_t *onEnd(us_socket_t *s) {
+    return us_socket_close(SSL, s, 0, nullptr);
+}
+
+us_socket_t *onOpen(us_socket_t *s, int, char *, int) {
+    return s;
+}
+
+/* Every millisecond, sends whatever is due and ends the run */
+void onTick(us_timer_t * /*t*/) {
+    uint64_t now = nanoseconds();
+    if (now > worker->measureEnd) {
+        std::vector<us_socket_t *> sockets = std::move(worker->sockets);
+        for (us_socket_t *s : sockets) {
+            us_socket_close(SSL, s, 0, nullptr);
+        }
+        us_timer_close(worker->timer);
+        return;
+    }
+
+    if (rate) {
+        for (us_socket_t *s : worker->sockets) {
+            Connection *c = (Connection *) us_socket_ext(SSL, s);
+            if (!c->upgraded || !c->publisher) {
+                continue;
+            }
+            /* Behind or not, every message keeps its place in the schedule */
+            while (c->nextSend <= now) {
+                sendMessage(s, c->nextSend);
+                c->nextSend += worker->interval;
+            }
+        }
+    }
+}
+
+int connectSocket(int index) {
+    int fd = socket(serverAddress.ss_family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    int enabled = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+#ifdef IP_BIND_ADDRESS_NO_PORT
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &enabled, sizeof(enabled));
+#endif
+    if (sourceAddresses.size()) {
+        sockaddr_storage &source = sourceAddresses[(size_t) index % sourceAddresses.size()];
+        if (bind(fd, (sockaddr *) &source, source.ss_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in))) {
+            close(fd);
+            return -1;
+        }
+    }
+    if (connect(fd, (sockaddr *) &serverAddress, serverAddressLength)) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+void noop(us_loop_t *) {
+
+}
+
+void run(Worker *w) {
+    worker = w;
+    w->loop = us_create_loop(nullptr, noop, noop, noop, 0);
+    w->context = us_create_socket_context(SSL, w->loop, 0, {});
+    us_socket_context_on_open(SSL, w->context, onOpen);
+    us_socket_context_on_data(SSL, w->context, onData);
+    us_socket_context_on_writable(SSL, w->context, onWritable);
+    us_socket_context_on_close(SSL, w->context, onClose);
+    us_socket_context_on_end(SSL, w->context, onEnd);
+
+    w->payload.assign(messageSize, 'T');
+    w->interval = rate ? (uint64_t) (1e9 / rate) : 0;
+
+    /* Our share of the connections, publishers first */
+    int from = connections * w->id / threads, to = connections * (w->id + 1) / threads;
+    std::string request = std::string(upgradeRequest) + (useDeflate ? deflateExtension : "") + "\r\n";
+    for (int i = from; i < to; i++) {
+        int fd = connectSocket(i);
+        if (fd == -1) {
+            perror("Connection failed");
+            continue;
+        }
+        us_socket_t *s = us_adopt_accepted_socket(SSL, w->context, fd, sizeof(Connection), nullptr, 0);
+        Connection *c = (Connection *) us_socket_ext(SSL, s);
+        *c = {false, false, i < (int) (connections * publisherFraction + 0.5), 0, 0, new std::string, new std::string(request)};
+        flush(s);
+        w->sockets.push_back(s);
+    }
+
+    /* Everyone starts at the same time */
+    readyThreads++;
+    while (!startTime) {
+        std::this_thread::yield();
+    }
+    w->measureStart = startTime + (uint64_t) warmupSeconds * 1000000000ull;
+    w->measureEnd = w->measureStart + (uint64_t) durationSeconds * 1000000000ull;
+
+    w->timer = us_create_timer(w->loop, 0, 0);
+    us_timer_set(w->timer, onTick, 1, 1);
+    us_loop_run(w->loop);
+    us_socket_context_free(SSL, w->context);
+}
+
+bool parseAddress(const char *name, int port, sockaddr_storage *address, socklen_t *length) {
+    addrinfo hints = {}, *result;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(name, std::to_string(port).c_str(), &hints, &result)) {
+        return false;
+    }
+    memcpy(address, result->ai_addr, result->ai_addrlen);
+    *length = result->ai_addrlen;
+    freeaddrinfo(result);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:s:r:p:dw:D:b:j")) != -1) {
+        switch (opt) {
+        case 't': threads = atoi(optarg); break;
+        case 'c': connections = atoi(optarg); break;
+        case 's': messageSize = (unsigned int) atoi(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'p': publisherFraction = atof(optarg); break;
+        case 'd': useDeflate = true; break;
+        case 'w': warmupSeconds = atoi(optarg); break;
+        case 'D': durationSeconds = atoi(optarg); break;
+        case 'b': {
+            sockaddr_storage source;
+            socklen_t length;
+            if (!parseAddress(optarg, 0, &source, &length)) {
+                printf("Error: bad source address %s\n", optarg);
+                return 1;
+            }
+            sourceAddresses.push_back(source);
+            break;
+        }
+        case 'j': json = true; break;
+        default: optind = argc + 1;
+        }
+    }
+    if (optind + 2 != argc) {
+        printf("Usage: ws_load_test [-t threads] [-c connections] [-s message_size] [-r messages_per_second_per_publisher]\n"
+               "                    [-p publisher_fraction] [-d (deflate)] [-w warmup_seconds] [-D duration_seconds]\n"
+               "                    [-b source_address ...] [-j (JSON)] host port\n");
+        return 0;
+    }
+    host = argv[optind];
+    port = atoi(argv[optind + 1]);
+    if (messageSize < 8) {
+        messageSize = 8;
+    }
+#ifdef UWS_NO_ZLIB
+    useDeflate = false;
+#endif
+    if (!parseAddress(host, port, &serverAddress, &serverAddressLength)) {
+        printf("Error: cannot resolve %s\n", host);
+        return 1;
+    }
+
+    std::vector<Worker *> workers;
+    std::vector<std::thread> running;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(new Worker);
+        workers.back()->id = i;
+        running.emplace_back(run, workers.back());
+    }
+    while (readyThreads != threads) {
+        std::this_thread::yield();
+    }
+    printf("Running benchmark now...\n");
+    startTime = nanoseconds();
+    for (std::thread &t : running) {
+        t.join();
+    }
+
+    /* Merge what every thread measured */
+    uint64_t histogram[uWS::HistogramBuckets::NUM_BUCKETS] = {}, received = 0, sent = 0, maxLatency = 0;
+    for (Worker *w : workers) {
+        for (unsigned int i = 0; i < uWS::HistogramBuckets::NUM_BUCKETS; i++) {
+            histogram[i] += w->histogram[i];
+        }
+        received += w->received;
+        sent += w->sent;
+        maxLatency = std::max(maxLatency, w->maxLatency);
+        delete w;
+    }
+
+    auto percentile = [&](double fraction) {
+        uint64_t wanted = (uint64_t) ((double) received * fraction), seen = 0;
+        for (unsigned int i = 0; i < uWS::HistogramBuckets::NUM_BUCKETS; i++) {
+            seen += histogram[i];
+            if (seen > wanted) {
+                return (double) uWS::HistogramBuckets::lowestValue(i + 1) / 1000;
+            }
+        }
+        return 0.0;
+    };
+
+    double messagesPerSecond = (double) received / durationSeconds;
+    if (json) {
+        printf("{\"name\": \"ws_load_messages\", \"unit\": \"msg/s\", \"median\": %f}\n", messagesPerSecond);
+        printf("{\"name\": \"ws_load_latency_p50\", \"unit\": \"us\", \"median\": %f}\n", percentile(0.5));
+        printf("{\"name\": \"ws_load_latency_p99\", \"unit\": \"us\", \"median\": %f}\n", percentile(0.99));
+        printf("{\"name\": \"ws_load_latency_p999\", \"unit\": \"us\", \"median\": %f}\n", percentile(0.999));
+    } else {
+        printf("Msg/sec: %f (sent %llu in total)\n", messagesPerSecond, (unsigned long long) sent);
+        printf("Latency p50: %.1f us, p99: %.1f us, p99.9: %.1f us, max: %.1f us\n", percentile(0.5), percentile(0.99), percentile(0.999), (double) maxLatency / 1000);
+    }
+    return 0;
+}
@@ -10,7 +10,10 @@ int main(int argc, char **argv) {
     char *EXEC_SUFFIX = strncpy(calloc(1024, 1), maybe(getenv("EXEC_SUFFIX")), 1024);
 
     char *EXAMPLE_FILES[] = {"Precompress", "EchoBody", "HelloWorldThreaded", "Http3Server", "Broadcast", "HelloWorld", "Crc32", "ServerName",
-    "EchoServer", "BroadcastingEchoServer", "UpgradeSync", "UpgradeAsync", "ParameterRoutes"};
+    "EchoServer", "BroadcastingEchoServer", "UpgradeSync", "UpgradeAsync", "ParameterRoutes", "EchoBodyCoroutine", "Client", "HttpClient", "HttpProxy", "Http2Server"};
+
+    /* These are all about pub/sub, so they are left out of builds without it */
+    char *PUBSUB_EXAMPLE_FILES[] = {"Broadcast", "BroadcastingEchoServer"};
 
     strcat(CXXFLAGS, " -march=native -O3 -Wpedantic -Wall -Wextra -Wsign-conversion -Wconversion -std=c++20 -Isrc -IuSockets/src");
     strcat(LDFLAGS, " uSockets/*.o");
@@ -27,11 +30,46 @@ int main(int argc, char **argv) {
         strcat(CXXFLAGS, " -DUWS_NO_ZLIB");
     }
 
-    // WITH_PROXY enables PROXY Protocol v2 support
+    // WITH_BROTLI=1 and WITH_ZSTD=1 add br and zstd to the HTTP body compression of App::compress
+    if (env_is("WITH_BROTLI", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_BROTLI");
+        strcat(LDFLAGS, " -lbrotlienc");
+    }
+
+    if (env_is("WITH_ZSTD", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_ZSTD");
+        strcat(LDFLAGS, " -lzstd");
+    }
+
+    // WITH_PUBSUB=0 and WITH_SNI=0 leave out WebSocket pub/sub and server name routing, checks on the hot paths included
+    if (env_is("WITH_PUBSUB", "0")) {
+        strcat(CXXFLAGS, " -DUWS_NO_PUBSUB");
+    }
+
+    if (env_is("WITH_SNI", "0")) {
+        strcat(CXXFLAGS, " -DUWS_NO_SNI");
+    }
+
+    // WITH_PROXY enables PROXY Protocol v1 and v2 support
     if (env_is("WITH_PROXY", "1")) {
         strcat(CXXFLAGS, " -DUWS_WITH_PROXY");
     }
 
+    // WITH_METRICS=1 keeps per loop counters, see Loop::getMetrics
+    if (env_is("WITH_METRICS", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_METRICS");
+    }
+
+    // WITH_CAPTURE=1 can record what clients send for benchmarks to replay, see Loop::startCapture
+    if (env_is("WITH_CAPTURE", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_CAPTURE");
+    }
+
+    // WITH_NUMA=1 binds the arena of every loop to the NUMA node it runs on, see LoopArena
+    if (env_is("WITH_NUMA", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_NUMA");
+    }
+
     // WITH_QUIC enables experimental Http3 examples
     if (env_is("WITH_QUIC", "1")) {
         strcat(CXXFLAGS, " -DLIBUS_USE_QUIC");
@@ -55,6 +93,23 @@ int main(int argc, char **argv) {
         }
     }
 
+    // WITH_KTLS=1 hands TLS encryption to the Linux kernel after the handshake (TLS 1.2 with WITH_BORINGSSL=1, or
+    // whatever OpenSSL 3 offloads by itself with WITH_OPENSSL=1)
+    if (env_is("WITH_KTLS", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_KTLS");
+        if (env_is("WITH_BORINGSSL", "1")) {
+            strcat(CXXFLAGS, " -I uSockets/boringssl/include");
+        }
+    }
+
+    // WITH_SESSION_CACHE=1 shares TLS sessions and ticket keys between all SSLApps of the process, see TlsSessionCache
+    if (env_is("WITH_SESSION_CACHE", "1")) {
+        strcat(CXXFLAGS, " -DUWS_WITH_SESSION_CACHE");
+        if (env_is("WITH_BORINGSSL", "1")) {
+            strcat(CXXFLAGS, " -I uSockets/boringssl/include");
+        }
+    }
+
     // WITH_LIBUV=1 builds with libuv as event-loop
     if (env_is("WITH_LIBUV", "1")) {
         strcat(LDFLAGS, " -luv");
@@ -75,6 +130,13 @@ int main(int argc, char **argv) {
     if (!strcmp(argv[1], "examples")) {
         #pragma omp parallel for
         for (int i = 0; i < sizeof(EXAMPLE_FILES) / sizeof(char *); i++) {
+            int pubsub = 0;
+            for (int j = 0; j < sizeof(PUBSUB_EXAMPLE_FILES) / sizeof(char *); j++) {
+                pubsub |= !strcmp(EXAMPLE_FILES[i], PUBSUB_EXAMPLE_FILES[j]);
+            }
+            if (pubsub && env_is("WITH_PUBSUB", "0")) {
+                continue;
+            }
             if (run("%s %s examples/%s.cpp %s -o %s%s", CXX, CXXFLAGS, EXAMPLE_FILES[i], LDFLAGS, EXAMPLE_FILES[i], EXEC_SUFFIX)) {
                 exit(-1);
             }
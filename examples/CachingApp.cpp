@@ -1,18 +1,22 @@
-#include "App.h"
+#include "CachingApp.h"
 #include <iostream>
 
 int main() {
-    uWS::App app;
+    uWS::CachingApp<false> app;
 
     /* Regular, non-cached response */
     app.get("/not-cached", [](auto *res, auto */*req*/) {
         res->end("Responding without a cache");
-    }).get("/*", [](auto *res, auto */*req*/) {
-        /* A cached response with 5 seconds of lifetime */
+    });
+
+    /* A cached response with 5 seconds of lifetime */
+    app.get("/*", [](auto *res, auto */*req*/) {
         std::cout << "Filling cache now" << std::endl;
         res->end("This is a response");
-    }, 5).listen(8080, [](bool success) {
-        if (success) {
+    }, 5);
+
+    app.listen(8080, [](auto *listenSocket) {
+        if (listenSocket) {
             std::cout << "Listening on port 8080" << std::endl;
         } else {
             std::cerr << "Failed to listen on port 8080" << std::endl;
@@ -1,23 +1,34 @@
-// This example is broken and doesn't do anything. It is a potential interface for a future potential client.
-// There is no client support implemented in the library. This example is a placeholder.
+/* Opens 100 connections to the EchoServer example, echoing back whatever comes back.
+ * Every connection reconnects on its own if the server goes away */
 
 #include "ClientApp.h"
 #include <iostream>
 
 int main() {
-    uWS::ClientApp app({
-        .open = [](/*auto *ws*/) {
-            std::cout << "Hello and welcome to client" << std::endl;
-        },
-        .message = [](/*auto *ws, auto message*/) {
+    struct PerSocketData {
+        unsigned int messages = 0;
+    };
 
+    uWS::TemplatedClientApp<false, PerSocketData> app({
+        .compression = uWS::SHARED_COMPRESSOR,
+        .open = [](auto *ws) {
+            ws->send("Hello and welcome to client", uWS::OpCode::TEXT);
+        },
+        .message = [](auto *ws, std::string_view message, uWS::OpCode opCode) {
+            if (++ws->getUserData()->messages % 100000 == 0) {
+                std::cout << "Echoed " << ws->getUserData()->messages << " messages" << std::endl;
+            }
+            ws->send(message, opCode, true);
+        },
+        .close = [](auto */*ws*/, int code, std::string_view /*message*/) {
+            std::cout << "Lost a connection with code " << code << std::endl;
         },
-        .close = [](/*auto *ws*/) {
-            std::cout << "bye" << std::endl;
+        .failed = [](std::string_view url, unsigned int attempts) {
+            std::cout << "Failed to connect to " << url << " (" << attempts << " attempts)" << std::endl;
         }
     });
-    
-    app.connect("ws://localhost:3000", "protocol");
-    
+
+    app.connect("ws://localhost:9001", "", 100);
+
     app.run();
 }
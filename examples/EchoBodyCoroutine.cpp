@@ -0,0 +1,31 @@
+#include "App.h"
+
+/* The EchoBody example written as a C++20 coroutine. Every await suspends the handler until
+ * the body is read or the socket becomes writable again, aborted responses resume with nothing. */
+
+int main() {
+
+    uWS::App().any("/*", [](auto *res, auto */*req*/) -> uWS::Task {
+        /* The request is only valid until we first suspend, copy what you need before this */
+        std::optional<std::string> body = co_await res->readBody();
+        if (!body) {
+            co_return;
+        }
+
+        /* Large bodies may not fit in the socket, continue from where the client stopped taking them */
+        auto [ok, done] = res->tryEnd(*body);
+        while (!ok && !done) {
+            std::optional<uintmax_t> offset = co_await res->writable();
+            if (!offset) {
+                co_return;
+            }
+            std::tie(ok, done) = res->tryEnd(std::string_view(*body).substr((size_t) *offset), body->length());
+        }
+    }).listen(3000, [](auto *listen_socket) {
+        if (listen_socket) {
+            std::cerr << "Listening on port " << 3000 << std::endl;
+        }
+    }).run();
+
+    std::cout << "Failed to listen on port 3000" << std::endl;
+}
@@ -20,5 +20,8 @@ int main() {
                 std::cout << "Thread " << std::this_thread::get_id() << " failed to listen on port 3000" << std::endl;
             }
         });
-    });
+    },
+    /* Let the kernel spread connections over all threads (SO_REUSEPORT), or hand them off in user space
+     * with uWS::LocalCluster<>::ROUND_ROBIN or uWS::LocalCluster<>::LEAST_CONNECTIONS */
+    uWS::LocalCluster<>::REUSE_PORT);
 }
@@ -0,0 +1,39 @@
+/* Do not rely on this API, it will change */
+#include "Http2App.h"
+#include <iostream>
+
+/* This is an example serving HTTP/2 with prior knowledge (h2c), such as behind a TLS terminator negotiating h2.
+ * Try it with: curl --http2-prior-knowledge http://localhost:3000/ */
+int main() {
+
+    uWS::H2App().get("/*", [](auto *res, auto */*req*/) {
+        res->writeHeader("Content-Type", "text/html; charset=utf-8")->end("<html><h1>Welcome to HTTP/2!</h1></html>");
+    }).get("/stream/:count", [](auto *res, auto *req) {
+        /* Every stream is flow controlled on its own, what does not fit is held back until the client reads */
+        int count = std::max(std::atoi(std::string(req->getParameter(0)).c_str()), 0);
+        for (int i = 0; i < count; i++) {
+            res->write("Hello from one of many streams of the same connection!\n");
+        }
+        res->end();
+    }).post("/*", [](auto *res, auto */*req*/) {
+
+        /* Echo back the posted body */
+        res->onData([res, body = std::string()](std::string_view chunk, bool isLast) mutable {
+            body.append(chunk);
+            if (isLast) {
+                res->end(body);
+            }
+        });
+
+        /* If you have pending, asynch work, you should abort such work in this callback */
+        res->onAborted([]() {
+            std::cout << "Stream was aborted!" << std::endl;
+        });
+    }).listen(3000, [](auto *listen_socket) {
+        if (listen_socket) {
+            std::cout << "HTTP/2 server listening on port " << 3000 << std::endl;
+        }
+    }).run();
+
+    std::cout << "Failed to listen on port 3000" << std::endl;
+}
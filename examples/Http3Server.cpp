@@ -5,8 +5,11 @@
 #include <iostream>
 #include <fstream>
 
-/* This is an example serving a video over HTTP3, and echoing posted data back */
+/* This is an example serving a video over HTTP3, echoing posted data back and relaying game state
+ * between WebTransport sessions */
 /* Todo: use onWritable and tryEnd instead of end */
+struct PerSessionData {};
+
 int main() {
 
     /* Read video file to memory */
@@ -80,6 +83,19 @@ int main() {
              * so that nothing will call res->end, since the request was aborted and deleted */
             printf("Stream was aborted!\n");
         });
+    }).webtransport<PerSessionData>("/game", {
+        /* Game state is latest-wins, messages that do not fit are dropped instead of queued */
+        .maxBackpressure = 16 * 1024,
+        .open = [](auto *session) {
+            session->subscribe("state");
+        },
+        .message = [](auto *session, std::string_view message) {
+            /* Everyone else in the game gets it too */
+            session->publish("state", message);
+        },
+        .close = [](auto */*session*/, int /*code*/, std::string_view /*reason*/) {
+            /* Sessions leave their topics by themselves */
+        }
     }).listen(9004, [](auto *listen_socket) {
         if (listen_socket) {
             std::cout << "HTTP/3 server Listening on port " << 9004 << std::endl;
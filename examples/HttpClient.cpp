@@ -0,0 +1,34 @@
+#include "App.h"
+#include "HttpClient.h"
+
+/* Answers every request with what an upstream server answers for the same path, asked for on the same
+ * loop. Connections to the upstream are kept open and reused, so a busy proxy opens a handful at most */
+
+int main() {
+    uWS::HttpClient client;
+
+    uWS::App().get("/*", [&client](auto *res, auto *req) -> uWS::Task {
+        /* The request is only valid until we first suspend, copy what you need before this */
+        std::string url = "http://localhost:3000" + std::string(req->getFullUrl());
+
+        bool aborted = false;
+        res->onAborted([&aborted]() {
+            aborted = true;
+        });
+
+        uWS::HttpClientResponse response = co_await client.fetch("GET", url);
+        if (aborted) {
+            co_return;
+        }
+
+        if (response.error != uWS::HttpClientResponse::NONE) {
+            res->writeStatus("502 Bad Gateway")->end("Upstream failed");
+            co_return;
+        }
+        res->writeStatus(std::to_string(response.status) + " ")->end(response.body);
+    }).listen(8000, [](auto *listen_socket) {
+        if (listen_socket) {
+            std::cout << "Listening on port " << 8000 << ", proxying to port 3000" << std::endl;
+        }
+    }).run();
+}
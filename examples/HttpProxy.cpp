@@ -0,0 +1,17 @@
+#include "App.h"
+#include "HttpProxy.h"
+
+/* A reverse proxy in front of port 3000, keeping its own static files. Bodies stream through as they come,
+ * in both directions, without ever being buffered whole */
+
+int main() {
+    uWS::HttpProxy proxy("http://localhost:3000", {.maxConnections = 32});
+
+    uWS::App().get("/health", [](auto *res, auto */*req*/) {
+        res->end("ok");
+    }).any("/*", proxy.handler()).listen(8000, [](auto *listen_socket) {
+        if (listen_socket) {
+            std::cout << "Listening on port " << 8000 << ", proxying to port 3000" << std::endl;
+        }
+    }).run();
+}
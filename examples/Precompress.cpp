@@ -44,10 +44,12 @@ int main() {
             m.lock();
             ws->sendPrepared(preparedMessage);
 
+#ifndef UWS_NO_PUBSUB
             /* Using publish should also take preparedMessage */
             ws->subscribe("test");
             app.publishPrepared("test", preparedMessage);
             ws->unsubscribe("test");
+#endif
 
             m.unlock();
         },
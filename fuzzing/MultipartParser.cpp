@@ -56,6 +56,30 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
         }
     }
 
+    /* The streaming parser must agree with itself no matter how the body is split, first body byte is the chunk size */
+    uWS::MultipartStreamParser msp(contentType, [](std::pair<std::string_view, std::string_view> *headers) {
+        for (int i = 0; headers[i].first.length(); i++) {
+            if (headers[i].first == "content-disposition") {
+                uWS::ParameterParser pp(headers[i].second);
+                while (pp.getKeyValue().first.length());
+            }
+        }
+    }, [](std::string_view data, bool /*last*/) {
+        if (data.length()) {
+            /* Touch the data */
+            volatile char c = data[data.length() - 1];
+            (void) c;
+        }
+    });
+    if (msp.isValid() && body.length()) {
+        size_t chunkSize = (unsigned char) body[0] + 1u;
+        for (size_t i = 0; i < body.length(); i += chunkSize) {
+            if (!msp.consume(body.substr(i, chunkSize), i + chunkSize >= body.length())) {
+                break;
+            }
+        }
+    }
+
     free(mutableMemory);
     return 0;
 }
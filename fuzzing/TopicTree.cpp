@@ -90,7 +90,7 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
                 if (it != subscribers.end()) {
                     std::vector<std::string> topics;
                     for (auto *topic : it->second->topics) {
-                        topics.push_back(topic->name);
+                        topics.emplace_back(topic->name);
                     }
 
                     for (std::string &topic : topics) {
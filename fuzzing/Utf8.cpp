@@ -0,0 +1,32 @@
+/* This is a differential fuzz test of the vectorized Utf-8 validator against the scalar one */
+
+#define WIN32_EXPORT
+
+#include "../src/WebSocketProtocol.h"
+
+#include <cstdlib>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+
+    /* Copy to a buffer of exactly this size so that any overread is caught by the sanitizer */
+    unsigned char *copy = (unsigned char *) malloc(size + 1);
+    if (size) {
+        memcpy(copy, data, size);
+    }
+
+    /* Test every suffix starting within the first block so that all block alignments are hit */
+    for (size_t offset = 0; offset <= size && offset < 64; offset++) {
+        bool valid = uWS::protocol::isValidUtf8Scalar(copy + offset, size - offset);
+#ifdef UWS_UTF8_SIMD_WIDTH
+        if (uWS::protocol::isValidUtf8Simd(copy + offset, size - offset) != valid) {
+            abort();
+        }
+#endif
+        if (uWS::protocol::isValidUtf8(copy + offset, size - offset) != valid) {
+            abort();
+        }
+    }
+
+    free(copy);
+    return 0;
+}
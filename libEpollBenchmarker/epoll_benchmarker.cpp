@@ -3,38 +3,286 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include <sys/timerfd.h>
 #include <sys/epoll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <errno.h>
 
+#include <string>
+#include <vector>
+
+#include "TrafficCapture.h"
+
+/* Wraps the syscalls uSockets makes (see the --wrap flags of the Makefile) so that whatever server we are linked
+ * with runs against virtual sockets, never entering the kernel. Set up with environment variables:
+ *
+ * UWS_BENCH_SOCKETS       virtual sockets (10)
+ * UWS_BENCH_WORKLOAD      http, ws (echo), pubsub (http) or replay
+ * UWS_BENCH_CAPTURE       with replay, the capture (see TrafficCapture.h) whose connections the sockets play one after
+ *                         another, every read as captured but as fast as the server takes them
+ * UWS_BENCH_PIPELINE      requests or messages per read (1)
+ * UWS_BENCH_MESSAGE_SIZE  payload of WebSocket messages (20)
+ * UWS_BENCH_PUBLISHERS    with pubsub, one in this many sockets sends messages, the rest only receive (10)
+ * UWS_BENCH_COMPRESS      offer permessage-deflate (0)
+ * UWS_BENCH_WRITE_LIMIT   most bytes a send takes, less builds backpressure, 0 takes everything (0)
+ * UWS_BENCH_BLOCK_EVERY   one in this many sends takes nothing (EAGAIN), 0 for none (0)
+ * UWS_BENCH_ROUNDS        rounds (polls of every socket) to warm up, then as many to measure, 0 runs forever (0)
+ *
+ * A server defining bench_warm and bench_done (harness.cpp) is called when warmed up and when done, with how
+ * many requests or messages it got since, reads with replay. Any other server prints requests per second, every
+ * million of them */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#define NUM_SOCKETS 10
-uint64_t listen_socket_epoll_data = 0;
-epoll_event ready_events[NUM_SOCKETS] = {};
+void bench_warm(void) __attribute__((weak));
+void bench_done(uint64_t requests) __attribute__((weak));
+
+/* The listen socket is 500, our sockets follow it */
+#define LISTEN_FD 500
+
+struct virtual_socket {
+	uint64_t epoll_data;
+	uint32_t events;
+	int upgraded;
+	/* With replay, the connection played, its next read and how much of that was taken. Closed sockets are
+	 * accepted again, playing the next connection */
+	int closed;
+	size_t connection, read, offset;
+};
+
+static struct virtual_socket *sockets = NULL;
+static int num_sockets = 10;
 static int accepted_sockets = 0;
+static uint64_t listen_socket_epoll_data = 0;
+
+enum workload { HTTP, WS, PUBSUB, REPLAY };
+static enum workload workload = HTTP;
+static int publishers = 10;
+static size_t write_limit = 0;
+static long block_every = 0;
+static long measured_rounds = 0;
+
+/* What a read gets, built once */
+static char *upgrade_request = NULL, *script = NULL;
+static size_t upgrade_request_length = 0, script_length = 0;
+static int pipeline = 1;
+
+static long rounds = 0, sends = 0, cursor = 0;
+static uint64_t requests = 0;
+
+/* With replay, the reads of every captured connection that read anything */
+static std::string capture;
+static std::vector<std::vector<std::string_view>> connections;
+static size_t next_connection = 0;
+
+static const char request[] =
+	"GET /joyent/http-parser HTTP/1.1\r\n"
+	"Host: github.com\r\n"
+	"DNT: 1\r\n"
+	"Accept-Encoding: gzip, deflate, sdch\r\n"
+	"Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
+	"User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_10_1) "
+		"AppleWebKit/537.36 (KHTML, like Gecko) "
+		"Chrome/39.0.2171.65 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+		"image/webp,*/*;q=0.8\r\n"
+	"Referer: https://github.com/joyent/http-parser\r\n"
+	"Connection: keep-alive\r\n"
+	"Cache-Control: max-age=0\r\n\r\n";
+
+static long env(const char *name, long fallback) {
+	const char *value = getenv(name);
+	return value ? atol(value) : fallback;
+}
+
+static void load_capture(const char *path) {
+	FILE *file = path ? fopen(path, "rb") : NULL;
+	if (!file) {
+		fprintf(stderr, "Error: replay needs UWS_BENCH_CAPTURE to be a capture!\n");
+		exit(1);
+	}
+	char buffer[65536];
+	for (size_t length; (length = fread(buffer, 1, sizeof(buffer), file)); ) {
+		capture.append(buffer, length);
+	}
+	fclose(file);
+
+	std::string_view records = capture;
+	if (records.substr(0, uWS::TrafficCapture::MAGIC.length()) != uWS::TrafficCapture::MAGIC) {
+		fprintf(stderr, "Error: %s is not a capture!\n", path);
+		exit(1);
+	}
+	records.remove_prefix(uWS::TrafficCapture::MAGIC.length());
+
+	/* Connections by their number, those that read nothing left out */
+	std::vector<std::vector<std::string_view>> numbered;
+	uWS::TrafficCapture::Record record = {};
+	while (uWS::TrafficCapture::read(records, record)) {
+		if (record.type == uWS::TrafficCapture::DATA && record.data.length()) {
+			if (record.connection >= numbered.size()) {
+				numbered.resize(record.connection + 1);
+			}
+			numbered[record.connection].push_back(record.data);
+		}
+	}
+	for (auto &reads : numbered) {
+		if (reads.size()) {
+			connections.push_back(std::move(reads));
+		}
+	}
+	if (connections.empty()) {
+		fprintf(stderr, "Error: %s has nothing to replay!\n", path);
+		exit(1);
+	}
+}
+
+/* Masked (with a zero key) binary frames of message_size each, as a client sends them */
+static size_t format_frame(char *dst, size_t message_size) {
+	size_t header = 2;
+	dst[0] = (char) 0x82;
+	if (message_size < 126) {
+		dst[1] = (char) (0x80 | message_size);
+	} else if (message_size < 65536) {
+		dst[1] = (char) (0x80 | 126);
+		dst[2] = (char) (message_size >> 8);
+		dst[3] = (char) message_size;
+		header = 4;
+	} else {
+		dst[1] = (char) (0x80 | 127);
+		for (int i = 0; i < 8; i++) {
+			dst[2 + i] = (char) (message_size >> (56 - 8 * i));
+		}
+		header = 10;
+	}
+	memset(dst + header, 0, 4);
+	memset(dst + header + 4, 'm', message_size);
+	return header + 4 + message_size;
+}
+
+static void configure() {
+	num_sockets = (int) env("UWS_BENCH_SOCKETS", 10);
+	pipeline = (int) env("UWS_BENCH_PIPELINE", 1);
+	publishers = (int) env("UWS_BENCH_PUBLISHERS", 10);
+	write_limit = (size_t) env("UWS_BENCH_WRITE_LIMIT", 0);
+	block_every = env("UWS_BENCH_BLOCK_EVERY", 0);
+	measured_rounds = env("UWS_BENCH_ROUNDS", 0);
+	size_t message_size = (size_t) env("UWS_BENCH_MESSAGE_SIZE", 20);
+
+	const char *name = getenv("UWS_BENCH_WORKLOAD");
+	if (name && !strcmp(name, "ws")) {
+		workload = WS;
+	} else if (name && !strcmp(name, "pubsub")) {
+		workload = PUBSUB;
+	} else if (name && !strcmp(name, "replay")) {
+		workload = REPLAY;
+		load_capture(getenv("UWS_BENCH_CAPTURE"));
+	} else if (name && strcmp(name, "http")) {
+		fprintf(stderr, "Error: UWS_BENCH_WORKLOAD must be http, ws, pubsub or replay!\n");
+		exit(1);
+	}
+	if (num_sockets < 1 || pipeline < 1 || publishers < 1) {
+		fprintf(stderr, "Error: UWS_BENCH_SOCKETS, UWS_BENCH_PIPELINE and UWS_BENCH_PUBLISHERS must be positive!\n");
+		exit(1);
+	}
+
+	sockets = (struct virtual_socket *) calloc((size_t) num_sockets, sizeof(struct virtual_socket));
+	if (workload == REPLAY) {
+		return;
+	}
+
+	/* Everything a read gets has to fit the receive buffer of uSockets */
+	size_t unit = workload == HTTP ? sizeof(request) - 1 : message_size + 14;
+	if (unit * (size_t) pipeline > 256 * 1024) {
+		pipeline = (int) (unit > 256 * 1024 ? 1 : 256 * 1024 / unit);
+	}
+	script = (char *) malloc(unit * (size_t) pipeline);
+	for (int i = 0; i < pipeline; i++) {
+		if (workload == HTTP) {
+			memcpy(script + script_length, request, sizeof(request) - 1);
+			script_length += sizeof(request) - 1;
+		} else {
+			script_length += format_frame(script + script_length, message_size);
+		}
+	}
+
+	static char upgrade[512];
+	upgrade_request_length = (size_t) snprintf(upgrade, sizeof(upgrade),
+		"GET /chat HTTP/1.1\r\n"
+		"Host: server.example.com\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"%s\r\n", env("UWS_BENCH_COMPRESS", 0) ? "Sec-WebSocket-Extensions: permessage-deflate\r\n" : "");
+	upgrade_request = upgrade;
+}
+
+/* Publishers (and everyone else before its upgrade) always have something for us to read. Replayed sockets have
+ * their reads, then the end of their connection */
+static int has_data(int index) {
+	if (workload == REPLAY) {
+		return !sockets[index].closed && sockets[index].read <= connections[sockets[index].connection].size();
+	}
+	return workload != PUBSUB || !sockets[index].upgraded || index % publishers == 0;
+}
+
+static void next_round() {
+	if (!measured_rounds || !bench_done) {
+		return;
+	}
+	if (++rounds == measured_rounds) {
+		requests = 0;
+		if (bench_warm) {
+			bench_warm();
+		}
+	} else if (rounds == 2 * measured_rounds) {
+		bench_done(requests);
+		exit(0);
+	}
+}
+
+/* How much of a write of length we take */
+static ssize_t take(size_t length) {
+	if (block_every && ++sends % block_every == 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	if (write_limit && length > write_limit) {
+		return (ssize_t) write_limit;
+	}
+	return (ssize_t) length;
+}
 
 int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
 
 	// the listen socket
-	if (fd == 500) {
+	if (fd == LISTEN_FD) {
 		listen_socket_epoll_data = event->data.u64;
 		return 0;
 	} else {
-		if (fd < 500) {
-
-		} else {
-			// on our FDs
-			ready_events[fd - 500 - 1].data.u64 = event->data.u64;
-			ready_events[fd - 500 - 1].events = EPOLLIN;
+		// on our FDs, whatever the loop polls for
+		if (fd > LISTEN_FD && fd <= LISTEN_FD + num_sockets) {
+			struct virtual_socket *vs = &sockets[fd - LISTEN_FD - 1];
+			if (op == EPOLL_CTL_DEL) {
+				vs->events = 0;
+				/* Closed, to be accepted again */
+				if (workload == REPLAY && !vs->closed) {
+					vs->closed = 1;
+					accepted_sockets--;
+				}
+			} else {
+				vs->epoll_data = event->data.u64;
+				vs->events = event->events;
+			}
 		}
-		
+
 		return 0;
 	}
 }
@@ -42,51 +290,97 @@ int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
 int __wrap_epoll_wait(int epfd, struct epoll_event *events,
                int maxevents, int timeout) {
 
-	if (accepted_sockets != NUM_SOCKETS) {
+	if (accepted_sockets != num_sockets) {
 		events[0].events = EPOLLIN;
 		events[0].data.u64 = listen_socket_epoll_data;
 		return 1;
-	} else {
-		for (int i = 0; i < NUM_SOCKETS; i++) {
-			events[i] = ready_events[i];
+	}
+
+	/* Every socket once per round, as many at a time as the loop takes */
+	int ready_events = 0;
+	for (int scanned = 0; scanned < num_sockets && ready_events < maxevents; scanned++) {
+		struct virtual_socket *vs = &sockets[cursor];
+		uint32_t ready = vs->events & EPOLLOUT;
+		if ((vs->events & EPOLLIN) && has_data((int) cursor)) {
+			ready |= EPOLLIN;
+		}
+		if (ready) {
+			events[ready_events].events = ready;
+			events[ready_events].data.u64 = vs->epoll_data;
+			ready_events++;
+		}
+
+		if (++cursor == num_sockets) {
+			cursor = 0;
+			next_round();
 		}
-		return NUM_SOCKETS;
 	}
+	return ready_events;
 }
 
-int __wrap_recv(int sockfd, void *buf, size_t len, int flags) {
-	const char request[] =
-    "GET /joyent/http-parser HTTP/1.1\r\n"
-    "Host: github.com\r\n"
-    "DNT: 1\r\n"
-    "Accept-Encoding: gzip, deflate, sdch\r\n"
-    "Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
-    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_10_1) "
-        "AppleWebKit/537.36 (KHTML, like Gecko) "
-        "Chrome/39.0.2171.65 Safari/537.36\r\n"
-    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
-        "image/webp,*/*;q=0.8\r\n"
-    "Referer: https://github.com/joyent/http-parser\r\n"
-    "Connection: keep-alive\r\n"
-    "Cache-Control: max-age=0\r\n\r\n";
+ssize_t __wrap_recv(int sockfd, void *buf, size_t len, int flags) {
+	struct virtual_socket *vs = &sockets[sockfd - LISTEN_FD - 1];
+
+	if (workload == REPLAY) {
+		std::vector<std::string_view> &reads = connections[vs->connection];
+		if (vs->read == reads.size()) {
+			/* The end of the connection, once */
+			vs->read++;
+			return 0;
+		} else if (vs->read > reads.size()) {
+			errno = EAGAIN;
+			return -1;
+		}
+		size_t length = reads[vs->read].length() - vs->offset < len ? reads[vs->read].length() - vs->offset : len;
+		memcpy(buf, reads[vs->read].data() + vs->offset, length);
+		if ((vs->offset += length) == reads[vs->read].length()) {
+			vs->read++;
+			vs->offset = 0;
+			requests++;
+		}
+		return (ssize_t) length;
+	}
+
+	if (workload != HTTP && !vs->upgraded) {
+		vs->upgraded = 1;
+		memcpy(buf, upgrade_request, upgrade_request_length);
+		return (ssize_t) upgrade_request_length;
+	}
+
+	if (!has_data(sockfd - LISTEN_FD - 1)) {
+		errno = EAGAIN;
+		return -1;
+	}
 
-	memcpy(buf, request, sizeof(request) - 1);
-	return sizeof(request) - 1;
+	size_t length = script_length < len ? script_length : len;
+	memcpy(buf, script, length);
+	requests += (uint64_t) pipeline;
+	return (ssize_t) length;
 }
 
-int __wrap_send(int sockfd, const void *buf, size_t len, int flags) {
-	static int sent = 0;
-	static clock_t lastTime = clock();
-	if (++sent == 1000000) {
-		// print how long it took to make 1 million requests
-		clock_t newTime = clock();
-		float elapsed = float(newTime - lastTime) / CLOCKS_PER_SEC;
-		printf("Req/sec: %f million\n", (1000000.0f / elapsed) / 1000000.0f);
-		sent = 0;
-		lastTime = newTime;
+ssize_t __wrap_send(int sockfd, const void *buf, size_t len, int flags) {
+	if (!bench_done) {
+		static int sent = 0;
+		static clock_t lastTime = clock();
+		if (++sent == 1000000) {
+			// print how long it took to make 1 million requests
+			clock_t newTime = clock();
+			float elapsed = float(newTime - lastTime) / CLOCKS_PER_SEC;
+			printf("Req/sec: %f million\n", (1000000.0f / elapsed) / 1000000.0f);
+			sent = 0;
+			lastTime = newTime;
+		}
 	}
 
-	return len;
+	return take(len);
+}
+
+ssize_t __wrap_writev(int fd, const struct iovec *iov, int iovcnt) {
+	size_t length = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		length += iov[i].iov_len;
+	}
+	return take(length);
 }
 
 int __wrap_bind() {
@@ -98,10 +392,24 @@ int __wrap_setsockopt() {
 }
 
 int __wrap_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
-	if (accepted_sockets < NUM_SOCKETS) {
+	if (workload == REPLAY) {
+		for (int i = 0; i < num_sockets; i++) {
+			struct virtual_socket *vs = &sockets[i];
+			/* Never accepted is the same as closed */
+			if (vs->closed || !vs->epoll_data) {
+				*vs = {};
+				vs->connection = next_connection++ % connections.size();
+				accepted_sockets++;
+				return LISTEN_FD + 1 + i;
+			}
+		}
+	}
+
+	if (accepted_sockets < num_sockets) {
 		accepted_sockets++;
-		return accepted_sockets + 500;
+		return accepted_sockets + LISTEN_FD;
 	} else {
+		errno = EAGAIN;
 		return -1;
 	}
 }
@@ -111,7 +419,10 @@ int __wrap_listen() {
 }
 
 int __wrap_socket(int domain, int type, int protocol) {
-	return 500;
+	if (!sockets) {
+		configure();
+	}
+	return LISTEN_FD;
 }
 
 #ifdef __cplusplus
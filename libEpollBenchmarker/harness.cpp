@@ -0,0 +1,86 @@
+/* The server side of the syscall-free harness, linked with epoll_benchmarker.cpp which plays every client (see
+ * there for how to set up the workload). Reports the CPU cycles per request, or message received, spent in every
+ * phase as one JSON object per line, the way benchmarks/suite does, so that benchmarks/compare can diff them:
+ *
+ * UWS_BENCH_WORKLOAD=ws UWS_BENCH_SOCKETS=1000 UWS_BENCH_ROUNDS=10000 ./harness */
+
+#include "App.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifndef UWS_WITH_PHASE_CYCLES
+#error "The harness needs UWS_WITH_METRICS and UWS_WITH_PHASE_CYCLES"
+#endif
+
+static const char *workload = "http";
+static uWS::LoopMetricsSnapshot warmMetrics;
+static uint64_t warmCycles = 0;
+
+extern "C" void bench_warm() {
+    warmMetrics = uWS::Loop::get()->getMetrics()->snapshot();
+    warmCycles = uWS::LoopMetrics::cycles();
+}
+
+extern "C" void bench_done(uint64_t requests) {
+    uint64_t cycles = uWS::LoopMetrics::cycles() - warmCycles;
+    uWS::LoopMetricsSnapshot metrics = uWS::Loop::get()->getMetrics()->snapshot();
+    if (!requests) {
+        std::cerr << "Error: Nothing was requested while measuring!" << std::endl;
+        return;
+    }
+
+    std::pair<const char *, uint64_t> phases[] = {
+        {"parse", metrics.parseCycles - warmMetrics.parseCycles},
+        {"route", metrics.routeCycles - warmMetrics.routeCycles},
+        {"handler", metrics.handlerCycles - warmMetrics.handlerCycles},
+        {"format", metrics.formatCycles - warmMetrics.formatCycles},
+        {"compress", metrics.compressCycles - warmMetrics.compressCycles}
+    };
+
+    /* Whatever no phase took is the loop, timers, (mocked) syscalls and the rest */
+    uint64_t other = cycles;
+    for (auto [name, phaseCycles] : phases) {
+        std::cout << std::fixed << "{\"name\": \"harness " << workload << " " << name << "\", \"unit\": \"cycles\", \"median\": "
+            << (double) phaseCycles / (double) requests << "}" << std::endl;
+        other -= std::min(other, phaseCycles);
+    }
+    std::cout << std::fixed << "{\"name\": \"harness " << workload << " other\", \"unit\": \"cycles\", \"median\": "
+        << (double) other / (double) requests << "}" << std::endl;
+    std::cout << std::fixed << "{\"name\": \"harness " << workload << " total\", \"unit\": \"cycles\", \"median\": "
+        << (double) cycles / (double) requests << "}" << std::endl;
+}
+
+struct PerSocketData {};
+
+int main() {
+    if (const char *name = getenv("UWS_BENCH_WORKLOAD")) {
+        workload = name;
+    }
+    static bool pubsub = !strcmp(workload, "pubsub");
+    const char *compress = getenv("UWS_BENCH_COMPRESS");
+
+    uWS::App().get("/*", [](auto *res, auto */*req*/) {
+        res->writeHeader("Content-Type", "text/plain")->end("Hello world!");
+    }).ws<PerSocketData>("/*", {
+        .compression = compress && atoi(compress) ? uWS::SHARED_COMPRESSOR : uWS::DISABLED,
+        .maxPayloadLength = 16 * 1024 * 1024,
+        .open = [](auto *ws) {
+            if (pubsub) {
+                ws->subscribe("room");
+            }
+        },
+        .message = [](auto *ws, std::string_view message, uWS::OpCode opCode) {
+            if (pubsub) {
+                ws->publish("room", message, opCode, true);
+            } else {
+                ws->send(message, opCode, true);
+            }
+        }
+    }).listen(3000, [](auto *listenSocket) {
+        if (!listenSocket) {
+            std::cerr << "Error: Could not listen on the virtual socket!" << std::endl;
+        }
+    }).run();
+}
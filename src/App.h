@@ -21,8 +21,11 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <string>
+#include <algorithm>
 #include <charconv>
+#include <climits>
 #include <string_view>
+#include <cstddef>
 
 namespace uWS {
     /* Safari 15.0 - 15.3 has a completely broken compression implementation (client_no_context_takeover not
@@ -56,6 +59,8 @@ namespace uWS {
 #include "WebSocketContext.h"
 #include "WebSocket.h"
 #include "PerMessageDeflate.h"
+#include "RoutePattern.h"
+#include "TlsSessionCache.h"
 
 namespace uWS {
 
@@ -69,15 +74,24 @@ namespace uWS {
         const char *ssl_ciphers = nullptr;
         int ssl_prefer_low_memory_usage = 0;
 
+        /* Ours, not passed to uSockets. TLS records start out this many bytes (such as 1400, one MTU) after a second of
+         * idle and double with every full record up to 16 KB, for a faster first byte. 0 always writes full records */
+        unsigned int tls_initial_record_size = 0;
+
+        /* Ours, with WITH_SESSION_CACHE=1. Sessions (up to this many) and ticket keys (rotated every this many seconds)
+         * shared by every SSLApp of the process setting them, so that clients resume on any thread. 0 keeps them per app */
+        unsigned int tls_session_cache_size = 0;
+        unsigned int tls_ticket_key_lifetime = 0;
+
         /* Conversion operator used internally */
         operator struct us_socket_context_options_t() const {
             struct us_socket_context_options_t socket_context_options;
-            memcpy(&socket_context_options, this, sizeof(SocketContextOptions));
+            memcpy(&socket_context_options, this, offsetof(SocketContextOptions, tls_initial_record_size));
             return socket_context_options;
         }
     };
 
-    static_assert(sizeof(struct us_socket_context_options_t) == sizeof(SocketContextOptions), "Mismatching uSockets/uWebSockets ABI");
+    static_assert(offsetof(SocketContextOptions, tls_initial_record_size) == offsetof(struct us_socket_context_options_t, ssl_prefer_low_memory_usage) + sizeof(int), "Mismatching uSockets/uWebSockets ABI");
 
 template <bool SSL>
 struct TemplatedApp {
@@ -88,11 +102,18 @@ private:
     std::vector<MoveOnlyFunction<void()>> webSocketContextDeleters;
 
     std::vector<void *> webSocketContexts;
+    /* By route, closes every WebSocket of a context, see closeAll */
+    std::vector<void (*)(void *webSocketContext, bool callCloseHandlers)> webSocketClosers;
+#ifndef _WIN32
+    /* By route, puts a WebSocket handed over by another process back together, see takeOver */
+    std::vector<void (*)(void *webSocketContext, int fd, std::string_view payload)> webSocketTakeOvers;
+#endif
 
 public:
 
     TopicTree<TopicTreeMessage, TopicTreeBigMessage> *topicTree = nullptr;
 
+#ifndef UWS_NO_SNI
     /* Server name */
     TemplatedApp &&addServerName(std::string hostname_pattern, SocketContextOptions options = {}) {
 
@@ -102,6 +123,7 @@ public:
             auto *domainRouter = new HttpRouter<typename HttpContextData<SSL>::RouterData>();
 
             us_socket_context_add_server_name(SSL, (struct us_socket_context_t *) httpContext, hostname_pattern.c_str(), options, domainRouter);
+            httpContext->getSocketContextData()->serverNamesGeneration++;
         }
 
         return std::move(static_cast<TemplatedApp &&>(*this));
@@ -116,6 +138,7 @@ public:
         }
 
         us_socket_context_remove_server_name(SSL, (struct us_socket_context_t *) httpContext, hostname_pattern.c_str());
+        httpContext->getSocketContextData()->serverNamesGeneration++;
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
 
@@ -134,6 +157,7 @@ public:
 
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
+#endif
 
     /* Returns the SSL_CTX of this app, or nullptr. */
     void *getNativeHandle() {
@@ -164,19 +188,113 @@ public:
      * TopicTree of this app (technically there are many TopicTrees, however the concept is that one
      * app has one conceptual Topic tree) */
     bool publish(std::string_view topic, std::string_view message, OpCode opCode, bool compress = false) {
-        /* Anything big bypasses corking efforts */
-        if (message.length() >= LoopData::CORK_BUFFER_SIZE) {
-            return topicTree->publishBig(nullptr, topic, {message, opCode, compress}, [](Subscriber *s, TopicTreeBigMessage &message) {
+        /* Coalesced topics go out later, as one message with the rest of their batch */
+        if (topicTree->coalesce(topic, message, (int) opCode | (int) compress << 8)) {
+            return true;
+        }
+        return publishNow(topicTree, {&topic, 1}, message, opCode, compress);
+    }
+
+    /* Publishes one message to several topics at once, such as a room and a user. It is stored once, and WebSockets
+     * subscribed to more than one of them receive it once. Coalesced topics still go out with their own batches, and
+     * the message is conflated only when published to one topic */
+    bool publish(std::span<const std::string_view> topics, std::string_view message, OpCode opCode, bool compress = false) {
+        /* Only once one is coalesced do we need to pick out the rest */
+        std::vector<std::string_view> uncoalesced;
+        bool coalesced = false;
+        for (size_t i = 0; i < topics.size(); i++) {
+            if (topicTree->coalesce(topics[i], message, (int) opCode | (int) compress << 8)) {
+                if (!coalesced) {
+                    uncoalesced.assign(topics.begin(), topics.begin() + (ptrdiff_t) i);
+                    coalesced = true;
+                }
+            } else if (coalesced) {
+                uncoalesced.push_back(topics[i]);
+            }
+        }
+        if (coalesced) {
+            if (uncoalesced.size()) {
+                publishNow(topicTree, uncoalesced, message, opCode, compress);
+            }
+            return true;
+        }
+        return topics.size() && publishNow(topicTree, topics, message, opCode, compress);
+    }
+
+    /* Messages published to topic (or to each topic matching it, if a wildcard topic) by this App go out together,
+     * as one message per batch for subscribers to take apart again, see CoalescingOptions. Needs a WebSocket route
+     * to be added first */
+    TemplatedApp &&coalesce(std::string_view topic, CoalescingOptions options = {}) {
+        if (!topicTree) {
+            std::cerr << "Error: coalesce needs a WebSocket route to be added first!" << std::endl;
+            std::terminate();
+        }
+        topicTree->setCoalesced(topic, std::move(options));
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+    /* Stops coalescing topic, sending what it held right away */
+    TemplatedApp &&coalesce(std::string_view topic, bool coalesced) {
+        if (coalesced) {
+            return coalesce(topic, CoalescingOptions{});
+        }
+        if (topicTree) {
+            topicTree->setCoalesced(topic, std::nullopt);
+        }
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+private:
+    static bool publishNow(TopicTree<TopicTreeMessage, TopicTreeBigMessage> *topicTree, std::span<const std::string_view> topics, std::string_view message, OpCode opCode, bool compress) {
+        /* Anything big bypasses corking efforts, and makes the cork buffer grow for next time */
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) Loop::get());
+        /* Whether it is worth deflating is learnt per topic, for messages of one topic only */
+        CompressionStats *topicStats = compress && topics.size() == 1 ? topicTree->getCompressionStats(topics[0]) : nullptr;
+        if (message.length() >= loopData->corkBufferSize) {
+            loopData->corkOverflow(message.length());
+            TopicTreeBigMessage bigMessage(message, opCode, compress);
+            bigMessage.topicStats = topicStats;
+            bigMessage.topicsVersion = topicTree->getTopicsVersion();
+            return topicTree->publishBig(nullptr, topics.data(), topics.size(), std::move(bigMessage), [](Subscriber *s, TopicTreeBigMessage &message) {
                 auto *ws = (WebSocket<SSL, true, int> *) s->user;
 
-                /* Send will drain if needed */
-                ws->send(message.message, (OpCode)message.opCode, message.compress);
+                /* Framed once, shared by all subscribers */
+                ws->sendShared(message);
             });
         } else {
-            return topicTree->publish(nullptr, topic, {std::string(message), opCode, compress});
+            const std::string *conflatedTopic = topics.size() == 1 ? topicTree->getConflatedTopic(topics[0]) : nullptr;
+            TopicTreeMessage topicTreeMessage(std::string(message), opCode, compress, conflatedTopic);
+            topicTreeMessage.topicStats = topicStats;
+            topicTreeMessage.topicsVersion = topicTree->getTopicsVersion();
+            return topicTree->publish(nullptr, topics.data(), topics.size(), std::move(topicTreeMessage));
         }
     }
 
+public:
+
+    /* Subscribers with backpressure get only the latest message of topic, held back until they drained, instead of
+     * every message. For topics where only the latest value matters. Needs a WebSocket route to be added first */
+    TemplatedApp &&conflate(std::string_view topic, bool conflated = true) {
+        if (!topicTree) {
+            std::cerr << "Error: conflate needs a WebSocket route to be added first!" << std::endl;
+            std::terminate();
+        }
+        topicTree->setConflated(topic, conflated);
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+    /* Keeps the last count messages published to topic (or to each topic matching it, if a wildcard topic) and sends
+     * them to every WebSocket subscribing to it later, before anything live. 0 stops and forgets them. Needs a
+     * WebSocket route to be added first */
+    TemplatedApp &&retain(std::string_view topic, unsigned int count = 1) {
+        if (!topicTree) {
+            std::cerr << "Error: retain needs a WebSocket route to be added first!" << std::endl;
+            std::terminate();
+        }
+        topicTree->setRetained(topic, count);
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
     /* Returns number of subscribers for this topic, or 0 for failure.
      * This function should probably be optimized a lot in future releases,
      * it could be O(1) with a hash map of fullnames and their counts. */
@@ -223,6 +341,10 @@ public:
         webSocketContextDeleters = std::move(other.webSocketContextDeleters);
 
         webSocketContexts = std::move(other.webSocketContexts);
+        webSocketClosers = std::move(other.webSocketClosers);
+#ifndef _WIN32
+        webSocketTakeOvers = std::move(other.webSocketTakeOvers);
+#endif
 
         /* Move TopicTree */
         topicTree = other.topicTree;
@@ -231,6 +353,24 @@ public:
 
     TemplatedApp(SocketContextOptions options = {}) {
         httpContext = HttpContext<SSL>::create(Loop::get(), options);
+        if (httpContext) {
+            httpContext->getSocketContextData()->tlsInitialRecordSize = (unsigned short) std::min<unsigned int>(options.tls_initial_record_size, AsyncSocket<SSL>::MAX_TLS_RECORD_SIZE);
+
+#if defined(UWS_WITH_KTLS) && defined(__linux__)
+            if (SSL) {
+                KernelTls::enable((SSL_CTX *) getNativeHandle());
+            }
+#endif
+
+            if (SSL && (options.tls_session_cache_size || options.tls_ticket_key_lifetime)) {
+#ifdef UWS_WITH_SESSION_CACHE
+                TlsSessionCache::attach((SSL_CTX *) getNativeHandle(), options.tls_session_cache_size, options.tls_ticket_key_lifetime);
+#else
+                std::cerr << "Error: tls_session_cache_size and tls_ticket_key_lifetime need WITH_SESSION_CACHE=1!" << std::endl;
+                std::terminate();
+#endif
+            }
+        }
 
         /* Register default handler for 404 (can be overridden by user) */
         this->any("/*", [](auto *res, auto */*req*/) {
@@ -247,6 +387,21 @@ public:
     struct WebSocketBehavior {
         /* Disabled compression by default - probably a bad default */
         CompressOptions compression = DISABLED;
+        /* With POOLED_COMPRESSOR, this many sliding windows are shared by all sockets of this behavior */
+        unsigned int compressorPoolSize = 1024;
+        /* Dedicated compressors unused for this many seconds are freed, and made again when next needed (0 keeps
+         * them). Clients are then asked for client_no_context_takeover, inflating with the shared decompressor */
+        unsigned short compressorIdleTimeout = 0;
+        /* Messages at least this big are compressed on worker threads, keeping later sends in order (0 disables) */
+        unsigned int asyncCompressionThreshold = 0;
+        /* Sends made while another socket is corked (replies fanned out from a handler) are flushed together
+         * at the end of the loop iteration, rather than with one syscall each */
+        bool batchSends = false;
+        /* 1 (fastest) to 9 (smallest), 0 stores. Messages compressed whole by libdeflate can go up to 12 */
+        int compressionLevel = DEFAULT_COMPRESSION_LEVEL;
+        /* Preset dictionary for clients offering "x_uws_dictionary=<compressionDictionaryId>" with permessage-deflate */
+        std::string compressionDictionary = {};
+        unsigned short compressionDictionaryId = 1;
         /* Maximum message size we can receive */
         unsigned int maxPayloadLength = 16 * 1024;
         /* 2 minutes timeout is good */
@@ -258,21 +413,36 @@ public:
         bool resetIdleTimeoutOnSend = false;
         /* A good default, esp. for newcomers */
         bool sendPingsAutomatically = true;
+        /* Pongs answering automatic pings only keep sockets alive, set this to have them reach pong as well */
+        bool emitAutomaticPongs = false;
         /* Maximum socket lifetime in minutes before forced closure (defaults to disabled) */
         unsigned short maxLifetime = 0;
         MoveOnlyFunction<void(HttpResponse<SSL> *, HttpRequest *, struct us_socket_context_t *)> upgrade = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *)> open = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::string_view, OpCode)> message = nullptr;
+        /* Instead of message, receives data messages in pieces as they arrive, the last one flagged, without ever
+         * holding a whole message. maxPayloadLength then limits frames, not messages. Pieces can split code points of text */
+        MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::string_view, OpCode, bool)> messageChunk = nullptr;
+        /* Instead of message, receives every whole data message of one read at once, corked. The messages are valid
+         * for the call only. Messages before a control frame or an error are handed over before it */
+        MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::span<const WebSocketMessage>)> messages = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::string_view, OpCode)> dropped = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *)> drain = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::string_view)> ping = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::string_view)> pong = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::string_view, int, int)> subscription = nullptr;
+        /* Instead of subscription, receives every change of one subscribe or unsubscribe (of many topics, or of
+         * one) at once, as well as those of a closing socket. Topics are valid for the call only */
+        MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, std::span<const WebSocketSubscription>)> subscriptions = nullptr;
         MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *, int, std::string_view)> close = nullptr;
+        /* Instead of close and open, a socket moving to another loop (see migrate) leaves here and arrives there */
+        MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *)> leave = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, true, UserData> *)> arrive = nullptr;
     };
 
     /* Closes all sockets including listen sockets. */
     TemplatedApp &&close() {
+        ((LoopData *) us_loop_ext(us_socket_context_loop(SSL, (us_socket_context_t *) httpContext)))->forgetListenSockets((us_socket_context_t *) httpContext);
         us_socket_context_close(SSL, (struct us_socket_context_t *) httpContext);
         for (void *webSocketContext : webSocketContexts) {
             us_socket_context_close(SSL, (struct us_socket_context_t *) webSocketContext);
@@ -281,6 +451,33 @@ public:
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
 
+    /* Closes one listen socket of ours. Use this rather than us_listen_socket_close on loops with maxLag, which
+     * pause and resume our listen sockets (see Loop::setMaxLag) */
+    TemplatedApp &&close(us_listen_socket_t *listenSocket) {
+        ((LoopData *) us_loop_ext(us_socket_context_loop(SSL, (us_socket_context_t *) httpContext)))->forgetListenSockets(nullptr, listenSocket);
+        us_listen_socket_close(SSL, listenSocket);
+
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+    /* Closes all sockets including listen sockets, as close does but in bulk, for when there are a great many
+     * WebSockets to close. Every subscription ends at once (no subscription events), and every WebSocket gets a close
+     * frame with 1001 (Going Away) written out if nothing waits before it and is closed right away. Close handlers get
+     * 1001 unless callCloseHandlers is false, user data is destructed either way */
+    TemplatedApp &&closeAll(bool callCloseHandlers = true) {
+        ((LoopData *) us_loop_ext(us_socket_context_loop(SSL, (us_socket_context_t *) httpContext)))->forgetListenSockets((us_socket_context_t *) httpContext);
+        us_socket_context_close(SSL, (struct us_socket_context_t *) httpContext);
+        if (topicTree) {
+            topicTree->clear();
+        }
+        for (size_t i = 0; i < webSocketContexts.size(); i++) {
+            webSocketClosers[i](webSocketContexts[i], callCloseHandlers);
+            us_socket_context_close(SSL, (struct us_socket_context_t *) webSocketContexts[i]);
+        }
+
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
     template <typename UserData>
     TemplatedApp &&ws(std::string pattern, WebSocketBehavior<UserData> &&behavior) {
         /* Don't compile if alignment rules cannot be satisfied */
@@ -320,16 +517,22 @@ public:
                  * TopicTree now */
                 auto *ws = (WebSocket<SSL, true, int> *) s->user;
 
+                UWS_METRIC(((AsyncSocket<SSL> *) ws)->getLoopData(), topicTreeDrainedMessages, 1);
+
                 /* If this is the first message we try and cork */
                 if (flags & TopicTree<TopicTreeMessage, TopicTreeBigMessage>::IteratorFlags::FIRST) {
+                    UWS_METRIC(((AsyncSocket<SSL> *) ws)->getLoopData(), topicTreeDrains, 1);
                     if (ws->canCork() && !ws->isCorked()) {
                         ((AsyncSocket<SSL> *)ws)->cork();
                         needsUncork = true;
                     }
                 }
 
-                /* If we ever overstep maxBackpresure, exit immediately */
-                if (WebSocket<SSL, true, int>::SendStatus::DROPPED == ws->send(message.message, (OpCode)message.opCode, message.compress)) {
+                /* Backlogged subscribers hold on to the latest message of conflated topics instead, sent once they drain */
+                if (message.conflatedTopic && (ws->getBufferedAmount() || TopicTree<TopicTreeMessage, TopicTreeBigMessage>::isConflating(s, *message.conflatedTopic))) {
+                    TopicTree<TopicTreeMessage, TopicTreeBigMessage>::conflate(s, *message.conflatedTopic, message).conflatedTopic = nullptr;
+                } else if (WebSocket<SSL, true, int>::SendStatus::DROPPED == ws->sendShared(message)) {
+                    /* If we ever overstep maxBackpresure, exit immediately */
                     if (needsUncork) {
                         ((AsyncSocket<SSL> *)ws)->uncork();
                         needsUncork = false;
@@ -350,10 +553,19 @@ public:
                 return false;
             });
 
+            /* Batches of coalesced topics are published like anything else, when their window ends */
+            topicTree->batchHandler = [topicTree = topicTree](std::string_view topic, std::string &&payload, int kind) {
+                publishNow(topicTree, {&topic, 1}, payload, (OpCode) (kind & 0xff), kind >> 8);
+            };
+            topicTree->armBatchTimer = [](TimingWheel::Timer *timer, unsigned int ms) {
+                Loop::get()->armTimer(timer, ms);
+            };
+
             /* And hook it up with the loop */
             /* We empty for both pre and post just to make sure */
             Loop::get()->addPostHandler(topicTree, [topicTree = topicTree](Loop */*loop*/) {
-                /* Commit pub/sub batches every loop iteration */
+                /* Commit pub/sub batches every loop iteration, with what was coalesced within it */
+                topicTree->flushImmediateBatches();
                 topicTree->drain();
             });
 
@@ -373,6 +585,9 @@ public:
 
         /* We also keep this list for easy closing */
         webSocketContexts.push_back((void *)webSocketContext);
+        webSocketClosers.push_back([](void *webSocketContext, bool callCloseHandlers) {
+            ((WebSocketContext<SSL, true, UserData> *) webSocketContext)->closeAll(callCloseHandlers);
+        });
 
         /* Quick fix to disable any compression if set */
 #ifdef UWS_NO_ZLIB
@@ -384,22 +599,41 @@ public:
             LoopData *loopData = (LoopData *) us_loop_ext(us_socket_context_loop(SSL, webSocketContext->getSocketContext()));
 
             /* Initialize loop's deflate inflate streams */
-            if (!loopData->zlibContext) {
-                loopData->zlibContext = new ZlibContext;
-                loopData->inflationStream = new InflationStream(CompressOptions::DEDICATED_DECOMPRESSOR);
-                loopData->deflationStream = new DeflationStream(CompressOptions::DEDICATED_COMPRESSOR);
-            }
+            loopData->initCompression();
         }
 
         /* Copy all handlers */
         webSocketContext->getExt()->openHandler = std::move(behavior.open);
         webSocketContext->getExt()->messageHandler = std::move(behavior.message);
+        webSocketContext->getExt()->messageChunkHandler = std::move(behavior.messageChunk);
+        webSocketContext->getExt()->messagesHandler = std::move(behavior.messages);
         webSocketContext->getExt()->droppedHandler = std::move(behavior.dropped);
         webSocketContext->getExt()->drainHandler = std::move(behavior.drain);
         webSocketContext->getExt()->subscriptionHandler = std::move(behavior.subscription);
+        webSocketContext->getExt()->subscriptionsHandler = std::move(behavior.subscriptions);
         webSocketContext->getExt()->closeHandler = std::move(behavior.close);
         webSocketContext->getExt()->pingHandler = std::move(behavior.ping);
         webSocketContext->getExt()->pongHandler = std::move(behavior.pong);
+        webSocketContext->getExt()->leaveHandler = std::move(behavior.leave);
+        webSocketContext->getExt()->arriveHandler = std::move(behavior.arrive);
+
+        /* Sockets of ours can move to this same route of an app set up like us */
+        webSocketContext->getExt()->routeIndex = (unsigned int) webSocketContexts.size() - 1;
+        if constexpr (!SSL) {
+            webSocketContext->getExt()->migrate = [](void *ws, void *targetApp) {
+                return migrate((WebSocket<SSL, true, UserData> *) ws, (TemplatedApp *) targetApp);
+            };
+#ifndef _WIN32
+            webSocketContext->getExt()->handOff = [](void *ws, void *channel) {
+                return WebSocketContext<SSL, true, UserData>::handOff((us_socket_t *) ws, *(int *) channel);
+            };
+#endif
+        }
+#ifndef _WIN32
+        webSocketTakeOvers.push_back([](void *webSocketContext, int fd, std::string_view payload) {
+            ((WebSocketContext<SSL, true, UserData> *) webSocketContext)->takeOver(fd, payload);
+        });
+#endif
 
         /* Copy settings */
         webSocketContext->getExt()->maxPayloadLength = behavior.maxPayloadLength;
@@ -407,8 +641,44 @@ public:
         webSocketContext->getExt()->closeOnBackpressureLimit = behavior.closeOnBackpressureLimit;
         webSocketContext->getExt()->resetIdleTimeoutOnSend = behavior.resetIdleTimeoutOnSend;
         webSocketContext->getExt()->sendPingsAutomatically = behavior.sendPingsAutomatically;
+        webSocketContext->getExt()->emitAutomaticPongs = behavior.emitAutomaticPongs;
         webSocketContext->getExt()->maxLifetime = behavior.maxLifetime;
         webSocketContext->getExt()->compression = behavior.compression;
+        webSocketContext->getExt()->asyncCompressionThreshold = behavior.asyncCompressionThreshold;
+        webSocketContext->getExt()->batchSends = behavior.batchSends;
+
+        if (behavior.compressionLevel < 0 || behavior.compressionLevel > MAX_COMPRESSION_LEVEL) {
+            std::cerr << "Error: compressionLevel must be between 0 and 12!" << std::endl;
+            std::terminate();
+        }
+        webSocketContext->getExt()->compressionLevel = behavior.compressionLevel;
+
+        /* Sockets that took our dictionary share streams primed with it (unless dedicated) */
+        if (behavior.compression && behavior.compressionDictionary.length()) {
+            if (!behavior.compressionDictionaryId || behavior.compressionDictionaryId > SHRT_MAX) {
+                std::cerr << "Error: compressionDictionaryId must be between 1 and 32767!" << std::endl;
+                std::terminate();
+            }
+            WebSocketContextData<SSL, UserData> *webSocketContextData = webSocketContext->getExt();
+            webSocketContextData->compressionDictionary = std::move(behavior.compressionDictionary);
+            webSocketContextData->compressionDictionaryId = behavior.compressionDictionaryId;
+            webSocketContextData->dictionaryDeflationStream = new DeflationStream(CompressOptions::DEDICATED_COMPRESSOR, webSocketContextData->compressionDictionary, behavior.compressionLevel);
+            webSocketContextData->dictionaryInflationStream = new InflationStream(CompressOptions::DEDICATED_DECOMPRESSOR, webSocketContextData->compressionDictionary);
+        }
+
+        /* A pool is made of dedicated compressors of the given size */
+        if (behavior.compression & POOLED_COMPRESSOR) {
+            CompressOptions pooledCompressor = (CompressOptions) (behavior.compression & _COMPRESSOR_MASK);
+            if (pooledCompressor == DISABLED || pooledCompressor == SHARED_COMPRESSOR) {
+                std::cerr << "Error: POOLED_COMPRESSOR must be combined with a DEDICATED_COMPRESSOR size!" << std::endl;
+                std::terminate();
+            }
+            /* The streams of the pool stay with the loop, in its arena */
+            LoopData *loopData = (LoopData *) us_loop_ext(us_socket_context_loop(SSL, webSocketContext->getSocketContext()));
+            webSocketContext->getExt()->deflationStreamPool = new DeflationStreamPool(pooledCompressor, behavior.compressorPoolSize, behavior.compressionLevel, &loopData->arena);
+        }
+
+        webSocketContext->getExt()->compressorIdleTimeout = behavior.compressorIdleTimeout;
 
         /* Calculate idleTimeoutCompnents */
         webSocketContext->getExt()->calculateIdleTimeoutCompnents(behavior.idleTimeout);
@@ -454,6 +724,7 @@ public:
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
 
+#ifndef UWS_NO_SNI
     /* Browse to a server name, changing the router to this domain */
     TemplatedApp &&domain(std::string serverName) {
         HttpContextData<SSL> *httpContextData = httpContext->getSocketContextData();
@@ -469,6 +740,7 @@ public:
     
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
+#endif
 
     TemplatedApp &&get(std::string pattern, MoveOnlyFunction<void(HttpResponse<SSL> *, HttpRequest *)> &&handler) {
         if (httpContext) {
@@ -541,6 +813,96 @@ public:
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
 
+    /* Answers method (case sensitive) on exactly url (without query) with responseTemplate and body, framed once
+     * here and sent as soon as the request is parsed, before any route. Only Date is filled in per response.
+     * Registering the same method and url again replaces the response */
+    TemplatedApp &&staticResponse(std::string_view method, std::string_view url, const ResponseTemplate &responseTemplate, std::string_view body = {}) {
+        if (!httpContext) {
+            return std::move(static_cast<TemplatedApp &&>(*this));
+        }
+
+        StaticResponse staticResponse = {std::string(method), std::string(responseTemplate.getHead()), 0};
+        staticResponse.framedResponse.append("Date: ");
+        staticResponse.dateOffset = staticResponse.framedResponse.length();
+        staticResponse.framedResponse.append(29, ' ').append("\r\n");
+#ifndef UWS_HTTPRESPONSE_NO_WRITEMARK
+        if (!((LoopData *) us_loop_ext((us_loop_t *) Loop::get()))->noMark) {
+            staticResponse.framedResponse.append("uWebSockets: 20\r\n");
+        }
+#endif
+        staticResponse.framedResponse.append("Content-Length: ").append(std::to_string(body.length())).append("\r\n\r\n").append(body);
+
+        std::vector<StaticResponse> &responses = httpContext->getSocketContextData()->staticResponses[std::string(url)];
+        auto it = std::find_if(responses.begin(), responses.end(), [method](StaticResponse &other) {
+            return other.method == method;
+        });
+        if (it != responses.end()) {
+            *it = std::move(staticResponse);
+        } else {
+            responses.push_back(std::move(staticResponse));
+        }
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+#ifndef _WIN32
+    /* Serves the files under root at urlPrefix followed by their path, indexing all of them now. Their strong ETags,
+     * Last-Modified and headers are made up front, so GET and HEAD of them, If-None-Match and If-Modified-Since (304)
+     * and single Range (206) requests included, are answered before any route. On Linux, files changed, added or
+     * removed are picked up every options.reloadInterval ms by inotify. Bodies are never compressed */
+    TemplatedApp &&serveStatic(std::string_view urlPrefix, std::string_view root, StaticAssetsOptions options = {}) {
+        if (!httpContext) {
+            return std::move(static_cast<TemplatedApp &&>(*this));
+        }
+
+        bool mark = false;
+#ifndef UWS_HTTPRESPONSE_NO_WRITEMARK
+        mark = !((LoopData *) us_loop_ext((us_loop_t *) Loop::get()))->noMark;
+#endif
+        HttpContextData<SSL> *httpContextData = httpContext->getSocketContextData();
+        std::unique_ptr<StaticAssets> staticAssets = std::make_unique<StaticAssets>(urlPrefix, root, std::move(options), mark);
+        if (!staticAssets->isOpen()) {
+            std::cerr << "Error: serveStatic cannot read directory " << root << "!" << std::endl;
+            std::terminate();
+        }
+
+#ifdef __linux__
+        if (int reloadInterval = staticAssets->getReloadInterval(); reloadInterval && !httpContextData->staticAssetsTimer) {
+            /* Falls through, so that it does not keep the loop alive */
+            httpContextData->staticAssetsTimer = us_create_timer((us_loop_t *) Loop::get(), 1, sizeof(HttpContextData<SSL> *));
+            *(HttpContextData<SSL> **) us_timer_ext(httpContextData->staticAssetsTimer) = httpContextData;
+            us_timer_set(httpContextData->staticAssetsTimer, [](us_timer_t *t) {
+                for (auto &staticAssets : (*(HttpContextData<SSL> **) us_timer_ext(t))->staticAssets) {
+                    staticAssets->update();
+                }
+            }, reloadInterval, reloadInterval);
+        }
+#endif
+        httpContextData->staticAssets.push_back(std::move(staticAssets));
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+#endif
+
+    /* Compresses bodies passed to end (of at least options.minSize, if that makes them smaller) and streamed with write,
+     * with the best of options.encodings the client accepts. Bodies of tryEnd, sendFile and ResponseTemplate are sent
+     * as they are, and so is any response you write a Content-Encoding header for */
+    TemplatedApp &&compress(HttpCompressionOptions options = {}) {
+        if (httpContext) {
+            options.encodings &= AVAILABLE_CONTENT_ENCODINGS;
+            httpContext->getSocketContextData()->compression = options;
+        }
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+    /* Limits new connections and requests per client address, in fixed memory however many clients there are.
+     * Connections over the limit are closed as they open, before any filter or TLS handshake, requests over it are
+     * answered 429. With UWS_WITH_PROXY, addresses are those of PROXY headers, checked at the first request */
+    TemplatedApp &&rateLimit(RateLimitOptions options) {
+        if (httpContext) {
+            httpContext->getSocketContextData()->rateLimiter.reset((options.connectionsPerSecond || options.requestsPerSecond) ? new RateLimiter(options) : nullptr);
+        }
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
     /* Host, port, callback */
     TemplatedApp &&listen(std::string host, int port, MoveOnlyFunction<void(us_listen_socket_t *)> &&handler) {
         if (!host.length()) {
@@ -646,6 +1008,159 @@ public:
         return std::move(static_cast<TemplatedApp &&>(*this));
     }
 
+    /* Moves ws to the same route of target, an app on another loop set up like the app of ws (such as the apps of
+     * a LocalCluster), connection, user data, topics, compression and backpressure alike. Call it on the loop of ws
+     * outside of its handlers. It leaves right away and arrives once the loop of target gets to it. Returns false,
+     * leaving ws be, for TLS and while a worker or coroutine is busy with ws */
+    template <typename UserData>
+    static bool migrate(WebSocket<SSL, true, UserData> *ws, TemplatedApp *target) {
+        auto *webSocketContextData = (WebSocketContextData<SSL, UserData, true> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) ws));
+        if (!target->httpContext || webSocketContextData->routeIndex >= target->webSocketContexts.size()) {
+            return false;
+        }
+
+        auto *migratingSocket = WebSocketContext<SSL, true, UserData>::detach((us_socket_t *) ws);
+        if (!migratingSocket) {
+            return false;
+        }
+
+        auto *webSocketContext = (WebSocketContext<SSL, true, UserData> *) target->webSocketContexts[webSocketContextData->routeIndex];
+        target->getLoop()->defer([webSocketContext, migratingSocket]() {
+            webSocketContext->attach(migratingSocket);
+        });
+        return true;
+    }
+
+#ifndef _WIN32
+    /* Restarts without dropping anyone (see Handoff.h). Waits at the Unix socket path for a process to takeOver from
+     * us, then gives it listenSockets and stops accepting on them. From then on this loop drains: requests are answered
+     * with Connection: close, and plain TCP WebSockets are handed over as they next have data (those that cannot go are
+     * closed with 1012, see WebSocketContext::handOff), their leave handler called. handedOff is called once the new
+     * process listens, a good time to close what is left after a grace period. One app per loop hands off */
+    TemplatedApp &&handOff(std::string path, std::vector<us_listen_socket_t *> listenSockets, MoveOnlyFunction<void()> &&handedOff = nullptr) {
+        if (!httpContext) {
+            return std::move(static_cast<TemplatedApp &&>(*this));
+        }
+
+        HttpContextData<SSL> *httpContextData = httpContext->getSocketContextData();
+        int listener = httpContextData->handOffTimer ? -1 : Handoff::listen(path.c_str());
+        if (listener == -1) {
+            std::cerr << "Error: handOff cannot listen at " << path << "!" << std::endl;
+            std::terminate();
+        }
+        httpContextData->handOffWaiting.reset(new Handoff::Waiting{listener, std::move(path), std::move(listenSockets), std::move(handedOff)});
+
+        /* Falls through, so that it does not keep the loop alive */
+        httpContextData->handOffTimer = us_create_timer((us_loop_t *) Loop::get(), 1, sizeof(HttpContextData<SSL> *));
+        *(HttpContextData<SSL> **) us_timer_ext(httpContextData->handOffTimer) = httpContextData;
+        us_timer_set(httpContextData->handOffTimer, [](us_timer_t *t) {
+            HttpContextData<SSL> *httpContextData = *(HttpContextData<SSL> **) us_timer_ext(t);
+            Handoff::Waiting *waiting = httpContextData->handOffWaiting.get();
+            int channel = Handoff::accept(waiting->listener);
+            if (channel == -1) {
+                return;
+            }
+
+            /* One that goes away before it has everything is as good as none, we keep waiting */
+            bool sent = true;
+            for (us_listen_socket_t *listenSocket : waiting->listenSockets) {
+                sent = sent && Handoff::send(channel, Handoff::LISTEN_SOCKET, {}, (int) (intptr_t) us_socket_get_native_handle(0, (us_socket_t *) listenSocket));
+            }
+            if (!sent || !Handoff::send(channel, Handoff::LISTENING)) {
+                ::close(channel);
+                return;
+            }
+            for (us_listen_socket_t *listenSocket : waiting->listenSockets) {
+                ((LoopData *) us_loop_ext(us_timer_loop(t)))->forgetListenSockets(nullptr, listenSocket);
+                us_listen_socket_close(SSL, listenSocket);
+            }
+
+            /* Every WebSocket with data is a candidate, handed over after the iteration */
+            Loop *loop = (Loop *) us_timer_loop(t);
+            LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) loop);
+            loopData->handoffChannel = channel;
+            loopData->migrationsWanted = UINT_MAX;
+            loopData->migrationTarget = &loopData->handoffChannel;
+            loop->addPostHandler(&loopData->handoffChannel, [loopData](Loop */*loop*/) {
+                std::vector<LoopData::MigrationCandidate> migrationCandidates;
+                migrationCandidates.swap(loopData->migrationCandidates);
+                for (LoopData::MigrationCandidate &migrationCandidate : migrationCandidates) {
+                    if (!us_socket_is_closed(0, (us_socket_t *) migrationCandidate.socket)) {
+                        migrationCandidate.migrate(migrationCandidate.socket, loopData->migrationTarget);
+                    }
+                }
+            });
+
+            MoveOnlyFunction<void()> handedOff = std::move(waiting->handedOff);
+            httpContextData->handOffWaiting.reset();
+            httpContextData->handOffTimer = nullptr;
+            us_timer_close(t);
+            if (handedOff) {
+                handedOff();
+            }
+        }, 100, 100);
+
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+
+    /* Takes over from a process that called handOff at the Unix socket path (see Handoff.h), with every route added.
+     * Blocks until it has the listen sockets of that process, then accepts on them on a thread of its own, adopting
+     * on this loop, and takes over its WebSockets as they come. handler is called with whether it worked, when it did
+     * not (nobody at path) nothing was taken over and you listen as usual */
+    TemplatedApp &&takeOver(std::string path, MoveOnlyFunction<void(bool)> &&handler) {
+        int channel = httpContext ? Handoff::connect(path.c_str()) : -1;
+        std::vector<int> listenSockets;
+        bool listening = false;
+        Handoff::Type type;
+        std::string payload;
+        int fd;
+        while (channel != -1 && !listening && Handoff::receive(channel, type, payload, fd)) {
+            if (type == Handoff::LISTEN_SOCKET && fd != -1) {
+                listenSockets.push_back(fd);
+            } else if (fd != -1) {
+                ::close(fd);
+            }
+            listening = type == Handoff::LISTENING;
+        }
+
+        if (!listening) {
+            for (int listenSocket : listenSockets) {
+                ::close(listenSocket);
+            }
+            if (channel != -1) {
+                ::close(channel);
+            }
+            handler(false);
+            return std::move(static_cast<TemplatedApp &&>(*this));
+        }
+
+        /* As listen would */
+        httpContext->getSocketContextData()->router.freeze();
+
+        Loop *loop = Loop::get();
+        httpContext->getSocketContextData()->handoff = std::make_unique<Handoff>(channel, std::move(listenSockets),
+            [loop, httpContext = httpContext](int fd, char *ip, int ipLength) {
+                loop->defer([httpContext, fd, address = ip ? std::string(ip, (size_t) ipLength) : std::string()]() mutable {
+                    httpContext->adoptAcceptedSocket(fd, address.data(), (int) address.length());
+                });
+            },
+            [loop, webSocketContexts = webSocketContexts, webSocketTakeOvers = webSocketTakeOvers](int fd, std::string &&payload) {
+                Handoff::Reader reader{payload};
+                uint64_t routeIndex = reader.number();
+                if (!reader.ok || routeIndex >= webSocketContexts.size()) {
+                    ::close(fd);
+                    return;
+                }
+                loop->defer([webSocketContext = webSocketContexts[routeIndex], takeOver = webSocketTakeOvers[routeIndex], fd, payload = std::move(payload)]() {
+                    takeOver(webSocketContext, fd, payload);
+                });
+            });
+
+        handler(true);
+        return std::move(static_cast<TemplatedApp &&>(*this));
+    }
+#endif
+
     TemplatedApp &&run() {
         uWS::run();
         return std::move(static_cast<TemplatedApp &&>(*this));
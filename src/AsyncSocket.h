@@ -25,12 +25,31 @@
  * to signal error with -1 (which is how the entire UNIX syscalling is built). */
 
 #include <cstring>
+#include <climits>
+#include <cerrno>
 #include <iostream>
 
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#endif
+
 #include "libusockets.h"
 
 #include "LoopData.h"
 #include "AsyncSocketData.h"
+#include "KernelTls.h"
 
 namespace uWS {
 
@@ -48,9 +67,14 @@ struct AsyncSocket {
     template <bool> friend struct HttpContext;
     template <bool, bool, typename> friend struct WebSocketContext;
     template <bool> friend struct TemplatedApp;
-    template <bool, typename> friend struct WebSocketContextData;
+    template <bool, typename> friend struct TemplatedClientApp;
+    template <bool> friend struct TemplatedHttpClient;
+    template <bool> friend struct TemplatedHttpProxy;
+    template <bool, typename, bool> friend struct WebSocketContextData;
     template <typename, typename> friend struct TopicTree;
     template <bool> friend struct HttpResponse;
+    friend struct Http2Response;
+    friend struct Http2Context;
 
 private:
     /* Helper, do not use directly (todo: move to uSockets or de-crazify) */
@@ -96,9 +120,81 @@ protected:
         us_socket_timeout(SSL, (us_socket_t *) this, seconds);
     }
 
+    /* Whether what we write goes through the SSL layer of uSockets, as the ssl argument it takes */
+    int tls() {
+#ifdef UWS_WITH_KTLS
+        if (SSL && getAsyncSocketData()->kernelTls) {
+            return 0;
+        }
+#endif
+        return SSL;
+    }
+
+    /* The largest TLS record */
+    static constexpr unsigned int MAX_TLS_RECORD_SIZE = 16 * 1024;
+
+    /* Writes through uSockets like us_socket_write. With dynamic TLS record sizing, writes after a second of idle start over
+     * with records of tlsInitialRecordSize bytes, every full one doubling the next up to MAX_TLS_RECORD_SIZE. Each record
+     * is its own SSL write, so the first of them leaves before the rest is encrypted */
+    int socketWrite(const char *src, int length, int msgMore) {
+        if constexpr (SSL) {
+            AsyncSocketData<SSL> *asyncSocketData = getAsyncSocketData();
+            if (asyncSocketData->tlsInitialRecordSize && tls()) {
+                LoopData *loopData = getLoopData();
+                unsigned int now = (unsigned int) loopData->cacheTimepoint;
+                if (!asyncSocketData->tlsRecordSize || now - asyncSocketData->tlsLastWrite > 1) {
+                    asyncSocketData->tlsRecordSize = asyncSocketData->tlsInitialRecordSize;
+                    UWS_METRIC(loopData, tlsRecordRamps, 1);
+                }
+                asyncSocketData->tlsLastWrite = now;
+
+                int written = 0;
+                while (asyncSocketData->tlsRecordSize < MAX_TLS_RECORD_SIZE && written < length) {
+                    int recordSize = std::min<int>(length - written, asyncSocketData->tlsRecordSize);
+                    int recordWritten = std::max(us_socket_write(1, (us_socket_t *) this, src + written, recordSize, msgMore || written + recordSize < length), 0);
+                    UWS_METRIC(loopData, tlsSmallRecords, 1);
+                    written += recordWritten;
+                    if (recordWritten < recordSize) {
+                        return written;
+                    }
+                    if (recordSize == asyncSocketData->tlsRecordSize) {
+                        asyncSocketData->tlsRecordSize = (unsigned short) std::min<unsigned int>(2u * (unsigned int) recordSize, MAX_TLS_RECORD_SIZE);
+                    }
+                }
+                if (written < length) {
+                    written += std::max(us_socket_write(1, (us_socket_t *) this, src + written, length - written, msgMore), 0);
+                }
+                return written;
+            }
+        }
+        return us_socket_write(tls(), (us_socket_t *) this, src, length, msgMore);
+    }
+
+    /* Tries once to have the kernel encrypt from now on, which needs the handshake done and nothing
+     * of the SSL layer or ours waiting to be sent. Safe to call on every read */
+    void offloadTls() {
+#if defined(UWS_WITH_KTLS) && defined(__linux__)
+        if constexpr (SSL) {
+            AsyncSocketData<SSL> *asyncSocketData = getAsyncSocketData();
+            if (asyncSocketData->kernelTlsTried || !SSL_is_init_finished((::SSL *) getNativeHandle())) {
+                return;
+            }
+            asyncSocketData->kernelTlsTried = true;
+            if (!asyncSocketData->buffer.length() && !(isCorked() && getLoopData()->corkOffset)) {
+                asyncSocketData->kernelTls = KernelTls::offloadTx((int) us_poll_fd((struct us_poll_t *) this), (::SSL *) getNativeHandle());
+            }
+        }
+#endif
+    }
+
     /* Shutdown socket without any automatic drainage */
     void shutdown() {
-        us_socket_shutdown(SSL, (us_socket_t *) this);
+#if defined(UWS_WITH_KTLS) && defined(__linux__)
+        if (!tls() && SSL) {
+            KernelTls::sendCloseNotify((int) us_poll_fd((struct us_poll_t *) this));
+        }
+#endif
+        us_socket_shutdown(tls(), (us_socket_t *) this);
     }
 
     /* Experimental pause */
@@ -113,6 +209,71 @@ protected:
         return (us_socket_t *) this;
     }
 
+    /* Stops reading from us while our loop is over its backpressure budget with PAUSE_READS. Unlike pause,
+     * writing goes on so that what is held drains */
+    void pauseReadsOverBudget() {
+        LoopData *loopData = getLoopData();
+        if (!(loopData->backpressurePolicies & PAUSE_READS) || !loopData->overBackpressureBudget()) {
+            return;
+        }
+        if (pauseReads()) {
+            UWS_METRIC(loopData, budgetPausedReads, 1);
+        }
+    }
+
+    /* Stops reading from a socket just accepted while our loop lags behind with PAUSE_CONNECTIONS */
+    void pauseReadsLagging() {
+        LoopData *loopData = getLoopData();
+        if (!loopData->overLag(100, PAUSE_CONNECTIONS)) {
+            return;
+        }
+        if (pauseReads()) {
+            UWS_METRIC(loopData, lagPausedConnections, 1);
+        }
+    }
+
+    /* Has the kernel busy poll the device queue of a socket just accepted by a loop that busy polls (Loop::setBusyPoll)
+     * rather than wait for its interrupt. Raising SO_BUSY_POLL past net.core.busy_read needs CAP_NET_ADMIN */
+    void inheritBusyPoll() {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+        if (int microseconds = (int) getLoopData()->busyPoll) {
+            int fd = (int) us_poll_fd((struct us_poll_t *) this), one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &microseconds, sizeof(microseconds));
+            setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+        }
+#endif
+    }
+
+    /* Until the end of the first iteration under 3/4 of both the backpressure budget and maxLag */
+    bool pauseReads() {
+        struct us_poll_t *p = (struct us_poll_t *) this;
+        int events = us_poll_events(p);
+        if (!(events & LIBUS_SOCKET_READABLE)) {
+            return false;
+        }
+        us_poll_change(p, us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) this)), events & LIBUS_SOCKET_WRITABLE);
+        getLoopData()->pausedReads.push_back({this, resumePausedReads});
+        return true;
+    }
+
+    static void resumePausedReads(void *s) {
+        struct us_poll_t *p = (struct us_poll_t *) s;
+        us_poll_change(p, us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) s)), us_poll_events(p) | LIBUS_SOCKET_READABLE);
+    }
+
+    /* Closed (and adopted) sockets must not be resumed. Returns whether we were paused */
+    bool forgetPausedReads() {
+        std::vector<LoopData::PausedReads> &pausedReads = getLoopData()->pausedReads;
+        for (size_t i = 0; i < pausedReads.size(); i++) {
+            if (pausedReads[i].socket == this) {
+                pausedReads[i] = pausedReads.back();
+                pausedReads.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
     /* Immediately close socket */
     us_socket_t *close() {
         return us_socket_close(SSL, (us_socket_t *) this, 0, nullptr);
@@ -151,13 +312,25 @@ protected:
         return getLoopData()->corkedSocket == nullptr;
     }
 
+    /* Metrics of one write syscall */
+    void countWrite(LoopData *loopData, ssize_t written) {
+        UWS_METRIC(loopData, writeSyscalls, 1);
+        UWS_METRIC(loopData, bytesWritten, written > 0 ? written : 0);
+#ifndef UWS_WITH_METRICS
+        (void) loopData;
+        (void) written;
+#endif
+    }
+
     /* Returns a suitable buffer for temporary assemblation of send data */
     std::pair<char *, SendBufferAttribute> getSendBuffer(size_t size) {
         /* First step is to determine if we already have backpressure or not */
         LoopData *loopData = getLoopData();
         BackPressure &backPressure = getAsyncSocketData()->buffer;
         size_t existingBackpressure = backPressure.length();
-        if ((!existingBackpressure) && (isCorked() || canCork()) && (loopData->corkOffset + size < LoopData::CORK_BUFFER_SIZE)) {
+        if ((!existingBackpressure) && (isCorked() || canCork()) && (loopData->corkOffset + size < loopData->corkBufferSize)) {
+            UWS_METRIC(loopData, corkHits, 1);
+
             /* Cork automatically if we can */
             if (isCorked()) {
                 char *sendBuffer = loopData->corkBuffer + loopData->corkOffset;
@@ -170,6 +343,9 @@ protected:
                 return {sendBuffer, SendBufferAttribute::NEEDS_UNCORK};
             }
         } else {
+            if (!existingBackpressure && (isCorked() || canCork())) {
+                loopData->corkOverflow(loopData->corkOffset + size);
+            }
 
             /* If we are corked and there is already data in the cork buffer,
             mark how much is ours and reset it */
@@ -179,20 +355,86 @@ protected:
                 loopData->corkOffset = 0;
             }
 
+            UWS_METRIC(loopData, corkMisses, 1);
+            UWS_METRIC(loopData, backpressureBytes, size);
+
             /* Fallback is to use the backpressure as buffer */
-            backPressure.resize(ourCorkOffset + existingBackpressure + size);
+            char *sendBuffer = backPressure.appendUninitialized(ourCorkOffset + size);
 
             /* And copy corkbuffer in front */
-            memcpy((char *) backPressure.data() + existingBackpressure, loopData->corkBuffer, ourCorkOffset);
+            memcpy(sendBuffer, loopData->corkBuffer, ourCorkOffset);
 
-            return {(char *) backPressure.data() + ourCorkOffset + existingBackpressure, SendBufferAttribute::NEEDS_DRAIN};
+            return {sendBuffer + ourCorkOffset, SendBufferAttribute::NEEDS_DRAIN};
         }
     }
 
+    /* Whether length more bytes for the corked socket should wait in its backpressure rather than be written now */
+    bool holdsCork(LoopData *loopData, size_t length) {
+        return loopData->holdCork && loopData->corkedSocket == this
+            && getAsyncSocketData()->buffer.length() + loopData->corkOffset + length <= LoopData::MAX_HELD_CORK_SIZE;
+    }
+
     /* Returns the user space backpressure. */
     unsigned int getBufferedAmount() {
-        /* We return the actual amount of bytes in backbuffer, including pendingRemoval */
-        return (unsigned int) getAsyncSocketData()->buffer.totalLength();
+        return (unsigned int) getAsyncSocketData()->buffer.length();
+    }
+
+    /* Writes off as much backpressure as we can, returns true if all of it. Non-SSL writes up to
+     * MAX_DRAIN_SEGMENTS chunks per syscall, such as held pipelined responses */
+    bool drainBackPressure(bool msgMore) {
+        BackPressure &backPressure = getAsyncSocketData()->buffer;
+
+#ifndef _WIN32
+        static constexpr size_t MAX_DRAIN_SEGMENTS = 64;
+        std::string_view segments[MAX_DRAIN_SEGMENTS];
+        size_t numSegments;
+        while (!tls() && (numSegments = backPressure.segments(segments, MAX_DRAIN_SEGMENTS)) > 2) {
+            struct iovec iov[MAX_DRAIN_SEGMENTS];
+            size_t wanted = 0;
+            for (size_t i = 0; i < numSegments; i++) {
+                iov[i] = {(void *) segments[i].data(), segments[i].length()};
+                wanted += segments[i].length();
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = numSegments;
+            /* A peer that reset must not raise SIGPIPE */
+            ssize_t written = sendmsg((int) us_poll_fd((struct us_poll_t *) this), &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            countWrite(getLoopData(), written);
+            if (written > 0) {
+                backPressure.erase((size_t) written);
+            }
+            /* Whatever is left goes through uSockets below, which polls for writable if it fails too */
+            if ((size_t) std::max<ssize_t>(written, 0) < wanted) {
+                break;
+            }
+        }
+#endif
+
+        while (backPressure.length()) {
+            std::string_view first = backPressure.front();
+            std::string_view second = backPressure.second();
+            int firstLength = (int) std::min<size_t>(first.length(), INT_MAX);
+            int written, wanted;
+
+            if (!tls() && second.length() && firstLength < INT_MAX) {
+                int secondLength = (int) std::min<size_t>(second.length(), (size_t) (INT_MAX - firstLength));
+                wanted = firstLength + secondLength;
+                written = us_socket_write2(0, (us_socket_t *) this, first.data(), firstLength, second.data(), secondLength);
+            } else {
+                wanted = firstLength;
+                written = socketWrite(first.data(), firstLength, msgMore || backPressure.length() > (size_t) firstLength);
+            }
+            countWrite(getLoopData(), written);
+
+            if (written > 0) {
+                backPressure.erase((size_t) written);
+            }
+            if (written < wanted) {
+                return false;
+            }
+        }
+        return true;
     }
 
     /* Returns the text representation of an IPv4 or IPv6 address */
@@ -244,56 +486,55 @@ protected:
 
         /* We are limited if we have a per-socket buffer */
         if (asyncSocketData->buffer.length()) {
-            /* Write off as much as we can */
-            int written = us_socket_write(SSL, (us_socket_t *) this, asyncSocketData->buffer.data(), (int) asyncSocketData->buffer.length(), /*nextLength != 0 | */length);
-
-            /* On failure return, otherwise continue down the function */
-            if ((unsigned int) written < asyncSocketData->buffer.length()) {
-
-                /* Update buffering (todo: we can do better here if we keep track of what happens to this guy later on) */
-                asyncSocketData->buffer.erase((unsigned int) written);
+            /* What waits there is sent along with this at uncork */
+            if (holdsCork(loopData, (size_t) length)) {
+                asyncSocketData->buffer.append(src, (size_t) length);
+                return {length, false};
+            }
 
+            /* Write off as much as we can, on failure return, otherwise continue down the function */
+            if (!drainBackPressure(length != 0)) {
                 if (optionally) {
                     /* Thankfully we can exit early here */
                     return {0, true};
                 } else {
                     /* This path is horrible and points towards erroneous usage */
                     asyncSocketData->buffer.append(src, (unsigned int) length);
+                    UWS_METRIC(loopData, backpressureBytes, length);
 
                     return {length, true};
                 }
             }
 
             /* At this point we simply have no buffer and can continue as normal */
-            asyncSocketData->buffer.clear();
         }
 
         if (length) {
             if (loopData->corkedSocket == this) {
                 /* We are corked */
-                if (LoopData::CORK_BUFFER_SIZE - loopData->corkOffset >= (unsigned int) length) {
+                if (loopData->corkBufferSize - loopData->corkOffset >= (unsigned int) length) {
                     /* If the entire chunk fits in cork buffer */
                     memcpy(loopData->corkBuffer + loopData->corkOffset, src, (unsigned int) length);
                     loopData->corkOffset += (unsigned int) length;
                     /* Fall through to default return */
                 } else {
-                    /* Strategy differences between SSL and non-SSL regarding syscall minimizing */
-                    if constexpr (false) {
-                        /* Cork up as much as we can */
-                        unsigned int stripped = LoopData::CORK_BUFFER_SIZE - loopData->corkOffset;
-                        memcpy(loopData->corkBuffer + loopData->corkOffset, src, stripped);
-                        loopData->corkOffset = LoopData::CORK_BUFFER_SIZE;
-
-                        auto [written, failed] = uncork(src + stripped, length - (int) stripped, optionally);
-                        return {written + (int) stripped, failed};
+                    loopData->corkOverflow(loopData->corkOffset + (size_t) length);
+
+                    if (holdsCork(loopData, (size_t) length)) {
+                        /* Move the cork buffer out of the way, all of it is written at uncork */
+                        asyncSocketData->buffer.append(loopData->corkBuffer, loopData->corkOffset);
+                        asyncSocketData->buffer.append(src, (size_t) length);
+                        loopData->corkOffset = 0;
+                        /* Fall through to default return */
+                    } else {
+                        /* Goes out right behind the cork buffer, straight from src */
+                        return writeScattered(nullptr, 0, src, length, optionally);
                     }
-
-                    /* For non-SSL we take the penalty of two syscalls */
-                    return uncork(src, length, optionally);
                 }
             } else {
                 /* We are not corked */
-                int written = us_socket_write(SSL, (us_socket_t *) this, src, length, nextLength != 0);
+                int written = socketWrite(src, length, nextLength != 0);
+                countWrite(loopData, written);
 
                 /* Did we fail? */
                 if (written < length) {
@@ -303,13 +544,9 @@ protected:
                     }
 
                     /* Fall back to worst possible case (should be very rare for HTTP) */
-                    /* At least we can reserve room for next chunk if we know it up front */
-                    if (nextLength) {
-                        asyncSocketData->buffer.reserve(asyncSocketData->buffer.length() + (size_t) (length - written + nextLength));
-                    }
-
                     /* Buffer this chunk */
                     asyncSocketData->buffer.append(src + written, (size_t) (length - written));
+                    UWS_METRIC(loopData, backpressureBytes, length - written);
 
                     /* Return the failure */
                     return {length, true};
@@ -322,6 +559,332 @@ protected:
         return {length, false};
     }
 
+    /* Writes data with descriptor fd attached (SCM_RIGHTS) over a Unix socket, the peer receiving fd along with its first
+     * byte, such as a memfd holding a large payload. Only when nothing waits before it, in backpressure or the cork buffer.
+     * Then what the socket does not take at once is buffered as write would. Returns false, having sent nothing, for TLS,
+     * when something waits, or when the socket takes none of it (or is no Unix socket) */
+    bool writeWithDescriptor(const char *data, int length, int fd) {
+#ifndef _WIN32
+        if (SSL || length <= 0 || getAsyncSocketData()->buffer.length() || (isCorked() && getLoopData()->corkOffset)
+            || us_socket_is_closed(SSL, (us_socket_t *) this)) {
+            return false;
+        }
+
+        struct iovec iov = {(void *) data, (size_t) length};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+        ssize_t written;
+        while ((written = sendmsg((int) us_poll_fd((struct us_poll_t *) this), &msg, MSG_DONTWAIT | MSG_NOSIGNAL)) == -1 && errno == EINTR);
+        countWrite(getLoopData(), written);
+        if (written <= 0) {
+            return false;
+        }
+        if (written < length) {
+            write(data + written, length - (int) written);
+        }
+        return true;
+#else
+        (void) data;
+        (void) length;
+        (void) fd;
+        return false;
+#endif
+    }
+
+    /* Writes a small header and then a payload too large for the cork buffer, whatever is corked going first. The payload
+     * is never copied unless the socket does not take all of it, then only its unsent tail is buffered (or not at all if
+     * optionally). If the payload lies within frame, to its end, even that tail is referenced instead. Without SSL
+     * everything goes in one writev. Stays corked for whomever corked us. Returns like write. */
+    std::pair<int, bool> writeScattered(const char *header, int headerLength, const char *src, int length, bool optionally = false, SharedFrame *frame = nullptr) {
+        if (us_socket_is_closed(SSL, (us_socket_t *) this)) {
+            return {length, false};
+        }
+
+        LoopData *loopData = getLoopData();
+        BackPressure &backPressure = getAsyncSocketData()->buffer;
+
+        auto bufferPayload = [&backPressure, frame, src, length](int offset) {
+            if (frame && src + length == frame->data() + frame->length) {
+                backPressure.appendShared(frame, (size_t) (src + offset - frame->data()));
+            } else {
+                backPressure.append(src + offset, (size_t) (length - offset));
+            }
+        };
+
+        /* The header joins what is corked, all of it goes in front of the payload */
+        if (isCorked()) {
+            if (loopData->corkBufferSize - loopData->corkOffset < (unsigned int) headerLength) {
+                uncork();
+                cork();
+            }
+            if (headerLength) {
+                memcpy(loopData->corkBuffer + loopData->corkOffset, header, (size_t) headerLength);
+                loopData->corkOffset += (unsigned int) headerLength;
+            }
+            header = loopData->corkBuffer;
+            headerLength = (int) loopData->corkOffset;
+            loopData->corkOffset = 0;
+        }
+
+        /* What waits is sent along with this at uncork */
+        if (holdsCork(loopData, (size_t) headerLength + (size_t) length)) {
+            backPressure.append(header, (size_t) headerLength);
+            bufferPayload(0);
+            return {length, false};
+        }
+
+        /* Nothing jumps the queue of what is already buffered */
+        if (backPressure.length() && !drainBackPressure(true)) {
+            backPressure.append(header, (size_t) headerLength);
+            if (optionally) {
+                return {0, true};
+            }
+            bufferPayload(0);
+            UWS_METRIC(loopData, backpressureBytes, length);
+            return {length, true};
+        }
+
+        int written;
+        if (!tls()) {
+            written = std::max(us_socket_write2(0, (us_socket_t *) this, header, headerLength, src, length), 0);
+            countWrite(loopData, written);
+        } else {
+            /* Without access to the SSL object each of the two becomes its own record(s), still never copied by us */
+            written = 0;
+            if (headerLength) {
+                written = std::max(socketWrite(header, headerLength, 1), 0);
+                countWrite(loopData, written);
+            }
+            if (written == headerLength) {
+                int payloadWritten = socketWrite(src, length, 0);
+                countWrite(loopData, payloadWritten);
+                written += std::max(payloadWritten, 0);
+            }
+        }
+
+        /* Only the unsent tail is buffered */
+        if (written < headerLength) {
+            backPressure.append(header + written, (size_t) (headerLength - written));
+        }
+        int payloadWritten = std::max(written - headerLength, 0);
+        if (payloadWritten < length) {
+            if (optionally) {
+                return {payloadWritten, true};
+            }
+            bufferPayload(payloadWritten);
+            UWS_METRIC(loopData, backpressureBytes, length - payloadWritten);
+            return {length, true};
+        }
+        return {length, false};
+    }
+
+    /* Like write, but src lies within frame and whatever the socket does not take is referenced instead of copied.
+     * Only what fits the cork buffer is copied there */
+    std::pair<int, bool> writeShared(SharedFrame *frame, const char *src, int length, bool optionally = false) {
+        LoopData *loopData = getLoopData();
+        if (isCorked()) {
+            if (loopData->corkBufferSize - loopData->corkOffset >= (unsigned int) length) {
+                return write(src, length, optionally);
+            }
+            loopData->corkOverflow(loopData->corkOffset + (size_t) length);
+        }
+        return writeScattered(nullptr, 0, src, length, optionally, frame);
+    }
+
+    /* Writes a frame shared with other sockets. It is only ever copied into the cork buffer, anything the
+     * socket does not take right away is referenced by our backpressure. Returns false on backpressure. */
+    bool writeShared(SharedFrame *frame) {
+        if (us_socket_is_closed(SSL, (us_socket_t *) this)) {
+            return true;
+        }
+
+        LoopData *loopData = getLoopData();
+        BackPressure &backPressure = getAsyncSocketData()->buffer;
+
+        /* Anything already buffered goes first */
+        if (backPressure.length() && !drainBackPressure(true)) {
+            backPressure.appendShared(frame, 0);
+            UWS_METRIC(loopData, backpressureBytes, frame->length);
+            return false;
+        }
+
+        if (isCorked()) {
+            if (loopData->corkBufferSize - loopData->corkOffset >= frame->length) {
+                memcpy(loopData->corkBuffer + loopData->corkOffset, frame->data(), frame->length);
+                loopData->corkOffset += (unsigned int) frame->length;
+                return true;
+            }
+            loopData->corkOverflow(loopData->corkOffset + frame->length);
+
+            /* Too big for what is left of the cork buffer, send that off and stay corked for whomever corked us */
+            auto [written, failed] = uncork();
+            cork();
+            if (failed) {
+                backPressure.appendShared(frame, 0);
+                UWS_METRIC(loopData, backpressureBytes, frame->length);
+                return false;
+            }
+        }
+
+        int written = socketWrite(frame->data(), (int) std::min<size_t>(frame->length, INT_MAX), 0);
+        countWrite(loopData, written);
+        if ((size_t) std::max<int>(written, 0) < frame->length) {
+            backPressure.appendShared(frame, (size_t) std::max<int>(written, 0));
+            UWS_METRIC(loopData, backpressureBytes, frame->length - (size_t) std::max<int>(written, 0));
+            return false;
+        }
+        return true;
+    }
+
+#ifndef _WIN32
+    /* Writes up to length bytes of fd from offset, never buffering any of it. Whatever is corked or buffered
+     * goes first. Without SSL (or with kTLS) the bytes go from the page cache with sendfile, otherwise they are read in chunks.
+     * Returns bytes of the file written and whether we are now polling for writable. */
+    std::pair<uintmax_t, bool> writeFile(int fd, uintmax_t offset, uintmax_t length) {
+        if (us_socket_is_closed(SSL, (us_socket_t *) this)) {
+            return {length, false};
+        }
+
+        /* What is corked was written before us, stay corked for whomever corked us */
+        if (isCorked()) {
+            auto [written, failed] = uncork();
+            cork();
+            if (failed) {
+                return {0, true};
+            }
+        }
+
+        if (getAsyncSocketData()->buffer.length() && !drainBackPressure(true)) {
+            return {0, true};
+        }
+
+        uintmax_t written = 0;
+        char buffer[16 * 1024];
+        while (written < length) {
+            size_t chunk = (size_t) std::min<uintmax_t>(length - written, sizeof(buffer));
+#ifdef __linux__
+            if (!tls()) {
+                off_t fileOffset = (off_t) (offset + written);
+                ssize_t sent = sendfile((int) us_poll_fd((struct us_poll_t *) this), fd, &fileOffset, (size_t) std::min<uintmax_t>(length - written, 1 << 30));
+                countWrite(getLoopData(), sent);
+                if (sent > 0) {
+                    written += (uintmax_t) sent;
+                    continue;
+                }
+                if (sent == -1 && errno == EINTR) {
+                    continue;
+                }
+
+                /* uSockets only polls for writable when its own write fails, so the byte sendfile could not
+                 * take goes through it. Most likely it fails like sendfile did, if not we got one byte further */
+                chunk = 1;
+            }
+#endif
+            ssize_t read = pread(fd, buffer, chunk, (off_t) (offset + written));
+            if (read <= 0) {
+                if (read == -1 && errno == EINTR) {
+                    continue;
+                }
+                /* The file shrunk under us (or cannot be read), this response can never complete */
+                close();
+                return {written, true};
+            }
+
+            int sent = socketWrite(buffer, (int) read, 0);
+            countWrite(getLoopData(), sent);
+            written += (uintmax_t) std::max(sent, 0);
+            if ((ssize_t) sent < read) {
+                return {written, true};
+            }
+        }
+        return {written, false};
+    }
+#endif
+
+#ifdef __linux__
+    /* Moves up to length bytes from fd (a socket or pipe) to us with splice through the pipe of the loop, never
+     * through user space. Stops when fd has nothing more to read right now. Whatever the pipe still holds once
+     * we stop taking it is read back and buffered like any other write. Whatever is corked or buffered goes first,
+     * and nothing is moved with TLS (but kTLS). Returns bytes moved and whether we are now polling for writable */
+    std::pair<uintmax_t, bool> writeSpliced(int fd, uintmax_t length) {
+        if (us_socket_is_closed(SSL, (us_socket_t *) this) || tls()) {
+            return {0, false};
+        }
+
+        /* What is corked was written before us, stay corked for whomever corked us */
+        if (isCorked()) {
+            auto [written, failed] = uncork();
+            cork();
+            if (failed) {
+                return {0, true};
+            }
+        }
+
+        if (getAsyncSocketData()->buffer.length() && !drainBackPressure(true)) {
+            return {0, true};
+        }
+
+        LoopData *loopData = getLoopData();
+        int *pipe = loopData->getSplicePipe();
+        if (!pipe) {
+            return {0, false};
+        }
+
+        uintmax_t moved = 0;
+        while (moved < length) {
+            ssize_t in = splice(fd, nullptr, pipe[1], nullptr, (size_t) std::min<uintmax_t>(length - moved, 64 * 1024), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (in <= 0) {
+                if (in == -1 && errno == EINTR) {
+                    continue;
+                }
+                /* Drained (or closed, which fd finds out for itself) */
+                break;
+            }
+            moved += (uintmax_t) in;
+
+            while (in) {
+                ssize_t out = splice(pipe[0], nullptr, (int) us_poll_fd((struct us_poll_t *) this), nullptr, (size_t) in, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (out <= 0) {
+                    if (out == -1 && errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                countWrite(loopData, out);
+                in -= out;
+            }
+
+            /* We are full. Backpressure makes uSockets poll for writable, and keeps the pipe empty for everyone */
+            if (in) {
+                char buffer[16 * 1024];
+                while (in) {
+                    ssize_t r = read(pipe[0], buffer, (size_t) std::min<ssize_t>(in, (ssize_t) sizeof(buffer)));
+                    if (r <= 0) {
+                        if (r == -1 && errno == EINTR) {
+                            continue;
+                        }
+                        break;
+                    }
+                    write(buffer, (int) r);
+                    in -= r;
+                }
+                return {moved, true};
+            }
+        }
+        return {moved, false};
+    }
+#endif
+
     /* Uncork this socket and flush or buffer any corked and/or passed data. It is essential to remember doing this. */
     /* It does NOT count bytes written from cork buffer (they are already accounted for in the write call responsible for its corking)! */
     std::pair<int, bool> uncork(const char *src = nullptr, int length = 0, bool optionally = false) {
@@ -330,6 +893,12 @@ protected:
         if (loopData->corkedSocket == this) {
             loopData->corkedSocket = nullptr;
 
+            /* Behind backpressure, the cork buffer joins it so that both drain together */
+            if (loopData->corkOffset && getAsyncSocketData()->buffer.length()) {
+                getAsyncSocketData()->buffer.append(loopData->corkBuffer, loopData->corkOffset);
+                loopData->corkOffset = 0;
+            }
+
             if (loopData->corkOffset) {
                 /* Corked data is already accounted for via its write call */
                 auto [written, failed] = write(loopData->corkBuffer, (int) loopData->corkOffset, false, length);
@@ -18,52 +18,431 @@
 #ifndef UWS_ASYNCSOCKETDATA_H
 #define UWS_ASYNCSOCKETDATA_H
 
+#include <string_view>
 #include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <new>
+#include <atomic>
+
+#include "BlockPool.h"
 
 namespace uWS {
 
+/* An immutable, reference counted buffer (such as one framed pub/sub message) that the backpressure
+ * of many sockets can reference instead of copy. Loop local, so the count is not atomic. */
+struct SharedFrame {
+    unsigned int references;
+    size_t length;
+    /* The data is either right after us, or a std::string moved in right after us */
+    bool owned;
+
+    char *data() {
+        return owned ? ((std::string *) (this + 1))->data() : (char *) (this + 1);
+    }
+
+    static SharedFrame *create(size_t length) {
+        SharedFrame *frame = (SharedFrame *) malloc(sizeof(SharedFrame) + length);
+        frame->references = 1;
+        frame->length = length;
+        frame->owned = false;
+        return frame;
+    }
+
+    /* Takes over the string without copying it */
+    static SharedFrame *create(std::string &&data) {
+        SharedFrame *frame = (SharedFrame *) malloc(sizeof(SharedFrame) + sizeof(std::string));
+        frame->references = 1;
+        frame->length = data.length();
+        frame->owned = true;
+        new (frame + 1) std::string(std::move(data));
+        return frame;
+    }
+
+    void ref() {
+        references++;
+    }
+
+    void release() {
+        if (!--references) {
+            if (owned) {
+                ((std::string *) (this + 1))->~basic_string();
+            }
+            free(this);
+        }
+    }
+};
+
+/* A buffer to send, built (or moved in from a std::string) once and sent to any number of sockets. Whatever
+ * a socket does not take right away is referenced by its backpressure instead of copied. Loop local like SharedFrame */
+struct SharedBuffer {
+private:
+    SharedFrame *frame;
+
+public:
+    explicit SharedBuffer(std::string &&data) : frame(SharedFrame::create(std::move(data))) {}
+    explicit SharedBuffer(std::string_view data) : frame(SharedFrame::create(data.length())) {
+        memcpy(frame->data(), data.data(), data.length());
+    }
+    SharedBuffer(const SharedBuffer &other) : frame(other.frame) {
+        frame->ref();
+    }
+    SharedBuffer(SharedBuffer &&other) : frame(other.frame) {
+        other.frame = nullptr;
+    }
+    SharedBuffer &operator=(SharedBuffer other) {
+        std::swap(frame, other.frame);
+        return *this;
+    }
+    ~SharedBuffer() {
+        if (frame) {
+            frame->release();
+        }
+    }
+
+    std::string_view view() const {
+        return {frame->data(), frame->length};
+    }
+
+    SharedFrame *getFrame() const {
+        return frame;
+    }
+};
+
+/* Backpressure is kept as a chain of chunks so that nothing is ever copied when partially drained.
+ * A chunk either holds its data right after itself, or references a SharedFrame (and is always full) */
+struct BackPressureChunk {
+    BackPressureChunk *next;
+    size_t capacity, begin, end;
+    SharedFrame *shared;
+    /* Where the last whole message ending in us ends, see BackPressure::markBoundary */
+    size_t boundary;
+
+    static constexpr size_t NO_BOUNDARY = SIZE_MAX;
+
+    char *data() {
+        return shared ? shared->data() : (char *) (this + 1);
+    }
+};
+
+/* Every loop runs on its own thread, so a thread local pool is a per loop pool.
+ * Chunks of the standard size are recycled, bigger ones are allocated as needed.
+ * The pool is trivially destructible so that it outlives every socket of the thread, Loop::free trims it. */
+struct BackPressurePool {
+    static constexpr size_t CHUNK_SIZE = 16 * 1024 - sizeof(BackPressureChunk);
+    /* Appends bigger than this get one chunk of their own instead of many standard ones */
+    static constexpr size_t JUMBO_THRESHOLD = 4 * CHUNK_SIZE;
+    static constexpr unsigned int MAX_FREE_CHUNKS = 1024;
+
+    BackPressureChunk *freeChunks = nullptr;
+    unsigned int numFreeChunks = 0;
+    /* Chunks referencing shared frames are only headers */
+    BackPressureChunk *freeReferences = nullptr;
+    unsigned int numFreeReferences = 0;
+
+    /* Bytes held by the backpressure of this thread, of which reported are in the total of the process */
+    size_t held = 0, reported = 0;
+
+    static std::atomic<size_t> &processTotal() {
+        static std::atomic<size_t> total{0};
+        return total;
+    }
+
+    /* Bytes held by the backpressure of every thread, as far as they reported it and exactly so for this one */
+    size_t processHeld() {
+        return processTotal().load(std::memory_order_relaxed) + held - reported;
+    }
+
+    /* Done by every loop once per iteration */
+    void report() {
+        if (held != reported) {
+            processTotal().fetch_add(held - reported, std::memory_order_relaxed);
+            reported = held;
+        }
+    }
+
+    static BackPressurePool &get() {
+        static thread_local BackPressurePool pool;
+        return pool;
+    }
+
+    void trim() {
+        numFreeChunks = numFreeReferences = 0;
+        for (BackPressureChunk **list : {&freeChunks, &freeReferences}) {
+            while (*list) {
+                BackPressureChunk *next = (*list)->next;
+                free(*list);
+                *list = next;
+            }
+        }
+    }
+
+    BackPressureChunk *acquire(size_t capacity) {
+        BackPressureChunk *chunk;
+        if (capacity <= CHUNK_SIZE && freeChunks) {
+            chunk = freeChunks;
+            freeChunks = chunk->next;
+            numFreeChunks--;
+        } else {
+            if (capacity < CHUNK_SIZE) {
+                capacity = CHUNK_SIZE;
+            }
+            chunk = (BackPressureChunk *) malloc(sizeof(BackPressureChunk) + capacity);
+            chunk->capacity = capacity;
+        }
+        chunk->next = nullptr;
+        chunk->begin = chunk->end = 0;
+        chunk->shared = nullptr;
+        chunk->boundary = BackPressureChunk::NO_BOUNDARY;
+        return chunk;
+    }
+
+    /* Takes over one reference to frame */
+    BackPressureChunk *acquireReference(SharedFrame *frame, size_t offset) {
+        BackPressureChunk *chunk;
+        if (freeReferences) {
+            chunk = freeReferences;
+            freeReferences = chunk->next;
+            numFreeReferences--;
+        } else {
+            chunk = (BackPressureChunk *) malloc(sizeof(BackPressureChunk));
+        }
+        chunk->next = nullptr;
+        chunk->capacity = chunk->end = frame->length;
+        chunk->begin = offset;
+        chunk->shared = frame;
+        chunk->boundary = BackPressureChunk::NO_BOUNDARY;
+        return chunk;
+    }
+
+    void release(BackPressureChunk *chunk) {
+        if (chunk->shared) {
+            chunk->shared->release();
+            if (numFreeReferences < MAX_FREE_CHUNKS) {
+                chunk->next = freeReferences;
+                freeReferences = chunk;
+                numFreeReferences++;
+            } else {
+                free(chunk);
+            }
+        } else if (chunk->capacity == CHUNK_SIZE && numFreeChunks < MAX_FREE_CHUNKS) {
+            chunk->next = freeChunks;
+            freeChunks = chunk;
+            numFreeChunks++;
+        } else {
+            free(chunk);
+        }
+    }
+};
+
 struct BackPressure {
-    std::string buffer;
-    unsigned int pendingRemoval = 0;
+private:
+    /* Only sockets actually holding backpressure have a queue, the rest are one null pointer */
+    struct Queue {
+        BackPressureChunk *head, *tail;
+        size_t bytes;
+    } *queue = nullptr;
+
+    /* Makes room for at least length contiguous bytes at the end */
+    BackPressureChunk *reserveTail(size_t length) {
+        if (!queue) {
+            queue = new (BlockPool::get().allocate(sizeof(Queue))) Queue{nullptr, nullptr, 0};
+        }
+        if (!queue->tail || queue->tail->capacity - queue->tail->end < length) {
+            BackPressureChunk *chunk = BackPressurePool::get().acquire(length);
+            if (queue->tail) {
+                queue->tail->next = chunk;
+            } else {
+                queue->head = chunk;
+            }
+            queue->tail = chunk;
+        }
+        return queue->tail;
+    }
+
+public:
     BackPressure(BackPressure &&other) {
-        buffer = std::move(other.buffer);
-        pendingRemoval = other.pendingRemoval;
+        queue = other.queue;
+        other.queue = nullptr;
     }
     BackPressure() = default;
+    ~BackPressure() {
+        clear();
+    }
     void append(const char *data, size_t length) {
-        buffer.append(data, length);
+        BackPressurePool::get().held += length;
+        /* Fill up what is left of the last chunk first */
+        if (queue && queue->tail->end < queue->tail->capacity) {
+            BackPressureChunk *tail = queue->tail;
+            size_t fill = std::min<size_t>(length, tail->capacity - tail->end);
+            memcpy(tail->data() + tail->end, data, fill);
+            tail->end += fill;
+            queue->bytes += fill;
+            data += fill;
+            length -= fill;
+        }
+        while (length) {
+            size_t fill = length > BackPressurePool::JUMBO_THRESHOLD ? length : std::min<size_t>(length, BackPressurePool::CHUNK_SIZE);
+            BackPressureChunk *chunk = reserveTail(fill);
+            memcpy(chunk->data() + chunk->end, data, fill);
+            chunk->end += fill;
+            queue->bytes += fill;
+            data += fill;
+            length -= fill;
+        }
     }
-    void erase(unsigned int length) {
-        pendingRemoval += length;
-        /* Always erase a minimum of 1/32th the current backpressure */
-        if (pendingRemoval > (buffer.length() >> 5)) {
-            std::string(buffer.begin() + pendingRemoval, buffer.end()).swap(buffer);
-            pendingRemoval = 0;
+    /* Returns length contiguous bytes at the end, for the caller to fill in */
+    char *appendUninitialized(size_t length) {
+        if (!length) {
+            return queue ? queue->tail->data() + queue->tail->end : nullptr;
+        }
+        BackPressurePool::get().held += length;
+        BackPressureChunk *chunk = reserveTail(length);
+        char *data = chunk->data() + chunk->end;
+        chunk->end += length;
+        queue->bytes += length;
+        return data;
+    }
+    /* References frame from offset on instead of copying it, frame stays alive until drained */
+    void appendShared(SharedFrame *frame, size_t offset) {
+        if (offset >= frame->length) {
+            return;
+        }
+        frame->ref();
+        BackPressurePool &pool = BackPressurePool::get();
+        pool.held += frame->length - offset;
+        BackPressureChunk *chunk = pool.acquireReference(frame, offset);
+        if (!queue) {
+            queue = new (BlockPool::get().allocate(sizeof(Queue))) Queue{nullptr, nullptr, 0};
+        }
+        if (queue->tail) {
+            queue->tail->next = chunk;
+        } else {
+            queue->head = chunk;
+        }
+        queue->tail = chunk;
+        queue->bytes += frame->length - offset;
+    }
+    /* Notes that what we hold ends with a whole message, for insertUninitialized to put others in front of what follows */
+    void markBoundary() {
+        if (queue) {
+            queue->tail->boundary = queue->tail->end;
+        }
+    }
+
+    /* Returns length contiguous bytes for the caller to fill in, at the first boundary not yet drained (the last one
+     * marked in its chunk) so that they go out ahead of what follows. Those inserted later go behind them.
+     * Returns nullptr if there is no such boundary */
+    char *insertUninitialized(size_t length) {
+        BackPressureChunk *previous = nullptr, *chunk = queue ? queue->head : nullptr;
+        while (chunk && (chunk->boundary == BackPressureChunk::NO_BOUNDARY || chunk->boundary < chunk->begin)) {
+            previous = chunk;
+            chunk = chunk->next;
+        }
+        if (!chunk) {
+            return nullptr;
+        }
+
+        BackPressurePool &pool = BackPressurePool::get();
+        BackPressureChunk *inserted = pool.acquire(length);
+        inserted->end = inserted->boundary = length;
+
+        if (chunk->boundary == chunk->begin) {
+            inserted->next = chunk;
+            if (previous) {
+                previous->next = inserted;
+            } else {
+                queue->head = inserted;
+            }
+        } else {
+            /* What follows the boundary in its chunk moves to a chunk of its own */
+            if (chunk->boundary < chunk->end) {
+                BackPressureChunk *rest;
+                if (chunk->shared) {
+                    chunk->shared->ref();
+                    rest = pool.acquireReference(chunk->shared, chunk->boundary);
+                    rest->end = chunk->end;
+                } else {
+                    rest = pool.acquire(chunk->end - chunk->boundary);
+                    memcpy(rest->data(), chunk->data() + chunk->boundary, chunk->end - chunk->boundary);
+                    rest->end = chunk->end - chunk->boundary;
+                }
+                rest->next = chunk->next;
+                chunk->next = rest;
+                chunk->end = chunk->boundary;
+                if (queue->tail == chunk) {
+                    queue->tail = rest;
+                }
+            }
+            chunk->boundary = BackPressureChunk::NO_BOUNDARY;
+            inserted->next = chunk->next;
+            chunk->next = inserted;
+            if (queue->tail == chunk) {
+                queue->tail = inserted;
+            }
+        }
+
+        queue->bytes += length;
+        pool.held += length;
+        return inserted->data();
+    }
+
+    /* Drained chunks go back to the pool, the rest stays where it is. Draining everything gives back the queue */
+    void erase(size_t length) {
+        if (!queue) {
+            return;
+        }
+        queue->bytes -= length;
+        BackPressurePool &pool = BackPressurePool::get();
+        pool.held -= length;
+        while (length) {
+            BackPressureChunk *head = queue->head;
+            size_t available = head->end - head->begin;
+            if (length < available) {
+                head->begin += length;
+                break;
+            }
+            length -= available;
+            queue->head = head->next;
+            pool.release(head);
+        }
+        if (!queue->head) {
+            BlockPool::get().deallocate(queue, sizeof(Queue));
+            queue = nullptr;
         }
     }
     size_t length() {
-        return buffer.length() - pendingRemoval;
+        return queue ? queue->bytes : 0;
     }
-    /* Only used in AsyncSocket::write - what about replacing it with the other functions like erase(length())? */
     void clear() {
-        pendingRemoval = 0;
-        buffer.clear();
-        buffer.shrink_to_fit();
-    }
-    /* Only used by AsyncSocket::write (optionally) before append */
-    void reserve(size_t length) {
-        buffer.reserve(length + pendingRemoval);
+        erase(length());
     }
-    /* Only used by getSendBuffer as last resort */
-    void resize(size_t length) {
-        buffer.resize(length + pendingRemoval);
+    /* The first contiguous segment, drain it then erase what was written */
+    std::string_view front() {
+        if (!queue) {
+            return {};
+        }
+        return {queue->head->data() + queue->head->begin, queue->head->end - queue->head->begin};
     }
-    const char *data() {
-        return buffer.data() + pendingRemoval;
+    /* Fills in up to max segments from the front, for draining many at a time. Returns how many */
+    size_t segments(std::string_view *out, size_t max) {
+        size_t count = 0;
+        for (BackPressureChunk *chunk = queue ? queue->head : nullptr; chunk && count < max; chunk = chunk->next) {
+            out[count++] = {chunk->data() + chunk->begin, chunk->end - chunk->begin};
+        }
+        return count;
     }
-    /* The total length, incuding pending removal */
-    size_t totalLength() {
-        return buffer.length();
+    /* The segment after front, for draining two at a time */
+    std::string_view second() {
+        if (!queue || !queue->head->next) {
+            return {};
+        }
+        BackPressureChunk *second = queue->head->next;
+        return {second->data() + second->begin, second->end - second->begin};
     }
 };
 
@@ -74,6 +453,18 @@ struct AsyncSocketData {
     /* This will do for now */
     BackPressure buffer;
 
+#ifdef UWS_WITH_KTLS
+    /* The kernel encrypts what we send, so we write plaintext past the SSL layer */
+    bool kernelTls = false;
+    bool kernelTlsTried = false;
+#endif
+
+    /* Dynamic TLS record sizing, see AsyncSocket::socketWrite. Off while the initial record size is 0 */
+    unsigned short tlsInitialRecordSize = 0;
+    unsigned short tlsRecordSize = 0;
+    /* Loop time (in seconds) of the last write */
+    unsigned int tlsLastWrite = 0;
+
     /* Allow move constructing us */
     AsyncSocketData(BackPressure &&backpressure) : buffer(std::move(backpressure)) {
 
@@ -0,0 +1,109 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_BLOCKPOOL_H
+#define UWS_BLOCKPOOL_H
+
+/* Recycles small, short lived allocations such as coroutine frames, in power of two size classes.
+ * Every loop runs on its own thread, so a thread local pool is a per loop pool. Like the BackPressurePool
+ * it is trivially destructible so that it outlives everything of the thread, Loop::free and thread exit trim it.
+ * Blocks may be given back on another thread than they were taken on, they are plain malloc memory. */
+
+#include <cstdlib>
+#include <cstddef>
+
+namespace uWS {
+
+struct BlockPool {
+    static constexpr size_t MIN_BLOCK_SIZE = 64;
+    static constexpr size_t MAX_BLOCK_SIZE = 4096;
+    /* 64, 128, ..., 4096 */
+    static constexpr unsigned int NUM_SIZE_CLASSES = 7;
+    static constexpr unsigned int MAX_FREE_BLOCKS = 256;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    FreeBlock *freeBlocks[NUM_SIZE_CLASSES];
+    unsigned int numFreeBlocks[NUM_SIZE_CLASSES];
+
+    static BlockPool &get() {
+        static thread_local BlockPool pool;
+        /* Threads without a Loop, such as workers building messages, give their free blocks back as they exit.
+         * The pool itself stays usable after this, whatever is given back later is simply freed at its next trim */
+        static thread_local struct Trimmer {
+            ~Trimmer() {
+                pool.trim();
+            }
+        } trimmer;
+        (void) trimmer;
+        return pool;
+    }
+
+    static unsigned int sizeClass(size_t size) {
+        unsigned int sizeClass = 0;
+        while ((MIN_BLOCK_SIZE << sizeClass) < size) {
+            sizeClass++;
+        }
+        return sizeClass;
+    }
+
+    void *allocate(size_t size) {
+        if (size > MAX_BLOCK_SIZE) {
+            return malloc(size);
+        }
+        unsigned int c = sizeClass(size);
+        if (FreeBlock *block = freeBlocks[c]) {
+            freeBlocks[c] = block->next;
+            numFreeBlocks[c]--;
+            return block;
+        }
+        return malloc(MIN_BLOCK_SIZE << c);
+    }
+
+    /* Size must be what was allocated */
+    void deallocate(void *p, size_t size) {
+        if (size > MAX_BLOCK_SIZE) {
+            free(p);
+            return;
+        }
+        unsigned int c = sizeClass(size);
+        if (numFreeBlocks[c] < MAX_FREE_BLOCKS) {
+            FreeBlock *block = (FreeBlock *) p;
+            block->next = freeBlocks[c];
+            freeBlocks[c] = block;
+            numFreeBlocks[c]++;
+        } else {
+            free(p);
+        }
+    }
+
+    void trim() {
+        for (unsigned int c = 0; c < NUM_SIZE_CLASSES; c++) {
+            while (FreeBlock *block = freeBlocks[c]) {
+                freeBlocks[c] = block->next;
+                free(block);
+            }
+            numFreeBlocks[c] = 0;
+        }
+    }
+};
+
+}
+
+#endif // UWS_BLOCKPOOL_H
@@ -1,11 +1,22 @@
 #ifndef UWS_CACHINGAPP_H
 #define UWS_CACHINGAPP_H
 
+/* A CachingApp is an App with GET routes whose responses are cached, already framed, in memory.
+ * Concurrent misses for the same key run the handler once and all wait for its response (single-flight),
+ * entries expire by LoopData::cacheTimepoint and the least recently used ones are evicted to stay within
+ * a byte budget. A hit is a single write of the shared, framed response. */
+
 #include "App.h"
 #include <unordered_map>
 #include <string>
 #include <functional>
 #include <string_view>
+#include <vector>
+#include <list>
+#include <memory>
+#include <algorithm>
+#include <cctype>
+#include <tuple>
 
 namespace uWS {
 
@@ -21,95 +32,360 @@ struct StringViewEqual {
     }
 };
 
-
-
+/* What a caching handler responds to, it builds the framed response that goes into the cache */
 class CachingHttpResponse {
+    template <bool> friend struct CachingApp;
 public:
-    CachingHttpResponse(uWS::HttpResponse<false> *res)
-        : res(res) {}
+    CachingHttpResponse(MoveOnlyFunction<void(CachingHttpResponse *)> &&onEnd)
+        : onEnd(std::move(onEnd)) {}
+
+    CachingHttpResponse *writeStatus(std::string_view status) {
+        this->status = status;
+        return this;
+    }
+
+    CachingHttpResponse *writeHeader(std::string_view key, std::string_view value) {
+        headers.append(key).append(": ").append(value).append("\r\n");
+        encoded |= key.length() == 16 && std::equal(key.begin(), key.end(), "content-encoding", [](char a, char b) {
+            return (a | 0x20) == b;
+        });
+        return this;
+    }
 
     void write(std::string_view data) {
         buffer.append(data);
     }
 
+    /* Completes the response for everyone waiting on it. Connection close is per socket so it
+     * cannot be cached, and is ignored. Do not touch the response after this. */
     void end(std::string_view data = "", bool closeConnection = false) {
         buffer.append(data);
-
-        // end for all queued up sockets also
-        res->end(buffer);
-
-        created = time(0);
-
         std::ignore = closeConnection;
+
+        /* Deletes us */
+        onEnd(this);
     }
 
-public:
-    uWS::HttpResponse<false>* res; // should be a vector of waiting sockets
+    /* Called if the request we are filling the cache for aborts before we end, when nobody gets what we would
+     * have cached. We are deleted right after, so do not touch us then (as with HttpResponse::onAborted) */
+    CachingHttpResponse *onAborted(MoveOnlyFunction<void()> &&handler) {
+        abortedHandler = std::move(handler);
+        return this;
+    }
 
+private:
+    MoveOnlyFunction<void(CachingHttpResponse *)> onEnd;
+    MoveOnlyFunction<void()> abortedHandler;
+    std::string status = HTTP_200_OK;
+    std::string headers;
+    /* A body you encoded yourself is not compressed again */
+    bool encoded = false;
 
+public:
     std::string buffer; // body
-    time_t created;
 };
 
-typedef std::unordered_map<std::string_view, CachingHttpResponse *, 
-                       StringViewHash, 
+/* One cached response, or one being produced */
+struct CacheEntry {
+    /* Owned key, the map refers to it */
+    std::string key;
+    /* Status line, headers and body */
+    std::string framedResponse;
+    /* Where the 29 characters of the Date header value are, and for which timepoint they were written */
+    size_t dateOffset = 0;
+    time_t dateTimepoint = 0;
+    time_t expires = 0;
+    /* Where Content-Length and the body start */
+    size_t contentLengthOffset = 0, bodyOffset = 0;
+
+    /* Compressed copies by ContentEncoding, made when first asked for (see CachingApp::compress). One that did not
+     * come out smaller stays empty, the response is sent as it is instead */
+    struct Variant {
+        std::string framedResponse;
+        size_t dateOffset = 0;
+        time_t dateTimepoint = 0;
+        bool made = false;
+    };
+    bool compressible = false;
+    Variant variants[NUM_CONTENT_ENCODINGS];
+
+    /* Pending until the handler ends, with everyone waiting for it */
+    bool pending = true;
+    std::vector<void *> waiting;
+
+    /* Position in the LRU list, only when not pending */
+    std::list<CacheEntry *>::iterator lru;
+
+    size_t cost() {
+        size_t variantsLength = 0;
+        for (Variant &variant : variants) {
+            variantsLength += variant.framedResponse.length();
+        }
+        return key.length() + framedResponse.length() + variantsLength + sizeof(CacheEntry);
+    }
+};
+
+typedef std::unordered_map<std::string_view, CacheEntry *,
+                       StringViewHash,
                        StringViewEqual> CacheType;
 
 // we can also derive from H3app later on
 template <bool SSL>
-struct CachingApp : public uWS::TemplatedAppBase<SSL, CachingApp<SSL>> {
+struct CachingApp : public uWS::TemplatedApp<SSL> {
+private:
+    /* The cache lives on the heap so that routes can keep pointing at it when the app is moved */
+    struct Cache {
+        CacheType entries;
+        /* Most recently used first, only entries that are not pending */
+        std::list<CacheEntry *> lru;
+        size_t maxBytes;
+        size_t bytes = 0;
+        /* Off while no encodings are offered */
+        HttpCompressionOptions compression = {0, 0, 0};
+
+        ~Cache() {
+            for (auto &[key, entry] : entries) {
+                /* Fillers still running would end into freed memory, so they better not */
+                delete entry;
+            }
+        }
+
+        /* Removes least recently used entries until we are within budget */
+        void evict() {
+            while (bytes > maxBytes && lru.size()) {
+                CacheEntry *entry = lru.back();
+                lru.pop_back();
+                bytes -= entry->cost();
+                entries.erase(entry->key);
+                delete entry;
+            }
+        }
+
+        /* Sends a framed response, refreshing its Date header if it is older than a second */
+        static void sendFramed(HttpResponse<SSL> *res, std::string &framedResponse, size_t dateOffset, time_t &dateTimepoint) {
+            LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) uWS::Loop::get());
+            if (dateTimepoint != loopData->cacheTimepoint) {
+                memcpy(framedResponse.data() + dateOffset, loopData->date, 29);
+                dateTimepoint = loopData->cacheTimepoint;
+            }
+            res->endFramed(framedResponse);
+        }
+
+        /* Frames the body of a ready entry compressed, if that makes it smaller. Counts toward the budget */
+        void makeVariant(CacheEntry *entry, ContentEncoding encoding) {
+            LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) uWS::Loop::get());
+            CacheEntry::Variant &variant = entry->variants[encoding];
+            variant.made = true;
+
+            std::string_view framed = entry->framedResponse;
+            std::string_view body = framed.substr(entry->bodyOffset);
+            std::string_view compressed = loopData->compressHttpBody(encoding, compression.level, body);
+            if (!compressed.length() || compressed.length() >= body.length()) {
+                return;
+            }
+
+            /* Status line and headers, then ours ahead of Date */
+            size_t headLength = entry->dateOffset - 6;
+            std::string &variantFramed = variant.framedResponse;
+            variantFramed.append(framed.substr(0, headLength)).append("Content-Encoding: ").append(CONTENT_ENCODING_NAMES[encoding]).append("\r\n");
+            variant.dateOffset = variantFramed.length() + 6;
+            variantFramed.append(framed.substr(headLength, entry->contentLengthOffset - headLength));
+            variantFramed.append("Content-Length: ").append(std::to_string(compressed.length())).append("\r\n\r\n").append(compressed);
+            variant.dateTimepoint = entry->dateTimepoint;
+            bytes += variantFramed.length();
+        }
+
+        /* Sends the ready entry, compressed as the response negotiated if that is worth it */
+        void send(HttpResponse<SSL> *res, CacheEntry *entry) {
+            if (ContentEncoding encoding = entry->compressible ? res->getContentEncoding() : IDENTITY) {
+                if (!entry->variants[encoding].made) {
+                    makeVariant(entry, encoding);
+                }
+                CacheEntry::Variant &variant = entry->variants[encoding];
+                if (variant.framedResponse.length()) {
+                    sendFramed(res, variant.framedResponse, variant.dateOffset, variant.dateTimepoint);
+                    return;
+                }
+            }
+            sendFramed(res, entry->framedResponse, entry->dateOffset, entry->dateTimepoint);
+        }
+
+        /* Waiters stop waiting when they abort */
+        static void wait(HttpResponse<SSL> *res, CacheEntry *entry) {
+            entry->waiting.push_back(res);
+            res->onAborted([res, entry]() {
+                auto it = std::find(entry->waiting.begin(), entry->waiting.end(), (void *) res);
+                if (it != entry->waiting.end()) {
+                    entry->waiting.erase(it);
+                }
+            });
+        }
+
+        /* Drops a pending entry whose filler aborted, those who waited for it get 503 rather than wait forever */
+        void abandon(CacheEntry *entry) {
+            std::vector<void *> waiting = std::move(entry->waiting);
+            entries.erase(entry->key);
+            delete entry;
+            for (void *res : waiting) {
+                ((HttpResponse<SSL> *) res)->writeStatus("503 Service Unavailable")->end();
+            }
+        }
+
+        /* Frames the response of a pending entry, makes it ready and answers everyone waiting for it */
+        void complete(CacheEntry *entry, CachingHttpResponse *cachingRes, std::string_view vary, unsigned int secondsToExpiry) {
+            LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) uWS::Loop::get());
+
+            /* Compressed copies of what we had before are stale */
+            for (CacheEntry::Variant &variant : entry->variants) {
+                variant = {};
+            }
+            entry->compressible = compression.encodings && !cachingRes->encoded && cachingRes->buffer.length() >= compression.minSize;
+
+            std::string &framed = entry->framedResponse;
+            framed.clear();
+            framed.append("HTTP/1.1 ").append(cachingRes->status).append("\r\n").append(cachingRes->headers);
+            if (vary.length() || entry->compressible) {
+                framed.append("Vary: ").append(vary);
+                if (entry->compressible) {
+                    framed.append(vary.length() ? ", " : "").append("accept-encoding");
+                }
+                framed.append("\r\n");
+            }
+            framed.append("Date: ");
+            entry->dateOffset = framed.length();
+            framed.append(loopData->date, 29).append("\r\n");
+            entry->dateTimepoint = loopData->cacheTimepoint;
+#ifndef UWS_HTTPRESPONSE_NO_WRITEMARK
+            if (!loopData->noMark) {
+                framed.append("uWebSockets: 20\r\n");
+            }
+#endif
+            entry->contentLengthOffset = framed.length();
+            framed.append("Content-Length: ").append(std::to_string(cachingRes->buffer.length())).append("\r\n\r\n");
+            entry->bodyOffset = framed.length();
+            framed.append(cachingRes->buffer);
+
+            entry->expires = loopData->cacheTimepoint + (time_t) secondsToExpiry;
+            entry->pending = false;
+            lru.push_front(entry);
+            entry->lru = lru.begin();
+            bytes += entry->cost();
+
+            /* Sending never calls back into us, but aborted handlers must not touch the list while we go */
+            std::vector<void *> waiting = std::move(entry->waiting);
+            entry->waiting.clear();
+            for (void *res : waiting) {
+                send((HttpResponse<SSL> *) res, entry);
+            }
+
+            evict();
+        }
+    };
+
+    std::unique_ptr<Cache> cache;
+
 public:
-    CachingApp(SocketContextOptions options = {}) : uWS::TemplatedAppBase<SSL, CachingApp<SSL>>(options) {}
+    CachingApp(SocketContextOptions options = {}, size_t maxCacheBytes = 64 * 1024 * 1024) : uWS::TemplatedApp<SSL>(options), cache(new Cache) {
+        cache->maxBytes = maxCacheBytes;
+    }
 
-    using uWS::TemplatedAppBase<SSL, CachingApp<SSL>>::get;
+    using uWS::TemplatedApp<SSL>::get;
+
+    /* As TemplatedApp::compress. Cached responses keep one compressed copy per encoding, made when first asked for */
+    CachingApp &&compress(HttpCompressionOptions options = {}) {
+        options.encodings &= AVAILABLE_CONTENT_ENCODINGS;
+        cache->compression = options;
+        uWS::TemplatedApp<SSL>::compress(options);
+        return std::move(*this);
+    }
 
     CachingApp(const CachingApp &other) = delete;
-    CachingApp(CachingApp<SSL> &&other) : uWS::TemplatedAppBase<SSL, CachingApp<SSL>>(std::move(other)) {
-        // also move the cache
+    CachingApp(CachingApp<SSL> &&other) : uWS::TemplatedApp<SSL>(std::move(other)), cache(std::move(other.cache)) {
+
     }
 
     ~CachingApp() {
 
     }
 
-    // variant 1: only taking URL into account
-    CachingApp &&get(const std::string& url, uWS::MoveOnlyFunction<void(CachingHttpResponse*, uWS::HttpRequest*)> &&handler, unsigned int secondsToExpiry) {
-        ((uWS::TemplatedAppBase<SSL, CachingApp<SSL>> *)this)->get(url, [this, handler = std::move(handler), secondsToExpiry](auto* res, auto* req) mutable {
+    /* Responses are cached by full URL and the values of the given request headers (sent back as Vary) */
+    CachingApp &&get(const std::string& url, uWS::MoveOnlyFunction<void(CachingHttpResponse*, uWS::HttpRequest*)> &&handler, unsigned int secondsToExpiry, std::vector<std::string> varyHeaders = {}) {
+        /* Request headers are looked up lower cased */
+        std::string vary;
+        for (std::string &header : varyHeaders) {
+            std::transform(header.begin(), header.end(), header.begin(), [](unsigned char c) { return (char) ::tolower(c); });
+            vary.append(vary.length() ? ", " : "").append(header);
+        }
+
+        ((uWS::TemplatedApp<SSL> *)this)->get(url, [cache = cache.get(), handler = std::move(handler), secondsToExpiry, varyHeaders = std::move(varyHeaders), vary = std::move(vary)](auto* res, auto* req) mutable {
             /* We need to know the cache key and the time of now */
-            std::string_view cache_key = req->getFullUrl();
+            std::string variantKey;
+            std::string_view cacheKey = req->getFullUrl();
+            if (varyHeaders.size()) {
+                variantKey.append(cacheKey);
+                for (std::string &header : varyHeaders) {
+                    variantKey.append(1, '\0').append(req->getHeader(header));
+                }
+                cacheKey = variantKey;
+            }
             time_t now = static_cast<LoopData *>(us_loop_ext((us_loop_t *)uWS::Loop::get()))->cacheTimepoint;
 
-            auto it = cache.find(cache_key);
-            if (it != cache.end()) {
+            CacheEntry *entry;
+            auto it = cache->entries.find(cacheKey);
+            if (it != cache->entries.end()) {
+                entry = it->second;
 
-                if (it->second->created + secondsToExpiry > now) {
-                    res->end(it->second->buffer); // tryEnd!
+                /* Someone is already producing this response, wait for it */
+                if (entry->pending) {
+                    Cache::wait(res, entry);
                     return;
                 }
 
-                /* We are no longer valid, delete old cache and fall through to create a new entry */
-                delete it->second;
-
-                // is the cache completed? if not, add yourself to the waiting list of sockets to that cache
+                if (entry->expires > now) {
+                    cache->lru.splice(cache->lru.begin(), cache->lru, entry->lru);
+                    cache->send(res, entry);
+                    /* Making a compressed copy may have taken us over budget */
+                    cache->evict();
+                    return;
+                }
 
-                // if the cache completed? ok, is it still valid? use it
+                /* We are no longer valid, take the entry back to pending and refill it ourselves */
+                cache->lru.erase(entry->lru);
+                cache->bytes -= entry->cost();
+                entry->pending = true;
+            } else {
+                /* Immediately take the place in the cache */
+                entry = new CacheEntry;
+                entry->key = cacheKey;
+                cache->entries[entry->key] = entry;
             }
 
-            // immediately take the place in the cache
-            CachingHttpResponse *cachingRes;
-            cache[cache_key] = (cachingRes = new CachingHttpResponse(res));
+            Cache::wait(res, entry);
+
+            CachingHttpResponse *cachingRes = new CachingHttpResponse([cache, entry, vary, secondsToExpiry](CachingHttpResponse *cachingRes) {
+                cache->complete(entry, cachingRes, vary, secondsToExpiry);
+                delete cachingRes;
+            });
+
+            /* Our response is answered along with the others once the filler ends, which then never aborts. Should
+             * we abort before, the entry goes, or everyone behind us would wait forever */
+            res->onAborted([cache, entry, res, cachingRes]() {
+                auto it = std::find(entry->waiting.begin(), entry->waiting.end(), (void *) res);
+                if (it != entry->waiting.end()) {
+                    entry->waiting.erase(it);
+                }
+                if (cachingRes->abortedHandler) {
+                    cachingRes->abortedHandler();
+                }
+                delete cachingRes;
+                cache->abandon(entry);
+            });
 
             handler(cachingRes, req);
         });
         return std::move(*this);
     }
-
-    // variant 2: taking URL and a list of headers into account
-    // todo
-
-private:
-    CacheType cache;
 };
 
 }
-#endif
\ No newline at end of file
+#endif
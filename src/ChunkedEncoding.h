@@ -39,42 +39,52 @@ namespace uWS {
         return state & STATE_SIZE_MASK;
     }
 
-    /* Reads hex number until CR or out of data to consume. Updates state. Returns bytes consumed. */
-    inline void consumeHexNumber(std::string_view &data, uint64_t &state) {
-        /* Consume everything higher than 32 */
-        while (data.length() && data.data()[0] > 32) {
+    /* Value of every hex digit, 0xFF for anything else */
+    struct HexDigits {
+        unsigned char values[256];
 
-            unsigned char digit = (unsigned char)data.data()[0];
-            if (digit >= 'a') {
-                digit = (unsigned char) (digit - ('a' - ':'));
-            } else if (digit >= 'A') {
-                digit = (unsigned char) (digit - ('A' - ':'));
+        constexpr HexDigits() : values() {
+            for (int c = 0; c < 256; c++) {
+                values[c] = 0xFF;
             }
+            for (int c = 0; c < 10; c++) {
+                values['0' + c] = (unsigned char) c;
+            }
+            for (int c = 0; c < 6; c++) {
+                values['a' + c] = values['A' + c] = (unsigned char) (10 + c);
+            }
+        }
+    };
+    inline constexpr HexDigits hexDigits;
 
-            unsigned int number = ((unsigned int) digit - (unsigned int) '0');
+    /* Reads hex number until CR or out of data to consume. Updates state. Returns bytes consumed. */
+    inline void consumeHexNumber(std::string_view &data, uint64_t &state) {
+        /* Consume everything higher than 32 */
+        const unsigned char *p = (const unsigned char *) data.data(), *end = p + data.length();
+        uint64_t size = state & STATE_SIZE_MASK;
+        for (; p != end && *p > 32; p++) {
+            unsigned int number = hexDigits.values[*p];
 
-            if (number > 16 || (chunkSize(state) & STATE_SIZE_OVERFLOW)) {
+            if (number == 0xFF || (size & STATE_SIZE_OVERFLOW)) {
                 state = STATE_IS_ERROR;
                 return;
             }
 
-            // extract state bits
-            uint64_t bits = /*state &*/ STATE_IS_CHUNKED;
-
-            state = (state & STATE_SIZE_MASK) * 16ull + number;
-
-            state |= bits;
-            data.remove_prefix(1);
+            size = size * 16ull + number;
         }
         /* Consume everything not /n */
-        while (data.length() && data.data()[0] != '\n') {
-            data.remove_prefix(1);
-        }
+        const unsigned char *lf = (const unsigned char *) memchr(p, '\n', (size_t) (end - p));
+
+        /* Extract state bits */
+        state = size | STATE_IS_CHUNKED;
+
         /* Now we stand on \n so consume it and enable size */
-        if (data.length()) {
+        if (lf) {
             state += 2; // include the two last /r/n
-            state |= STATE_HAS_SIZE | STATE_IS_CHUNKED;
-            data.remove_prefix(1);
+            state |= STATE_HAS_SIZE;
+            data.remove_prefix((size_t) (lf + 1 - (const unsigned char *) data.data()));
+        } else {
+            data.remove_prefix(data.length());
         }
     }
 
@@ -110,18 +120,17 @@ namespace uWS {
 
                 //printf("Parsing trailer now\n");
 
-                while(data.length() && chunkSize(state)) {
-                    data.remove_prefix(1);
-                    decChunkSize(state, 1);
+                unsigned int drop = (unsigned int) std::min<uint64_t>(data.length(), chunkSize(state));
+                data.remove_prefix(drop);
+                decChunkSize(state, drop);
 
-                    if (chunkSize(state) == 0) {
+                if (chunkSize(state) == 0) {
 
-                        /* This is an actual place where we need 0 as state */
-                        state = 0;
+                    /* This is an actual place where we need 0 as state */
+                    state = 0;
 
-                        /* The parser MUST stop consuming here */
-                        return std::nullopt;
-                    }
+                    /* The parser MUST stop consuming here */
+                    return std::nullopt;
                 }
                 continue;
             }
@@ -190,16 +199,42 @@ namespace uWS {
         return std::nullopt;
     }
 
-    /* This is really just a wrapper for convenience */
+    /* This is really just a wrapper for convenience. When coalescing, data must be writable: chunks following each other
+     * in data are moved together over the framing between them and given as one, so tiny chunks do not mean tiny calls */
     struct ChunkIterator {
 
         std::string_view *data;
         std::optional<std::string_view> chunk;
         uint64_t *state;
         bool trailer;
+        bool coalesce;
 
-        ChunkIterator(std::string_view *data, uint64_t *state, bool trailer = false) : data(data), state(state), trailer(trailer) {
-            chunk = uWS::getNextChunk(*data, *state, trailer);
+        ChunkIterator(std::string_view *data, uint64_t *state, bool trailer = false, bool coalesce = false) : data(data), state(state), trailer(trailer), coalesce(coalesce) {
+            chunk = next();
+        }
+
+        std::optional<std::string_view> next() {
+            std::optional<std::string_view> chunk = uWS::getNextChunk(*data, *state, trailer);
+            if (!coalesce || !chunk.has_value() || !chunk->length()) {
+                return chunk;
+            }
+
+            /* Only a whole chunk is followed by another one, the end of body is never merged */
+            char *merged = (char *) chunk->data();
+            size_t mergedLength = chunk->length();
+            while (*state == STATE_IS_CHUNKED) {
+                std::string_view nextData = *data;
+                uint64_t nextState = *state;
+                std::optional<std::string_view> following = uWS::getNextChunk(nextData, nextState, trailer);
+                if (!following.has_value() || !following->length()) {
+                    break;
+                }
+                memmove(merged + mergedLength, following->data(), following->length());
+                mergedLength += following->length();
+                *data = nextData;
+                *state = nextState;
+            }
+            return std::string_view(merged, mergedLength);
         }
 
         ChunkIterator() {
@@ -226,7 +261,7 @@ namespace uWS {
         }
 
         ChunkIterator &operator++() {
-            chunk = uWS::getNextChunk(*data, *state, trailer);
+            chunk = next();
             return *this;
         }
 
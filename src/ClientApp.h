@@ -1,36 +1,504 @@
-#include "MoveOnlyFunction.h"
-#include "WebSocketContext.h"
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_CLIENTAPP_H
+#define UWS_CLIENTAPP_H
+
+/* WebSocket clients. Every connection is opened on a handshake context that writes the upgrade request and checks
+ * the 101 response, then adopted into a WebSocketContext<SSL, false, ...> where it is framed, masked, corked and
+ * backpressured exactly like a WebSocket of the server. Connections that close or fail are reconnected with
+ * jittered exponential backoff until the app is closed. Clients have no pub/sub. */
+
+#include "App.h"
+#include "WebSocketHandshake.h"
+#include "WebSocketExtensions.h"
+
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
 
 namespace uWS {
 
+template <bool SSL, typename USERDATA = int>
+struct TemplatedClientApp {
+
     struct WebSocketClientBehavior {
-        MoveOnlyFunction<void()> open;
-        MoveOnlyFunction<void()> message;
-        MoveOnlyFunction<void()> close;
-        //MoveOnlyFunction<void()> failed;
+        /* Anything but DISABLED offers permessage-deflate without sliding windows either way,
+         * which is what tens of thousands of connections can afford */
+        CompressOptions compression = DISABLED;
+        /* 1 (fastest) to 9 (smallest), 0 stores */
+        int compressionLevel = DEFAULT_COMPRESSION_LEVEL;
+        /* Maximum message size we can receive */
+        unsigned int maxPayloadLength = 16 * 1024;
+        /* Seconds, also the time a handshake may take */
+        unsigned short idleTimeout = 120;
+        unsigned int maxBackpressure = 64 * 1024;
+        bool closeOnBackpressureLimit = false;
+        bool resetIdleTimeoutOnSend = false;
+        bool sendPingsAutomatically = true;
+        /* See WebSocketBehavior::emitAutomaticPongs */
+        bool emitAutomaticPongs = false;
+        /* See WebSocketBehavior::batchSends */
+        bool batchSends = false;
+        /* First delay in ms before reconnecting, doubled for every failed attempt up to maxReconnectDelay (0 disables) */
+        unsigned int reconnectDelay = 250;
+        unsigned int maxReconnectDelay = 30000;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *)> open = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *, std::string_view, OpCode)> message = nullptr;
+        /* See WebSocketBehavior::messageChunk */
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *, std::string_view, OpCode, bool)> messageChunk = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *, std::string_view, OpCode)> dropped = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *)> drain = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *, std::string_view)> ping = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *, std::string_view)> pong = nullptr;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *, int, std::string_view)> close = nullptr;
+        /* A connect or handshake failed, with the url and how many attempts in a row failed */
+        MoveOnlyFunction<void(std::string_view, unsigned int)> failed = nullptr;
+    };
 
+private:
+    struct ClientContextData;
+
+    /* One wanted connection, kept across the sockets that come and go for it */
+    struct Connection {
+        ClientContextData *clientContextData;
+        std::string url;
+        std::string host;
+        int port;
+        std::string path;
+        std::string protocol;
+        unsigned int attempts = 0;
+        TimingWheel::Timer reconnectTimer;
     };
 
-    struct ClientApp {
+    /* Ext of sockets in handshake */
+    struct HandshakeData {
+        Connection *connection;
+        std::string response;
+        char key[24];
+    };
+
+    /* Ext of WebSockets behind WebSocketData, the user data first so that getUserData finds it */
+    struct ClientSocketData {
+        USERDATA userData;
+        Connection *connection;
+    };
+
+    /* Ext of the handshake context */
+    struct ClientContextData {
+        us_socket_context_t *handshakeContext;
+        WebSocketContext<SSL, false, USERDATA> *webSocketContext;
+        std::vector<std::unique_ptr<Connection>> connections;
+        MoveOnlyFunction<void(WebSocket<SSL, false, USERDATA> *)> openHandler;
+        MoveOnlyFunction<void(std::string_view, unsigned int)> failedHandler;
+        unsigned int reconnectDelay;
+        unsigned int maxReconnectDelay;
+        unsigned short handshakeTimeout;
+        bool perMessageDeflate;
+        bool closing = false;
+    };
+
+    us_socket_context_t *handshakeContext = nullptr;
+
+    ClientContextData *getClientContextData() {
+        return (ClientContextData *) us_socket_context_ext(SSL, handshakeContext);
+    }
+
+    /* Splits ws://host:port/path, wss:// defaults to port 443 */
+    static bool parseUrl(std::string_view url, Connection *connection) {
+        int defaultPort = 80;
+        if (url.substr(0, 5) == "ws://") {
+            url.remove_prefix(5);
+        } else if (url.substr(0, 6) == "wss://") {
+            url.remove_prefix(6);
+            defaultPort = 443;
+        } else {
+            return false;
+        }
+
+        size_t pathStart = url.find('/');
+        connection->path = pathStart == std::string_view::npos ? "/" : std::string(url.substr(pathStart));
+        std::string_view authority = url.substr(0, pathStart);
+
+        /* IPv6 addresses come in brackets */
+        size_t portStart = authority.rfind(':');
+        if (portStart != std::string_view::npos && authority.find(']', portStart) == std::string_view::npos) {
+            connection->port = 0;
+            auto [ptr, ec] = std::from_chars(authority.data() + portStart + 1, authority.data() + authority.length(), connection->port);
+            if (ec != std::errc() || connection->port <= 0 || connection->port > 65535) {
+                return false;
+            }
+            authority = authority.substr(0, portStart);
+        } else {
+            connection->port = defaultPort;
+        }
+        if (authority.length() > 2 && authority.front() == '[' && authority.back() == ']') {
+            authority = authority.substr(1, authority.length() - 2);
+        }
+        connection->host = std::string(authority);
+        return connection->host.length();
+    }
+
+    /* Value of a header of the response, names compared case insensitively */
+    static std::string_view getHeader(std::string_view headers, std::string_view lowerCaseName) {
+        while (headers.length()) {
+            size_t lineEnd = headers.find("\r\n");
+            std::string_view line = headers.substr(0, lineEnd);
+            headers.remove_prefix(lineEnd == std::string_view::npos ? headers.length() : lineEnd + 2);
+
+            if (line.length() > lowerCaseName.length() && line[lowerCaseName.length()] == ':') {
+                bool equal = true;
+                for (size_t i = 0; i < lowerCaseName.length() && equal; i++) {
+                    equal = (line[i] | 32) == lowerCaseName[i];
+                }
+                if (equal) {
+                    std::string_view value = line.substr(lowerCaseName.length() + 1);
+                    while (value.length() && (value.front() == ' ' || value.front() == '\t')) {
+                        value.remove_prefix(1);
+                    }
+                    while (value.length() && (value.back() == ' ' || value.back() == '\t')) {
+                        value.remove_suffix(1);
+                    }
+                    return value;
+                }
+            }
+        }
+        return {};
+    }
+
+    static void connectSocket(Connection *connection) {
+        ClientContextData *clientContextData = connection->clientContextData;
+        us_socket_t *s = us_socket_context_connect(SSL, clientContextData->handshakeContext, connection->host.c_str(), connection->port, nullptr, 0, sizeof(HandshakeData));
+        if (!s) {
+            failed(connection);
+            return;
+        }
+
+        new (us_socket_ext(SSL, s)) HandshakeData{connection, {}, {}};
+        us_socket_timeout(SSL, s, clientContextData->handshakeTimeout);
+    }
+
+    /* Reconnects after a delay of reconnectDelay * 2^attempts, capped, of which the latter half is random
+     * so that thousands of connections lost together do not all come back in the same millisecond */
+    static void reconnect(Connection *connection) {
+        ClientContextData *clientContextData = connection->clientContextData;
+        if (clientContextData->closing || !clientContextData->reconnectDelay) {
+            return;
+        }
+
+        uint64_t delay = std::min<uint64_t>((uint64_t) clientContextData->reconnectDelay << std::min(connection->attempts, 16u), clientContextData->maxReconnectDelay);
+        delay = delay / 2 + protocol::maskingKey() % (delay / 2 + 1);
+
+        connection->reconnectTimer.user = connection;
+        connection->reconnectTimer.cb = [](void *user) {
+            connectSocket((Connection *) user);
+        };
+        Loop::get()->armTimer(&connection->reconnectTimer, delay);
+    }
+
+    static void failed(Connection *connection) {
+        connection->attempts++;
+        if (connection->clientContextData->failedHandler) {
+            connection->clientContextData->failedHandler(connection->url, connection->attempts);
+        }
+        reconnect(connection);
+    }
+
+    /* Checks the response of the server, adopting the socket into the WebSocketContext if it agreed */
+    static us_socket_t *upgrade(us_socket_t *s, std::string_view response, char *tail, int tailLength) {
+        HandshakeData *handshakeData = (HandshakeData *) us_socket_ext(SSL, s);
+        Connection *connection = handshakeData->connection;
+        ClientContextData *clientContextData = connection->clientContextData;
+
+        if (response.substr(0, 13) != "HTTP/1.1 101 ") {
+            return us_socket_close(SSL, s, 0, nullptr);
+        }
+        std::string_view headers = response.substr(response.find("\r\n") + 2);
+
+        char secWebSocketAccept[29] = {};
+        WebSocketHandshake::generate(handshakeData->key, secWebSocketAccept);
+        if (getHeader(headers, "sec-websocket-accept") != std::string_view(secWebSocketAccept, 28)) {
+            return us_socket_close(SSL, s, 0, nullptr);
+        }
+
+        /* We asked the server not to take context over, it has to agree when it compresses */
+        bool perMessageDeflate = false;
+        std::string_view secWebSocketExtensions = getHeader(headers, "sec-websocket-extensions");
+        if (secWebSocketExtensions.length() && clientContextData->perMessageDeflate) {
+            ExtensionsParser extensionsParser(secWebSocketExtensions.data(), secWebSocketExtensions.length());
+            if (extensionsParser.perMessageDeflate && !extensionsParser.serverNoContextTakeover) {
+                return us_socket_close(SSL, s, 0, nullptr);
+            }
+            perMessageDeflate = extensionsParser.perMessageDeflate;
+        }
+
+        handshakeData->~HandshakeData();
+
+        WebSocket<SSL, false, USERDATA> *webSocket = (WebSocket<SSL, false, USERDATA> *) us_socket_context_adopt_socket(SSL,
+                    (us_socket_context_t *) clientContextData->webSocketContext, s, sizeof(WebSocketData) + sizeof(ClientSocketData));
+        webSocket->init(perMessageDeflate, CompressOptions(SHARED_COMPRESSOR | SHARED_DECOMPRESSOR), BackPressure());
+        us_socket_timeout(SSL, (us_socket_t *) webSocket, clientContextData->webSocketContext->getExt()->idleTimeoutComponents.first);
 
-        WebSocketContext<0, false, int> *webSocketContext;
-        // behöver ett nytt http context med minimal klient, som slår om till den riktiga websocketcontext
-        // om samma storlek på httpsocket och websocket blir det enkel övergång
+        new (webSocket->getUserData()) ClientSocketData{USERDATA(), connection};
+        connection->attempts = 0;
 
-        ClientApp(WebSocketClientBehavior &&behavior) {
-            //webSocketContext = WebSocketContext<0, false, int>::create();
+        /* What we send in open goes out together, or with our reply to what came with the 101 */
+        webSocket->AsyncSocket<SSL>::cork();
+        if (clientContextData->openHandler) {
+            clientContextData->openHandler(webSocket);
         }
+        if (us_socket_is_closed(SSL, (us_socket_t *) webSocket)) {
+            /* Uncorking a closed socket is fine, and the cork must not outlive this iteration */
+            webSocket->AsyncSocket<SSL>::uncork();
+            return (us_socket_t *) webSocket;
+        }
+        if (tailLength) {
+            WebSocketContext<SSL, false, USERDATA>::handleData((us_socket_t *) webSocket, tail, tailLength);
+        }
+        webSocket->AsyncSocket<SSL>::uncork();
+        return (us_socket_t *) webSocket;
+    }
+
+    void init(WebSocketClientBehavior &&behavior) {
+        ClientContextData *clientContextData = new (getClientContextData()) ClientContextData;
+        clientContextData->handshakeContext = handshakeContext;
+        clientContextData->openHandler = std::move(behavior.open);
+        clientContextData->failedHandler = std::move(behavior.failed);
+        clientContextData->reconnectDelay = behavior.reconnectDelay;
+        clientContextData->maxReconnectDelay = std::max(behavior.maxReconnectDelay, behavior.reconnectDelay);
+        clientContextData->handshakeTimeout = behavior.idleTimeout ? behavior.idleTimeout : 120;
+
+#ifdef UWS_NO_ZLIB
+        behavior.compression = DISABLED;
+#endif
+        clientContextData->perMessageDeflate = behavior.compression != DISABLED;
+        if (clientContextData->perMessageDeflate) {
+            ((LoopData *) us_loop_ext((us_loop_t *) Loop::get()))->initCompression();
+        }
+
+        /* Sockets in handshake */
+        us_socket_context_on_open(SSL, handshakeContext, [](us_socket_t *s, int /*isClient*/, char */*ip*/, int /*ipLength*/) {
+            HandshakeData *handshakeData = (HandshakeData *) us_socket_ext(SSL, s);
+            Connection *connection = handshakeData->connection;
+            ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_add(1, std::memory_order_relaxed);
+
+            unsigned char random[16];
+            for (int i = 0; i < 16; i += 4) {
+                uint32_t key = protocol::maskingKey();
+                memcpy(random + i, &key, 4);
+            }
+            WebSocketHandshake::generateKey(random, handshakeData->key);
+
+            std::string request = "GET " + connection->path + " HTTP/1.1\r\nHost: " + connection->host;
+            if (connection->port != (SSL ? 443 : 80)) {
+                request += ":" + std::to_string(connection->port);
+            }
+            request += "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: ";
+            request.append(handshakeData->key, 24);
+            if (connection->protocol.length()) {
+                request += "\r\nSec-WebSocket-Protocol: " + connection->protocol;
+            }
+            if (connection->clientContextData->perMessageDeflate) {
+                request += "\r\nSec-WebSocket-Extensions: permessage-deflate; client_no_context_takeover; server_no_context_takeover";
+            }
+            request += "\r\n\r\n";
+
+            /* A fresh socket takes a request this small whole */
+            us_socket_write(SSL, s, request.data(), (int) request.length(), 0);
+            return s;
+        });
+
+        us_socket_context_on_data(SSL, handshakeContext, [](us_socket_t *s, char *data, int length) {
+            HandshakeData *handshakeData = (HandshakeData *) us_socket_ext(SSL, s);
+
+            /* The end of the response is in this read, and so is whatever the server sent right behind it */
+            size_t previousLength = handshakeData->response.length();
+            handshakeData->response.append(data, (size_t) length);
+            size_t end = handshakeData->response.find("\r\n\r\n", previousLength >= 3 ? previousLength - 3 : 0);
+            if (end == std::string::npos) {
+                if (handshakeData->response.length() > 16 * 1024) {
+                    return us_socket_close(SSL, s, 0, nullptr);
+                }
+                return s;
+            }
+            end += 4;
+
+            int tailLength = (int) (handshakeData->response.length() - end);
+            std::string response = std::move(handshakeData->response);
+            return upgrade(s, std::string_view(response.data(), end), data + length - tailLength, tailLength);
+        });
+
+        us_socket_context_on_close(SSL, handshakeContext, [](us_socket_t *s, int /*code*/, void */*reason*/) {
+            HandshakeData *handshakeData = (HandshakeData *) us_socket_ext(SSL, s);
+            Connection *connection = handshakeData->connection;
+            handshakeData->~HandshakeData();
+            ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_sub(1, std::memory_order_relaxed);
+
+            failed(connection);
+            return s;
+        });
+
+        /* Connecting sockets never opened, so there is no close */
+        us_socket_context_on_connect_error(SSL, handshakeContext, [](us_socket_t *s, int /*code*/) {
+            HandshakeData *handshakeData = (HandshakeData *) us_socket_ext(SSL, s);
+            Connection *connection = handshakeData->connection;
+            handshakeData->~HandshakeData();
+
+            failed(connection);
+            return s;
+        });
+
+        us_socket_context_on_timeout(SSL, handshakeContext, [](us_socket_t *s) {
+            return us_socket_close(SSL, s, 0, nullptr);
+        });
+
+        us_socket_context_on_end(SSL, handshakeContext, [](us_socket_t *s) {
+            return us_socket_close(SSL, s, 0, nullptr);
+        });
 
-        ClientApp &&connect(std::string url, std::string protocol = "") {
+        us_socket_context_on_writable(SSL, handshakeContext, [](us_socket_t *s) {
+            return s;
+        });
 
+        /* Open WebSockets */
+        auto *webSocketContext = WebSocketContext<SSL, false, USERDATA>::create(Loop::get(), handshakeContext, nullptr);
+        clientContextData->webSocketContext = webSocketContext;
+
+        WebSocketContextData<SSL, USERDATA, false> *webSocketContextData = webSocketContext->getExt();
+        webSocketContextData->messageHandler = std::move(behavior.message);
+        webSocketContextData->messageChunkHandler = std::move(behavior.messageChunk);
+        webSocketContextData->droppedHandler = std::move(behavior.dropped);
+        webSocketContextData->drainHandler = std::move(behavior.drain);
+        webSocketContextData->pingHandler = std::move(behavior.ping);
+        webSocketContextData->pongHandler = std::move(behavior.pong);
+        webSocketContextData->closeHandler = [close = std::move(behavior.close)](WebSocket<SSL, false, USERDATA> *ws, int code, std::string_view message) mutable {
+            Connection *connection = ((ClientSocketData *) ws->getUserData())->connection;
+            if (close) {
+                close(ws, code, message);
+            }
+            reconnect(connection);
+        };
+
+        webSocketContextData->maxPayloadLength = behavior.maxPayloadLength;
+        webSocketContextData->maxBackpressure = behavior.maxBackpressure;
+        webSocketContextData->closeOnBackpressureLimit = behavior.closeOnBackpressureLimit;
+        webSocketContextData->resetIdleTimeoutOnSend = behavior.resetIdleTimeoutOnSend;
+        webSocketContextData->sendPingsAutomatically = behavior.sendPingsAutomatically;
+        webSocketContextData->emitAutomaticPongs = behavior.emitAutomaticPongs;
+        webSocketContextData->batchSends = behavior.batchSends;
+        webSocketContextData->compression = behavior.compression;
+        webSocketContextData->compressionLevel = std::clamp(behavior.compressionLevel, 0, 9);
+        webSocketContextData->calculateIdleTimeoutCompnents(behavior.idleTimeout);
+    }
+
+public:
+    TemplatedClientApp(WebSocketClientBehavior &&behavior, SocketContextOptions options = {}) {
+        /* Don't compile if alignment rules cannot be satisfied */
+        static_assert(alignof(USERDATA) <= LIBUS_EXT_ALIGNMENT,
+        "µWebSockets cannot satisfy UserData alignment requirements. You need to recompile µSockets with LIBUS_EXT_ALIGNMENT adjusted accordingly.");
+
+        /* Terminate on misleading idleTimeout values */
+        if (behavior.idleTimeout && behavior.idleTimeout < 8) {
+            std::cerr << "Error: idleTimeout must be either 0 or greater than 8!" << std::endl;
+            std::terminate();
+        }
+
+        if (behavior.idleTimeout > 240 * 4) {
+            std::cerr << "Error: idleTimeout must not be greater than 960 seconds!" << std::endl;
+            std::terminate();
+        }
+
+        handshakeContext = us_create_socket_context(SSL, (us_loop_t *) Loop::get(), sizeof(ClientContextData), options);
+        if (handshakeContext) {
+            init(std::move(behavior));
+        }
+    }
+
+    ~TemplatedClientApp() {
+        if (handshakeContext) {
+            ClientContextData *clientContextData = getClientContextData();
+            clientContextData->webSocketContext->free();
+            clientContextData->~ClientContextData();
+            us_socket_context_free(SSL, handshakeContext);
+        }
+    }
+
+    /* Disallow copying, only move */
+    TemplatedClientApp(const TemplatedClientApp &other) = delete;
+
+    TemplatedClientApp(TemplatedClientApp &&other) {
+        handshakeContext = other.handshakeContext;
+        other.handshakeContext = nullptr;
+    }
+
+    bool constructorFailed() {
+        return !handshakeContext;
+    }
+
+    /* Opens connections to url (ws:// or wss://), each reconnecting on its own whenever it is lost */
+    TemplatedClientApp &&connect(std::string url, std::string protocol = "", unsigned int connections = 1) {
+        if (!handshakeContext) {
             return std::move(*this);
         }
 
-        void run() {
+        ClientContextData *clientContextData = getClientContextData();
+        for (unsigned int i = 0; i < connections; i++) {
+            std::unique_ptr<Connection> connection = std::make_unique<Connection>();
+            connection->clientContextData = clientContextData;
+            connection->url = url;
+            connection->protocol = protocol;
+            if (!parseUrl(url, connection.get())) {
+                std::cerr << "Error: cannot connect to malformed url " << url << "!" << std::endl;
+                return std::move(*this);
+            }
+            clientContextData->connections.push_back(std::move(connection));
+            connectSocket(clientContextData->connections.back().get());
+        }
+        return std::move(*this);
+    }
 
+    /* Closes every connection for good, nothing reconnects after this */
+    TemplatedClientApp &&close() {
+        if (handshakeContext) {
+            ClientContextData *clientContextData = getClientContextData();
+            clientContextData->closing = true;
+            for (std::unique_ptr<Connection> &connection : clientContextData->connections) {
+                connection->reconnectTimer.cancel();
+            }
+            us_socket_context_close(SSL, (us_socket_context_t *) clientContextData->webSocketContext);
+            us_socket_context_close(SSL, handshakeContext);
         }
+        return std::move(*this);
+    }
 
-    };
+    TemplatedClientApp &&run() {
+        uWS::run();
+        return std::move(*this);
+    }
+
+    Loop *getLoop() {
+        return (Loop *) us_socket_context_loop(SSL, handshakeContext);
+    }
+};
+
+typedef TemplatedClientApp<false> ClientApp;
+typedef TemplatedClientApp<true> SSLClientApp;
+
+}
 
-}
\ No newline at end of file
+#endif // UWS_CLIENTAPP_H
@@ -0,0 +1,632 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_CLUSTER_H
+#define UWS_CLUSTER_H
+
+/* A Cluster takes publish of one App to the Apps of other processes, on this node through shared memory and on
+ * other nodes over TCP. Every process shares what it subscribes to as an InterestDigest, so that a message only
+ * travels to processes that may have subscribers for its topic, and is published into their TopicTree there.
+ *
+ * Every node runs the same numProcesses processes. Process i of a node links to process i of every other node
+ * and relays what it gets from them to the other processes of its node, so every message crosses the network
+ * once per interested node. What is published in one loop iteration leaves in one write per link, and changes
+ * in what we subscribe to reach others within interestInterval. See cluster/README.md */
+
+#include "App.h"
+#include "ClusterSegment.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+
+namespace uWS {
+
+struct ClusterOptions {
+    /* Names the shared memory and the unix sockets of a node, the same for all of its processes */
+    std::string name = "uws-cluster";
+    /* Where the unix sockets that wake processes up go */
+    std::string socketDirectory = "/tmp";
+    unsigned int numProcesses = 1;
+    unsigned int processIndex = 0;
+    /* Host and port of every node, in the same order on all of them. Process i listens on port + i */
+    std::vector<std::pair<std::string, int>> nodes;
+    unsigned int nodeIndex = 0;
+    /* Bytes in flight from one process to another of this node, rounded up to a power of two */
+    size_t ringCapacity = 1024 * 1024;
+    /* Bytes buffered for another node before messages to it are dropped */
+    size_t maxBackpressure = 16 * 1024 * 1024;
+    /* Milliseconds between looks at what we subscribe to, and what others of this node do */
+    int interestInterval = 20;
+};
+
+template <typename APP>
+struct Cluster {
+private:
+    enum FrameType : unsigned char {
+        /* Which node is connecting, sent once by the connecting side */
+        HELLO,
+        /* What the node subscribes to, whenever it changes */
+        INTEREST,
+        PUBLISH
+    };
+
+    /* Frames are their length (including type) and type, followed by the body */
+    static constexpr size_t FRAME_HEADER_LENGTH = 5;
+    static constexpr size_t MAX_FRAME_LENGTH = 64 * 1024 * 1024;
+
+    struct Node {
+        us_socket_t *socket = nullptr;
+        /* Connected and told who we are */
+        bool open = false;
+        std::string outgoing;
+        /* Nothing until told */
+        InterestDigest interest;
+    };
+
+    struct NodeSocketData {
+        int node = -1;
+        std::string incoming;
+    };
+
+    struct WakeSocketData {
+        int process = -1;
+    };
+
+    APP *app;
+    ClusterOptions options;
+    ClusterSegment segment;
+    bool failed = false, closed = false;
+
+    us_socket_context_t *wakeContext = nullptr, *nodeContext = nullptr;
+    us_listen_socket_t *wakeListenSocket = nullptr, *nodeListenSocket = nullptr;
+    us_timer_t *timer = nullptr;
+    unsigned int ticks = 0;
+
+    /* Connected to the wake up socket of every other process of this node */
+    std::vector<us_socket_t *> wakeSockets;
+    /* Processes of this node that are running, as of the last tick */
+    std::vector<bool> alive;
+    std::vector<Node> nodes;
+
+    /* What was last put in our slot, and last sent to other nodes */
+    unsigned int topicsVersion = UINT_MAX;
+    InterestDigest nodeInterest;
+
+    static Cluster *getCluster(us_socket_t *s) {
+        return *(Cluster **) us_socket_context_ext(0, us_socket_context(0, s));
+    }
+
+    LoopData *getLoopData() {
+        return (LoopData *) us_loop_ext((us_loop_t *) app->getLoop());
+    }
+
+    std::string wakePath(unsigned int process) {
+        return options.socketDirectory + "/" + options.name + "-" + std::to_string(process) + ".sock";
+    }
+
+    bool publishLocally(std::string_view topic, std::string_view message, int opCode, bool compress) {
+        /* Apps without any WebSocket route have no TopicTree */
+        return app->topicTree && app->publish(topic, message, (OpCode) opCode, compress);
+    }
+
+    /* Puts the message in the ring of every other process of this node that may want it */
+    bool forwardToProcesses(uint64_t hash, std::string_view header, std::string_view topic, std::string_view message) {
+        bool forwarded = false;
+        for (unsigned int p = 0; p < options.numProcesses; p++) {
+            if (p == options.processIndex || !alive[p] || !segment.slot(p)->mayContain(hash)) {
+                continue;
+            }
+
+            SharedRing *ring = segment.ring(options.processIndex, p);
+            if (!ring->push(segment.getRingCapacity(), {header, topic, message})) {
+                UWS_METRIC(getLoopData(), clusterDroppedMessages, 1);
+                continue;
+            }
+            forwarded = true;
+
+            /* Only the first message since the consumer last looked wakes it up, ticks catch anything lost */
+            if (!ring->wakeupPending.exchange(1, std::memory_order_acq_rel) && wakeSockets[p] && us_socket_is_established(0, wakeSockets[p])) {
+                us_socket_write(0, wakeSockets[p], "w", 1, 0);
+            }
+        }
+        return forwarded;
+    }
+
+    void drainRings() {
+        for (unsigned int p = 0; p < options.numProcesses; p++) {
+            if (p == options.processIndex) {
+                continue;
+            }
+
+            /* Clear before popping so that anything pushed after this wakes us up again */
+            SharedRing *ring = segment.ring(p, options.processIndex);
+            ring->wakeupPending.store(0, std::memory_order_seq_cst);
+            ring->pop(segment.getRingCapacity(), [this](std::string_view record) {
+                std::string_view topic, message;
+                int opCode;
+                bool compress;
+                if (ClusterMessage::parse(record, topic, message, opCode, compress)) {
+                    publishLocally(topic, message, opCode, compress);
+                }
+            });
+        }
+    }
+
+    void appendFrame(Node &node, FrameType type, std::initializer_list<std::string_view> parts) {
+        size_t length = 1;
+        for (std::string_view part : parts) {
+            length += part.length();
+        }
+
+        char header[FRAME_HEADER_LENGTH] = {(char) length, (char) (length >> 8), (char) (length >> 16), (char) (length >> 24), (char) type};
+        node.outgoing.append(header, FRAME_HEADER_LENGTH);
+        for (std::string_view part : parts) {
+            node.outgoing.append(part);
+        }
+    }
+
+    void sendInterest(Node &node) {
+        char serialized[InterestDigest::SERIALIZED_LENGTH];
+        nodeInterest.serialize(serialized);
+        appendFrame(node, INTEREST, {std::string_view(serialized, sizeof(serialized))});
+    }
+
+    /* Writes as much as the kernel takes, the rest goes when writable */
+    void flush(Node &node) {
+        if (!node.open || node.outgoing.empty()) {
+            return;
+        }
+        int written = us_socket_write(0, node.socket, node.outgoing.data(), (int) std::min<size_t>(node.outgoing.length(), INT_MAX), 0);
+        if (written > 0) {
+            node.outgoing.erase(0, (size_t) written);
+        }
+    }
+
+    /* Returns false if the link is broken */
+    bool handleFrame(us_socket_t *s, NodeSocketData *nodeSocketData, FrameType type, std::string_view body) {
+        if (type == HELLO) {
+            unsigned int node = body.length() == 4 ? (unsigned int) (unsigned char) body[0] | (unsigned int) (unsigned char) body[1] << 8
+                | (unsigned int) (unsigned char) body[2] << 16 | (unsigned int) (unsigned char) body[3] << 24 : UINT_MAX;
+
+            /* Only nodes before us connect to us, and only once */
+            if (nodeSocketData->node != -1 || node >= options.nodeIndex) {
+                return false;
+            }
+            if (nodes[node].socket) {
+                us_socket_close(0, nodes[node].socket, 0, nullptr);
+            }
+            nodeSocketData->node = (int) node;
+            nodes[node].socket = s;
+            nodes[node].open = true;
+            sendInterest(nodes[node]);
+            return true;
+        }
+
+        if (nodeSocketData->node == -1) {
+            return false;
+        }
+
+        if (type == INTEREST) {
+            return nodes[(unsigned int) nodeSocketData->node].interest.deserialize(body);
+        }
+
+        if (type == PUBLISH) {
+            std::string_view topic, message;
+            int opCode;
+            bool compress;
+            if (!ClusterMessage::parse(body, topic, message, opCode, compress)) {
+                return false;
+            }
+
+            /* What comes from another node is ours to relay within this node, never to other nodes */
+            publishLocally(topic, message, opCode, compress);
+            forwardToProcesses(InterestDigest::hash(topic), body.substr(0, ClusterMessage::HEADER_LENGTH), topic, message);
+            return true;
+        }
+
+        return false;
+    }
+
+    /* Returns how many bytes of whole frames were handled, or npos if the link is broken */
+    size_t handleFrames(us_socket_t *s, NodeSocketData *nodeSocketData, std::string_view data) {
+        size_t consumed = 0;
+        while (data.length() - consumed >= FRAME_HEADER_LENGTH) {
+            const char *frame = data.data() + consumed;
+            size_t length = (size_t) (unsigned char) frame[0] | (size_t) (unsigned char) frame[1] << 8
+                | (size_t) (unsigned char) frame[2] << 16 | (size_t) (unsigned char) frame[3] << 24;
+            if (!length || length > MAX_FRAME_LENGTH) {
+                return std::string_view::npos;
+            }
+            if (data.length() - consumed < 4 + length) {
+                break;
+            }
+            if (!handleFrame(s, nodeSocketData, (FrameType) frame[4], std::string_view(frame + FRAME_HEADER_LENGTH, length - 1))) {
+                return std::string_view::npos;
+            }
+            consumed += 4 + length;
+        }
+        return consumed;
+    }
+
+    void connectNode(unsigned int node) {
+        us_socket_t *s = us_socket_context_connect(0, nodeContext, options.nodes[node].first.c_str(), options.nodes[node].second + (int) options.processIndex, nullptr, 0, sizeof(NodeSocketData));
+        if (s) {
+            new (us_socket_ext(0, s)) NodeSocketData{(int) node, {}};
+            nodes[node].socket = s;
+        }
+    }
+
+    void connectProcess(unsigned int process) {
+        us_socket_t *s = us_socket_context_connect_unix(0, wakeContext, wakePath(process).c_str(), 0, sizeof(WakeSocketData));
+        if (s) {
+            new (us_socket_ext(0, s)) WakeSocketData{(int) process};
+            wakeSockets[process] = s;
+        }
+    }
+
+    /* Links lost, or never made because the other end was not up yet, are retried about once a second */
+    void reconnect() {
+        if (ticks++ % (unsigned int) std::max(1, 1000 / options.interestInterval)) {
+            return;
+        }
+        for (unsigned int p = 0; p < options.numProcesses; p++) {
+            if (p != options.processIndex && !wakeSockets[p] && alive[p]) {
+                connectProcess(p);
+            }
+        }
+        for (unsigned int n = options.nodeIndex + 1; n < nodes.size(); n++) {
+            if (!nodes[n].socket) {
+                connectNode(n);
+            }
+        }
+    }
+
+    void refreshInterest() {
+        for (unsigned int p = 0; p < options.numProcesses; p++) {
+            int32_t pid = segment.slot(p)->pid.load(std::memory_order_relaxed);
+            alive[p] = p == options.processIndex || (pid && (kill(pid, 0) == 0 || errno != ESRCH));
+        }
+
+        /* Our own interest, rebuilt whenever topics came or went */
+        auto *topicTree = app->topicTree;
+        unsigned int version = topicTree ? topicTree->getTopicsVersion() : 0;
+        if (version != topicsVersion) {
+            topicsVersion = version;
+            InterestDigest digest;
+            if (topicTree) {
+                topicTree->forEachTopic([&digest](std::string_view topic) {
+                    digest.add(topic);
+                });
+                digest.everything = topicTree->hasWildcardTopics();
+            }
+            segment.slot(options.processIndex)->store(digest);
+        }
+
+        /* Other nodes hear about all of this node at once, from the process linked to them */
+        if (nodes.size() > 1) {
+            InterestDigest digest;
+            for (unsigned int p = 0; p < options.numProcesses; p++) {
+                if (alive[p]) {
+                    InterestDigest processInterest;
+                    segment.slot(p)->load(processInterest);
+                    digest.merge(processInterest);
+                }
+            }
+            if (!(digest == nodeInterest)) {
+                nodeInterest = digest;
+                for (Node &node : nodes) {
+                    if (node.open) {
+                        sendInterest(node);
+                    }
+                }
+            }
+        }
+    }
+
+    void initWakeContext() {
+        us_socket_context_on_open(0, wakeContext, [](us_socket_t *s, int is_client, char */*ip*/, int /*ip_length*/) {
+            if (!is_client) {
+                new (us_socket_ext(0, s)) WakeSocketData;
+            }
+            return s;
+        });
+
+        /* Whatever woke us, every ring is looked at */
+        us_socket_context_on_data(0, wakeContext, [](us_socket_t *s, char */*data*/, int /*length*/) {
+            getCluster(s)->drainRings();
+            return s;
+        });
+
+        us_socket_context_on_close(0, wakeContext, [](us_socket_t *s, int /*code*/, void */*reason*/) {
+            WakeSocketData *wakeSocketData = (WakeSocketData *) us_socket_ext(0, s);
+            Cluster *cluster = getCluster(s);
+            if (wakeSocketData->process != -1 && cluster->wakeSockets[(unsigned int) wakeSocketData->process] == s) {
+                cluster->wakeSockets[(unsigned int) wakeSocketData->process] = nullptr;
+            }
+            wakeSocketData->~WakeSocketData();
+            return s;
+        });
+
+        /* Connecting sockets never opened, so there is no close */
+        us_socket_context_on_connect_error(0, wakeContext, [](us_socket_t *s, int /*code*/) {
+            WakeSocketData *wakeSocketData = (WakeSocketData *) us_socket_ext(0, s);
+            getCluster(s)->wakeSockets[(unsigned int) wakeSocketData->process] = nullptr;
+            wakeSocketData->~WakeSocketData();
+            return s;
+        });
+
+        us_socket_context_on_end(0, wakeContext, [](us_socket_t *s) {
+            return us_socket_close(0, s, 0, nullptr);
+        });
+
+        us_socket_context_on_writable(0, wakeContext, [](us_socket_t *s) {
+            return s;
+        });
+
+        us_socket_context_on_timeout(0, wakeContext, [](us_socket_t *s) {
+            return s;
+        });
+    }
+
+    void initNodeContext() {
+        us_socket_context_on_open(0, nodeContext, [](us_socket_t *s, int is_client, char */*ip*/, int /*ip_length*/) {
+            Cluster *cluster = getCluster(s);
+            if (!is_client) {
+                /* Nobody until it says hello */
+                new (us_socket_ext(0, s)) NodeSocketData;
+                return s;
+            }
+
+            NodeSocketData *nodeSocketData = (NodeSocketData *) us_socket_ext(0, s);
+            Node &node = cluster->nodes[(unsigned int) nodeSocketData->node];
+            node.open = true;
+
+            char hello[4] = {(char) cluster->options.nodeIndex, (char) (cluster->options.nodeIndex >> 8),
+                (char) (cluster->options.nodeIndex >> 16), (char) (cluster->options.nodeIndex >> 24)};
+            cluster->appendFrame(node, HELLO, {std::string_view(hello, 4)});
+            cluster->sendInterest(node);
+            cluster->flush(node);
+            return s;
+        });
+
+        us_socket_context_on_data(0, nodeContext, [](us_socket_t *s, char *data, int length) {
+            Cluster *cluster = getCluster(s);
+            NodeSocketData *nodeSocketData = (NodeSocketData *) us_socket_ext(0, s);
+
+            /* Frames are parsed where they were read, only what is left over is kept */
+            std::string_view pending(data, (size_t) length);
+            bool buffered = nodeSocketData->incoming.length();
+            if (buffered) {
+                nodeSocketData->incoming.append(data, (size_t) length);
+                pending = nodeSocketData->incoming;
+            }
+
+            size_t consumed = cluster->handleFrames(s, nodeSocketData, pending);
+            if (consumed == std::string_view::npos) {
+                return us_socket_close(0, s, 0, nullptr);
+            }
+
+            if (buffered) {
+                nodeSocketData->incoming.erase(0, consumed);
+            } else {
+                nodeSocketData->incoming.assign(pending.substr(consumed));
+            }
+            return s;
+        });
+
+        us_socket_context_on_writable(0, nodeContext, [](us_socket_t *s) {
+            NodeSocketData *nodeSocketData = (NodeSocketData *) us_socket_ext(0, s);
+            Cluster *cluster = getCluster(s);
+            if (nodeSocketData->node != -1 && cluster->nodes[(unsigned int) nodeSocketData->node].socket == s) {
+                cluster->flush(cluster->nodes[(unsigned int) nodeSocketData->node]);
+            }
+            return s;
+        });
+
+        us_socket_context_on_close(0, nodeContext, [](us_socket_t *s, int /*code*/, void */*reason*/) {
+            NodeSocketData *nodeSocketData = (NodeSocketData *) us_socket_ext(0, s);
+            getCluster(s)->lostNode(s, nodeSocketData->node);
+            nodeSocketData->~NodeSocketData();
+            return s;
+        });
+
+        /* Connecting sockets never opened, so there is no close */
+        us_socket_context_on_connect_error(0, nodeContext, [](us_socket_t *s, int /*code*/) {
+            NodeSocketData *nodeSocketData = (NodeSocketData *) us_socket_ext(0, s);
+            getCluster(s)->lostNode(s, nodeSocketData->node);
+            nodeSocketData->~NodeSocketData();
+            return s;
+        });
+
+        us_socket_context_on_end(0, nodeContext, [](us_socket_t *s) {
+            return us_socket_close(0, s, 0, nullptr);
+        });
+
+        us_socket_context_on_timeout(0, nodeContext, [](us_socket_t *s) {
+            return s;
+        });
+    }
+
+    void lostNode(us_socket_t *s, int node) {
+        if (node != -1 && nodes[(unsigned int) node].socket == s) {
+            nodes[(unsigned int) node] = {};
+        }
+    }
+
+public:
+    /* Must be called from the thread running the app's Loop, before it runs */
+    Cluster(APP &app, ClusterOptions clusterOptions) : app(&app), options(std::move(clusterOptions)) {
+        if (!options.numProcesses || options.processIndex >= options.numProcesses || (options.nodes.size() && options.nodeIndex >= options.nodes.size())) {
+            std::cerr << "Error: processIndex and nodeIndex of a Cluster must be less than numProcesses and the number of nodes!" << std::endl;
+            std::terminate();
+        }
+
+        if (options.interestInterval <= 0) {
+            std::cerr << "Error: interestInterval of a Cluster must be positive!" << std::endl;
+            std::terminate();
+        }
+
+        if (!segment.open(options.name, options.numProcesses, options.ringCapacity)) {
+            std::cerr << "Error: cannot map the shared memory of cluster " << options.name << ", or it has another numProcesses or ringCapacity!" << std::endl;
+            failed = true;
+            return;
+        }
+
+        /* Whatever was sent to whoever had our place before is stale */
+        for (unsigned int p = 0; p < options.numProcesses; p++) {
+            segment.ring(p, options.processIndex)->discard();
+        }
+        segment.slot(options.processIndex)->store(InterestDigest{});
+        segment.slot(options.processIndex)->pid.store((int32_t) getpid(), std::memory_order_relaxed);
+
+        wakeSockets.resize(options.numProcesses, nullptr);
+        alive.resize(options.numProcesses, false);
+        nodes.resize(options.nodes.size());
+
+        us_loop_t *loop = (us_loop_t *) app.getLoop();
+        wakeContext = us_create_socket_context(0, loop, sizeof(Cluster *), {});
+        nodeContext = us_create_socket_context(0, loop, sizeof(Cluster *), {});
+        if (!wakeContext || !nodeContext) {
+            failed = true;
+            return;
+        }
+        *(Cluster **) us_socket_context_ext(0, wakeContext) = this;
+        *(Cluster **) us_socket_context_ext(0, nodeContext) = this;
+        initWakeContext();
+        initNodeContext();
+
+        unlink(wakePath(options.processIndex).c_str());
+        wakeListenSocket = us_socket_context_listen_unix(0, wakeContext, wakePath(options.processIndex).c_str(), 0, sizeof(WakeSocketData));
+        if (nodes.size() > 1) {
+            nodeListenSocket = us_socket_context_listen(0, nodeContext, nullptr, options.nodes[options.nodeIndex].second + (int) options.processIndex, 0, sizeof(NodeSocketData));
+        }
+        if (!wakeListenSocket || (nodes.size() > 1 && !nodeListenSocket)) {
+            std::cerr << "Error: cluster " << options.name << " cannot listen for process " << options.processIndex << "!" << std::endl;
+            failed = true;
+            return;
+        }
+
+        /* Fall through, so that the loop still ends when the app closes */
+        timer = us_create_timer(loop, 1, sizeof(Cluster *));
+        *(Cluster **) us_timer_ext(timer) = this;
+        us_timer_set(timer, [](us_timer_t *t) {
+            Cluster *cluster = *(Cluster **) us_timer_ext(t);
+            cluster->refreshInterest();
+            cluster->drainRings();
+            cluster->reconnect();
+        }, options.interestInterval, options.interestInterval);
+
+        /* Everything published in one iteration leaves together */
+        app.getLoop()->addPostHandler(this, [this](Loop */*loop*/) {
+            for (Node &node : nodes) {
+                flush(node);
+            }
+        });
+
+        refreshInterest();
+        reconnect();
+    }
+
+    Cluster(const Cluster &) = delete;
+
+    ~Cluster() {
+        close();
+        if (wakeContext) {
+            us_socket_context_free(0, wakeContext);
+        }
+        if (nodeContext) {
+            us_socket_context_free(0, nodeContext);
+        }
+        if (!failed || wakeListenSocket) {
+            unlink(wakePath(options.processIndex).c_str());
+        }
+        if (segment.isOpen()) {
+            segment.slot(options.processIndex)->store(InterestDigest{});
+            segment.slot(options.processIndex)->pid.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool constructorFailed() {
+        return failed;
+    }
+
+    /* Closes every link, so that the loop can end along with the app */
+    void close() {
+        if (closed) {
+            return;
+        }
+        closed = true;
+
+        if (timer) {
+            us_timer_close(timer);
+            app->getLoop()->removePostHandler(this);
+        }
+        if (wakeListenSocket) {
+            us_listen_socket_close(0, wakeListenSocket);
+        }
+        if (nodeListenSocket) {
+            us_listen_socket_close(0, nodeListenSocket);
+        }
+        if (wakeContext) {
+            us_socket_context_close(0, wakeContext);
+        }
+        if (nodeContext) {
+            us_socket_context_close(0, nodeContext);
+        }
+    }
+
+    /* Publishes to our own app and to every process of the cluster that may have subscribers for topic,
+     * from the thread of our app. Returns false if it went nowhere */
+    bool publish(std::string_view topic, std::string_view message, OpCode opCode = OpCode::TEXT, bool compress = false) {
+        bool published = publishLocally(topic, message, opCode, compress);
+        if (failed || closed || topic.length() > ClusterMessage::MAX_TOPIC_LENGTH) {
+            return published;
+        }
+
+        char header[ClusterMessage::HEADER_LENGTH];
+        ClusterMessage::formatHeader(header, topic.length(), opCode, compress);
+        uint64_t hash = InterestDigest::hash(topic);
+        std::string_view headerView(header, sizeof(header));
+
+        published |= forwardToProcesses(hash, headerView, topic, message);
+
+        bool fitsFrame = 1 + sizeof(header) + topic.length() + message.length() <= MAX_FRAME_LENGTH;
+        for (Node &node : nodes) {
+            if (!node.open || !node.interest.mayContain(hash)) {
+                continue;
+            }
+            if (!fitsFrame || node.outgoing.length() > options.maxBackpressure) {
+                UWS_METRIC(getLoopData(), clusterDroppedMessages, 1);
+                continue;
+            }
+            appendFrame(node, PUBLISH, {headerView, topic, message});
+            published = true;
+        }
+        return published;
+    }
+};
+
+}
+
+#endif // UWS_CLUSTER_H
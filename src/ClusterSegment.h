@@ -0,0 +1,376 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_CLUSTERSEGMENT_H
+#define UWS_CLUSTERSEGMENT_H
+
+/* What the processes of a Cluster share: the shared memory of one node, holding what every process subscribes to
+ * and one ring of messages for every ordered pair of processes, and the encoding of messages and interest used
+ * both in there and between nodes. Only the producing process writes to a ring and only the consuming one reads
+ * from it, so no lock is ever taken. POSIX only */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace uWS {
+
+/* A Bloom filter of topics. False positives only cost a message sent for nothing, a wildcard subscription
+ * matches everything */
+struct InterestDigest {
+    static constexpr unsigned int BITS = 8192;
+    static constexpr unsigned int WORDS = BITS / 64;
+    static constexpr unsigned int PROBES = 3;
+    static constexpr size_t SERIALIZED_LENGTH = WORDS * 8 + 1;
+
+    uint64_t words[WORDS] = {};
+    bool everything = false;
+
+    /* The same on every node whatever its build, the probes are cut from it */
+    static uint64_t hash(std::string_view topic) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (char c : topic) {
+            h = (h ^ (unsigned char) c) * 0x100000001b3ull;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static unsigned int probe(uint64_t hash, unsigned int i) {
+        return (unsigned int) (hash >> (i * 13)) & (BITS - 1);
+    }
+
+    void add(std::string_view topic) {
+        uint64_t h = hash(topic);
+        for (unsigned int i = 0; i < PROBES; i++) {
+            words[probe(h, i) / 64] |= 1ull << (probe(h, i) % 64);
+        }
+    }
+
+    bool mayContain(uint64_t hash) const {
+        if (everything) {
+            return true;
+        }
+        for (unsigned int i = 0; i < PROBES; i++) {
+            if (!(words[probe(hash, i) / 64] & (1ull << (probe(hash, i) % 64)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void merge(const InterestDigest &other) {
+        for (unsigned int i = 0; i < WORDS; i++) {
+            words[i] |= other.words[i];
+        }
+        everything |= other.everything;
+    }
+
+    void clear() {
+        *this = {};
+    }
+
+    bool operator==(const InterestDigest &other) const {
+        return everything == other.everything && !memcmp(words, other.words, sizeof(words));
+    }
+
+    /* Little endian words followed by everything */
+    void serialize(char *out) const {
+        for (unsigned int i = 0; i < WORDS; i++) {
+            for (unsigned int b = 0; b < 8; b++) {
+                out[i * 8 + b] = (char) (words[i] >> (b * 8));
+            }
+        }
+        out[WORDS * 8] = (char) everything;
+    }
+
+    bool deserialize(std::string_view in) {
+        if (in.length() != SERIALIZED_LENGTH) {
+            return false;
+        }
+        for (unsigned int i = 0; i < WORDS; i++) {
+            words[i] = 0;
+            for (unsigned int b = 0; b < 8; b++) {
+                words[i] |= (uint64_t) (unsigned char) in[i * 8 + b] << (b * 8);
+            }
+        }
+        everything = in[WORDS * 8];
+        return true;
+    }
+};
+
+/* A message on its way to other processes: opCode, compress and the length of its topic, then topic and message */
+struct ClusterMessage {
+    static constexpr size_t HEADER_LENGTH = 4;
+    static constexpr size_t MAX_TOPIC_LENGTH = UINT16_MAX;
+
+    static void formatHeader(char *header, size_t topicLength, int opCode, bool compress) {
+        header[0] = (char) opCode;
+        header[1] = (char) compress;
+        header[2] = (char) topicLength;
+        header[3] = (char) (topicLength >> 8);
+    }
+
+    /* Returns false if broken */
+    static bool parse(std::string_view data, std::string_view &topic, std::string_view &message, int &opCode, bool &compress) {
+        if (data.length() < HEADER_LENGTH) {
+            return false;
+        }
+        size_t topicLength = (size_t) (unsigned char) data[2] | (size_t) (unsigned char) data[3] << 8;
+        if (data.length() - HEADER_LENGTH < topicLength) {
+            return false;
+        }
+        opCode = (unsigned char) data[0];
+        compress = data[1];
+        topic = data.substr(HEADER_LENGTH, topicLength);
+        message = data.substr(HEADER_LENGTH + topicLength);
+        return true;
+    }
+};
+
+/* Lives in shared memory where all zeroes is empty. Records are their length followed by their bytes, padded
+ * to 8 bytes, and one that does not fit before the end leaves a marker there and starts over at the beginning */
+struct SharedRing {
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free);
+
+    static constexpr uint32_t WRAP = UINT32_MAX;
+
+    /* Bytes ever pushed and ever popped, on lines of their own since each is written by one process only */
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    /* Set by the producer when it wakes the consumer, cleared by the consumer before it pops */
+    std::atomic<uint32_t> wakeupPending;
+
+    char *data() {
+        return (char *) (this + 1);
+    }
+
+    static size_t recordLength(size_t length) {
+        return (4 + length + 7) & ~(size_t) 7;
+    }
+
+    /* Producer only, capacity is a power of two. Returns false if the parts do not fit right now */
+    bool push(size_t capacity, std::initializer_list<std::string_view> parts) {
+        size_t length = 0;
+        for (std::string_view part : parts) {
+            length += part.length();
+        }
+        size_t needed = recordLength(length);
+
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t free = capacity - (h - tail.load(std::memory_order_acquire));
+        size_t offset = (size_t) h & (capacity - 1);
+        size_t untilEnd = capacity - offset;
+
+        if (needed > untilEnd) {
+            if (untilEnd + needed > free) {
+                return false;
+            }
+            memcpy(data() + offset, &WRAP, 4);
+            h += untilEnd;
+            offset = 0;
+        } else if (needed > free) {
+            return false;
+        }
+
+        uint32_t length32 = (uint32_t) length;
+        memcpy(data() + offset, &length32, 4);
+        char *dst = data() + offset + 4;
+        for (std::string_view part : parts) {
+            if (part.length()) {
+                memcpy(dst, part.data(), part.length());
+                dst += part.length();
+            }
+        }
+        head.store(h + needed, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer only, calls cb with every record there is. Returns how many */
+    template <typename F>
+    unsigned int pop(size_t capacity, F cb) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        unsigned int records = 0;
+
+        while (t != h) {
+            size_t offset = (size_t) t & (capacity - 1);
+            uint32_t length;
+            memcpy(&length, data() + offset, 4);
+            if (length == WRAP) {
+                t += capacity - offset;
+                continue;
+            }
+            cb(std::string_view(data() + offset + 4, length));
+            t += recordLength(length);
+            records++;
+        }
+
+        tail.store(t, std::memory_order_release);
+        return records;
+    }
+
+    /* Consumer only, forgets everything there is */
+    void discard() {
+        tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};
+
+/* The shared memory of one node, mapped by every process of its Cluster */
+struct ClusterSegment {
+    struct Header {
+        std::atomic<uint32_t> numProcesses;
+        std::atomic<uint64_t> ringCapacity;
+    };
+
+    /* What one process subscribes to, stored word by word so readers never see it cleared in between */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> interest[InterestDigest::WORDS];
+        std::atomic<uint32_t> everything;
+        /* 0 when nobody holds it */
+        std::atomic<int32_t> pid;
+
+        void store(const InterestDigest &digest) {
+            for (unsigned int i = 0; i < InterestDigest::WORDS; i++) {
+                interest[i].store(digest.words[i], std::memory_order_relaxed);
+            }
+            everything.store(digest.everything, std::memory_order_relaxed);
+        }
+
+        void load(InterestDigest &digest) const {
+            for (unsigned int i = 0; i < InterestDigest::WORDS; i++) {
+                digest.words[i] = interest[i].load(std::memory_order_relaxed);
+            }
+            digest.everything = everything.load(std::memory_order_relaxed);
+        }
+
+        bool mayContain(uint64_t hash) const {
+            if (everything.load(std::memory_order_relaxed)) {
+                return true;
+            }
+            for (unsigned int i = 0; i < InterestDigest::PROBES; i++) {
+                unsigned int bit = InterestDigest::probe(hash, i);
+                if (!(interest[bit / 64].load(std::memory_order_relaxed) & (1ull << (bit % 64)))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+private:
+    char *memory = nullptr;
+    size_t length = 0;
+    unsigned int numProcesses = 0;
+    size_t ringCapacity = 0;
+
+    static size_t headerLength() {
+        return (sizeof(Header) + 63) & ~(size_t) 63;
+    }
+
+    size_t ringLength() const {
+        return sizeof(SharedRing) + ringCapacity;
+    }
+
+public:
+    ClusterSegment() = default;
+    ClusterSegment(const ClusterSegment &) = delete;
+
+    ~ClusterSegment() {
+        if (memory) {
+            munmap(memory, length);
+        }
+    }
+
+    /* Maps (creating if first) the segment called name, returns false if it cannot or if it was made for
+     * another number of processes or ring capacity. The capacity is rounded up to a power of two */
+    bool open(std::string name, unsigned int processes, size_t capacity) {
+        ringCapacity = 64;
+        while (ringCapacity < capacity) {
+            ringCapacity *= 2;
+        }
+        numProcesses = processes;
+        length = headerLength() + sizeof(Slot) * numProcesses + ringLength() * numProcesses * numProcesses;
+
+        int fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd == -1) {
+            return false;
+        }
+
+        /* Growing to the same length twice is harmless, and new pages read as zeroes */
+        struct stat st;
+        if (fstat(fd, &st) || ((size_t) st.st_size < length && ftruncate(fd, (off_t) length))) {
+            ::close(fd);
+            return false;
+        }
+
+        void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        memory = (char *) mapped;
+
+        /* Whoever comes first decides the geometry */
+        Header *header = (Header *) memory;
+        uint32_t expectedProcesses = 0;
+        uint64_t expectedCapacity = 0;
+        if ((!header->numProcesses.compare_exchange_strong(expectedProcesses, numProcesses) && expectedProcesses != numProcesses)
+            || (!header->ringCapacity.compare_exchange_strong(expectedCapacity, ringCapacity) && expectedCapacity != ringCapacity)) {
+            munmap(memory, length);
+            memory = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    /* Removes the segment called name, those mapping it keep it until they unmap */
+    static void remove(std::string name) {
+        shm_unlink(("/" + name).c_str());
+    }
+
+    bool isOpen() {
+        return memory;
+    }
+
+    size_t getRingCapacity() {
+        return ringCapacity;
+    }
+
+    Slot *slot(unsigned int process) {
+        return (Slot *) (memory + headerLength()) + process;
+    }
+
+    /* The ring from one process to another */
+    SharedRing *ring(unsigned int from, unsigned int to) {
+        return (SharedRing *) (memory + headerLength() + sizeof(Slot) * numProcesses + ringLength() * (from * numProcesses + to));
+    }
+};
+
+}
+
+#endif // UWS_CLUSTERSEGMENT_H
@@ -0,0 +1,111 @@
+/*
+ * Authored by Alex Hultman, 2018-2024.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_COMPRESSIONPOOL_H
+#define UWS_COMPRESSIONPOOL_H
+
+/* Worker threads compressing big messages off the event loops. Every worker has its own compressor which
+ * is reset after every message, so what it makes is valid for any negotiated permessage-deflate mode.
+ * Results are handed back to the loop they came from with Loop::defer. */
+
+#include "PerMessageDeflate.h"
+#include "MoveOnlyFunction.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+/* Number of worker threads, 0 is half of the hardware threads */
+#ifndef UWS_COMPRESSION_POOL_THREADS
+#define UWS_COMPRESSION_POOL_THREADS 0
+#endif
+
+namespace uWS {
+
+struct CompressionPool {
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<MoveOnlyFunction<void(ZlibContext *, DeflationStream *)>> jobs;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    CompressionPool() {
+        unsigned int numWorkers = UWS_COMPRESSION_POOL_THREADS;
+        if (!numWorkers) {
+            numWorkers = std::max(1u, std::thread::hardware_concurrency() / 2);
+        }
+
+        for (unsigned int i = 0; i < numWorkers; i++) {
+            workers.emplace_back([this]() {
+                ZlibContext zlibContext;
+                DeflationStream deflationStream(CompressOptions::DEDICATED_COMPRESSOR);
+
+                while (true) {
+                    MoveOnlyFunction<void(ZlibContext *, DeflationStream *)> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        condition.wait(lock, [this]() { return stopping || jobs.size(); });
+                        if (jobs.empty()) {
+                            return;
+                        }
+                        job = std::move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job(&zlibContext, &deflationStream);
+                }
+            });
+        }
+    }
+
+public:
+    CompressionPool(const CompressionPool &) = delete;
+
+    /* Finishes what was posted, then joins */
+    ~CompressionPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    /* Shared by all loops, started on first use */
+    static CompressionPool &get() {
+        static CompressionPool compressionPool;
+        return compressionPool;
+    }
+
+    /* The job runs on a worker, compressing with deflationStream->deflate(zlibContext, data, true) after setting its level */
+    void post(MoveOnlyFunction<void(ZlibContext *, DeflationStream *)> &&job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back(std::move(job));
+        }
+        condition.notify_one();
+    }
+};
+
+}
+
+#endif // UWS_COMPRESSIONPOOL_H
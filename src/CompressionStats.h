@@ -0,0 +1,80 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_COMPRESSIONSTATS_H
+#define UWS_COMPRESSIONSTATS_H
+
+/* Deflating what does not shrink costs CPU for nothing. Messages that plainly use most byte values, such as anything
+ * already compressed or encrypted, are sent as they are, and so is everything of a socket or topic whose recent
+ * messages did not shrink, but for one in every so many to see if that changed. Sending a message uncompressed
+ * is always allowed, sliding windows simply do not see it, so what was negotiated stays as it was */
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+namespace uWS {
+
+struct CompressionStats {
+    /* Compressed to original size in sixteenths, averaged over the last few messages, 15 for no gain */
+    unsigned char ratio : 4;
+    /* Messages left to send uncompressed before trying again */
+    unsigned char skips : 4;
+
+    static constexpr unsigned int NO_GAIN = 15;
+    static constexpr size_t SAMPLE_WINDOWS = 8, SAMPLE_WINDOW = 32;
+
+    CompressionStats() : ratio(8), skips(0) {}
+
+    bool shouldCompress() {
+        if (skips) {
+            skips--;
+            return false;
+        }
+        return true;
+    }
+
+    void report(size_t originalLength, size_t compressedLength) {
+        unsigned int sixteenths = originalLength ? (unsigned int) std::min<size_t>(NO_GAIN, compressedLength * 16 / originalLength) : NO_GAIN;
+        ratio = (unsigned char) (((ratio * 3 + sixteenths + 3) / 4) & NO_GAIN);
+        if (ratio >= NO_GAIN) {
+            skips = 15;
+        }
+    }
+
+    /* Counts the byte values used by windows spread over the message: random data uses about 160 of 256 samples,
+     * text and most binary formats far fewer. Short messages are left to deflate */
+    static bool looksCompressible(std::string_view message) {
+        if (message.length() < SAMPLE_WINDOWS * SAMPLE_WINDOW) {
+            return true;
+        }
+        bool seen[256] = {};
+        unsigned int distinct = 0;
+        for (size_t i = 0; i < SAMPLE_WINDOWS; i++) {
+            const unsigned char *window = (const unsigned char *) message.data() + i * (message.length() - SAMPLE_WINDOW) / (SAMPLE_WINDOWS - 1);
+            for (size_t j = 0; j < SAMPLE_WINDOW; j++) {
+                distinct += !seen[window[j]];
+                seen[window[j]] = true;
+            }
+        }
+        return distinct < 128;
+    }
+};
+
+}
+
+#endif // UWS_COMPRESSIONSTATS_H
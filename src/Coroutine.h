@@ -0,0 +1,73 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_COROUTINE_H
+#define UWS_COROUTINE_H
+
+/* Handlers may be C++20 coroutines returning uWS::Task, awaiting res->readBody(), res->writable() and ws->drained().
+ * A Task starts right away, runs until its first suspension within the handler and frees itself when done.
+ * Its frame comes from the BlockPool and the awaiters register handlers capturing nothing but themselves,
+ * so a coroutine handler allocates no more than one written with callbacks */
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define UWS_HAS_COROUTINES
+
+#include "BlockPool.h"
+
+#include <coroutine>
+#include <exception>
+
+namespace uWS {
+
+struct Task {
+    struct promise_type {
+        Task get_return_object() {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {
+
+        }
+
+        /* We do not use exceptions, an escaping one is as fatal as in any other handler */
+        void unhandled_exception() {
+            std::terminate();
+        }
+
+        static void *operator new(size_t size) {
+            return BlockPool::get().allocate(size);
+        }
+
+        static void operator delete(void *p, size_t size) {
+            BlockPool::get().deallocate(p, size);
+        }
+    };
+};
+
+}
+
+#endif
+
+#endif // UWS_COROUTINE_H
@@ -0,0 +1,78 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_CPUFEATURES_H
+#define UWS_CPUFEATURES_H
+
+/* What the x86 CPU we run on has beyond what we are compiled for, detected once. Kernels built for more with
+ * __attribute__((target)) are picked through this at startup, so that builds for a baseline CPU (like those of
+ * distributions) still run them. Vector units are only counted as there if the OS saves their registers */
+
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define UWS_CPUFEATURES_X86
+#endif
+
+namespace uWS {
+
+struct CpuFeatures {
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool sha = false;
+    bool avx2 = false;
+    bool avx512f = false;
+
+    static const CpuFeatures &get() {
+        static const CpuFeatures features = detect();
+        return features;
+    }
+
+private:
+    static CpuFeatures detect() {
+        CpuFeatures features;
+#ifdef UWS_CPUFEATURES_X86
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return features;
+        }
+        features.ssse3 = ecx & bit_SSSE3;
+        features.sse41 = ecx & bit_SSE4_1;
+
+        /* Which register states the OS saves: SSE and AVX (bits 1, 2), and the AVX-512 ones (bits 5 to 7) */
+        uint64_t xcr0 = 0;
+        if (ecx & bit_OSXSAVE) {
+            unsigned int low, high;
+            __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+            xcr0 = (uint64_t) high << 32 | low;
+        }
+
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            return features;
+        }
+        features.sha = ebx & bit_SHA;
+        features.avx2 = (ebx & bit_AVX2) && (xcr0 & 0x6) == 0x6;
+        features.avx512f = (ebx & bit_AVX512F) && (xcr0 & 0xe6) == 0xe6;
+#endif
+        return features;
+    }
+};
+
+}
+
+#endif // UWS_CPUFEATURES_H
@@ -0,0 +1,204 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_FILECACHE_H
+#define UWS_FILECACHE_H
+
+/* Per loop cache of open files and their stat results, for HttpResponse::sendFile */
+
+#ifndef _WIN32
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <ctime>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace uWS {
+
+struct FileCache {
+    struct File {
+        /* Open for reading, valid for as long as the File is acquired */
+        int fd;
+        uintmax_t size;
+        time_t lastModified;
+
+    private:
+        friend struct FileCache;
+
+        FileCache *cache;
+        std::map<std::string, File *, std::less<>>::iterator entry;
+        dev_t device;
+        ino_t inode;
+        /* When we last made sure the path still refers to this */
+        time_t checked;
+        unsigned int refs = 0;
+        /* No longer in the cache, closed when released by its last user */
+        bool stale = false;
+        /* Most recently used first */
+        File *prev = nullptr, *next = nullptr;
+
+        bool matches(struct stat &st) {
+            return st.st_dev == device && st.st_ino == inode && (uintmax_t) st.st_size == size && st.st_mtime == lastModified;
+        }
+    public:
+        /* Another reference to this file, given back with its own release */
+        File *share() {
+            refs++;
+            return this;
+        }
+
+        /* Gives back what acquire gave us */
+        void release() {
+            cache->release(this);
+        }
+    };
+
+private:
+    std::map<std::string, File *, std::less<>> files;
+    File *head = nullptr, *tail = nullptr;
+    size_t maxFiles;
+    time_t revalidateSeconds;
+
+    void unlink(File *file) {
+        (file->prev ? file->prev->next : head) = file->next;
+        (file->next ? file->next->prev : tail) = file->prev;
+        file->prev = file->next = nullptr;
+    }
+
+    void pushFront(File *file) {
+        file->next = head;
+        (head ? head->prev : tail) = file;
+        head = file;
+    }
+
+    /* Takes file out of the cache, it goes away now or with its last user */
+    void drop(File *file) {
+        files.erase(file->entry);
+        unlink(file);
+        file->stale = true;
+        if (!file->refs) {
+            close(file->fd);
+            delete file;
+        }
+    }
+
+    /* Closes the least recently used files nobody is sending, until we are within maxFiles */
+    void trim() {
+        for (File *file = tail; file && files.size() > maxFiles; ) {
+            File *prev = file->prev;
+            if (!file->refs) {
+                drop(file);
+            }
+            file = prev;
+        }
+    }
+
+public:
+    /* Stat results are trusted for revalidateSeconds, after which the path is checked for having changed */
+    FileCache(size_t maxFiles = 256, time_t revalidateSeconds = 1) : maxFiles(maxFiles), revalidateSeconds(revalidateSeconds) {
+
+    }
+
+    FileCache(const FileCache &) = delete;
+
+    ~FileCache() {
+        while (head) {
+            File *file = head;
+            unlink(file);
+            close(file->fd);
+            delete file;
+        }
+    }
+
+    size_t size() {
+        return files.size();
+    }
+
+    /* Returns the regular file at path, opening it unless cached, or nullptr. The path is taken as is,
+     * so it must already be resolved and sanitized. Every acquire must be paired with a release */
+    File *acquire(std::string_view path) {
+        time_t now = time(nullptr);
+
+        auto it = files.find(path);
+        if (it != files.end()) {
+            File *file = it->second;
+            struct stat st;
+            if (now - file->checked < revalidateSeconds || (stat(it->first.c_str(), &st) == 0 && file->matches(st))) {
+                if (now - file->checked >= revalidateSeconds) {
+                    file->checked = now;
+                }
+                file->refs++;
+                if (file != head) {
+                    unlink(file);
+                    pushFront(file);
+                }
+                return file;
+            }
+            /* Replaced, modified or removed; whoever is still sending the old one keeps it */
+            drop(file);
+        }
+
+        std::string pathString(path);
+        int fd = open(pathString.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return nullptr;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return nullptr;
+        }
+
+        File *file = new File;
+        file->fd = fd;
+        file->size = (uintmax_t) st.st_size;
+        file->lastModified = st.st_mtime;
+        file->cache = this;
+        file->device = st.st_dev;
+        file->inode = st.st_ino;
+        file->checked = now;
+        file->refs = 1;
+        file->entry = files.emplace(std::move(pathString), file).first;
+        pushFront(file);
+
+        trim();
+        return file;
+    }
+
+    void release(File *file) {
+        if (!--file->refs) {
+            if (file->stale) {
+                close(file->fd);
+                delete file;
+            } else {
+                trim();
+            }
+        }
+    }
+};
+
+}
+
+#endif
+
+#endif // UWS_FILECACHE_H
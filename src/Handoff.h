@@ -0,0 +1,353 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HANDOFF_H
+#define UWS_HANDOFF_H
+
+/* Restarts without dropping anyone. The process being replaced (TemplatedApp::handOff) gives the one replacing it
+ * (TemplatedApp::takeOver) its listen sockets over a Unix socket with SCM_RIGHTS and stops accepting. It then drains:
+ * responses in flight finish with Connection: close, and plain TCP WebSockets follow their listen sockets over as they
+ * next have data, with their state, topics, backpressure and user data. Both must be builds of the same app.
+ *
+ * A message is a type byte and a 4 byte length, then the payload, with at most one descriptor along with it */
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <netinet/in.h>
+
+#include "MoveOnlyFunction.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+namespace uWS {
+
+struct Handoff {
+    enum Type : unsigned char {
+        LISTEN_SOCKET,
+        /* Every listen socket was sent, WebSockets follow */
+        LISTENING,
+        WEBSOCKET
+    };
+
+    /* Builds a payload of LEB128 varints and length prefixed bytes */
+    struct Writer {
+        std::string out;
+
+        void number(uint64_t value) {
+            while (value >= 0x80) {
+                out.push_back((char) (value | 0x80));
+                value >>= 7;
+            }
+            out.push_back((char) value);
+        }
+
+        void bytes(std::string_view data) {
+            number(data.length());
+            out.append(data);
+        }
+    };
+
+    /* Reads what a Writer wrote, ok turns false if it runs out */
+    struct Reader {
+        std::string_view in;
+        bool ok = true;
+
+        uint64_t number() {
+            uint64_t value = 0;
+            for (unsigned int shift = 0; shift < 64 && in.length(); shift += 7) {
+                unsigned char byte = (unsigned char) in[0];
+                in.remove_prefix(1);
+                value |= (uint64_t) (byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return value;
+                }
+            }
+            ok = false;
+            return 0;
+        }
+
+        std::string_view bytes() {
+            uint64_t length = number();
+            if (!ok || length > in.length()) {
+                ok = false;
+                return {};
+            }
+            std::string_view data = in.substr(0, length);
+            in.remove_prefix(length);
+            return data;
+        }
+    };
+
+    /* Sends a message, along with fd unless -1. Blocks until all of it is sent */
+    static bool send(int channel, Type type, std::string_view payload = {}, int fd = -1) {
+        char header[5] = {(char) type};
+        uint32_t length = (uint32_t) payload.length();
+        memcpy(header + 1, &length, 4);
+
+        iovec iov[2] = {{header, 5}, {(void *) payload.data(), payload.length()}};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        if (fd != -1) {
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+
+        /* The descriptor goes with the first byte */
+        size_t total = 5 + payload.length(), sent = 0;
+        while (sent < total) {
+            ssize_t result = sendmsg(channel, &msg, MSG_NOSIGNAL);
+            if (result == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            sent += (size_t) result;
+            msg.msg_control = nullptr;
+            msg.msg_controllen = 0;
+            for (size_t skip = (size_t) result; skip; ) {
+                size_t step = std::min(skip, msg.msg_iov->iov_len);
+                msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + step;
+                msg.msg_iov->iov_len -= step;
+                skip -= step;
+                if (!msg.msg_iov->iov_len && msg.msg_iovlen > 1) {
+                    msg.msg_iov++;
+                    msg.msg_iovlen--;
+                }
+            }
+        }
+        return true;
+    }
+
+    /* Receives a message, with fd -1 unless one came along. Blocks until it has one, false once the channel closed */
+    static bool receive(int channel, Type &type, std::string &payload, int &fd) {
+        char header[5];
+        iovec iov = {header, 5};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        fd = -1;
+        ssize_t result;
+        while ((result = recvmsg(channel, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+        if (cmsghdr *cmsg = result > 0 ? CMSG_FIRSTHDR(&msg) : nullptr; cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+        if (result != 5) {
+            if (fd != -1) {
+                close(fd);
+            }
+            return false;
+        }
+
+        type = (Type) header[0];
+        uint32_t length;
+        memcpy(&length, header + 1, 4);
+        payload.resize(length);
+        for (size_t received = 0; received < length; ) {
+            ssize_t got = recv(channel, payload.data() + received, length - received, 0);
+            if (got <= 0 && !(got == -1 && errno == EINTR)) {
+                if (fd != -1) {
+                    close(fd);
+                }
+                return false;
+            }
+            received += got > 0 ? (size_t) got : 0;
+        }
+        return true;
+    }
+
+    /* A connected, blocking Unix socket to path, or -1 */
+    static int connect(const char *path) {
+        sockaddr_un address = {};
+        if (strlen(path) >= sizeof(address.sun_path)) {
+            return -1;
+        }
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 && ::connect(fd, (sockaddr *) &address, sizeof(address))) {
+            close(fd);
+            return -1;
+        }
+        if (fd != -1) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        return fd;
+    }
+
+    /* Handing off: what TemplatedApp::handOff hands over once a process connects to listener at path */
+    struct Waiting {
+        int listener;
+        std::string path;
+        std::vector<struct us_listen_socket_t *> listenSockets;
+        MoveOnlyFunction<void()> handedOff;
+
+        ~Waiting() {
+            close(listener);
+            unlink(path.c_str());
+        }
+    };
+
+    /* A non-blocking Unix socket listening at path, replacing whatever was there, or -1 */
+    static int listen(const char *path) {
+        sockaddr_un address = {};
+        if (strlen(path) >= sizeof(address.sun_path)) {
+            return -1;
+        }
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+        unlink(path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 && (bind(fd, (sockaddr *) &address, sizeof(address)) || ::listen(fd, 1))) {
+            close(fd);
+            return -1;
+        }
+        if (fd != -1) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+        return fd;
+    }
+
+    /* The blocking channel of whoever connected to listener, or -1 */
+    static int accept(int listener) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd != -1) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        }
+        return fd;
+    }
+
+private:
+    /* Taking over: the channel, the listen sockets we were given and the pipe that stops our thread */
+    int channel;
+    std::vector<int> listenSockets;
+    int wake[2] = {-1, -1};
+    std::thread thread;
+
+public:
+    /* Takes over listen sockets and WebSockets on channel (past LISTENING) on a thread of its own. Sockets accepted
+     * go to accepted with the raw address of the peer, WebSockets to webSocket with their payload. Both are called on
+     * that thread. Runs until we are destroyed, WebSockets stop coming once the process handing off is gone */
+    Handoff(int channel, std::vector<int> listenSockets, MoveOnlyFunction<void(int, char *, int)> &&accepted,
+        MoveOnlyFunction<void(int, std::string &&)> &&webSocket) : channel(channel), listenSockets(std::move(listenSockets)) {
+        if (pipe(wake)) {
+            wake[0] = wake[1] = -1;
+            return;
+        }
+        thread = std::thread([this, accepted = std::move(accepted), webSocket = std::move(webSocket)]() mutable {
+            std::vector<pollfd> fds = {{wake[0], POLLIN, 0}, {this->channel, POLLIN, 0}};
+            for (int listenSocket : this->listenSockets) {
+                fds.push_back({listenSocket, POLLIN, 0});
+            }
+            while (poll(fds.data(), fds.size(), -1) >= 0 || errno == EINTR) {
+                if (fds[0].revents) {
+                    return;
+                }
+                if (fds[1].revents) {
+                    Type type;
+                    std::string payload;
+                    int fd;
+                    if (!receive(this->channel, type, payload, fd)) {
+                        /* Done handing off, we keep accepting */
+                        fds[1].fd = -1;
+                    } else if (type == WEBSOCKET && fd != -1) {
+                        webSocket(fd, std::move(payload));
+                    } else if (fd != -1) {
+                        close(fd);
+                    }
+                }
+                /* Listen sockets are non-blocking, shared with whoever had them */
+                for (size_t i = 2; i < fds.size(); i++) {
+                    if (!fds[i].revents) {
+                        continue;
+                    }
+                    for (;;) {
+                        sockaddr_storage address;
+                        socklen_t addressLength = sizeof(address);
+                        int fd = ::accept(fds[i].fd, (sockaddr *) &address, &addressLength);
+                        if (fd == -1) {
+                            break;
+                        }
+                        fcntl(fd, F_SETFD, FD_CLOEXEC);
+                        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                        if (address.ss_family == AF_INET6) {
+                            accepted(fd, (char *) &((sockaddr_in6 *) &address)->sin6_addr, 16);
+                        } else if (address.ss_family == AF_INET) {
+                            accepted(fd, (char *) &((sockaddr_in *) &address)->sin_addr, 4);
+                        } else {
+                            accepted(fd, nullptr, 0);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    Handoff(const Handoff &) = delete;
+
+    ~Handoff() {
+        if (thread.joinable()) {
+            char stop = 0;
+            (void) !write(wake[1], &stop, 1);
+            thread.join();
+        }
+        for (int fd : listenSockets) {
+            close(fd);
+        }
+        close(channel);
+        close(wake[0]);
+        close(wake[1]);
+    }
+};
+
+}
+
+#endif
+
+#endif // UWS_HANDOFF_H
@@ -0,0 +1,488 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HPACK_H
+#define UWS_HPACK_H
+
+/* HPACK (RFC 7541), the header compression of HTTP/2. The decoder keeps its dynamic table in a fixed ring of its own
+ * and decodes into a scratch string the caller reuses, so nothing is allocated once that has grown. The encoder never
+ * indexes anything, so it needs no state at all: statuses the static table has are one byte, names it has are their
+ * index and everything else is a literal, Huffman coded when that is shorter */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace uWS {
+
+namespace hpack {
+
+static constexpr std::string_view staticTable[][2] = {
+    {"", ""}, {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+    {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+    {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+    {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""}, {"date", ""}, {"etag", ""},
+    {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""},
+    {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""},
+    {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""},
+    {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""}, {"set-cookie", ""},
+    {"strict-transport-security", ""}, {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+    {"www-authenticate", ""}
+};
+static constexpr uint32_t STATIC_TABLE_LENGTH = sizeof(staticTable) / sizeof(staticTable[0]) - 1;
+
+/* Lengths of the canonical Huffman code of every byte and EOS (256), the codes follow from them */
+static constexpr unsigned char huffmanLengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5, 6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23, 24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23, 21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25, 19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23, 26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30
+};
+static constexpr unsigned int HUFFMAN_EOS = 256;
+static constexpr unsigned int HUFFMAN_MAX_LENGTH = 30;
+
+/* Codes of the same length are consecutive, so a code of length l is the symbol at firstSymbol[l] + code - firstCode[l] */
+struct HuffmanTables {
+    uint32_t codes[257];
+    uint32_t firstCode[HUFFMAN_MAX_LENGTH + 1];
+    uint16_t firstSymbol[HUFFMAN_MAX_LENGTH + 1];
+    uint16_t count[HUFFMAN_MAX_LENGTH + 1];
+    uint16_t symbols[257];
+};
+
+constexpr HuffmanTables makeHuffmanTables() {
+    HuffmanTables tables = {};
+    uint32_t code = 0;
+    uint16_t numSymbols = 0;
+    for (unsigned int length = 1; length <= HUFFMAN_MAX_LENGTH; length++) {
+        tables.firstCode[length] = code;
+        tables.firstSymbol[length] = numSymbols;
+        for (unsigned int symbol = 0; symbol < 257; symbol++) {
+            if (huffmanLengths[symbol] == length) {
+                tables.codes[symbol] = code++;
+                tables.symbols[numSymbols++] = (uint16_t) symbol;
+                tables.count[length]++;
+            }
+        }
+        code <<= 1;
+    }
+    return tables;
+}
+
+static constexpr HuffmanTables huffman = makeHuffmanTables();
+
+/* Appends what in decodes to, false if broken (EOS, or padding longer than 7 bits or not all ones) */
+inline bool huffmanDecode(std::string_view in, std::string &out) {
+    /* Bits not yet decoded, from the top */
+    uint64_t bits = 0;
+    unsigned int numBits = 0;
+    size_t i = 0;
+
+    for (;;) {
+        while (numBits <= 56 && i < in.length()) {
+            bits |= (uint64_t) (unsigned char) in[i++] << (56 - numBits);
+            numBits += 8;
+        }
+
+        /* The shortest codes are 5 bits */
+        unsigned int length = 5;
+        if (length > numBits) {
+            break;
+        }
+        uint32_t code = (uint32_t) (bits >> (64 - length));
+        while (code - huffman.firstCode[length] >= huffman.count[length]) {
+            if (++length > numBits) {
+                break;
+            }
+            code = (uint32_t) (bits >> (64 - length));
+        }
+        if (length > numBits) {
+            break;
+        }
+
+        unsigned int symbol = huffman.symbols[huffman.firstSymbol[length] + code - huffman.firstCode[length]];
+        if (symbol == HUFFMAN_EOS) {
+            return false;
+        }
+        out.push_back((char) symbol);
+        bits <<= length;
+        numBits -= length;
+    }
+
+    /* What is left is padding, the beginning of EOS */
+    return numBits < 8 && (numBits == 0 || (bits >> (64 - numBits)) == (1ull << numBits) - 1);
+}
+
+inline size_t huffmanLength(std::string_view in) {
+    size_t bits = 0;
+    for (char c : in) {
+        bits += huffmanLengths[(unsigned char) c];
+    }
+    return (bits + 7) / 8;
+}
+
+inline void huffmanEncode(std::string_view in, std::string &out) {
+    uint64_t bits = 0;
+    unsigned int numBits = 0;
+    for (char c : in) {
+        unsigned int length = huffmanLengths[(unsigned char) c];
+        bits = (bits << length) | huffman.codes[(unsigned char) c];
+        numBits += length;
+        while (numBits >= 8) {
+            numBits -= 8;
+            out.push_back((char) (bits >> numBits));
+        }
+        bits &= (1ull << numBits) - 1;
+    }
+    if (numBits) {
+        out.push_back((char) ((bits << (8 - numBits)) | ((1u << (8 - numBits)) - 1)));
+    }
+}
+
+/* The value of a prefixed integer starting at pos, false if it runs past the end or is unreasonably big */
+inline bool decodeInteger(std::string_view in, size_t &pos, unsigned int prefixBits, uint32_t &value) {
+    if (pos >= in.length()) {
+        return false;
+    }
+    uint32_t max = (1u << prefixBits) - 1;
+    value = (unsigned char) in[pos++] & max;
+    if (value < max) {
+        return true;
+    }
+    for (unsigned int shift = 0; shift <= 21; shift += 7) {
+        if (pos >= in.length()) {
+            return false;
+        }
+        unsigned char byte = (unsigned char) in[pos++];
+        value += (uint32_t) (byte & 127) << shift;
+        if (!(byte & 128)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* flags fill the bits of the first byte above the prefix */
+inline void encodeInteger(std::string &out, unsigned char flags, unsigned int prefixBits, size_t value) {
+    size_t max = (1u << prefixBits) - 1;
+    if (value < max) {
+        out.push_back((char) (flags | value));
+        return;
+    }
+    out.push_back((char) (flags | max));
+    for (value -= max; value >= 128; value >>= 7) {
+        out.push_back((char) (128 | (value & 127)));
+    }
+    out.push_back((char) value);
+}
+
+inline void encodeString(std::string &out, std::string_view string) {
+    size_t length = huffmanLength(string);
+    if (length < string.length()) {
+        encodeInteger(out, 0x80, 7, length);
+        huffmanEncode(string, out);
+    } else {
+        encodeInteger(out, 0, 7, string.length());
+        out.append(string);
+    }
+}
+
+/* The names of the static table by a perfect hash, like KnownHeaders, for the index of names we encode */
+static constexpr unsigned int NAME_HASH_BITS = 8;
+
+constexpr uint32_t nameFeatures(std::string_view name) {
+    return (uint32_t) (unsigned char) name[0] | (uint32_t) (unsigned char) name[name.length() - 1] << 8
+        | (uint32_t) (unsigned char) name[name.length() >> 1] << 16 | (uint32_t) name.length() << 24;
+}
+
+constexpr unsigned int nameHash(std::string_view name, uint32_t multiplier) {
+    return (nameFeatures(name) * multiplier) >> (32 - NAME_HASH_BITS);
+}
+
+/* The first odd multiplier giving every name (the first entry of those sharing one) a hash of its own */
+constexpr uint32_t findNameMultiplier() {
+    for (uint32_t multiplier = 0x9e3779b1; ; multiplier += 2) {
+        bool taken[1 << NAME_HASH_BITS] = {};
+        uint32_t i = 1;
+        for (; i <= STATIC_TABLE_LENGTH; i++) {
+            if (staticTable[i][0] == staticTable[i - 1][0]) {
+                continue;
+            }
+            if (taken[nameHash(staticTable[i][0], multiplier)]) {
+                break;
+            }
+            taken[nameHash(staticTable[i][0], multiplier)] = true;
+        }
+        if (i > STATIC_TABLE_LENGTH) {
+            return multiplier;
+        }
+    }
+}
+
+static constexpr uint32_t NAME_MULTIPLIER = findNameMultiplier();
+
+struct NameSlots {
+    unsigned char index[1 << NAME_HASH_BITS];
+};
+
+constexpr NameSlots makeNameSlots() {
+    NameSlots slots = {};
+    for (uint32_t i = STATIC_TABLE_LENGTH; i >= 1; i--) {
+        slots.index[nameHash(staticTable[i][0], NAME_MULTIPLIER)] = (unsigned char) i;
+    }
+    return slots;
+}
+
+static constexpr NameSlots nameSlots = makeNameSlots();
+
+/* Index of the first static entry named name (lower case), 0 if none */
+inline uint32_t findStaticName(std::string_view name) {
+    if (name.empty()) {
+        return 0;
+    }
+    uint32_t index = nameSlots.index[nameHash(name, NAME_MULTIPLIER)];
+    return (index && staticTable[index][0] == name) ? index : 0;
+}
+
+/* The encoder. Header names of HTTP/2 are lower case, so name has to be */
+inline void encodeHeader(std::string &out, std::string_view name, std::string_view value) {
+    /* Literal without indexing, by the static name if there is one */
+    uint32_t index = findStaticName(name);
+    encodeInteger(out, 0, 4, index);
+    if (!index) {
+        encodeString(out, name);
+    }
+    encodeString(out, value);
+}
+
+/* status is the three digits */
+inline void encodeStatus(std::string &out, std::string_view status) {
+    for (uint32_t index = 8; index <= 14; index++) {
+        if (staticTable[index][1] == status) {
+            out.push_back((char) (0x80 | index));
+            return;
+        }
+    }
+    encodeHeader(out, ":status", status);
+}
+
+}
+
+/* Header blocks of one connection, in order. Names and values given to the callback are valid during the call only */
+struct HpackDecoder {
+    /* What SETTINGS_HEADER_TABLE_SIZE is by default, and all we allow */
+    static constexpr uint32_t TABLE_SIZE = 4096;
+
+private:
+    /* Every entry counts 32 bytes over its name and value, so this many at most */
+    static constexpr uint32_t MAX_ENTRIES = TABLE_SIZE / 32;
+
+    /* Names and values of the entries back to back, wrapping around. They are always less than TABLE_SIZE */
+    char ring[TABLE_SIZE];
+    struct Entry {
+        uint32_t offset;
+        uint32_t nameLength;
+        uint32_t valueLength;
+    } entries[MAX_ENTRIES];
+    /* The oldest entry, and where the next bytes go */
+    uint32_t firstEntry = 0;
+    uint32_t numEntries = 0;
+    uint32_t writeOffset = 0;
+    /* By the accounting of HPACK, and what the encoder limited it to */
+    uint32_t size = 0;
+    uint32_t maxSize = TABLE_SIZE;
+
+    /* Part of a header being decoded. Either it points to something staying put during the callback, or it is
+     * length bytes at offset of the scratch (which may still move while decoding) */
+    struct Piece {
+        const char *data;
+        uint32_t offset;
+        uint32_t length;
+
+        std::string_view view(std::string &scratch) {
+            return data ? std::string_view(data, length) : std::string_view(scratch.data() + offset, length);
+        }
+    };
+
+    void evict() {
+        Entry &entry = entries[firstEntry];
+        size -= entry.nameLength + entry.valueLength + 32;
+        firstEntry = (firstEntry + 1) % MAX_ENTRIES;
+        numEntries--;
+    }
+
+    void copyIn(const char *data, uint32_t length) {
+        uint32_t first = std::min<uint32_t>(length, TABLE_SIZE - writeOffset);
+        memcpy(ring + writeOffset, data, first);
+        memcpy(ring, data + first, length - first);
+        writeOffset = (writeOffset + length) % TABLE_SIZE;
+    }
+
+    /* Bytes of the ring, copied to the scratch if they wrap around */
+    Piece ringPiece(uint32_t offset, uint32_t length, std::string &scratch) {
+        offset %= TABLE_SIZE;
+        if (offset + length <= TABLE_SIZE) {
+            return {ring + offset, 0, length};
+        }
+        Piece piece = {nullptr, (uint32_t) scratch.length(), length};
+        scratch.append(ring + offset, TABLE_SIZE - offset);
+        scratch.append(ring, length - (TABLE_SIZE - offset));
+        return piece;
+    }
+
+    bool lookup(uint32_t index, Piece &name, Piece *value, std::string &scratch) {
+        if (!index) {
+            return false;
+        }
+        if (index <= hpack::STATIC_TABLE_LENGTH) {
+            name = {hpack::staticTable[index][0].data(), 0, (uint32_t) hpack::staticTable[index][0].length()};
+            if (value) {
+                *value = {hpack::staticTable[index][1].data(), 0, (uint32_t) hpack::staticTable[index][1].length()};
+            }
+            return true;
+        }
+        index -= hpack::STATIC_TABLE_LENGTH + 1;
+        if (index >= numEntries) {
+            return false;
+        }
+        /* Index 0 of the dynamic table is the newest */
+        Entry &entry = entries[(firstEntry + numEntries - 1 - index) % MAX_ENTRIES];
+        name = ringPiece(entry.offset, entry.nameLength, scratch);
+        if (value) {
+            *value = ringPiece(entry.offset + entry.nameLength, entry.valueLength, scratch);
+        }
+        return true;
+    }
+
+    static bool readString(std::string_view block, size_t &pos, Piece &piece, std::string &scratch) {
+        if (pos >= block.length()) {
+            return false;
+        }
+        bool huffmanCoded = block[pos] & 0x80;
+        uint32_t length;
+        if (!hpack::decodeInteger(block, pos, 7, length) || length > block.length() - pos) {
+            return false;
+        }
+        if (huffmanCoded) {
+            piece = {nullptr, (uint32_t) scratch.length(), 0};
+            if (!hpack::huffmanDecode(block.substr(pos, length), scratch)) {
+                return false;
+            }
+            piece.length = (uint32_t) (scratch.length() - piece.offset);
+        } else {
+            piece = {block.data() + pos, 0, length};
+        }
+        pos += length;
+        return true;
+    }
+
+    void insert(std::string_view name, std::string_view value) {
+        uint32_t entrySize = (uint32_t) (name.length() + value.length() + 32);
+        while (numEntries && size + entrySize > maxSize) {
+            evict();
+        }
+        /* Too big for the table, which it emptied */
+        if (entrySize > maxSize) {
+            return;
+        }
+        entries[(firstEntry + numEntries) % MAX_ENTRIES] = {writeOffset, (uint32_t) name.length(), (uint32_t) value.length()};
+        numEntries++;
+        size += entrySize;
+        copyIn(name.data(), (uint32_t) name.length());
+        copyIn(value.data(), (uint32_t) value.length());
+    }
+
+    bool inRing(const char *data) {
+        return data >= ring && data < ring + TABLE_SIZE;
+    }
+
+public:
+    HpackDecoder() = default;
+    HpackDecoder(const HpackDecoder &) = delete;
+
+    /* Calls cb(name, value) for every header of block, which stops by returning false. Returns false if the block
+     * is broken (a COMPRESSION_ERROR) or cb stopped, by then the table may be out of step with the encoder */
+    template <typename F>
+    bool decode(std::string_view block, std::string &scratch, F cb) {
+        for (size_t pos = 0, numHeaders = 0; pos < block.length(); ) {
+            scratch.clear();
+            unsigned char first = (unsigned char) block[pos];
+            Piece name, value;
+
+            if (first & 0x80) {
+                /* Indexed */
+                uint32_t index;
+                if (!hpack::decodeInteger(block, pos, 7, index) || !lookup(index, name, &value, scratch)) {
+                    return false;
+                }
+            } else if ((first & 0xe0) == 0x20) {
+                /* Dynamic table size update, only before the headers */
+                uint32_t newSize;
+                if (numHeaders || !hpack::decodeInteger(block, pos, 5, newSize) || newSize > TABLE_SIZE) {
+                    return false;
+                }
+                maxSize = newSize;
+                while (size > maxSize) {
+                    evict();
+                }
+                continue;
+            } else {
+                /* Literal with incremental indexing (01), without indexing (0000) or never indexed (0001) */
+                bool indexing = first & 0x40;
+                uint32_t index;
+                if (!hpack::decodeInteger(block, pos, indexing ? 6 : 4, index)) {
+                    return false;
+                }
+                if (index ? !lookup(index, name, nullptr, scratch) : !readString(block, pos, name, scratch)) {
+                    return false;
+                }
+                if (!readString(block, pos, value, scratch)) {
+                    return false;
+                }
+                if (indexing) {
+                    /* A name of the table could be evicted by its own insertion */
+                    if (name.data && inRing(name.data)) {
+                        std::string_view inTable = name.view(scratch);
+                        name = {nullptr, (uint32_t) scratch.length(), name.length};
+                        scratch.append(inTable);
+                    }
+                    insert(name.view(scratch), value.view(scratch));
+                }
+            }
+
+            numHeaders++;
+            if (!cb(name.view(scratch), value.view(scratch))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+}
+
+#endif // UWS_HPACK_H
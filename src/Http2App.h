@@ -0,0 +1,160 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2APP_H
+#define UWS_HTTP2APP_H
+
+#include "App.h"
+
+#include "Http2Response.h"
+#include "Http2Request.h"
+#include "Http2Context.h"
+
+namespace uWS {
+
+    /* HTTP/2 with prior knowledge over cleartext TCP (h2c). Put it behind a TLS terminator negotiating h2 */
+    struct H2App {
+        Http2Context *http2Context;
+
+        H2App(SocketContextOptions options = {}) {
+            /* Plaintext only, options are what the socket context takes */
+            http2Context = Http2Context::create(Loop::get(), options);
+        }
+
+        ~H2App() {
+            if (http2Context) {
+                http2Context->free();
+            }
+        }
+
+        /* Disallow copying, only move */
+        H2App(const H2App &other) = delete;
+
+        H2App(H2App &&other) {
+            /* Move Http2Context */
+            http2Context = other.http2Context;
+            other.http2Context = nullptr;
+        }
+
+        /* Host, port, callback */
+        H2App &&listen(std::string host, int port, MoveOnlyFunction<void(us_listen_socket_t *)> &&handler) {
+            if (!host.length()) {
+                return listen(port, std::move(handler));
+            }
+            handler(http2Context ? http2Context->listen(host.c_str(), port, 0) : nullptr);
+            return std::move(*this);
+        }
+
+        /* Host, port, options, callback */
+        H2App &&listen(std::string host, int port, int options, MoveOnlyFunction<void(us_listen_socket_t *)> &&handler) {
+            if (!host.length()) {
+                return listen(port, options, std::move(handler));
+            }
+            handler(http2Context ? http2Context->listen(host.c_str(), port, options) : nullptr);
+            return std::move(*this);
+        }
+
+        /* Port, callback */
+        H2App &&listen(int port, MoveOnlyFunction<void(us_listen_socket_t *)> &&handler) {
+            handler(http2Context ? http2Context->listen(nullptr, port, 0) : nullptr);
+            return std::move(*this);
+        }
+
+        /* Port, options, callback */
+        H2App &&listen(int port, int options, MoveOnlyFunction<void(us_listen_socket_t *)> &&handler) {
+            handler(http2Context ? http2Context->listen(nullptr, port, options) : nullptr);
+            return std::move(*this);
+        }
+
+        H2App &&get(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("GET", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&post(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("POST", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&options(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("OPTIONS", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&del(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("DELETE", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&patch(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("PATCH", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&put(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("PUT", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&head(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("HEAD", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&connect(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("CONNECT", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        H2App &&trace(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("TRACE", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        /* This one catches any method */
+        H2App &&any(std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+            if (http2Context) {
+                http2Context->onHttp("*", pattern, std::move(handler));
+            }
+            return std::move(*this);
+        }
+
+        void run() {
+            uWS::Loop::get()->run();
+        }
+    };
+}
+
+#endif // UWS_HTTP2APP_H
@@ -0,0 +1,570 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2CONTEXT_H
+#define UWS_HTTP2CONTEXT_H
+
+/* HTTP/2 over cleartext TCP with prior knowledge (h2c), for use behind whatever terminates TLS and negotiates h2.
+ * Every connection is a socket of this context, and its streams are Http2Responses routed just like HttpContext does */
+
+#include "Loop.h"
+#include "Http2ContextData.h"
+#include "Http2Request.h"
+#include "Http2Response.h"
+#include "HttpParser.h"
+
+#include <chrono>
+#include <iostream>
+
+namespace uWS {
+
+struct Http2Context {
+private:
+    static constexpr unsigned int MAX_CONCURRENT_STREAMS = 100;
+    /* Header blocks longer than this (before decoding) end the connection */
+    static constexpr size_t MAX_HEADER_BLOCK_LENGTH = 64 * 1024;
+    /* More RST_STREAM than this within RESET_WINDOW_MS is a rapid reset attack (CVE-2023-44487), answered with
+     * GOAWAY(ENHANCE_YOUR_CALM). Every reset stream was routed at our expense while never counting as concurrent */
+    static constexpr unsigned int MAX_RESETS_PER_WINDOW = 2 * MAX_CONCURRENT_STREAMS;
+    static constexpr uint64_t RESET_WINDOW_MS = 1000;
+
+    us_socket_context_t *getSocketContext() {
+        return (us_socket_context_t *) this;
+    }
+
+    Http2ContextData *getContextData() {
+        return (Http2ContextData *) us_socket_context_ext(0, getSocketContext());
+    }
+
+    static Http2ResponseData *findStream(Http2ConnectionData *connectionData, uint32_t streamId) {
+        for (Http2ResponseData *stream : connectionData->streams) {
+            if (stream->streamId == streamId) {
+                return stream;
+            }
+        }
+        return nullptr;
+    }
+
+    /* Takes padding off DATA and HEADERS, false if there is more of it than payload */
+    static bool removePadding(unsigned char flags, std::string_view &payload) {
+        if (!(flags & http2::FLAG_PADDED)) {
+            return true;
+        }
+        if (!payload.length() || (size_t) (unsigned char) payload[0] >= payload.length()) {
+            return false;
+        }
+        size_t padLength = (unsigned char) payload[0];
+        payload = payload.substr(1, payload.length() - 1 - padLength);
+        return true;
+    }
+
+    /* Drains every stream flow control held back and tells those waiting that they can write again.
+     * Streams may complete or abort meanwhile, taking themselves out of the list */
+    static void drainStreams(us_socket_t *s) {
+        Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+        for (size_t i = 0; i < connectionData->streams.size(); ) {
+            Http2ResponseData *stream = connectionData->streams[i];
+            Http2Response::drain(stream);
+            if (!Http2Response::complete(stream) && !stream->backpressure.length() && !stream->ended
+                && stream->onWritable && !connectionData->awaitingWritable) {
+                stream->onWritable(stream->offset);
+            }
+            if (i < connectionData->streams.size() && connectionData->streams[i] == stream) {
+                i++;
+            }
+        }
+    }
+
+    /* A complete header block, which opens a stream or holds the trailers of one */
+    static http2::ErrorCode handleHeaders(us_socket_t *s, uint32_t streamId, std::string_view block, bool endStream) {
+        Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+        Http2ContextData *contextData = Http2Response::getContextData(s);
+        Http2Request *req = &contextData->request;
+
+        /* Every block is decoded, since all of them change the HPACK state we share with the client */
+        req->clear();
+        bool tooManyHeaders = false;
+        if (!connectionData->decoder.decode(block, contextData->headerScratch, [req, &tooManyHeaders](std::string_view name, std::string_view value) {
+            if (req->headers.size() < UWS_HTTP_MAX_HEADERS_COUNT) {
+                req->addHeader(name, value);
+            } else {
+                tooManyHeaders = true;
+            }
+            return true;
+        })) {
+            return http2::COMPRESSION_ERROR;
+        }
+
+        /* Trailers, which end the request */
+        if (Http2ResponseData *stream = findStream(connectionData, streamId)) {
+            if (stream->requestEnded || !endStream) {
+                Http2Response::abort(stream, http2::PROTOCOL_ERROR);
+                return http2::NO_ERROR;
+            }
+            stream->requestEnded = true;
+            if (stream->onData) {
+                stream->onData({}, true);
+            }
+            return http2::NO_ERROR;
+        }
+
+        /* Clients open streams in order, with odd ids */
+        if (streamId <= connectionData->lastStreamId || !(streamId & 1)) {
+            return http2::PROTOCOL_ERROR;
+        }
+        connectionData->lastStreamId = streamId;
+
+        if (connectionData->goingAway || connectionData->streams.size() >= MAX_CONCURRENT_STREAMS) {
+            Http2Response::writeRstStream(s, streamId, http2::REFUSED_STREAM);
+            return http2::NO_ERROR;
+        }
+
+        req->resolvePseudoHeaders();
+        if (tooManyHeaders || !req->method.length() || (!req->path.length() && req->method != "CONNECT")) {
+            Http2Response::writeRstStream(s, streamId, http2::PROTOCOL_ERROR);
+            return http2::NO_ERROR;
+        }
+
+        Http2ResponseData *stream = contextData->acquireStream();
+        stream->socket = s;
+        stream->streamId = streamId;
+        stream->sendWindow = connectionData->initialWindowSize;
+        stream->requestEnded = endStream;
+        connectionData->streams.push_back(stream);
+
+        /* Same routing as HttpContext, by case sensitive method and the url without query */
+        contextData->router.getUserData() = {(Http2Response *) stream, req};
+        if (!contextData->router.route(req->getCaseSensitiveMethod(), req->getUrl())) {
+            /* Like HTTP/1.1 we close what has no handler, here only the stream of it */
+            if (stream->streamId == streamId) {
+                Http2Response::abort(stream, http2::REFUSED_STREAM);
+            }
+            return http2::NO_ERROR;
+        }
+
+        /* Completed within the handler */
+        if (stream->streamId != streamId) {
+            return http2::NO_ERROR;
+        }
+
+        /* Returning from a request handler without responding or attaching an onAborted handler is ill-use */
+        if (!stream->ended && !stream->onAborted) {
+            std::cerr << "Error: Returning from a request handler without responding or attaching an abort handler is forbidden!" << std::endl;
+            std::terminate();
+        }
+
+        /* We always get an empty chunk even if there is no data, like for HTTP/1.1 */
+        if (stream->requestEnded && stream->onData) {
+            stream->onData({}, true);
+        }
+
+        return http2::NO_ERROR;
+    }
+
+    static http2::ErrorCode handleSettings(us_socket_t *s, unsigned char flags, std::string_view payload) {
+        Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+
+        if (flags & http2::FLAG_ACK) {
+            return payload.length() ? http2::FRAME_SIZE_ERROR : http2::NO_ERROR;
+        }
+        if (payload.length() % 6) {
+            return http2::FRAME_SIZE_ERROR;
+        }
+
+        bool windowGrew = false;
+        for (; payload.length(); payload.remove_prefix(6)) {
+            uint16_t id = (uint16_t) ((unsigned char) payload[0] << 8 | (unsigned char) payload[1]);
+            uint32_t value = http2::readUint32(payload.data() + 2);
+
+            switch (id) {
+            case http2::SETTINGS_ENABLE_PUSH:
+                if (value > 1) {
+                    return http2::PROTOCOL_ERROR;
+                }
+                break;
+            case http2::SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > (uint32_t) http2::MAX_WINDOW_SIZE) {
+                    return http2::FLOW_CONTROL_ERROR;
+                }
+                /* Applies to the windows of open streams as well */
+                int64_t delta = (int64_t) value - connectionData->initialWindowSize;
+                for (Http2ResponseData *stream : connectionData->streams) {
+                    if (stream->sendWindow + delta > http2::MAX_WINDOW_SIZE) {
+                        return http2::FLOW_CONTROL_ERROR;
+                    }
+                    stream->sendWindow = (int32_t) (stream->sendWindow + delta);
+                }
+                connectionData->initialWindowSize = (int32_t) value;
+                windowGrew |= delta > 0;
+                break;
+            }
+            case http2::SETTINGS_MAX_FRAME_SIZE:
+                if (value < http2::DEFAULT_MAX_FRAME_SIZE || value > http2::MAX_MAX_FRAME_SIZE) {
+                    return http2::PROTOCOL_ERROR;
+                }
+                connectionData->maxFrameSize = value;
+                break;
+            default:
+                /* We never index what we send, so the table size of the client is never ours to care about */
+                break;
+            }
+        }
+
+        Http2Response::writeFrame(s, http2::SETTINGS, http2::FLAG_ACK, 0, {});
+        if (windowGrew) {
+            drainStreams(s);
+        }
+        return http2::NO_ERROR;
+    }
+
+    static http2::ErrorCode handleWindowUpdate(us_socket_t *s, uint32_t streamId, std::string_view payload) {
+        Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+
+        if (payload.length() != 4) {
+            return http2::FRAME_SIZE_ERROR;
+        }
+        uint32_t increment = http2::readUint32(payload.data()) & 0x7fffffff;
+
+        if (!streamId) {
+            if (!increment) {
+                return http2::PROTOCOL_ERROR;
+            }
+            if (connectionData->sendWindow > http2::MAX_WINDOW_SIZE - (int32_t) increment) {
+                return http2::FLOW_CONTROL_ERROR;
+            }
+            connectionData->sendWindow += (int32_t) increment;
+            drainStreams(s);
+            return http2::NO_ERROR;
+        }
+
+        Http2ResponseData *stream = findStream(connectionData, streamId);
+        if (!stream) {
+            return http2::NO_ERROR;
+        }
+        if (!increment || stream->sendWindow > http2::MAX_WINDOW_SIZE - (int32_t) increment) {
+            Http2Response::abort(stream, increment ? http2::FLOW_CONTROL_ERROR : http2::PROTOCOL_ERROR);
+            return http2::NO_ERROR;
+        }
+        stream->sendWindow += (int32_t) increment;
+        Http2Response::drain(stream);
+        if (!Http2Response::complete(stream) && !stream->backpressure.length() && !stream->ended
+            && stream->onWritable && !connectionData->awaitingWritable) {
+            stream->onWritable(stream->offset);
+        }
+        return http2::NO_ERROR;
+    }
+
+    static http2::ErrorCode handleFrame(us_socket_t *s, http2::FrameType type, unsigned char flags, uint32_t streamId, std::string_view payload) {
+        Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+
+        /* Nothing may come between the frames of one header block */
+        if (connectionData->headerBlockStreamId && (type != http2::CONTINUATION || streamId != connectionData->headerBlockStreamId)) {
+            return http2::PROTOCOL_ERROR;
+        }
+
+        switch (type) {
+        case http2::DATA: {
+            if (!streamId) {
+                return http2::PROTOCOL_ERROR;
+            }
+            /* Padding counts for flow control as well */
+            uint32_t length = (uint32_t) payload.length();
+            connectionData->receivedBytes += length;
+            if (!removePadding(flags, payload)) {
+                return http2::PROTOCOL_ERROR;
+            }
+
+            Http2ResponseData *stream = findStream(connectionData, streamId);
+            if (!stream) {
+                /* Streams we are done with may still get some, those never opened may not */
+                return streamId > connectionData->lastStreamId ? http2::PROTOCOL_ERROR : http2::NO_ERROR;
+            }
+            if (stream->requestEnded) {
+                Http2Response::abort(stream, http2::STREAM_CLOSED);
+                return http2::NO_ERROR;
+            }
+
+            bool fin = flags & http2::FLAG_END_STREAM;
+            stream->requestEnded = fin;
+            if (stream->onData) {
+                stream->onData(payload, fin);
+            }
+
+            /* The stream gets its window back right away, the connection once per read */
+            if (!fin && length && stream->streamId == streamId) {
+                Http2Response::writeWindowUpdate(s, streamId, length);
+            }
+            return http2::NO_ERROR;
+        }
+        case http2::HEADERS: {
+            if (!streamId || !removePadding(flags, payload)) {
+                return http2::PROTOCOL_ERROR;
+            }
+            /* We do not prioritize */
+            if (flags & http2::FLAG_PRIORITY) {
+                if (payload.length() < 5) {
+                    return http2::PROTOCOL_ERROR;
+                }
+                payload.remove_prefix(5);
+            }
+            if (!(flags & http2::FLAG_END_HEADERS)) {
+                if (payload.length() > MAX_HEADER_BLOCK_LENGTH) {
+                    return http2::PROTOCOL_ERROR;
+                }
+                connectionData->headerBlock.assign(payload.data(), payload.length());
+                connectionData->headerBlockStreamId = streamId;
+                connectionData->headerBlockEndsStream = flags & http2::FLAG_END_STREAM;
+                return http2::NO_ERROR;
+            }
+            return handleHeaders(s, streamId, payload, flags & http2::FLAG_END_STREAM);
+        }
+        case http2::CONTINUATION: {
+            if (!connectionData->headerBlockStreamId || connectionData->headerBlock.length() + payload.length() > MAX_HEADER_BLOCK_LENGTH) {
+                return http2::PROTOCOL_ERROR;
+            }
+            connectionData->headerBlock.append(payload.data(), payload.length());
+            if (!(flags & http2::FLAG_END_HEADERS)) {
+                return http2::NO_ERROR;
+            }
+            connectionData->headerBlockStreamId = 0;
+            return handleHeaders(s, streamId, connectionData->headerBlock, connectionData->headerBlockEndsStream);
+        }
+        case http2::RST_STREAM: {
+            if (!streamId) {
+                return http2::PROTOCOL_ERROR;
+            }
+            if (payload.length() != 4) {
+                return http2::FRAME_SIZE_ERROR;
+            }
+            uint64_t now = (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            if (now - connectionData->resetWindowBegan >= RESET_WINDOW_MS) {
+                connectionData->resetWindowBegan = now;
+                connectionData->resetsInWindow = 0;
+            }
+            if (++connectionData->resetsInWindow > MAX_RESETS_PER_WINDOW) {
+                return http2::ENHANCE_YOUR_CALM;
+            }
+            if (Http2ResponseData *stream = findStream(connectionData, streamId)) {
+                Http2Response::abort(stream, std::nullopt);
+            }
+            return http2::NO_ERROR;
+        }
+        case http2::SETTINGS:
+            return streamId ? http2::PROTOCOL_ERROR : handleSettings(s, flags, payload);
+        case http2::PING:
+            if (streamId) {
+                return http2::PROTOCOL_ERROR;
+            }
+            if (payload.length() != 8) {
+                return http2::FRAME_SIZE_ERROR;
+            }
+            if (!(flags & http2::FLAG_ACK)) {
+                Http2Response::writeFrame(s, http2::PING, http2::FLAG_ACK, 0, payload);
+            }
+            return http2::NO_ERROR;
+        case http2::GOAWAY:
+            if (streamId) {
+                return http2::PROTOCOL_ERROR;
+            }
+            /* What is open finishes, nothing new is taken */
+            connectionData->goingAway = true;
+            return http2::NO_ERROR;
+        case http2::WINDOW_UPDATE:
+            return handleWindowUpdate(s, streamId, payload);
+        case http2::PUSH_PROMISE:
+            /* Clients never push */
+            return http2::PROTOCOL_ERROR;
+        default:
+            /* PRIORITY, and types we do not know of, are ignored */
+            return http2::NO_ERROR;
+        }
+    }
+
+    /* Tells the client why and closes, nothing more is read */
+    static us_socket_t *goAway(us_socket_t *s, http2::ErrorCode errorCode) {
+        char payload[8];
+        http2::writeUint32(payload, Http2Response::getConnectionData(s)->lastStreamId);
+        http2::writeUint32(payload + 4, errorCode);
+        Http2Response::writeFrame(s, http2::GOAWAY, 0, 0, {payload, sizeof(payload)});
+        ((AsyncSocket<false> *) s)->uncork();
+        ((AsyncSocket<false> *) s)->shutdown();
+        return ((AsyncSocket<false> *) s)->close();
+    }
+
+    Http2Context *init() {
+        us_socket_context_on_open(0, getSocketContext(), [](us_socket_t *s, int /*is_client*/, char */*ip*/, int /*ip_length*/) {
+            new (us_socket_ext(0, s)) Http2ConnectionData;
+            ((AsyncSocket<false> *) s)->getLoopData()->numSockets.fetch_add(1, std::memory_order_relaxed);
+
+            /* Our SETTINGS start the connection, everything else stays as the defaults */
+            char settings[6] = {0, http2::SETTINGS_MAX_CONCURRENT_STREAMS};
+            http2::writeUint32(settings + 2, MAX_CONCURRENT_STREAMS);
+            Http2Response::writeFrame(s, http2::SETTINGS, 0, 0, {settings, sizeof(settings)});
+
+            us_socket_timeout(0, s, Http2Response::IDLE_TIMEOUT_S);
+            return s;
+        });
+
+        us_socket_context_on_close(0, getSocketContext(), [](us_socket_t *s, int /*code*/, void */*reason*/) {
+            Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+
+            /* Every stream still open is aborted */
+            while (connectionData->streams.size()) {
+                Http2Response::abort(connectionData->streams.back(), std::nullopt);
+            }
+
+            ((AsyncSocket<false> *) s)->getLoopData()->numSockets.fetch_sub(1, std::memory_order_relaxed);
+            connectionData->~Http2ConnectionData();
+            return s;
+        });
+
+        us_socket_context_on_data(0, getSocketContext(), [](us_socket_t *s, char *data, int length) {
+            Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+
+            /* Do not accept any data while in shutdown state */
+            if (us_socket_is_shut_down(0, s)) {
+                return s;
+            }
+
+            UWS_METRIC(((AsyncSocket<false> *) s)->getLoopData(), readSyscalls, 1);
+            UWS_METRIC(((AsyncSocket<false> *) s)->getLoopData(), bytesRead, length);
+            ((AsyncSocket<false> *) s)->getLoopData()->dataRead = true;
+
+            /* Cork this socket, holding on to everything we respond to the frames of this read */
+            ((AsyncSocket<false> *) s)->cork();
+            LoopData *loopData = ((AsyncSocket<false> *) s)->getLoopData();
+            loopData->holdCork = true;
+
+            http2::ErrorCode errorCode = http2::NO_ERROR;
+            http2::FrameParser::Result result = connectionData->parser.consume({data, (size_t) length}, http2::DEFAULT_MAX_FRAME_SIZE,
+                [s, &errorCode](http2::FrameType type, unsigned char flags, uint32_t streamId, std::string_view payload) {
+                errorCode = handleFrame(s, type, flags, streamId, payload);
+                return errorCode == http2::NO_ERROR;
+            });
+
+            loopData->holdCork = false;
+
+            if (result == http2::FrameParser::BAD_PREFACE) {
+                /* Not HTTP/2 at all */
+                ((AsyncSocket<false> *) s)->uncorkWithoutSending();
+                loopData->corkOffset = 0;
+                return ((AsyncSocket<false> *) s)->close();
+            }
+            if (result == http2::FrameParser::FRAME_TOO_BIG) {
+                errorCode = http2::FRAME_SIZE_ERROR;
+            }
+            if (errorCode != http2::NO_ERROR) {
+                return goAway(s, errorCode);
+            }
+
+            /* The connection gets back the window all DATA of this read took */
+            if (connectionData->receivedBytes) {
+                Http2Response::writeWindowUpdate(s, 0, connectionData->receivedBytes);
+                connectionData->receivedBytes = 0;
+            }
+
+            auto [written, failed] = ((AsyncSocket<false> *) s)->uncork();
+            if (failed) {
+                connectionData->awaitingWritable = true;
+            }
+            Http2Response::updateTimeout(s);
+            return s;
+        });
+
+        us_socket_context_on_writable(0, getSocketContext(), [](us_socket_t *s) {
+            AsyncSocket<false> *asyncSocket = (AsyncSocket<false> *) s;
+            Http2ConnectionData *connectionData = Http2Response::getConnectionData(s);
+
+            /* Drain the socket, then the streams, and only then ask for more */
+            asyncSocket->write(nullptr, 0, true, 0);
+            connectionData->awaitingWritable = asyncSocket->getBufferedAmount() > 0;
+
+            Http2Response::corked(s, [s]() {
+                drainStreams(s);
+            });
+            Http2Response::updateTimeout(s);
+            return s;
+        });
+
+        /* HTTP/2 does not support half-closed sockets, so simply close */
+        us_socket_context_on_end(0, getSocketContext(), [](us_socket_t *s) {
+            return ((AsyncSocket<false> *) s)->close();
+        });
+
+        /* Force close rather than gracefully shutdown and risk confusing the client with a complete download */
+        us_socket_context_on_timeout(0, getSocketContext(), [](us_socket_t *s) {
+            return ((AsyncSocket<false> *) s)->close();
+        });
+
+        return this;
+    }
+
+public:
+    /* Construct a new Http2Context using specified loop */
+    static Http2Context *create(Loop *loop, us_socket_context_options_t options = {}) {
+        Http2Context *http2Context = (Http2Context *) us_create_socket_context(0, (us_loop_t *) loop, sizeof(Http2ContextData), options);
+
+        if (!http2Context) {
+            return nullptr;
+        }
+
+        new ((Http2ContextData *) us_socket_context_ext(0, (us_socket_context_t *) http2Context)) Http2ContextData();
+        return http2Context->init();
+    }
+
+    /* Destruct the Http2Context, it does not follow RAII */
+    void free() {
+        getContextData()->~Http2ContextData();
+        us_socket_context_free(0, getSocketContext());
+    }
+
+    /* Register an HTTP route handler acording to URL pattern, exactly like HttpContext::onHttp */
+    void onHttp(std::string method, std::string pattern, MoveOnlyFunction<void(Http2Response *, Http2Request *)> &&handler) {
+        Http2ContextData *contextData = getContextData();
+
+        /* If we are passed nullptr then remove this */
+        if (!handler) {
+            contextData->router.addRoute(method, pattern, nullptr);
+            return;
+        }
+
+        auto parameterOffsets = HttpRouter<Http2ContextData::RouterData>::getParameterOffsets(pattern);
+
+        contextData->router.addRoute(method, pattern, [handler = std::move(handler), parameterOffsets = std::move(parameterOffsets)](HttpRouter<Http2ContextData::RouterData> *router) mutable {
+            Http2ContextData::RouterData &routerData = router->getUserData();
+            routerData.req->setYield(false);
+            routerData.req->setParameters(router->getParameters());
+            routerData.req->setParameterOffsets(&parameterOffsets);
+
+            handler(routerData.res, routerData.req);
+
+            /* If any handler yielded, the router will keep looking for a suitable handler. */
+            return !routerData.req->getYield();
+        });
+    }
+
+    /* Listen to port using this Http2Context */
+    us_listen_socket_t *listen(const char *host, int port, int options) {
+        /* Routes are usually all added by now */
+        getContextData()->router.freeze();
+        return us_socket_context_listen(0, getSocketContext(), host, port, options, sizeof(Http2ConnectionData));
+    }
+};
+
+}
+
+#endif // UWS_HTTP2CONTEXT_H
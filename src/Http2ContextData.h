@@ -0,0 +1,100 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2CONTEXTDATA_H
+#define UWS_HTTP2CONTEXTDATA_H
+
+#include <libusockets.h>
+
+#include "HttpRouter.h"
+#include "Hpack.h"
+#include "Http2Protocol.h"
+#include "Http2Request.h"
+#include "Http2ResponseData.h"
+
+#include <deque>
+#include <vector>
+
+namespace uWS {
+
+struct Http2Response;
+
+/* This data belongs to the connection, as socket ext */
+struct Http2ConnectionData : AsyncSocketData<false> {
+    http2::FrameParser parser;
+    HpackDecoder decoder;
+
+    /* A header block continued by CONTINUATION frames is put together here */
+    std::string headerBlock;
+    uint32_t headerBlockStreamId = 0;
+    bool headerBlockEndsStream = false;
+
+    /* Open streams, in the order they came */
+    std::vector<Http2ResponseData *> streams;
+    uint32_t lastStreamId = 0;
+
+    /* What the client lets us send on the connection, and on new streams */
+    int32_t sendWindow = http2::DEFAULT_WINDOW_SIZE;
+    int32_t initialWindowSize = http2::DEFAULT_WINDOW_SIZE;
+    uint32_t maxFrameSize = http2::DEFAULT_MAX_FRAME_SIZE;
+
+    /* DATA received during this read, given back at once */
+    uint32_t receivedBytes = 0;
+
+    /* A write failed, so the socket polls for writable */
+    bool awaitingWritable = false;
+    bool goingAway = false;
+
+    /* RST_STREAM received since resetWindowBegan (steady clock ms), see Http2Context::MAX_RESETS_PER_WINDOW */
+    uint64_t resetWindowBegan = 0;
+    unsigned int resetsInWindow = 0;
+};
+
+struct Http2ContextData {
+    struct RouterData {
+        Http2Response *res;
+        Http2Request *req;
+    };
+
+    HttpRouter<RouterData> router;
+
+    /* Streams of every connection, never moving. Done ones wait in freeStreams to be used again */
+    std::deque<Http2ResponseData> streamSlab;
+    std::vector<Http2ResponseData *> freeStreams;
+
+    /* Only one request is routed at a time */
+    Http2Request request;
+    std::string headerScratch;
+
+    Http2ResponseData *acquireStream() {
+        if (freeStreams.empty()) {
+            return &streamSlab.emplace_back();
+        }
+        Http2ResponseData *stream = freeStreams.back();
+        freeStreams.pop_back();
+        return stream;
+    }
+
+    void releaseStream(Http2ResponseData *stream) {
+        stream->reset();
+        freeStreams.push_back(stream);
+    }
+};
+
+}
+
+#endif // UWS_HTTP2CONTEXTDATA_H
@@ -0,0 +1,197 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2PROTOCOL_H
+#define UWS_HTTP2PROTOCOL_H
+
+/* The framing of HTTP/2 (RFC 9113), as seen by a server */
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace uWS {
+
+namespace http2 {
+
+enum FrameType : unsigned char {
+    DATA = 0,
+    HEADERS = 1,
+    PRIORITY = 2,
+    RST_STREAM = 3,
+    SETTINGS = 4,
+    PUSH_PROMISE = 5,
+    PING = 6,
+    GOAWAY = 7,
+    WINDOW_UPDATE = 8,
+    CONTINUATION = 9
+};
+
+enum Flags : unsigned char {
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20
+};
+
+enum ErrorCode : uint32_t {
+    NO_ERROR = 0,
+    PROTOCOL_ERROR = 1,
+    INTERNAL_ERROR = 2,
+    FLOW_CONTROL_ERROR = 3,
+    SETTINGS_TIMEOUT = 4,
+    STREAM_CLOSED = 5,
+    FRAME_SIZE_ERROR = 6,
+    REFUSED_STREAM = 7,
+    CANCEL = 8,
+    COMPRESSION_ERROR = 9,
+    CONNECT_ERROR = 10,
+    ENHANCE_YOUR_CALM = 11
+};
+
+enum Setting : uint16_t {
+    SETTINGS_HEADER_TABLE_SIZE = 1,
+    SETTINGS_ENABLE_PUSH = 2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 4,
+    SETTINGS_MAX_FRAME_SIZE = 5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 6
+};
+
+/* What every client connection starts with */
+static constexpr std::string_view PREFACE("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+
+static constexpr unsigned int FRAME_HEADER_LENGTH = 9;
+static constexpr uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+static constexpr uint32_t MAX_MAX_FRAME_SIZE = (1u << 24) - 1;
+static constexpr int32_t DEFAULT_WINDOW_SIZE = 65535;
+static constexpr int32_t MAX_WINDOW_SIZE = INT32_MAX;
+
+inline uint32_t readUint32(const char *src) {
+    return (uint32_t) (unsigned char) src[0] << 24 | (uint32_t) (unsigned char) src[1] << 16
+        | (uint32_t) (unsigned char) src[2] << 8 | (uint32_t) (unsigned char) src[3];
+}
+
+inline void writeUint32(char *dst, uint32_t value) {
+    dst[0] = (char) (value >> 24);
+    dst[1] = (char) (value >> 16);
+    dst[2] = (char) (value >> 8);
+    dst[3] = (char) value;
+}
+
+inline void formatFrameHeader(char *dst, uint32_t length, FrameType type, unsigned char flags, uint32_t streamId) {
+    dst[0] = (char) (length >> 16);
+    dst[1] = (char) (length >> 8);
+    dst[2] = (char) length;
+    dst[3] = (char) type;
+    dst[4] = (char) flags;
+    writeUint32(dst + 5, streamId & 0x7fffffff);
+}
+
+/* Takes reads apart into frames. Frames within one read are passed on where they are, only those split across
+ * reads are put together in the buffer */
+struct FrameParser {
+    enum Result {
+        OK,
+        /* The callback returned false */
+        STOPPED,
+        BAD_PREFACE,
+        FRAME_TOO_BIG
+    };
+
+private:
+    std::string buffer;
+    /* How much of the preface we have seen */
+    unsigned int prefaceOffset = 0;
+
+    static uint32_t frameLength(const char *header) {
+        return (uint32_t) (unsigned char) header[0] << 16 | (uint32_t) (unsigned char) header[1] << 8 | (uint32_t) (unsigned char) header[2];
+    }
+
+    template <typename F>
+    static bool emit(std::string_view frame, F &cb) {
+        return cb((FrameType) frame[3], (unsigned char) frame[4], readUint32(frame.data() + 5) & 0x7fffffff,
+            frame.substr(FRAME_HEADER_LENGTH));
+    }
+
+public:
+    /* Calls cb(type, flags, streamId, payload) for every complete frame, until it returns false. Frames may be no
+     * longer than maxFrameSize */
+    template <typename F>
+    Result consume(std::string_view data, uint32_t maxFrameSize, F cb) {
+        if (prefaceOffset < PREFACE.length()) {
+            size_t length = std::min<size_t>(data.length(), PREFACE.length() - prefaceOffset);
+            if (data.substr(0, length) != PREFACE.substr(prefaceOffset, length)) {
+                return BAD_PREFACE;
+            }
+            prefaceOffset += (unsigned int) length;
+            data.remove_prefix(length);
+        }
+
+        /* Complete what was split last time */
+        if (buffer.length()) {
+            if (buffer.length() < FRAME_HEADER_LENGTH) {
+                size_t length = std::min<size_t>(data.length(), FRAME_HEADER_LENGTH - buffer.length());
+                buffer.append(data.data(), length);
+                data.remove_prefix(length);
+                if (buffer.length() < FRAME_HEADER_LENGTH) {
+                    return OK;
+                }
+            }
+            uint32_t payloadLength = frameLength(buffer.data());
+            if (payloadLength > maxFrameSize) {
+                return FRAME_TOO_BIG;
+            }
+            size_t length = std::min<size_t>(data.length(), FRAME_HEADER_LENGTH + payloadLength - buffer.length());
+            buffer.append(data.data(), length);
+            data.remove_prefix(length);
+            if (buffer.length() < FRAME_HEADER_LENGTH + payloadLength) {
+                return OK;
+            }
+            bool more = emit(buffer, cb);
+            buffer.clear();
+            if (!more) {
+                return STOPPED;
+            }
+        }
+
+        while (data.length() >= FRAME_HEADER_LENGTH) {
+            uint32_t payloadLength = frameLength(data.data());
+            if (payloadLength > maxFrameSize) {
+                return FRAME_TOO_BIG;
+            }
+            if (data.length() < FRAME_HEADER_LENGTH + payloadLength) {
+                break;
+            }
+            if (!emit(data.substr(0, FRAME_HEADER_LENGTH + payloadLength), cb)) {
+                return STOPPED;
+            }
+            data.remove_prefix(FRAME_HEADER_LENGTH + payloadLength);
+        }
+
+        buffer.append(data.data(), data.length());
+        return OK;
+    }
+};
+
+}
+
+}
+
+#endif // UWS_HTTP2PROTOCOL_H
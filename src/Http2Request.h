@@ -0,0 +1,140 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2REQUEST_H
+#define UWS_HTTP2REQUEST_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace uWS {
+
+/* Like HttpRequest, valid only during the route handler. One of these is used for every request of an Http2Context,
+ * so decoded headers land in storage that has long grown big enough */
+struct Http2Request {
+    friend struct Http2Context;
+private:
+    struct Header {
+        uint32_t nameOffset, nameLength, valueOffset, valueLength;
+    };
+
+    /* Names and values back to back, HPACK hands them to us one by one */
+    std::string storage;
+    std::vector<Header> headers;
+    std::string_view method, path;
+    bool didYield = false;
+    std::pair<int, std::string_view *> currentParameters = {-1, nullptr};
+    std::map<std::string, unsigned short, std::less<>> *currentParameterOffsets = nullptr;
+
+    void clear() {
+        storage.clear();
+        headers.clear();
+        method = path = {};
+    }
+
+    void addHeader(std::string_view name, std::string_view value) {
+        headers.push_back({(uint32_t) storage.length(), (uint32_t) name.length(), (uint32_t) (storage.length() + name.length()), (uint32_t) value.length()});
+        storage.append(name);
+        storage.append(value);
+    }
+
+    /* Once every header is in storage */
+    void resolvePseudoHeaders() {
+        method = getHeader(":method");
+        path = getHeader(":path");
+    }
+
+public:
+    /* Lower case key, host also finds :authority */
+    std::string_view getHeader(std::string_view key) {
+        for (Header &header : headers) {
+            if (std::string_view(storage.data() + header.nameOffset, header.nameLength) == key) {
+                return {storage.data() + header.valueOffset, header.valueLength};
+            }
+        }
+        if (key == "host") {
+            return getHeader(":authority");
+        }
+        return {nullptr, 0};
+    }
+
+    /* Upper case, as sent */
+    std::string_view getCaseSensitiveMethod() {
+        return method;
+    }
+
+    std::string_view getUrl() {
+        return path.substr(0, path.find('?'));
+    }
+
+    std::string_view getFullUrl() {
+        return path;
+    }
+
+    /* Returns the raw querystring as a whole, still encoded */
+    std::string_view getQuery() {
+        size_t querySeparator = path.find('?');
+        if (querySeparator == std::string_view::npos) {
+            return {nullptr, 0};
+        }
+        return path.substr(querySeparator + 1);
+    }
+
+    /* If you do not want to handle this route */
+    void setYield(bool yield) {
+        didYield = yield;
+    }
+
+    bool getYield() {
+        return didYield;
+    }
+
+    void setParameters(std::pair<int, std::string_view *> parameters) {
+        currentParameters = parameters;
+    }
+
+    void setParameterOffsets(std::map<std::string, unsigned short, std::less<>> *offsets) {
+        currentParameterOffsets = offsets;
+    }
+
+    std::string_view getParameter(std::string_view name) {
+        if (!currentParameterOffsets) {
+            return {nullptr, 0};
+        }
+        auto it = currentParameterOffsets->find(name);
+        if (it == currentParameterOffsets->end()) {
+            return {nullptr, 0};
+        }
+        return getParameter(it->second);
+    }
+
+    std::string_view getParameter(unsigned short index) {
+        if (currentParameters.first < (int) index) {
+            return {};
+        } else {
+            return currentParameters.second[index];
+        }
+    }
+};
+
+}
+
+#endif // UWS_HTTP2REQUEST_H
@@ -0,0 +1,399 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2RESPONSE_H
+#define UWS_HTTP2RESPONSE_H
+
+#include "AsyncSocket.h"
+#include "Hpack.h"
+#include "Http2ContextData.h"
+#include "Http2ResponseData.h"
+#include "Utilities.h"
+
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace uWS {
+
+/* Is the Http2ResponseData of a stream. Like HttpResponse, it is not to be used after it completed or aborted */
+struct Http2Response {
+    friend struct Http2Context;
+private:
+    static constexpr unsigned int IDLE_TIMEOUT_S = 10;
+
+    Http2ResponseData *getResponseData() {
+        return (Http2ResponseData *) this;
+    }
+
+    static Http2ConnectionData *getConnectionData(us_socket_t *s) {
+        return (Http2ConnectionData *) us_socket_ext(0, s);
+    }
+
+    static Http2ContextData *getContextData(us_socket_t *s) {
+        return (Http2ContextData *) us_socket_context_ext(0, us_socket_context(0, s));
+    }
+
+    static void writeFrame(us_socket_t *s, http2::FrameType type, unsigned char flags, uint32_t streamId, std::string_view payload) {
+        char header[http2::FRAME_HEADER_LENGTH];
+        http2::formatFrameHeader(header, (uint32_t) payload.length(), type, flags, streamId);
+        auto [written, failed] = ((AsyncSocket<false> *) s)->write(header, (int) sizeof(header), false, (int) payload.length());
+        if (payload.length()) {
+            auto [payloadWritten, payloadFailed] = ((AsyncSocket<false> *) s)->write(payload.data(), (int) payload.length());
+            failed |= payloadFailed;
+        }
+        if (failed) {
+            getConnectionData(s)->awaitingWritable = true;
+        }
+    }
+
+    static void writeRstStream(us_socket_t *s, uint32_t streamId, http2::ErrorCode errorCode) {
+        char payload[4];
+        http2::writeUint32(payload, errorCode);
+        writeFrame(s, http2::RST_STREAM, 0, streamId, {payload, sizeof(payload)});
+    }
+
+    static void writeWindowUpdate(us_socket_t *s, uint32_t streamId, uint32_t increment) {
+        char payload[4];
+        http2::writeUint32(payload, increment);
+        writeFrame(s, http2::WINDOW_UPDATE, 0, streamId, {payload, sizeof(payload)});
+    }
+
+    /* Idle connections, and those waiting for the client to read or send, time out */
+    static void updateTimeout(us_socket_t *s) {
+        Http2ConnectionData *connectionData = getConnectionData(s);
+        bool waiting = connectionData->streams.empty() || connectionData->awaitingWritable;
+        for (Http2ResponseData *stream : connectionData->streams) {
+            waiting |= !stream->requestEnded;
+        }
+        us_socket_timeout(0, s, waiting ? IDLE_TIMEOUT_S : 0);
+    }
+
+    /* Runs f corked, like the handlers are, unless another socket holds the cork */
+    template <typename F>
+    static void corked(us_socket_t *s, F &&f) {
+        AsyncSocket<false> *asyncSocket = (AsyncSocket<false> *) s;
+        if (asyncSocket->isCorked() || !asyncSocket->canCork()) {
+            f();
+            return;
+        }
+        asyncSocket->cork();
+        f();
+        auto [written, failed] = asyncSocket->uncork();
+        if (failed) {
+            getConnectionData(s)->awaitingWritable = true;
+        }
+        updateTimeout(s);
+    }
+
+    /* The header block gathered so far, split in frames as big as the client takes */
+    static void sendHeaders(Http2ResponseData *stream, bool endStream) {
+        if (stream->headersSent) {
+            return;
+        }
+        if (!stream->statusWritten) {
+            hpack::encodeStatus(stream->headers, "200");
+        }
+        uint32_t maxFrameSize = getConnectionData(stream->socket)->maxFrameSize;
+        std::string_view block = stream->headers;
+        http2::FrameType type = http2::HEADERS;
+        do {
+            std::string_view fragment = block.substr(0, maxFrameSize);
+            block.remove_prefix(fragment.length());
+            unsigned char flags = (unsigned char) ((block.length() ? 0 : http2::FLAG_END_HEADERS) | (endStream && type == http2::HEADERS ? http2::FLAG_END_STREAM : 0));
+            writeFrame(stream->socket, type, flags, stream->streamId, fragment);
+            type = http2::CONTINUATION;
+        } while (block.length());
+
+        stream->headersSent = true;
+        stream->headers.clear();
+        if (endStream) {
+            stream->endSent = true;
+        }
+    }
+
+    /* Sends as much of data as both windows allow, ending the stream with the last of it if endStream. Returns how much */
+    static size_t sendData(Http2ResponseData *stream, std::string_view data, bool endStream) {
+        Http2ConnectionData *connectionData = getConnectionData(stream->socket);
+        size_t sent = 0;
+        do {
+            size_t allowed = (size_t) std::max<int32_t>(std::min(stream->sendWindow, connectionData->sendWindow), 0);
+            size_t length = std::min<size_t>({data.length() - sent, allowed, connectionData->maxFrameSize});
+            bool last = endStream && sent + length == data.length();
+            if (!length && !last) {
+                break;
+            }
+            writeFrame(stream->socket, http2::DATA, last ? http2::FLAG_END_STREAM : 0, stream->streamId, data.substr(sent, length));
+            stream->sendWindow -= (int32_t) length;
+            connectionData->sendWindow -= (int32_t) length;
+            sent += length;
+            if (last) {
+                stream->endSent = true;
+                break;
+            }
+        } while (sent < data.length());
+        return sent;
+    }
+
+    /* Sends what flow control held back, and the end once everything is out */
+    static void drain(Http2ResponseData *stream) {
+        while (stream->backpressure.length()) {
+            std::string_view chunk = stream->backpressure.front();
+            size_t length = chunk.length();
+            size_t sent = sendData(stream, chunk, stream->ended && length == stream->backpressure.length());
+            stream->backpressure.erase(sent);
+            if (sent < length) {
+                return;
+            }
+        }
+        if (stream->ended && !stream->endSent) {
+            sendHeaders(stream, false);
+            sendData(stream, {}, true);
+        }
+    }
+
+    /* Gives back a stream we sent all of. Returns true if it did */
+    static bool complete(Http2ResponseData *stream) {
+        if (!stream->endSent) {
+            return false;
+        }
+        /* We are done before the client, it can stop sending */
+        if (!stream->requestEnded) {
+            writeRstStream(stream->socket, stream->streamId, http2::NO_ERROR);
+        }
+        release(stream);
+        return true;
+    }
+
+    static void release(Http2ResponseData *stream) {
+        std::vector<Http2ResponseData *> &streams = getConnectionData(stream->socket)->streams;
+        streams.erase(std::find(streams.begin(), streams.end(), stream));
+        getContextData(stream->socket)->releaseStream(stream);
+    }
+
+    /* The stream is gone for good, tell the client if errorCode and the application if it still cares */
+    static void abort(Http2ResponseData *stream, std::optional<http2::ErrorCode> errorCode) {
+        if (errorCode) {
+            writeRstStream(stream->socket, stream->streamId, *errorCode);
+        }
+        if (stream->onAborted) {
+            stream->onAborted();
+        }
+        release(stream);
+    }
+
+public:
+    Http2Response *writeStatus(std::string_view status) {
+        Http2ResponseData *responseData = getResponseData();
+
+        /* Nothing is done if status already written. HTTP/2 has no reason phrase, only the code */
+        if (!responseData->statusWritten && !responseData->headersSent) {
+            hpack::encodeStatus(responseData->headers, status.substr(0, 3));
+            responseData->statusWritten = true;
+        }
+
+        return this;
+    }
+
+    /* Header names are sent in lower case, and those only meaning something to HTTP/1.1 are left out */
+    Http2Response *writeHeader(std::string_view key, std::string_view value) {
+        Http2ResponseData *responseData = getResponseData();
+
+        writeStatus("200 OK");
+        if (responseData->headersSent) {
+            return this;
+        }
+
+        char lowerCase[256];
+        if (key.length() > sizeof(lowerCase)) {
+            return this;
+        }
+        for (size_t i = 0; i < key.length(); i++) {
+            lowerCase[i] = (char) ((key[i] >= 'A' && key[i] <= 'Z') ? key[i] | 32 : key[i]);
+        }
+        std::string_view name(lowerCase, key.length());
+        if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade") {
+            return this;
+        }
+
+        hpack::encodeHeader(responseData->headers, name, value);
+        return this;
+    }
+
+    Http2Response *writeHeader(std::string_view key, uint64_t value) {
+        char buf[20];
+        return writeHeader(key, std::string_view(buf, (size_t) utils::u64toa(value, buf)));
+    }
+
+    /* Streams data, what flow control does not let out right away is held back and sent in order.
+     * Returns false if anything is held back or the socket is full, after which onWritable tells */
+    bool write(std::string_view data) {
+        Http2ResponseData *responseData = getResponseData();
+        if (responseData->ended) {
+            return false;
+        }
+
+        corked(responseData->socket, [responseData, data]() {
+            sendHeaders(responseData, false);
+            size_t sent = responseData->backpressure.length() ? 0 : sendData(responseData, data, false);
+            responseData->backpressure.append(data.data() + sent, data.length() - sent);
+            responseData->offset += data.length();
+        });
+
+        return !responseData->backpressure.length() && !getConnectionData(responseData->socket)->awaitingWritable;
+    }
+
+    /* Ends the response with data, which is held back like for write. Content-Length is added when nothing was written */
+    void end(std::string_view data = {}, bool /*closeConnection*/ = false) {
+        Http2ResponseData *responseData = getResponseData();
+        if (responseData->ended) {
+            return;
+        }
+
+        corked(responseData->socket, [this, responseData, data]() {
+            responseData->ended = true;
+            responseData->offset += data.length();
+
+            if (!responseData->headersSent) {
+                if (!data.length()) {
+                    /* All of it is one HEADERS frame */
+                    writeHeader("content-length", (uint64_t) 0);
+                    sendHeaders(responseData, true);
+                    complete(responseData);
+                    return;
+                }
+                writeHeader("content-length", (uint64_t) data.length());
+                sendHeaders(responseData, false);
+            }
+
+            responseData->backpressure.append(data.data(), data.length());
+            drain(responseData);
+            complete(responseData);
+        });
+    }
+
+    /* Writes as much as flow control allows without holding anything back, like HttpResponse::tryEnd.
+     * Returns ok and whether we are done. What was not taken is to be tried again from getWriteOffset, in onWritable */
+    std::pair<bool, bool> tryEnd(std::string_view data, uintmax_t totalSize = 0, bool /*closeConnection*/ = false) {
+        Http2ResponseData *responseData = getResponseData();
+        if (responseData->ended) {
+            return {true, true};
+        }
+
+        bool ok = false, done = false;
+        corked(responseData->socket, [this, responseData, data, totalSize, &ok, &done]() {
+            if (!responseData->headersSent) {
+                writeHeader("content-length", (uint64_t) (totalSize ? totalSize : data.length()));
+                sendHeaders(responseData, false);
+            }
+
+            /* Nothing jumps the queue of what write held back */
+            if (responseData->backpressure.length()) {
+                drain(responseData);
+                if (responseData->backpressure.length()) {
+                    return;
+                }
+            }
+
+            bool last = !totalSize || responseData->offset + data.length() >= totalSize;
+            size_t sent = sendData(responseData, data, last);
+            responseData->offset += sent;
+            ok = sent == data.length() && !getConnectionData(responseData->socket)->awaitingWritable;
+
+            if (responseData->endSent) {
+                responseData->ended = done = true;
+                complete(responseData);
+            }
+        });
+
+        return {ok, done};
+    }
+
+    /* Ends the response with no body at all, reporting a Content-Length if given such as for HEAD */
+    void endWithoutBody(std::optional<size_t> reportedContentLength = std::nullopt, bool closeConnection = false) {
+        Http2ResponseData *responseData = getResponseData();
+        if (responseData->ended) {
+            return;
+        }
+        if (responseData->headersSent) {
+            end({}, closeConnection);
+            return;
+        }
+
+        corked(responseData->socket, [this, responseData, reportedContentLength]() {
+            if (reportedContentLength) {
+                writeHeader("content-length", (uint64_t) *reportedContentLength);
+            }
+            responseData->ended = true;
+            sendHeaders(responseData, true);
+            complete(responseData);
+        });
+    }
+
+    /* Resets the stream, the client sees it cancelled */
+    void close() {
+        Http2ResponseData *responseData = getResponseData();
+        corked(responseData->socket, [responseData]() {
+            abort(responseData, http2::CANCEL);
+        });
+    }
+
+    bool hasResponded() {
+        return getResponseData()->ended;
+    }
+
+    uintmax_t getWriteOffset() {
+        return getResponseData()->offset;
+    }
+
+    std::string_view getRemoteAddress() {
+        return ((AsyncSocket<false> *) getResponseData()->socket)->getRemoteAddress();
+    }
+
+    std::string_view getRemoteAddressAsText() {
+        return ((AsyncSocket<false> *) getResponseData()->socket)->getRemoteAddressAsText();
+    }
+
+    /* Corks the connection if possible, so that everything written in handler leaves at once */
+    Http2Response *cork(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
+        corked(getResponseData()->socket, handler);
+        return this;
+    }
+
+    /* Attach handler for aborted HTTP request */
+    Http2Response *onAborted(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
+        getResponseData()->onAborted = std::move(handler);
+        return this;
+    }
+
+    /* Attach a read handler for data sent. Will be called with FIN set true if last segment. */
+    Http2Response *onData(MoveOnlyFunction<void(std::string_view, bool), CALLBACK_INLINE_SIZE> &&handler) {
+        getResponseData()->onData = std::move(handler);
+        return this;
+    }
+
+    /* Called once the stream can take more, both by flow control and the socket */
+    Http2Response *onWritable(MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> &&handler) {
+        getResponseData()->onWritable = std::move(handler);
+        return this;
+    }
+};
+
+}
+
+#endif // UWS_HTTP2RESPONSE_H
@@ -0,0 +1,80 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTP2RESPONSEDATA_H
+#define UWS_HTTP2RESPONSEDATA_H
+
+/* One stream of an HTTP/2 connection, kept in the slab of its Http2Context and used again once done */
+
+#include <libusockets.h>
+
+#include "MoveOnlyFunction.h"
+#include "AsyncSocketData.h"
+#include "Http2Protocol.h"
+
+#include <string>
+#include <string_view>
+
+namespace uWS {
+
+struct Http2ResponseData {
+    /* The connection, and 0 while in the slab */
+    us_socket_t *socket = nullptr;
+    uint32_t streamId = 0;
+
+    /* What the client lets us send on this stream, negative if it shrank its window */
+    int32_t sendWindow = 0;
+
+    MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> onAborted = nullptr;
+    MoveOnlyFunction<void(std::string_view, bool), CALLBACK_INLINE_SIZE> onData = nullptr;
+    MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> onWritable = nullptr;
+
+    /* The HPACK of the status and headers written so far, sent as one header block on the first write or end */
+    std::string headers;
+    bool statusWritten = false;
+    bool headersSent = false;
+
+    /* end was called, and END_STREAM went out once all of the body did */
+    bool ended = false;
+    bool endSent = false;
+    /* The client sent END_STREAM */
+    bool requestEnded = false;
+
+    /* Body bytes taken so far, sent or not */
+    uintmax_t offset = 0;
+
+    /* What flow control holds back, in order */
+    BackPressure backpressure;
+
+    /* Keeps what was allocated for the next stream */
+    void reset() {
+        socket = nullptr;
+        streamId = 0;
+        sendWindow = 0;
+        onAborted = nullptr;
+        onData = nullptr;
+        onWritable = nullptr;
+        headers.clear();
+        statusWritten = headersSent = ended = endSent = requestEnded = false;
+        offset = 0;
+        backpressure.clear();
+    }
+};
+
+}
+
+#endif // UWS_HTTP2RESPONSEDATA_H
@@ -3,12 +3,31 @@
 #include "Http3Response.h"
 #include "Http3Request.h"
 #include "Http3Context.h"
+#include "WebTransport.h"
 
 namespace uWS {
 
     struct H3App {
         Http3Context *http3Context;
 
+        /* Topics of WebTransport sessions, made by the first WebTransport route */
+        WebTransportTopicTree *topicTree = nullptr;
+
+        /* Behaviors of WebTransport routes, of differing type */
+        std::vector<MoveOnlyFunction<void()>> webTransportContextDeleters;
+
+        template <typename UserData>
+        struct WebTransportBehavior {
+            /* Maximum message size we can receive */
+            unsigned int maxPayloadLength = 16 * 1024;
+            /* Messages sent while the stream holds more than this are dropped, see WebTransport */
+            unsigned int maxBackpressure = 64 * 1024;
+            MoveOnlyFunction<void(Http3Response *, Http3Request *, WebTransportContextData<UserData> *)> upgrade = nullptr;
+            MoveOnlyFunction<void(WebTransport<UserData> *)> open = nullptr;
+            MoveOnlyFunction<void(WebTransport<UserData> *, std::string_view)> message = nullptr;
+            MoveOnlyFunction<void(WebTransport<UserData> *, int, std::string_view)> close = nullptr;
+        };
+
         H3App(SocketContextOptions options = {}) {
             /* This conversion should not be needed */
             us_quic_socket_context_options_t h3options = {};
@@ -23,6 +42,18 @@ namespace uWS {
             http3Context->init();
         }
 
+        ~H3App() {
+            for (auto &webTransportContextDeleter : webTransportContextDeleters) {
+                webTransportContextDeleter();
+            }
+
+            if (topicTree) {
+                Loop::get()->removePostHandler(topicTree);
+                Loop::get()->removePreHandler(topicTree);
+                delete topicTree;
+            }
+        }
+
         /* Disallow copying, only move */
         H3App(const H3App &other) = delete;
 
@@ -30,6 +61,76 @@ namespace uWS {
             /* Move HttpContext */
             http3Context = other.http3Context;
             other.http3Context = nullptr;
+
+            webTransportContextDeleters = std::move(other.webTransportContextDeleters);
+
+            topicTree = other.topicTree;
+            other.topicTree = nullptr;
+        }
+
+        /* Accepts WebTransport sessions (extended CONNECT with :protocol webtransport) on pattern, like App::ws */
+        template <typename UserData>
+        H3App &&webtransport(std::string pattern, WebTransportBehavior<UserData> &&behavior) {
+            if (!http3Context) {
+                return std::move(*this);
+            }
+
+            /* The first route makes the topics, drained every loop iteration like those of App */
+            if (!topicTree) {
+                topicTree = new WebTransportTopicTree([](Subscriber *s, std::string &message, WebTransportTopicTree::IteratorFlags) {
+                    /* Many routes share the topics, the user data type does not matter for sending */
+                    ((WebTransport<int> *) s->user)->send(message);
+                    return false;
+                });
+
+                Loop::get()->addPostHandler(topicTree, [topicTree = topicTree](Loop */*loop*/) {
+                    topicTree->drain();
+                });
+                Loop::get()->addPreHandler(topicTree, [topicTree = topicTree](Loop */*loop*/) {
+                    topicTree->drain();
+                });
+            }
+
+            auto *webTransportContextData = new WebTransportContextData<UserData>;
+            webTransportContextData->openHandler = std::move(behavior.open);
+            webTransportContextData->messageHandler = std::move(behavior.message);
+            webTransportContextData->closeHandler = std::move(behavior.close);
+            webTransportContextData->maxPayloadLength = behavior.maxPayloadLength;
+            webTransportContextData->maxBackpressure = behavior.maxBackpressure;
+            webTransportContextData->topicTree = topicTree;
+            webTransportContextDeleters.push_back([webTransportContextData]() {
+                delete webTransportContextData;
+            });
+
+            http3Context->onHttp("CONNECT", pattern, [webTransportContextData, upgrade = std::move(behavior.upgrade)](Http3Response *res, Http3Request *req) mutable {
+                /* A plain CONNECT is not ours */
+                if (req->getHeader(":protocol") != webtransport::PROTOCOL) {
+                    req->setYield(true);
+                    return;
+                }
+
+                if (upgrade) {
+                    upgrade(res, req, webTransportContextData);
+                } else {
+                    res->template upgrade<UserData>({}, webTransportContextData);
+                }
+            });
+
+            return std::move(*this);
+        }
+
+        /* Publishes to every WebTransport session subscribing to topic, see WebTransport::send */
+        bool publish(std::string_view topic, std::string_view message) {
+            if (!topicTree) {
+                return false;
+            }
+            return topicTree->publish(nullptr, topic, std::string(message));
+        }
+
+        /* Returns number of WebTransport sessions subscribing to topic */
+        unsigned int numSubscribers(std::string_view topic) {
+            Topic *t = topicTree ? topicTree->lookupTopic(topic) : nullptr;
+            return t ? (unsigned int) t->size() : 0;
         }
 
         /* Host, port, callback */
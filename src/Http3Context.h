@@ -58,12 +58,8 @@ namespace uWS {
                 if (responseData->onWritable) {
                     responseData->onWritable(responseData->offset);
                 } else {
-                    int written = us_quic_stream_write(s, (char *) responseData->backpressure.data(), responseData->backpressure.length());
-                    responseData->backpressure.erase(written);
-
-                    if (responseData->backpressure.length() == 0) {
-                        printf("wrote until end, shutting down now!\n");
-                        us_quic_stream_shutdown(s);
+                    /* Write chunk by chunk until the stream takes no more */
+                    if (((Http3Response *) s)->drain(responseData)) {
                         us_quic_stream_close(s);
                     }
                 }
@@ -73,13 +69,23 @@ namespace uWS {
                 /* This is the main place of start for requests */
                 Http3ContextData *contextData = (Http3ContextData *) us_quic_socket_context_ext(us_quic_socket_context(us_quic_stream_socket(s)));
 
-                Http3Request *req = nullptr;
+                Http3Request req;
+                req.method = req.getHeader(":method");
+                req.path = req.getHeader(":path");
 
-                std::string_view upperCasedMethod = req->getHeader(":method");
-                std::string_view path = req->getHeader(":path");
-                
-                contextData->router.getUserData() = {(Http3Response *) s, (Http3Request *) nullptr};
-                contextData->router.route(upperCasedMethod, path);
+                /* Whatever the handler writes leaves as one header block and one stream write */
+                Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext(s);
+                responseData->corked = true;
+
+                /* Same routing as HttpContext, by case sensitive method and the url without query */
+                contextData->router.getUserData() = {(Http3Response *) s, &req};
+                if (!contextData->router.route(req.getCaseSensitiveMethod(), req.getUrl())) {
+                    /* Like HTTP/1.1 we close what has no handler, here only the stream of it */
+                    us_quic_stream_close(s);
+                    return;
+                }
+
+                ((Http3Response *) s)->uncork();
 
             });
             us_quic_socket_context_on_open(context, [](us_quic_socket_t *s, int is_client) {
@@ -109,6 +115,9 @@ namespace uWS {
 
         us_quic_listen_socket_t *listen(const char *host, int port) {
             /* The listening socket is the actual UDP socket used */
+            /* Routes are usually all added by now */
+            ((Http3ContextData *) us_quic_socket_context_ext((us_quic_socket_context_t *) this))->router.freeze();
+
             us_quic_listen_socket_t *listen_socket = us_quic_socket_context_listen((us_quic_socket_context_t *) this, host, port, sizeof(Http3ResponseData));
 
             //printf("Listen socket is: %p\n", listen_socket);
@@ -129,28 +138,28 @@ namespace uWS {
 
         }
 
-        // generic for get, post, any, etc
-        void onHttp(std::string method, std::string path, MoveOnlyFunction<void(Http3Response *, Http3Request *)> &&cb) {
-            // modifies the router we own as part of Http3ContextData, used in callbacks set in init
-        
+        /* Register an HTTP route handler acording to URL pattern, exactly like HttpContext::onHttp */
+        void onHttp(std::string method, std::string pattern, MoveOnlyFunction<void(Http3Response *, Http3Request *)> &&handler) {
             Http3ContextData *contextData = (Http3ContextData *) us_quic_socket_context_ext((us_quic_socket_context_t *) this);
 
-            /* Todo: This is ugly, fix */
-            std::vector<std::string> methods;
-            if (method == "*") {
-                methods = {"*"}; //bug! needs to be upper cased!
-                // router.upperCasedMethods;
-            } else {
-                methods = {method};
+            /* If we are passed nullptr then remove this */
+            if (!handler) {
+                contextData->router.addRoute(method, pattern, nullptr);
+                return;
             }
 
-            contextData->router.add(methods, path, [handler = std::move(cb)](HttpRouter<Http3ContextData::RouterData> *router) mutable {
+            auto parameterOffsets = HttpRouter<Http3ContextData::RouterData>::getParameterOffsets(pattern);
 
+            contextData->router.addRoute(method, pattern, [handler = std::move(handler), parameterOffsets = std::move(parameterOffsets)](HttpRouter<Http3ContextData::RouterData> *router) mutable {
                 Http3ContextData::RouterData &routerData = router->getUserData();
+                routerData.req->setYield(false);
+                routerData.req->setParameters(router->getParameters());
+                routerData.req->setParameterOffsets(&parameterOffsets);
 
                 handler(routerData.res, routerData.req);
 
-                return true;
+                /* If any handler yielded, the router will keep looking for a suitable handler. */
+                return !routerData.req->getYield();
             });
         }
     };
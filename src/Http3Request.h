@@ -2,10 +2,24 @@ extern "C" {
 #include "quic.h"
 }
 
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <cstring>
+
 namespace uWS {
 
+    /* Like HttpRequest, valid only during the route handler */
     struct Http3Request {
+        friend struct Http3Context;
+    private:
+        std::string_view method, path;
+        bool didYield = false;
+        std::pair<int, std::string_view *> currentParameters = {-1, nullptr};
+        std::map<std::string, unsigned short, std::less<>> *currentParameterOffsets = nullptr;
 
+    public:
         std::string_view getHeader(std::string_view key) {
             for (int i = 0, more = 1; more; i++) {
                 char *name, *value;
@@ -18,5 +32,63 @@ namespace uWS {
             }
             return {nullptr, 0};
         }
+
+        /* Upper case, as sent */
+        std::string_view getCaseSensitiveMethod() {
+            return method;
+        }
+
+        std::string_view getUrl() {
+            return path.substr(0, path.find('?'));
+        }
+
+        std::string_view getFullUrl() {
+            return path;
+        }
+
+        /* Returns the raw querystring as a whole, still encoded */
+        std::string_view getQuery() {
+            size_t querySeparator = path.find('?');
+            if (querySeparator == std::string_view::npos) {
+                return {nullptr, 0};
+            }
+            return path.substr(querySeparator + 1);
+        }
+
+        /* If you do not want to handle this route */
+        void setYield(bool yield) {
+            didYield = yield;
+        }
+
+        bool getYield() {
+            return didYield;
+        }
+
+        void setParameters(std::pair<int, std::string_view *> parameters) {
+            currentParameters = parameters;
+        }
+
+        void setParameterOffsets(std::map<std::string, unsigned short, std::less<>> *offsets) {
+            currentParameterOffsets = offsets;
+        }
+
+        std::string_view getParameter(std::string_view name) {
+            if (!currentParameterOffsets) {
+                return {nullptr, 0};
+            }
+            auto it = currentParameterOffsets->find(name);
+            if (it == currentParameterOffsets->end()) {
+                return {nullptr, 0};
+            }
+            return getParameter(it->second);
+        }
+
+        std::string_view getParameter(unsigned short index) {
+            if (currentParameters.first < (int) index) {
+                return {};
+            } else {
+                return currentParameters.second[index];
+            }
+        }
     };
-}
\ No newline at end of file
+}
@@ -1,13 +1,101 @@
+#ifndef UWS_H3RESPONSE_H
+#define UWS_H3RESPONSE_H
+
 extern "C" {
 #include "quic.h"
 }
 
 #include "Http3ResponseData.h"
+#include "WebTransportContextData.h"
+
+#include <cstring>
+#include <cstdint>
 
 namespace uWS {
 
+    template <typename USERDATA> struct WebTransport;
+
     /* Is a quic stream */
     struct Http3Response {
+        friend struct Http3Context;
+    private:
+        static void gatherHeader(Http3ResponseData *responseData, std::string_view key, std::string_view value) {
+            uint32_t lengths[2] = {(uint32_t) key.length(), (uint32_t) value.length()};
+            responseData->headers.append((char *) lengths, sizeof(lengths));
+            responseData->headers.append(key.data(), key.length());
+            responseData->headers.append(value.data(), value.length());
+            responseData->headerOffset++;
+        }
+
+        /* Hands all headers gathered to lsquic as one header block, only once */
+        void sendHeaders(Http3ResponseData *responseData, bool hasBody) {
+            if (responseData->headersSent) {
+                return;
+            }
+            writeStatus("200 OK");
+
+            const char *header = responseData->headers.data();
+            for (unsigned int i = 0; i < responseData->headerOffset; i++) {
+                uint32_t lengths[2];
+                memcpy(lengths, header, sizeof(lengths));
+                header += sizeof(lengths);
+                us_quic_socket_context_set_header(nullptr, (int) i, header, (int) lengths[0], header + lengths[0], (int) lengths[1]);
+                header += lengths[0] + lengths[1];
+            }
+            us_quic_socket_context_send_headers(nullptr, (us_quic_stream_t *) this, (int) responseData->headerOffset, hasBody);
+
+            responseData->headersSent = true;
+            responseData->headers.clear();
+        }
+
+        /* Writes what the stream takes, buffers the rest */
+        void writeBody(Http3ResponseData *responseData, std::string_view data) {
+            int written = data.length() ? us_quic_stream_write((us_quic_stream_t *) this, (char *) data.data(), (int) data.length()) : 0;
+            if (written < 0) {
+                written = 0;
+            }
+            responseData->offset += (uintmax_t) written;
+            if ((size_t) written < data.length()) {
+                responseData->backpressure.append(data.data() + written, data.length() - (size_t) written);
+            }
+        }
+
+        /* Writes backpressure chunk by chunk (each chunk holds many writes) until the stream takes no more.
+         * Returns true if this shut the stream down, which happens once everything of an ended response is out */
+        bool drain(Http3ResponseData *responseData) {
+            sendHeaders(responseData, responseData->backpressure.length() > 0 || !responseData->ended);
+
+            while (responseData->backpressure.length()) {
+                std::string_view chunk = responseData->backpressure.front();
+                int written = us_quic_stream_write((us_quic_stream_t *) this, (char *) chunk.data(), (int) chunk.length());
+                if (written > 0) {
+                    responseData->backpressure.erase((size_t) written);
+                    responseData->offset += (uintmax_t) written;
+                }
+                if (written < (int) chunk.length()) {
+                    return false;
+                }
+            }
+
+            if (responseData->ended) {
+                us_quic_stream_shutdown((us_quic_stream_t *) this);
+                return true;
+            }
+            return false;
+        }
+
+        /* Sends what the handler wrote, with one header block and as few stream writes as possible */
+        void uncork() {
+            Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
+
+            /* Headers alone wait for whatever the response continues with */
+            responseData->corked = false;
+            if (responseData->backpressure.length() || responseData->ended) {
+                drain(responseData);
+            }
+        }
+
+    public:
 
         // this one is AsyncSocket, so it has to translate to the stream - abrupt stream termination
         void close() {
@@ -21,10 +109,9 @@ namespace uWS {
         Http3Response *writeStatus(std::string_view status) {
             Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
 
-            /* Nothing is done if status already written */
+            /* Nothing is done if status already written. HTTP/3 has no reason phrase, only the code */
             if (responseData->headerOffset == 0) {
-                us_quic_socket_context_set_header(nullptr, 0, (char *) ":status", 7, status.data(), status.length());
-                responseData->headerOffset = 1;
+                gatherHeader(responseData, ":status", status.substr(0, 3));
             }
 
             return this;
@@ -35,66 +122,137 @@ namespace uWS {
 
             writeStatus("200 OK");
 
-            us_quic_socket_context_set_header(nullptr, responseData->headerOffset++, key.data(), key.length(), value.data(), value.length());
+            gatherHeader(responseData, key, value);
 
             return this;
         }
 
+        /* Writes as much as possible without buffering, returns ok and whether we are done, like HttpResponse::tryEnd */
         std::pair<bool, bool> tryEnd(std::string_view data, uintmax_t totalSize = 0) {
             Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
 
-            writeStatus("200 OK");
-
-            us_quic_socket_context_send_headers(nullptr, (us_quic_stream_t *) this, responseData->headerOffset, data.length() > 0);
+            /* Corked we own the data in backpressure until the handler returns, so everything is taken */
+            if (responseData->corked || responseData->backpressure.length()) {
+                write(data);
+                if (!totalSize || responseData->offset + responseData->backpressure.length() >= totalSize) {
+                    responseData->ended = true;
+                    if (!responseData->corked) {
+                        drain(responseData);
+                    }
+                    return {true, true};
+                }
+                return {true, false};
+            }
 
+            sendHeaders(responseData, data.length() > 0 || totalSize > 0);
 
-            unsigned int written = us_quic_stream_write((us_quic_stream_t *) this, (char *) data.data(), (int) data.length());
+            int written = data.length() ? us_quic_stream_write((us_quic_stream_t *) this, (char *) data.data(), (int) data.length()) : 0;
+            if (written < 0) {
+                written = 0;
+            }
+            responseData->offset += (uintmax_t) written;
 
-            if (written == data.length()) {
+            if ((size_t) written < data.length()) {
+                return {false, false};
+            }
+            if (!totalSize || responseData->offset >= totalSize) {
+                responseData->ended = true;
+                us_quic_stream_shutdown((us_quic_stream_t *) this);
                 return {true, true};
-            } else {
-
-                responseData->offset = written;
-
-                return {true, false};
             }
-
-
-            return {true, true};
+            return {true, false};
         }
 
-        /* Idnetical */
+        /* Streams data, what the stream does not take right away is buffered and drained in order */
         Http3Response *write(std::string_view data) {
+            Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
+
+            /* Many small writes in a handler leave as one */
+            if (responseData->corked || responseData->backpressure.length()) {
+                responseData->backpressure.append(data.data(), data.length());
+                return this;
+            }
 
+            sendHeaders(responseData, true);
+            writeBody(responseData, data);
 
             return this;
         }
 
         /* Identical */
-        void end(std::string_view data = {}, bool closeConnection = false) {
-
+        void end(std::string_view data = {}, bool /*closeConnection*/ = false) {
             Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
 
-            /* If not already written */
-            writeStatus("200 OK");
-            
-            // has body is determined by the ending so this is perfect here
-            us_quic_socket_context_send_headers(nullptr, (us_quic_stream_t *) this, responseData->headerOffset, data.length() > 0);
+            responseData->ended = true;
 
-            /* Write body and shutdown (unknown if content-length must be present?) */
-            unsigned int written = us_quic_stream_write((us_quic_stream_t *) this, (char *) data.data(), (int) data.length());
+            if (responseData->corked || responseData->backpressure.length()) {
+                responseData->backpressure.append(data.data(), data.length());
+                return;
+            }
+
+            // has body is determined by the ending so this is perfect here
+            sendHeaders(responseData, data.length() > 0);
+            writeBody(responseData, data);
 
-            /* Buffer up remains */
-            if (written != data.length()) {
-                responseData->backpressure.append(data.data() + written, data.length() - written);
-            } else {
-                /* Every request has its own stream, so we conceptually serve requests like in HTTP 1.0 */
+            /* Every request has its own stream, so we conceptually serve requests like in HTTP 1.0 */
+            if (!responseData->backpressure.length()) {
                 us_quic_stream_shutdown((us_quic_stream_t *) this);
             }
         }
 
+        /* Accepts the extended CONNECT of a WebTransport session, see H3App::webtransport. The stream stays open as
+         * the session, with its capsules as body */
+        template <typename UserData>
+        WebTransport<UserData> *upgrade(UserData &&userData, WebTransportContextData<UserData> *webTransportContextData) {
+            Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
+
+            writeStatus("200 OK");
+            sendHeaders(responseData, true);
+
+            WebTransport<UserData> *webTransport = (WebTransport<UserData> *) this;
+            WebTransportSessionData<UserData> *sessionData = new WebTransportSessionData<UserData>(webTransportContextData, std::move(userData));
+            responseData->webTransport = sessionData;
+
+            responseData->onData = [webTransport, webTransportContextData](std::string_view data, bool fin) {
+                WebTransportData *webTransportData = webTransport->getWebTransportData();
+                auto result = webTransportData->parser.consume(data, webTransportContextData->maxPayloadLength, [webTransport](uint64_t type, std::string_view payload) {
+                    return webTransport->handleCapsule(type, payload);
+                });
+                if (result == webtransport::CapsuleParser::TOO_BIG) {
+                    webTransport->close();
+                } else if (fin && !webTransportData->isShuttingDown) {
+                    /* The peer ended the session without a capsule */
+                    webTransport->shutdown();
+                }
+            };
+
+            /* Every session ends here, however it was closed */
+            responseData->onAborted = [webTransport, webTransportContextData, sessionData]() {
+                sessionData->isShuttingDown = true;
+                if (webTransportContextData->closeHandler) {
+                    webTransportContextData->closeHandler(webTransport, (int) sessionData->closeCode, sessionData->closeReason);
+                }
+                if (sessionData->subscriber) {
+                    webTransportContextData->topicTree->freeSubscriber(sessionData->subscriber);
+                }
+                ((Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) webTransport))->webTransport = nullptr;
+                delete sessionData;
+            };
+
+            if (webTransportContextData->openHandler) {
+                webTransportContextData->openHandler(webTransport);
+            }
+            return webTransport;
+        }
+
+        uintmax_t getWriteOffset() {
+            Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
+
+            return responseData->offset;
+        }
+
         /* Attach handler for aborted HTTP request */
-        Http3Response *onAborted(MoveOnlyFunction<void()> &&handler) {
+        Http3Response *onAborted(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
             Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
 
             responseData->onAborted = std::move(handler);
@@ -102,14 +260,14 @@ namespace uWS {
         }
 
         /* Attach a read handler for data sent. Will be called with FIN set true if last segment. */
-        Http3Response *onData(MoveOnlyFunction<void(std::string_view, bool)> &&handler) {
+        Http3Response *onData(MoveOnlyFunction<void(std::string_view, bool), CALLBACK_INLINE_SIZE> &&handler) {
             Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
 
             responseData->onData = std::move(handler);
             return this;
         }
 
-        Http3Response *onWritable(MoveOnlyFunction<bool(uintmax_t)> &&handler) {
+        Http3Response *onWritable(MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> &&handler) {
             Http3ResponseData *responseData = (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
 
             responseData->onWritable = std::move(handler);
@@ -117,4 +275,6 @@ namespace uWS {
         }
     };
 
-}
\ No newline at end of file
+}
+
+#endif
@@ -3,22 +3,37 @@
 
 #include "MoveOnlyFunction.h"
 #include "AsyncSocketData.h"
+#include "WebTransportData.h"
 #include <string_view>
+#include <string>
 
 namespace uWS {
     struct Http3ResponseData {
 
-        MoveOnlyFunction<void()> onAborted = nullptr;
-        MoveOnlyFunction<void(std::string_view, bool)> onData = nullptr;
-        MoveOnlyFunction<bool(uintmax_t)> onWritable = nullptr;
+        MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> onAborted = nullptr;
+        MoveOnlyFunction<void(std::string_view, bool), CALLBACK_INLINE_SIZE> onData = nullptr;
+        MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> onWritable = nullptr;
 
-        /* Status is always first header just like for h1 */
+        /* Status is always first header just like for h1, this counts the headers gathered so far */
         unsigned int headerOffset = 0;
-        
+
+        /* Headers are gathered here and go to lsquic as one header block, together with the first body data
+         * (or the end). Each is the 4 byte lengths of name and value followed by name and value */
+        std::string headers;
+        bool headersSent = false;
+
+        /* While the handler runs we are corked, and everything written goes out in one go when it returns */
+        bool corked = false;
+        /* end was called, shutdown follows once backpressure is drained */
+        bool ended = false;
+
         /* Write offset */
         uintmax_t offset = 0;
 
         BackPressure backpressure;
+
+        /* Set once upgraded to a WebTransport session */
+        WebTransportData *webTransport = nullptr;
     };
 }
 
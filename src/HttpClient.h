@@ -0,0 +1,572 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTPCLIENT_H
+#define UWS_HTTPCLIENT_H
+
+/* HTTP/1.1 clients living on the loop of the app, so that calling an upstream from a handler costs a socket,
+ * not a thread. Every host gets a pool of keep-alive connections, opened as requests queue up and reused
+ * (or pipelined onto once the pool is full) for the ones after. Responses are parsed by the HttpResponseParser,
+ * which shares header scanning and chunked decoding with the HttpParser of the server, and are handed over
+ * whole to a MoveOnlyFunction, or to a coroutine awaiting fetch. TLS is the SSL template of the same
+ * us_socket_context, configured by SocketContextOptions like that of SSLApp. */
+
+#include "App.h"
+#include "HttpParser.h"
+#include "Coroutine.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <charconv>
+#include <initializer_list>
+
+namespace uWS {
+
+struct HttpClientResponse {
+    enum Error {
+        NONE,
+        INVALID_URL,
+        /* No connection to the host could be made */
+        CONNECT_FAILED,
+        /* The connection closed before the response was complete (idempotent requests were retried once) */
+        CONNECTION_CLOSED,
+        TIMEOUT,
+        INVALID_RESPONSE,
+        RESPONSE_TOO_LARGE
+    };
+
+    Error error = NONE;
+    unsigned int status = 0;
+    /* Lower cased names */
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+
+    std::string_view getHeader(std::string_view lowerCasedHeader) {
+        for (auto &[key, value] : headers) {
+            if (key == lowerCasedHeader) {
+                return value;
+            }
+        }
+        return std::string_view(nullptr, 0);
+    }
+};
+
+struct HttpClientOptions {
+    /* Connections open (or opening) to one host:port at most */
+    unsigned int maxConnectionsPerHost = 6;
+    /* Idempotent requests sent ahead on a busy connection once the pool is full, 1 disables pipelining */
+    unsigned int maxPipelinedRequests = 4;
+    /* Seconds an unused connection stays in the pool */
+    unsigned short idleTimeout = 30;
+    /* Seconds to connect, and for a response to come once asked for */
+    unsigned short requestTimeout = 30;
+    /* Largest body we buffer */
+    size_t maxResponseSize = 16 * 1024 * 1024;
+};
+
+template <bool SSL>
+struct TemplatedHttpClient {
+private:
+    struct ClientContextData;
+
+    struct Request {
+        std::string data;
+        /* Responses to HEAD have no body */
+        bool head;
+        /* RFC 9110 9.2.2, only these are pipelined and retried */
+        bool idempotent;
+        bool retried = false;
+        MoveOnlyFunction<void(HttpClientResponse &)> handler;
+        HttpClientResponse response = {};
+    };
+
+    struct Host {
+        ClientContextData *clientContextData;
+        std::string host;
+        int port;
+        /* Open and connecting sockets */
+        std::vector<us_socket_t *> connections;
+        std::deque<std::unique_ptr<Request>> queue;
+    };
+
+    /* Ext of sockets, first the AsyncSocketData so that AsyncSocket can write with backpressure */
+    struct ConnectionData : AsyncSocketData<SSL> {
+        Host *host;
+        HttpResponseParser parser;
+        /* Sent and waiting for their response, in order */
+        std::deque<std::unique_ptr<Request>> inFlight;
+        bool open = false;
+        bool keepAlive = true;
+    };
+
+    /* Ext of the socket context */
+    struct ClientContextData {
+        HttpClientOptions options;
+        /* By host:port */
+        std::unordered_map<std::string, std::unique_ptr<Host>> hosts;
+        bool closing = false;
+    };
+
+    us_socket_context_t *socketContext = nullptr;
+
+    ClientContextData *getClientContextData() {
+        return (ClientContextData *) us_socket_context_ext(SSL, socketContext);
+    }
+
+    /* Splits http://host:port/path (https:// for SSL) into the host, port and what goes in the request */
+    static bool parseUrl(std::string_view url, std::string &host, int &port, std::string_view &authority, std::string_view &path) {
+        std::string_view scheme = SSL ? "https://" : "http://";
+        if (url.substr(0, scheme.length()) != scheme) {
+            return false;
+        }
+        url.remove_prefix(scheme.length());
+
+        size_t pathStart = url.find_first_of("/?");
+        path = pathStart == std::string_view::npos ? "/" : url.substr(pathStart);
+        authority = url.substr(0, pathStart);
+
+        /* IPv6 addresses come in brackets */
+        std::string_view hostname = authority;
+        size_t portStart = authority.rfind(':');
+        if (portStart != std::string_view::npos && authority.find(']', portStart) == std::string_view::npos) {
+            port = 0;
+            auto [ptr, ec] = std::from_chars(authority.data() + portStart + 1, authority.data() + authority.length(), port);
+            if (ec != std::errc() || ptr != authority.data() + authority.length() || port <= 0 || port > 65535) {
+                return false;
+            }
+            hostname = authority.substr(0, portStart);
+        } else {
+            port = SSL ? 443 : 80;
+        }
+        if (hostname.length() > 2 && hostname.front() == '[' && hostname.back() == ']') {
+            hostname = hostname.substr(1, hostname.length() - 2);
+        }
+        host = std::string(hostname);
+        return host.length() && path.front() != '?';
+    }
+
+    static bool equalsLowerCased(std::string_view value, std::string_view lowerCased) {
+        if (value.length() != lowerCased.length()) {
+            return false;
+        }
+        for (size_t i = 0; i < value.length(); i++) {
+            if ((value[i] | 0x20) != lowerCased[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void complete(std::unique_ptr<Request> request, HttpClientResponse::Error error = HttpClientResponse::NONE) {
+        if (error != HttpClientResponse::NONE) {
+            request->response.error = error;
+        }
+        request->handler(request->response);
+    }
+
+    /* Sends what is queued for the host. An idle connection goes first, then a new one while the pool is not
+     * full, and only then does an idempotent request go behind other idempotent ones on the least busy connection */
+    static void dispatch(us_socket_context_t *socketContext, Host *host) {
+        ClientContextData *clientContextData = (ClientContextData *) us_socket_context_ext(SSL, socketContext);
+        HttpClientOptions &options = clientContextData->options;
+
+        while (host->queue.size() && !clientContextData->closing) {
+            Request *request = host->queue.front().get();
+
+            us_socket_t *idle = nullptr, *leastBusy = nullptr;
+            size_t connecting = 0, leastInFlight = options.maxPipelinedRequests;
+            for (us_socket_t *s : host->connections) {
+                ConnectionData *connectionData = (ConnectionData *) us_socket_ext(SSL, s);
+                if (!connectionData->open) {
+                    connecting++;
+                } else if (connectionData->keepAlive) {
+                    if (connectionData->inFlight.empty()) {
+                        idle = s;
+                        break;
+                    }
+                    if (request->idempotent && connectionData->inFlight.back()->idempotent && connectionData->inFlight.size() < leastInFlight) {
+                        leastBusy = s;
+                        leastInFlight = connectionData->inFlight.size();
+                    }
+                }
+            }
+
+            if (!idle && host->connections.size() < options.maxConnectionsPerHost) {
+                /* What is already connecting will take the queue, until there is more queued than connecting */
+                if (connecting < host->queue.size()) {
+                    us_socket_t *s = us_socket_context_connect(SSL, socketContext, host->host.c_str(), host->port, nullptr, 0, sizeof(ConnectionData));
+                    if (s) {
+                        ConnectionData *connectionData = new (us_socket_ext(SSL, s)) ConnectionData;
+                        connectionData->host = host;
+                        host->connections.push_back(s);
+                        us_socket_timeout(SSL, s, options.requestTimeout);
+                        continue;
+                    }
+                    /* Nothing there to ever take the queue */
+                    if (host->connections.empty()) {
+                        failQueue(host, HttpClientResponse::CONNECT_FAILED);
+                    }
+                }
+                return;
+            }
+
+            us_socket_t *s = idle ? idle : leastBusy;
+            if (!s) {
+                return;
+            }
+            send(s, std::move(host->queue.front()));
+            host->queue.pop_front();
+        }
+    }
+
+    static void send(us_socket_t *s, std::unique_ptr<Request> request) {
+        ConnectionData *connectionData = (ConnectionData *) us_socket_ext(SSL, s);
+        if (connectionData->inFlight.empty()) {
+            us_socket_timeout(SSL, s, connectionData->host->clientContextData->options.requestTimeout);
+        }
+        connectionData->inFlight.push_back(std::move(request));
+        std::string &data = connectionData->inFlight.back()->data;
+        ((AsyncSocket<SSL> *) s)->write(data.data(), (int) data.length());
+    }
+
+    static void failQueue(Host *host, HttpClientResponse::Error error) {
+        /* Handlers may queue more, which fail along */
+        while (host->queue.size()) {
+            std::unique_ptr<Request> request = std::move(host->queue.front());
+            host->queue.pop_front();
+            complete(std::move(request), error);
+        }
+    }
+
+    /* The socket is gone, what was sent on it is retried or failed and the connection leaves the pool */
+    static void closed(us_socket_t *s) {
+        ConnectionData *connectionData = (ConnectionData *) us_socket_ext(SSL, s);
+        Host *host = connectionData->host;
+        bool opened = connectionData->open;
+        std::erase(host->connections, s);
+
+        std::vector<std::unique_ptr<Request>> failed;
+        if (connectionData->inFlight.size() && connectionData->parser.end()) {
+            failed.push_back(std::move(connectionData->inFlight.front()));
+            connectionData->inFlight.pop_front();
+        }
+        bool bodyUntilClose = failed.size();
+
+        /* Requests we never saw a response to go first again, unless we tried them twice now */
+        while (connectionData->inFlight.size()) {
+            std::unique_ptr<Request> request = std::move(connectionData->inFlight.back());
+            connectionData->inFlight.pop_back();
+            if (request->idempotent && !request->retried && !host->clientContextData->closing) {
+                request->retried = true;
+                request->response = {};
+                host->queue.push_front(std::move(request));
+            } else {
+                failed.push_back(std::move(request));
+            }
+        }
+        connectionData->~ConnectionData();
+
+        for (size_t i = 0; i < failed.size(); i++) {
+            complete(std::move(failed[i]), i == 0 && bodyUntilClose ? HttpClientResponse::NONE : HttpClientResponse::CONNECTION_CLOSED);
+        }
+
+        /* Nobody left to take the queue, and nothing was ever reached. Closing fails the queue by itself */
+        if (!host->clientContextData->closing) {
+            if (!opened && host->connections.empty()) {
+                failQueue(host, HttpClientResponse::CONNECT_FAILED);
+            }
+            dispatch(us_socket_context(SSL, s), host);
+        }
+    }
+
+    void init(HttpClientOptions options) {
+        ClientContextData *clientContextData = new (getClientContextData()) ClientContextData;
+        options.maxConnectionsPerHost = std::max(options.maxConnectionsPerHost, 1u);
+        options.maxPipelinedRequests = std::max(options.maxPipelinedRequests, 1u);
+        clientContextData->options = options;
+
+        us_socket_context_on_open(SSL, socketContext, [](us_socket_t *s, int /*isClient*/, char */*ip*/, int /*ipLength*/) {
+            ConnectionData *connectionData = (ConnectionData *) us_socket_ext(SSL, s);
+            ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_add(1, std::memory_order_relaxed);
+
+            connectionData->open = true;
+            us_socket_timeout(SSL, s, connectionData->host->clientContextData->options.idleTimeout);
+            dispatch(us_socket_context(SSL, s), connectionData->host);
+            return s;
+        });
+
+        us_socket_context_on_data(SSL, socketContext, [](us_socket_t *s, char *data, int length) {
+            ConnectionData *connectionData = (ConnectionData *) us_socket_ext(SSL, s);
+            Host *host = connectionData->host;
+            HttpClientOptions &options = host->clientContextData->options;
+
+            /* Handlers run once we are done with the socket, they may well close it (or the whole client) */
+            std::vector<std::unique_ptr<Request>> completed;
+            bool valid = connectionData->parser.consume(data, (unsigned int) length, [connectionData](HttpResponseHead &head) {
+                /* Nothing was asked for */
+                if (connectionData->inFlight.empty()) {
+                    return HttpResponseParser::STOP;
+                }
+                Request *request = connectionData->inFlight.front().get();
+                request->response.status = head.status;
+                for (HttpRequest::Header *h = head.headers; h->key.length(); h++) {
+                    request->response.headers.emplace_back(h->key, h->value);
+                }
+
+                /* HTTP/1.0 closes unless it says otherwise, HTTP/1.1 the other way around */
+                std::string_view connection = head.getHeader("connection");
+                if (head.ancient ? !equalsLowerCased(connection, "keep-alive") : equalsLowerCased(connection, "close")) {
+                    connectionData->keepAlive = false;
+                }
+                /* We never ask to switch protocols */
+                if (head.status == 101) {
+                    connectionData->keepAlive = false;
+                }
+                return request->head ? HttpResponseParser::NO_BODY : HttpResponseParser::READ_BODY;
+            }, [connectionData, &completed, &options](std::string_view chunk, bool fin) {
+                Request *request = connectionData->inFlight.front().get();
+                if (request->response.body.length() + chunk.length() > options.maxResponseSize) {
+                    request->response.error = HttpClientResponse::RESPONSE_TOO_LARGE;
+                    return false;
+                }
+                request->response.body.append(chunk);
+                if (fin) {
+                    completed.push_back(std::move(connectionData->inFlight.front()));
+                    connectionData->inFlight.pop_front();
+                }
+                return true;
+            });
+
+            if (!valid) {
+                if (connectionData->inFlight.size()) {
+                    std::unique_ptr<Request> request = std::move(connectionData->inFlight.front());
+                    connectionData->inFlight.pop_front();
+                    if (request->response.error == HttpClientResponse::NONE) {
+                        request->response.error = HttpClientResponse::INVALID_RESPONSE;
+                    }
+                    completed.push_back(std::move(request));
+                }
+                s = us_socket_close(SSL, s, 0, nullptr);
+            } else if (completed.size()) {
+                if (!connectionData->keepAlive && connectionData->inFlight.empty()) {
+                    s = us_socket_close(SSL, s, 0, nullptr);
+                } else {
+                    us_socket_timeout(SSL, s, connectionData->inFlight.size() ? options.requestTimeout : options.idleTimeout);
+                }
+            }
+
+            /* The socket may be gone after any of these, or closing the client */
+            us_socket_context_t *context = us_socket_context(SSL, s);
+            for (std::unique_ptr<Request> &request : completed) {
+                complete(std::move(request));
+            }
+            if (completed.size() && !host->clientContextData->closing) {
+                dispatch(context, host);
+            }
+            return s;
+        });
+
+        us_socket_context_on_close(SSL, socketContext, [](us_socket_t *s, int /*code*/, void */*reason*/) {
+            /* Connecting sockets we gave up on close too */
+            if (((ConnectionData *) us_socket_ext(SSL, s))->open) {
+                ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_sub(1, std::memory_order_relaxed);
+            }
+            closed(s);
+            return s;
+        });
+
+        /* Connecting sockets never opened, so there is no close */
+        us_socket_context_on_connect_error(SSL, socketContext, [](us_socket_t *s, int /*code*/) {
+            closed(s);
+            return s;
+        });
+
+        /* Waited too long for a connection or response, or an idle connection expired */
+        us_socket_context_on_timeout(SSL, socketContext, [](us_socket_t *s) {
+            ConnectionData *connectionData = (ConnectionData *) us_socket_ext(SSL, s);
+            std::unique_ptr<Request> request;
+            if (connectionData->inFlight.size()) {
+                request = std::move(connectionData->inFlight.front());
+                connectionData->inFlight.pop_front();
+            }
+            s = us_socket_close(SSL, s, 0, nullptr);
+            if (request) {
+                complete(std::move(request), HttpClientResponse::TIMEOUT);
+            }
+            return s;
+        });
+
+        us_socket_context_on_end(SSL, socketContext, [](us_socket_t *s) {
+            return us_socket_close(SSL, s, 0, nullptr);
+        });
+
+        us_socket_context_on_writable(SSL, socketContext, [](us_socket_t *s) {
+            /* Drain the backpressure of requests */
+            ((AsyncSocket<SSL> *) s)->write(nullptr, 0, true, 0);
+            return s;
+        });
+    }
+
+public:
+    TemplatedHttpClient(HttpClientOptions options = {}, SocketContextOptions socketContextOptions = {}) {
+        socketContext = us_create_socket_context(SSL, (us_loop_t *) Loop::get(), sizeof(ClientContextData), socketContextOptions);
+        if (socketContext) {
+            init(options);
+        }
+    }
+
+    ~TemplatedHttpClient() {
+        if (socketContext) {
+            close();
+            getClientContextData()->~ClientContextData();
+            us_socket_context_free(SSL, socketContext);
+        }
+    }
+
+    /* Disallow copying, only move */
+    TemplatedHttpClient(const TemplatedHttpClient &other) = delete;
+
+    TemplatedHttpClient(TemplatedHttpClient &&other) {
+        socketContext = other.socketContext;
+        other.socketContext = nullptr;
+    }
+
+    bool constructorFailed() {
+        return !socketContext;
+    }
+
+    /* Sends method to url (http://host:port/path, https:// for SSLHttpClient) with extra headers and a body,
+     * calling handler with the response, or an error, exactly once. Host and Content-Length are added for you */
+    TemplatedHttpClient &&request(std::string_view method, std::string_view url, MoveOnlyFunction<void(HttpClientResponse &)> &&handler,
+                                  std::string_view body = {}, std::initializer_list<std::pair<std::string_view, std::string_view>> headers = {}) {
+        std::unique_ptr<Request> request(new Request{{}, method == "HEAD",
+            method == "GET" || method == "HEAD" || method == "OPTIONS" || method == "TRACE" || method == "PUT" || method == "DELETE",
+            false, std::move(handler)});
+
+        std::string host;
+        int port;
+        std::string_view authority, path;
+        if (!socketContext || getClientContextData()->closing) {
+            complete(std::move(request), HttpClientResponse::CONNECTION_CLOSED);
+            return std::move(*this);
+        }
+        if (!parseUrl(url, host, port, authority, path)) {
+            complete(std::move(request), HttpClientResponse::INVALID_URL);
+            return std::move(*this);
+        }
+
+        std::string &data = request->data;
+        data.reserve(method.length() + path.length() + authority.length() + body.length() + 64);
+        data.append(method).append(" ").append(path).append(" HTTP/1.1\r\nHost: ").append(authority).append("\r\n");
+        for (auto &[key, value] : headers) {
+            data.append(key).append(": ").append(value).append("\r\n");
+        }
+        if (body.length() || method == "POST" || method == "PUT" || method == "PATCH") {
+            data.append("Content-Length: ").append(std::to_string(body.length())).append("\r\n");
+        }
+        data.append("\r\n").append(body);
+
+        ClientContextData *clientContextData = getClientContextData();
+        std::unique_ptr<Host> &entry = clientContextData->hosts[host + ":" + std::to_string(port)];
+        if (!entry) {
+            entry.reset(new Host{clientContextData, std::move(host), port, {}, {}});
+        }
+        entry->queue.push_back(std::move(request));
+        dispatch(socketContext, entry.get());
+        return std::move(*this);
+    }
+
+    TemplatedHttpClient &&get(std::string_view url, MoveOnlyFunction<void(HttpClientResponse &)> &&handler, std::initializer_list<std::pair<std::string_view, std::string_view>> headers = {}) {
+        return request("GET", url, std::move(handler), {}, headers);
+    }
+
+    TemplatedHttpClient &&post(std::string_view url, std::string_view body, MoveOnlyFunction<void(HttpClientResponse &)> &&handler, std::initializer_list<std::pair<std::string_view, std::string_view>> headers = {}) {
+        return request("POST", url, std::move(handler), body, headers);
+    }
+
+#ifdef UWS_HAS_COROUTINES
+    /* Awaits the response of a request, which holds the error if there is no response */
+    struct ResponseAwaiter {
+        TemplatedHttpClient *client;
+        std::string_view method, url, body;
+        std::initializer_list<std::pair<std::string_view, std::string_view>> headers;
+        HttpClientResponse response = {};
+        std::coroutine_handle<> handle = nullptr;
+        bool done = false;
+
+        bool await_ready() {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> h) {
+            client->request(method, url, [this](HttpClientResponse &r) {
+                response = std::move(r);
+                done = true;
+                if (handle) {
+                    handle.resume();
+                }
+            }, body, headers);
+
+            /* Failed right away, so we go on without suspending */
+            if (done) {
+                return false;
+            }
+            handle = h;
+            return true;
+        }
+
+        HttpClientResponse await_resume() {
+            return std::move(response);
+        }
+    };
+
+    /* Everything viewed must stay valid until the request is sent, which it is before the first suspension */
+    ResponseAwaiter fetch(std::string_view method, std::string_view url, std::string_view body = {}, std::initializer_list<std::pair<std::string_view, std::string_view>> headers = {}) {
+        return {this, method, url, body, headers};
+    }
+#endif
+
+    /* Closes every connection, failing what was asked for and not yet answered */
+    TemplatedHttpClient &&close() {
+        if (socketContext) {
+            ClientContextData *clientContextData = getClientContextData();
+            if (!clientContextData->closing) {
+                clientContextData->closing = true;
+                us_socket_context_close(SSL, socketContext);
+                for (auto &[key, host] : clientContextData->hosts) {
+                    failQueue(host.get(), HttpClientResponse::CONNECTION_CLOSED);
+                }
+            }
+        }
+        return std::move(*this);
+    }
+
+    Loop *getLoop() {
+        return (Loop *) us_socket_context_loop(SSL, socketContext);
+    }
+};
+
+typedef TemplatedHttpClient<false> HttpClient;
+typedef TemplatedHttpClient<true> SSLHttpClient;
+
+}
+
+#endif // UWS_HTTPCLIENT_H
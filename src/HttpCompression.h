@@ -0,0 +1,348 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTPCOMPRESSION_H
+#define UWS_HTTPCOMPRESSION_H
+
+/* Compression of HTTP bodies (Content-Encoding), negotiated by Accept-Encoding. Gzip and deflate come with zlib,
+ * brotli and zstd are built in with WITH_BROTLI and WITH_ZSTD */
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+#include <zlib.h>
+#endif
+
+#ifdef UWS_WITH_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#ifdef UWS_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace uWS {
+
+enum ContentEncoding : unsigned char {
+    IDENTITY,
+    GZIP,
+    DEFLATE,
+    BROTLI,
+    ZSTD,
+    NUM_CONTENT_ENCODINGS
+};
+
+/* As sent in Content-Encoding */
+static constexpr std::string_view CONTENT_ENCODING_NAMES[NUM_CONTENT_ENCODINGS] = {"identity", "gzip", "deflate", "br", "zstd"};
+
+/* Bit mask of the encodings this build can compress with */
+static constexpr unsigned int AVAILABLE_CONTENT_ENCODINGS = 0
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+    | 1u << GZIP | 1u << DEFLATE
+#endif
+#ifdef UWS_WITH_BROTLI
+    | 1u << BROTLI
+#endif
+#ifdef UWS_WITH_ZSTD
+    | 1u << ZSTD
+#endif
+    ;
+
+struct HttpCompressionOptions {
+    /* Smaller bodies are sent as they are, what compression saves on them is less than what it costs */
+    unsigned int minSize = 1024;
+    /* 1 (fastest) to 9 (smallest) for gzip and deflate. Brotli takes it as quality (up to 11), zstd as level (up to 22) */
+    int level = 6;
+    /* Bit mask (1 << ContentEncoding) of what to offer, of what is built in */
+    unsigned int encodings = AVAILABLE_CONTENT_ENCODINGS;
+};
+
+/* Picks what to compress with by the q-values of Accept-Encoding, then by our preference of brotli, zstd, gzip
+ * and deflate. IDENTITY if nothing offered is acceptable */
+static inline ContentEncoding negotiateContentEncoding(std::string_view acceptEncoding, unsigned int offered) {
+    /* Thousandths, -1 is not mentioned */
+    int q[NUM_CONTENT_ENCODINGS] = {-1, -1, -1, -1, -1};
+    int wildcard = -1;
+
+    auto trim = [](std::string_view s) {
+        while (s.length() && (s.front() == ' ' || s.front() == '\t')) {
+            s.remove_prefix(1);
+        }
+        while (s.length() && (s.back() == ' ' || s.back() == '\t')) {
+            s.remove_suffix(1);
+        }
+        return s;
+    };
+
+    auto equalsLowerCase = [](std::string_view s, std::string_view lowerCase) {
+        return s.length() == lowerCase.length() && std::equal(s.begin(), s.end(), lowerCase.begin(), [](char a, char b) {
+            return (a | 0x20) == b;
+        });
+    };
+
+    while (acceptEncoding.length()) {
+        size_t comma = acceptEncoding.find(',');
+        std::string_view item = acceptEncoding.substr(0, comma);
+        acceptEncoding.remove_prefix(comma == std::string_view::npos ? acceptEncoding.length() : comma + 1);
+
+        size_t semicolon = item.find(';');
+        std::string_view name = trim(item.substr(0, semicolon));
+
+        /* A missing or broken q-value counts as 1 */
+        int value = 1000;
+        if (semicolon != std::string_view::npos) {
+            std::string_view parameter = trim(item.substr(semicolon + 1));
+            if (parameter.length() >= 3 && (parameter[0] | 0x20) == 'q' && parameter[1] == '=' && parameter[2] == '0') {
+                value = 0;
+                for (size_t i = 4, scale = 100; i < parameter.length() && i < 7 && parameter[3] == '.'; i++, scale /= 10) {
+                    if (parameter[i] < '0' || parameter[i] > '9') {
+                        break;
+                    }
+                    value += (parameter[i] - '0') * (int) scale;
+                }
+            }
+        }
+
+        if (equalsLowerCase(name, "gzip") || equalsLowerCase(name, "x-gzip")) {
+            q[GZIP] = value;
+        } else if (equalsLowerCase(name, "deflate")) {
+            q[DEFLATE] = value;
+        } else if (equalsLowerCase(name, "br")) {
+            q[BROTLI] = value;
+        } else if (equalsLowerCase(name, "zstd")) {
+            q[ZSTD] = value;
+        } else if (name == "*") {
+            wildcard = value;
+        }
+    }
+
+    static constexpr ContentEncoding preference[] = {BROTLI, ZSTD, GZIP, DEFLATE};
+    ContentEncoding best = IDENTITY;
+    int bestQ = 0;
+    for (ContentEncoding encoding : preference) {
+        if (!(offered & AVAILABLE_CONTENT_ENCODINGS & (1u << encoding))) {
+            continue;
+        }
+        int value = q[encoding] != -1 ? q[encoding] : wildcard;
+        if (value > bestQ) {
+            best = encoding;
+            bestQ = value;
+        }
+    }
+    return best;
+}
+
+/* Compresses one body, all at once or as a stream of writes. The loop keeps one per encoding for whole bodies,
+ * streamed responses get their own */
+struct HttpCompressor {
+private:
+    ContentEncoding encoding;
+    int level;
+
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+    z_stream zlibStream = {};
+#endif
+#ifdef UWS_WITH_BROTLI
+    BrotliEncoderState *brotliState = nullptr;
+#endif
+#ifdef UWS_WITH_ZSTD
+    ZSTD_CCtx *zstdContext = nullptr;
+#endif
+
+    /* Output of the last compress, reused */
+    std::string buffer;
+
+    /* Makes room for at least this many more bytes after length, returns where they start */
+    char *reserve(size_t length, size_t more) {
+        if (buffer.length() < length + more) {
+            buffer.resize(std::max(length + more, buffer.length() * 2));
+        }
+        return buffer.data() + length;
+    }
+
+#ifdef UWS_WITH_BROTLI
+    void createBrotli() {
+        brotliState = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+        BrotliEncoderSetParameter(brotliState, BROTLI_PARAM_QUALITY, (uint32_t) std::clamp(level, BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY));
+    }
+#endif
+
+public:
+    HttpCompressor(ContentEncoding encoding, int level) : encoding(encoding), level(level) {
+        switch (encoding) {
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+        case GZIP:
+        case DEFLATE:
+            /* 16 more window bits make zlib write the gzip wrapper instead of its own */
+            deflateInit2(&zlibStream, std::clamp(level, 1, 9), Z_DEFLATED, encoding == GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+            break;
+#endif
+#ifdef UWS_WITH_BROTLI
+        case BROTLI:
+            createBrotli();
+            break;
+#endif
+#ifdef UWS_WITH_ZSTD
+        case ZSTD:
+            zstdContext = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(zstdContext, ZSTD_c_compressionLevel, std::clamp(level, 1, ZSTD_maxCLevel()));
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+
+    ~HttpCompressor() {
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+        if (encoding == GZIP || encoding == DEFLATE) {
+            deflateEnd(&zlibStream);
+        }
+#endif
+#ifdef UWS_WITH_BROTLI
+        if (brotliState) {
+            BrotliEncoderDestroyInstance(brotliState);
+        }
+#endif
+#ifdef UWS_WITH_ZSTD
+        if (zstdContext) {
+            ZSTD_freeCCtx(zstdContext);
+        }
+#endif
+    }
+
+    HttpCompressor(const HttpCompressor &) = delete;
+    HttpCompressor &operator=(const HttpCompressor &) = delete;
+
+    ContentEncoding getEncoding() {
+        return encoding;
+    }
+
+    int getLevel() {
+        return level;
+    }
+
+    /* Starts over with a new body */
+    void reset() {
+        switch (encoding) {
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+        case GZIP:
+        case DEFLATE:
+            deflateReset(&zlibStream);
+            break;
+#endif
+#ifdef UWS_WITH_BROTLI
+        case BROTLI:
+            /* Brotli has no reset */
+            BrotliEncoderDestroyInstance(brotliState);
+            createBrotli();
+            break;
+#endif
+#ifdef UWS_WITH_ZSTD
+        case ZSTD:
+            ZSTD_CCtx_reset(zstdContext, ZSTD_reset_session_only);
+            break;
+#endif
+        default:
+            break;
+        }
+    }
+
+    /* Compresses data and flushes, so that the peer can decode everything so far. Finish ends the body.
+     * What is returned is valid until the next call */
+    std::string_view compress(std::string_view data, bool finish) {
+        size_t length = 0;
+
+        switch (encoding) {
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+        case GZIP:
+        case DEFLATE: {
+            zlibStream.next_in = (Bytef *) data.data();
+            zlibStream.avail_in = (unsigned int) data.length();
+            size_t bound = deflateBound(&zlibStream, (uLong) data.length()) + 16;
+            while (true) {
+                zlibStream.next_out = (Bytef *) reserve(length, bound);
+                zlibStream.avail_out = (unsigned int) (buffer.length() - length);
+                int err = deflate(&zlibStream, finish ? Z_FINISH : Z_SYNC_FLUSH);
+                length = buffer.length() - zlibStream.avail_out;
+                if (finish ? err == Z_STREAM_END : zlibStream.avail_out != 0) {
+                    break;
+                }
+                if (err != Z_OK && err != Z_BUF_ERROR) {
+                    return {};
+                }
+                bound = 4096;
+            }
+            break;
+        }
+#endif
+#ifdef UWS_WITH_BROTLI
+        case BROTLI: {
+            size_t availableIn = data.length();
+            const uint8_t *nextIn = (const uint8_t *) data.data();
+            size_t bound = BrotliEncoderMaxCompressedSize(data.length()) + 16;
+            while (true) {
+                uint8_t *nextOut = (uint8_t *) reserve(length, bound);
+                size_t availableOut = buffer.length() - length;
+                if (!BrotliEncoderCompressStream(brotliState, finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH,
+                    &availableIn, &nextIn, &availableOut, &nextOut, nullptr)) {
+                    return {};
+                }
+                length = buffer.length() - availableOut;
+                if (!availableIn && !BrotliEncoderHasMoreOutput(brotliState) && (!finish || BrotliEncoderIsFinished(brotliState))) {
+                    break;
+                }
+                bound = 4096;
+            }
+            break;
+        }
+#endif
+#ifdef UWS_WITH_ZSTD
+        case ZSTD: {
+            ZSTD_inBuffer input = {data.data(), data.length(), 0};
+            size_t bound = ZSTD_compressBound(data.length()) + 16;
+            while (true) {
+                reserve(length, bound);
+                ZSTD_outBuffer output = {buffer.data(), buffer.length(), length};
+                size_t remaining = ZSTD_compressStream2(zstdContext, &output, &input, finish ? ZSTD_e_end : ZSTD_e_flush);
+                if (ZSTD_isError(remaining)) {
+                    return {};
+                }
+                length = output.pos;
+                if (!remaining) {
+                    break;
+                }
+                bound = 4096;
+            }
+            break;
+        }
+#endif
+        default:
+            /* Nothing is built in, we are never made */
+            (void) finish;
+            return data;
+        }
+
+        return {buffer.data(), length};
+    }
+};
+
+}
+
+#endif // UWS_HTTPCOMPRESSION_H
@@ -25,6 +25,7 @@
 #include "HttpResponseData.h"
 #include "AsyncSocket.h"
 #include "WebSocketData.h"
+#include "Probes.h"
 
 #include <string_view>
 #include <iostream>
@@ -33,6 +34,10 @@
 namespace uWS {
 template<bool> struct HttpResponse;
 
+/* We parse in place whatever uSockets reads into, whichever backend reads it, so every such buffer must be padded for
+ * the parser to write past the end */
+static_assert(LIBUS_RECV_BUFFER_PADDING >= MINIMUM_HTTP_POST_PADDING, "uSockets must pad receive buffers for HttpParser");
+
 template <bool SSL>
 struct HttpContext {
     template<bool> friend struct TemplatedApp;
@@ -66,18 +71,95 @@ private:
         return (HttpContextData<SSL> *) us_socket_context_ext(SSL, getSocketContext(s));
     }
 
+    /* Counts the TLS handshake of a socket just accepted, or pauses the socket in line for one if the loop
+     * already has maxTlsHandshakes in progress */
+    static void beginTlsHandshake(us_socket_t *s) {
+        HttpResponseData<SSL> *httpResponseData = (HttpResponseData<SSL> *) us_socket_ext(SSL, s);
+        LoopData *loopData = ((AsyncSocket<SSL> *) s)->getLoopData();
+        if (loopData->maxTlsHandshakes && loopData->tlsHandshakes >= loopData->maxTlsHandshakes) {
+            ((AsyncSocket<SSL> *) s)->pause();
+            httpResponseData->tlsHandshake = HttpResponseData<SSL>::TLS_HANDSHAKE_WAITING;
+            httpResponseData->tlsHandshakeTicket = loopData->tlsHandshakeQueueFront + (unsigned int) loopData->tlsHandshakeQueue.size();
+            loopData->tlsHandshakeQueue.push_back(s);
+            UWS_METRIC(loopData, tlsHandshakesQueued, 1);
+            return;
+        }
+        httpResponseData->tlsHandshake = HttpResponseData<SSL>::TLS_HANDSHAKE_RUNNING;
+        loopData->tlsHandshakes++;
+    }
+
+    /* On the first data (which only comes after the handshake) and on close. Leaves the line, or makes room for
+     * the sockets waiting in it and resumes them */
+    static void endTlsHandshake(us_socket_t *s) {
+        HttpResponseData<SSL> *httpResponseData = (HttpResponseData<SSL> *) us_socket_ext(SSL, s);
+        if (httpResponseData->tlsHandshake == HttpResponseData<SSL>::TLS_HANDSHAKE_NONE) {
+            return;
+        }
+        LoopData *loopData = ((AsyncSocket<SSL> *) s)->getLoopData();
+        if (httpResponseData->tlsHandshake == HttpResponseData<SSL>::TLS_HANDSHAKE_WAITING) {
+            loopData->tlsHandshakeQueue[httpResponseData->tlsHandshakeTicket - loopData->tlsHandshakeQueueFront] = nullptr;
+        } else {
+            loopData->tlsHandshakes--;
+        }
+        httpResponseData->tlsHandshake = HttpResponseData<SSL>::TLS_HANDSHAKE_NONE;
+
+        while (loopData->tlsHandshakeQueue.size() && (!loopData->maxTlsHandshakes || loopData->tlsHandshakes < loopData->maxTlsHandshakes)) {
+            us_socket_t *next = (us_socket_t *) loopData->tlsHandshakeQueue.front();
+            loopData->tlsHandshakeQueue.pop_front();
+            loopData->tlsHandshakeQueueFront++;
+            if (next) {
+                ((HttpResponseData<SSL> *) us_socket_ext(SSL, next))->tlsHandshake = HttpResponseData<SSL>::TLS_HANDSHAKE_RUNNING;
+                loopData->tlsHandshakes++;
+                ((AsyncSocket<SSL> *) next)->resume();
+            }
+        }
+    }
+
     /* Init the HttpContext by registering libusockets event handlers */
     HttpContext<SSL> *init() {
         /* Handle socket connections */
-        us_socket_context_on_open(SSL, getSocketContext(), [](us_socket_t *s, int /*is_client*/, char */*ip*/, int /*ip_length*/) {
+        us_socket_context_on_open(SSL, getSocketContext(), [](us_socket_t *s, int /*is_client*/, char *ip, int ip_length) {
             /* Any connected socket should timeout until it has a request */
             us_socket_timeout(SSL, s, HTTP_IDLE_TIMEOUT_S);
+            UWS_CAPTURE(((AsyncSocket<SSL> *) s)->getLoopData(), open(s));
 
             /* Init socket ext */
             new (us_socket_ext(SSL, s)) HttpResponseData<SSL>;
 
-            /* Call filter */
+            /* This socket stays counted as long as it lives, even if it upgrades to WebSocket */
+            ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_add(1, std::memory_order_relaxed);
+
+            /* Addresses over their rate of connections are closed before any TLS or HTTP work. Behind a proxy every
+             * connection comes from the proxy, so they are counted at their first request instead */
             HttpContextData<SSL> *httpContextData = getSocketContextDataS(s);
+#ifndef UWS_WITH_PROXY
+            if (RateLimiter *rateLimiter = httpContextData->rateLimiter.get()) {
+                HttpResponseData<SSL> *httpResponseData = (HttpResponseData<SSL> *) us_socket_ext(SSL, s);
+                httpResponseData->rateLimitKey = rateLimiter->key({ip, (size_t) ip_length});
+                if (!rateLimiter->takeConnection(httpResponseData->rateLimitKey, RateLimiter::now())) {
+                    UWS_METRIC(((AsyncSocket<SSL> *) s)->getLoopData(), rateLimitedConnections, 1);
+                    httpResponseData->state |= HttpResponseData<SSL>::HTTP_RATE_LIMITED;
+                    return us_socket_close(SSL, s, 0, nullptr);
+                }
+            }
+#else
+            (void) ip;
+            (void) ip_length;
+#endif
+
+            /* Call filter */
+            if constexpr (SSL) {
+                ((AsyncSocket<SSL> *) s)->getAsyncSocketData()->tlsInitialRecordSize = httpContextData->tlsInitialRecordSize;
+                beginTlsHandshake(s);
+            }
+
+            /* A loop lagging behind does not accept (see LoopData::listenSockets), but sockets taken over come anyway.
+             * Those are left for later, those waiting for a handshake already wait */
+            if (!SSL || ((HttpResponseData<SSL> *) us_socket_ext(SSL, s))->tlsHandshake != HttpResponseData<SSL>::TLS_HANDSHAKE_WAITING) {
+                ((AsyncSocket<SSL> *) s)->pauseReadsLagging();
+            }
+            ((AsyncSocket<SSL> *) s)->inheritBusyPoll();
+
             for (auto &f : httpContextData->filterHandlers) {
                 f((HttpResponse<SSL> *) s, 1);
             }
@@ -86,14 +168,18 @@ private:
         });
 
         /* Handle socket disconnections */
-        us_socket_context_on_close(SSL, getSocketContext(), [](us_socket_t *s, int /*code*/, void */*reason*/) {
+        us_socket_context_on_close(SSL, getSocketContext(), [](us_socket_t *s, int code, void */*reason*/) {
+            UWS_PROBE2(socket__close, s, code);
+
             /* Get socket ext */
             HttpResponseData<SSL> *httpResponseData = (HttpResponseData<SSL> *) us_socket_ext(SSL, s);
 
-            /* Call filter */
+            /* Call filter, unless closed over the connection rate before it was */
             HttpContextData<SSL> *httpContextData = getSocketContextDataS(s);
-            for (auto &f : httpContextData->filterHandlers) {
-                f((HttpResponse<SSL> *) s, -1);
+            if (!(httpResponseData->state & HttpResponseData<SSL>::HTTP_RATE_LIMITED)) {
+                for (auto &f : httpContextData->filterHandlers) {
+                    f((HttpResponse<SSL> *) s, -1);
+                }
             }
 
             /* Signal broken HTTP request only if we have a pending request */
@@ -101,6 +187,13 @@ private:
                 httpResponseData->onAborted();
             }
 
+            ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_sub(1, std::memory_order_relaxed);
+            UWS_CAPTURE(((AsyncSocket<SSL> *) s)->getLoopData(), close(s));
+            ((AsyncSocket<SSL> *) s)->forgetPausedReads();
+            if constexpr (SSL) {
+                endTlsHandshake(s);
+            }
+
             /* Destruct socket ext */
             httpResponseData->~HttpResponseData<SSL>();
 
@@ -125,8 +218,25 @@ private:
 
             HttpResponseData<SSL> *httpResponseData = (HttpResponseData<SSL> *) us_socket_ext(SSL, s);
 
-            /* Cork this socket */
+            UWS_METRIC(((AsyncSocket<SSL> *) s)->getLoopData(), readSyscalls, 1);
+            UWS_METRIC(((AsyncSocket<SSL> *) s)->getLoopData(), bytesRead, length);
+            ((AsyncSocket<SSL> *) s)->getLoopData()->dataRead = true;
+            UWS_CAPTURE(((AsyncSocket<SSL> *) s)->getLoopData(), data(s, data, length));
+
+            /* The first data we get comes after the handshake, making room for the next one */
+            if constexpr (SSL) {
+                endTlsHandshake(s);
+            }
+
+#ifdef UWS_WITH_KTLS
+            /* The first data we get comes after the handshake, its last flight long sent */
+            ((AsyncSocket<SSL> *) s)->offloadTls();
+#endif
+
+            /* Cork this socket, holding on to everything we respond to the requests of this read */
             ((AsyncSocket<SSL> *) s)->cork();
+            LoopData *loopData = ((AsyncSocket<SSL> *) s)->getLoopData();
+            loopData->holdCork = true;
 
             /* Mark that we are inside the parser now */
             httpContextData->isParsingHttp = true;
@@ -140,6 +250,7 @@ private:
 #endif
 
             /* The return value is entirely up to us to interpret. The HttpParser only care for whether the returned value is DIFFERENT or not from passed user */
+            UWS_PHASE_BEGIN(loopData, parseCycles);
             auto [err, returnedSocket] = httpResponseData->consumePostPadded(data, (unsigned int) length, s, proxyParser, [httpContextData](void *s, HttpRequest *httpRequest) -> void * {
                 /* For every request we reset the timeout and hang until user makes action */
                 /* Warning: if we are in shutdown state, resetting the timer is a security issue! */
@@ -159,24 +270,102 @@ private:
 
                 /* Mark pending request and emit it */
                 httpResponseData->state = HttpResponseData<SSL>::HTTP_RESPONSE_PENDING;
+                UWS_PROBE3(request__parsed, httpResponseData, httpRequest->getUrl().data(), httpRequest->getUrl().length());
 
                 /* Mark this response as connectionClose if ancient or connection: close */
-                if (httpRequest->isAncient() || httpRequest->getHeader("connection").length() == 5) {
+                if (httpRequest->isAncient() || httpRequest->getHeader("connection").length() == 5
+                    || ((AsyncSocket<SSL> *) s)->getLoopData()->handoffChannel != -1) {
                     httpResponseData->state |= HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE;
                 }
 
+                /* What end and write compress with, if anything */
+                httpResponseData->contentEncoding = IDENTITY;
+                if (httpContextData->compression.encodings) {
+                    httpResponseData->contentEncoding = negotiateContentEncoding(httpRequest->getHeader("accept-encoding"), httpContextData->compression.encodings);
+                }
+
+                /* Health checks, scrapes and redirects are answered right here, for every server name */
+                if (httpContextData->staticResponses.size()) {
+                    if (auto it = httpContextData->staticResponses.find(httpRequest->getUrl()); it != httpContextData->staticResponses.end()) {
+                        for (StaticResponse &staticResponse : it->second) {
+                            if (staticResponse.method == httpRequest->getCaseSensitiveMethod()) {
+                                ((HttpResponse<SSL> *) s)->endFramed(staticResponse.framedResponse, staticResponse.dateOffset);
+                                return us_socket_is_closed(SSL, (us_socket_t *) s) ? nullptr : s;
+                            }
+                        }
+                    }
+                }
+
+                /* Addresses over their rate of requests are turned away before anything is done for them. Behind a proxy
+                 * this is also where connections are counted, by the address in the PROXY header */
+                if (RateLimiter *rateLimiter = httpContextData->rateLimiter.get()) {
+#ifdef UWS_WITH_PROXY
+                    if (!httpResponseData->rateLimitKeyed) {
+                        httpResponseData->rateLimitKeyed = true;
+                        std::string_view address = httpResponseData->proxyParser.getSourceAddress();
+                        httpResponseData->rateLimitKey = rateLimiter->key(address.length() ? address : ((AsyncSocket<SSL> *) s)->getRemoteAddress());
+                        if (!rateLimiter->takeConnection(httpResponseData->rateLimitKey, RateLimiter::now())) {
+                            UWS_METRIC(((AsyncSocket<SSL> *) s)->getLoopData(), rateLimitedConnections, 1);
+                            us_socket_close(SSL, (us_socket_t *) s, 0, nullptr);
+                            return nullptr;
+                        }
+                    }
+#endif
+                    if (!rateLimiter->takeRequest(httpResponseData->rateLimitKey, RateLimiter::now())) {
+                        ((HttpResponse<SSL> *) s)->endTooManyRequests();
+                        return us_socket_is_closed(SSL, (us_socket_t *) s) ? nullptr : s;
+                    }
+                }
+
+                /* A loop lagging behind turns requests away before doing anything for them */
+                if (((AsyncSocket<SSL> *) s)->getLoopData()->overLag(100, REJECT_REQUESTS)) {
+                    ((HttpResponse<SSL> *) s)->endServiceUnavailable();
+                    return us_socket_is_closed(SSL, (us_socket_t *) s) ? nullptr : s;
+                }
+
+#ifndef _WIN32
+                /* Files of serveStatic are answered here, revalidations and ranges included */
+                if (httpContextData->staticAssets.size()) {
+                    std::string_view method = httpRequest->getCaseSensitiveMethod();
+                    if (method == "GET" || method == "HEAD") {
+                        for (auto &staticAssets : httpContextData->staticAssets) {
+                            if (StaticAssets::Asset *asset = staticAssets->find(httpRequest->getUrl())) {
+                                bool head = method == "HEAD";
+                                uintmax_t offset, length;
+                                StaticAssets::Answer answer = StaticAssets::answer(asset, httpRequest->getHeader("if-none-match"),
+                                    httpRequest->getHeader("if-modified-since"), head ? std::string_view{} : httpRequest->getHeader("range"),
+                                    httpRequest->getHeader("if-range"), offset, length);
+                                ((HttpResponse<SSL> *) s)->endAsset(asset, answer, offset, length, head);
+                                return us_socket_is_closed(SSL, (us_socket_t *) s) ? nullptr : s;
+                            }
+                        }
+                    }
+                }
+#endif
+
                 /* Select the router based on SNI (only possible for SSL) */
                 auto *selectedRouter = &httpContextData->router;
+#ifndef UWS_NO_SNI
                 if constexpr (SSL) {
-                    void *domainRouter = us_socket_server_name_userdata(SSL, (struct us_socket_t *) s);
-                    if (domainRouter) {
-                        selectedRouter = (decltype(selectedRouter)) domainRouter;
+                    /* The server name of a connection never changes, so neither does its router until server names do */
+                    if (httpResponseData->serverNamesGeneration != httpContextData->serverNamesGeneration) {
+                        httpResponseData->domainRouter = us_socket_server_name_userdata(SSL, (struct us_socket_t *) s);
+                        httpResponseData->serverNamesGeneration = httpContextData->serverNamesGeneration;
+                    }
+                    if (httpResponseData->domainRouter) {
+                        selectedRouter = (decltype(selectedRouter)) httpResponseData->domainRouter;
                     }
                 }
+#endif
 
                 /* Route the method and URL */
                 selectedRouter->getUserData() = {(HttpResponse<SSL> *) s, httpRequest};
-                if (!selectedRouter->route(httpRequest->getCaseSensitiveMethod(), httpRequest->getUrl())) {
+                bool routed;
+                {
+                    UWS_PHASE(((AsyncSocket<SSL> *) s)->getLoopData(), routeCycles);
+                    routed = selectedRouter->route(httpRequest->getKnownMethod(), httpRequest->getCaseSensitiveMethod(), httpRequest->getUrl());
+                }
+                if (!routed) {
                     /* We have to force close this socket as we have no handler for it */
                     us_socket_close(SSL, (us_socket_t *) s, 0, nullptr);
                     return nullptr;
@@ -252,15 +441,17 @@ private:
                 }
                 return user;
             });
+            UWS_PHASE_END(loopData);
 
             /* Mark that we are no longer parsing Http */
             httpContextData->isParsingHttp = false;
+            loopData->holdCork = false;
 
             /* If we got fullptr that means the parser wants us to close the socket from error (same as calling the errorHandler) */
             if (returnedSocket == FULLPTR) {
                 /* For errors, we only deliver them "at most once". We don't care if they get halfways delivered or not. */
-                us_socket_write(SSL, s, httpErrorResponses[err].data(), (int) httpErrorResponses[err].length(), false);
-                us_socket_shutdown(SSL, s);
+                us_socket_write(((AsyncSocket<SSL> *) s)->tls(), s, httpErrorResponses[err].data(), (int) httpErrorResponses[err].length(), false);
+                ((AsyncSocket<SSL> *) s)->shutdown();
                 /* Close any socket on HTTP errors */
                 us_socket_close(SSL, s, 0, nullptr);
                 /* This just makes the following code act as if the socket was closed from error inside the parser. */
@@ -277,6 +468,9 @@ private:
                     ((AsyncSocket<SSL> *) s)->timeout(HTTP_IDLE_TIMEOUT_S);
                 }
 
+                /* No more requests while the loop holds too much backpressure */
+                ((AsyncSocket<SSL> *) s)->pauseReadsOverBudget();
+
                 /* We need to check if we should close this socket here now */
                 if (httpResponseData->state & HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE) {
                     if ((httpResponseData->state & HttpResponseData<SSL>::HTTP_RESPONSE_PENDING) == 0) {
@@ -329,6 +523,15 @@ private:
             AsyncSocket<SSL> *asyncSocket = (AsyncSocket<SSL> *) s;
             HttpResponseData<SSL> *httpResponseData = (HttpResponseData<SSL> *) asyncSocket->getAsyncSocketData();
 
+#ifndef _WIN32
+            /* Files from sendFile drain by themselves */
+            if (httpResponseData->fileFd != -1) {
+                us_socket_timeout(SSL, s, 0);
+                ((HttpResponse<SSL> *) s)->drainFile();
+                return s;
+            }
+#endif
+
             /* Ask the developer to write data and return success (true) or failure (false), OR skip sending anything and return success (true). */
             if (httpResponseData->onWritable) {
                 /* We are now writable, so hang timeout again, the user does not have to do anything so we should hang until end or tryEnd rearms timeout */
@@ -411,7 +614,16 @@ public:
     void free() {
         /* Destruct socket context data */
         HttpContextData<SSL> *httpContextData = getSocketContextData();
+#ifndef _WIN32
+        if (httpContextData->staticAssetsTimer) {
+            us_timer_close(httpContextData->staticAssetsTimer);
+        }
+        if (httpContextData->handOffTimer) {
+            us_timer_close(httpContextData->handOffTimer);
+        }
+#endif
         httpContextData->~HttpContextData<SSL>();
+        ((LoopData *) us_loop_ext(us_socket_context_loop(SSL, getSocketContext())))->forgetListenSockets(getSocketContext());
 
         /* Free the socket context in whole */
         us_socket_context_free(SSL, getSocketContext());
@@ -425,39 +637,16 @@ public:
     void onHttp(std::string method, std::string pattern, MoveOnlyFunction<void(HttpResponse<SSL> *, HttpRequest *)> &&handler, bool upgrade = false) {
         HttpContextData<SSL> *httpContextData = getSocketContextData();
 
-        /* Todo: This is ugly, fix */
-        std::vector<std::string> methods;
-        if (method == "*") {
-            methods = {"*"};
-        } else {
-            methods = {method};
-        }
-
-        uint32_t priority = method == "*" ? httpContextData->currentRouter->LOW_PRIORITY : (upgrade ? httpContextData->currentRouter->HIGH_PRIORITY : httpContextData->currentRouter->MEDIUM_PRIORITY);
-
         /* If we are passed nullptr then remove this */
         if (!handler) {
-            httpContextData->currentRouter->remove(methods[0], pattern, priority);
+            httpContextData->currentRouter->addRoute(method, pattern, nullptr, upgrade);
             return;
         }
 
         /* Record this route's parameter offsets */
-        std::map<std::string, unsigned short, std::less<>> parameterOffsets;
-        unsigned short offset = 0;
-        for (unsigned int i = 0; i < pattern.length(); i++) {
-            if (pattern[i] == ':') {
-                i++;
-                unsigned int start = i;
-                while (i < pattern.length() && pattern[i] != '/') {
-                    i++;
-                }
-                parameterOffsets[std::string(pattern.data() + start, i - start)] = offset;
-                //std::cout << "<" << std::string(pattern.data() + start, i - start) << "> is offset " << offset;
-                offset++;
-            }
-        }
+        auto parameterOffsets = HttpRouter<typename HttpContextData<SSL>::RouterData>::getParameterOffsets(pattern);
 
-        httpContextData->currentRouter->add(methods, pattern, [handler = std::move(handler), parameterOffsets = std::move(parameterOffsets)](auto *r) mutable {
+        httpContextData->currentRouter->addRoute(method, pattern, [handler = std::move(handler), parameterOffsets = std::move(parameterOffsets)](auto *r) mutable {
             auto user = r->getUserData();
             user.httpRequest->setYield(false);
             user.httpRequest->setParameters(r->getParameters());
@@ -469,33 +658,52 @@ public:
                 user.httpResponse->writeContinue();
             }
 
-            handler(user.httpResponse, user.httpRequest);
+            {
+                UWS_PHASE(((AsyncSocket<SSL> *) user.httpResponse)->getLoopData(), handlerCycles);
+                handler(user.httpResponse, user.httpRequest);
+            }
 
             /* If any handler yielded, the router will keep looking for a suitable handler. */
             if (user.httpRequest->getYield()) {
                 return false;
             }
             return true;
-        }, priority);
+        }, upgrade);
     }
 
     /* Listen to port using this HttpContext */
     us_listen_socket_t *listen(const char *host, int port, int options) {
-        return us_socket_context_listen(SSL, getSocketContext(), host, port, options, sizeof(HttpResponseData<SSL>));
+        /* Routes are usually all added by now */
+        getSocketContextData()->router.freeze();
+        return trackListenSocket(us_socket_context_listen(SSL, getSocketContext(), host, port, options, sizeof(HttpResponseData<SSL>)));
     }
 
     /* Listen to unix domain socket using this HttpContext */
     us_listen_socket_t *listen(const char *path, int options) {
-        return us_socket_context_listen_unix(SSL, getSocketContext(), path, options, sizeof(HttpResponseData<SSL>));
+        getSocketContextData()->router.freeze();
+        return trackListenSocket(us_socket_context_listen_unix(SSL, getSocketContext(), path, options, sizeof(HttpResponseData<SSL>)));
+    }
+
+    /* Our loop stops polling the listen sockets we made while it lags (PAUSE_CONNECTIONS), new ones included */
+    us_listen_socket_t *trackListenSocket(us_listen_socket_t *listenSocket) {
+        if (listenSocket) {
+            us_loop_t *loop = us_socket_context_loop(SSL, getSocketContext());
+            LoopData *loopData = (LoopData *) us_loop_ext(loop);
+            loopData->listenSockets.push_back({listenSocket, getSocketContext()});
+            if (loopData->listenSocketsPaused) {
+                us_poll_change((us_poll_t *) listenSocket, loop, 0);
+            }
+        }
+        return listenSocket;
     }
 
     void onPreOpen(LIBUS_SOCKET_DESCRIPTOR (*handler)(struct us_socket_context_t *, LIBUS_SOCKET_DESCRIPTOR)) {
         us_socket_context_on_pre_open(SSL, getSocketContext(), handler);
     }
 
-    /* Adopt an externally accepted socket into this HttpContext */
-    us_socket_t *adoptAcceptedSocket(LIBUS_SOCKET_DESCRIPTOR accepted_fd) {
-        return us_adopt_accepted_socket(SSL, getSocketContext(), accepted_fd, sizeof(HttpResponseData<SSL>), 0, 0);
+    /* Adopt an externally accepted socket into this HttpContext, with the raw address of its peer if known */
+    us_socket_t *adoptAcceptedSocket(LIBUS_SOCKET_DESCRIPTOR accepted_fd, char *ip = nullptr, int ipLength = 0) {
+        return us_adopt_accepted_socket(SSL, getSocketContext(), accepted_fd, sizeof(HttpResponseData<SSL>), ip, ipLength);
     }
 };
 
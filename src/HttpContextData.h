@@ -19,7 +19,16 @@
 #define UWS_HTTPCONTEXTDATA_H
 
 #include "HttpRouter.h"
+#include "HttpCompression.h"
+#include "RateLimiter.h"
+#include "StaticAssets.h"
+#include "Handoff.h"
 
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include "MoveOnlyFunction.h"
 
@@ -27,6 +36,23 @@ namespace uWS {
 template<bool> struct HttpResponse;
 struct HttpRequest;
 
+/* A response sent as soon as its request is parsed, see TemplatedApp::staticResponse */
+struct StaticResponse {
+    std::string method;
+    /* Status line, headers and body, with room for Date at dateOffset */
+    std::string framedResponse;
+    size_t dateOffset;
+};
+
+/* Lets string keyed maps be looked up by string_view */
+struct TransparentStringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view s) const {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+
 template <bool SSL>
 struct alignas(16) HttpContextData {
     template <bool> friend struct HttpContext;
@@ -35,7 +61,9 @@ struct alignas(16) HttpContextData {
 private:
     std::vector<MoveOnlyFunction<void(HttpResponse<SSL> *, int)>> filterHandlers;
 
+#ifndef UWS_NO_SNI
     MoveOnlyFunction<void(const char *hostname)> missingServerNameHandler;
+#endif
 
     struct RouterData {
         HttpResponse<SSL> *httpResponse;
@@ -47,9 +75,38 @@ private:
 
     /* This is the default router for default SNI or non-SSL */
     HttpRouter<RouterData> router;
+
+    /* Static responses by exact url, checked before any router */
+    std::unordered_map<std::string, std::vector<StaticResponse>, TransparentStringHash, std::equal_to<>> staticResponses;
+
+    /* TemplatedApp::compress, off while no encodings are offered */
+    HttpCompressionOptions compression = {0, 0, 0};
+
+    /* TemplatedApp::rateLimit, checked as connections open and requests come */
+    std::unique_ptr<RateLimiter> rateLimiter;
+
+#ifndef _WIN32
+    /* TemplatedApp::serveStatic, checked before any router, and the timer picking up their changes */
+    std::vector<std::unique_ptr<StaticAssets>> staticAssets;
+    struct us_timer_t *staticAssetsTimer = nullptr;
+
+    /* TemplatedApp::handOff waiting for a taker, and TemplatedApp::takeOver accepting on what it took */
+    std::unique_ptr<Handoff::Waiting> handOffWaiting;
+    struct us_timer_t *handOffTimer = nullptr;
+    std::unique_ptr<Handoff> handoff;
+#endif
+
+#ifndef UWS_NO_SNI
+    /* Bumped by every addServerName and removeServerName, making sockets look up their domain router again */
+    unsigned int serverNamesGeneration = 1;
+#endif
+
     void *upgradedWebSocket = nullptr;
     bool isParsingHttp = false;
 
+    /* SocketContextOptions::tls_initial_record_size, for every socket we accept */
+    unsigned short tlsInitialRecordSize = 0;
+
     /* If we are main acceptor, distribute to these apps */
     std::vector<void *> childApps;
     unsigned int roundRobin = 0;
@@ -0,0 +1,67 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTPMETHOD_H
+#define UWS_HTTPMETHOD_H
+
+/* The standard methods are told apart once, by the parser as it scans the request line, so that the router indexes
+ * their routes directly. Anything else, custom or not upper cased, is HTTP_OTHER and routed by name */
+
+#include <cstring>
+#include <string_view>
+
+namespace uWS {
+
+enum HttpMethod : unsigned char {
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_DELETE,
+    HTTP_CONNECT,
+    HTTP_OPTIONS,
+    HTTP_TRACE,
+    HTTP_PATCH,
+    HTTP_OTHER,
+    NUM_HTTP_METHODS = HTTP_OTHER
+};
+
+/* As sent in the request line */
+static constexpr std::string_view HTTP_METHOD_NAMES[NUM_HTTP_METHODS] = {"GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+
+/* Methods are case sensitive, so get is not GET */
+static inline HttpMethod classifyHttpMethod(std::string_view method) {
+    const char *m = method.data();
+    switch (method.length()) {
+    case 3:
+        return !memcmp(m, "GET", 3) ? HTTP_GET : !memcmp(m, "PUT", 3) ? HTTP_PUT : HTTP_OTHER;
+    case 4:
+        return !memcmp(m, "POST", 4) ? HTTP_POST : !memcmp(m, "HEAD", 4) ? HTTP_HEAD : HTTP_OTHER;
+    case 5:
+        return !memcmp(m, "PATCH", 5) ? HTTP_PATCH : !memcmp(m, "TRACE", 5) ? HTTP_TRACE : HTTP_OTHER;
+    case 6:
+        return !memcmp(m, "DELETE", 6) ? HTTP_DELETE : HTTP_OTHER;
+    case 7:
+        return !memcmp(m, "OPTIONS", 7) ? HTTP_OPTIONS : !memcmp(m, "CONNECT", 7) ? HTTP_CONNECT : HTTP_OTHER;
+    default:
+        return HTTP_OTHER;
+    }
+}
+
+}
+
+#endif // UWS_HTTPMETHOD_H
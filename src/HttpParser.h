@@ -32,9 +32,28 @@
 #include "ChunkedEncoding.h"
 
 #include "BloomFilter.h"
+#include "KnownHeaders.h"
+#include "HttpMethod.h"
 #include "ProxyParser.h"
 #include "QueryParser.h"
 #include "HttpErrors.h"
+#include "AsyncSocketData.h"
+
+/* Header scanning is vectorized with SSE2 or NEON, and with AVX2 when the compiler targets it or else when the CPU
+ * has it (checked once at startup, see CpuFeatures). Define UWS_NO_SIMD to force the portable SWAR / scalar paths. */
+#if !defined(UWS_NO_SIMD) && defined(__GNUC__)
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define UWS_HTTPPARSER_SIMD_WIDTH 16
+#ifndef __AVX2__
+#include "CpuFeatures.h"
+#define UWS_HTTPPARSER_DISPATCH
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UWS_HTTPPARSER_SIMD_WIDTH 16
+#endif
+#endif
 
 namespace uWS {
 
@@ -52,19 +71,27 @@ static const size_t MAX_FALLBACK_SIZE = (size_t) atoi(optional_ptr(getenv("UWS_H
 #ifndef UWS_HTTP_MAX_HEADERS_COUNT
 #define UWS_HTTP_MAX_HEADERS_COUNT 100
 #endif
+static_assert(UWS_HTTP_MAX_HEADERS_COUNT <= 256, "KnownHeaders index headers with unsigned char");
 
 struct HttpRequest {
 
     friend struct HttpParser;
+    friend struct HttpResponseHead;
+    friend struct HttpResponseParser;
 
 private:
     struct Header {
         std::string_view key, value;
     } headers[UWS_HTTP_MAX_HEADERS_COUNT];
     bool ancientHttp;
+    HttpMethod method;
     unsigned int querySeparator;
+    /* Made by the first getQuery(key) */
+    bool queryIndexed;
+    QueryIndex queryIndex;
     bool didYield;
     BloomFilter bf;
+    KnownHeaders knownHeaders;
     std::pair<int, std::string_view *> currentParameters;
     std::map<std::string, unsigned short, std::less<>> *currentParameterOffsets = nullptr;
 
@@ -113,6 +140,12 @@ public:
     }
 
     std::string_view getHeader(std::string_view lowerCasedHeader) {
+        /* Well-known headers know where they are */
+        int knownHeader = KnownHeaders::find(lowerCasedHeader);
+        if (knownHeader != -1) {
+            unsigned char index = knownHeaders.indices[knownHeader];
+            return index ? headers[index].value : std::string_view(nullptr, 0);
+        }
         if (bf.mightHave(lowerCasedHeader)) {
             for (Header *h = headers; (++h)->key.length(); ) {
                 if (h->key.length() == lowerCasedHeader.length() && !strncmp(h->key.data(), lowerCasedHeader.data(), lowerCasedHeader.length())) {
@@ -136,6 +169,11 @@ public:
         return std::string_view(headers->key.data(), headers->key.length());
     }
 
+    /* The method as classified by the parser, HTTP_OTHER for anything but the standard ones */
+    HttpMethod getKnownMethod() {
+        return method;
+    }
+
     std::string_view getMethod() {
         /* Compatibility hack: lower case method (todo: remove when major version bumps) */
         for (unsigned int i = 0; i < headers->key.length(); i++) {
@@ -155,12 +193,18 @@ public:
         }
     }
 
-    /* Finds and decodes the URI component. */
+    /* Finds and decodes the URI component. The first call decodes the whole query in place, read getQuery() before if you need it raw */
     std::string_view getQuery(std::string_view key) {
-        /* Raw querystring including initial '?' sign */
-        std::string_view queryString = std::string_view(headers->value.data() + querySeparator, headers->value.length() - querySeparator);
+        return getQueryIndex().get(key);
+    }
 
-        return getDecodedQueryValue(key, queryString);
+    /* Iteration over decoded query (key, value) pairs, of which there are at most UWS_QUERY_MAX_PAIRS */
+    QueryIndex &getQueryIndex() {
+        if (!queryIndexed) {
+            queryIndex.build(getQuery());
+            queryIndexed = true;
+        }
+        return queryIndex;
     }
 
     void setParameters(std::pair<int, std::string_view *> parameters) {
@@ -193,9 +237,11 @@ public:
 };
 
 struct HttpParser {
+    friend struct HttpResponseParser;
 
 private:
-    std::string fallback;
+    /* A partial request waits for the rest in a pooled chunk, with room for the post padding */
+    BackPressureChunk *fallback = nullptr;
     /* This guy really has only 30 bits since we reserve two highest bits to chunked encoding parsing state */
     uint64_t remainingStreamingBytes = 0;
 
@@ -261,7 +307,152 @@ private:
         return false;
     }
     
+#ifdef UWS_HTTPPARSER_SIMD_WIDTH
+    /* Lower cases the leading [A-Za-z-] run of one block, returning its length (16 if the whole block).
+     * Reading a full block is fine since post padding is at least one block and the fenced \r always ends the run. */
+    static inline unsigned int lowerCaseFieldNameBlock16(char *p) {
+#if defined(__SSE2__)
+        __m128i v = _mm_loadu_si128((__m128i *) p);
+        __m128i a = _mm_sub_epi8(v, _mm_set1_epi8('A'));
+        __m128i upper = _mm_cmpeq_epi8(_mm_min_epu8(a, _mm_set1_epi8(25)), a);
+        __m128i lowered = _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(32)));
+        __m128i l = _mm_sub_epi8(lowered, _mm_set1_epi8('a'));
+        __m128i valid = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(25)), l), _mm_cmpeq_epi8(lowered, _mm_set1_epi8('-')));
+        unsigned int invalid = ~(unsigned int) _mm_movemask_epi8(valid) & 0xffff;
+        if (!invalid) {
+            _mm_storeu_si128((__m128i *) p, lowered);
+            return 16;
+        }
+        unsigned int length = (unsigned int) __builtin_ctz(invalid);
+        alignas(16) char block[16];
+        _mm_store_si128((__m128i *) block, lowered);
+#else
+        uint8x16_t v = vld1q_u8((uint8_t *) p);
+        uint8x16_t upper = vcltq_u8(vsubq_u8(v, vdupq_n_u8('A')), vdupq_n_u8(26));
+        uint8x16_t lowered = vorrq_u8(v, vandq_u8(upper, vdupq_n_u8(32)));
+        uint8x16_t valid = vorrq_u8(vcltq_u8(vsubq_u8(lowered, vdupq_n_u8('a')), vdupq_n_u8(26)), vceqq_u8(lowered, vdupq_n_u8('-')));
+        /* Narrow to 4 bits per byte since NEON has no movemask */
+        uint64_t invalid = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(valid), 4)), 0);
+        if (!invalid) {
+            vst1q_u8((uint8_t *) p, lowered);
+            return 16;
+        }
+        unsigned int length = (unsigned int) __builtin_ctzll(invalid) >> 2;
+        alignas(16) char block[16];
+        vst1q_u8((uint8_t *) block, lowered);
+#endif
+        /* Bytes past the run belong to someone else and must not be touched */
+        memcpy(p, block, length);
+        return length;
+    }
+
+    /* Returns the offset of the first byte below 32 in one block, or 16 if there is none */
+    static inline unsigned int findFieldValueEndInBlock16(char *p) {
+#if defined(__SSE2__)
+        __m128i v = _mm_loadu_si128((__m128i *) p);
+        unsigned int found = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(31)), v));
+        return found ? (unsigned int) __builtin_ctz(found) : 16;
+#else
+        uint8x16_t v = vld1q_u8((uint8_t *) p);
+        uint64_t found = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(vcltq_u8(v, vdupq_n_u8(32))), 4)), 0);
+        return found ? (unsigned int) __builtin_ctzll(found) >> 2 : 16;
+#endif
+    }
+
+#if defined(__SSE2__)
+    /* The same for 32 bytes at a time */
+    __attribute__((target("avx2")))
+    static inline unsigned int lowerCaseFieldNameBlock32(char *p) {
+        __m256i v = _mm256_loadu_si256((__m256i *) p);
+        __m256i a = _mm256_sub_epi8(v, _mm256_set1_epi8('A'));
+        __m256i upper = _mm256_cmpeq_epi8(_mm256_min_epu8(a, _mm256_set1_epi8(25)), a);
+        __m256i lowered = _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(32)));
+        __m256i l = _mm256_sub_epi8(lowered, _mm256_set1_epi8('a'));
+        __m256i valid = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(l, _mm256_set1_epi8(25)), l), _mm256_cmpeq_epi8(lowered, _mm256_set1_epi8('-')));
+        unsigned int invalid = ~(unsigned int) _mm256_movemask_epi8(valid);
+        if (!invalid) {
+            _mm256_storeu_si256((__m256i *) p, lowered);
+            return 32;
+        }
+        unsigned int length = (unsigned int) __builtin_ctz(invalid);
+        alignas(32) char block[32];
+        _mm256_store_si256((__m256i *) block, lowered);
+        memcpy(p, block, length);
+        return length;
+    }
+
+    __attribute__((target("avx2")))
+    static inline unsigned int findFieldValueEndInBlock32(char *p) {
+        __m256i v = _mm256_loadu_si256((__m256i *) p);
+        unsigned int found = (unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(31)), v));
+        return found ? (unsigned int) __builtin_ctz(found) : 32;
+    }
+#endif
+
+    /* Always inlined so that the blocks inline as well, also into the callers built for AVX2 */
+    template <unsigned int WIDTH, unsigned int (*lowerCaseFieldNameBlock)(char *)>
+    __attribute__((always_inline))
+    static inline void *consumeFieldNameBlocks(char *p) {
+        while (true) {
+            /* Lower case and skip whole blocks of the common [A-Za-z-] bytes */
+            unsigned int length;
+            while ((length = lowerCaseFieldNameBlock(p)) == WIDTH) {
+                p += WIDTH;
+            }
+            p += length;
+
+            /* Anything else is either an unlikely but valid byte, or the end of the field name (hopefully a colon) */
+            if (!isFieldNameByteFastLowercased(*(unsigned char *)p)) {
+                return (void *)p;
+            }
+            p++;
+        }
+    }
+
+    template <unsigned int WIDTH, unsigned int (*findFieldValueEndInBlock)(char *)>
+    __attribute__((always_inline))
+    static inline void *consumeFieldValueBlocks(char *p) {
+        for (; true; p += WIDTH) {
+            unsigned int offset = findFieldValueEndInBlock(p);
+            if (offset != WIDTH) {
+                return (void *)(p + offset);
+            }
+        }
+    }
+
+#ifdef UWS_HTTPPARSER_DISPATCH
+    __attribute__((target("avx2")))
+    static void *consumeFieldNameAvx2(char *p) {
+        return consumeFieldNameBlocks<32, lowerCaseFieldNameBlock32>(p);
+    }
+
+    __attribute__((target("avx2")))
+    static void *consumeFieldValueAvx2(char *p) {
+        return consumeFieldValueBlocks<32, findFieldValueEndInBlock32>(p);
+    }
+
+    static void *consumeFieldNameSse2(char *p) {
+        return consumeFieldNameBlocks<16, lowerCaseFieldNameBlock16>(p);
+    }
+
+    static void *consumeFieldValueSse2(char *p) {
+        return consumeFieldValueBlocks<16, findFieldValueEndInBlock16>(p);
+    }
+
+    /* Resolved once at startup */
+    static inline void *(*const consumeFieldNameResolved)(char *) = CpuFeatures::get().avx2 ? consumeFieldNameAvx2 : consumeFieldNameSse2;
+    static inline void *(*const consumeFieldValueResolved)(char *) = CpuFeatures::get().avx2 ? consumeFieldValueAvx2 : consumeFieldValueSse2;
+#endif
+#endif
+
     static inline void *consumeFieldName(char *p) {
+#if defined(UWS_HTTPPARSER_DISPATCH)
+        return consumeFieldNameResolved(p);
+#elif defined(__AVX2__)
+        return consumeFieldNameBlocks<32, lowerCaseFieldNameBlock32>(p);
+#elif defined(UWS_HTTPPARSER_SIMD_WIDTH)
+        return consumeFieldNameBlocks<16, lowerCaseFieldNameBlock16>(p);
+#else
         /* Best case fast path (particularly useful with clang) */
         while (true) {
             while ((*p >= 65) & (*p <= 90)) [[likely]] {
@@ -287,6 +478,7 @@ private:
             p++;
         }
         return (void *)p;
+#endif
     }
 
     /* Puts method as key, target as value and returns non-null (or nullptr on error). */
@@ -337,11 +529,47 @@ private:
         return (char *) 0x1;
     }
 
+    /* Puts the status code as key, the reason phrase as value and returns past the line, nullptr if fragmented or 0x1 on error */
+    static inline char *consumeStatusLine(char *data, char *end, HttpRequest::Header &header) {
+        /* HTTP/1.x and three digits, then the reason phrase which may be empty */
+        if (end - data < 13) {
+            return memcmp("HTTP/1.", data, std::min<size_t>(7, (size_t) (end - data))) == 0 ? nullptr : (char *) 0x1;
+        }
+        if (memcmp("HTTP/1.", data, 7) || (data[7] != '1' && data[7] != '0') || data[8] != ' '
+            || data[9] < '1' || data[9] > '5' || data[10] < '0' || data[10] > '9' || data[11] < '0' || data[11] > '9'
+            || (data[12] != ' ' && data[12] != '\r')) {
+            return (char *) 0x1;
+        }
+        header.key = {data + 9, 3};
+
+        char *start = data + 12 + (data[12] == ' ');
+        data = start;
+        while (*(data = (char *) tryConsumeFieldValue(data)) == '\t') {
+            data++;
+        }
+        /* The fence is \r followed by something not \n */
+        if (data[0] != '\r') {
+            return (char *) 0x1;
+        }
+        if (data[1] != '\n') {
+            return data + 1 < end ? (char *) 0x1 : nullptr;
+        }
+        header.value = {start, (size_t) (data - start)};
+        return data + 2;
+    }
+
     /* RFC 9110: 5.5 Field Values (TLDR; anything above 31 is allowed; htab (9) is also allowed)
      * Field values are usually constrained to the range of US-ASCII characters [...]
      * Field values containing CR, LF, or NUL characters are invalid and dangerous [...]
      * Field values containing other CTL characters are also invalid. */
     static inline void *tryConsumeFieldValue(char *p) {
+#if defined(UWS_HTTPPARSER_DISPATCH)
+        return consumeFieldValueResolved(p);
+#elif defined(__AVX2__)
+        return consumeFieldValueBlocks<32, findFieldValueEndInBlock32>(p);
+#elif defined(UWS_HTTPPARSER_SIMD_WIDTH)
+        return consumeFieldValueBlocks<16, findFieldValueEndInBlock16>(p);
+#else
         for (; true; p += 8) {
             uint64_t word;
             memcpy(&word, p, sizeof(uint64_t));
@@ -350,9 +578,12 @@ private:
                 return (void *)p;
             }
         }
+#endif
     }
 
-    /* End is only used for the proxy parser. The HTTP parser recognizes "\ra" as invalid "\r\n" scan and breaks. */
+    /* End is only used for the proxy parser. The HTTP parser recognizes "\ra" as invalid "\r\n" scan and breaks.
+     * Responses (of HttpClient) start with a status line instead of a request line and have no PROXY header */
+    template <bool RESPONSE = false>
     static unsigned int getHeaders(char *postPaddedBuffer, char *end, struct HttpRequest::Header *headers, void *reserved, unsigned int &err) {
         char *preliminaryKey, *preliminaryValue, *start = postPaddedBuffer;
 
@@ -361,15 +592,17 @@ private:
             ProxyParser *pp = (ProxyParser *) reserved;
 
             /* Parse PROXY protocol */
-            auto [done, offset] = pp->parse({postPaddedBuffer, (size_t) (end - postPaddedBuffer)});
-            if (!done) {
-                /* We do not reset the ProxyParser (on filure) since it is tied to this
-                * connection, which is really only supposed to ever get one PROXY frame
-                * anyways. We do however allow multiple PROXY frames to be sent (overwrites former). */
-                return 0;
-            } else {
-                /* We have consumed this data so skip it */
-                postPaddedBuffer += offset;
+            if constexpr (!RESPONSE) {
+                auto [done, offset] = pp->parse({postPaddedBuffer, (size_t) (end - postPaddedBuffer)});
+                if (!done) {
+                    /* We do not reset the ProxyParser (on filure) since it is tied to this
+                    * connection, which is really only supposed to ever get one PROXY frame
+                    * anyways, ahead of its first request (it is sealed after that one) */
+                    return 0;
+                } else {
+                    /* We have consumed this data so skip it */
+                    postPaddedBuffer += offset;
+                }
             }
         #else
             /* This one is unused */
@@ -383,11 +616,30 @@ private:
          * which is then removed, and our counters to flip due to overflow and we end up with a crash */
 
         /* The request line is different from the field names / field values */
-        if ((char *) 2 > (postPaddedBuffer = consumeRequestLine(postPaddedBuffer, end, headers[0]))) {
-            /* Error - invalid request line */
-            /* Assuming it is 505 HTTP Version Not Supported */
-            err = postPaddedBuffer ? HTTP_ERROR_505_HTTP_VERSION_NOT_SUPPORTED : 0;
-            return 0;
+        if constexpr (RESPONSE) {
+            if ((char *) 2 > (postPaddedBuffer = consumeStatusLine(postPaddedBuffer, end, headers[0]))) {
+                err = postPaddedBuffer ? HTTP_ERROR_400_BAD_REQUEST : 0;
+                return 0;
+            }
+
+            /* Unlike requests, responses may come without a single header */
+            if (postPaddedBuffer[0] == '\r') {
+                if (postPaddedBuffer[1] == '\n') {
+                    headers[1].key = std::string_view(nullptr, 0);
+                    return (unsigned int) ((postPaddedBuffer + 2) - start);
+                }
+                if (postPaddedBuffer + 1 < end) {
+                    err = HTTP_ERROR_400_BAD_REQUEST;
+                }
+                return 0;
+            }
+        } else {
+            if ((char *) 2 > (postPaddedBuffer = consumeRequestLine(postPaddedBuffer, end, headers[0]))) {
+                /* Error - invalid request line */
+                /* Assuming it is 505 HTTP Version Not Supported */
+                err = postPaddedBuffer ? HTTP_ERROR_505_HTTP_VERSION_NOT_SUPPORTED : 0;
+                return 0;
+            }
         }
         headers++;
 
@@ -450,6 +702,12 @@ private:
                     if (postPaddedBuffer[1] == '\n') {
                         /* This cann take the very last header space */
                         headers->key = std::string_view(nullptr, 0);
+#ifdef UWS_WITH_PROXY
+                        /* Any PROXY header after this request would come from the client itself */
+                        if constexpr (!RESPONSE) {
+                            ((ProxyParser *) reserved)->seal();
+                        }
+#endif
                         return (unsigned int) ((postPaddedBuffer + 2) - start);
                     } else {
                         /* \r\n\r plus non-\n letter is malformed request, or simply out of search space */
@@ -495,19 +753,25 @@ private:
                 return {HTTP_ERROR_431_REQUEST_HEADER_FIELDS_TOO_LARGE, FULLPTR};
             }
 
-            /* Store HTTP version (ancient 1.0 or 1.1) */
+            /* Store HTTP version (ancient 1.0 or 1.1) and what method this is, while the request line is hot */
             req->ancientHttp = false;
+            req->method = classifyHttpMethod(req->headers->key);
 
-            /* Add all headers to bloom filter */
+            /* Add all headers to bloom filter, and note where the first of every well-known one is */
             req->bf.reset();
+            req->knownHeaders.reset();
             for (HttpRequest::Header *h = req->headers; (++h)->key.length(); ) {
-                if (req->bf.mightHave(h->key)) [[unlikely]] {
-                    /* Host header is not allowed twice */
-                    if (h->key == "host" && req->getHeader("host").data()) {
+                int knownHeader = KnownHeaders::find(h->key);
+                if (knownHeader != -1) {
+                    if (!req->knownHeaders.indices[knownHeader]) {
+                        req->knownHeaders.indices[knownHeader] = (unsigned char) (h - req->headers);
+                    } else if (knownHeader == KnownHeaders::HOST) {
+                        /* Host header is not allowed twice */
                         return {HTTP_ERROR_400_BAD_REQUEST, FULLPTR};
                     }
+                } else {
+                    req->bf.add(h->key);
                 }
-                req->bf.add(h->key);
             }
             
             /* Break if no host header (but we can have empty string which is different from nullptr) */
@@ -532,6 +796,7 @@ private:
             /* Parse query */
             const char *querySeparatorPtr = (const char *) memchr(req->headers->value.data(), '?', req->headers->value.length());
             req->querySeparator = (unsigned int) ((querySeparatorPtr ? querySeparatorPtr : req->headers->value.data() + req->headers->value.length()) - req->headers->value.data());
+            req->queryIndexed = false;
 
             /* If returned socket is not what we put in we need
              * to break here as we either have upgraded to
@@ -570,7 +835,7 @@ private:
                 if (!CONSUME_MINIMALLY) {
                     /* Go ahead and parse it (todo: better heuristics for emitting FIN to the app level) */
                     std::string_view dataToConsume(data, length);
-                    for (auto chunk : uWS::ChunkIterator(&dataToConsume, &remainingStreamingBytes)) {
+                    for (auto chunk : uWS::ChunkIterator(&dataToConsume, &remainingStreamingBytes, false, true)) {
                         dataHandler(user, chunk, chunk.length() == 0);
                     }
                     if (isParsingInvalidChunkedEncoding(remainingStreamingBytes)) {
@@ -614,7 +879,45 @@ private:
         return {consumedTotal, user};
     }
 
+    size_t fallbackLength() {
+        return fallback ? fallback->end : 0;
+    }
+
+    void appendFallback(const char *data, size_t length) {
+        if (!fallback) {
+            fallback = BackPressurePool::get().acquire(MAX_FALLBACK_SIZE + MINIMUM_HTTP_POST_PADDING);
+        }
+        memcpy(fallback->data() + fallback->end, data, length);
+        fallback->end += length;
+    }
+
+    void clearFallback() {
+        if (fallback) {
+            BackPressurePool::get().release(fallback);
+            fallback = nullptr;
+        }
+    }
+
 public:
+    HttpParser() = default;
+    HttpParser(const HttpParser &) = delete;
+
+    ~HttpParser() {
+        clearFallback();
+    }
+
+    /* Content-Length body bytes of the current request not yet parsed, 0 for chunked bodies. Seen from
+     * a data handler, the chunk being handled is not yet subtracted */
+    uint64_t getRemainingBodyLength() {
+        return isParsingChunkedEncoding(remainingStreamingBytes) ? 0 : remainingStreamingBytes;
+    }
+
+    /* Whoever moved length of those bytes past us (such as with splice) tells us so. Never the last one,
+     * which has to come through us to end the body */
+    void skipBody(uint64_t length) {
+        remainingStreamingBytes -= length;
+    }
+
     std::pair<unsigned int, void *> consumePostPadded(char *data, unsigned int length, void *user, void *reserved, MoveOnlyFunction<void *(void *, HttpRequest *)> &&requestHandler, MoveOnlyFunction<void *(void *, std::string_view, bool)> &&dataHandler) {
 
         /* This resets BloomFilter by construction, but later we also reset it again.
@@ -626,7 +929,7 @@ public:
             /* It's either chunked or with a content-length */
             if (isParsingChunkedEncoding(remainingStreamingBytes)) {
                 std::string_view dataToConsume(data, length);
-                for (auto chunk : uWS::ChunkIterator(&dataToConsume, &remainingStreamingBytes)) {
+                for (auto chunk : uWS::ChunkIterator(&dataToConsume, &remainingStreamingBytes, false, true)) {
                     dataHandler(user, chunk, chunk.length() == 0);
                 }
                 if (isParsingInvalidChunkedEncoding(remainingStreamingBytes)) {
@@ -655,17 +958,16 @@ public:
                 }
             }
 
-        } else if (fallback.length()) {
-            unsigned int had = (unsigned int) fallback.length();
+        } else if (fallbackLength()) {
+            unsigned int had = (unsigned int) fallbackLength();
 
-            size_t maxCopyDistance = std::min<size_t>(MAX_FALLBACK_SIZE - fallback.length(), (size_t) length);
+            size_t maxCopyDistance = std::min<size_t>(MAX_FALLBACK_SIZE - fallbackLength(), (size_t) length);
 
-            /* We don't want fallback to be short string optimized, since we want to move it */
-            fallback.reserve(fallback.length() + maxCopyDistance + std::max<unsigned int>(MINIMUM_HTTP_POST_PADDING, sizeof(std::string)));
-            fallback.append(data, maxCopyDistance);
+            /* The chunk always has room for the post padding after MAX_FALLBACK_SIZE */
+            appendFallback(data, maxCopyDistance);
 
             // break here on break
-            std::pair<unsigned int, void *> consumed = fenceAndConsumePostPadded<true>(fallback.data(), (unsigned int) fallback.length(), user, reserved, &req, requestHandler, dataHandler);
+            std::pair<unsigned int, void *> consumed = fenceAndConsumePostPadded<true>(fallback->data(), (unsigned int) fallbackLength(), user, reserved, &req, requestHandler, dataHandler);
             if (consumed.second != user) {
                 return consumed;
             }
@@ -675,7 +977,7 @@ public:
                 /* This logic assumes that we consumed everything in fallback buffer.
                  * This is critically important, as we will get an integer overflow in case
                  * of "had" being larger than what we consumed, and that we would drop data */
-                fallback.clear();
+                clearFallback();
                 data += consumed.first - had;
                 length -= consumed.first - had;
 
@@ -683,7 +985,7 @@ public:
                     /* It's either chunked or with a content-length */
                     if (isParsingChunkedEncoding(remainingStreamingBytes)) {
                         std::string_view dataToConsume(data, length);
-                        for (auto chunk : uWS::ChunkIterator(&dataToConsume, &remainingStreamingBytes)) {
+                        for (auto chunk : uWS::ChunkIterator(&dataToConsume, &remainingStreamingBytes, false, true)) {
                             dataHandler(user, chunk, chunk.length() == 0);
                         }
                         if (isParsingInvalidChunkedEncoding(remainingStreamingBytes)) {
@@ -713,7 +1015,7 @@ public:
                 }
 
             } else {
-                if (fallback.length() == MAX_FALLBACK_SIZE) {
+                if (fallbackLength() == MAX_FALLBACK_SIZE) {
                     return {HTTP_ERROR_431_REQUEST_HEADER_FIELDS_TOO_LARGE, FULLPTR};
                 }
                 return {0, user};
@@ -730,7 +1032,7 @@ public:
 
         if (length) {
             if (length < MAX_FALLBACK_SIZE) {
-                fallback.append(data, length);
+                appendFallback(data, length);
             } else {
                 return {HTTP_ERROR_431_REQUEST_HEADER_FIELDS_TOO_LARGE, FULLPTR};
             }
@@ -741,6 +1043,171 @@ public:
     }
 };
 
+/* One response head, for HttpClient. Header names are lower cased and the last one is followed by an empty key */
+struct HttpResponseHead {
+    unsigned int status;
+    /* HTTP/1.0, which closes after the response unless it says keep-alive */
+    bool ancient;
+    std::string_view reason;
+    HttpRequest::Header *headers;
+
+    std::string_view getHeader(std::string_view lowerCasedHeader) {
+        for (HttpRequest::Header *h = headers; h->key.length(); h++) {
+            if (h->key == lowerCasedHeader) {
+                return h->value;
+            }
+        }
+        return std::string_view(nullptr, 0);
+    }
+};
+
+/* Parses responses, pipelined one after the other, with the header scanning of HttpParser and the ChunkIterator.
+ * A body is as long as its Content-Length says, chunked, or lasts until the connection closes. Data given to
+ * consume must be post padded and writable, like that of HttpParser */
+struct HttpResponseParser {
+    /* What the head handler wants done after a head */
+    enum HeadAction {
+        READ_BODY,
+        /* Responses to HEAD have none, whatever their headers say */
+        NO_BODY,
+        STOP
+    };
+
+private:
+    /* A partial head waits here for the rest */
+    std::string fallback;
+    /* Content-Length left or the chunked encoding state, like in HttpParser */
+    uint64_t remainingStreamingBytes = 0;
+    bool untilClose = false;
+
+    template <typename H, typename D>
+    bool consumePostPadded(char *data, unsigned int length, H &headHandler, D &dataHandler) {
+        while (length) {
+            if (untilClose) {
+                return dataHandler(std::string_view(data, length), false);
+            }
+
+            if (remainingStreamingBytes) {
+                if (isParsingChunkedEncoding(remainingStreamingBytes)) {
+                    std::string_view dataToConsume(data, length);
+                    for (auto chunk : ChunkIterator(&dataToConsume, &remainingStreamingBytes, false, true)) {
+                        if (!dataHandler(chunk, chunk.length() == 0)) {
+                            return false;
+                        }
+                    }
+                    if (isParsingInvalidChunkedEncoding(remainingStreamingBytes)) {
+                        return false;
+                    }
+                    data = (char *) dataToConsume.data();
+                    length = (unsigned int) dataToConsume.length();
+                } else {
+                    unsigned int emittable = (unsigned int) std::min<uint64_t>(remainingStreamingBytes, length);
+                    remainingStreamingBytes -= emittable;
+                    if (!dataHandler(std::string_view(data, emittable), remainingStreamingBytes == 0)) {
+                        return false;
+                    }
+                    data += emittable;
+                    length -= emittable;
+                }
+                continue;
+            }
+
+            /* Fenced like in HttpParser */
+            data[length] = '\r';
+            data[length + 1] = 'a';
+
+            HttpRequest::Header headers[UWS_HTTP_MAX_HEADERS_COUNT];
+            unsigned int err = 0;
+            unsigned int consumed = HttpParser::getHeaders<true>(data, data + length, headers, nullptr, err);
+            if (!consumed) {
+                if (err || length >= MAX_FALLBACK_SIZE) {
+                    return false;
+                }
+                fallback.assign(data, length);
+                return true;
+            }
+
+            HttpResponseHead head = {
+                (unsigned int) (headers[0].key[0] - '0') * 100 + (unsigned int) (headers[0].key[1] - '0') * 10 + (unsigned int) (headers[0].key[2] - '0'),
+                data[7] == '0',
+                headers[0].value,
+                headers + 1
+            };
+            data += consumed;
+            length -= consumed;
+
+            /* Interim responses such as 100 Continue come ahead of the real one */
+            if (head.status < 200 && head.status != 101) {
+                continue;
+            }
+
+            HeadAction action = headHandler(head);
+            if (action == STOP) {
+                return false;
+            }
+
+            /* RFC 9112 6.3, as for requests. Without either, the body lasts until close */
+            std::string_view transferEncodingString = head.getHeader("transfer-encoding");
+            std::string_view contentLengthString = head.getHeader("content-length");
+            if (action == NO_BODY || head.status == 204 || head.status == 304 || head.status == 101) {
+                if (!dataHandler(std::string_view(nullptr, 0), true)) {
+                    return false;
+                }
+            } else if (transferEncodingString.length()) {
+                if (contentLengthString.length()) {
+                    return false;
+                }
+                remainingStreamingBytes = STATE_IS_CHUNKED;
+            } else if (contentLengthString.length()) {
+                remainingStreamingBytes = HttpParser::toUnsignedInteger(contentLengthString);
+                if (remainingStreamingBytes == UINT64_MAX) {
+                    return false;
+                }
+                if (!remainingStreamingBytes && !dataHandler(std::string_view(nullptr, 0), true)) {
+                    return false;
+                }
+            } else {
+                untilClose = true;
+            }
+        }
+        return true;
+    }
+
+public:
+    /* Calls headHandler(HttpResponseHead &) -> HeadAction for every response and dataHandler(std::string_view, bool fin)
+     * -> bool for its body, ending with fin. Both see data only during the call. Returns false on invalid responses
+     * and when a handler stopped us */
+    template <typename H, typename D>
+    bool consume(char *data, unsigned int length, H &&headHandler, D &&dataHandler) {
+        if (fallback.length()) {
+            std::string buffer = std::move(fallback);
+            fallback.clear();
+            buffer.append(data, length);
+            unsigned int bufferLength = (unsigned int) buffer.length();
+            buffer.append(MINIMUM_HTTP_POST_PADDING, '\0');
+            return consumePostPadded(buffer.data(), bufferLength, headHandler, dataHandler);
+        }
+        return consumePostPadded(data, length, headHandler, dataHandler);
+    }
+
+    /* Content-Length body bytes of the current response not yet parsed, 0 for other bodies */
+    uint64_t getRemainingBodyLength() {
+        return isParsingChunkedEncoding(remainingStreamingBytes) ? 0 : remainingStreamingBytes;
+    }
+
+    /* See HttpParser::skipBody */
+    void skipBody(uint64_t length) {
+        remainingStreamingBytes -= length;
+    }
+
+    /* The connection closed. Returns true if that ended a body lasting until close */
+    bool end() {
+        bool ended = untilClose;
+        untilClose = false;
+        return ended;
+    }
+};
+
 }
 
 #endif // UWS_HTTPPARSER_H
@@ -0,0 +1,720 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_HTTPPROXY_H
+#define UWS_HTTPPROXY_H
+
+/* Reverse proxying to one plain HTTP/1.1 upstream over a pool of keep-alive connections, one request at a time
+ * on each. The request head goes upstream as it came, in runs of the bytes we received (header names lowercased
+ * by our parser), with only hop-by-hop headers taken out and X-Forwarded-For put in. Bodies stream both ways as
+ * they come, each side paused while the other one has backpressure. Content-Length bodies between plain sockets
+ * (or kTLS) are moved fd to fd with splice through the pipe of the loop, past the parsers, which only ever see
+ * what uSockets read before us. */
+
+#include "App.h"
+#include "HttpParser.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <charconv>
+
+namespace uWS {
+
+struct HttpProxyOptions {
+    /* Connections open (or opening) to the upstream at most, requests wait for one beyond that */
+    unsigned int maxConnections = 64;
+    /* Seconds an unused connection stays in the pool */
+    unsigned short idleTimeout = 30;
+    /* Seconds to connect, and for the upstream to say something once asked */
+    unsigned short timeout = 30;
+    /* Bytes buffered toward either side before the other one is paused */
+    unsigned int maxBackpressure = 64 * 1024;
+    /* Append the address of the client to X-Forwarded-For */
+    bool forwardedFor = true;
+};
+
+template <bool SSL>
+struct TemplatedHttpProxy {
+private:
+    struct ProxyContextData;
+
+    /* One request and its response, from forward until both are through */
+    struct Exchange {
+        ProxyContextData *proxyContextData;
+        HttpResponse<SSL> *res;
+        us_socket_t *upstream = nullptr;
+        /* The request so far, while waiting for an upstream */
+        std::string pending;
+        bool head;
+        /* Responses to HEAD, 204 and 304 */
+        bool noBody = false;
+        bool chunkedRequest;
+        bool requestDone = false;
+        /* Paused for backpressure upstream */
+        bool clientPaused = false;
+        /* The response has a Content-Length, which we send with tryEnd */
+        bool lengthKnown = false;
+        uintmax_t contentLength = 0;
+        /* What tryEnd could not send, from unsentOffset on */
+        std::string unsent;
+        uintmax_t unsentOffset = 0;
+    };
+
+    /* Ext of upstream sockets, first the AsyncSocketData so that AsyncSocket can write with backpressure */
+    struct UpstreamData : AsyncSocketData<false> {
+        ProxyContextData *proxyContextData;
+        Exchange *exchange = nullptr;
+        HttpResponseParser parser;
+        bool open = false;
+        bool keepAlive = true;
+        /* The response came whole */
+        bool responseDone = false;
+    };
+
+    /* Ext of the upstream socket context */
+    struct ProxyContextData {
+        HttpProxyOptions options;
+        std::string host;
+        int port;
+        unsigned int connections = 0;
+        std::vector<us_socket_t *> idle;
+        std::deque<Exchange *> waiting;
+        bool closing = false;
+    };
+
+    us_socket_context_t *socketContext = nullptr;
+
+    ProxyContextData *getProxyContextData() {
+        return (ProxyContextData *) us_socket_context_ext(false, socketContext);
+    }
+
+    /* Hop-by-hop, or framing we do ourselves (RFC 9110 7.6.1) */
+    static bool isHopByHop(std::string_view key) {
+        switch (key.length()) {
+        case 2:
+            return key == "te";
+        case 7:
+            return key == "upgrade" || key == "trailer";
+        case 10:
+            return key == "connection" || key == "keep-alive";
+        case 16:
+            return key == "proxy-connection";
+        case 17:
+            return key == "transfer-encoding";
+        }
+        return false;
+    }
+
+    static bool equalsLowerCased(std::string_view value, std::string_view lowerCased) {
+        return value.length() == lowerCased.length() && std::equal(value.begin(), value.end(), lowerCased.begin(), [](char a, char b) {
+            return (a | 0x20) == b;
+        });
+    }
+
+    /* Takes over the request, the head going upstream in runs of the bytes it came in */
+    void start(HttpResponse<SSL> *res, HttpRequest *req) {
+        ProxyContextData *proxyContextData = getProxyContextData();
+        Exchange *exchange = new Exchange;
+        exchange->proxyContextData = proxyContextData;
+        exchange->res = res;
+        exchange->head = req->getCaseSensitiveMethod() == "HEAD";
+        exchange->chunkedRequest = req->getHeader("transfer-encoding").length();
+
+        std::string &head = exchange->pending;
+        head.append(req->getCaseSensitiveMethod()).append(" ").append(req->getFullUrl()).append(" HTTP/1.1\r\n");
+
+        const char *run = nullptr, *end = nullptr;
+        std::string_view forwardedFor;
+        for (auto [key, value] : *req) {
+            bool dropped = isHopByHop(key) || (proxyContextData->options.forwardedFor && key == "x-forwarded-for");
+            if (dropped && run) {
+                head.append(run, (size_t) (key.data() - run));
+                run = nullptr;
+            } else if (!dropped && !run) {
+                run = key.data();
+            }
+            if (key == "x-forwarded-for") {
+                forwardedFor = value;
+            }
+            end = value.data() + value.length();
+        }
+        if (run) {
+            /* Past the whitespace we trimmed off the last value */
+            while (*end != '\r') {
+                end++;
+            }
+            head.append(run, (size_t) (end + 2 - run));
+        }
+
+        if (proxyContextData->options.forwardedFor) {
+            head.append("X-Forwarded-For: ");
+            if (forwardedFor.length()) {
+                head.append(forwardedFor).append(", ");
+            }
+            head.append(res->getRemoteAddressAsText()).append("\r\n");
+        }
+        if (exchange->chunkedRequest) {
+            head.append("Transfer-Encoding: chunked\r\n");
+        }
+        head.append("\r\n");
+
+        res->onAborted([exchange]() {
+            aborted(exchange);
+        });
+        res->onData([exchange](std::string_view chunk, bool fin) {
+            requestData(exchange, chunk, fin);
+        });
+
+        if (proxyContextData->idle.size()) {
+            us_socket_t *s = proxyContextData->idle.back();
+            proxyContextData->idle.pop_back();
+            attach(s, exchange);
+            return;
+        }
+        proxyContextData->waiting.push_back(exchange);
+        if (proxyContextData->connections < proxyContextData->options.maxConnections) {
+            connect(socketContext);
+        }
+    }
+
+    static void connect(us_socket_context_t *socketContext) {
+        ProxyContextData *proxyContextData = (ProxyContextData *) us_socket_context_ext(false, socketContext);
+        us_socket_t *s = us_socket_context_connect(false, socketContext, proxyContextData->host.c_str(), proxyContextData->port, nullptr, 0, sizeof(UpstreamData));
+        if (!s) {
+            /* Nothing can ever take what waits, unless something is connected already */
+            if (!proxyContextData->connections) {
+                failWaiting(proxyContextData);
+            }
+            return;
+        }
+        UpstreamData *upstreamData = new (us_socket_ext(false, s)) UpstreamData;
+        upstreamData->proxyContextData = proxyContextData;
+        proxyContextData->connections++;
+        us_socket_timeout(false, s, proxyContextData->options.timeout);
+    }
+
+    static void failWaiting(ProxyContextData *proxyContextData) {
+        while (proxyContextData->waiting.size()) {
+            Exchange *exchange = proxyContextData->waiting.front();
+            proxyContextData->waiting.pop_front();
+            fail(exchange);
+        }
+    }
+
+    /* Sends the request on an open upstream with nothing else to do */
+    static void attach(us_socket_t *s, Exchange *exchange) {
+        UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+        upstreamData->exchange = exchange;
+        upstreamData->responseDone = false;
+        exchange->upstream = s;
+        us_socket_timeout(false, s, upstreamData->proxyContextData->options.timeout);
+
+        ((AsyncSocket<false> *) s)->write(exchange->pending.data(), (int) exchange->pending.length());
+        std::string().swap(exchange->pending);
+        if (exchange->clientPaused && !((AsyncSocket<false> *) s)->getBufferedAmount()) {
+            exchange->clientPaused = false;
+            exchange->res->resume();
+        }
+    }
+
+    /* The upstream is done with its exchange, it goes back to the pool if it can take another */
+    static void detach(us_socket_t *s) {
+        UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+        ProxyContextData *proxyContextData = upstreamData->proxyContextData;
+        upstreamData->exchange->upstream = nullptr;
+        upstreamData->exchange = nullptr;
+
+        if (!upstreamData->keepAlive || proxyContextData->closing || ((AsyncSocket<false> *) s)->getBufferedAmount()) {
+            us_socket_close(false, s, 0, nullptr);
+        } else if (proxyContextData->waiting.size()) {
+            Exchange *next = proxyContextData->waiting.front();
+            proxyContextData->waiting.pop_front();
+            attach(s, next);
+        } else {
+            proxyContextData->idle.push_back(s);
+            us_socket_timeout(false, s, proxyContextData->options.idleTimeout);
+        }
+    }
+
+    /* Done with the exchange when the client has its response (or is gone) and the upstream let go of it */
+    static void release(Exchange *exchange) {
+        if (!exchange->upstream && !exchange->res) {
+            delete exchange;
+        }
+    }
+
+    /* The response is about to end. A request body still coming would go nowhere, it is ignored from here on */
+    static void ending(Exchange *exchange) {
+        if (!exchange->requestDone) {
+            exchange->res->onData(nullptr);
+            exchange->requestDone = true;
+            if (exchange->upstream) {
+                ((UpstreamData *) us_socket_ext(false, exchange->upstream))->keepAlive = false;
+            }
+        }
+        if (exchange->clientPaused) {
+            exchange->clientPaused = false;
+            exchange->res->resume();
+        }
+    }
+
+    /* No response, or only part of one, is coming. Whatever was started cannot be finished but by closing */
+    static void fail(Exchange *exchange) {
+        HttpResponse<SSL> *res = exchange->res;
+        if (!res) {
+            return;
+        }
+        ending(exchange);
+        exchange->res = nullptr;
+        if (res->getHttpResponseData()->state & HttpResponseData<SSL>::HTTP_STATUS_CALLED) {
+            res->onAborted(nullptr);
+            res->close();
+        } else {
+            res->writeStatus("502 Bad Gateway")->end("Bad Gateway");
+        }
+    }
+
+    /* The client went away */
+    static void aborted(Exchange *exchange) {
+        exchange->res = nullptr;
+        if (exchange->upstream) {
+            /* Whatever the upstream was up to, it is not worth waiting for. Its close releases us */
+            us_socket_close(false, exchange->upstream, 0, nullptr);
+            return;
+        }
+        std::erase(exchange->proxyContextData->waiting, exchange);
+        release(exchange);
+    }
+
+    /* A part of the request body, framed again if it came chunked */
+    static void requestData(Exchange *exchange, std::string_view chunk, bool fin) {
+        HttpProxyOptions &options = exchange->proxyContextData->options;
+        exchange->requestDone = fin;
+
+        std::string framed;
+        if (exchange->chunkedRequest) {
+            if (chunk.length()) {
+                char size[16];
+                auto [ptr, ec] = std::to_chars(size, size + sizeof(size), chunk.length(), 16);
+                framed.append(size, ptr).append("\r\n").append(chunk).append("\r\n");
+            }
+            if (fin) {
+                framed.append("0\r\n\r\n");
+            }
+            chunk = framed;
+        }
+
+        if (!exchange->upstream) {
+            exchange->pending.append(chunk);
+            if (exchange->pending.length() > options.maxBackpressure && !exchange->clientPaused && !fin) {
+                exchange->clientPaused = true;
+                exchange->res->pause();
+            }
+            return;
+        }
+
+        AsyncSocket<false> *upstream = (AsyncSocket<false> *) exchange->upstream;
+        auto [written, failed] = upstream->write(chunk.data(), (int) chunk.length());
+
+#ifdef __linux__
+        /* The rest of the body, still in the socket of the client, goes straight to the upstream */
+        if constexpr (!SSL) {
+            HttpResponseData<SSL> *httpResponseData = exchange->res->getHttpResponseData();
+            uint64_t unparsed = httpResponseData->getRemainingBodyLength() - chunk.length();
+            if (!fin && !failed && !exchange->chunkedRequest && unparsed > 1) {
+                uintmax_t moved;
+                std::tie(moved, failed) = upstream->writeSpliced((int) us_poll_fd((us_poll_t *) exchange->res), unparsed - 1);
+                httpResponseData->skipBody(moved);
+                if (moved) {
+                    us_socket_timeout(SSL, (us_socket_t *) exchange->res, HTTP_TIMEOUT_S);
+                }
+            }
+        }
+#endif
+
+        if (!fin && !exchange->clientPaused && (failed || upstream->getBufferedAmount() > options.maxBackpressure)) {
+            exchange->clientPaused = true;
+            exchange->res->pause();
+        }
+    }
+
+    /* The client has backpressure, the upstream waits until it took what it has */
+    static void pauseUpstream(Exchange *exchange) {
+        if (exchange->upstream) {
+            ((AsyncSocket<false> *) exchange->upstream)->pause();
+            us_socket_timeout(false, exchange->upstream, 0);
+        }
+    }
+
+    static void resumeUpstream(Exchange *exchange) {
+        if (exchange->upstream) {
+            ((AsyncSocket<false> *) exchange->upstream)->resume();
+            us_socket_timeout(false, exchange->upstream, exchange->proxyContextData->options.timeout);
+        }
+    }
+
+    /* Sends what tryEnd could not, continuing the upstream once all of it went out */
+    static bool drainUnsent(Exchange *exchange, uintmax_t offset) {
+        HttpResponse<SSL> *res = exchange->res;
+        std::string_view unsent = std::string_view(exchange->unsent).substr((size_t) (offset - exchange->unsentOffset));
+        bool last = offset + unsent.length() == exchange->contentLength;
+        if (last) {
+            ending(exchange);
+        }
+        auto [ok, done] = res->tryEnd(unsent, exchange->contentLength);
+        if (done) {
+            exchange->res = nullptr;
+            release(exchange);
+            return true;
+        }
+        if (ok) {
+            exchange->unsent.clear();
+            resumeUpstream(exchange);
+        }
+        return ok;
+    }
+
+    /* Drains the backpressure of write (or writeSpliced), continuing the upstream once all of it went out */
+    static bool drainWritten(Exchange *exchange) {
+        AsyncSocket<SSL> *asyncSocket = (AsyncSocket<SSL> *) exchange->res;
+        asyncSocket->write(nullptr, 0, true, 0);
+        if (asyncSocket->getBufferedAmount()) {
+            return false;
+        }
+        asyncSocket->timeout(HTTP_TIMEOUT_S);
+        exchange->res->onWritable(nullptr);
+        resumeUpstream(exchange);
+        return true;
+    }
+
+    static HttpResponseParser::HeadAction responseHead(Exchange *exchange, UpstreamData *upstreamData, HttpResponseHead &head) {
+        HttpResponse<SSL> *res = exchange->res;
+
+        /* We never ask to switch protocols */
+        if (head.status == 101) {
+            return HttpResponseParser::STOP;
+        }
+        std::string_view connection = head.getHeader("connection");
+        if (head.ancient ? !equalsLowerCased(connection, "keep-alive") : equalsLowerCased(connection, "close")) {
+            upstreamData->keepAlive = false;
+        }
+
+        std::string status = std::to_string(head.status);
+        res->writeStatus(status.append(" ").append(head.reason));
+        for (auto *h = head.headers; h->key.length(); h++) {
+            /* We write our own Date, and frame the body ourselves */
+            if (!isHopByHop(h->key) && h->key != "content-length" && h->key != "date") {
+                res->writeHeader(h->key, h->value);
+            }
+        }
+
+        /* These never have a body, whatever their headers say */
+        exchange->noBody = exchange->head || head.status == 204 || head.status == 304;
+        std::string_view contentLength = head.getHeader("content-length");
+        if (contentLength.length() && !head.getHeader("transfer-encoding").length()) {
+            exchange->lengthKnown = true;
+            std::from_chars(contentLength.data(), contentLength.data() + contentLength.length(), exchange->contentLength);
+            /* The client asked with HEAD too, it only wants to know how large */
+            if (exchange->head) {
+                res->writeHeader("Content-Length", exchange->contentLength);
+            }
+        }
+        return exchange->head ? HttpResponseParser::NO_BODY : HttpResponseParser::READ_BODY;
+    }
+
+    /* A part of the response body, which we may have to buffer while the client does not take it */
+    static bool responseData(Exchange *exchange, UpstreamData *upstreamData, std::string_view chunk, bool fin) {
+        HttpResponse<SSL> *res = exchange->res;
+        if (fin) {
+            upstreamData->responseDone = true;
+            ending(exchange);
+        }
+
+        if (exchange->noBody) {
+            res->endWithoutBody();
+            exchange->res = nullptr;
+        } else if (exchange->lengthKnown) {
+            if (exchange->unsent.length()) {
+                exchange->unsent.append(chunk);
+                return true;
+            }
+            uintmax_t offset = res->getWriteOffset();
+            auto [ok, done] = res->tryEnd(chunk, exchange->contentLength);
+            if (done) {
+                exchange->res = nullptr;
+            } else if (!ok) {
+                exchange->unsent.assign(chunk.substr((size_t) (res->getWriteOffset() - offset)));
+                exchange->unsentOffset = res->getWriteOffset();
+                pauseUpstream(exchange);
+                res->onWritable([exchange](uintmax_t offset) {
+                    return drainUnsent(exchange, offset);
+                });
+            }
+        } else {
+            if (chunk.length() && !res->write(chunk) && !fin) {
+                pauseUpstream(exchange);
+                res->onWritable([exchange](uintmax_t) {
+                    return drainWritten(exchange);
+                });
+            }
+            if (fin) {
+                res->onWritable(nullptr);
+                res->end();
+                exchange->res = nullptr;
+            }
+        }
+        return true;
+    }
+
+    void init(HttpProxyOptions options) {
+        ProxyContextData *proxyContextData = new (getProxyContextData()) ProxyContextData;
+        options.maxConnections = std::max(options.maxConnections, 1u);
+        proxyContextData->options = options;
+
+        us_socket_context_on_open(false, socketContext, [](us_socket_t *s, int /*isClient*/, char */*ip*/, int /*ipLength*/) {
+            UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+            ProxyContextData *proxyContextData = upstreamData->proxyContextData;
+            ((AsyncSocket<false> *) s)->getLoopData()->numSockets.fetch_add(1, std::memory_order_relaxed);
+
+            upstreamData->open = true;
+            if (proxyContextData->waiting.size()) {
+                Exchange *exchange = proxyContextData->waiting.front();
+                proxyContextData->waiting.pop_front();
+                attach(s, exchange);
+            } else {
+                proxyContextData->idle.push_back(s);
+                us_socket_timeout(false, s, proxyContextData->options.idleTimeout);
+            }
+            return s;
+        });
+
+        us_socket_context_on_data(false, socketContext, [](us_socket_t *s, char *data, int length) {
+            UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+            Exchange *exchange = upstreamData->exchange;
+
+            /* Nothing was asked for */
+            if (!exchange || upstreamData->responseDone) {
+                return us_socket_close(false, s, 0, nullptr);
+            }
+            us_socket_timeout(false, s, upstreamData->proxyContextData->options.timeout);
+
+            /* What the upstream said in one read goes to the client in one write */
+            bool valid = true;
+            exchange->res->cork([upstreamData, exchange, data, length, &valid]() {
+                valid = upstreamData->parser.consume(data, (unsigned int) length, [upstreamData, exchange](HttpResponseHead &head) {
+                    if (upstreamData->responseDone) {
+                        return HttpResponseParser::STOP;
+                    }
+                    return responseHead(exchange, upstreamData, head);
+                }, [upstreamData, exchange](std::string_view chunk, bool fin) {
+                    return responseData(exchange, upstreamData, chunk, fin);
+                });
+            });
+
+            if (!valid) {
+                fail(exchange);
+                return us_socket_close(false, s, 0, nullptr);
+            }
+
+#ifdef __linux__
+            /* The rest of the body, still in the socket of the upstream, goes straight to the client */
+            uint64_t unparsed = upstreamData->parser.getRemainingBodyLength();
+            if (exchange->res && exchange->lengthKnown && !exchange->unsent.length() && unparsed > 1) {
+                HttpResponse<SSL> *res = exchange->res;
+                auto [moved, failed] = ((AsyncSocket<SSL> *) res)->writeSpliced((int) us_poll_fd((us_poll_t *) s), unparsed - 1);
+                upstreamData->parser.skipBody(moved);
+                res->getHttpResponseData()->offset += moved;
+                if (failed) {
+                    pauseUpstream(exchange);
+                    res->onWritable([exchange](uintmax_t) {
+                        return drainWritten(exchange);
+                    });
+                }
+            }
+#endif
+
+            /* The client may still be taking what we buffered, the exchange then lasts until it did */
+            if (upstreamData->responseDone) {
+                detach(s);
+                release(exchange);
+            }
+            return s;
+        });
+
+        us_socket_context_on_close(false, socketContext, [](us_socket_t *s, int /*code*/, void */*reason*/) {
+            UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+            ProxyContextData *proxyContextData = upstreamData->proxyContextData;
+            Exchange *exchange = upstreamData->exchange;
+
+            /* Connecting sockets we gave up on close too */
+            if (upstreamData->open) {
+                ((AsyncSocket<false> *) s)->getLoopData()->numSockets.fetch_sub(1, std::memory_order_relaxed);
+            }
+            proxyContextData->connections--;
+            std::erase(proxyContextData->idle, s);
+
+            if (exchange) {
+                exchange->upstream = nullptr;
+                /* A body lasting until close just ended */
+                if (exchange->res && !upstreamData->responseDone && upstreamData->parser.end()) {
+                    responseData(exchange, upstreamData, {}, true);
+                } else {
+                    fail(exchange);
+                }
+                release(exchange);
+            }
+            upstreamData->~UpstreamData();
+
+            /* What waits needs a connection of its own */
+            if (!proxyContextData->closing && proxyContextData->waiting.size() && proxyContextData->connections < proxyContextData->waiting.size()
+                && proxyContextData->connections < proxyContextData->options.maxConnections) {
+                connect(us_socket_context(false, s));
+            }
+            return s;
+        });
+
+        /* Connecting sockets never opened, so there is no close */
+        us_socket_context_on_connect_error(false, socketContext, [](us_socket_t *s, int /*code*/) {
+            UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+            ProxyContextData *proxyContextData = upstreamData->proxyContextData;
+            upstreamData->~UpstreamData();
+            proxyContextData->connections--;
+
+            if (!proxyContextData->connections) {
+                failWaiting(proxyContextData);
+            }
+            return s;
+        });
+
+        us_socket_context_on_timeout(false, socketContext, [](us_socket_t *s) {
+            return us_socket_close(false, s, 0, nullptr);
+        });
+
+        us_socket_context_on_end(false, socketContext, [](us_socket_t *s) {
+            return us_socket_close(false, s, 0, nullptr);
+        });
+
+        us_socket_context_on_writable(false, socketContext, [](us_socket_t *s) {
+            UpstreamData *upstreamData = (UpstreamData *) us_socket_ext(false, s);
+            Exchange *exchange = upstreamData->exchange;
+
+            /* Drain the request, and continue the client once it is all out */
+            AsyncSocket<false> *asyncSocket = (AsyncSocket<false> *) s;
+            asyncSocket->write(nullptr, 0, true, 0);
+            if (exchange && exchange->clientPaused && exchange->res && !asyncSocket->getBufferedAmount()) {
+                exchange->clientPaused = false;
+                exchange->res->resume();
+            }
+            return s;
+        });
+    }
+
+public:
+    /* Proxies to upstream, given as http://host:port */
+    TemplatedHttpProxy(std::string_view url, HttpProxyOptions options = {}) {
+        std::string_view upstream = url;
+        std::string host;
+        int port = 80;
+        if (upstream.substr(0, 7) == "http://") {
+            upstream.remove_prefix(7);
+            if (upstream.length() && upstream.back() == '/') {
+                upstream.remove_suffix(1);
+            }
+            size_t portStart = upstream.rfind(':');
+            if (portStart != std::string_view::npos && upstream.find(']', portStart) == std::string_view::npos) {
+                auto [ptr, ec] = std::from_chars(upstream.data() + portStart + 1, upstream.data() + upstream.length(), port);
+                if (ec != std::errc() || ptr != upstream.data() + upstream.length()) {
+                    port = 0;
+                }
+                upstream = upstream.substr(0, portStart);
+            }
+            if (upstream.length() > 2 && upstream.front() == '[' && upstream.back() == ']') {
+                upstream = upstream.substr(1, upstream.length() - 2);
+            }
+            host = upstream;
+        }
+        if (!host.length() || host.find('/') != std::string::npos || port <= 0 || port > 65535) {
+            std::cerr << "Error: cannot proxy to malformed upstream " << url << "!" << std::endl;
+            return;
+        }
+
+        socketContext = us_create_socket_context(false, (us_loop_t *) Loop::get(), sizeof(ProxyContextData), {});
+        if (socketContext) {
+            init(options);
+            getProxyContextData()->host = std::move(host);
+            getProxyContextData()->port = port;
+        }
+    }
+
+    ~TemplatedHttpProxy() {
+        if (socketContext) {
+            close();
+            getProxyContextData()->~ProxyContextData();
+            us_socket_context_free(false, socketContext);
+        }
+    }
+
+    /* Disallow copying, only move */
+    TemplatedHttpProxy(const TemplatedHttpProxy &other) = delete;
+
+    TemplatedHttpProxy(TemplatedHttpProxy &&other) {
+        socketContext = other.socketContext;
+        other.socketContext = nullptr;
+    }
+
+    bool constructorFailed() {
+        return !socketContext;
+    }
+
+    /* Answers the request with whatever the upstream answers, or 502 Bad Gateway. Call it from a handler,
+     * before reading the body, and leave res alone from then on */
+    void forward(HttpResponse<SSL> *res, HttpRequest *req) {
+        if (!socketContext || getProxyContextData()->closing) {
+            res->writeStatus("502 Bad Gateway")->end("Bad Gateway");
+            return;
+        }
+        start(res, req);
+    }
+
+    /* A handler forwarding everything, for App.any and friends */
+    auto handler() {
+        return [this](HttpResponse<SSL> *res, HttpRequest *req) {
+            forward(res, req);
+        };
+    }
+
+    /* Closes every upstream connection, failing whatever was forwarded and is not yet answered */
+    void close() {
+        if (socketContext) {
+            ProxyContextData *proxyContextData = getProxyContextData();
+            if (!proxyContextData->closing) {
+                proxyContextData->closing = true;
+                us_socket_context_close(false, socketContext);
+                failWaiting(proxyContextData);
+            }
+        }
+    }
+};
+
+typedef TemplatedHttpProxy<false> HttpProxy;
+typedef TemplatedHttpProxy<true> SSLHttpProxy;
+
+}
+
+#endif // UWS_HTTPPROXY_H
@@ -24,6 +24,8 @@
 #include "HttpResponseData.h"
 #include "HttpContext.h"
 #include "HttpContextData.h"
+#include "ResponseTemplate.h"
+#include "Coroutine.h"
 #include "Utilities.h"
 
 #include "WebSocketExtensions.h"
@@ -47,21 +49,146 @@ template <bool SSL>
 struct HttpResponse : public AsyncSocket<SSL> {
     /* Solely used for getHttpResponseData() */
     template <bool> friend struct TemplatedApp;
+    template <bool> friend struct HttpContext;
+    template <bool> friend struct TemplatedHttpProxy;
     typedef AsyncSocket<SSL> Super;
 private:
     HttpResponseData<SSL> *getHttpResponseData() {
         return (HttpResponseData<SSL> *) Super::getAsyncSocketData();
     }
 
-    /* Write an unsigned 32-bit integer in hex */
-    void writeUnsignedHex(unsigned int value) {
-        /* Buf really only needs to be 8 long but building with
+    /* Closes the connection with 503, while our loop lags behind (see Loop::setMaxLag) */
+    void endServiceUnavailable() {
+        static constexpr std::string_view serviceUnavailable = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        UWS_METRIC(Super::getLoopData(), lagRejectedRequests, 1);
+        getHttpResponseData()->state |= HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE;
+        endFramed(serviceUnavailable);
+    }
+
+    /* Over the request rate of this address, see TemplatedApp::rateLimit */
+    void endTooManyRequests() {
+        static constexpr std::string_view tooManyRequests = "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 1\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        UWS_METRIC(Super::getLoopData(), rateLimitedRequests, 1);
+        getHttpResponseData()->state |= HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE;
+        endFramed(tooManyRequests);
+    }
+
+    /* Over maxBytes of collectBody, the rest of the body is not read */
+    void endPayloadTooLarge() {
+        static constexpr std::string_view payloadTooLarge = "HTTP/1.1 413 Payload Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        getHttpResponseData()->state |= HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE;
+        endFramed(payloadTooLarge);
+    }
+
+    /* CRLF, 8 hex digits and CRLF. Leading zeros are fine, so a chunk keeps its header as it grows */
+    static const unsigned int CHUNK_HEADER_SIZE = 12;
+
+    static void writeChunkHeader(char *dst, unsigned int length) {
+        const char palette[] = "0123456789abcdef";
+        dst[0] = '\r';
+        dst[1] = '\n';
+        for (int i = 9; i >= 2; i--) {
+            dst[i] = palette[length & 15];
+            length >>= 4;
+        }
+        dst[10] = '\r';
+        dst[11] = '\n';
+    }
+
+    /* Frames data as a chunk. While corked, the chunk is put together in the cork buffer and later writes
+     * of the same iteration grow it by patching its size, so many small writes become one chunk */
+    bool writeChunk(std::string_view data) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+        LoopData *loopData = Super::getLoopData();
+
+        if (Super::isCorked() && !Super::getBufferedAmount()) {
+            unsigned int space = loopData->corkBufferSize - loopData->corkOffset;
+
+            /* Nothing was written after our chunk, so it can grow */
+            if (httpResponseData->chunkEnd && httpResponseData->chunkEnd == loopData->corkOffset && space >= data.length()) {
+                memcpy(loopData->corkBuffer + loopData->corkOffset, data.data(), data.length());
+                loopData->corkOffset += (unsigned int) data.length();
+                httpResponseData->chunkLength += (unsigned int) data.length();
+                httpResponseData->chunkEnd = loopData->corkOffset;
+                writeChunkHeader(loopData->corkBuffer + httpResponseData->chunkHeader, httpResponseData->chunkLength);
+                return true;
+            }
+
+            /* Begin a new one */
+            if (space >= CHUNK_HEADER_SIZE + data.length()) {
+                httpResponseData->chunkHeader = loopData->corkOffset;
+                writeChunkHeader(loopData->corkBuffer + loopData->corkOffset, (unsigned int) data.length());
+                memcpy(loopData->corkBuffer + loopData->corkOffset + CHUNK_HEADER_SIZE, data.data(), data.length());
+                loopData->corkOffset += CHUNK_HEADER_SIZE + (unsigned int) data.length();
+                httpResponseData->chunkLength = (unsigned int) data.length();
+                httpResponseData->chunkEnd = loopData->corkOffset;
+                return true;
+            }
+        }
+
+        /* Too large for the cork buffer, written on its own. Header really only needs to be 12 long but building with
          * -mavx2, GCC still wants to overstep it so made it 16 */
-        char buf[16];
-        int length = utils::u32toaHex(value, buf);
+        httpResponseData->chunkEnd = 0;
+        char header[16] = {'\r', '\n'};
+        int length = utils::u32toaHex((unsigned int) data.length(), header + 2);
+        header[length + 2] = '\r';
+        header[length + 3] = '\n';
+        Super::write(header, length + 4);
 
-        /* For now we do this copy */
-        Super::write(buf, length);
+        auto [written, failed] = Super::write(data.data(), (int) data.length());
+        return !failed;
+    }
+
+    /* Write mark and Transfer-Encoding on first call to write */
+    void beginChunked() {
+        writeStatus(HTTP_200_OK);
+
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        if (!(httpResponseData->state & HttpResponseData<SSL>::HTTP_WRITE_CALLED)) {
+            writeMark();
+
+            writeHeader("Transfer-Encoding", "chunked");
+            httpResponseData->state |= HttpResponseData<SSL>::HTTP_WRITE_CALLED;
+            httpResponseData->chunkEnd = 0;
+
+            /* A streamed body is compressed whatever its size, flushing every write */
+            if (ContentEncoding contentEncoding = httpResponseData->contentEncoding) {
+                writeHeader("Content-Encoding", CONTENT_ENCODING_NAMES[contentEncoding]);
+                writeHeader("Vary", "Accept-Encoding");
+                httpResponseData->compressor = new HttpCompressor(contentEncoding, getHttpContextData()->compression.level);
+            }
+        }
+    }
+
+    HttpContextData<SSL> *getHttpContextData() {
+        return (HttpContextData<SSL> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) this));
+    }
+
+    /* Ends with the whole body compressed as negotiated. Returns false if it is better sent as it is: when it is
+     * small, does not get smaller or parts of the response went out with write or tryEnd */
+    bool endCompressed(std::string_view data, bool closeConnection) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+        HttpCompressionOptions &compression = getHttpContextData()->compression;
+
+        if (httpResponseData->state & (HttpResponseData<SSL>::HTTP_WRITE_CALLED | HttpResponseData<SSL>::HTTP_END_CALLED) || data.length() < compression.minSize) {
+            return false;
+        }
+
+        ContentEncoding contentEncoding = httpResponseData->contentEncoding;
+        std::string_view compressed;
+        {
+            UWS_PHASE(Super::getLoopData(), compressCycles);
+            compressed = Super::getLoopData()->compressHttpBody(contentEncoding, compression.level, data);
+        }
+        if (!compressed.length() || compressed.length() >= data.length()) {
+            return false;
+        }
+
+        writeHeader("Content-Encoding", CONTENT_ENCODING_NAMES[contentEncoding]);
+        writeHeader("Vary", "Accept-Encoding");
+        internalEnd(compressed, compressed.length(), false, true, closeConnection);
+        return true;
     }
 
     /* Write an unsigned 64-bit integer */
@@ -89,7 +216,9 @@ private:
 
     /* Returns true on success, indicating that it might be feasible to write more data.
      * Will start timeout if stream reaches totalSize or write failure. */
-    bool internalEnd(std::string_view data, uintmax_t totalSize, bool optional, bool allowContentLength = true, bool closeConnection = false) {
+    bool internalEnd(std::string_view data, uintmax_t totalSize, bool optional, bool allowContentLength = true, bool closeConnection = false, SharedFrame *frame = nullptr) {
+        UWS_PHASE(Super::getLoopData(), formatCycles);
+
         /* Write status if not already done */
         writeStatus(HTTP_200_OK);
 
@@ -119,18 +248,31 @@ private:
 
             /* We do not have tryWrite-like functionalities, so ignore optional in this path */
 
+            /* The rest of a compressed stream, which always has an end to it */
+            if (httpResponseData->compressor) {
+                UWS_PHASE(Super::getLoopData(), compressCycles);
+                data = httpResponseData->compressor->compress(data, true);
+            }
+
             /* Do not allow sending 0 chunk here */
             if (data.length()) {
-                Super::write("\r\n", 2);
-                writeUnsignedHex((unsigned int) data.length());
-                Super::write("\r\n", 2);
+                /* Trailers are the very end of the body */
+                if (httpResponseData->state & HttpResponseData<SSL>::HTTP_TRAILER_WRITTEN) {
+                    std::cerr << "Error: Data must not be written after trailers!" << std::endl;
+                    std::terminate();
+                }
 
                 /* Ignoring optional for now */
-                Super::write(data.data(), (int) data.length());
+                writeChunk(data);
             }
 
-            /* Terminating 0 chunk */
-            Super::write("\r\n0\r\n\r\n", 7);
+            /* Terminating 0 chunk, unless it went out ahead of trailers */
+            if (httpResponseData->state & HttpResponseData<SSL>::HTTP_TRAILER_WRITTEN) {
+                Super::write("\r\n", 2);
+            } else {
+                Super::write("\r\n0\r\n\r\n", 7);
+            }
+            httpResponseData->chunkEnd = 0;
 
             httpResponseData->markDone();
 
@@ -180,7 +322,9 @@ private:
             bool failed = false;
             while (written < data.length() && !failed) {
                 /* uSockets only deals with int sizes, so pass chunks of max signed int size */
-                auto writtenFailed = Super::write(data.data() + written, (int) std::min<size_t>(data.length() - written, INT_MAX), optional);
+                /* Data within a frame is referenced rather than copied by backpressure */
+                int length = (int) std::min<size_t>(data.length() - written, INT_MAX);
+                auto writtenFailed = frame ? Super::writeShared(frame, data.data() + written, length, optional) : Super::write(data.data() + written, length, optional);
 
                 written += (size_t) writtenFailed.first;
                 failed = writtenFailed.second;
@@ -219,6 +363,73 @@ private:
         }
     }
 
+#ifndef _WIN32
+    /* Writes off as much of the file as the socket takes, finishing the response when all of it is sent.
+     * Returns true if we did not run into backpressure */
+    bool drainFile() {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        auto [written, failed] = Super::writeFile(httpResponseData->fileFd, httpResponseData->fileOffset + httpResponseData->offset,
+            httpResponseData->fileLength - httpResponseData->offset);
+        httpResponseData->offset += written;
+
+        /* Same timeout as tryEnd, the rest goes out from the writable handler */
+        Super::timeout(HTTP_TIMEOUT_S);
+        if (httpResponseData->offset < httpResponseData->fileLength) {
+            return false;
+        }
+
+        httpResponseData->markDone();
+
+        /* We need to check if we should close this socket here now */
+        if (!Super::isCorked()) {
+            if (httpResponseData->state & HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE) {
+                if (((AsyncSocket<SSL> *) this)->getBufferedAmount() == 0) {
+                    ((AsyncSocket<SSL> *) this)->shutdown();
+                    /* We need to force close after sending FIN since we want to hinder
+                     * clients from keeping to send their huge data */
+                    ((AsyncSocket<SSL> *) this)->close();
+                }
+            }
+        }
+        return !failed;
+    }
+
+    /* Answers a GET or HEAD of asset as StaticAssets::answer decided, see TemplatedApp::serveStatic */
+    void endAsset(StaticAssets::Asset *asset, StaticAssets::Answer answer, uintmax_t offset, uintmax_t length, bool head) {
+        char contentRange[64];
+        if (answer == StaticAssets::NOT_MODIFIED) {
+            endFramed(asset->notModified, asset->notModifiedDate);
+            return;
+        } else if (answer == StaticAssets::UNSATISFIABLE) {
+            writeStatus("416 Range Not Satisfiable");
+            snprintf(contentRange, sizeof(contentRange), "bytes */%ju", asset->size);
+            writeHeader("Content-Range", contentRange);
+            internalEnd({}, 0, false);
+            return;
+        } else if (answer == StaticAssets::FULL) {
+            if (head || asset->ok.length()) {
+                head ? endFramed(asset->head, asset->headDate) : endFramed(asset->ok, asset->okDate);
+                return;
+            }
+            writeStatus(HTTP_200_OK);
+        } else {
+            writeStatus("206 Partial Content");
+            snprintf(contentRange, sizeof(contentRange), "bytes %ju-%ju/%ju", offset, offset + length - 1, asset->size);
+            writeHeader("Content-Range", contentRange);
+        }
+        Super::write(asset->headers.data(), (int) asset->headers.length());
+
+        /* Large files go out with sendfile, keeping the file for as long as it takes even if reloaded meanwhile */
+        if (asset->file) {
+            getHttpResponseData()->file = asset->file->share();
+            sendFile(asset->file->fd, offset, length);
+        } else {
+            internalEnd(asset->body.substr((size_t) offset, (size_t) length), length, false);
+        }
+    }
+#endif
+
 public:
     /* If we have proxy support; returns the proxed source address as reported by the proxy. */
 #ifdef UWS_WITH_PROXY
@@ -227,7 +438,11 @@ public:
     }
 
     std::string_view getProxiedRemoteAddressAsText() {
-        return Super::addressAsText(getProxiedRemoteAddress());
+        ProxyParser &proxyParser = getHttpResponseData()->proxyParser;
+        if (proxyParser.getSourceAddressAsText().empty()) {
+            proxyParser.setSourceAddressAsText(Super::addressAsText(proxyParser.getSourceAddress()));
+        }
+        return proxyParser.getSourceAddressAsText();
     }
 #endif
 
@@ -238,10 +453,16 @@ public:
             std::string_view secWebSocketExtensions,
             struct us_socket_context_t *webSocketContext) {
 
+        /* A loop lagging behind takes on no more WebSockets */
+        if (Super::getLoopData()->overLag(100, REJECT_UPGRADES)) {
+            endServiceUnavailable();
+            return;
+        }
+
         /* Extract needed parameters from WebSocketContextData */
         WebSocketContextData<SSL, UserData> *webSocketContextData = (WebSocketContextData<SSL, UserData> *) us_socket_context_ext(SSL, webSocketContext);
 
-        /* Note: OpenSSL can be used here to speed this up somewhat */
+        /* SHA-1 and base64 run on whatever the CPU accelerates, see WebSocketHandshake */
         char secWebSocketAccept[29] = {};
         WebSocketHandshake::generate(secWebSocketKey.data(), secWebSocketAccept);
 
@@ -258,23 +479,26 @@ public:
         /* Negotiate compression */
         bool perMessageDeflate = false;
         CompressOptions compressOptions = CompressOptions::DISABLED;
+        bool dictionary = false;
         if (secWebSocketExtensions.length() && webSocketContextData->compression != DISABLED) {
 
-            /* Make sure to map SHARED_DECOMPRESSOR to windowBits = 0, not 1  */
+            /* Make sure to map SHARED_DECOMPRESSOR to windowBits = 0, not 1. Compressors that may be freed when idle
+             * take no_context_takeover, so that no decompressor state outlives a message either */
             int wantedInflationWindow = 0;
-            if ((webSocketContextData->compression & CompressOptions::_DECOMPRESSOR_MASK) != CompressOptions::SHARED_DECOMPRESSOR) {
+            if ((webSocketContextData->compression & CompressOptions::_DECOMPRESSOR_MASK) != CompressOptions::SHARED_DECOMPRESSOR && !webSocketContextData->compressorIdleTimeout) {
                 wantedInflationWindow = (webSocketContextData->compression & CompressOptions::_DECOMPRESSOR_MASK) >> 8;
             }
 
             /* Map from selected compressor (this automatically maps SHARED_COMPRESSOR to windowBits 0, not 1) */
             int wantedCompressionWindow = (webSocketContextData->compression & CompressOptions::_COMPRESSOR_MASK) >> 4;
 
-            auto [negCompression, negCompressionWindow, negInflationWindow, negResponse] =
+            auto [negCompression, negCompressionWindow, negInflationWindow, negResponse, negDictionary] =
             negotiateCompression(true, wantedCompressionWindow, wantedInflationWindow,
-                                        secWebSocketExtensions);
+                                        secWebSocketExtensions, webSocketContextData->compressionDictionaryId);
 
             if (negCompression) {
                 perMessageDeflate = true;
+                dictionary = negDictionary;
 
                 /* Map from negotiated windowBits to compressor and decompressor */
                 if (negCompressionWindow == 0) {
@@ -288,6 +512,11 @@ public:
                     if (webSocketContextData->compression & DEDICATED_COMPRESSOR_3KB) {
                         compressOptions = DEDICATED_COMPRESSOR_3KB;
                     }
+
+                    /* Our sliding window comes from the pool, unless the peer limited it below the size of the pool */
+                    if ((webSocketContextData->compression & POOLED_COMPRESSOR) && negCompressionWindow == wantedCompressionWindow) {
+                        compressOptions = POOLED_COMPRESSOR;
+                    }
                 }
 
                 /* Here we modify the above compression with negotiated decompressor */
@@ -309,11 +538,22 @@ public:
         /* Move any backpressure out of HttpResponse */
         BackPressure backpressure(std::move(((AsyncSocketData<SSL> *) getHttpResponseData())->buffer));
 
+#ifdef UWS_WITH_KTLS
+        /* The kernel keeps encrypting for the WebSocket */
+        bool kernelTls = getHttpResponseData()->kernelTls;
+#endif
+
+        /* And records keep their size */
+        unsigned short tlsInitialRecordSize = getHttpResponseData()->tlsInitialRecordSize;
+        unsigned short tlsRecordSize = getHttpResponseData()->tlsRecordSize;
+        unsigned int tlsLastWrite = getHttpResponseData()->tlsLastWrite;
+
         /* Destroy HttpResponseData */
         getHttpResponseData()->~HttpResponseData();
 
         /* Before we adopt and potentially change socket, check if we are corked */
         bool wasCorked = Super::isCorked();
+        bool readsPaused = Super::forgetPausedReads();
 
         /* Adopting a socket invalidates it, do not rely on it directly to carry any data */
         WebSocket<SSL, true, UserData> *webSocket = (WebSocket<SSL, true, UserData> *) us_socket_context_adopt_socket(SSL,
@@ -323,9 +563,22 @@ public:
         if (wasCorked) {
             webSocket->AsyncSocket<SSL>::corkUnchecked();
         }
+        UWS_CAPTURE(webSocket->AsyncSocket<SSL>::getLoopData(), move(this, webSocket));
+
+        /* Reads paused over the backpressure budget resume with the new socket */
+        if (readsPaused) {
+            webSocket->AsyncSocket<SSL>::getLoopData()->pausedReads.push_back({webSocket, Super::resumePausedReads});
+        }
 
         /* Initialize websocket with any moved backpressure intact */
-        webSocket->init(perMessageDeflate, compressOptions, std::move(backpressure));
+        webSocket->init(perMessageDeflate, compressOptions, std::move(backpressure), dictionary);
+#ifdef UWS_WITH_KTLS
+        webSocket->AsyncSocket<SSL>::getAsyncSocketData()->kernelTls = kernelTls;
+        webSocket->AsyncSocket<SSL>::getAsyncSocketData()->kernelTlsTried = true;
+#endif
+        webSocket->AsyncSocket<SSL>::getAsyncSocketData()->tlsInitialRecordSize = tlsInitialRecordSize;
+        webSocket->AsyncSocket<SSL>::getAsyncSocketData()->tlsRecordSize = tlsRecordSize;
+        webSocket->AsyncSocket<SSL>::getAsyncSocketData()->tlsLastWrite = tlsLastWrite;
 
         /* We should only mark this if inside the parser; if upgrading "async" we cannot set this */
         HttpContextData<SSL> *httpContextData = httpContext->getSocketContextData();
@@ -342,6 +595,7 @@ public:
 
         /* Move construct the UserData right before calling open handler */
         new (webSocket->getUserData()) UserData(std::move(userData));
+        webSocketContextData->openSockets.insert((us_socket_t *) webSocket);
 
         /* Emit open event and start the timeout */
         if (webSocketContextData->openHandler) {
@@ -381,6 +635,7 @@ public:
 
     /* Write the HTTP status */
     HttpResponse *writeStatus(std::string_view status) {
+        UWS_PHASE(Super::getLoopData(), formatCycles);
         HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
 
         /* Do not allow writing more than one status */
@@ -399,8 +654,17 @@ public:
 
     /* Write an HTTP header with string value */
     HttpResponse *writeHeader(std::string_view key, std::string_view value) {
+        UWS_PHASE(Super::getLoopData(), formatCycles);
         writeStatus(HTTP_200_OK);
 
+        /* A body you encoded yourself is not compressed again */
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+        if (httpResponseData->contentEncoding && key.length() == 16 && std::equal(key.begin(), key.end(), "content-encoding", [](char a, char b) {
+            return (a | 0x20) == b;
+        })) {
+            httpResponseData->contentEncoding = IDENTITY;
+        }
+
         Super::write(key.data(), (int) key.length());
         Super::write(": ", 2);
         Super::write(value.data(), (int) value.length());
@@ -428,19 +692,123 @@ public:
         }
     }
 
-    /* End the response with an optional data chunk. Always starts a timeout. */
+    /* End the response with an optional data chunk. Always starts a timeout.
+     * With TemplatedApp::compress the body is compressed, if large enough and the client accepts it */
     void end(std::string_view data = {}, bool closeConnection = false) {
+        if (getHttpResponseData()->contentEncoding && endCompressed(data, closeConnection)) {
+            return;
+        }
+        internalEnd(data, data.length(), false, true, closeConnection);
+    }
+
+    /* Same as above, but whatever of a large body the socket does not take right away is moved into
+     * its backpressure instead of copied */
+    template <typename STRING, typename = std::enable_if_t<std::is_same_v<STRING, std::string>>>
+    void end(STRING &&data, bool closeConnection = false) {
+        if (getHttpResponseData()->contentEncoding && endCompressed(data, closeConnection)) {
+            return;
+        }
+        if (data.length() <= Super::getLoopData()->corkBufferSize) {
+            internalEnd(data, data.length(), false, true, closeConnection);
+            return;
+        }
+        end(SharedBuffer(std::move(data)), closeConnection);
+    }
+
+    /* Same as above, for a body sent to many sockets. Backpressure references it instead of copying it.
+     * It is sent as it is, never compressed */
+    void end(const SharedBuffer &data, bool closeConnection = false) {
+        internalEnd(data.view(), data.view().length(), false, true, closeConnection, data.getFrame());
+    }
+
+    /* End the response with a complete, already framed response (status line, headers and body) as one write.
+     * Used by CachingApp to send shared, cached responses and for static responses, where the 29 bytes at
+     * dateOffset are sent as the current Date. Nothing else may have been written before. */
+    void endFramed(std::string_view framedResponse, size_t dateOffset = std::string_view::npos) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+        httpResponseData->state |= HttpResponseData<SSL>::HTTP_STATUS_CALLED | HttpResponseData<SSL>::HTTP_END_CALLED;
+
+        /* Writes that do not fit are buffered, so we never hold on to the shared response */
+        for (size_t written = 0; written < framedResponse.length(); ) {
+            if (written == dateOffset) {
+                Super::write(Super::getLoopData()->date, 29);
+                written += 29;
+                continue;
+            }
+            size_t end = written < dateOffset ? std::min(dateOffset, framedResponse.length()) : framedResponse.length();
+            int length = (int) std::min<size_t>(end - written, INT_MAX);
+            Super::write(framedResponse.data() + written, length);
+            written += (size_t) length;
+        }
+
+        Super::timeout(HTTP_TIMEOUT_S);
+        httpResponseData->markDone();
+
+        /* We need to check if we should close this socket here now */
+        if (!Super::isCorked()) {
+            if (httpResponseData->state & HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE) {
+                if (((AsyncSocket<SSL> *) this)->getBufferedAmount() == 0) {
+                    ((AsyncSocket<SSL> *) this)->shutdown();
+                    ((AsyncSocket<SSL> *) this)->close();
+                }
+            }
+        }
+    }
+
+    /* End the response with the status line and headers of responseTemplate, followed by Date, the mark,
+     * Content-Length and the data. Nothing else may have been written before. Always starts a timeout. */
+    void end(const ResponseTemplate &responseTemplate, std::string_view data = {}, bool closeConnection = false) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        if (httpResponseData->state & HttpResponseData<SSL>::HTTP_STATUS_CALLED) {
+            std::cerr << "Error: Ending with a ResponseTemplate after writing the status or headers is forbidden!" << std::endl;
+            std::terminate();
+        }
+
+        /* Everything the loop fills in fits on the stack: Connection, Date, the mark and Content-Length */
+        char tail[19 + 6 + 29 + 2 + 17 + 16 + 20 + 4];
+        size_t length = 0;
+        auto append = [&tail, &length](const char *src, size_t srcLength) {
+            memcpy(tail + length, src, srcLength);
+            length += srcLength;
+        };
+
+        if (closeConnection && !(httpResponseData->state & HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE)) {
+            append("Connection: close\r\n", 19);
+        }
+        append("Date: ", 6);
+        append(Super::getLoopData()->date, 29);
+        append("\r\n", 2);
+#ifndef UWS_HTTPRESPONSE_NO_WRITEMARK
+        if (!Super::getLoopData()->noMark) {
+            append("uWebSockets: 20\r\n", 17);
+        }
+#endif
+        append("Content-Length: ", 16);
+        length += (size_t) utils::u64toa(data.length(), tail + length);
+        append("\r\n\r\n", 4);
+
+        std::string_view head = responseTemplate.getHead();
+        Super::write(head.data(), (int) head.length());
+        Super::write(tail, (int) length);
+
+        /* The rest is an ordinary end of what we already framed */
+        httpResponseData->state |= HttpResponseData<SSL>::HTTP_STATUS_CALLED | HttpResponseData<SSL>::HTTP_END_CALLED;
+        if (closeConnection) {
+            httpResponseData->state |= HttpResponseData<SSL>::HTTP_CONNECTION_CLOSE;
+        }
         internalEnd(data, data.length(), false, true, closeConnection);
     }
 
     /* Try and end the response. Returns [true, true] on success.
-     * Starts a timeout in some cases. Returns [ok, hasResponded] */
+     * Starts a timeout in some cases. Returns [ok, hasResponded]. Not compressed, unless it ends a written stream */
     std::pair<bool, bool> tryEnd(std::string_view data, uintmax_t totalSize = 0, bool closeConnection = false) {
         bool ok = internalEnd(data, totalSize, true, true, closeConnection);
         return {ok, hasResponded()};
     }
 
-    /* Write parts of the response in chunking fashion. Starts timeout if failed. */
+    /* Write parts of the response in chunking fashion. Starts timeout if failed.
+     * Writes made within the same cork (such as within a handler) go out as one chunk */
     bool write(std::string_view data) {
         writeStatus(HTTP_200_OK);
 
@@ -450,21 +818,33 @@ public:
             return true;
         }
 
-        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+        beginChunked();
 
-        if (!(httpResponseData->state & HttpResponseData<SSL>::HTTP_WRITE_CALLED)) {
-            /* Write mark on first call to write */
-            writeMark();
+        /* Trailers are the very end of the body */
+        if (getHttpResponseData()->state & HttpResponseData<SSL>::HTTP_TRAILER_WRITTEN) {
+            std::cerr << "Error: Data must not be written after trailers!" << std::endl;
+            std::terminate();
+        }
 
-            writeHeader("Transfer-Encoding", "chunked");
-            httpResponseData->state |= HttpResponseData<SSL>::HTTP_WRITE_CALLED;
+        /* Compressed streams send what the compressor flushed, which may be nothing yet */
+        if (HttpCompressor *compressor = getHttpResponseData()->compressor) {
+            UWS_PHASE(Super::getLoopData(), compressCycles);
+            data = compressor->compress(data, false);
+            if (!data.length()) {
+                return true;
+            }
         }
 
-        Super::write("\r\n", 2);
-        writeUnsignedHex((unsigned int) data.length());
-        Super::write("\r\n", 2);
+        /* Outside of any cork we cork ourselves, so that header and data are one send */
+        bool failed;
+        if (!Super::isCorked() && Super::canCork()) {
+            Super::cork();
+            failed = !writeChunk(data);
+            failed |= Super::uncork().second;
+        } else {
+            failed = !writeChunk(data);
+        }
 
-        auto [written, failed] = Super::write(data.data(), (int) data.length());
         if (failed) {
             Super::timeout(HTTP_TIMEOUT_S);
         }
@@ -473,6 +853,45 @@ public:
         return !failed;
     }
 
+    /* Write a trailer, such as Server-Timing, after the last write and before end (without data).
+     * The body is chunked even if nothing was written */
+    HttpResponse *writeTrailer(std::string_view key, std::string_view value) {
+        beginChunked();
+
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        /* Terminating 0 chunk goes ahead of the first trailer, and so does the end of a compressed stream */
+        if (!(httpResponseData->state & HttpResponseData<SSL>::HTTP_TRAILER_WRITTEN)) {
+            if (httpResponseData->compressor) {
+                if (std::string_view tail = httpResponseData->compressor->compress({}, true); tail.length()) {
+                    writeChunk(tail);
+                }
+                delete httpResponseData->compressor;
+                httpResponseData->compressor = nullptr;
+            }
+            Super::write("\r\n0\r\n", 5);
+            httpResponseData->state |= HttpResponseData<SSL>::HTTP_TRAILER_WRITTEN;
+            httpResponseData->chunkEnd = 0;
+        }
+
+        Super::write(key.data(), (int) key.length());
+        Super::write(": ", 2);
+        Super::write(value.data(), (int) value.length());
+        Super::write("\r\n", 2);
+        return this;
+    }
+
+    /* What end and write compress the body with, negotiated by Accept-Encoding. IDENTITY if not compressed */
+    ContentEncoding getContentEncoding() {
+        return getHttpResponseData()->contentEncoding;
+    }
+
+    /* Memory for the temporaries of this request, as in std::pmr::string(res->arena()), given back all at once
+     * when the response is done or aborted. Nothing in it may be touched after end (or onAborted) returns */
+    RequestArena *arena() {
+        return &getHttpResponseData()->arena;
+    }
+
     /* Get the current byte write offset for this Http response */
     uintmax_t getWriteOffset() {
         HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
@@ -495,7 +914,7 @@ public:
     }
 
     /* Corks the response if possible. Leaves already corked socket be. */
-    HttpResponse *cork(MoveOnlyFunction<void()> &&handler) {
+    HttpResponse *cork(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
         if (!Super::isCorked() && Super::canCork()) {
             LoopData *loopData = Super::getLoopData();
             Super::cork();
@@ -548,16 +967,99 @@ public:
         return this;
     }
 
+#ifndef _WIN32
+    /* Responds with length bytes of fd from offset as body. Without SSL they go straight from the page cache
+     * with sendfile, never through user space. Whatever the socket does not take right away is sent as it drains,
+     * so do not write anything more and do not close fd until the response is done or aborted.
+     * Returns true if everything was sent right away. */
+    bool sendFile(int fd, uintmax_t offset, uintmax_t length) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        /* Status, headers and the content-length */
+        internalEnd({}, length, false);
+        if (!length) {
+            return true;
+        }
+
+        httpResponseData->fileFd = fd;
+        httpResponseData->fileOffset = offset;
+        httpResponseData->fileLength = length;
+        return drainFile();
+    }
+
+    /* Responds with a file acquired from the loop's FileCache, taking over its release */
+    bool sendFile(FileCache::File *file) {
+        if (!file->size) {
+            file->release();
+            return sendFile(-1, 0, 0);
+        }
+
+        getHttpResponseData()->file = file;
+        return sendFile(file->fd, 0, file->size);
+    }
+#endif
+
     /* Attach handler for writable HTTP response */
-    HttpResponse *onWritable(MoveOnlyFunction<bool(uintmax_t)> &&handler) {
+    HttpResponse *onWritable(MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> &&handler) {
         HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
 
         httpResponseData->onWritable = std::move(handler);
+        httpResponseData->onWritableReplaced = true;
+        return this;
+    }
+
+    /* Calls handler in ms (with millisecond resolution) unless the response is done or aborted by then,
+     * replacing any earlier one. A null handler cancels it */
+    HttpResponse *setTimeout(unsigned int ms, MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        httpResponseData->onTimeout = std::move(handler);
+        if (!httpResponseData->onTimeout) {
+            httpResponseData->timeoutTimer.cancel();
+            return this;
+        }
+
+        httpResponseData->timeoutTimer.user = this;
+        httpResponseData->timeoutTimer.cb = [](void *user) {
+            HttpResponse<SSL> *res = (HttpResponse<SSL> *) user;
+
+            /* The handler may well end the response, which clears it */
+            MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> onTimeout = std::move(res->getHttpResponseData()->onTimeout);
+            res->cork([&onTimeout]() {
+                onTimeout();
+            });
+        };
+        ((Loop *) us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) this)))->armTimer(&httpResponseData->timeoutTimer, ms);
+        return this;
+    }
+
+    /* Runs work() on a worker thread, then then(res, result) corked on this loop, unless the response was aborted
+     * or ended in the meantime. Stands in for onAborted if you have none, set your own to learn of aborts */
+    template <typename WORK, typename THEN>
+    HttpResponse *offload(WORK &&work, THEN &&then) {
+        HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
+
+        if (!httpResponseData->onAborted) {
+            httpResponseData->onAborted = []() {};
+        }
+        if (!httpResponseData->offloadGuard) {
+            httpResponseData->offloadGuard = new OffloadGuard;
+        }
+
+        ((Loop *) us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) this)))->offload(std::forward<WORK>(work),
+            [res = this, guard = httpResponseData->offloadGuard->retain(), then = std::forward<THEN>(then)](auto &&... result) mutable {
+            if (guard->alive) {
+                res->cork([&]() {
+                    then(res, std::move(result)...);
+                });
+            }
+            guard->release();
+        });
         return this;
     }
 
     /* Attach handler for aborted HTTP request */
-    HttpResponse *onAborted(MoveOnlyFunction<void()> &&handler) {
+    HttpResponse *onAborted(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
         HttpResponseData<SSL> *httpResponseData = getHttpResponseData();
 
         httpResponseData->onAborted = std::move(handler);
@@ -565,13 +1067,147 @@ public:
     }
 
     /* Attach a read handler for data sent. Will be called with FIN set true if last segment. */
-    void onData(MoveOnlyFunction<void(std::string_view, bool)> &&handler) {
+    void onData(MoveOnlyFunction<void(std::string_view, bool), CALLBACK_INLINE_SIZE> &&handler) {
         HttpResponseData<SSL> *data = getHttpResponseData();
         data->inStream = std::move(handler);
 
         /* Always reset this counter here */
         data->received_bytes_per_timeout = 0;
     }
+
+    /* Calls handler with the whole body, of at most maxBytes. A body that came in one read is handed over right out
+     * of it, anything longer is copied into arena() once, sized by Content-Length (grown for chunked bodies). Bodies
+     * that say or turn out to be larger are answered 413 and their connection closed, without buffering them. The
+     * body stays valid until the response ends. Attaches an onAborted doing nothing unless you attached one */
+    template <typename Handler>
+    void collectBody(uint64_t maxBytes, Handler &&handler) {
+        /* Length and capacity lead what is collected, in the arena */
+        struct Collected {
+            size_t length, capacity;
+        };
+
+        onData([this, maxBytes, collected = (Collected *) nullptr, handler = std::forward<Handler>(handler)](std::string_view chunk, bool fin) mutable {
+            if (!collected) {
+                /* Seen from the first chunk, the remaining length is all of Content-Length (0 for chunked) */
+                uint64_t contentLength = getHttpResponseData()->getRemainingBodyLength();
+                if (contentLength > maxBytes || chunk.length() > maxBytes) {
+                    endPayloadTooLarge();
+                    return;
+                }
+                if (fin) {
+                    handler(chunk);
+                    return;
+                }
+                size_t capacity = (size_t) (contentLength ? contentLength : std::min<uint64_t>(maxBytes, std::max<size_t>(chunk.length() * 2, 4096)));
+                collected = (Collected *) arena()->allocate(sizeof(Collected) + capacity, alignof(Collected));
+                *collected = {0, capacity};
+            }
+
+            if (collected->length + chunk.length() > maxBytes) {
+                endPayloadTooLarge();
+                return;
+            }
+            if (collected->length + chunk.length() > collected->capacity) {
+                size_t capacity = (size_t) std::min<uint64_t>(maxBytes, std::max<size_t>(collected->length + chunk.length(), collected->capacity * 2));
+                Collected *grown = (Collected *) arena()->allocate(sizeof(Collected) + capacity, alignof(Collected));
+                memcpy(grown + 1, collected + 1, collected->length);
+                *grown = {collected->length, capacity};
+                collected = grown;
+            }
+            memcpy((char *) (collected + 1) + collected->length, chunk.data(), chunk.length());
+            collected->length += chunk.length();
+
+            if (fin) {
+                handler(std::string_view((char *) (collected + 1), collected->length));
+            }
+        });
+
+        if (!getHttpResponseData()->onAborted) {
+            onAborted([]() {});
+        }
+    }
+
+#ifdef UWS_HAS_COROUTINES
+    /* Awaits the whole body, or std::nullopt if aborted. Attaches onData and onAborted, so it must be awaited
+     * before the handler first suspends on anything else. Aborted responses must not be touched */
+    struct BodyAwaiter {
+        HttpResponse *res;
+        std::string body = {};
+        bool aborted = false;
+        std::coroutine_handle<> handle = nullptr;
+
+        bool await_ready() {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            res->onAborted([this]() {
+                aborted = true;
+                handle.resume();
+            });
+            res->onData([this](std::string_view chunk, bool fin) {
+                body.append(chunk);
+                if (fin) {
+                    /* We are still pending, the coroutine attaches whatever it needs from here on */
+                    res->getHttpResponseData()->onAborted = nullptr;
+                    handle.resume();
+                }
+            });
+        }
+
+        std::optional<std::string> await_resume() {
+            if (aborted) {
+                return std::nullopt;
+            }
+            return std::move(body);
+        }
+    };
+
+    BodyAwaiter readBody() {
+        return {this};
+    }
+
+    /* Awaits writable after tryEnd or write failed, returning the write offset to continue from,
+     * or std::nullopt if aborted. Attaches onWritable and onAborted while awaiting */
+    struct WritableAwaiter {
+        HttpResponse *res;
+        uintmax_t offset = 0;
+        bool aborted = false;
+        std::coroutine_handle<> handle = nullptr;
+
+        bool await_ready() {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            res->onAborted([this]() {
+                aborted = true;
+                handle.resume();
+            });
+            res->onWritable([this](uintmax_t writeOffset) {
+                HttpResponseData<SSL> *httpResponseData = res->getHttpResponseData();
+                offset = writeOffset;
+                httpResponseData->onWritable = nullptr;
+                httpResponseData->onAborted = nullptr;
+                handle.resume();
+                return true;
+            });
+        }
+
+        std::optional<uintmax_t> await_resume() {
+            if (aborted) {
+                return std::nullopt;
+            }
+            return offset;
+        }
+    };
+
+    WritableAwaiter writable() {
+        return {this};
+    }
+#endif
 };
 
 }
@@ -23,6 +23,12 @@
 #include "HttpParser.h"
 #include "AsyncSocketData.h"
 #include "ProxyParser.h"
+#include "FileCache.h"
+#include "TimingWheel.h"
+#include "Probes.h"
+#include "HttpCompression.h"
+#include "RequestArena.h"
+#include "WorkerPool.h"
 
 #include "MoveOnlyFunction.h"
 
@@ -32,12 +38,36 @@ template <bool SSL>
 struct HttpResponseData : AsyncSocketData<SSL>, HttpParser {
     template <bool> friend struct HttpResponse;
     template <bool> friend struct HttpContext;
+    template <bool> friend struct TemplatedHttpProxy;
 
     /* When we are done with a response we mark it like so */
     void markDone() {
+        UWS_PROBE1(response__ended, this);
+
         onAborted = nullptr;
         /* Also remove onWritable so that we do not emit when draining behind the scenes. */
         onWritable = nullptr;
+        timeoutTimer.cancel();
+        onTimeout = nullptr;
+
+#ifndef _WIN32
+        /* Whatever file we sent is no longer ours */
+        fileFd = -1;
+        if (file) {
+            file->release();
+            file = nullptr;
+        }
+#endif
+
+        /* A streamed body is over */
+        delete compressor;
+        compressor = nullptr;
+
+        /* And so is everything the handlers made in HttpResponse::arena() */
+        arena.reset();
+
+        /* Work still offloaded comes back to find us done */
+        OffloadGuard::invalidate(offloadGuard);
 
         /* We are done with this request */
         state &= ~HttpResponseData<SSL>::HTTP_RESPONSE_PENDING;
@@ -46,16 +76,17 @@ struct HttpResponseData : AsyncSocketData<SSL>, HttpParser {
     /* Caller of onWritable. It is possible onWritable calls markDone so we need to borrow it. */
     bool callOnWritable(uintmax_t offset) {
         /* Borrow real onWritable */
-        MoveOnlyFunction<bool(uintmax_t)> borrowedOnWritable = std::move(onWritable);
+        MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> borrowedOnWritable = std::move(onWritable);
 
         /* Set onWritable to placeholder */
         onWritable = [](uintmax_t) {return true;};
 
         /* Run borrowed onWritable */
+        onWritableReplaced = false;
         bool ret = borrowedOnWritable(offset);
 
         /* If we still have onWritable (the placeholder) then move back the real one */
-        if (onWritable) {
+        if (onWritable && !onWritableReplaced) {
             /* We haven't reset onWritable, so give it back */
             onWritable = std::move(borrowedOnWritable);
         }
@@ -69,13 +100,38 @@ private:
         HTTP_WRITE_CALLED = 2, // used
         HTTP_END_CALLED = 4, // used
         HTTP_RESPONSE_PENDING = 8, // used
-        HTTP_CONNECTION_CLOSE = 16 // used
+        HTTP_CONNECTION_CLOSE = 16, // used
+        HTTP_TRAILER_WRITTEN = 32, // used
+        HTTP_RATE_LIMITED = 64 // used
     };
 
     /* Per socket event handlers */
-    MoveOnlyFunction<bool(uintmax_t)> onWritable;
-    MoveOnlyFunction<void()> onAborted;
-    MoveOnlyFunction<void(std::string_view, bool)> inStream; // onData
+    /* Per request lambdas capture more than the default inline size allows */
+    MoveOnlyFunction<bool(uintmax_t), CALLBACK_INLINE_SIZE> onWritable;
+    MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> onAborted;
+    MoveOnlyFunction<void(std::string_view, bool), CALLBACK_INLINE_SIZE> inStream; // onData
+    /* HttpResponse::setTimeout, cancelled when done or destroyed */
+    MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> onTimeout;
+    TimingWheel::Timer timeoutTimer;
+    /* Set when a new onWritable is attached, so that callOnWritable does not put back the old one */
+    bool onWritableReplaced = false;
+    /* Where the TLS handshake of this socket is at, see HttpContext::beginTlsHandshake. Number in line while waiting */
+    enum : unsigned char {
+        TLS_HANDSHAKE_NONE,
+        TLS_HANDSHAKE_RUNNING,
+        TLS_HANDSHAKE_WAITING
+    };
+    unsigned char tlsHandshake = TLS_HANDSHAKE_NONE;
+    unsigned int tlsHandshakeTicket = 0;
+
+#ifndef UWS_NO_SNI
+    /* The router of the server name of this socket, looked up on its first request and again after server names change */
+    void *domainRouter = nullptr;
+    unsigned int serverNamesGeneration = 0;
+#endif
+    /* RateLimiter::key of the address of this socket, the proxied one if any */
+    uint64_t rateLimitKey = 0;
+
     /* Outgoing offset */
     uintmax_t offset = 0;
 
@@ -85,9 +141,44 @@ private:
     /* Current state (content-length sent, status sent, write called, etc */
     int state = 0;
 
+    /* The chunk still growing at the end of the cork buffer, if chunkEnd is where the cork buffer ends */
+    unsigned int chunkHeader = 0, chunkEnd = 0, chunkLength = 0;
+
+#ifndef _WIN32
+    /* File being sent by sendFile, where the body starts in it and how long the body is */
+    int fileFd = -1;
+    uintmax_t fileOffset = 0, fileLength = 0;
+    FileCache::File *file = nullptr;
+#endif
+
+    /* What the body of this response is compressed with, negotiated when its request is parsed. Writing a
+     * Content-Encoding header yourself turns it off. Streamed bodies have their compressor made on first write */
+    ContentEncoding contentEncoding = IDENTITY;
+    HttpCompressor *compressor = nullptr;
+
+    /* HttpResponse::arena(), reset when the response is done and freed when the socket closes */
+    RequestArena arena;
+
+    /* Made by the first HttpResponse::offload of a request */
+    OffloadGuard *offloadGuard = nullptr;
+
 #ifdef UWS_WITH_PROXY
     ProxyParser proxyParser;
+    /* Behind a proxy, connections are rate limited at their first request, once the PROXY header is parsed */
+    bool rateLimitKeyed = false;
 #endif
+
+public:
+    /* Aborted while sending a file from the cache or streaming a compressed body */
+    ~HttpResponseData() {
+#ifndef _WIN32
+        if (file) {
+            file->release();
+        }
+#endif
+        delete compressor;
+        OffloadGuard::invalidate(offloadGuard);
+    }
 };
 
 }
@@ -30,6 +30,7 @@
 #include <iostream>
 
 #include "MoveOnlyFunction.h"
+#include "HttpMethod.h"
 
 namespace uWS {
 
@@ -63,6 +64,23 @@ private:
         Node(std::string name) : name(name) {}
     } root = {"rootNode"};
 
+    /* Children of root by method, so that standard methods never compare names: those of the standard methods
+     * indexed by HttpMethod and that of ANY_METHOD_TOKEN, or null */
+    Node *methodNodes[NUM_HTTP_METHODS] = {}, *anyMethodNode = nullptr;
+
+    /* Rebuilds methodNodes, as children of root come and go */
+    void indexMethods() {
+        std::fill(std::begin(methodNodes), std::end(methodNodes), nullptr);
+        anyMethodNode = nullptr;
+        for (auto &method : root.children) {
+            if (method->name == ANY_METHOD_TOKEN) {
+                anyMethodNode = method.get();
+            } else if (HttpMethod knownMethod = classifyHttpMethod(method->name); knownMethod != HTTP_OTHER) {
+                methodNodes[knownMethod] = method.get();
+            }
+        }
+    }
+
     /* Sort wildcards after alphanum */
     int lexicalOrder(std::string &name) {
         if (!name.length()) {
@@ -85,7 +103,7 @@ private:
             }
         }
 
-        /* Insert sorted, but keep order if parent is root (we sort methods by priority elsewhere) */
+        /* Insert sorted, but keep order if parent is root (methods are indexed by indexMethods, never scanned in order) */
         std::unique_ptr<Node> newNode(new Node(child));
         newNode->isHighPriority = isHighPriority;
         return parent->children.emplace(std::upper_bound(parent->children.begin(), parent->children.end(), newNode, [parent, this](auto &a, auto &b) {
@@ -206,6 +224,219 @@ private:
         return false;
     }
 
+    /* The frozen tree is the matching tree compiled into flat arrays, only used for routing.
+     * Children of a node are split into runs of static children followed by parameter and wildcard children
+     * of the same priority, which is the order the tree already keeps them in. So a run is matched by looking up
+     * its one possible static child in a perfect hash table and then trying the rest in order, which is exactly
+     * what scanning the children would do. */
+    static constexpr uint32_t FROZEN_NONE = UINT32_MAX, FROZEN_WILDCARD = 0x80000000;
+
+    struct FrozenNode {
+        uint32_t firstHandler, numHandlers;
+        uint32_t firstRun, numRuns;
+    };
+
+    struct FrozenRun {
+        /* Static children hash into frozenSlots[firstSlot + (hash & slotMask)], or if linear are all scanned */
+        uint32_t firstSlot, numSlots, slotMask, seed;
+        bool linear;
+        /* Parameter and wildcard children, in order */
+        uint32_t firstDynamic, numDynamic;
+    };
+
+    struct FrozenSlot {
+        uint32_t nameOffset, nameLength;
+        uint32_t node;
+    };
+
+    std::vector<FrozenNode> frozenNodes;
+    std::vector<FrozenRun> frozenRuns;
+    std::vector<FrozenSlot> frozenSlots;
+    /* Child node index, or'ed with FROZEN_WILDCARD for wildcards */
+    std::vector<uint32_t> frozenDynamic;
+    /* Handler indices, without priority */
+    std::vector<uint32_t> frozenHandlers;
+    std::string frozenNames;
+    /* Same as methodNodes, FROZEN_NONE where there is no node */
+    uint32_t frozenMethodNodes[NUM_HTTP_METHODS], frozenAnyMethodNode = FROZEN_NONE;
+    /* Name and node of every custom method */
+    std::vector<std::pair<std::string, uint32_t>> frozenMethods;
+    /* Frozen means we route on the frozen tree, stale means it must be rebuilt before the next route */
+    bool frozen = false, frozenStale = false;
+
+    static inline uint32_t hashSegment(std::string_view segment, uint32_t seed) {
+        /* FNV-1a, seeded */
+        uint32_t hash = 2166136261u ^ seed;
+        for (char c : segment) {
+            hash = (hash ^ (unsigned char) c) * 16777619u;
+        }
+        return hash;
+    }
+
+    /* Finds a seed and power of two table size without collisions for these names, or returns false */
+    static bool findPerfectHash(std::vector<std::string_view> &names, uint32_t &slotMask, uint32_t &seed) {
+        uint32_t size = 1;
+        while (size < names.size()) {
+            size <<= 1;
+        }
+
+        std::vector<bool> taken;
+        /* Give up at 8 times the room we need, which only happens for (practically impossible) full collisions */
+        for (uint32_t maxSize = size * 8; size <= maxSize; size <<= 1) {
+            for (seed = 0; seed < 64; seed++) {
+                taken.assign(size, false);
+                bool collision = false;
+                for (std::string_view name : names) {
+                    uint32_t slot = hashSegment(name, seed) & (size - 1);
+                    if (taken[slot]) {
+                        collision = true;
+                        break;
+                    }
+                    taken[slot] = true;
+                }
+                if (!collision) {
+                    slotMask = size - 1;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /* Compiles node and everything below it, returning its index */
+    uint32_t freezeNode(Node *node) {
+        uint32_t index = (uint32_t) frozenNodes.size();
+        frozenNodes.push_back({});
+
+        uint32_t firstHandler = (uint32_t) frozenHandlers.size();
+        for (uint32_t handler : node->handlers) {
+            frozenHandlers.push_back(handler & HANDLER_MASK);
+        }
+
+        /* Split children into runs first, since children are appended below us as we recurse */
+        std::vector<std::pair<size_t, size_t>> runs;
+        for (size_t i = 0; i < node->children.size(); ) {
+            size_t begin = i;
+            bool isHighPriority = node->children[i]->isHighPriority;
+            bool seenDynamic = false;
+            for (; i < node->children.size() && node->children[i]->isHighPriority == isHighPriority; i++) {
+                std::string &name = node->children[i]->name;
+                bool isDynamic = name.length() && (name[0] == ':' || name[0] == '*');
+                if (!isDynamic && seenDynamic) {
+                    break;
+                }
+                seenDynamic |= isDynamic;
+            }
+            runs.push_back({begin, i});
+        }
+
+        std::vector<uint32_t> children;
+        for (auto &child : node->children) {
+            children.push_back(freezeNode(child.get()));
+        }
+
+        uint32_t firstRun = (uint32_t) frozenRuns.size();
+        for (auto [begin, end] : runs) {
+            FrozenRun run = {(uint32_t) frozenSlots.size(), 0, 0, 0, false, (uint32_t) frozenDynamic.size(), 0};
+
+            std::vector<std::string_view> names;
+            size_t i = begin;
+            for (; i < end && !(node->children[i]->name.length() && (node->children[i]->name[0] == ':' || node->children[i]->name[0] == '*')); i++) {
+                names.push_back(node->children[i]->name);
+            }
+            size_t numStatic = i - begin;
+
+            if (numStatic) {
+                run.linear = !findPerfectHash(names, run.slotMask, run.seed);
+                run.numSlots = (uint32_t) (run.linear ? numStatic : run.slotMask + 1);
+                frozenSlots.resize(frozenSlots.size() + run.numSlots, {0, 0, FROZEN_NONE});
+                for (size_t j = 0; j < numStatic; j++) {
+                    size_t slot = run.firstSlot + (run.linear ? j : (hashSegment(names[j], run.seed) & run.slotMask));
+                    frozenSlots[slot] = {(uint32_t) frozenNames.length(), (uint32_t) names[j].length(), children[begin + j]};
+                    frozenNames.append(names[j]);
+                }
+            } else {
+                /* An empty table always misses */
+                run.linear = true;
+            }
+
+            for (; i < end; i++) {
+                frozenDynamic.push_back(children[i] | (node->children[i]->name[0] == '*' ? FROZEN_WILDCARD : 0));
+            }
+            run.numDynamic = (uint32_t) frozenDynamic.size() - run.firstDynamic;
+            frozenRuns.push_back(run);
+        }
+
+        frozenNodes[index] = {firstHandler, (uint32_t) node->handlers.size(), firstRun, (uint32_t) runs.size()};
+        return index;
+    }
+
+    /* Returns the static child of this run named segment, or FROZEN_NONE */
+    inline uint32_t findFrozenStatic(FrozenRun &run, std::string_view segment) {
+        if (run.linear) {
+            for (uint32_t i = run.firstSlot; i < run.firstSlot + run.numSlots; i++) {
+                if (frozenSlots[i].nameLength == segment.length() && !memcmp(frozenNames.data() + frozenSlots[i].nameOffset, segment.data(), segment.length())) {
+                    return frozenSlots[i].node;
+                }
+            }
+            return FROZEN_NONE;
+        }
+
+        /* A single static child needs no hashing */
+        FrozenSlot &slot = frozenSlots[run.firstSlot + (run.slotMask ? (hashSegment(segment, run.seed) & run.slotMask) : 0)];
+        if (slot.node != FROZEN_NONE && slot.nameLength == segment.length() && !memcmp(frozenNames.data() + slot.nameOffset, segment.data(), segment.length())) {
+            return slot.node;
+        }
+        return FROZEN_NONE;
+    }
+
+    /* Same as executeHandlers, on the frozen tree */
+    bool executeFrozenHandlers(uint32_t nodeIndex, int urlSegment) {
+        FrozenNode node = frozenNodes[nodeIndex];
+
+        auto [segment, isStop] = getUrlSegment(urlSegment);
+
+        if (isStop) {
+            for (uint32_t i = node.firstHandler; i < node.firstHandler + node.numHandlers; i++) {
+                if (handlers[frozenHandlers[i]](this)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        for (uint32_t r = node.firstRun; r < node.firstRun + node.numRuns; r++) {
+            FrozenRun run = frozenRuns[r];
+
+            /* Static match */
+            uint32_t child = findFrozenStatic(run, segment);
+            if (child != FROZEN_NONE && executeFrozenHandlers(child, urlSegment + 1)) {
+                return true;
+            }
+
+            for (uint32_t d = run.firstDynamic; d < run.firstDynamic + run.numDynamic; d++) {
+                child = frozenDynamic[d];
+                if (child & FROZEN_WILDCARD) {
+                    /* Wildcard match */
+                    FrozenNode wildcard = frozenNodes[child & ~FROZEN_WILDCARD];
+                    for (uint32_t i = wildcard.firstHandler; i < wildcard.firstHandler + wildcard.numHandlers; i++) {
+                        if (handlers[frozenHandlers[i]](this)) {
+                            return true;
+                        }
+                    }
+                } else if (segment.length()) {
+                    /* Parameter match */
+                    routeParameters.push(segment);
+                    if (executeFrozenHandlers(child, urlSegment + 1)) {
+                        return true;
+                    }
+                    routeParameters.pop();
+                }
+            }
+        }
+        return false;
+    }
+
     /* Scans for one matching handler, returning the handler and its priority or UINT32_MAX for not found */
     uint32_t findHandler(std::string method, std::string pattern, uint32_t priority) {
         for (std::unique_ptr<Node> &node : root.children) {
@@ -243,6 +474,7 @@ public:
     HttpRouter() {
         /* Always have ANY route */
         getNode(&root, std::string(ANY_METHOD_TOKEN.data(), ANY_METHOD_TOKEN.length()), false);
+        indexMethods();
     }
 
     std::pair<int, std::string_view *> getParameters() {
@@ -253,35 +485,98 @@ public:
         return userData;
     }
 
-    /* Fast path */
+    /* Compiles the matching tree for faster routing, done by listen. Adding or removing routes after this
+     * rebuilds it on the next route, so routing semantics never change */
+    void freeze() {
+        frozenNodes.clear();
+        frozenRuns.clear();
+        frozenSlots.clear();
+        frozenDynamic.clear();
+        frozenHandlers.clear();
+        frozenNames.clear();
+        frozenMethods.clear();
+        std::fill(std::begin(frozenMethodNodes), std::end(frozenMethodNodes), FROZEN_NONE);
+        frozenAnyMethodNode = FROZEN_NONE;
+
+        for (auto &method : root.children) {
+            uint32_t node = freezeNode(method.get());
+            if (method.get() == anyMethodNode) {
+                frozenAnyMethodNode = node;
+            } else if (HttpMethod knownMethod = classifyHttpMethod(method->name); knownMethod != HTTP_OTHER) {
+                frozenMethodNodes[knownMethod] = node;
+            } else {
+                frozenMethods.emplace_back(method->name, node);
+            }
+        }
+
+        frozen = true;
+        frozenStale = false;
+    }
+
+    bool isFrozen() {
+        return frozen && !frozenStale;
+    }
+
     bool route(std::string_view method, std::string_view url) {
+        return route(classifyHttpMethod(method), method, url);
+    }
+
+    /* Fast path, for a method already classified (by the parser). Only custom methods are looked up by name */
+    bool route(HttpMethod knownMethod, std::string_view method, std::string_view url) {
         /* Reset url parsing cache */
         setUrl(url);
         routeParameters.reset();
 
+        if (frozen) {
+            if (frozenStale) [[unlikely]] {
+                freeze();
+            }
+
+            /* Same as below */
+            uint32_t node = FROZEN_NONE;
+            if (knownMethod != HTTP_OTHER) [[likely]] {
+                node = frozenMethodNodes[knownMethod];
+            } else {
+                for (auto &[name, customNode] : frozenMethods) {
+                    if (name == method) {
+                        node = customNode;
+                        break;
+                    }
+                }
+            }
+            if (node != FROZEN_NONE && executeFrozenHandlers(node, 0)) {
+                return true;
+            }
+            return frozenAnyMethodNode != FROZEN_NONE && executeFrozenHandlers(frozenAnyMethodNode, 0);
+        }
+
         /* Begin by finding the method node */
-        for (auto &p : root.children) {
-            if (p->name == method) {
-                /* Then route the url */
-                if (executeHandlers(p.get(), 0, userData)) {
-                    return true;
-                } else {
+        Node *node = nullptr;
+        if (knownMethod != HTTP_OTHER) [[likely]] {
+            node = methodNodes[knownMethod];
+        } else {
+            for (auto &p : root.children) {
+                if (p->name == method && p.get() != anyMethodNode) {
+                    node = p.get();
                     break;
                 }
             }
         }
 
-        /* Always test any route last (this check should not be necessary if we always have at least one handler) */
-        if (root.children.empty()) [[unlikely]] {
-            return false;
+        /* Then route the url */
+        if (node && executeHandlers(node, 0, userData)) {
+            return true;
         }
-        return executeHandlers(root.children.back().get(), 0, userData);
+
+        /* Always test any route last */
+        return anyMethodNode && executeHandlers(anyMethodNode, 0, userData);
     }
 
     /* Adds the corresponding entires in matching tree and handler list */
     void add(std::vector<std::string> methods, std::string pattern, MoveOnlyFunction<bool(HttpRouter *)> &&handler, uint32_t priority = MEDIUM_PRIORITY) {
         /* First remove existing handler */
         remove(methods[0], pattern, priority);
+        frozenStale = true;
         
         for (std::string method : methods) {
             /* Lookup method */
@@ -303,20 +598,39 @@ public:
         /* Alloate this handler */
         handlers.emplace_back(std::move(handler));
 
-        /* ANY method must be last, GET must be first */
-        std::sort(root.children.begin(), root.children.end(), [](const auto &a, const auto &b) {
-            if (a->name == "GET" && b->name != "GET") {
-                return true;
-            } else if (b->name == "GET" && a->name != "GET") {
-                return false;
-            } else if (a->name == ANY_METHOD_TOKEN && b->name != ANY_METHOD_TOKEN) {
-                return false;
-            } else if (b->name == ANY_METHOD_TOKEN && a->name != ANY_METHOD_TOKEN) {
-                return true;
-            } else {
-                return a->name < b->name;
+        indexMethods();
+    }
+
+    /* Name to index of every parameter of a pattern, what requests look their parameters up by */
+    using ParameterOffsets = std::map<std::string, unsigned short, std::less<>>;
+
+    static ParameterOffsets getParameterOffsets(std::string_view pattern) {
+        ParameterOffsets parameterOffsets;
+        unsigned short offset = 0;
+        for (unsigned int i = 0; i < pattern.length(); i++) {
+            if (pattern[i] == ':') {
+                i++;
+                unsigned int start = i;
+                while (i < pattern.length() && pattern[i] != '/') {
+                    i++;
+                }
+                parameterOffsets[std::string(pattern.data() + start, i - start)] = offset;
+                offset++;
             }
-        });
+        }
+        return parameterOffsets;
+    }
+
+    /* How every App adds (or with a null handler removes) a route of one method, or of ANY_METHOD_TOKEN. Any method
+     * goes last and upgrades first, the same for HTTP/1.1 and HTTP/3 so that one route table behaves the same on both */
+    void addRoute(std::string_view method, std::string pattern, MoveOnlyFunction<bool(HttpRouter *)> &&handler, bool upgrade = false) {
+        uint32_t priority = method == ANY_METHOD_TOKEN ? LOW_PRIORITY : (upgrade ? HIGH_PRIORITY : MEDIUM_PRIORITY);
+
+        if (!handler) {
+            remove(std::string(method), pattern, priority);
+            return;
+        }
+        add({std::string(method)}, std::move(pattern), std::move(handler), priority);
     }
 
     bool cullNode(Node *parent, Node *node, uint32_t handler) {
@@ -371,9 +685,11 @@ public:
          * if node contains handler - remove the handler -
          * if node holds no handlers after removal, remove the node and return */
         cullNode(nullptr, &root, handler);
+        indexMethods();
 
         /* Now remove the actual handler */
         handlers.erase(handlers.begin() + (handler & HANDLER_MASK));
+        frozenStale = true;
 
         return true;
     }
@@ -0,0 +1,182 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_KERNELTLS_H
+#define UWS_KERNELTLS_H
+
+/* Hands the sending half of an established TLS session to the Linux kernel (kTLS), so that everything we write
+ * afterwards is plaintext to the socket and sendfile works over TLS. Receiving stays with the SSL layer of uSockets.
+ *
+ * Once the kernel seals our records the SSL layer must never seal one again, its keys and sequence number are behind.
+ * So offloading is refused unless the session can neither renegotiate nor update keys:
+ *
+ * With BoringSSL we install the keys ourselves, for TLS 1.2 only with renegotiation turned off. TLS 1.3 stays with
+ * the SSL layer since a peer's KeyUpdate is answered by it and cannot be turned off.
+ *
+ * With OpenSSL 3 we never extract keys: enable sets SSL_OP_ENABLE_KTLS (and SSL_OP_NO_RENEGOTIATION) on the context
+ * and OpenSSL, which then handles key updates itself, offloads on its own where it can (socket BIOs only). We just
+ * write past the SSL layer once it did.
+ *
+ * Supports AES-128-GCM, AES-256-GCM and ChaCha20-Poly1305. */
+
+#if defined(UWS_WITH_KTLS) && defined(__linux__)
+
+#include <openssl/ssl.h>
+#ifdef OPENSSL_IS_BORINGSSL
+#include <openssl/mem.h>
+#endif
+
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+namespace uWS::KernelTls {
+
+#ifdef OPENSSL_IS_BORINGSSL
+
+/* Nothing to set up front */
+inline void enable(SSL_CTX *) {
+
+}
+
+/* Fills in key, salt, iv and rec_seq of the kernel's crypto info for our sending direction */
+template <typename CRYPTO_INFO>
+inline bool install(int fd, SSL *ssl, CRYPTO_INFO &info) {
+    constexpr size_t keyLength = sizeof(info.key), saltLength = sizeof(info.salt), ivLength = sizeof(info.iv);
+
+    uint8_t sequence[8];
+    uint64_t writeSequence = SSL_get_write_sequence(ssl);
+    for (int i = 0; i < 8; i++) {
+        sequence[i] = (uint8_t) (writeSequence >> (56 - 8 * i));
+    }
+
+    /* AEADs have no MAC keys, the key block is client key, server key, client iv, server iv.
+     * GCM has a 4 byte fixed iv (the salt) and uses the sequence as explicit nonce, ChaCha20 has a 12 byte iv */
+    constexpr size_t fixedLength = saltLength ? saltLength : ivLength;
+    bool server = SSL_is_server(ssl);
+    bool success = false;
+
+    std::vector<uint8_t> keyBlock(SSL_get_key_block_len(ssl));
+    if (keyBlock.size() == 2 * (keyLength + fixedLength) && SSL_generate_key_block(ssl, keyBlock.data(), keyBlock.size())) {
+        memcpy(info.key, keyBlock.data() + (server ? keyLength : 0), keyLength);
+        const uint8_t *fixed = keyBlock.data() + 2 * keyLength + (server ? fixedLength : 0);
+        if (saltLength) {
+            memcpy(info.salt, fixed, saltLength);
+            memcpy(info.iv, sequence, ivLength);
+        } else {
+            memcpy(info.iv, fixed, ivLength);
+        }
+        success = true;
+    }
+    OPENSSL_cleanse(keyBlock.data(), keyBlock.size());
+    memcpy(info.rec_seq, sequence, sizeof(info.rec_seq));
+
+    success = success && setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0
+        && setsockopt(fd, SOL_TLS, TLS_TX, &info, sizeof(info)) == 0;
+
+    OPENSSL_cleanse(&info, sizeof(info));
+    return success;
+}
+
+/* Returns true if the kernel now encrypts what we send. Must only be called when the SSL layer
+ * has nothing left to send, as the kernel continues from its current sequence number. */
+inline bool offloadTx(int fd, SSL *ssl) {
+    if (!SSL_is_init_finished(ssl) || SSL_version(ssl) != TLS1_2_VERSION) {
+        return false;
+    }
+
+    /* Servers never renegotiate with BoringSSL, clients must not either from now on */
+    SSL_set_renegotiate_mode(ssl, ssl_renegotiate_never);
+
+    uint16_t version = TLS1_2_VERSION;
+    switch (SSL_CIPHER_get_protocol_id(SSL_get_current_cipher(ssl))) {
+    case 0xC02B: /* TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256 */
+    case 0xC02F: { /* TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256 */
+        tls12_crypto_info_aes_gcm_128 info = {};
+        info.info = {version, TLS_CIPHER_AES_GCM_128};
+        return install(fd, ssl, info);
+    }
+    case 0xC02C: /* TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384 */
+    case 0xC030: { /* TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384 */
+        tls12_crypto_info_aes_gcm_256 info = {};
+        info.info = {version, TLS_CIPHER_AES_GCM_256};
+        return install(fd, ssl, info);
+    }
+    case 0xCCA8: /* TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256 */
+    case 0xCCA9: { /* TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256 */
+        tls12_crypto_info_chacha20_poly1305 info = {};
+        info.info = {version, TLS_CIPHER_CHACHA20_POLY1305};
+        return install(fd, ssl, info);
+    }
+    }
+    return false;
+}
+
+#else
+
+/* OpenSSL offloads by itself once asked to, during the handshake */
+inline void enable(SSL_CTX *ctx) {
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION);
+}
+
+/* Returns true if OpenSSL had the kernel encrypt what we send */
+inline bool offloadTx(int, SSL *ssl) {
+    return SSL_is_init_finished(ssl) && (SSL_get_options(ssl) & SSL_OP_NO_RENEGOTIATION) && BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+
+#endif
+
+/* The SSL layer would encrypt its close_notify with keys the kernel has moved on from, so the kernel sends it */
+inline void sendCloseNotify(int fd) {
+    char alert[2] = {1, 0};
+    char control[CMSG_SPACE(sizeof(unsigned char))] = {};
+
+    struct iovec iov = {alert, sizeof(alert)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    /* Alert */
+    *CMSG_DATA(cmsg) = 21;
+
+    sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+}
+
+#endif
+
+#endif // UWS_KERNELTLS_H
@@ -0,0 +1,112 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_KNOWNHEADERS_H
+#define UWS_KNOWNHEADERS_H
+
+/* Well-known request headers get a slot of their own, holding where in the request they are. The slot comes from a
+ * perfect hash over (lower cased) names, its multiplier found at compile time, so that getHeader of these is one
+ * multiplication and one compare instead of a search */
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace uWS {
+
+namespace known_headers {
+
+static constexpr std::string_view names[] = {
+    "host", "user-agent", "accept", "accept-encoding", "accept-language", "authorization", "cookie", "content-type",
+    "content-length", "transfer-encoding", "connection", "upgrade", "origin", "referer", "cache-control", "pragma",
+    "if-none-match", "if-modified-since", "if-match", "range", "expect", "te", "forwarded", "x-forwarded-for",
+    "x-forwarded-proto", "x-forwarded-host", "x-real-ip", "x-request-id", "sec-websocket-key", "sec-websocket-version",
+    "sec-websocket-protocol", "sec-websocket-extensions"
+};
+static constexpr unsigned int NUM_HEADERS = sizeof(names) / sizeof(names[0]);
+
+static constexpr unsigned int HASH_BITS = 7;
+
+constexpr uint32_t features(std::string_view name) {
+    return (uint32_t) (unsigned char) name[0] | (uint32_t) (unsigned char) name[name.length() - 1] << 8
+        | (uint32_t) (unsigned char) name[name.length() >> 1] << 16 | (uint32_t) name.length() << 24;
+}
+
+constexpr unsigned int hash(std::string_view name, uint32_t multiplier) {
+    return (features(name) * multiplier) >> (32 - HASH_BITS);
+}
+
+/* The first odd multiplier giving every name a hash of its own */
+constexpr uint32_t findMultiplier() {
+    for (uint32_t multiplier = 0x9e3779b1; ; multiplier += 2) {
+        bool taken[1 << HASH_BITS] = {};
+        unsigned int i = 0;
+        for (; i < NUM_HEADERS && !taken[hash(names[i], multiplier)]; i++) {
+            taken[hash(names[i], multiplier)] = true;
+        }
+        if (i == NUM_HEADERS) {
+            return multiplier;
+        }
+    }
+}
+
+static constexpr uint32_t MULTIPLIER = findMultiplier();
+
+struct Slots {
+    signed char header[1 << HASH_BITS];
+};
+
+constexpr Slots makeSlots() {
+    Slots slots = {};
+    for (signed char &header : slots.header) {
+        header = -1;
+    }
+    for (unsigned int i = 0; i < NUM_HEADERS; i++) {
+        slots.header[hash(names[i], MULTIPLIER)] = (signed char) i;
+    }
+    return slots;
+}
+
+static constexpr Slots slots = makeSlots();
+
+}
+
+struct KnownHeaders {
+    static constexpr const std::string_view *names = known_headers::names;
+    static constexpr unsigned int NUM_HEADERS = known_headers::NUM_HEADERS;
+    static constexpr int HOST = 0;
+
+    /* Where each of them is in HttpRequest::headers, 0 (the request line) if not there */
+    unsigned char indices[NUM_HEADERS];
+
+    /* Which of the well-known headers this is, or -1 */
+    static constexpr int find(std::string_view lowerCasedHeader) {
+        if (lowerCasedHeader.empty()) {
+            return -1;
+        }
+        int header = known_headers::slots.header[known_headers::hash(lowerCasedHeader, known_headers::MULTIPLIER)];
+        return (header != -1 && names[header] == lowerCasedHeader) ? header : -1;
+    }
+
+    void reset() {
+        memset(indices, 0, sizeof(indices));
+    }
+};
+
+}
+
+#endif // UWS_KNOWNHEADERS_H
@@ -1,64 +1,459 @@
-/* This header is highly experimental and needs refactorings but will do for now */
+/*
+ * Authored by Alex Hultman, 2018-2024.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_LOCALCLUSTER_H
+#define UWS_LOCALCLUSTER_H
+
+/* A LocalCluster runs one App per thread, each on its own Loop, and spreads accepted sockets over them. Sockets
+ * staying long (WebSockets) can end up piled on some loops over time, which Rebalancing moves to others */
+
+#include "App.h"
+#include "MpscQueue.h"
 
 #include <thread>
 #include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <iostream>
+#include <type_traits>
+#include <ctime>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
-unsigned int roundRobin = 0;
-unsigned int hardwareConcurrency = std::thread::hardware_concurrency();
-std::vector<std::thread *> threads(hardwareConcurrency);
-std::vector<uWS::SSLApp *> apps;
-std::mutex m;
+#ifdef __linux__
+#include <sched.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+#endif
 
 namespace uWS {
+
+template <typename APP = SSLApp>
 struct LocalCluster {
 
-    //std::vector<std::thread *> threads = std::thread::hardware_concurrency();
-    //std::vector<uWS::SSLApp *> apps;
-    //std::mutex m;
+    enum Strategy {
+        /* Every thread listens with SO_REUSEPORT and the kernel picks (see steerReusePortByCpu) */
+        REUSE_PORT,
+        /* Accepted sockets are handed off to the next thread in turn */
+        ROUND_ROBIN,
+        /* Accepted sockets are handed off to the thread with the least open sockets */
+        LEAST_CONNECTIONS,
+        /* Accepted sockets are handed off to the thread pinned to the CPU that processed their packets (SO_INCOMING_CPU,
+         * Linux), so that reading them stays on that core, else as LEAST_CONNECTIONS. Needs pinThreads */
+        INCOMING_CPU
+    };
+
+    /* What a loop did over the last interval */
+    struct LoopLoad {
+        unsigned int connections;
+        /* Share of the interval its thread was on a CPU, 0 to 1 (always 0 on Windows) */
+        double cpu;
+    };
+
+    /* Moving count WebSockets from the loop of one index to that of another */
+    struct Migration {
+        unsigned int from, to, count;
+    };
+
+    /* Every interval ms (0 never), policy is given the load of every loop and returns what to move where. The sockets
+     * moved are WebSockets of plain TCP apps (see TemplatedApp::migrate) with data at the time, those keeping a loop busy */
+    struct Rebalancing {
+        unsigned int interval = 0;
+        std::function<std::vector<Migration>(const std::vector<LoopLoad> &)> policy = balanceLoad;
+    };
+
+    /* Moves from the busiest loop to the idlest, by CPU once one is half busy and else by connections, halving
+     * their difference unless it is small */
+    static std::vector<Migration> balanceLoad(const std::vector<LoopLoad> &loads) {
+        bool byCpu = std::any_of(loads.begin(), loads.end(), [](const LoopLoad &load) {
+            return load.cpu >= 0.5;
+        });
+        auto less = [byCpu](const LoopLoad &a, const LoopLoad &b) {
+            return byCpu ? a.cpu < b.cpu : a.connections < b.connections;
+        };
+        unsigned int busiest = (unsigned int) (std::max_element(loads.begin(), loads.end(), less) - loads.begin());
+        unsigned int idlest = (unsigned int) (std::min_element(loads.begin(), loads.end(), less) - loads.begin());
+
+        unsigned int count = 0;
+        if (byCpu) {
+            double difference = loads[busiest].cpu - loads[idlest].cpu;
+            if (difference >= 0.2) {
+                count = (unsigned int) (loads[busiest].connections * difference / (2 * loads[busiest].cpu));
+            }
+        } else {
+            unsigned int difference = loads[busiest].connections - loads[idlest].connections;
+            if (difference >= std::max<unsigned int>(16, loads[busiest].connections / 4)) {
+                count = difference / 2;
+            }
+        }
+
+        if (!count) {
+            return {};
+        }
+        return {{busiest, idlest, count}};
+    }
+
+private:
+    struct Worker {
+        APP *app = nullptr;
+        LoopData *loopData = nullptr;
+        std::thread *thread = nullptr;
 
+        /* Accepted sockets from other threads, many accepting threads produce and this loop consumes */
+        BoundedMpscQueue<LIBUS_SOCKET_DESCRIPTOR> handoffs;
+        /* Sockets handed off but not yet adopted, they count as load already */
+        std::atomic<unsigned int> inFlight{0};
+        /* Only the producer flipping this from false wakes the loop up */
+        std::atomic<bool> wakeupPending{false};
+        /* The CPU we are pinned to, if any */
+        int cpu = -1;
 
-    static void loadBalancer() {
-        static std::atomic<unsigned int> roundRobin = 0; // atomic fetch_add
+#ifndef _WIN32
+        /* CPU time of the thread, sampled by rebalanceTimer */
+        clockid_t cpuClock;
+        uint64_t lastCpuNanoseconds = 0;
+#endif
+
+        unsigned int load() {
+            return loopData->numSockets.load(std::memory_order_relaxed) + inFlight.load(std::memory_order_relaxed);
+        }
+    };
+
+    Strategy strategy;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned int> roundRobin{0};
+    /* By CPU, the first worker pinned to it, for INCOMING_CPU */
+    std::vector<Worker *> workersByCpu;
+
+    Rebalancing rebalancing;
+    /* On the loop of the first thread */
+    us_timer_t *rebalanceTimer = nullptr;
+
+    /* Apps are created one thread at a time, in order, so that listen sockets join the reuseport group in thread order */
+    std::mutex constructionMutex;
+    std::condition_variable constructionCv;
+    unsigned int constructed = 0, finished = 0;
+
+    /* The preOpen handler cannot capture so it finds us through the accepting thread */
+    static Worker *&currentWorker() {
+        static thread_local Worker *worker = nullptr;
+        return worker;
     }
 
-    LocalCluster(SocketContextOptions options = {}, std::function<void(uWS::SSLApp &)> cb = nullptr) {
-        std::transform(threads.begin(), threads.end(), threads.begin(), [options, &cb](std::thread *) {
+    static LocalCluster *&currentCluster() {
+        static thread_local LocalCluster *cluster = nullptr;
+        return cluster;
+    }
+
+    Worker *pick(LIBUS_SOCKET_DESCRIPTOR fd) {
+        if (strategy == ROUND_ROBIN) {
+            return workers[roundRobin.fetch_add(1, std::memory_order_relaxed) % workers.size()].get();
+        }
 
-            return new std::thread([options, &cb]() {
+#ifdef __linux__
+        if (strategy == INCOMING_CPU) {
+            int cpu = -1;
+            socklen_t length = sizeof(cpu);
+            if (!getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) && cpu >= 0 && (size_t) cpu < workersByCpu.size() && workersByCpu[(size_t) cpu]) {
+                return workersByCpu[(size_t) cpu];
+            }
+        }
+#else
+        (void) fd;
+#endif
 
-                // lock this
-                m.lock();
-                apps.emplace_back(new uWS::SSLApp(options));
-                uWS::SSLApp *app = apps.back();
+        /* Least connections, preferring ourselves on ties to skip a handoff */
+        Worker *leastLoaded = currentWorker();
+        unsigned int leastLoad = leastLoaded->load();
+        for (auto &worker : workers) {
+            unsigned int load = worker->load();
+            if (load < leastLoad) {
+                leastLoad = load;
+                leastLoaded = worker.get();
+            }
+        }
+        return leastLoaded;
+    }
 
-                cb(*app);
-                
-                app->preOpen([](struct us_socket_context_t *context, LIBUS_SOCKET_DESCRIPTOR fd) -> LIBUS_SOCKET_DESCRIPTOR {
+    static void handoff(Worker *worker, LIBUS_SOCKET_DESCRIPTOR fd) {
+        worker->inFlight.fetch_add(1, std::memory_order_relaxed);
 
-                    std::ignore = context;
+        if (!worker->handoffs.push(fd)) {
+            /* Full queue means the receiving loop is far behind anyways, so take the slow path */
+            worker->app->getLoop()->defer([worker, fd]() {
+                worker->app->adoptSocket(fd);
+                worker->inFlight.fetch_sub(1, std::memory_order_relaxed);
+            });
+            return;
+        }
 
-                    /* Distribute this socket in round robin fashion */
-                    //std::cout << "About to load balance " << fd << " to " << roundRobin << std::endl;
+        if (!worker->wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+            us_wakeup_loop((us_loop_t *) worker->app->getLoop());
+        }
+    }
+
+    static LIBUS_SOCKET_DESCRIPTOR preOpenHandler(struct us_socket_context_t */*context*/, LIBUS_SOCKET_DESCRIPTOR fd) {
+        Worker *receivingWorker = currentCluster()->pick(fd);
+
+        /* Returning the same fd means we keep it */
+        if (receivingWorker == currentWorker()) {
+            return fd;
+        }
+
+        handoff(receivingWorker, fd);
+        return (LIBUS_SOCKET_DESCRIPTOR) -1;
+    }
+
+    /* Runs on the receiving loop after every iteration */
+    static void adoptHandoffs(Worker *worker) {
+        /* Clear before draining so that anything pushed after this wakes us up again */
+        if (!worker->wakeupPending.load(std::memory_order_relaxed) || !worker->wakeupPending.exchange(false, std::memory_order_acq_rel)) {
+            return;
+        }
+
+        LIBUS_SOCKET_DESCRIPTOR fd;
+        while (worker->handoffs.pop(fd)) {
+            worker->app->adoptSocket(fd);
+            worker->inFlight.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
 
-                    auto receivingApp = apps[roundRobin];
-                    apps[roundRobin]->getLoop()->defer([fd, receivingApp]() {
-                        receivingApp->adoptSocket(fd);
-                    });
+    /* Runs on the loop of the first thread every interval, the others learn what to shed through defer */
+    void rebalance() {
+        std::vector<LoopLoad> loads;
+        for (auto &worker : workers) {
+            LoopLoad load = {worker->loopData->numSockets.load(std::memory_order_relaxed), 0};
+#ifndef _WIN32
+            struct timespec ts;
+            if (!clock_gettime(worker->cpuClock, &ts)) {
+                uint64_t cpuNanoseconds = (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+                load.cpu = std::min(1.0, (double) (cpuNanoseconds - worker->lastCpuNanoseconds) / (rebalancing.interval * 1000000.0));
+                worker->lastCpuNanoseconds = cpuNanoseconds;
+            }
+#endif
+            loads.push_back(load);
+        }
 
-                    roundRobin = (roundRobin + 1) % hardwareConcurrency;
-                    return (LIBUS_SOCKET_DESCRIPTOR) -1;
+        /* Every loop is told, so that what it was asked to shed last time is over */
+        std::vector<Migration> migrations = rebalancing.policy(loads);
+        for (unsigned int i = 0; i < workers.size(); i++) {
+            unsigned int count = 0;
+            APP *target = nullptr;
+            for (Migration &migration : migrations) {
+                if (migration.from == i && migration.to < workers.size() && migration.to != i && migration.count) {
+                    count = migration.count;
+                    target = workers[migration.to]->app;
+                }
+            }
+            workers[i]->app->getLoop()->defer([loopData = workers[i]->loopData, count, target]() {
+                /* A loop handing off (TemplatedApp::handOff) sheds everything, elsewhere */
+                if (loopData->handoffChannel != -1) {
+                    return;
+                }
+                loopData->migrationsWanted = count;
+                loopData->migrationTarget = target;
+            });
+        }
+    }
+
+    /* Runs on every loop after every iteration, moving what had data while we were asked to shed it */
+    static void migrateCandidates(LoopData *loopData) {
+        if (loopData->migrationCandidates.empty()) {
+            return;
+        }
+
+        std::vector<LoopData::MigrationCandidate> migrationCandidates;
+        migrationCandidates.swap(loopData->migrationCandidates);
+        for (LoopData::MigrationCandidate &migrationCandidate : migrationCandidates) {
+            /* A socket with data twice is there twice, and closed once moved */
+            if (loopData->migrationsWanted && !us_socket_is_closed(0, (us_socket_t *) migrationCandidate.socket)
+                && migrationCandidate.migrate(migrationCandidate.socket, loopData->migrationTarget)) {
+                loopData->migrationsWanted--;
+            }
+        }
+    }
+
+    void runWorker(unsigned int index, SocketContextOptions options, std::function<void(APP &)> &cb) {
+        Worker *worker = workers[index].get();
+
+        {
+            std::unique_lock<std::mutex> lock(constructionMutex);
+            constructionCv.wait(lock, [this, index]() { return constructed == index; });
+
+            worker->app = new APP(options);
+            worker->loopData = (LoopData *) us_loop_ext((us_loop_t *) worker->app->getLoop());
+            currentWorker() = worker;
+            currentCluster() = this;
+#ifndef _WIN32
+            pthread_getcpuclockid(pthread_self(), &worker->cpuClock);
+#endif
+
+            if (strategy != REUSE_PORT) {
+                worker->app->preOpen(preOpenHandler);
+                worker->app->getLoop()->addPostHandler(worker, [worker](Loop */*loop*/) {
+                    adoptHandoffs(worker);
                 });
-                m.unlock();
-                app->run();
-                std::cout << "Fallthrough!" << std::endl;
-                delete app;
+            }
+
+            if (cb) {
+                cb(*worker->app);
+            }
+
+            constructed++;
+            constructionCv.notify_all();
+
+            /* Nobody can hand off to us before every app exists */
+            constructionCv.wait(lock, [this]() { return constructed == workers.size(); });
+        }
+
+        if (rebalancing.interval) {
+            worker->app->getLoop()->addPostHandler(this, [loopData = worker->loopData](Loop */*loop*/) {
+                migrateCandidates(loopData);
             });
-        });
 
-        std::for_each(threads.begin(), threads.end(), [](std::thread *t) {
-            t->join();
-        });
+            /* The timer does not keep the loop running */
+            if (!index) {
+                rebalanceTimer = us_create_timer((us_loop_t *) worker->app->getLoop(), 1, sizeof(LocalCluster *));
+                *(LocalCluster **) us_timer_ext(rebalanceTimer) = this;
+                us_timer_set(rebalanceTimer, [](us_timer_t *t) {
+                    (*(LocalCluster **) us_timer_ext(t))->rebalance();
+                }, (int) rebalancing.interval, (int) rebalancing.interval);
+            }
+        }
+
+        worker->app->run();
+
+        /* Others may still hand off to us until they too fall through, and the app must be deleted on its own thread */
+        {
+            std::unique_lock<std::mutex> lock(constructionMutex);
+            finished++;
+            constructionCv.notify_all();
+            constructionCv.wait(lock, [this]() { return finished == workers.size(); });
+        }
+
+        if (strategy != REUSE_PORT) {
+            worker->app->getLoop()->removePostHandler(worker);
+        }
+        if (rebalancing.interval) {
+            worker->app->getLoop()->removePostHandler(this);
+            if (!index) {
+                us_timer_close(rebalanceTimer);
+            }
+        }
+        delete worker->app;
+        worker->app = nullptr;
+    }
+
+public:
+    /* Attaches a classic BPF program to the reuseport group of this listen socket, steering every connection
+     * to the listen socket of the same index as the CPU handling it. Use with REUSE_PORT and pinThreads (one thread
+     * per CPU, no cores), calling it from any one listen handler, so that connections are served on the CPU that
+     * received them. With cores of your own, INCOMING_CPU does the same for whichever CPUs have a thread */
+    static bool steerReusePortByCpu(us_listen_socket_t *listenSocket) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+        struct sock_filter code[] = {
+            {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t) (SKF_AD_OFF + SKF_AD_CPU)},
+            {BPF_RET | BPF_A, 0, 0, 0}
+        };
+        struct sock_fprog program = {2, code};
+
+        /* Listen sockets have no SSL state so their native handle is always the fd */
+        int fd = (int) (intptr_t) us_socket_get_native_handle(0, (us_socket_t *) listenSocket);
+        return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+#else
+        (void) listenSocket;
+        return false;
+#endif
+    }
+
+    /* Blocks until all threads have fallen through their run. With pinThreads, thread i runs on cores[i % cores.size()],
+     * such as cores isolated for loops that busy poll (Loop::setBusyPoll), or on CPU i when cores is empty */
+    LocalCluster(SocketContextOptions options = {}, std::function<void(APP &)> cb = nullptr, Strategy strategy = REUSE_PORT,
+        unsigned int numThreads = std::thread::hardware_concurrency(), bool pinThreads = false, Rebalancing rebalancing = {},
+        std::vector<unsigned int> cores = {})
+        : strategy(strategy), rebalancing(std::move(rebalancing)) {
+
+        /* TLS state is bound to its loop */
+        if (this->rebalancing.interval && std::is_same_v<APP, SSLApp>) {
+            std::cerr << "Error: Rebalancing moves WebSockets of App only, not of SSLApp!" << std::endl;
+            std::terminate();
+        }
+
+        /* Without threads on known CPUs there is nothing to match sockets with */
+        if (strategy == INCOMING_CPU && !pinThreads) {
+            std::cerr << "Error: INCOMING_CPU needs pinThreads!" << std::endl;
+            std::terminate();
+        }
+
+        numThreads = std::max<unsigned int>(numThreads, 1);
+        for (unsigned int i = 0; i < numThreads; i++) {
+            workers.emplace_back(new Worker);
+#ifdef __linux__
+            /* Known before any thread accepts */
+            if (pinThreads) {
+                unsigned int cpu = cores.size() ? cores[i % cores.size()] : i % std::max<unsigned int>(std::thread::hardware_concurrency(), 1);
+                workers[i]->cpu = (int) cpu;
+                if (workersByCpu.size() <= cpu) {
+                    workersByCpu.resize(cpu + 1, nullptr);
+                }
+                if (!workersByCpu[cpu]) {
+                    workersByCpu[cpu] = workers[i].get();
+                }
+            }
+#endif
+        }
+
+        for (unsigned int i = 0; i < numThreads; i++) {
+            workers[i]->thread = new std::thread([this, i, options, &cb]() {
+                runWorker(i, options, cb);
+            });
+
+#ifdef __linux__
+            if (workers[i]->cpu != -1) {
+                cpu_set_t cpuSet;
+                CPU_ZERO(&cpuSet);
+                CPU_SET((size_t) workers[i]->cpu, &cpuSet);
+                pthread_setaffinity_np(workers[i]->thread->native_handle(), sizeof(cpu_set_t), &cpuSet);
+            }
+#else
+            (void) cores;
+#endif
+        }
+
+        for (auto &worker : workers) {
+            worker->thread->join();
+            delete worker->thread;
+        }
     }
 };
-}
\ No newline at end of file
+
+/* uWS::LocalCluster({...}, [](uWS::SSLApp &app) {...}) runs SSLApps and [](uWS::App &app) {...} runs Apps */
+template <typename CB, typename... Args>
+LocalCluster(SocketContextOptions, CB, Args &&...) -> LocalCluster<std::conditional_t<std::is_invocable_v<CB, SSLApp &>, SSLApp, App>>;
+
+}
+
+#endif // UWS_LOCALCLUSTER_H
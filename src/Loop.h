@@ -21,8 +21,13 @@
 /* The loop is lazily created per-thread and run with run() */
 
 #include "LoopData.h"
+#include "AsyncSocketData.h"
+#include "BlockPool.h"
+#include "WorkerPool.h"
 #include <libusockets.h>
 #include <iostream>
+#include <climits>
+#include <algorithm>
 
 namespace uWS {
 
@@ -39,22 +44,53 @@ private:
     static void wakeupCb(us_loop_t *loop) {
         LoopData *loopData = (LoopData *) us_loop_ext(loop);
 
-        /* Swap current deferQueue */
-        loopData->deferMutex.lock();
-        int oldDeferQueue = loopData->currentDeferQueue;
-        loopData->currentDeferQueue = (loopData->currentDeferQueue + 1) % 2;
-        loopData->deferMutex.unlock();
+        /* Clear before draining so that anything deferred from now on wakes us up again */
+        loopData->wakeupPending.store(false, std::memory_order_seq_cst);
 
-        /* Drain the queue */
-        for (auto &x : loopData->deferQueues[oldDeferQueue]) {
-            x();
+        /* Drain the lock-free queue, but never more than one queue worth so that callbacks deferring themselves cannot starve the loop */
+        MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> cb;
+        size_t drained = 0;
+        while (drained < LoopData::DEFER_QUEUE_SIZE && loopData->deferQueue.pop(cb)) {
+            cb();
+            drained++;
+        }
+        cb = nullptr;
+        if (drained == LoopData::DEFER_QUEUE_SIZE && !loopData->wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+            us_wakeup_loop(loop);
+        }
+
+        /* Anything that overflowed was deferred after what we just drained */
+        if (loopData->deferOverflowing.load(std::memory_order_acquire)) {
+            /* Swap current deferQueue */
+            loopData->deferMutex.lock();
+            int oldDeferQueue = loopData->currentDeferQueue;
+            loopData->currentDeferQueue = (loopData->currentDeferQueue + 1) % 2;
+            loopData->deferOverflowing.store(false, std::memory_order_relaxed);
+            loopData->deferMutex.unlock();
+
+            /* Drain the queue */
+            for (auto &x : loopData->deferQueues[oldDeferQueue]) {
+                x();
+            }
+            loopData->deferQueues[oldDeferQueue].clear();
         }
-        loopData->deferQueues[oldDeferQueue].clear();
     }
 
     static void preCb(us_loop_t *loop) {
         LoopData *loopData = (LoopData *) us_loop_ext(loop);
 
+        loopData->iteration++;
+#ifdef UWS_WITH_METRICS
+        loopData->metrics.beginIteration();
+#endif
+
+        /* Time spent waiting for events is time we caught up */
+        if (loopData->maxLag) {
+            loopData->iterationBegan = std::chrono::steady_clock::now();
+            uint64_t waited = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(loopData->iterationBegan - loopData->iterationEnded).count();
+            loopData->lag = waited < loopData->lag ? loopData->lag - (unsigned int) waited : 0;
+        }
+
         for (auto &p : loopData->preHandlers) {
             p.second((Loop *) loop);
         }
@@ -67,11 +103,89 @@ private:
             p.second((Loop *) loop);
         }
 
+        /* Everything sent while others were corked goes out now, one drain per socket */
+        if (loopData->deferredFlushes.size()) {
+            std::vector<LoopData::DeferredFlush> deferredFlushes;
+            deferredFlushes.swap(loopData->deferredFlushes);
+            for (LoopData::DeferredFlush &deferredFlush : deferredFlushes) {
+                deferredFlush.flush(deferredFlush.socket);
+            }
+            /* Keep the capacity for the next iteration */
+            deferredFlushes.clear();
+            loopData->deferredFlushes.swap(deferredFlushes);
+        }
+
+        /* A long iteration makes us lag at once, short ones only bring it down bit by bit */
+        if (loopData->maxLag) {
+            loopData->iterationEnded = std::chrono::steady_clock::now();
+            uint64_t took = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(loopData->iterationEnded - loopData->iterationBegan).count();
+            loopData->lag = std::max((unsigned int) std::min<uint64_t>(took, UINT_MAX), loopData->lag - loopData->lag / 4);
+        }
+
+        /* Lagging, we stop accepting and leave new connections to the backlog (or other loops listening too) */
+        if (loopData->listenSocketsPaused ? !loopData->overLag(75) : loopData->overLag(100, PAUSE_CONNECTIONS)) {
+            loopData->listenSocketsPaused = !loopData->listenSocketsPaused;
+            for (LoopData::ListenSocket &listenSocket : loopData->listenSockets) {
+                us_poll_change((us_poll_t *) listenSocket.listenSocket, loop, loopData->listenSocketsPaused ? 0 : LIBUS_SOCKET_READABLE);
+            }
+        }
+
+        /* What we hold counts towards the budget of every loop of the process */
+        BackPressurePool &backPressurePool = BackPressurePool::get();
+        backPressurePool.report();
+        if (loopData->pausedReads.size() && !loopData->overBackpressureBudget(75) && !loopData->overLag(75)) {
+            std::vector<LoopData::PausedReads> pausedReads;
+            pausedReads.swap(loopData->pausedReads);
+            for (LoopData::PausedReads &paused : pausedReads) {
+                paused.resume(paused.socket);
+            }
+        }
+
+#ifdef UWS_WITH_METRICS
+        loopData->metrics.backpressureHeld.store(backPressurePool.held, std::memory_order_relaxed);
+        loopData->metrics.endIteration();
+#endif
+
+        /* Busy polling, we wake ourselves up so that the next poll returns at once rather than block */
+        if (loopData->busyPoll) {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (loopData->dataRead) {
+                loopData->dataRead = false;
+                loopData->busyPollUntil = now + std::chrono::microseconds(loopData->busyPoll);
+            }
+            if (now < loopData->busyPollUntil && !loopData->wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+                UWS_METRIC(loopData, busyPolls, 1);
+                us_wakeup_loop(loop);
+            }
+        }
+
         /* After every event loop iteration, we must not hold the cork buffer */
         if (loopData->corkedSocket) {
             std::cerr << "Error: Cork buffer must not be held across event loop iterations!" << std::endl;
             std::terminate();
         }
+
+        /* Nobody holds it, so now it may grow */
+        loopData->growCorkBuffer();
+    }
+
+    /* Sets the us_timer to the next tick of the timing wheel, unless it already fires before it */
+    static void scheduleTimingWheel(LoopData *loopData) {
+        uint64_t next = loopData->timingWheel->nextTick();
+        if (next >= loopData->timingWheelScheduled) {
+            return;
+        }
+
+        uint64_t now = loopData->getTimingWheelTime();
+        int ms = next > now ? (int) std::min<uint64_t>(next - now, INT_MAX) : 1;
+        us_timer_set(loopData->timingWheelTimer, [](struct us_timer_t *t) {
+            LoopData *loopData;
+            memcpy(&loopData, us_timer_ext(t), sizeof(LoopData *));
+            loopData->timingWheelScheduled = UINT64_MAX;
+            loopData->timingWheel->advance(loopData->getTimingWheelTime());
+            scheduleTimingWheel(loopData);
+        }, ms, 0);
+        loopData->timingWheelScheduled = next;
     }
 
     Loop() = delete;
@@ -117,7 +231,7 @@ private:
 public:
 
     /* Preformatted messages need the Loop */
-    PreparedMessage prepareMessage(std::string_view message, int opCode, bool compress = true) {
+    PreparedMessage prepareMessage(std::string_view message, int opCode, bool compress = true, int compressionLevel = DEFAULT_COMPRESSION_LEVEL) {
         /* The message could be formatted right here, but this optimization is not done yet */
         PreparedMessage preparedMessage;
         preparedMessage.compressed = compress;
@@ -128,12 +242,10 @@ public:
 
         if (compress) {
             /* Initialize loop's deflate inflate streams */
-            if (!loopData->zlibContext) {
-                loopData->zlibContext = new ZlibContext;
-                loopData->inflationStream = new InflationStream(CompressOptions::DEDICATED_DECOMPRESSOR);
-                loopData->deflationStream = new DeflationStream(CompressOptions::DEDICATED_COMPRESSOR);
-            }
+            loopData->initCompression();
 
+            /* Whole message, so this goes to libdeflate when we have it */
+            loopData->deflationStream->setLevel(compressionLevel);
             preparedMessage.compressedMessage = loopData->deflationStream->deflate(loopData->zlibContext, {preparedMessage.originalMessage.data(), preparedMessage.originalMessage.length()}, true);
         }
 
@@ -164,15 +276,74 @@ public:
 
         /* Stop and free dateTimer first */
         us_timer_close(loopData->dateTimer);
+        if (loopData->timingWheelTimer) {
+            us_timer_close(loopData->timingWheelTimer);
+        }
 
         loopData->~LoopData();
         /* uSockets will track whether this loop is owned by us or a borrowed alien loop */
         us_loop_free((us_loop_t *) this);
 
+        /* No socket of ours can hold backpressure anymore */
+        BackPressurePool::get().trim();
+        BlockPool::get().trim();
+
         /* Reset lazyLoop */
         getLazyLoop().loop = nullptr;
     }
 
+#ifndef _WIN32
+    /* This loop's open files for HttpResponse::sendFile, made on first use */
+    FileCache *getFileCache() {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        if (!loopData->fileCache) {
+            loopData->fileCache = new FileCache;
+        }
+        return loopData->fileCache;
+    }
+#endif
+
+#ifdef UWS_WITH_METRICS
+    /* Counters of this loop, snapshot() may be taken from any thread for as long as the loop lives */
+    LoopMetrics *getMetrics() {
+        return &((LoopData *) us_loop_ext((us_loop_t *) this))->metrics;
+    }
+#endif
+
+#ifdef UWS_WITH_CAPTURE
+    /* Records what clients of connections opened from now on send, to path, for benchmarks to replay (see
+     * TrafficCapture). Captures hold whatever clients sent, cookies and all. Stops past maxBytes, 0 for no limit */
+    bool startCapture(const char *path, uint64_t maxBytes = 0) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+        stopCapture();
+        loopData->capture = TrafficCapture::create(path, maxBytes);
+        return loopData->capture;
+    }
+
+    void stopCapture() {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+        delete loopData->capture;
+        loopData->capture = nullptr;
+    }
+#endif
+
+    /* Arms timer to fire ms from now (with millisecond resolution), replacing what it was armed for. Timers are
+     * cancelled with Timer::cancel or by being destroyed and must only be touched on the thread of this loop */
+    void armTimer(TimingWheel::Timer *timer, uint64_t ms) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        if (!loopData->timingWheel) {
+            loopData->timingWheelEpoch = std::chrono::steady_clock::now();
+            loopData->timingWheel = loopData->arena.make<TimingWheel>();
+            loopData->timingWheelTimer = us_create_timer((struct us_loop_t *) this, 0, sizeof(LoopData *));
+            memcpy(us_timer_ext(loopData->timingWheelTimer), &loopData, sizeof(LoopData *));
+        }
+
+        loopData->timingWheel->arm(timer, ms, loopData->getTimingWheelTime());
+        scheduleTimingWheel(loopData);
+    }
+
     void addPostHandler(void *key, MoveOnlyFunction<void(Loop *)> &&handler) {
         LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
 
@@ -200,15 +371,66 @@ public:
     }
 
     /* Defer this callback on Loop's thread of execution */
-    void defer(MoveOnlyFunction<void()> &&cb) {
+    void defer(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&cb) {
         LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
 
         //if (std::thread::get_id() == ) // todo: add fast path for same thread id
-        loopData->deferMutex.lock();
-        loopData->deferQueues[loopData->currentDeferQueue].emplace_back(std::move(cb));
-        loopData->deferMutex.unlock();
+        /* Once anything overflowed, everyone takes the slow path until the loop caught up */
+        if (loopData->deferOverflowing.load(std::memory_order_acquire) || !loopData->deferQueue.push(std::move(cb))) {
+            loopData->deferMutex.lock();
+            loopData->deferOverflowing.store(true, std::memory_order_relaxed);
+            loopData->deferQueues[loopData->currentDeferQueue].emplace_back(std::move(cb));
+            loopData->deferMutex.unlock();
+        }
+
+        /* Producers finding a wakeup already pending skip the syscall */
+        if (!loopData->wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+            us_wakeup_loop((us_loop_t *) this);
+        }
+    }
 
-        us_wakeup_loop((us_loop_t *) this);
+    /* Runs work on the WorkerPool, then done with what it returned on the thread of this loop. Results finishing
+     * close together come back in one wakeup. The loop must outlive the work */
+    template <typename WORK, typename DONE>
+    void offload(WORK &&work, DONE &&done) {
+        WorkerPool::get().post([loop = this, work = std::forward<WORK>(work), done = std::forward<DONE>(done)]() mutable {
+            if constexpr (std::is_void_v<decltype(work())>) {
+                work();
+                loop->deliver([done = std::move(done)]() mutable {
+                    done();
+                });
+            } else {
+                loop->deliver([done = std::move(done), result = work()]() mutable {
+                    done(std::move(result));
+                });
+            }
+        });
+    }
+
+    /* Called by workers */
+    void deliver(MoveOnlyFunction<void()> &&result) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(loopData->offloadMutex);
+            loopData->offloadResults.emplace_back(std::move(result));
+            first = !loopData->offloadDrainDeferred;
+            loopData->offloadDrainDeferred = true;
+        }
+        if (first) {
+            defer([loopData]() {
+                std::vector<MoveOnlyFunction<void()>> results;
+                {
+                    std::lock_guard<std::mutex> lock(loopData->offloadMutex);
+                    results.swap(loopData->offloadResults);
+                    loopData->offloadDrainDeferred = false;
+                }
+                for (MoveOnlyFunction<void()> &result : results) {
+                    result();
+                }
+            });
+        }
     }
 
     /* Actively block and run this loop */
@@ -222,6 +444,71 @@ public:
         us_loop_integrate((us_loop_t *) this);
     }
 
+    /* Caps how far the cork buffer grows when corked writes overflow it, rounded up to a multiple of 16 KB
+     * (a TLS record). Defaults to 256 KB, 16 KB keeps it from growing at all */
+    void setMaxCorkBufferSize(unsigned int size) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        if (size < LoopData::CORK_BUFFER_SIZE) {
+            size = LoopData::CORK_BUFFER_SIZE;
+        }
+        loopData->maxCorkBufferSize = (size + LoopData::CORK_BUFFER_SIZE - 1) / LoopData::CORK_BUFFER_SIZE * LoopData::CORK_BUFFER_SIZE;
+    }
+
+    /* Admission limiting for TLS: caps the handshakes in progress on this loop, so that a storm of connections does
+     * not starve the sockets already established. Connections over it wait for their turn in order, paused, as long as
+     * their timeout allows. Handshakes still run on the loop, their private key operations are not offloaded.
+     * 0 (the default) does not cap them */
+    void setMaxTlsHandshakes(unsigned int handshakes) {
+        ((LoopData *) us_loop_ext((us_loop_t *) this))->maxTlsHandshakes = handshakes;
+    }
+
+    /* Caps the bytes held in backpressure, by the sockets of this loop (loopBytes) and by those of every loop of the
+     * process together (processBytes), 0 being no cap. While over either, policies (BackpressurePolicy flags) shed
+     * load: reads pause until back under 3/4 of it, publishes and the largest WebSockets are dropped */
+    void setBackpressureBudget(size_t loopBytes, size_t processBytes = 0, int policies = PAUSE_READS | DROP_PUBLISHES) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        loopData->backpressureBudget = loopBytes;
+        loopData->processBackpressureBudget = processBytes;
+        loopData->backpressurePolicies = policies;
+    }
+
+    /* Lets a loop falling behind, with iterations taking more than milliseconds (less the time it then waits for
+     * events), stay responsive to the sockets it has by taking on less: policies (LagPolicy flags) pause new
+     * connections (our listen sockets are not polled) and answer requests and upgrades 503 until back under 3/4 of
+     * it. 0 (the default) never does. Listen sockets are then closed with TemplatedApp::close, not us_listen_socket_close */
+    void setMaxLag(unsigned int milliseconds, int policies = PAUSE_CONNECTIONS | REJECT_UPGRADES) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        loopData->maxLag = milliseconds * 1000;
+        loopData->lagPolicies = policies;
+        loopData->lag = 0;
+        loopData->iterationBegan = loopData->iterationEnded = std::chrono::steady_clock::now();
+    }
+
+    /* Trades a core for wakeup latency: for microseconds after data was last read, this loop polls for events
+     * without waiting for them instead of blocking, and sockets it accepts on Linux ask the kernel to busy poll
+     * their device queue (SO_BUSY_POLL, SO_PREFER_BUSY_POLL) for as long. Pin the thread to a core of its own
+     * (LocalCluster pinThreads and cores). 0 (the default) always blocks */
+    void setBusyPoll(unsigned int microseconds) {
+        LoopData *loopData = (LoopData *) us_loop_ext((us_loop_t *) this);
+
+        loopData->busyPoll = microseconds;
+        loopData->dataRead = false;
+        loopData->busyPollUntil = {};
+    }
+
+    /* Microseconds this loop lags behind, see setMaxLag (which it is only measured with) */
+    unsigned int getLag() {
+        return ((LoopData *) us_loop_ext((us_loop_t *) this))->lag;
+    }
+
+    /* Bytes held in backpressure by every loop of the process, as of the end of their last iteration */
+    static size_t getProcessBackpressure() {
+        return BackPressurePool::processTotal().load(std::memory_order_relaxed);
+    }
+
     /* Dynamically change this */
     void setSilent(bool silent) {
         ((LoopData *) us_loop_ext((us_loop_t *) this))->noMark = silent;
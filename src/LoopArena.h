@@ -0,0 +1,168 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_LOOPARENA_H
+#define UWS_LOOPARENA_H
+
+/* Bump allocated memory living as long as its loop, for what every loop makes once and keeps: the cork buffer,
+ * the shared and pooled compressors, the timing wheel. Nothing is given back before the arena goes away.
+ * On Linux the arena maps 2 MB aligned regions advised for transparent huge pages, and with UWS_WITH_NUMA binds
+ * them to the node of the cpu it runs on. Regions are mapped on first use, which happens on the thread of the loop,
+ * so the pages are faulted in (first touch) by the core that uses them. Define UWS_NO_HUGEPAGES to not advise. */
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#ifdef UWS_WITH_NUMA
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace uWS {
+
+struct LoopArena {
+    static constexpr size_t REGION_SIZE = 2 * 1024 * 1024;
+
+private:
+    struct Region {
+        Region *next;
+        size_t size;
+    };
+
+    Region *regions = nullptr;
+    char *cursor = nullptr, *end = nullptr;
+    size_t mappedBytes = 0;
+
+    static void *map(size_t size) {
+#ifdef __linux__
+        /* Map one region more than we need and cut what is outside the aligned part */
+        char *p = (char *) mmap(nullptr, size + REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+        char *aligned = (char *) (((uintptr_t) p + REGION_SIZE - 1) & ~(uintptr_t) (REGION_SIZE - 1));
+        if (aligned != p) {
+            munmap(p, (size_t) (aligned - p));
+        }
+        if (size_t tail = (size_t) (p + REGION_SIZE - aligned)) {
+            munmap(aligned + size, tail);
+        }
+
+#ifndef UWS_NO_HUGEPAGES
+        madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+#ifdef UWS_WITH_NUMA
+        /* MPOL_PREFERRED, so that a full node is no reason to fail. Same as libnuma without linking it */
+        unsigned int cpu, node;
+        if (!syscall(SYS_getcpu, &cpu, &node, nullptr) && node < 64) {
+            unsigned long nodemask = 1ul << node;
+            syscall(SYS_mbind, aligned, size, 1 /* MPOL_PREFERRED */, &nodemask, 64, 0);
+        }
+#endif
+        return aligned;
+#else
+        return malloc(size);
+#endif
+    }
+
+    static void unmap(void *p, size_t size) {
+#ifdef __linux__
+        munmap(p, size);
+#else
+        (void) size;
+        free(p);
+#endif
+    }
+
+public:
+    LoopArena() = default;
+    LoopArena(const LoopArena &) = delete;
+    LoopArena &operator=(const LoopArena &) = delete;
+
+    ~LoopArena() {
+        while (Region *region = regions) {
+            regions = region->next;
+            unmap(region, region->size);
+        }
+    }
+
+    /* Throws std::bad_alloc like new does when the system is out of memory */
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        char *p = (char *) (((uintptr_t) cursor + alignment - 1) & ~(uintptr_t) (alignment - 1));
+        if (!cursor || p + size > end) {
+            /* Anything bigger than a quarter region gets its own, so that we never waste much of one */
+            size_t regionSize = REGION_SIZE;
+            size_t needed = sizeof(Region) + alignment + size;
+            if (needed > REGION_SIZE / 4) {
+                regionSize = (needed + REGION_SIZE - 1) & ~(REGION_SIZE - 1);
+            }
+
+            Region *region = (Region *) map(regionSize);
+            if (!region) {
+                throw std::bad_alloc();
+            }
+            mappedBytes += regionSize;
+
+            char *begin = (char *) (region + 1);
+            p = (char *) (((uintptr_t) begin + alignment - 1) & ~(uintptr_t) (alignment - 1));
+
+            region->size = regionSize;
+            if (regionSize != REGION_SIZE && cursor) {
+                /* Keep bumping the current region (the first one), the big one is full already */
+                region->next = regions->next;
+                regions->next = region;
+                return p;
+            }
+
+            region->next = regions;
+            regions = region;
+            end = (char *) region + regionSize;
+        }
+        cursor = p + size;
+        return p;
+    }
+
+    /* Objects of the arena are destroyed with destroy, their memory stays until the arena goes */
+    template <typename T, typename... Args>
+    T *make(Args &&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    void destroy(T *object) {
+        if (object) {
+            object->~T();
+        }
+    }
+
+    /* Bytes mapped so far */
+    size_t size() {
+        return mappedBytes;
+    }
+};
+
+}
+
+#endif // UWS_LOOPARENA_H
@@ -21,26 +21,79 @@
 #include <thread>
 #include <functional>
 #include <vector>
+#include <deque>
 #include <mutex>
 #include <map>
 #include <ctime>
 #include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "PerMessageDeflate.h"
+#include "FileCache.h"
 #include "MoveOnlyFunction.h"
+#include "MpscQueue.h"
+#include "TimingWheel.h"
+#include "Metrics.h"
+#include "TrafficCapture.h"
+#include "LoopArena.h"
+#include "HttpCompression.h"
+#include "AsyncSocketData.h"
 
 struct us_timer_t;
+struct us_listen_socket_t;
+struct us_socket_context_t;
 
 namespace uWS {
 
 struct Loop;
 
+/* What a loop does while over its backpressure budget, see Loop::setBackpressureBudget */
+enum BackpressurePolicy : int {
+    /* Sockets that send us data stop being read from (but not written to) */
+    PAUSE_READS = 1,
+    /* Published messages are dropped for subscribers already holding backpressure */
+    DROP_PUBLISHES = 2,
+    /* WebSockets sending while holding several times the average backpressure are closed */
+    CLOSE_LARGEST = 4
+};
+
+/* What a loop does while lagging behind, see Loop::setMaxLag */
+enum LagPolicy : int {
+    /* Listen sockets are not polled, so that connections wait in the backlog of the kernel until the loop caught up.
+     * Those accepted otherwise (taken over) are not read from (no TLS handshake, no requests) until then */
+    PAUSE_CONNECTIONS = 1,
+    /* Requests are answered 503 before routing, static responses aside */
+    REJECT_REQUESTS = 2,
+    /* WebSocket upgrades are answered 503 instead */
+    REJECT_UPGRADES = 4
+};
+
 struct alignas(16) LoopData {
     friend struct Loop;
+
+    /* What this loop keeps for as long as it lives is allocated here, on (and near) the thread of the loop.
+     * Declared first so that it goes last */
+    LoopArena arena;
+
 private:
+    /* Deferred callbacks go through a lock-free queue of preallocated cells, only when it is full do we
+     * fall back to the double buffered, mutex protected queues (and stay there until the loop caught up, to keep order) */
+    static const size_t DEFER_QUEUE_SIZE = 1024;
+    BoundedMpscQueue<MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE>> deferQueue{DEFER_QUEUE_SIZE};
+    std::atomic<bool> deferOverflowing{false};
+    /* Only the thread flipping this from false wakes the loop up */
+    std::atomic<bool> wakeupPending{false};
+
     std::mutex deferMutex;
     int currentDeferQueue = 0;
-    std::vector<MoveOnlyFunction<void()>> deferQueues[2];
+    std::vector<MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE>> deferQueues[2];
 
     /* Map from void ptr to handler */
     std::map<void *, MoveOnlyFunction<void(Loop *)>> postHandlers, preHandlers;
@@ -53,11 +106,40 @@ public:
     ~LoopData() {
         /* If we have had App.ws called with compression we need to clear this */
         if (zlibContext) {
-            delete zlibContext;
-            delete inflationStream;
-            delete deflationStream;
+            arena.destroy(zlibContext);
+            arena.destroy(inflationStream);
+            arena.destroy(deflationStream);
+        }
+#ifndef _WIN32
+        delete fileCache;
+#endif
+        for (HttpCompressor *httpCompressor : httpCompressors) {
+            delete httpCompressor;
+        }
+#ifndef _WIN32
+        if (handoffChannel != -1) {
+            close(handoffChannel);
+        }
+#endif
+#ifdef __linux__
+        if (splicePipe[0] != -1) {
+            close(splicePipe[0]);
+            close(splicePipe[1]);
+        }
+#endif
+        arena.destroy(timingWheel);
+#ifdef UWS_WITH_CAPTURE
+        delete capture;
+#endif
+    }
+
+    /* Makes the shared streams of this loop, on first use */
+    void initCompression() {
+        if (!zlibContext) {
+            zlibContext = arena.make<ZlibContext>(&arena);
+            inflationStream = arena.make<InflationStream>(CompressOptions::DEDICATED_DECOMPRESSOR, std::string_view{}, &arena);
+            deflationStream = arena.make<DeflationStream>(CompressOptions::DEDICATED_COMPRESSOR, std::string_view{}, DEFAULT_COMPRESSION_LEVEL, &arena);
         }
-        delete [] corkBuffer;
     }
 
     void updateDate() {
@@ -92,20 +174,201 @@ public:
     /* Be silent */
     bool noMark = false;
 
-    /* Good 16k for SSL perf. */
+    /* Sockets currently open on this loop (HTTP and WebSocket), read by other threads for load balancing */
+    std::atomic<unsigned int> numSockets{0};
+
+    /* TLS handshakes in progress on this loop, at most maxTlsHandshakes of them (0 is any number). Sockets accepted
+     * over it are paused and wait in line, the one at the front of it being number tlsHandshakeQueueFront */
+    unsigned int tlsHandshakes = 0;
+    unsigned int maxTlsHandshakes = 0;
+    std::deque<void *> tlsHandshakeQueue;
+    unsigned int tlsHandshakeQueueFront = 0;
+
+    /* Good 16k for SSL perf. The cork buffer starts out this big and always is a multiple of it */
     static const unsigned int CORK_BUFFER_SIZE = 16 * 1024;
 
     /* Cork data */
-    char *corkBuffer = new char[CORK_BUFFER_SIZE];
+    char *corkBuffer = (char *) arena.allocate(CORK_BUFFER_SIZE, 64);
+    unsigned int corkBufferSize = CORK_BUFFER_SIZE;
     unsigned int corkOffset = 0;
     void *corkedSocket = nullptr;
 
+    /* What did not fit the cork buffer during this iteration makes it grow at the end of it, up to maxCorkBufferSize.
+     * Outgrown buffers stay in the arena, which is at most as much again */
+    unsigned int maxCorkBufferSize = 16 * CORK_BUFFER_SIZE;
+    size_t corkBufferWanted = 0;
+
+    /* Notes that a corked write needed the cork buffer to be size bytes */
+    void corkOverflow(size_t size) {
+        UWS_METRIC(this, corkOverflows, 1);
+        corkBufferWanted = std::max(corkBufferWanted, size);
+    }
+
+    /* Only ever called when no socket is corked */
+    void growCorkBuffer() {
+        if (corkBufferWanted > corkBufferSize && corkBufferSize < maxCorkBufferSize) {
+            unsigned int size = corkBufferSize;
+            while (size < corkBufferWanted && size < maxCorkBufferSize) {
+                size *= 2;
+            }
+            size = std::min(size, maxCorkBufferSize);
+            corkBuffer = (char *) arena.allocate(size, 64);
+            corkBufferSize = size;
+            UWS_METRIC(this, corkBufferGrowths, 1);
+        }
+        corkBufferWanted = 0;
+    }
+
+    /* While HTTP parses one read, what overflows the cork buffer waits in the corked socket's backpressure
+     * (up to this much) so that all pipelined responses go out with one write when uncorked */
+    static const unsigned int MAX_HELD_CORK_SIZE = 16 * CORK_BUFFER_SIZE;
+    bool holdCork = false;
+
     /* Per message deflate data */
     ZlibContext *zlibContext = nullptr;
     InflationStream *inflationStream = nullptr;
     DeflationStream *deflationStream = nullptr;
 
+    /* Compressors of whole HTTP bodies, by ContentEncoding, made on first use */
+    HttpCompressor *httpCompressors[NUM_CONTENT_ENCODINGS] = {};
+
+    /* Compresses a whole HTTP body, what is returned is valid until the next body of the same encoding */
+    std::string_view compressHttpBody(ContentEncoding encoding, int level, std::string_view data) {
+        HttpCompressor *&httpCompressor = httpCompressors[encoding];
+        if (httpCompressor && httpCompressor->getLevel() != level) {
+            delete httpCompressor;
+            httpCompressor = nullptr;
+        }
+        if (!httpCompressor) {
+            httpCompressor = new HttpCompressor(encoding, level);
+        } else {
+            httpCompressor->reset();
+        }
+        return httpCompressor->compress(data, true);
+    }
+
+#ifdef __linux__
+    /* Pipe of AsyncSocket::writeSpliced, made on first use and always left empty */
+    int splicePipe[2] = {-1, -1};
+
+    int *getSplicePipe() {
+        if (splicePipe[0] == -1 && pipe2(splicePipe, O_NONBLOCK | O_CLOEXEC)) {
+            splicePipe[0] = splicePipe[1] = -1;
+            return nullptr;
+        }
+        return splicePipe;
+    }
+#endif
+
+    /* Sockets whose sends wait in their backpressure for the end of this iteration (WebSocketBehavior::batchSends) */
+    struct DeferredFlush {
+        void *socket;
+        void (*flush)(void *socket);
+    };
+    std::vector<DeferredFlush> deferredFlushes;
+
+    /* Results of Loop::offload, put here by workers and run together by the one callback deferred for all of them */
+    std::mutex offloadMutex;
+    std::vector<MoveOnlyFunction<void()>> offloadResults;
+    bool offloadDrainDeferred = false;
+
+    /* While we are asked to shed migrationsWanted WebSockets, those with data are put here and moved to
+     * migrationTarget (a TemplatedApp<false>) at the end of the iteration, see LocalCluster */
+    struct MigrationCandidate {
+        void *socket;
+        bool (*migrate)(void *socket, void *target);
+    };
+    std::vector<MigrationCandidate> migrationCandidates;
+    unsigned int migrationsWanted = 0;
+    void *migrationTarget = nullptr;
+
+    /* Once TemplatedApp::handOff got a taker, its channel. Requests are answered with Connection: close and
+     * WebSockets with data are candidates handed over it (migrationTarget points here) */
+    int handoffChannel = -1;
+
+    /* Bytes of backpressure this loop, and all loops together, may hold before policies kick in (0 is any number) */
+    size_t backpressureBudget = 0;
+    size_t processBackpressureBudget = 0;
+    int backpressurePolicies = 0;
+
+    /* Whether we hold more than percent of either budget */
+    bool overBackpressureBudget(unsigned int percent = 100) {
+        BackPressurePool &pool = BackPressurePool::get();
+        return (backpressureBudget && pool.held > backpressureBudget / 100 * percent) ||
+            (processBackpressureBudget && pool.processHeld() > processBackpressureBudget / 100 * percent);
+    }
+
+    /* Microseconds the last iterations took, less the time waited for events since, and above which (0 is never)
+     * policies (LagPolicy flags) shed load. Only measured with maxLag set */
+    unsigned int lag = 0;
+    unsigned int maxLag = 0;
+    int lagPolicies = 0;
+    std::chrono::steady_clock::time_point iterationBegan, iterationEnded;
+
+    /* Whether we lag behind by more than percent of maxLag, with any of policies (or regardless) */
+    bool overLag(unsigned int percent = 100, int policies = ~0) {
+        return (lagPolicies & policies) && maxLag && lag > maxLag / 100 * percent;
+    }
+
+    /* Microseconds we keep polling without waiting after data was last read (0 is never), see Loop::setBusyPoll.
+     * Sockets reading data set dataRead, which the end of the iteration turns into busyPollUntil */
+    unsigned int busyPoll = 0;
+    bool dataRead = false;
+    std::chrono::steady_clock::time_point busyPollUntil;
+
+    /* Sockets whose reads were paused over budget (PAUSE_READS) or lagging (PAUSE_CONNECTIONS), resumed at the end of
+     * the first iteration under 3/4 of both */
+    struct PausedReads {
+        void *socket;
+        void (*resume)(void *socket);
+    };
+    std::vector<PausedReads> pausedReads;
+
+    /* Listen sockets of HttpContext::listen, not polled while lagging (PAUSE_CONNECTIONS) until the end of the first
+     * iteration under 3/4 of it. Closed ones are forgotten by their App, see TemplatedApp::close */
+    struct ListenSocket {
+        us_listen_socket_t *listenSocket;
+        us_socket_context_t *context;
+    };
+    std::vector<ListenSocket> listenSockets;
+    bool listenSocketsPaused = false;
+
+    /* Forgets the listen sockets of context, or only listenSocket, before they are closed */
+    void forgetListenSockets(us_socket_context_t *context, us_listen_socket_t *listenSocket = nullptr) {
+        listenSockets.erase(std::remove_if(listenSockets.begin(), listenSockets.end(), [context, listenSocket](ListenSocket &tracked) {
+            return listenSocket ? tracked.listenSocket == listenSocket : tracked.context == context;
+        }), listenSockets.end());
+    }
+
+#ifndef _WIN32
+    /* Open files for HttpResponse::sendFile, made on first use */
+    FileCache *fileCache = nullptr;
+#endif
+
     us_timer_t *dateTimer;
+
+    /* Counts event loop iterations, so that work can be done at most once per iteration */
+    unsigned int iteration = 0;
+
+#ifdef UWS_WITH_METRICS
+    LoopMetrics metrics;
+#endif
+
+#ifdef UWS_WITH_CAPTURE
+    /* Loop::startCapture, until stopCapture */
+    TrafficCapture *capture = nullptr;
+#endif
+
+    /* Millisecond timers, made on first use. The us_timer is set to the next tick of the wheel, timingWheelScheduled */
+    TimingWheel *timingWheel = nullptr;
+    us_timer_t *timingWheelTimer = nullptr;
+    uint64_t timingWheelScheduled = UINT64_MAX;
+    std::chrono::steady_clock::time_point timingWheelEpoch;
+
+    /* Milliseconds since the timing wheel was made */
+    uint64_t getTimingWheelTime() {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - timingWheelEpoch).count();
+    }
 };
 
 }
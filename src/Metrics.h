@@ -0,0 +1,244 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_METRICS_H
+#define UWS_METRICS_H
+
+/* Per loop counters, built with UWS_WITH_METRICS (WITH_METRICS=1) and compiled out entirely otherwise.
+ * Only the loop writes them, with relaxed loads and stores rather than locked adds, so any thread may take
+ * a snapshot of them at any time (Loop::getMetrics()->snapshot()). Snapshots of one loop are not atomic as a whole */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/* Every counter, in nanoseconds where it says so */
+#define UWS_LOOP_METRICS(X) \
+    X(iterations) \
+    X(busyPolls) /* iterations that polled without waiting rather than block, see Loop::setBusyPoll */ \
+    X(waitNanoseconds) /* time between iterations, polling for events or blocked */ \
+    X(bytesRead) \
+    X(bytesWritten) \
+    X(readSyscalls) \
+    X(writeSyscalls) \
+    X(corkHits) /* getSendBuffer found room in the cork buffer */ \
+    X(corkMisses) /* getSendBuffer had to use backpressure */ \
+    X(corkOverflows) /* corked writes that did not fit the cork buffer */ \
+    X(corkBufferGrowths) /* times the cork buffer grew because of them */ \
+    X(tlsRecordRamps) /* TLS writes starting over with small records after idle */ \
+    X(tlsSmallRecords) /* records smaller than 16 KB written while ramping up */ \
+    X(tlsHandshakesQueued) /* accepted TLS sockets that waited for their handshake over maxTlsHandshakes */ \
+    X(backpressureBytes) /* bytes that could not be written right away and were buffered */ \
+    X(droppedMessages) /* WebSocket messages dropped over maxBackpressure */ \
+    X(backpressureHeld) /* bytes held in backpressure at the end of the last iteration, not a counter */ \
+    X(budgetPausedReads) /* sockets paused for reading over the backpressure budget */ \
+    X(budgetDroppedMessages) /* published messages dropped over the backpressure budget */ \
+    X(budgetClosedSockets) /* WebSockets closed over the backpressure budget */ \
+    X(lagPausedConnections) /* accepted sockets not read from until the loop caught up, see Loop::setMaxLag */ \
+    X(lagRejectedRequests) /* requests and WebSocket upgrades answered 503 while the loop lagged */ \
+    X(rateLimitedConnections) /* connections closed over the rate of their address, see TemplatedApp::rateLimit */ \
+    X(rateLimitedRequests) /* requests and WebSocket upgrades answered 429 over the rate of their address */ \
+    X(clusterDroppedMessages) /* cluster messages dropped over a full ring or maxBackpressure of a link */ \
+    X(topicTreeDrains) /* subscribers drained */ \
+    X(topicTreeDrainedMessages) \
+    X(deflations) \
+    X(deflateNanoseconds) \
+    X(deflationsSkipped) /* messages sent uncompressed as unlikely to shrink, see CompressionStats */ \
+    X(inflations) \
+    X(inflateNanoseconds) \
+    X(parseCycles) /* with UWS_WITH_PHASE_CYCLES, CPU cycles spent in each phase but not in phases within it */ \
+    X(routeCycles) \
+    X(handlerCycles) \
+    X(formatCycles) \
+    X(compressCycles) /* compressing and decompressing */
+
+#ifdef UWS_WITH_METRICS
+#define UWS_METRIC(loopData, counter, n) uWS::LoopMetrics::add((loopData)->metrics.counter, (uint64_t) (n))
+/* Adds the time until the end of the scope to counter */
+#define UWS_METRIC_TIMED(loopData, counter) uWS::LoopMetrics::ScopedTimer uwsMetricTimer((loopData)->metrics.counter)
+#else
+#define UWS_METRIC(loopData, counter, n) ((void) 0)
+#define UWS_METRIC_TIMED(loopData, counter) ((void) 0)
+#endif
+
+/* Cycle counting per phase is for profiling (see libEpollBenchmarker), it costs two cycle counter reads per phase */
+#ifdef UWS_WITH_PHASE_CYCLES
+#ifndef UWS_WITH_METRICS
+#error "UWS_WITH_PHASE_CYCLES needs UWS_WITH_METRICS"
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+/* Attributes the cycles until the end of the scope to counter, except those of phases entered within it */
+#define UWS_PHASE(loopData, counter) uWS::LoopMetrics::ScopedPhase uwsPhase((loopData)->metrics, &(loopData)->metrics.counter)
+/* The same for an outermost phase not ending with a scope */
+#define UWS_PHASE_BEGIN(loopData, counter) (loopData)->metrics.switchPhase(&(loopData)->metrics.counter)
+#define UWS_PHASE_END(loopData) (loopData)->metrics.switchPhase(nullptr)
+#else
+#define UWS_PHASE(loopData, counter) ((void) 0)
+#define UWS_PHASE_BEGIN(loopData, counter) ((void) 0)
+#define UWS_PHASE_END(loopData) ((void) 0)
+#endif
+
+namespace uWS {
+
+/* Log-linear buckets like HDR histograms, 16 per power of two so values are within 6% */
+struct HistogramBuckets {
+    static constexpr unsigned int SUB_BITS = 4;
+    static constexpr unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr unsigned int NUM_BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static unsigned int index(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return (unsigned int) value;
+        }
+        unsigned int shift = (unsigned int) (63 - __builtin_clzll(value)) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (unsigned int) ((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /* The smallest value counted in bucket */
+    static uint64_t lowestValue(unsigned int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        unsigned int shift = bucket / SUB_BUCKETS - 1;
+        return (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    }
+};
+
+/* A plain copy of LoopMetrics */
+struct LoopMetricsSnapshot {
+#define UWS_METRIC_FIELD(name) uint64_t name = 0;
+    UWS_LOOP_METRICS(UWS_METRIC_FIELD)
+#undef UWS_METRIC_FIELD
+
+    /* Histogram of the time the loop spent per iteration (between polls), in nanoseconds */
+    uint64_t iterationTime[HistogramBuckets::NUM_BUCKETS] = {};
+
+    /* Iteration time below which the given fraction (such as 0.99) of iterations were */
+    uint64_t iterationTimePercentile(double fraction) const {
+        uint64_t total = 0;
+        for (uint64_t count : iterationTime) {
+            total += count;
+        }
+        uint64_t wanted = (uint64_t) ((double) total * fraction), seen = 0;
+        for (unsigned int i = 0; i < HistogramBuckets::NUM_BUCKETS; i++) {
+            seen += iterationTime[i];
+            if (seen > wanted) {
+                return HistogramBuckets::lowestValue(i + 1);
+            }
+        }
+        return 0;
+    }
+};
+
+struct LoopMetrics {
+#define UWS_METRIC_FIELD(name) std::atomic<uint64_t> name{0};
+    UWS_LOOP_METRICS(UWS_METRIC_FIELD)
+#undef UWS_METRIC_FIELD
+
+    std::atomic<uint64_t> iterationTime[HistogramBuckets::NUM_BUCKETS] = {};
+
+    /* When the current iteration began, and when the last one ended */
+    std::chrono::steady_clock::time_point iterationStart, iterationEnd;
+
+    /* Only ever called by the loop */
+    static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct ScopedTimer {
+        std::atomic<uint64_t> &counter;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        ScopedTimer(std::atomic<uint64_t> &counter) : counter(counter) {}
+
+        ~ScopedTimer() {
+            add(counter, (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+    };
+
+#ifdef UWS_WITH_PHASE_CYCLES
+    /* The phase we are in, if any, and since when */
+    std::atomic<uint64_t> *phase = nullptr;
+    uint64_t phaseStart = 0;
+
+    static uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#elif defined(__aarch64__)
+        uint64_t ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r" (ticks));
+        return ticks;
+#else
+        return (uint64_t) std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    void switchPhase(std::atomic<uint64_t> *next) {
+        uint64_t now = cycles();
+        if (phase) {
+            add(*phase, now - phaseStart);
+        }
+        phase = next;
+        phaseStart = now;
+    }
+
+    struct ScopedPhase {
+        LoopMetrics &metrics;
+        std::atomic<uint64_t> *outer;
+
+        ScopedPhase(LoopMetrics &metrics, std::atomic<uint64_t> *counter) : metrics(metrics), outer(metrics.phase) {
+            metrics.switchPhase(counter);
+        }
+
+        ~ScopedPhase() {
+            metrics.switchPhase(outer);
+        }
+    };
+#endif
+
+    void beginIteration() {
+        iterationStart = std::chrono::steady_clock::now();
+        if (iterationEnd.time_since_epoch().count()) {
+            add(waitNanoseconds, (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(iterationStart - iterationEnd).count());
+        }
+    }
+
+    void endIteration() {
+        add(iterations, 1);
+        iterationEnd = std::chrono::steady_clock::now();
+        uint64_t nanoseconds = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(iterationEnd - iterationStart).count();
+        add(iterationTime[HistogramBuckets::index(nanoseconds)], 1);
+    }
+
+    /* Safe to call from any thread */
+    LoopMetricsSnapshot snapshot() const {
+        LoopMetricsSnapshot snapshot;
+#define UWS_METRIC_COPY(name) snapshot.name = name.load(std::memory_order_relaxed);
+        UWS_LOOP_METRICS(UWS_METRIC_COPY)
+#undef UWS_METRIC_COPY
+        for (unsigned int i = 0; i < HistogramBuckets::NUM_BUCKETS; i++) {
+            snapshot.iterationTime[i] = iterationTime[i].load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+};
+
+}
+
+#endif // UWS_METRICS_H
@@ -22,17 +22,26 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-/* Sources fetched from https://github.com/ofats/any_invocable on 2021-02-19. */
+/* Sources fetched from https://github.com/ofats/any_invocable on 2021-02-19.
+ * Modified to take the inline storage size as template parameter and to take callables
+ * too big for it from the thread's BlockPool instead of new. */
 
 #ifndef _ANY_INVOKABLE_H_
 #define _ANY_INVOKABLE_H_
 
 #include <functional>
-
-#if !defined(__cpp_lib_move_only_function) || __cpp_lib_move_only_function < 202110L
-
 #include <memory>
 #include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "BlockPool.h"
+
+namespace uWS {
+  /* How many MoveOnlyFunctions this thread made with a callable too big to be stored inline, for tuning inline sizes */
+  inline thread_local uint64_t numSpilledFunctions = 0;
+}
 
 // clang-format off
 /*
@@ -85,22 +94,30 @@ namespace ofats {
 
 namespace any_detail {
 
-using buffer = std::aligned_storage_t<sizeof(void*) * 2, alignof(void*)>;
+template <size_t InlineSize>
+using buffer = std::aligned_storage_t<InlineSize, alignof(void*)>;
 
-template <class T>
+template <class T, size_t InlineSize>
 inline constexpr bool is_small_object_v =
-    sizeof(T) <= sizeof(buffer) && alignof(buffer) % alignof(T) == 0 &&
+    sizeof(T) <= sizeof(buffer<InlineSize>) && alignof(buffer<InlineSize>) % alignof(T) == 0 &&
     std::is_nothrow_move_constructible_v<T>;
 
+template <size_t InlineSize>
 union storage {
   void* ptr_ = nullptr;
-  buffer buf_;
+  buffer<InlineSize> buf_;
 };
 
+// Pool blocks are malloc aligned, anything aligned above that is left to new
+template <class T>
+inline constexpr bool is_pooled_v = alignof(T) <= alignof(std::max_align_t);
+
 enum class action { destroy, move };
 
-template <class R, class... ArgTypes>
+template <size_t InlineSize, class R, class... ArgTypes>
 struct handler_traits {
+  using storage = any_detail::storage<InlineSize>;
+
   template <class Derived>
   struct handler_base {
     static void handle(action act, storage* current, storage* other = nullptr) {
@@ -133,8 +150,14 @@ struct handler_traits {
     }
 
     static R call(storage& s, ArgTypes... args) {
-      return std::invoke(*static_cast<T*>(static_cast<void*>(&s.buf_)),
-                         std::forward<ArgTypes>(args)...);
+      // Results are discarded for void, such as the Task of a coroutine handler
+      if constexpr (std::is_void_v<R>) {
+        std::invoke(*static_cast<T*>(static_cast<void*>(&s.buf_)),
+                    std::forward<ArgTypes>(args)...);
+      } else {
+        return std::invoke(*static_cast<T*>(static_cast<void*>(&s.buf_)),
+                           std::forward<ArgTypes>(args)...);
+      }
     }
   };
 
@@ -142,23 +165,41 @@ struct handler_traits {
   struct large_handler : handler_base<large_handler<T>> {
     template <class... Args>
     static void create(storage& s, Args&&... args) {
-      s.ptr_ = new T(std::forward<Args>(args)...);
+      uWS::numSpilledFunctions++;
+      if constexpr (is_pooled_v<T>) {
+        s.ptr_ = new (uWS::BlockPool::get().allocate(sizeof(T))) T(std::forward<Args>(args)...);
+      } else {
+        s.ptr_ = new T(std::forward<Args>(args)...);
+      }
     }
 
-    static void destroy(storage& s) noexcept { delete static_cast<T*>(s.ptr_); }
+    static void destroy(storage& s) noexcept {
+      if constexpr (is_pooled_v<T>) {
+        static_cast<T*>(s.ptr_)->~T();
+        uWS::BlockPool::get().deallocate(s.ptr_, sizeof(T));
+      } else {
+        delete static_cast<T*>(s.ptr_);
+      }
+    }
 
     static void move(storage& dst, storage& src) noexcept {
       dst.ptr_ = src.ptr_;
     }
 
     static R call(storage& s, ArgTypes... args) {
-      return std::invoke(*static_cast<T*>(s.ptr_),
-                         std::forward<ArgTypes>(args)...);
+      // Results are discarded for void, such as the Task of a coroutine handler
+      if constexpr (std::is_void_v<R>) {
+        std::invoke(*static_cast<T*>(s.ptr_),
+                    std::forward<ArgTypes>(args)...);
+      } else {
+        return std::invoke(*static_cast<T*>(s.ptr_),
+                           std::forward<ArgTypes>(args)...);
+      }
     }
   };
 
   template <class T>
-  using handler = std::conditional_t<is_small_object_v<T>, small_handler<T>,
+  using handler = std::conditional_t<is_small_object_v<T, InlineSize>, small_handler<T>,
                                      large_handler<T>>;
 };
 
@@ -171,17 +212,16 @@ struct is_in_place_type<std::in_place_type_t<T>> : std::true_type {};
 template <class T>
 inline constexpr auto is_in_place_type_v = is_in_place_type<T>::value;
 
-template <class R, bool is_noexcept, class... ArgTypes>
+template <class R, bool is_noexcept, size_t InlineSize, class... ArgTypes>
 class any_invocable_impl {
   template <class T>
   using handler =
-      typename any_detail::handler_traits<R, ArgTypes...>::template handler<T>;
+      typename any_detail::handler_traits<InlineSize, R, ArgTypes...>::template handler<T>;
 
-  using storage = any_detail::storage;
+  using storage = any_detail::storage<InlineSize>;
   using action = any_detail::action;
-  using handle_func = void (*)(any_detail::action, any_detail::storage*,
-                               any_detail::storage*);
-  using call_func = R (*)(any_detail::storage&, ArgTypes...);
+  using handle_func = void (*)(any_detail::action, storage*, storage*);
+  using call_func = R (*)(storage&, ArgTypes...);
 
  public:
   using result_type = R;
@@ -287,14 +327,16 @@ using can_convert = std::conjunction<
 
 }  // namespace any_detail
 
-template <class Signature>
+template <class Signature, size_t InlineSize = sizeof(void*) * 2>
 class any_invocable;
 
 #define __OFATS_ANY_INVOCABLE(cv, ref, noex, inv_quals)                        \
-  template <class R, class... ArgTypes>                                        \
-  class any_invocable<R(ArgTypes...) cv ref noexcept(noex)>                    \
-      : public any_detail::any_invocable_impl<R, noex, ArgTypes...> {          \
-    using base_type = any_detail::any_invocable_impl<R, noex, ArgTypes...>;    \
+  template <class R, size_t InlineSize, class... ArgTypes>                     \
+  class any_invocable<R(ArgTypes...) cv ref noexcept(noex), InlineSize>        \
+      : public any_detail::any_invocable_impl<R, noex, InlineSize,             \
+                                              ArgTypes...> {                   \
+    using base_type =                                                          \
+        any_detail::any_invocable_impl<R, noex, InlineSize, ArgTypes...>;      \
                                                                                \
    public:                                                                     \
     using base_type::base_type;                                                \
@@ -373,17 +415,13 @@ __OFATS_ANY_INVOCABLE(const, &&, true, const&&)   // 121
 
 /* We, uWebSockets define our own type */
 namespace uWS {
-  template <class T>
-  using MoveOnlyFunction = ofats::any_invocable<T>;
-}
-
-#else // !defined(__cpp_lib_move_only_function) || __cpp_lib_move_only_function < 202110L
+  /* Callables up to InlineSize bytes are stored inline, the default fits a lambda capturing two pointers */
+  inline constexpr size_t DEFAULT_INLINE_SIZE = sizeof(void *) * 2;
+  /* Response handlers and deferred callbacks routinely capture the response, a few pointers and a string */
+  inline constexpr size_t CALLBACK_INLINE_SIZE = sizeof(void *) * 8;
 
-namespace uWS {
-  template <class T>
-  using MoveOnlyFunction = std::move_only_function<T>;
+  template <class T, size_t InlineSize = DEFAULT_INLINE_SIZE>
+  using MoveOnlyFunction = ofats::any_invocable<T, InlineSize>;
 }
 
-#endif
-
 #endif  // _ANY_INVOKABLE_H_
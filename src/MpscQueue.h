@@ -0,0 +1,100 @@
+/*
+ * Authored by Alex Hultman, 2018-2024.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_MPSCQUEUE_H
+#define UWS_MPSCQUEUE_H
+
+/* Bounded lock-free queue for handing things over to one event loop from any number of threads.
+ * Cells are sequenced as in Dmitry Vyukov's bounded MPMC queue, with the consumer side simplified to one thread.
+ * All cells are allocated up front so pushing never allocates (unless assigning T does). */
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+namespace uWS {
+
+template <typename T>
+struct BoundedMpscQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueuePosition{0};
+    alignas(64) size_t dequeuePosition = 0;
+
+public:
+    /* Capacity is rounded up to a power of two */
+    BoundedMpscQueue(size_t capacity = 1024) {
+        size_t powerOfTwo = 2;
+        while (powerOfTwo < capacity) {
+            powerOfTwo <<= 1;
+        }
+        mask = powerOfTwo - 1;
+        cells.reset(new Cell[powerOfTwo]);
+        for (size_t i = 0; i < powerOfTwo; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMpscQueue(const BoundedMpscQueue &) = delete;
+
+    /* Thread safe, returns false if full (leaving value untouched even if it was an rvalue) */
+    template <typename V>
+    bool push(V &&value) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[position & mask];
+            intptr_t diff = (intptr_t) cell->sequence.load(std::memory_order_acquire) - (intptr_t) position;
+            if (diff == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::forward<V>(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer thread only, returns false if empty (or if the next push is not yet complete) */
+    bool pop(T &value) {
+        Cell *cell = &cells[dequeuePosition & mask];
+        if (cell->sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+            return false;
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+        dequeuePosition++;
+        return true;
+    }
+};
+
+}
+
+#endif // UWS_MPSCQUEUE_H
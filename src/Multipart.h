@@ -15,19 +15,22 @@
  * limitations under the License.
  */
 
-/* Implements the multipart protocol. Builds atop parts of our common http parser (not yet refactored that way). */
+/* Implements the multipart protocol. Builds atop parts of our common http parser (not yet refactored that way).
+ * MultipartParser splits a whole body, MultipartStreamParser is fed the body as it arrives. */
 /* https://www.w3.org/Protocols/rfc1341/7_2_Multipart.html */
 
 #ifndef UWS_MULTIPART_H
 #define UWS_MULTIPART_H
 
 #include "MessageParser.h"
+#include "MoveOnlyFunction.h"
 
 #include <string_view>
 #include <optional>
 #include <cstring>
 #include <utility>
 #include <cctype>
+#include <algorithm>
 
 namespace uWS {
 
@@ -226,6 +229,257 @@ namespace uWS {
         }
     };
 
+    /* Parses multipart bodies chunk by chunk, as given to HttpResponse::onData, in constant memory. Emits the headers
+     * of every part followed by slices of its data as they arrive, the last one marked as such. Header values stay valid
+     * until the next part begins, data slices only for the call. The boundary is searched with Boyer-Moore-Horspool,
+     * the few bytes at the end of a chunk that could start a boundary are held back until the next chunk tells */
+    struct MultipartStreamParser {
+        /* Headers of one part, with room for more than we have */
+        static const unsigned int MAX_PART_HEADERS_SIZE = 4096;
+
+    private:
+        /* CRLF, 2 hyphens and 1 - 70 chars of boundary */
+        char delimiter[74];
+        unsigned int delimiterLength = 0;
+        unsigned char skip[256];
+
+        /* The end of the previous chunk, a prefix of delimiter */
+        char carry[74];
+        unsigned int carryLength = 0;
+
+        /* Headers of the current part, fenced for getHeaders */
+        char headerBuffer[MAX_PART_HEADERS_SIZE + 2];
+        unsigned int headerLength = 0;
+        std::pair<std::string_view, std::string_view> headers[MAX_HEADERS + 1];
+
+        /* What follows the boundary, either "--" or CRLF */
+        char boundaryTail[2];
+        unsigned int boundaryTailLength = 0;
+
+        enum State {
+            PREAMBLE,
+            BOUNDARY_TAIL,
+            HEADERS,
+            BODY,
+            EPILOGUE,
+            INVALID
+        } state = INVALID;
+
+        MoveOnlyFunction<void(std::pair<std::string_view, std::string_view> *)> partHandler;
+        MoveOnlyFunction<void(std::string_view, bool)> dataHandler;
+
+        /* Returns the first occurrence of delimiter in data, or npos */
+        size_t findDelimiter(const char *data, size_t length) {
+            size_t last = delimiterLength - 1;
+            for (size_t i = 0; i + delimiterLength <= length; ) {
+                unsigned char c = (unsigned char) data[i + last];
+                if (c == (unsigned char) delimiter[last] && !memcmp(data + i, delimiter, last)) {
+                    return i;
+                }
+                i += skip[c];
+            }
+            return std::string_view::npos;
+        }
+
+        /* Returns the length of the longest end of data that begins delimiter */
+        size_t partialDelimiter(const char *data, size_t length) {
+            for (size_t k = std::min<size_t>(length, delimiterLength - 1); k; k--) {
+                if (data[length - k] == '\r' && !memcmp(data + length - k, delimiter, k)) {
+                    return k;
+                }
+            }
+            return 0;
+        }
+
+        /* Body data of the current part, or preamble we ignore */
+        void emit(const char *data, size_t length, bool last) {
+            if (state == BODY && (length || last)) {
+                dataHandler({data, length}, last);
+            }
+        }
+
+        /* Ends what we were in when we found a delimiter at data + match */
+        void endAt(const char *data, size_t match) {
+            emit(data, match, true);
+            state = BOUNDARY_TAIL;
+            boundaryTailLength = 0;
+        }
+
+        /* Consumes PREAMBLE or BODY up to and including the next delimiter if any, returns how much */
+        size_t consumeBody(std::string_view chunk) {
+            if (carryLength) {
+                /* A delimiter starting in what we held back ends within the next delimiterLength - 1 bytes */
+                char window[2 * sizeof(delimiter)];
+                size_t take = std::min<size_t>(chunk.length(), delimiterLength - 1);
+                memcpy(window, carry, carryLength);
+                memcpy(window + carryLength, chunk.data(), take);
+                size_t windowLength = carryLength + take;
+
+                size_t match = findDelimiter(window, windowLength);
+                if (match < carryLength) {
+                    size_t consumed = match + delimiterLength - carryLength;
+                    carryLength = 0;
+                    endAt(window, match);
+                    return consumed;
+                }
+                if (match == std::string_view::npos && take == chunk.length()) {
+                    /* All of chunk fit, it might still end in a delimiter started before */
+                    size_t keep = partialDelimiter(window, windowLength);
+                    emit(window, windowLength - keep, false);
+                    memmove(carry, window + windowLength - keep, keep);
+                    carryLength = (unsigned int) keep;
+                    return chunk.length();
+                }
+                emit(carry, carryLength, false);
+                carryLength = 0;
+            }
+
+            size_t match = findDelimiter(chunk.data(), chunk.length());
+            if (match != std::string_view::npos) {
+                endAt(chunk.data(), match);
+                return match + delimiterLength;
+            }
+
+            size_t keep = partialDelimiter(chunk.data(), chunk.length());
+            emit(chunk.data(), chunk.length() - keep, false);
+            memcpy(carry, chunk.data() + chunk.length() - keep, keep);
+            carryLength = (unsigned int) keep;
+            return chunk.length();
+        }
+
+        /* Consumes header bytes up to and including the empty line if any, returns how much */
+        size_t consumeHeaders(std::string_view chunk) {
+            unsigned int had = headerLength;
+            size_t copy = std::min<size_t>(chunk.length(), MAX_PART_HEADERS_SIZE - headerLength);
+            memcpy(headerBuffer + headerLength, chunk.data(), copy);
+            headerLength += (unsigned int) copy;
+
+            /* No headers at all, or the end of them */
+            unsigned int end = 0;
+            if (headerLength >= 2 && headerBuffer[0] == '\r' && headerBuffer[1] == '\n') {
+                end = 2;
+            } else {
+                std::string_view buffered(headerBuffer, headerLength);
+                size_t emptyLine = buffered.find("\r\n\r\n", had < 3 ? 0 : had - 3);
+                if (emptyLine != std::string_view::npos) {
+                    end = (unsigned int) emptyLine + 4;
+                }
+            }
+
+            if (!end) {
+                if (headerLength == MAX_PART_HEADERS_SIZE) {
+                    state = INVALID;
+                }
+                return copy;
+            }
+
+            headerBuffer[end] = '\r';
+            headerBuffer[end + 1] = '\0';
+            if (getHeaders(headerBuffer, headerBuffer + end, headers) != end) {
+                state = INVALID;
+                return copy;
+            }
+
+            state = BODY;
+            partHandler(headers);
+            return end - had;
+        }
+
+    public:
+        /* Construct the parser based on contentType (reads boundary) */
+        MultipartStreamParser(std::string_view contentType, MoveOnlyFunction<void(std::pair<std::string_view, std::string_view> *)> &&partHandler,
+            MoveOnlyFunction<void(std::string_view, bool)> &&dataHandler) : partHandler(std::move(partHandler)), dataHandler(std::move(dataHandler)) {
+
+            /* We expect the form "multipart/something;somethingboundary=something" */
+            if (contentType.length() < 10 || contentType.substr(0, 10) != "multipart/") {
+                return;
+            }
+
+            auto equalToken = contentType.find('=', 10);
+            if (equalToken == std::string_view::npos) {
+                return;
+            }
+
+            /* The boundary may be quoted */
+            std::string_view boundary = contentType.substr(equalToken + 1);
+            if (boundary.length() >= 2 && boundary.front() == '"' && boundary.back() == '"') {
+                boundary = boundary.substr(1, boundary.length() - 2);
+            }
+
+            /* Boundary must be less than or equal to 70 chars yet 1 char or longer */
+            if (!boundary.length() || boundary.length() > 70) {
+                return;
+            }
+
+            memcpy(delimiter, "\r\n--", 4);
+            memcpy(delimiter + 4, boundary.data(), boundary.length());
+            delimiterLength = (unsigned int) boundary.length() + 4;
+
+            /* How far we may skip when the byte below the end of the delimiter is c */
+            memset(skip, (int) delimiterLength, sizeof(skip));
+            for (unsigned int i = 0; i < delimiterLength - 1; i++) {
+                skip[(unsigned char) delimiter[i]] = (unsigned char) (delimiterLength - 1 - i);
+            }
+
+            /* The first boundary may be the very start of the body, as if there was a CRLF before it */
+            memcpy(carry, "\r\n", 2);
+            carryLength = 2;
+            state = PREAMBLE;
+        }
+
+        /* Is this even a valid multipart request? */
+        bool isValid() {
+            return delimiterLength != 0;
+        }
+
+        /* Did we see the closing boundary? */
+        bool isDone() {
+            return state == EPILOGUE;
+        }
+
+        /* Feeds the next chunk of body, fin when it is the last one (as with onData).
+         * Returns false once the body is found invalid or ends too early */
+        bool consume(std::string_view chunk, bool fin = false) {
+            while (chunk.length() && state != INVALID && state != EPILOGUE) {
+                switch (state) {
+                case PREAMBLE:
+                case BODY:
+                    chunk.remove_prefix(consumeBody(chunk));
+                    break;
+                case BOUNDARY_TAIL:
+                    /* Transport padding before the CRLF is allowed */
+                    if (!boundaryTailLength && (chunk[0] == ' ' || chunk[0] == '\t')) {
+                        chunk.remove_prefix(1);
+                        break;
+                    }
+                    boundaryTail[boundaryTailLength++] = chunk[0];
+                    chunk.remove_prefix(1);
+                    if (boundaryTailLength == 2) {
+                        if (boundaryTail[0] == '-' && boundaryTail[1] == '-') {
+                            state = EPILOGUE;
+                        } else if (boundaryTail[0] == '\r' && boundaryTail[1] == '\n') {
+                            state = HEADERS;
+                            headerLength = 0;
+                        } else {
+                            state = INVALID;
+                        }
+                    }
+                    break;
+                case HEADERS:
+                    chunk.remove_prefix(consumeHeaders(chunk));
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (fin && state != EPILOGUE) {
+                state = INVALID;
+            }
+            return state != INVALID;
+        }
+    };
+
 }
 
 #endif
@@ -58,8 +58,17 @@ namespace uWS {
         DEDICATED_COMPRESSOR_128KB = 14 << 4 | 7,
         DEDICATED_COMPRESSOR_256KB = 15 << 4 | 8,
         /* Same as 256kb */
-        DEDICATED_COMPRESSOR = 15 << 4 | 8
+        DEDICATED_COMPRESSOR = 15 << 4 | 8,
+
+        /* Combined with a dedicated compressor size, sockets share a bounded pool of such compressors
+         * instead of owning one each (see DeflationStreamPool) */
+        POOLED_COMPRESSOR = 1 << 12
     };
+
+    /* Compression levels go from 0 (stored) over 1 (fastest) to 9 (smallest) like with zlib. Messages compressed
+     * whole by libdeflate can go up to 12, anything above 9 means 9 for zlib */
+    static const int DEFAULT_COMPRESSION_LEVEL = 6;
+    static const int MAX_COMPRESSION_LEVEL = 12;
 }
 
 #if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
@@ -68,6 +77,11 @@ namespace uWS {
 
 #include <string>
 #include <optional>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "LoopArena.h"
 
 #ifdef UWS_USE_LIBDEFLATE
 #include "libdeflate.h"
@@ -78,25 +92,58 @@ namespace uWS {
 
 /* Do not compile this module if we don't want it */
 #if defined(UWS_NO_ZLIB) || defined(UWS_MOCK_ZLIB)
-struct ZlibContext {};
+struct ZlibContext {
+    ZlibContext(LoopArena * /*arena*/ = nullptr) {
+    }
+};
 struct InflationStream {
     std::optional<std::string_view> inflate(ZlibContext * /*zlibContext*/, std::string_view compressed, size_t maxPayloadLength, bool /*reset*/) {
         return compressed.substr(0, std::min(maxPayloadLength, compressed.length()));
     }
-    InflationStream(CompressOptions /*compressOptions*/) {
+    template <typename F>
+    bool inflateChunks(ZlibContext * /*zlibContext*/, std::string_view compressed, bool /*last*/, bool /*reset*/, F &&emit) {
+        return !emit(compressed, true);
+    }
+    InflationStream(CompressOptions /*compressOptions*/, std::string_view /*dictionary*/ = {}, LoopArena * /*arena*/ = nullptr) {
     }
 };
 struct DeflationStream {
     std::string_view deflate(ZlibContext * /*zlibContext*/, std::string_view raw, bool /*reset*/) {
         return raw;
     }
-    DeflationStream(CompressOptions /*compressOptions*/) {
+    DeflationStream(CompressOptions /*compressOptions*/, std::string_view /*dictionary*/ = {}, int /*level*/ = DEFAULT_COMPRESSION_LEVEL, LoopArena * /*arena*/ = nullptr) {
+    }
+    void setLevel(int /*level*/) {
+    }
+    void reset() {
+    }
+};
+struct DeflationStreamPool {
+    struct Entry {};
+    DeflationStream stream;
+    DeflationStreamPool(CompressOptions compressOptions, size_t /*maxStreams*/, int level = DEFAULT_COMPRESSION_LEVEL, LoopArena * /*arena*/ = nullptr) : stream(compressOptions, {}, level) {
+    }
+    DeflationStream *acquire(void * /*owner*/, Entry *& /*lease*/) {
+        return &stream;
+    }
+    void release(void * /*owner*/, Entry *& /*lease*/) {
     }
 };
 #else
 
 #define LARGE_BUFFER_SIZE 1024 * 16 // todo: fix this
 
+/* Streams living as long as their loop keep their zlib state in its arena, which only ever frees all at once */
+inline void useArena(z_stream *stream, LoopArena *arena) {
+    if (arena) {
+        stream->zalloc = [](voidpf opaque, uInt items, uInt size) -> voidpf {
+            return ((LoopArena *) opaque)->allocate((size_t) items * size);
+        };
+        stream->zfree = [](voidpf, voidpf) {};
+        stream->opaque = arena;
+    }
+}
+
 struct ZlibContext {
     /* Any returned data is valid until next same-class call.
      * We need to have two classes to allow inflation followed
@@ -108,26 +155,47 @@ struct ZlibContext {
 
 #ifdef UWS_USE_LIBDEFLATE
     libdeflate_decompressor *decompressor;
-    libdeflate_compressor *compressor;
+    /* One compressor per level, made on first use */
+    libdeflate_compressor *compressors[MAX_COMPRESSION_LEVEL + 1] = {};
+
+    libdeflate_compressor *getCompressor(int level) {
+        if (!compressors[level]) {
+            compressors[level] = libdeflate_alloc_compressor(level);
+        }
+        return compressors[level];
+    }
 #endif
 
-    ZlibContext() {
-        deflationBuffer = (char *) malloc(LARGE_BUFFER_SIZE);
-        inflationBuffer = (char *) malloc(LARGE_BUFFER_SIZE);
+    /* Buffers from the arena of the loop, if any */
+    LoopArena *arena;
+
+    ZlibContext(LoopArena *arena = nullptr) : arena(arena) {
+        if (arena) {
+            deflationBuffer = (char *) arena->allocate(LARGE_BUFFER_SIZE);
+            inflationBuffer = (char *) arena->allocate(LARGE_BUFFER_SIZE);
+        } else {
+            deflationBuffer = (char *) malloc(LARGE_BUFFER_SIZE);
+            inflationBuffer = (char *) malloc(LARGE_BUFFER_SIZE);
+        }
 
 #ifdef UWS_USE_LIBDEFLATE
         decompressor = libdeflate_alloc_decompressor();
-        compressor = libdeflate_alloc_compressor(6);
 #endif
     }
 
     ~ZlibContext() {
-        free(deflationBuffer);
-        free(inflationBuffer);
+        if (!arena) {
+            free(deflationBuffer);
+            free(inflationBuffer);
+        }
 
 #ifdef UWS_USE_LIBDEFLATE
         libdeflate_free_decompressor(decompressor);
-        libdeflate_free_compressor(compressor);
+        for (libdeflate_compressor *compressor : compressors) {
+            if (compressor) {
+                libdeflate_free_compressor(compressor);
+            }
+        }
 #endif
     }
 };
@@ -135,7 +203,20 @@ struct ZlibContext {
 struct DeflationStream {
     z_stream deflationStream = {};
 
-    DeflationStream(CompressOptions compressOptions) {
+    /* Preset dictionary, owned by whoever made us, primed again on every reset */
+    std::string_view dictionary;
+
+    void primeDictionary() {
+        if (dictionary.length()) {
+            deflateSetDictionary(&deflationStream, (const Bytef *) dictionary.data(), (unsigned int) dictionary.length());
+        }
+    }
+
+    /* Level as given to us, zlib itself tops out at 9 */
+    int level;
+
+    DeflationStream(CompressOptions compressOptions, std::string_view dictionary = {}, int level = DEFAULT_COMPRESSION_LEVEL, LoopArena *arena = nullptr) : dictionary(dictionary), level(level) {
+        useArena(&deflationStream, arena);
 
         /* Sliding inflator should be about 44kb by default, less than compressor */
 
@@ -144,23 +225,38 @@ struct DeflationStream {
 
         //printf("windowBits: %d, memLevel: %d\n", windowBits, memLevel);
 
-        deflateInit2(&deflationStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, memLevel, Z_DEFAULT_STRATEGY);
+        deflateInit2(&deflationStream, std::min(level, 9), Z_DEFLATED, windowBits, memLevel, Z_DEFAULT_STRATEGY);
+        primeDictionary();
+    }
+
+    /* Only for streams reset after every message (shared ones), as nothing is pending then */
+    void setLevel(int level) {
+        if (this->level != level) {
+            this->level = level;
+            deflateParams(&deflationStream, std::min(level, 9), Z_DEFAULT_STRATEGY);
+        }
     }
 
     /* Deflate and optionally reset. You must not deflate an empty string. */
     std::string_view deflate(ZlibContext *zlibContext, std::string_view raw, bool reset) {
 
 #ifdef UWS_USE_LIBDEFLATE
-        /* Run a fast path in case of shared_compressor */
-        if (reset) {
-            size_t written = 0;
-            static unsigned char buf[1024 + 1];
-
-            written = libdeflate_deflate_compress(zlibContext->compressor, raw.data(), raw.length(), buf, 1024);
+        /* Whole messages go to libdeflate, which only lacks dictionaries. The final block it ends with
+         * is fine since the peer throws its window away after every message of ours either way */
+        if (reset && !dictionary.length()) {
+            libdeflate_compressor *compressor = zlibContext->getCompressor(level);
+            size_t bound = libdeflate_deflate_compress_bound(compressor, raw.length()) + 1;
+
+            char *buf = zlibContext->deflationBuffer;
+            if (bound > LARGE_BUFFER_SIZE) {
+                zlibContext->dynamicDeflationBuffer.resize(bound);
+                buf = zlibContext->dynamicDeflationBuffer.data();
+            }
 
+            size_t written = libdeflate_deflate_compress(compressor, raw.data(), raw.length(), buf, bound - 1);
             if (written) {
-                memcpy(&buf[written], "\x00", 1);
-                return std::string_view((char *) buf, written + 1);
+                buf[written] = 0;
+                return std::string_view(buf, written + 1);
             }
         }
 #endif
@@ -191,6 +287,7 @@ struct DeflationStream {
         /* This must not change avail_out */
         if (reset) {
             deflateReset(&deflationStream);
+            primeDictionary();
         }
 
         if (zlibContext->dynamicDeflationBuffer.length()) {
@@ -207,41 +304,189 @@ struct DeflationStream {
         };
     }
 
+    /* Forgets the sliding window */
+    void reset() {
+        deflateReset(&deflationStream);
+        primeDictionary();
+    }
+
     ~DeflationStream() {
         deflateEnd(&deflationStream);
     }
 };
 
+/* Up to maxStreams sliding window compressors, leased to sockets most recently used first.
+ * A socket keeps its window for as long as it holds its lease; when all streams are taken the least
+ * recently used one is reset and handed over. Resetting is always fine with context takeover since
+ * the peer never sees references to anything it did not get from us, windows are just never shared. */
+struct DeflationStreamPool {
+    struct Entry {
+        DeflationStream stream;
+        void *owner = nullptr;
+        Entry *prev = nullptr, *next = nullptr;
+
+        Entry(CompressOptions compressOptions, int level, LoopArena *arena) : stream(compressOptions, {}, level, arena) {}
+    };
+
+private:
+    CompressOptions compressOptions;
+    size_t maxStreams;
+    int level;
+    /* The streams are used by one loop for as long as it runs, their state is in its arena */
+    LoopArena *arena;
+    /* Streams are made on demand */
+    std::vector<std::unique_ptr<Entry>> entries;
+    /* Most recently used first */
+    Entry *head = nullptr, *tail = nullptr;
+
+    void unlink(Entry *entry) {
+        (entry->prev ? entry->prev->next : head) = entry->next;
+        (entry->next ? entry->next->prev : tail) = entry->prev;
+        entry->prev = entry->next = nullptr;
+    }
+
+    void pushFront(Entry *entry) {
+        entry->next = head;
+        (head ? head->prev : tail) = entry;
+        head = entry;
+    }
+
+    void pushBack(Entry *entry) {
+        entry->prev = tail;
+        (tail ? tail->next : head) = entry;
+        tail = entry;
+    }
+
+public:
+    DeflationStreamPool(CompressOptions compressOptions, size_t maxStreams, int level = DEFAULT_COMPRESSION_LEVEL, LoopArena *arena = nullptr) : compressOptions(compressOptions), maxStreams(maxStreams ? maxStreams : 1), level(level), arena(arena) {
+
+    }
+
+    /* Returns the stream owner compresses with (without reset), lease being where the owner keeps track of it */
+    DeflationStream *acquire(void *owner, Entry *&lease) {
+        if (lease && lease->owner == owner) {
+            if (lease != head) {
+                unlink(lease);
+                pushFront(lease);
+            }
+            return &lease->stream;
+        }
+
+        if (entries.size() < maxStreams) {
+            entries.emplace_back(new Entry(compressOptions, level, arena));
+            lease = entries.back().get();
+        } else {
+            lease = tail;
+            unlink(lease);
+            /* Whatever the previous owner left behind has to go */
+            lease->stream.reset();
+        }
+        lease->owner = owner;
+        pushFront(lease);
+        return &lease->stream;
+    }
+
+    /* Gives back the lease, making its stream the first to be taken over */
+    void release(void *owner, Entry *&lease) {
+        if (lease && lease->owner == owner) {
+            lease->owner = nullptr;
+            unlink(lease);
+            pushBack(lease);
+        }
+        lease = nullptr;
+    }
+};
+
 struct InflationStream {
     z_stream inflationStream = {};
 
-    InflationStream(CompressOptions compressOptions) {
-        /* Inflation windowBits are the top 8 bits of the 16 bit compressOptions */
-        inflateInit2(&inflationStream, -(compressOptions >> 8));
+    /* Preset dictionary, owned by whoever made us, primed again on every reset */
+    std::string_view dictionary;
+
+    void primeDictionary() {
+        /* Raw inflate takes its dictionary up front */
+        if (dictionary.length()) {
+            inflateSetDictionary(&inflationStream, (const Bytef *) dictionary.data(), (unsigned int) dictionary.length());
+        }
+    }
+
+    InflationStream(CompressOptions compressOptions, std::string_view dictionary = {}, LoopArena *arena = nullptr) : dictionary(dictionary) {
+        useArena(&inflationStream, arena);
+        /* Inflation windowBits are the top 8 bits of the 16 bit compressOptions (without our own flags) */
+        inflateInit2(&inflationStream, -((compressOptions & _DECOMPRESSOR_MASK) >> 8));
+        primeDictionary();
     }
 
     ~InflationStream() {
         inflateEnd(&inflationStream);
     }
 
+    /* Inflates a message part by part, handing every buffer full to emit(inflated, final) where final marks the last
+     * of this part. The last part gets the tail of the message appended (in its post padding) and, with reset, resets
+     * us when done. Returns false on inflation errors or if emit returned true for breaking */
+    template <typename F>
+    bool inflateChunks(ZlibContext *zlibContext, std::string_view compressed, bool last, bool reset, F &&emit) {
+        char *tailLocation = (char *) compressed.data() + compressed.length();
+        char preTailBytes[4];
+        if (last) {
+            memcpy(preTailBytes, tailLocation, 4);
+            memcpy(tailLocation, "\x00\x00\xff\xff", 4);
+            compressed = {compressed.data(), compressed.length() + 4};
+        }
+
+        inflationStream.next_in = (Bytef *) compressed.data();
+        inflationStream.avail_in = (unsigned int) compressed.length();
+
+        bool ok = true;
+        do {
+            inflationStream.next_out = (Bytef *) zlibContext->inflationBuffer;
+            inflationStream.avail_out = LARGE_BUFFER_SIZE;
+
+            int err = ::inflate(&inflationStream, Z_SYNC_FLUSH);
+            if (err != Z_OK && err != Z_BUF_ERROR) {
+                ok = false;
+                break;
+            }
+
+            /* Whatever did not fill the buffer was all there was */
+            bool final = inflationStream.avail_out != 0;
+            if (emit(std::string_view(zlibContext->inflationBuffer, LARGE_BUFFER_SIZE - inflationStream.avail_out), final)) {
+                ok = false;
+                break;
+            }
+        } while (inflationStream.avail_out == 0);
+
+        if (last) {
+            if (reset) {
+                inflateReset(&inflationStream);
+                primeDictionary();
+            }
+            memcpy(tailLocation, preTailBytes, 4);
+        }
+        return ok;
+    }
+
     /* Zero length inflates are possible and valid */
     std::optional<std::string_view> inflate(ZlibContext *zlibContext, std::string_view compressed, size_t maxPayloadLength, bool reset) {
 
 #ifdef UWS_USE_LIBDEFLATE
-        /* Try fast path first */
-        size_t written = 0;
-        static char buf[1024];
-
-        /* We have to pad 9 bytes and restore those bytes when done since 9 is more than 6 of next WebSocket message */
-        char tmp[9];
-        memcpy(tmp, (char *) compressed.data() + compressed.length(), 9);
-        memcpy((char *) compressed.data() + compressed.length(), "\x00\x00\xff\xff\x01\x00\x00\xff\xff", 9);
-        libdeflate_result res = libdeflate_deflate_decompress(zlibContext->decompressor, compressed.data(), compressed.length() + 9, buf, 1024, &written);
-        memcpy((char *) compressed.data() + compressed.length(), tmp, 9);
-
-        if (res == 0) {
-            /* Fast path wins */
-            return std::string_view(buf, written);
+        /* Whole messages nothing later refers back to can go to libdeflate first, unless we need the dictionary.
+         * A message inflated by it never enters the window of our zlib stream, which is why this needs reset */
+        if (reset && !dictionary.length()) {
+            size_t written = 0;
+
+            /* We have to pad 9 bytes and restore those bytes when done since 9 is more than 6 of next WebSocket message */
+            char tmp[9];
+            memcpy(tmp, (char *) compressed.data() + compressed.length(), 9);
+            memcpy((char *) compressed.data() + compressed.length(), "\x00\x00\xff\xff\x01\x00\x00\xff\xff", 9);
+            libdeflate_result res = libdeflate_deflate_decompress(zlibContext->decompressor, compressed.data(), compressed.length() + 9,
+                zlibContext->inflationBuffer, std::min<size_t>(LARGE_BUFFER_SIZE, maxPayloadLength), &written);
+            memcpy((char *) compressed.data() + compressed.length(), tmp, 9);
+
+            if (res == LIBDEFLATE_SUCCESS) {
+                /* Fast path wins */
+                return std::string_view(zlibContext->inflationBuffer, written);
+            }
         }
 #endif
 
@@ -278,6 +523,7 @@ struct InflationStream {
 
         if (reset) {
             inflateReset(&inflationStream);
+            primeDictionary();
         }
 
         /* Restore the bytes we used for the tail */
@@ -0,0 +1,52 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_PROBES_H
+#define UWS_PROBES_H
+
+/* USDT probes of provider uws, compiled in wherever <sys/sdt.h> is found (systemtap-sdt-dev) unless UWS_NO_PROBES.
+ * A probe nobody is attached to is a single NOP, so we only ever pass what is already at hand. The probes are:
+ *
+ * request__parsed(void *response, const char *url, size_t urlLength)    before the request is routed
+ * response__ended(void *response)                                        response is the same pointer as above
+ * ws__message(void *ws, size_t length, int opCode)                       before the message handler
+ * ws__publish(const char *topic, size_t topicLength)                     App or WebSocket publish
+ * backpressure__limit(void *ws, unsigned int bufferedAmount)             a message is dropped over maxBackpressure
+ * socket__close(void *socket, int code)                                  HTTP and WebSocket sockets
+ *
+ * For instance, a histogram of request latency with bpftrace:
+ * usdt:./app:uws:request__parsed { @s[arg0] = nsecs; }
+ * usdt:./app:uws:response__ended /@s[arg0]/ { @ns = hist(nsecs - @s[arg0]); delete(@s[arg0]); } */
+
+#if !defined(UWS_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define UWS_WITH_PROBES
+#endif
+#endif
+
+#ifdef UWS_WITH_PROBES
+#include <sys/sdt.h>
+#define UWS_PROBE1(name, a) DTRACE_PROBE1(uws, name, a)
+#define UWS_PROBE2(name, a, b) DTRACE_PROBE2(uws, name, a, b)
+#define UWS_PROBE3(name, a, b, c) DTRACE_PROBE3(uws, name, a, b, c)
+#else
+#define UWS_PROBE1(name, a) ((void) (a))
+#define UWS_PROBE2(name, a, b) ((void) (a), (void) (b))
+#define UWS_PROBE3(name, a, b, c) ((void) (a), (void) (b), (void) (c))
+#endif
+
+#endif // UWS_PROBES_H
@@ -15,13 +15,21 @@
  * limitations under the License.
  */
 
-/* This module implements The PROXY Protocol v2 */
+/* This module implements The PROXY Protocol v1 (text) and v2 (binary) */
 
 #ifndef UWS_PROXY_PARSER_H
 #define UWS_PROXY_PARSER_H
 
 #ifdef UWS_WITH_PROXY
 
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <algorithm>
+
+#include "Utilities.h"
+
 namespace uWS {
 
 struct proxy_hdr_v2 {
@@ -46,67 +54,168 @@ union proxy_addr {
     } ipv6_addr;
 };
 
-/* Byte swap for little-endian systems */
-/* Todo: This functions should be shared with the one in WebSocketProtocol.h! */
-template <typename T>
-T _cond_byte_swap(T value) {
-    uint32_t endian_test = 1;
-    if (*((char *)&endian_test)) {
-        union {
-            T i;
-            uint8_t b[sizeof(T)];
-        } src = { value }, dst;
-
-        for (unsigned int i = 0; i < sizeof(value); i++) {
-            dst.b[i] = src.b[sizeof(value) - 1 - i];
-        }
+struct ProxyParser {
+    /* Type-length-values of v2 past this many bytes are dropped, whole. Enough for the usual ones of load balancers
+     * such as the AWS VPC endpoint id (type 0xEA) */
+    static const unsigned int MAX_TLV_LENGTH = 128;
 
-        return dst.i;
-    }
-    return value;
-}
+    /* The longest v1 header, CRLF included */
+    static const unsigned int MAX_V1_LENGTH = 107;
 
-struct ProxyParser {
 private:
     union proxy_addr addr;
 
     /* Default family of 0 signals no proxy address */
     uint8_t family = 0;
 
-public:
-    /* Returns 4 or 16 bytes source address */
-    std::string_view getSourceAddress() {
+    /* Set after the first request, any PROXY header after it would come from the client itself */
+    bool sealed = false;
 
-        // UNSPEC family and protocol
-        if (family == 0) {
-            return {};
+    uint8_t tlvs[MAX_TLV_LENGTH];
+    uint16_t tlvLength = 0;
+
+    /* getSourceAddressAsText, formatted on first use */
+    char sourceText[40];
+    uint8_t sourceTextLength = 0;
+
+    static bool parseDecimal(std::string_view text, unsigned int max, unsigned int &value) {
+        if (text.empty() || text.length() > 5) {
+            return false;
+        }
+        value = 0;
+        for (char c : text) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            value = value * 10 + (unsigned int) (c - '0');
         }
+        return value <= max;
+    }
 
-        if ((family & 0xf0) >> 4 == 1) {
-            /* Family 1 is INET4 */
-            return {(char *) &addr.ipv4_addr.src_addr, 4};
-        } else {
-            /* Family 2 is INET6 */
-            return {(char *) &addr.ipv6_addr.src_addr, 16};
+    static bool parseIPv4(std::string_view text, uint8_t *out) {
+        for (int i = 0; i < 4; i++) {
+            size_t dot = i < 3 ? text.find('.') : text.length();
+            unsigned int octet;
+            if (dot == std::string_view::npos || dot > 3 || !parseDecimal(text.substr(0, dot), 255, octet)) {
+                return false;
+            }
+            out[i] = (uint8_t) octet;
+            text.remove_prefix(i < 3 ? dot + 1 : dot);
         }
+        return true;
     }
 
-    /* Returns [done, consumed] where done = false on failure */
-    std::pair<bool, unsigned int> parse(std::string_view data) {
+    static bool parseIPv6(std::string_view text, uint8_t *out) {
+        uint16_t groups[8];
+        int numGroups = 0, gap = -1;
 
-        /* We require at least four bytes to determine protocol */
-        if (data.length() < 4) {
+        if (text.substr(0, 2) == "::") {
+            gap = 0;
+            text.remove_prefix(2);
+        }
+        while (text.length()) {
+            size_t colon = text.find(':');
+            std::string_view group = text.substr(0, colon);
+
+            /* An IPv4 address can only end it */
+            if (colon == std::string_view::npos && group.find('.') != std::string_view::npos) {
+                uint8_t ipv4[4];
+                if (numGroups > 6 || !parseIPv4(group, ipv4)) {
+                    return false;
+                }
+                groups[numGroups++] = (uint16_t) (ipv4[0] << 8 | ipv4[1]);
+                groups[numGroups++] = (uint16_t) (ipv4[2] << 8 | ipv4[3]);
+                break;
+            }
+
+            if (group.empty() || group.length() > 4 || numGroups == 8) {
+                return false;
+            }
+            unsigned int value = 0;
+            for (char c : group) {
+                unsigned int digit = (c >= '0' && c <= '9') ? (unsigned int) (c - '0') : ((unsigned int) (c | 0x20) - 'a' + 10);
+                if (digit > 15) {
+                    return false;
+                }
+                value = value * 16 + digit;
+            }
+            groups[numGroups++] = (uint16_t) value;
+
+            if (colon == std::string_view::npos) {
+                break;
+            }
+            text.remove_prefix(colon + 1);
+            if (text.substr(0, 1) == ":") {
+                if (gap != -1) {
+                    return false;
+                }
+                gap = numGroups;
+                text.remove_prefix(1);
+            } else if (text.empty()) {
+                return false;
+            }
+        }
+
+        if (gap == -1 ? numGroups != 8 : numGroups > 7) {
+            return false;
+        }
+        memset(out, 0, 16);
+        int tail = gap == -1 ? 0 : numGroups - gap;
+        for (int i = 0; i < numGroups; i++) {
+            int position = i < numGroups - tail ? i : 8 - numGroups + i;
+            out[position * 2] = (uint8_t) (groups[i] >> 8);
+            out[position * 2 + 1] = (uint8_t) groups[i];
+        }
+        return true;
+    }
+
+    /* "PROXY TCP4 192.168.0.1 192.168.0.11 56324 443\r\n", or "PROXY UNKNOWN" and anything up to "\r\n" */
+    std::pair<bool, unsigned int> parseV1(std::string_view data) {
+        size_t lineLength = data.substr(0, MAX_V1_LENGTH).find("\r\n");
+        if (lineLength == std::string_view::npos) {
             return {false, 0};
         }
+        std::string_view line = data.substr(6, lineLength - 6);
+
+        /* UNKNOWN may leave out the rest, it carries no address we can use anyways */
+        if (line.substr(0, 7) == "UNKNOWN" && (line.length() == 7 || line[7] == ' ')) {
+            family = 0;
+            tlvLength = 0;
+            sourceTextLength = 0;
+            return {true, (unsigned int) lineLength + 2};
+        }
 
-        /* HTTP can never start with "\r\n\r\n", but PROXY always does */
-        if (memcmp(data.data(), "\r\n\r\n", 4)) {
-            /* This is HTTP, so be done */
-            return {true, 0};
+        std::string_view fields[5];
+        for (int i = 0; i < 5; i++) {
+            size_t space = i < 4 ? line.find(' ') : line.length();
+            if (space == std::string_view::npos) {
+                return {false, 0};
+            }
+            fields[i] = line.substr(0, space);
+            line.remove_prefix(i < 4 ? space + 1 : space);
         }
 
-        /* We assume we are parsing PROXY V2 here */
+        unsigned int sourcePort, destinationPort;
+        if (fields[0] == "TCP4" && parseIPv4(fields[1], (uint8_t *) &addr.ipv4_addr.src_addr) && parseIPv4(fields[2], (uint8_t *) &addr.ipv4_addr.dst_addr)
+            && parseDecimal(fields[3], 65535, sourcePort) && parseDecimal(fields[4], 65535, destinationPort)) {
+            family = 0x11;
+            addr.ipv4_addr.src_port = utils::cond_byte_swap<uint16_t>((uint16_t) sourcePort);
+            addr.ipv4_addr.dst_port = utils::cond_byte_swap<uint16_t>((uint16_t) destinationPort);
+        } else if (fields[0] == "TCP6" && parseIPv6(fields[1], addr.ipv6_addr.src_addr) && parseIPv6(fields[2], addr.ipv6_addr.dst_addr)
+            && parseDecimal(fields[3], 65535, sourcePort) && parseDecimal(fields[4], 65535, destinationPort)) {
+            family = 0x21;
+            addr.ipv6_addr.src_port = utils::cond_byte_swap<uint16_t>((uint16_t) sourcePort);
+            addr.ipv6_addr.dst_port = utils::cond_byte_swap<uint16_t>((uint16_t) destinationPort);
+        } else {
+            return {false, 0};
+        }
 
+        tlvLength = 0;
+        sourceTextLength = 0;
+        return {true, (unsigned int) lineLength + 2};
+    }
+
+    std::pair<bool, unsigned int> parseV2(std::string_view data) {
         /* We require 16 bytes here */
         if (data.length() < 16) {
             return {false, 0};
@@ -126,33 +235,128 @@ public:
             return {false, 0};
         }
 
-        //printf("Version: %d\n", (header.ver_cmd & 0xf0) >> 4);
-        //printf("Command: %d\n", (header.ver_cmd & 0x0f));
-
-        /* We get length in network byte order (todo: share this function with the rest) */
-        uint16_t hostLength = _cond_byte_swap<uint16_t>(header.len);
+        /* We get length in network byte order */
+        uint16_t hostLength = utils::cond_byte_swap<uint16_t>(header.len);
 
         /* We must have all the data available */
         if (data.length() < 16u + hostLength) {
             return {false, 0};
         }
 
-        /* Payload cannot be more than sizeof proxy_addr */
-        if (sizeof(proxy_addr) < hostLength) {
+        /* Addresses of INET (12 bytes) and INET6 (36 bytes) come first, then type-length-values. The LOCAL command
+         * (health checks of the proxy itself) and other families carry no address of a client */
+        unsigned int addressLength = 0;
+        family = 0;
+        if ((header.ver_cmd & 0x0f) == 1) {
+            if ((header.fam & 0xf0) >> 4 == 1) {
+                addressLength = 12;
+            } else if ((header.fam & 0xf0) >> 4 == 2) {
+                addressLength = 36;
+            }
+        }
+        if (hostLength < addressLength) {
             return {false, 0};
         }
+        if (addressLength) {
+            family = header.fam;
+            memcpy(&addr, data.data() + 16, addressLength);
+        }
 
-        //printf("Family: %d\n", (header.fam & 0xf0) >> 4);
-        //printf("Transport: %d\n", (header.fam & 0x0f));
+        /* Keep the whole type-length-values that fit */
+        tlvLength = 0;
+        sourceTextLength = 0;
+        if ((header.ver_cmd & 0x0f) == 1 && (header.fam & 0xf0) >> 4 < 3) {
+            std::string_view tlv = data.substr(16 + addressLength, hostLength - addressLength);
+            while (tlv.length() >= 3) {
+                unsigned int length = 3u + (unsigned int) ((uint8_t) tlv[1] << 8 | (uint8_t) tlv[2]);
+                if (length > tlv.length() || tlvLength + length > MAX_TLV_LENGTH) {
+                    break;
+                }
+                memcpy(tlvs + tlvLength, tlv.data(), length);
+                tlvLength = (uint16_t) (tlvLength + length);
+                tlv.remove_prefix(length);
+            }
+        }
+
+        /* We consumed everything */
+        return {true, 16u + hostLength};
+    }
 
-        /* We have 0 family by default, and UNSPEC is 0 as well */
-        family = header.fam;
+public:
+    /* Returns 4 or 16 bytes source address */
+    std::string_view getSourceAddress() {
 
-        /* Copy payload */
-        memcpy(&addr, data.data() + 16, hostLength);
+        // UNSPEC family and protocol
+        if (family == 0) {
+            return {};
+        }
 
-        /* We consumed everything */
-        return {true, 16 + hostLength};
+        if ((family & 0xf0) >> 4 == 1) {
+            /* Family 1 is INET4 */
+            return {(char *) &addr.ipv4_addr.src_addr, 4};
+        } else {
+            /* Family 2 is INET6 */
+            return {(char *) &addr.ipv6_addr.src_addr, 16};
+        }
+    }
+
+    /* The source address as text once set, so that it is formatted only once per PROXY header */
+    std::string_view getSourceAddressAsText() {
+        return {sourceText, sourceTextLength};
+    }
+
+    void setSourceAddressAsText(std::string_view text) {
+        sourceTextLength = (uint8_t) std::min<size_t>(text.length(), sizeof(sourceText));
+        memcpy(sourceText, text.data(), sourceTextLength);
+    }
+
+    /* Returns the value of the first type-length-value of this type (v2 only), or empty if none. Values are raw,
+     * the AWS VPC endpoint id (0xEA) for one starts with its subtype byte 0x01 */
+    std::string_view getTlv(uint8_t type) {
+        for (unsigned int offset = 0; offset + 3 <= tlvLength; ) {
+            unsigned int length = (unsigned int) (tlvs[offset + 1] << 8 | tlvs[offset + 2]);
+            if (tlvs[offset] == type) {
+                return {(char *) tlvs + offset + 3, length};
+            }
+            offset += 3 + length;
+        }
+        return {};
+    }
+
+    /* Called after the first request, from then on nothing more is parsed as PROXY */
+    void seal() {
+        sealed = true;
+    }
+
+    /* Returns [done, consumed] where done = false on failure */
+    std::pair<bool, unsigned int> parse(std::string_view data) {
+
+        /* Only the proxy in front of us can send this, and it does so before anything else */
+        if (sealed) {
+            return {true, 0};
+        }
+
+        /* We require at least four bytes to determine protocol */
+        if (data.length() < 4) {
+            return {false, 0};
+        }
+
+        /* HTTP can never start with "\r\n\r\n", but PROXY v2 always does */
+        if (!memcmp(data.data(), "\r\n\r\n", 4)) {
+            return parseV2(data);
+        }
+
+        /* Nor with "PROXY ", like v1 does (we wait for 6 bytes only for what could still become it) */
+        std::string_view v1 = "PROXY ";
+        if (data.substr(0, v1.length()) == v1.substr(0, std::min(data.length(), v1.length()))) {
+            if (data.length() < v1.length()) {
+                return {false, 0};
+            }
+            return parseV1(data);
+        }
+
+        /* This is HTTP, so be done */
+        return {true, 0};
     }
 };
 
@@ -160,4 +364,4 @@ public:
 
 #endif
 
-#endif // UWS_PROXY_PARSER_H
\ No newline at end of file
+#endif // UWS_PROXY_PARSER_H
@@ -0,0 +1,226 @@
+/*
+ * Authored by Alex Hultman, 2018-2024.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_PUBSUBFABRIC_H
+#define UWS_PUBSUBFABRIC_H
+
+/* A PubSubFabric connects the TopicTrees of Apps running on different threads (Loops) so that
+ * one publish reaches all of them. The message is copied once into a reference counted buffer
+ * which is passed to every joined loop through its own lock-free queue, and published into that
+ * loop's TopicTree right after its next iteration (becoming part of its next drain).
+ *
+ * Join every App (from its own thread) before it runs, leave it (from its own thread) before it
+ * is deleted. Publishing is allowed from any thread, including threads not running any Loop, as
+ * long as it stops before the threads of joined apps exit. */
+
+#include "App.h"
+#include "MpscQueue.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace uWS {
+
+template <typename APP>
+struct PubSubFabric {
+private:
+    /* One allocation holding topic and message, shared by all loops */
+    struct Message {
+        std::atomic<unsigned int> references;
+        std::string topicAndMessage;
+        size_t topicLength;
+        OpCode opCode;
+        bool compress;
+
+        std::string_view topic() {
+            return {topicAndMessage.data(), topicLength};
+        }
+
+        std::string_view message() {
+            return {topicAndMessage.data() + topicLength, topicAndMessage.length() - topicLength};
+        }
+
+        void release() {
+            if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+    };
+
+    struct Member {
+        /* Only read by publishers while active */
+        std::atomic<bool> active{false};
+        APP *app = nullptr;
+        /* Loops are freed at thread exit, so they outlive the app they belong to */
+        Loop *loop = nullptr;
+        BoundedMpscQueue<Message *> queue;
+        /* Only the publisher flipping this from false wakes the loop up */
+        std::atomic<bool> wakeupPending{false};
+        /* Bumped by every join, so that what was deferred for whoever held this slot before is only released */
+        std::atomic<unsigned int> generation{0};
+
+        Member(size_t queueCapacity) : queue(queueCapacity) {}
+    };
+
+    /* Members are never freed (or moved) until the fabric is, so publishers can always reach them */
+    unsigned int maxMembers;
+    size_t queueCapacity;
+    std::unique_ptr<std::unique_ptr<Member>[]> members;
+    std::atomic<unsigned int> numMembers{0};
+    std::mutex joinMutex;
+
+    /* Publishes everything queued for this member into its own TopicTree */
+    static void drainQueue(Member *member) {
+        Message *message;
+        while (member->queue.pop(message)) {
+            /* Apps without any WebSocket route have no TopicTree */
+            if (member->active.load(std::memory_order_relaxed) && member->app->topicTree) {
+                member->app->publish(message->topic(), message->message(), message->opCode, message->compress);
+            }
+            message->release();
+        }
+    }
+
+public:
+    /* Every member can have queueCapacity messages in flight before publishers fall back to Loop::defer */
+    PubSubFabric(unsigned int maxMembers = 256, size_t queueCapacity = 4096) : maxMembers(maxMembers), queueCapacity(queueCapacity),
+        members(new std::unique_ptr<Member>[maxMembers]) {
+
+    }
+
+    PubSubFabric(const PubSubFabric &) = delete;
+
+    ~PubSubFabric() {
+        /* Release whatever was published to members that left (or never ran) */
+        for (unsigned int i = 0; i < numMembers.load(std::memory_order_acquire); i++) {
+            drainQueue(members[i].get());
+        }
+    }
+
+    /* Must be called from the thread running this app's Loop, returns false if full */
+    bool join(APP &app) {
+        std::lock_guard<std::mutex> lock(joinMutex);
+
+        /* Reuse the slot of a member that left */
+        Member *member = nullptr;
+        unsigned int count = numMembers.load(std::memory_order_relaxed);
+        for (unsigned int i = 0; i < count; i++) {
+            if (!members[i]->active.load(std::memory_order_relaxed) && !members[i]->app) {
+                member = members[i].get();
+                break;
+            }
+        }
+
+        if (member) {
+            /* Nothing of the member that left carries over: messages that raced its leave are released undelivered,
+             * and a wakeup still pending from them would keep publishers from ever waking our loop */
+            drainQueue(member);
+            member->wakeupPending.store(false, std::memory_order_relaxed);
+            member->generation.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            if (count == maxMembers) {
+                return false;
+            }
+            members[count].reset(new Member(queueCapacity));
+            member = members[count].get();
+            numMembers.store(count + 1, std::memory_order_release);
+        }
+
+        member->app = &app;
+        member->loop = app.getLoop();
+        member->loop->addPostHandler(member, [member](Loop */*loop*/) {
+            /* Clear before draining so that anything published after this wakes us up again */
+            if (member->wakeupPending.load(std::memory_order_relaxed) && member->wakeupPending.exchange(false, std::memory_order_acq_rel)) {
+                drainQueue(member);
+            }
+        });
+        member->active.store(true, std::memory_order_release);
+
+        return true;
+    }
+
+    /* Must be called from the thread running this app's Loop, before the app is deleted */
+    void leave(APP &app) {
+        std::lock_guard<std::mutex> lock(joinMutex);
+
+        for (unsigned int i = 0; i < numMembers.load(std::memory_order_relaxed); i++) {
+            Member *member = members[i].get();
+            if (member->app == &app) {
+                member->active.store(false, std::memory_order_release);
+                app.getLoop()->removePostHandler(member);
+                /* Late messages are released by the next drain of whoever joins this slot, or by our destructor */
+                drainQueue(member);
+                member->app = nullptr;
+                return;
+            }
+        }
+    }
+
+    /* Publishes to the TopicTrees of all joined apps, from any thread. Conceptually like calling
+     * publish on every app, but with one copy of the message. Returns false if nobody is joined. */
+    bool publish(std::string_view topic, std::string_view message, OpCode opCode = OpCode::TEXT, bool compress = false) {
+        unsigned int count = numMembers.load(std::memory_order_acquire);
+
+        Message *sharedMessage = new Message;
+        sharedMessage->topicAndMessage.reserve(topic.length() + message.length());
+        sharedMessage->topicAndMessage.append(topic).append(message);
+        sharedMessage->topicLength = topic.length();
+        sharedMessage->opCode = opCode;
+        sharedMessage->compress = compress;
+
+        /* Hold one reference ourselves while handing it out */
+        sharedMessage->references.store(count + 1, std::memory_order_relaxed);
+
+        bool published = false;
+        for (unsigned int i = 0; i < count; i++) {
+            Member *member = members[i].get();
+
+            if (!member->active.load(std::memory_order_acquire)) {
+                sharedMessage->release();
+                continue;
+            }
+
+            published = true;
+            if (!member->queue.push(sharedMessage)) {
+                /* A full queue means this loop is far behind anyways, so take the slow path */
+                unsigned int generation = member->generation.load(std::memory_order_relaxed);
+                member->loop->defer([member, sharedMessage, generation]() {
+                    if (member->active.load(std::memory_order_acquire) && member->generation.load(std::memory_order_relaxed) == generation
+                        && member->app->topicTree) {
+                        member->app->publish(sharedMessage->topic(), sharedMessage->message(), sharedMessage->opCode, sharedMessage->compress);
+                    }
+                    sharedMessage->release();
+                });
+                continue;
+            }
+
+            if (!member->wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+                us_wakeup_loop((us_loop_t *) member->loop);
+            }
+        }
+
+        sharedMessage->release();
+        return published;
+    }
+};
+
+}
+
+#endif // UWS_PUBSUBFABRIC_H
@@ -15,12 +15,29 @@
  * limitations under the License.
  */
 
-/* This module implements URI query parsing and retrieval of value given key */
+/* This module implements URI query parsing and retrieval of value given key,
+ * either by scanning the raw query per key or through a QueryIndex made in one pass */
 
 #ifndef UWS_QUERYPARSER_H
 #define UWS_QUERYPARSER_H
 
 #include <string_view>
+#include <cstring>
+#include <cstdint>
+
+#if !defined(UWS_NO_SIMD) && defined(__GNUC__)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define UWS_QUERYPARSER_SIMD_WIDTH 16
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UWS_QUERYPARSER_SIMD_WIDTH 16
+#endif
+#endif
+
+#ifndef UWS_QUERY_MAX_PAIRS
+#define UWS_QUERY_MAX_PAIRS 32
+#endif
 
 namespace uWS {
 
@@ -115,6 +132,149 @@ namespace uWS {
         return {nullptr, 0};
     }
 
+    /* All key, value pairs of a query decoded in one pass, in place. Pairs without '=', or with invalid percent-encoding,
+     * are left out (get finds neither), keys are decoded as well as values. Pairs past UWS_QUERY_MAX_PAIRS are not indexed but still found by get */
+    struct QueryIndex {
+        struct Pair {
+            std::string_view key, value;
+        };
+
+    private:
+        Pair pairs[UWS_QUERY_MAX_PAIRS];
+        unsigned int numPairs = 0;
+        /* What did not fit, with the '&' before it */
+        std::string_view rest;
+
+        static inline bool isSpecial(char c) {
+            return (c == '&') | (c == '=') | (c == '%') | (c == '+');
+        }
+
+        /* Returns the first of "&=%+" in [p, end), or end */
+        static inline char *findSpecial(char *p, char *end) {
+#ifdef UWS_QUERYPARSER_SIMD_WIDTH
+            for (; end - p >= UWS_QUERYPARSER_SIMD_WIDTH; p += UWS_QUERYPARSER_SIMD_WIDTH) {
+#if defined(__SSE2__)
+                __m128i v = _mm_loadu_si128((__m128i *) p);
+                __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('&')), _mm_cmpeq_epi8(v, _mm_set1_epi8('='))),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')), _mm_cmpeq_epi8(v, _mm_set1_epi8('+'))));
+                unsigned int mask = (unsigned int) _mm_movemask_epi8(found);
+                if (mask) {
+                    return p + __builtin_ctz(mask);
+                }
+#else
+                uint8x16_t v = vld1q_u8((uint8_t *) p);
+                uint8x16_t found = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('&')), vceqq_u8(v, vdupq_n_u8('='))),
+                    vorrq_u8(vceqq_u8(v, vdupq_n_u8('%')), vceqq_u8(v, vdupq_n_u8('+'))));
+                /* Narrow to 4 bits per byte since NEON has no movemask */
+                uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(found), 4)), 0);
+                if (mask) {
+                    return p + (__builtin_ctzll(mask) >> 2);
+                }
+#endif
+            }
+#endif
+            while (p != end && !isSpecial(*p)) {
+                p++;
+            }
+            return p;
+        }
+
+        static inline int hexValue(char c) {
+            if (c >= '0' && c <= '9') {
+                return c - '0';
+            }
+            c |= 32;
+            if (c >= 'a' && c <= 'f') {
+                return c - 'a' + 10;
+            }
+            return -1;
+        }
+
+    public:
+        /* Takes raw query without initial '?' sign. Will inplace decode, so input will mutate */
+        void build(std::string_view rawQuery) {
+            numPairs = 0;
+            rest = {};
+
+            char *p = (char *) rawQuery.data(), *end = p + rawQuery.length();
+            while (p < end) {
+                if (numPairs == UWS_QUERY_MAX_PAIRS) {
+                    rest = std::string_view(p - 1, (size_t) (end - p + 1));
+                    return;
+                }
+
+                /* Decoding only ever shrinks, so we write behind where we read */
+                char *key = p, *value = nullptr, *out = p;
+                bool valid = true;
+                while (true) {
+                    char *special = findSpecial(p, end);
+                    if (out != p) {
+                        memmove(out, p, (size_t) (special - p));
+                    }
+                    out += special - p;
+                    p = special;
+
+                    if (p == end || *p == '&') {
+                        break;
+                    } else if (*p == '=' && !value) {
+                        /* Key ends here */
+                        *out = '=';
+                        value = ++out;
+                        p++;
+                    } else if (*p == '%') {
+                        int hex1 = end - p > 2 ? hexValue(p[1]) : -1;
+                        int hex2 = end - p > 2 ? hexValue(p[2]) : -1;
+                        if (hex1 < 0 || hex2 < 0) {
+                            valid = false;
+                            p = findSpecial(p + 1, end);
+                            continue;
+                        }
+                        *((unsigned char *) out++) = (unsigned char) (hex1 * 16 + hex2);
+                        p += 3;
+                    } else {
+                        /* Space as '+', or '=' within the value */
+                        *out++ = *p == '+' ? ' ' : '=';
+                        p++;
+                    }
+                }
+
+                if (value && valid) {
+                    pairs[numPairs++] = {std::string_view(key, (size_t) (value - 1 - key)), std::string_view(value, (size_t) (out - value))};
+                }
+
+                /* Skip the '&' */
+                p++;
+            }
+        }
+
+        /* Nothing found is given as nullptr, while empty string is given as some pointer to the given buffer */
+        std::string_view get(std::string_view key) {
+            if (!key.length()) {
+                return {};
+            }
+
+            for (unsigned int i = 0; i < numPairs; i++) {
+                if (pairs[i].key.length() == key.length() && pairs[i].key[0] == key[0] && pairs[i].key == key) {
+                    return pairs[i].value;
+                }
+            }
+
+            if (rest.length()) {
+                return getDecodedQueryValue(key, rest);
+            }
+            return {nullptr, 0};
+        }
+
+        /* Iteration over indexed (key, value) pairs in order */
+        const Pair *begin() const {
+            return pairs;
+        }
+
+        const Pair *end() const {
+            return pairs + numPairs;
+        }
+    };
+
 }
 
 #endif
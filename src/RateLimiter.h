@@ -0,0 +1,176 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_RATELIMITER_H
+#define UWS_RATELIMITER_H
+
+/* Per address token buckets in fixed memory, no matter how many addresses there are. Every address maps to one
+ * bucket in each of a few rows (a count-min sketch): its level is the lowest of them, and taking a token raises
+ * only those below the new level. Addresses sharing buckets can be limited early but never late */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string_view>
+
+namespace uWS {
+
+struct RateLimitOptions {
+    /* New connections per address and second, and how many above that a burst may make. 0 for no limit */
+    unsigned int connectionsPerSecond = 0;
+    unsigned int connectionBurst = 0;
+    /* The same for requests, WebSocket upgrades included */
+    unsigned int requestsPerSecond = 0;
+    unsigned int requestBurst = 0;
+    /* IPv6 addresses are limited by prefix, as anyone with one address usually has a /64 of them */
+    unsigned int ipv6PrefixLength = 64;
+    /* Buckets per row, rounded up to a power of two. Every limit takes 4 rows of 8 bytes per bucket */
+    unsigned int buckets = 16384;
+};
+
+struct RateLimiter {
+    static constexpr unsigned int ROWS = 4;
+    /* Levels are kept in 1024ths of a token */
+    static constexpr uint64_t ONE = 1024;
+
+private:
+    struct Bucket {
+        uint32_t level;
+        /* Milliseconds, wrapping, when level was last drained */
+        uint32_t time;
+    };
+
+    struct Limit {
+        std::unique_ptr<Bucket[]> buckets;
+        uint64_t perSecond = 0, capacity = 0;
+        /* Milliseconds to drain a full bucket, longer idle times count as this */
+        uint64_t drainTime = 0;
+
+        /* Drains, and if a token fits, raises the buckets of key */
+        bool take(uint64_t key, unsigned int mask, uint32_t now) {
+            if (!perSecond || !key) {
+                return true;
+            }
+
+            Bucket *row[ROWS];
+            uint64_t level = UINT64_MAX;
+            uint32_t h = (uint32_t) key, step = (uint32_t) (key >> 32) | 1;
+            for (unsigned int i = 0; i < ROWS; i++, h += step) {
+                Bucket *b = row[i] = &buckets[i * (mask + 1) + (h & mask)];
+                uint64_t drained = std::min<uint64_t>((uint32_t) (now - b->time), drainTime) * perSecond * ONE / 1000;
+                b->level = drained < b->level ? b->level - (uint32_t) drained : 0;
+                b->time = now;
+                level = std::min<uint64_t>(level, b->level);
+            }
+
+            if (level + ONE > capacity) {
+                return false;
+            }
+            for (Bucket *b : row) {
+                b->level = (uint32_t) std::max<uint64_t>(b->level, level + ONE);
+            }
+            return true;
+        }
+
+        void init(unsigned int perSecond, unsigned int burst, unsigned int width) {
+            if (perSecond) {
+                this->perSecond = perSecond;
+                capacity = std::min<uint64_t>(((uint64_t) perSecond + burst) * ONE, UINT32_MAX);
+                drainTime = capacity * 1000 / (this->perSecond * ONE) + 1;
+                buckets.reset(new Bucket[ROWS * width]());
+            }
+        }
+    };
+
+    Limit connections, requests;
+    unsigned int mask = 0;
+    unsigned int ipv6PrefixLength;
+    uint64_t seed;
+
+public:
+    RateLimiter(RateLimitOptions options) : ipv6PrefixLength(std::min(options.ipv6PrefixLength, 128u)) {
+        unsigned int width = 1;
+        while (width < options.buckets && width < (1u << 24)) {
+            width <<= 1;
+        }
+        mask = width - 1;
+        connections.init(options.connectionsPerSecond, options.connectionBurst, width);
+        requests.init(options.requestsPerSecond, options.requestBurst, width);
+
+        /* Nobody outside should know which addresses share buckets */
+        std::random_device random;
+        seed = (uint64_t) random() << 32 | random();
+    }
+
+    /* Hashes a 4 or 16 byte address, as sockets and PROXY headers give it, once per connection. IPv4 mapped into
+     * IPv6 counts as IPv4, IPv6 is cut to its prefix. Anything else, such as a Unix socket, is 0 and never limited */
+    uint64_t key(std::string_view address) {
+        unsigned char bytes[16] = {};
+        static constexpr unsigned char mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+        if (address.length() == 16 && !memcmp(address.data(), mapped, 12)) {
+            address.remove_prefix(12);
+        }
+        if (address.length() == 4) {
+            memcpy(bytes, address.data(), 4);
+        } else if (address.length() == 16) {
+            memcpy(bytes, address.data(), ipv6PrefixLength / 8);
+            if (ipv6PrefixLength % 8) {
+                bytes[ipv6PrefixLength / 8] = (unsigned char) (address[ipv6PrefixLength / 8] & (0xff00 >> (ipv6PrefixLength % 8)));
+            }
+        } else {
+            return 0;
+        }
+
+        uint64_t words[2];
+        memcpy(words, bytes, 16);
+        return mix(mix(words[0] ^ seed) ^ words[1] ^ address.length()) | 1;
+    }
+
+    bool takeConnection(uint64_t key, uint32_t now) {
+        return connections.take(key, mask, now);
+    }
+
+    bool takeRequest(uint64_t key, uint32_t now) {
+        return requests.take(key, mask, now);
+    }
+
+    bool limitsConnections() {
+        return connections.perSecond != 0;
+    }
+
+    /* Milliseconds, to be compared wrapping */
+    static uint32_t now() {
+        return (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    /* The finalizer of MurmurHash3 */
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+};
+
+}
+
+#endif // UWS_RATELIMITER_H
@@ -0,0 +1,123 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_REQUESTARENA_H
+#define UWS_REQUESTARENA_H
+
+/* Bump allocated memory for the temporaries of one request (or WebSocket message), all given back at once when
+ * it is over. Blocks come from the BlockPool of the loop and go back to it, so a busy loop recycles the same few
+ * blocks from request to request without ever calling malloc. Deallocation does nothing, like with
+ * std::pmr::monotonic_buffer_resource, which makes this a drop-in resource for std::pmr containers. */
+
+#include "BlockPool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <memory_resource>
+
+namespace uWS {
+
+struct RequestArena : std::pmr::memory_resource {
+    static constexpr size_t BLOCK_SIZE = BlockPool::MAX_BLOCK_SIZE;
+
+private:
+    struct Block {
+        Block *next;
+        size_t size;
+    };
+
+    Block *blocks = nullptr;
+    char *cursor = nullptr, *end = nullptr;
+
+    void *do_allocate(size_t size, size_t alignment) override {
+        char *p = (char *) (((uintptr_t) cursor + alignment - 1) & ~(uintptr_t) (alignment - 1));
+        if (cursor && p + size <= end) {
+            cursor = p + size;
+            return p;
+        }
+
+        /* Anything bigger than a quarter block gets its own, so that we never waste much of one */
+        size_t blockSize = BLOCK_SIZE;
+        size_t needed = sizeof(Block) + alignment + size;
+        if (needed > BLOCK_SIZE / 4) {
+            blockSize = needed;
+        }
+
+        Block *block = (Block *) BlockPool::get().allocate(blockSize);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        block->size = blockSize;
+
+        char *begin = (char *) (block + 1);
+        p = (char *) (((uintptr_t) begin + alignment - 1) & ~(uintptr_t) (alignment - 1));
+
+        if (blockSize != BLOCK_SIZE && cursor) {
+            /* Keep bumping the current block (the first one), the big one is full already */
+            block->next = blocks->next;
+            blocks->next = block;
+            return p;
+        }
+
+        block->next = blocks;
+        blocks = block;
+        end = (char *) block + blockSize;
+        cursor = p + size;
+        return p;
+    }
+
+    void do_deallocate(void * /*p*/, size_t /*size*/, size_t /*alignment*/) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    RequestArena() = default;
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    ~RequestArena() {
+        reset();
+    }
+
+    /* Gives every block back to the pool. What was made in the arena must be destroyed before, or never */
+    void reset() {
+        while (Block *block = blocks) {
+            blocks = block->next;
+            BlockPool::get().deallocate(block, block->size);
+        }
+        cursor = end = nullptr;
+    }
+
+    /* Objects made in the arena are never destroyed by it, make trivially destructible ones or destroy them yourself */
+    template <typename T, typename... Args>
+    T *make(Args &&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /* Whether nothing was allocated since the last reset */
+    bool empty() {
+        return !blocks;
+    }
+};
+
+}
+
+#endif // UWS_REQUESTARENA_H
@@ -0,0 +1,53 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_RESPONSETEMPLATE_H
+#define UWS_RESPONSETEMPLATE_H
+
+/* A ResponseTemplate is the status line and static headers of a response, serialized once and sent
+ * with HttpResponse::end(responseTemplate, data). Date, the mark and Content-Length are filled in per response.
+ * Templates are immutable once built, so one template can be shared by all threads */
+
+#include <string>
+#include <string_view>
+
+namespace uWS {
+
+struct ResponseTemplate {
+private:
+    std::string head;
+
+public:
+    ResponseTemplate(std::string_view status = "200 OK") {
+        head.append("HTTP/1.1 ").append(status).append("\r\n");
+    }
+
+    /* Adds a static header. Date, Content-Length and Connection are written by the response itself */
+    ResponseTemplate &writeHeader(std::string_view key, std::string_view value) {
+        head.append(key).append(": ").append(value).append("\r\n");
+        return *this;
+    }
+
+    /* The serialized status line and headers */
+    std::string_view getHead() const {
+        return head;
+    }
+};
+
+}
+
+#endif // UWS_RESPONSETEMPLATE_H
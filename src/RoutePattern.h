@@ -0,0 +1,130 @@
+/*
+ * Authored by Alex Hultman, 2018-2024.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_ROUTEPATTERN_H
+#define UWS_ROUTEPATTERN_H
+
+/* Route patterns known at compile time have their parameter names resolved to indices at compile time,
+ * so that handlers read parameters by index instead of looking them up by name on every request:
+ *
+ * using UserPost = uWS::Route<"/users/:id/posts/:post">;
+ * app.get(UserPost::pattern, [](auto *res, auto *req) {
+ *     auto params = UserPost::parameters(req);
+ *     res->end(params.get<"post">());
+ * });
+ *
+ * Misspelled parameter names do not compile. Dynamic patterns keep using HttpRequest::getParameter(name). */
+
+#if __cplusplus >= 202002L
+
+#include <cstddef>
+#include <string_view>
+
+#include "HttpParser.h"
+
+namespace uWS {
+
+/* A string literal usable as template argument */
+template <size_t N>
+struct RouteString {
+    char value[N] = {};
+
+    constexpr RouteString(const char (&string)[N]) {
+        for (size_t i = 0; i < N; i++) {
+            value[i] = string[i];
+        }
+    }
+
+    constexpr std::string_view view() const {
+        return {value, N - 1};
+    }
+};
+
+template <RouteString PATTERN>
+struct Route {
+private:
+    /* Calls cb(name, index) for every parameter, parsed the same way HttpContext::onHttp does it */
+    template <typename F>
+    static constexpr void forEachParameter(F cb) {
+        constexpr std::string_view string = PATTERN.view();
+        unsigned short index = 0;
+        for (size_t i = 0; i < string.length(); i++) {
+            if (string[i] == ':') {
+                i++;
+                size_t start = i;
+                while (i < string.length() && string[i] != '/') {
+                    i++;
+                }
+                cb(string.substr(start, i - start), index++);
+            }
+        }
+    }
+
+    static constexpr unsigned short countParameters() {
+        unsigned short count = 0;
+        forEachParameter([&count](std::string_view, unsigned short) {
+            count++;
+        });
+        return count;
+    }
+
+    static constexpr int findParameter(std::string_view name) {
+        int found = -1;
+        forEachParameter([&found, name](std::string_view parameter, unsigned short index) {
+            if (found == -1 && parameter == name) {
+                found = index;
+            }
+        });
+        return found;
+    }
+
+public:
+    static constexpr const char *pattern = PATTERN.value;
+    static constexpr unsigned short numParameters = countParameters();
+
+    /* Index for HttpRequest::getParameter(unsigned short), resolved at compile time */
+    template <RouteString NAME>
+    static consteval unsigned short index() {
+        static_assert(findParameter(NAME.view()) != -1, "No such parameter in this route pattern");
+        return (unsigned short) findParameter(NAME.view());
+    }
+
+    /* The parameters of one request to this route, valid as long as the request is */
+    struct Parameters {
+        std::string_view values[numParameters ? numParameters : 1];
+
+        template <RouteString NAME>
+        std::string_view get() const {
+            return values[index<NAME>()];
+        }
+    };
+
+    /* Only meaningful from within a handler registered with this pattern */
+    static Parameters parameters(HttpRequest *req) {
+        Parameters params;
+        for (unsigned short i = 0; i < numParameters; i++) {
+            params.values[i] = req->getParameter(i);
+        }
+        return params;
+    }
+};
+
+}
+
+#endif
+
+#endif // UWS_ROUTEPATTERN_H
@@ -0,0 +1,532 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_STATICASSETS_H
+#define UWS_STATICASSETS_H
+
+/* A directory of files indexed up front for TemplatedApp::serveStatic. Every file is hashed for its strong ETag as it
+ * is loaded and its responses are put together then, so that requests for it, conditional and ranged ones too, are
+ * answered without touching the disk or running a handler. On Linux, inotify keeps the index current file by file */
+
+#ifndef _WIN32
+
+#include "FileCache.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace uWS {
+
+struct StaticAssetsOptions {
+    /* What a url ending in / is answered with */
+    std::string indexFile = "index.html";
+    /* Sent along with every file unless empty, such as "no-cache" to have browsers revalidate every time */
+    std::string cacheControl;
+    /* Files up to this size are kept in memory, larger ones are sent from disk with sendfile */
+    size_t maxMemoryFileSize = 64 * 1024;
+    /* How often, in milliseconds, changes seen by inotify are picked up. 0 never reloads */
+    int reloadInterval = 250;
+};
+
+struct StaticAssets {
+    struct Asset {
+        uintmax_t size;
+        time_t lastModified;
+        /* Quoted, as sent */
+        std::string etag;
+        std::string lastModifiedDate;
+        /* Header lines of 200 and 206 responses, after the status line */
+        std::string headers;
+        /* Whole responses with room for Date at their offsets. ok only for files kept in memory */
+        std::string ok, head, notModified;
+        size_t okDate = 0, headDate = 0, notModifiedDate = 0;
+        /* The body within ok, or else the file held open for sendfile */
+        std::string_view body;
+        FileCache::File *file = nullptr;
+
+        ~Asset() {
+            if (file) {
+                file->release();
+            }
+        }
+    };
+
+    enum Answer {
+        FULL,
+        PARTIAL,
+        NOT_MODIFIED,
+        UNSATISFIABLE
+    };
+
+private:
+    struct Hash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view s) const {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
+    /* Without any trailing slash */
+    std::string urlPrefix, root;
+    StaticAssetsOptions options;
+    /* Whether responses carry the uWebSockets header */
+    bool mark;
+    /* Large files are shared with responses still sending them; after a reload the old one goes with the last */
+    FileCache files{0, 0};
+    /* By path relative to root */
+    std::unordered_map<std::string, std::unique_ptr<Asset>, Hash, std::equal_to<>> assets;
+    /* Reused for urls ending in / */
+    std::string indexPath;
+#ifdef __linux__
+    int inotifyFd = -1;
+    /* Watched directories relative to root, "" being root */
+    std::unordered_map<int, std::string> directories;
+#endif
+
+    static std::string join(std::string_view directory, std::string_view name) {
+        return directory.empty() ? std::string(name) : std::string(directory).append("/").append(name);
+    }
+
+    static std::string_view contentType(std::string_view path) {
+        static constexpr std::pair<std::string_view, std::string_view> types[] = {
+            {".html", "text/html; charset=utf-8"},
+            {".htm", "text/html; charset=utf-8"},
+            {".css", "text/css; charset=utf-8"},
+            {".js", "text/javascript; charset=utf-8"},
+            {".mjs", "text/javascript; charset=utf-8"},
+            {".json", "application/json"},
+            {".map", "application/json"},
+            {".txt", "text/plain; charset=utf-8"},
+            {".xml", "application/xml"},
+            {".svg", "image/svg+xml"},
+            {".png", "image/png"},
+            {".jpg", "image/jpeg"},
+            {".jpeg", "image/jpeg"},
+            {".gif", "image/gif"},
+            {".webp", "image/webp"},
+            {".avif", "image/avif"},
+            {".ico", "image/x-icon"},
+            {".wasm", "application/wasm"},
+            {".woff", "font/woff"},
+            {".woff2", "font/woff2"},
+            {".pdf", "application/pdf"},
+            {".mp4", "video/mp4"},
+            {".webm", "video/webm"},
+            {".mp3", "audio/mpeg"}
+        };
+        size_t dot = path.rfind('.');
+        if (dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos) {
+            std::string_view extension = path.substr(dot);
+            for (auto &[suffix, type] : types) {
+                if (extension.length() == suffix.length() && std::equal(suffix.begin(), suffix.end(), extension.begin(), [](char a, char b) {
+                    return a == (b | 0x20);
+                })) {
+                    return type;
+                }
+            }
+        }
+        return "application/octet-stream";
+    }
+
+    /* Word at a time, only as strong as an ETag needs to be */
+    static uint64_t hash(const char *data, size_t length) {
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ length;
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        for (; i < length; i++) {
+            h = (h ^ (unsigned char) data[i]) * 0x100000001b3ull;
+        }
+        return h ^ (h >> 32);
+    }
+
+    static std::string httpDate(time_t time) {
+        struct tm tm;
+        gmtime_r(&time, &tm);
+        /* Not strftime, which follows the locale */
+        static const char weekdays[] = "SunMonTueWedThuFriSat", months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        /* Room for any int, as far as the compiler knows */
+        char date[80];
+        snprintf(date, sizeof(date), "%.3s, %.2d %.3s %.4d %.2d:%.2d:%.2d GMT", weekdays + tm.tm_wday * 3, tm.tm_mday,
+            months + tm.tm_mon * 3, tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        return date;
+    }
+
+    /* IMF-fixdate only, which is all that browsers send back. -1 for anything else */
+    static time_t parseHttpDate(std::string_view date) {
+        static constexpr std::string_view months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        if (date.length() != 29 || date.substr(25) != " GMT") {
+            return -1;
+        }
+        auto number = [date](size_t offset, size_t length) {
+            int value = -1;
+            std::from_chars(date.data() + offset, date.data() + offset + length, value);
+            return value;
+        };
+        size_t month = months.find(date.substr(8, 3));
+        struct tm tm = {};
+        tm.tm_mday = number(5, 2);
+        tm.tm_mon = (int) (month / 3);
+        tm.tm_year = number(12, 4) - 1900;
+        tm.tm_hour = number(17, 2);
+        tm.tm_min = number(20, 2);
+        tm.tm_sec = number(23, 2);
+        if (month == std::string_view::npos || month % 3 || tm.tm_mday < 1 || tm.tm_year < 0 || tm.tm_hour < 0 || tm.tm_min < 0 || tm.tm_sec < 0) {
+            return -1;
+        }
+        return timegm(&tm);
+    }
+
+    /* Weak comparison against a list of entity tags, or * */
+    static bool matchesAny(std::string_view list, std::string_view etag) {
+        while (list.length()) {
+            size_t comma = list.find(',');
+            std::string_view tag = list.substr(0, comma);
+            list.remove_prefix(comma == std::string_view::npos ? list.length() : comma + 1);
+            while (tag.length() && tag.front() == ' ') {
+                tag.remove_prefix(1);
+            }
+            while (tag.length() && tag.back() == ' ') {
+                tag.remove_suffix(1);
+            }
+            if (tag.substr(0, 2) == "W/") {
+                tag.remove_prefix(2);
+            }
+            if (tag == "*" || tag == etag) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Status line, headers, Date, the mark and what comes after */
+    std::string frame(std::string_view status, std::string_view headers, size_t &dateOffset, std::string_view rest) {
+        std::string framed = std::string("HTTP/1.1 ").append(status).append("\r\n").append(headers).append("Date: ");
+        dateOffset = framed.length();
+        framed.append(29, ' ').append("\r\n");
+        if (mark) {
+            framed.append("uWebSockets: 20\r\n");
+        }
+        return framed.append(rest);
+    }
+
+    /* Everything under directory, which is relative to root */
+    void scan(const std::string &directory) {
+#ifdef __linux__
+        watch(directory);
+#endif
+        std::error_code ec;
+        std::filesystem::path base = directory.empty() ? std::filesystem::path(root) : std::filesystem::path(root) / directory;
+        for (std::filesystem::recursive_directory_iterator it(base, ec), end; !ec && it != end; it.increment(ec)) {
+            std::string relative = it->path().lexically_relative(root).generic_string();
+            if (it->is_directory(ec)) {
+#ifdef __linux__
+                watch(relative);
+#endif
+            } else {
+                load(relative);
+            }
+        }
+    }
+
+    /* Drops everything under directory */
+    void forget(const std::string &directory) {
+        std::string prefix = directory + "/";
+        for (auto it = assets.begin(); it != assets.end(); ) {
+            it = it->first.compare(0, prefix.length(), prefix) ? std::next(it) : assets.erase(it);
+        }
+#ifdef __linux__
+        /* A directory moved out keeps its watches, which would otherwise go on reporting from wherever it went */
+        for (auto it = directories.begin(); it != directories.end(); ) {
+            if (it->second == directory || !it->second.compare(0, prefix.length(), prefix)) {
+                inotify_rm_watch(inotifyFd, it->first);
+                it = directories.erase(it);
+            } else {
+                it++;
+            }
+        }
+#endif
+    }
+
+#ifdef __linux__
+    void watch(const std::string &directory) {
+        if (inotifyFd != -1) {
+            std::string path = directory.empty() ? root : root + "/" + directory;
+            int wd = inotify_add_watch(inotifyFd, path.c_str(), IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+            if (wd != -1) {
+                directories[wd] = directory;
+            }
+        }
+    }
+#endif
+
+public:
+    /* Indexes all of root now. Urls are urlPrefix followed by the path under root */
+    StaticAssets(std::string_view urlPrefix, std::string_view root, StaticAssetsOptions options = {}, bool mark = true)
+        : urlPrefix(urlPrefix), root(root), options(std::move(options)), mark(mark) {
+        while (this->urlPrefix.length() && this->urlPrefix.back() == '/') {
+            this->urlPrefix.pop_back();
+        }
+        while (this->root.length() > 1 && this->root.back() == '/') {
+            this->root.pop_back();
+        }
+#ifdef __linux__
+        if (this->options.reloadInterval) {
+            inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        }
+#endif
+        scan("");
+    }
+
+    StaticAssets(const StaticAssets &) = delete;
+
+    ~StaticAssets() {
+        /* Before files goes */
+        assets.clear();
+#ifdef __linux__
+        if (inotifyFd != -1) {
+            close(inotifyFd);
+        }
+#endif
+    }
+
+    /* Whether root is a directory we could read */
+    bool isOpen() {
+        std::error_code ec;
+        return std::filesystem::is_directory(root, ec);
+    }
+
+    size_t size() {
+        return assets.size();
+    }
+
+    int getReloadInterval() {
+        return options.reloadInterval;
+    }
+
+    /* (Re)loads the file at path relative to root, or forgets it when it is gone or not a regular file */
+    void load(const std::string &path) {
+        FileCache::File *file = files.acquire(root + "/" + path);
+        if (!file) {
+            assets.erase(path);
+            return;
+        }
+
+        size_t size = (size_t) file->size;
+        std::unique_ptr<Asset> asset = std::make_unique<Asset>();
+        asset->size = file->size;
+        asset->lastModified = file->lastModified;
+        asset->file = file;
+
+        /* Mapped only for as long as we hash and copy, a file truncated under a mapping we serve from would take us
+         * down with SIGBUS */
+        const char *data = "";
+        if (size) {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+            if (mapped == MAP_FAILED) {
+                assets.erase(path);
+                return;
+            }
+            data = (const char *) mapped;
+        }
+
+        char etag[20];
+        snprintf(etag, sizeof(etag), "\"%016llx\"", (unsigned long long) hash(data, size));
+        asset->etag = etag;
+        asset->lastModifiedDate = httpDate(file->lastModified);
+
+        std::string validators = "ETag: " + asset->etag + "\r\nLast-Modified: " + asset->lastModifiedDate + "\r\n";
+        if (options.cacheControl.length()) {
+            validators.append("Cache-Control: ").append(options.cacheControl).append("\r\n");
+        }
+        asset->headers = std::string("Content-Type: ").append(contentType(path)).append("\r\n").append(validators).append("Accept-Ranges: bytes\r\n");
+
+        std::string contentLength = "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+        asset->head = frame("200 OK", asset->headers, asset->headDate, contentLength);
+        asset->notModified = frame("304 Not Modified", validators, asset->notModifiedDate, "\r\n");
+        if (size <= options.maxMemoryFileSize) {
+            asset->ok = frame("200 OK", asset->headers, asset->okDate, contentLength);
+            asset->ok.append(data, size);
+            asset->body = std::string_view(asset->ok).substr(asset->ok.length() - size);
+            asset->file = nullptr;
+            file->release();
+        }
+
+        if (size) {
+            munmap((void *) data, size);
+        }
+        assets[path] = std::move(asset);
+    }
+
+    /* Takes in what inotify saw since last time, reloading what changed. Returns whether anything did */
+    bool update() {
+        bool changed = false;
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        for (ssize_t length; inotifyFd != -1 && (length = read(inotifyFd, buffer, sizeof(buffer))) > 0; ) {
+            for (char *p = buffer; p < buffer + length; ) {
+                inotify_event *event = (inotify_event *) p;
+                p += sizeof(inotify_event) + event->len;
+
+                /* Events were lost, so we start over */
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (auto &[wd, directory] : directories) {
+                        inotify_rm_watch(inotifyFd, wd);
+                    }
+                    directories.clear();
+                    assets.clear();
+                    scan("");
+                    changed = true;
+                    continue;
+                }
+
+                auto it = directories.find(event->wd);
+                if (it == directories.end()) {
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    directories.erase(it);
+                    continue;
+                }
+                if (!event->len) {
+                    continue;
+                }
+
+                std::string path = join(it->second, std::string_view(event->name));
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                        forget(path);
+                    } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                        scan(path);
+                    }
+                } else if (!(event->mask & IN_CREATE)) {
+                    /* A created file is loaded once written and closed */
+                    load(path);
+                }
+                changed = true;
+            }
+        }
+#endif
+        return changed;
+    }
+
+    /* The asset at url, which is urlPrefix and the path. A url ending in / means its index file */
+    Asset *find(std::string_view url) {
+        if (url.length() <= urlPrefix.length() || url.compare(0, urlPrefix.length(), urlPrefix) || url[urlPrefix.length()] != '/') {
+            return nullptr;
+        }
+        std::string_view path = url.substr(urlPrefix.length() + 1);
+
+        if (path.empty() || path.back() == '/') {
+            indexPath.assign(path).append(options.indexFile);
+            path = indexPath;
+        }
+        auto it = assets.find(path);
+        return it == assets.end() ? nullptr : it->second.get();
+    }
+
+    /* What to answer a GET of asset with, following RFC 9110: If-None-Match over If-Modified-Since, and a single range
+     * only while If-Range holds. Multiple or malformed ranges get the whole file. Sets the range of PARTIAL */
+    static Answer answer(Asset *asset, std::string_view ifNoneMatch, std::string_view ifModifiedSince, std::string_view range,
+        std::string_view ifRange, uintmax_t &offset, uintmax_t &length) {
+        offset = 0;
+        length = asset->size;
+
+        if (ifNoneMatch.length()) {
+            if (matchesAny(ifNoneMatch, asset->etag)) {
+                return NOT_MODIFIED;
+            }
+        } else if (ifModifiedSince.length()) {
+            time_t since = parseHttpDate(ifModifiedSince);
+            if (since != -1 && asset->lastModified <= since) {
+                return NOT_MODIFIED;
+            }
+        }
+
+        if (range.substr(0, 6) != "bytes=" || range.find(',') != std::string_view::npos) {
+            return FULL;
+        }
+        /* Strong comparison, dates exactly */
+        if (ifRange.length() && ifRange != asset->etag && ifRange != asset->lastModifiedDate) {
+            return FULL;
+        }
+
+        range.remove_prefix(6);
+        size_t dash = range.find('-');
+        if (dash == std::string_view::npos) {
+            return FULL;
+        }
+        uintmax_t first = 0, last = 0;
+        const char *end = range.data() + range.length();
+        if (dash == 0) {
+            /* The last so many bytes */
+            if (std::from_chars(range.data() + 1, end, last).ptr != end || range.length() == 1) {
+                return FULL;
+            }
+            if (!last || !asset->size) {
+                return UNSATISFIABLE;
+            }
+            offset = asset->size - std::min<uintmax_t>(last, asset->size);
+            length = asset->size - offset;
+            return PARTIAL;
+        }
+
+        if (std::from_chars(range.data(), range.data() + dash, first).ptr != range.data() + dash) {
+            return FULL;
+        }
+        last = asset->size ? asset->size - 1 : 0;
+        if (dash + 1 < range.length()) {
+            uintmax_t given;
+            if (std::from_chars(range.data() + dash + 1, end, given).ptr != end || given < first) {
+                return FULL;
+            }
+            last = std::min(last, given);
+        }
+        if (first >= asset->size) {
+            return UNSATISFIABLE;
+        }
+        offset = first;
+        length = last - first + 1;
+        return PARTIAL;
+    }
+};
+
+}
+
+#endif
+
+#endif // UWS_STATICASSETS_H
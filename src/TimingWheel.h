@@ -0,0 +1,227 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_TIMINGWHEEL_H
+#define UWS_TIMINGWHEEL_H
+
+/* A hierarchical timing wheel of millisecond ticks, 4 levels of 64 slots covering 2^24 ms (4.6 hours),
+ * anything later waits in an overflow list. Arming and cancelling are O(1), timers are intrusive and never allocate.
+ * Every loop has one driven by a single us_timer set to the next tick anything happens at, see Loop::armTimer.
+ *
+ * Socket idle timeouts, automatic pings and maxLifetime are not on this wheel. They still expire through
+ * us_socket_timeout and us_socket_long_timeout, with their granularity of seconds (minutes for the long one) and
+ * their limits of 960 seconds and 240 minutes: a Timer is 40 bytes, which WebSocketData has no room for. What lives
+ * here is HttpResponse::setTimeout, reconnects of ClientApp, batched publishes, and the per context timers pacing
+ * automatic pings and closing idle compressors */
+
+#include <cstdint>
+
+namespace uWS {
+
+struct TimingWheel {
+    static constexpr unsigned int SLOT_BITS = 6;
+    static constexpr unsigned int NUM_SLOTS = 1 << SLOT_BITS;
+    static constexpr unsigned int NUM_LEVELS = 4;
+    static constexpr uint64_t RANGE = 1ull << (SLOT_BITS * NUM_LEVELS);
+
+    struct Timer {
+        friend struct TimingWheel;
+    private:
+        Timer *next = nullptr;
+        /* Whatever points to us, null when not armed */
+        Timer **pprev = nullptr;
+        uint64_t expiry = 0;
+
+        void link(Timer **head) {
+            next = *head;
+            if (next) {
+                next->pprev = &next;
+            }
+            *head = this;
+            pprev = head;
+        }
+
+    public:
+        /* Called with user when the timer fires */
+        void (*cb)(void *user) = nullptr;
+        void *user = nullptr;
+
+        Timer() = default;
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        ~Timer() {
+            cancel();
+        }
+
+        bool isArmed() {
+            return pprev != nullptr;
+        }
+
+        void cancel() {
+            if (pprev) {
+                *pprev = next;
+                if (next) {
+                    next->pprev = pprev;
+                }
+                pprev = nullptr;
+                next = nullptr;
+            }
+        }
+    };
+
+private:
+    Timer *slots[NUM_LEVELS][NUM_SLOTS] = {};
+    /* Which slots might hold timers, cancelling leaves bits behind until the slot is visited */
+    uint64_t occupied[NUM_LEVELS] = {};
+    Timer *overflow = nullptr;
+    uint64_t now = 0;
+
+    void place(Timer *timer) {
+        uint64_t delta = timer->expiry > now ? timer->expiry - now : 0;
+        if (delta >= RANGE) {
+            timer->link(&overflow);
+            return;
+        }
+
+        unsigned int level = 0;
+        while (delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        unsigned int slot = (unsigned int) (timer->expiry >> (SLOT_BITS * level)) & (NUM_SLOTS - 1);
+        timer->link(&slots[level][slot]);
+        occupied[level] |= 1ull << slot;
+    }
+
+    /* Takes all timers of head into a list of our own, so that callbacks may cancel any of them */
+    static void detach(Timer **head, Timer **list) {
+        *list = *head;
+        *head = nullptr;
+        if (*list) {
+            (*list)->pprev = list;
+        }
+    }
+
+    void visit(unsigned int level, unsigned int slot) {
+        Timer *list;
+        detach(&slots[level][slot], &list);
+        occupied[level] &= ~(1ull << slot);
+
+        while (Timer *timer = list) {
+            timer->cancel();
+            if (level || timer->expiry > now) {
+                /* Cascade down */
+                place(timer);
+            } else {
+                timer->cb(timer->user);
+            }
+        }
+    }
+
+public:
+    TimingWheel(uint64_t now = 0) : now(now) {}
+
+    /* Timers outliving us are simply no longer armed */
+    ~TimingWheel() {
+        for (unsigned int level = 0; level < NUM_LEVELS; level++) {
+            for (unsigned int slot = 0; slot < NUM_SLOTS; slot++) {
+                while (slots[level][slot]) {
+                    slots[level][slot]->cancel();
+                }
+            }
+        }
+        while (overflow) {
+            overflow->cancel();
+        }
+    }
+
+    /* Time of the last advance */
+    uint64_t getNow() {
+        return now;
+    }
+
+    /* Arms (or re-arms) timer to fire delay ms after currentTime, which is at least what we last advanced to */
+    void arm(Timer *timer, uint64_t delay, uint64_t currentTime) {
+        timer->cancel();
+        timer->expiry = (currentTime > now ? currentTime : now) + (delay ? delay : 1);
+        place(timer);
+    }
+
+    /* The tick at which something is to be done (a timer fires or cascades), UINT64_MAX if nothing is armed */
+    uint64_t nextTick() {
+        uint64_t next = UINT64_MAX;
+        for (unsigned int level = 0; level < NUM_LEVELS; level++) {
+            if (!occupied[level]) {
+                continue;
+            }
+            unsigned int shift = SLOT_BITS * level;
+            unsigned int current = (unsigned int) (now >> shift) & (NUM_SLOTS - 1);
+            uint64_t rotation = (now >> shift) & ~(uint64_t) (NUM_SLOTS - 1);
+
+            /* The rest of this rotation, else the next one */
+            uint64_t later = current == NUM_SLOTS - 1 ? 0 : occupied[level] & (~0ull << (current + 1));
+            uint64_t slot = later ? rotation + (uint64_t) __builtin_ctzll(later) : rotation + NUM_SLOTS + (uint64_t) __builtin_ctzll(occupied[level]);
+            if ((slot << shift) < next) {
+                next = slot << shift;
+            }
+        }
+        if (overflow) {
+            uint64_t wrap = ((now / RANGE) + 1) * RANGE;
+            if (wrap < next) {
+                next = wrap;
+            }
+        }
+        return next;
+    }
+
+    /* Fires everything due by currentTime, in order of ticks */
+    void advance(uint64_t currentTime) {
+        while (true) {
+            uint64_t tick = nextTick();
+            if (tick > currentTime) {
+                if (currentTime > now) {
+                    now = currentTime;
+                }
+                return;
+            }
+            now = tick;
+
+            /* Higher levels first, they cascade into lower ones and eventually into this very tick */
+            if (overflow && !(now % RANGE)) {
+                Timer *list;
+                detach(&overflow, &list);
+                while (Timer *timer = list) {
+                    timer->cancel();
+                    place(timer);
+                }
+            }
+            for (unsigned int level = NUM_LEVELS; level--; ) {
+                unsigned int shift = SLOT_BITS * level;
+                if (!(now & ((1ull << shift) - 1))) {
+                    unsigned int slot = (unsigned int) (now >> shift) & (NUM_SLOTS - 1);
+                    if (occupied[level] & (1ull << slot)) {
+                        visit(level, slot);
+                    }
+                }
+            }
+        }
+    }
+};
+
+}
+
+#endif // UWS_TIMINGWHEEL_H
@@ -0,0 +1,350 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_TLSSESSIONCACHE_H
+#define UWS_TLSSESSIONCACHE_H
+
+/* TLS session resumption across every SSLApp of the process, such as the threads of a LocalCluster. Every app has an
+ * SSL_CTX of its own, and with it its own session cache and ticket keys, so a client reconnecting to another thread
+ * than the one it came from does a full handshake. Here sessions go in one sharded store and tickets are encrypted
+ * with one rotating set of keys for all of them (SocketContextOptions::tls_session_cache_size, tls_ticket_key_lifetime).
+ *
+ * The store and the key ring do not depend on the TLS library, the glue to OpenSSL (or BoringSSL) is built with
+ * UWS_WITH_SESSION_CACHE (WITH_SESSION_CACHE=1). */
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+#ifdef UWS_WITH_SESSION_CACHE
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_IS_BORINGSSL)
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#endif
+
+namespace uWS {
+
+/* Serialized sessions by id. Sharded by id so that handshakes on different threads rarely meet on the same mutex,
+ * every shard forgets its oldest sessions first */
+struct SessionStore {
+    static constexpr unsigned int NUM_SHARDS = 16;
+
+private:
+    struct Session {
+        std::string data;
+        time_t expires;
+        std::list<std::string>::iterator age;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Session> sessions;
+        /* Oldest first */
+        std::list<std::string> ages;
+    } shards[NUM_SHARDS];
+
+    std::atomic<size_t> shardCapacity{0};
+
+    Shard &shard(std::string_view id) {
+        return shards[std::hash<std::string_view>()(id) % NUM_SHARDS];
+    }
+
+    static void forget(Shard &shard, std::unordered_map<std::string, Session>::iterator it) {
+        shard.ages.erase(it->second.age);
+        shard.sessions.erase(it);
+    }
+
+public:
+    /* Apps asking for more make it bigger, never smaller */
+    void reserve(size_t sessions) {
+        size_t capacity = (sessions + NUM_SHARDS - 1) / NUM_SHARDS;
+        size_t current = shardCapacity.load(std::memory_order_relaxed);
+        while (current < capacity && !shardCapacity.compare_exchange_weak(current, capacity, std::memory_order_relaxed));
+    }
+
+    void put(std::string_view id, std::string &&data, time_t expires) {
+        Shard &s = shard(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        auto it = s.sessions.find(std::string(id));
+        if (it != s.sessions.end()) {
+            forget(s, it);
+        }
+        size_t capacity = shardCapacity.load(std::memory_order_relaxed);
+        while (s.sessions.size() && s.sessions.size() >= capacity) {
+            forget(s, s.sessions.find(s.ages.front()));
+        }
+        if (!capacity) {
+            return;
+        }
+        s.ages.emplace_back(id);
+        s.sessions.emplace(std::string(id), Session{std::move(data), expires, std::prev(s.ages.end())});
+    }
+
+    /* Empty if we do not have it, or no longer */
+    std::string get(std::string_view id, time_t now) {
+        Shard &s = shard(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        auto it = s.sessions.find(std::string(id));
+        if (it == s.sessions.end()) {
+            return {};
+        }
+        if (it->second.expires <= now) {
+            forget(s, it);
+            return {};
+        }
+        return it->second.data;
+    }
+
+    void erase(std::string_view id) {
+        Shard &s = shard(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        auto it = s.sessions.find(std::string(id));
+        if (it != s.sessions.end()) {
+            forget(s, it);
+        }
+    }
+
+    size_t size() {
+        size_t total = 0;
+        for (Shard &s : shards) {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            total += s.sessions.size();
+        }
+        return total;
+    }
+};
+
+/* Session ticket keys. The current key encrypts new tickets for lifetime seconds, then the key before it still decrypts
+ * (and its tickets are renewed) for as long again. Threads work on a copy of both and only take the mutex when it rotated */
+struct TicketKeyRing {
+    struct Key {
+        unsigned char name[16];
+        unsigned char aes[32];
+        unsigned char hmac[32];
+    };
+
+    struct Keys {
+        Key current, previous;
+        bool hasPrevious;
+        uint64_t generation;
+    };
+
+private:
+    std::mutex mutex;
+    Keys keys = {};
+    std::atomic<uint64_t> generation{0};
+    std::atomic<time_t> rotatesAt{0};
+    std::atomic<unsigned int> lifetime{0};
+    void (*random)(unsigned char *, size_t);
+
+    /* Generations are unique across rings, so a thread's copy can never be mistaken for another ring's */
+    static uint64_t nextGeneration() {
+        static std::atomic<uint64_t> generations{0};
+        return ++generations;
+    }
+
+public:
+    TicketKeyRing(void (*random)(unsigned char *, size_t)) : random(random) {}
+
+    /* The shortest lifetime asked for wins */
+    void setLifetime(unsigned int seconds) {
+        unsigned int current = lifetime.load(std::memory_order_relaxed);
+        while ((!current || seconds < current) && !lifetime.compare_exchange_weak(current, seconds, std::memory_order_relaxed));
+    }
+
+    /* The keys of now, rotating them first if it is time */
+    const Keys &get(time_t now) {
+        static thread_local Keys local = {};
+
+        if (now >= rotatesAt.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (now >= rotatesAt.load(std::memory_order_relaxed)) {
+                keys.previous = keys.current;
+                keys.hasPrevious = keys.generation != 0;
+                random((unsigned char *) &keys.current, sizeof(Key));
+                keys.generation = nextGeneration();
+                generation.store(keys.generation, std::memory_order_release);
+                unsigned int seconds = lifetime.load(std::memory_order_relaxed);
+                rotatesAt.store(seconds ? now + (time_t) seconds : std::numeric_limits<time_t>::max(), std::memory_order_release);
+            }
+        }
+
+        if (local.generation != generation.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            local = keys;
+        }
+        return local;
+    }
+
+    /* The key a ticket was encrypted with, or nullptr if it is too old */
+    const Key *find(const Keys &keys, const unsigned char name[16]) {
+        if (!memcmp(keys.current.name, name, 16)) {
+            return &keys.current;
+        }
+        if (keys.hasPrevious && !memcmp(keys.previous.name, name, 16)) {
+            return &keys.previous;
+        }
+        return nullptr;
+    }
+};
+
+#ifdef UWS_WITH_SESSION_CACHE
+
+struct TlsSessionCache {
+private:
+    static SessionStore &store() {
+        static SessionStore store;
+        return store;
+    }
+
+    static TicketKeyRing &ticketKeys() {
+        static TicketKeyRing ticketKeys([](unsigned char *out, size_t length) {
+            RAND_bytes(out, (int) length);
+        });
+        return ticketKeys;
+    }
+
+    static int newSession(SSL *, SSL_SESSION *session) {
+        unsigned int idLength;
+        const unsigned char *id = SSL_SESSION_get_id(session, &idLength);
+
+        int length = i2d_SSL_SESSION(session, nullptr);
+        if (length <= 0) {
+            return 0;
+        }
+        std::string data((size_t) length, 0);
+        unsigned char *p = (unsigned char *) data.data();
+        i2d_SSL_SESSION(session, &p);
+
+        time_t expires = (time_t) SSL_SESSION_get_time(session) + (time_t) SSL_SESSION_get_timeout(session);
+        store().put({(const char *) id, idLength}, std::move(data), expires);
+
+        /* We keep no reference to the session itself */
+        return 0;
+    }
+
+    static SSL_SESSION *getSession(SSL *, const unsigned char *id, int idLength, int *copy) {
+        *copy = 0;
+        std::string data = store().get({(const char *) id, (size_t) idLength}, time(nullptr));
+        if (data.empty()) {
+            return nullptr;
+        }
+        const unsigned char *p = (const unsigned char *) data.data();
+        return d2i_SSL_SESSION(nullptr, &p, (long) data.length());
+    }
+
+    static void removeSession(SSL_CTX *, SSL_SESSION *session) {
+        unsigned int idLength;
+        const unsigned char *id = SSL_SESSION_get_id(session, &idLength);
+        store().erase({(const char *) id, idLength});
+    }
+
+    /* Picks the key to encrypt (and sets the iv) or the key to decrypt with. Returns like the ticket key callbacks:
+     * 1 for a current key, 2 for the previous one (renew the ticket), 0 for none */
+    static int ticketKey(unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher, int encrypt, const TicketKeyRing::Key *&key) {
+        const TicketKeyRing::Keys &keys = ticketKeys().get(time(nullptr));
+        if (encrypt) {
+            if (RAND_bytes(iv, 16) != 1) {
+                return -1;
+            }
+            key = &keys.current;
+            memcpy(name, key->name, 16);
+            return EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->aes, iv) == 1 ? 1 : -1;
+        }
+        key = ticketKeys().find(keys, name);
+        if (!key) {
+            return 0;
+        }
+        if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->aes, iv) != 1) {
+            return -1;
+        }
+        return key == &keys.current ? 1 : 2;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_IS_BORINGSSL)
+    static int ticketKeyCallback(SSL *, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int encrypt) {
+        const TicketKeyRing::Key *key;
+        int result = ticketKey(name, iv, cipher, encrypt, key);
+        if (result > 0) {
+            OSSL_PARAM params[] = {
+                OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, (void *) key->hmac, sizeof(key->hmac)),
+                OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *) "SHA256", 0),
+                OSSL_PARAM_construct_end()
+            };
+            if (EVP_MAC_CTX_set_params(mac, params) != 1) {
+                return -1;
+            }
+        }
+        return result;
+    }
+#else
+    static int ticketKeyCallback(SSL *, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher, HMAC_CTX *hmac, int encrypt) {
+        const TicketKeyRing::Key *key;
+        int result = ticketKey(name, iv, cipher, encrypt, key);
+        if (result > 0 && HMAC_Init_ex(hmac, key->hmac, sizeof(key->hmac), EVP_sha256(), nullptr) != 1) {
+            return -1;
+        }
+        return result;
+    }
+#endif
+
+public:
+    /* Makes ctx resume sessions from, and issue tickets readable by, every other SSL_CTX attached. 0 leaves either as is */
+    static void attach(SSL_CTX *ctx, unsigned int sessions, unsigned int ticketKeyLifetime) {
+        /* Sessions are only ever resumed within the same context id */
+        SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "uWS", 3);
+
+        if (sessions) {
+            store().reserve(sessions);
+            SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+            SSL_CTX_sess_set_new_cb(ctx, newSession);
+            SSL_CTX_sess_set_get_cb(ctx, getSession);
+            SSL_CTX_sess_set_remove_cb(ctx, removeSession);
+        }
+
+        if (ticketKeyLifetime) {
+            ticketKeys().setLifetime(ticketKeyLifetime);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(OPENSSL_IS_BORINGSSL)
+            SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketKeyCallback);
+#else
+            SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticketKeyCallback);
+#endif
+        }
+    }
+};
+
+#endif
+
+}
+
+#endif // UWS_TLSSESSIONCACHE_H
@@ -18,31 +18,259 @@
 #ifndef UWS_TOPICTREE_H
 #define UWS_TOPICTREE_H
 
+#include <deque>
 #include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
 #include <list>
 #include <iostream>
-#include <unordered_set>
 #include <utility>
 #include <memory>
-#include <unordered_map>
 #include <vector>
 #include <string_view>
 #include <functional>
-#include <set>
 #include <string>
 #include <exception>
+#include <algorithm>
+#include <new>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+#include "Probes.h"
+#include "CompressionStats.h"
+#include "TimingWheel.h"
 
 namespace uWS {
 
 struct Subscriber;
 
-struct Topic : std::unordered_set<Subscriber *> {
+/* Open addressing set of pointers with linear probing and backward shift deletion (no tombstones).
+ * There can be millions of these, so it is only a pointer and two counters until it holds something.
+ * Iteration order is unspecified and the set must not be modified while iterating it. */
+template <typename T, typename HASHER>
+struct FlatPointerSet {
+private:
+    T **slots = nullptr;
+    uint32_t numElements = 0;
+    /* Capacity - 1, only meaningful with slots */
+    uint32_t mask = 0;
+
+    size_t slotOf(T *element) const {
+        return HASHER::hash(element) & mask;
+    }
+
+    void rehash(uint32_t capacity) {
+        T **oldSlots = slots;
+        uint32_t oldCapacity = slots ? mask + 1 : 0;
+
+        slots = capacity ? (T **) calloc(capacity, sizeof(T *)) : nullptr;
+        mask = capacity - 1;
+        for (uint32_t i = 0; i < oldCapacity; i++) {
+            if (oldSlots[i]) {
+                size_t slot = slotOf(oldSlots[i]);
+                while (slots[slot]) {
+                    slot = (slot + 1) & mask;
+                }
+                slots[slot] = oldSlots[i];
+            }
+        }
+        free(oldSlots);
+    }
+
+public:
+    struct iterator {
+        T **slot, **end;
+
+        void skip() {
+            while (slot != end && !*slot) {
+                slot++;
+            }
+        }
+
+        T *operator*() const {
+            return *slot;
+        }
+
+        iterator &operator++() {
+            slot++;
+            skip();
+            return *this;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return slot != other.slot;
+        }
+    };
+
+    FlatPointerSet() = default;
+    FlatPointerSet(const FlatPointerSet &) = delete;
+    FlatPointerSet &operator=(const FlatPointerSet &) = delete;
+
+    ~FlatPointerSet() {
+        free(slots);
+    }
+
+    iterator begin() const {
+        iterator it = {slots, slots ? slots + mask + 1 : nullptr};
+        it.skip();
+        return it;
+    }
+
+    iterator end() const {
+        T **end = slots ? slots + mask + 1 : nullptr;
+        return {end, end};
+    }
+
+    size_t size() const {
+        return numElements;
+    }
+
+    void clear() {
+        free(slots);
+        slots = nullptr;
+        numElements = 0;
+    }
 
-    Topic(std::string_view topic) : name(topic) {
+    /* Finds the element with this hash for which match returns true */
+    template <typename MATCH>
+    T *find(size_t hash, MATCH match) const {
+        if (!numElements) {
+            return nullptr;
+        }
+        for (size_t slot = hash & mask; slots[slot]; slot = (slot + 1) & mask) {
+            if (match(slots[slot])) {
+                return slots[slot];
+            }
+        }
+        return nullptr;
+    }
 
+    size_t count(T *element) const {
+        return find(HASHER::hash(element), [element](T *other) { return other == element; }) != nullptr;
     }
 
-    std::string name;
+    /* Returns false if already present */
+    bool insert(T *element) {
+        /* Keep the load factor at or below 3/4 */
+        if (!slots || (numElements + 1) * 4 > (mask + 1) * 3) {
+            rehash(slots ? (mask + 1) * 2 : 2);
+        }
+        size_t slot = slotOf(element);
+        for (; slots[slot]; slot = (slot + 1) & mask) {
+            if (slots[slot] == element) {
+                return false;
+            }
+        }
+        slots[slot] = element;
+        numElements++;
+        return true;
+    }
+
+    /* Returns the number of elements removed */
+    size_t erase(T *element) {
+        if (!numElements) {
+            return 0;
+        }
+        size_t slot = slotOf(element);
+        while (slots[slot] != element) {
+            if (!slots[slot]) {
+                return 0;
+            }
+            slot = (slot + 1) & mask;
+        }
+
+        /* Shift back everything that was displaced past the hole */
+        size_t hole = slot;
+        for (size_t next = (hole + 1) & mask; slots[next]; next = (next + 1) & mask) {
+            size_t home = slotOf(slots[next]);
+            /* Move it if its home is not cyclically within (hole, next] */
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+        }
+        slots[hole] = nullptr;
+        numElements--;
+
+        /* Give memory back when we have shrunk a lot, such as after a mass disconnect */
+        if (!numElements) {
+            rehash(0);
+        } else if (mask + 1 > 16 && numElements * 8 < mask + 1) {
+            rehash((mask + 1) / 2);
+        }
+        return 1;
+    }
+};
+
+/* Hashes any pointer by its address, such as of subscribers or of sockets */
+struct PointerHasher {
+    static size_t hash(const void *p) {
+        /* Allocations are aligned so the low bits carry nothing, mix them all down */
+        uint64_t h = (uint64_t) (uintptr_t) p;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return (size_t) h;
+    }
+};
+
+using SubscriberHasher = PointerHasher;
+
+/* A topic is the set of its subscribers, with its name stored right after it in the same allocation */
+struct Topic : FlatPointerSet<Subscriber, SubscriberHasher> {
+
+    std::string_view name;
+    size_t hash;
+    /* Of what is published to us compressed */
+    CompressionStats compressionStats;
+
+    static size_t hashName(std::string_view name) {
+        return std::hash<std::string_view>()(name);
+    }
+
+    static Topic *create(std::string_view topic) {
+        char *memory = (char *) malloc(sizeof(Topic) + topic.length());
+        char *nameMemory = memory + sizeof(Topic);
+        if (topic.length()) {
+            memcpy(nameMemory, topic.data(), topic.length());
+        }
+        return new (memory) Topic(std::string_view(nameMemory, topic.length()));
+    }
+
+    static void destroy(Topic *topic) {
+        topic->~Topic();
+        free(topic);
+    }
+
+private:
+    Topic(std::string_view name) : name(name), hash(hashName(name)) {
+
+    }
+};
+
+struct TopicHasher {
+    static size_t hash(Topic *topic) {
+        return topic->hash;
+    }
+};
+
+/* Topics with MQTT wildcard levels, '+' for exactly one level and a trailing '#' for any number of levels
+ * (including none), are also kept in a trie of levels that publish walks once per message */
+struct WildcardNode {
+    std::map<std::string, std::unique_ptr<WildcardNode>, std::less<>> children;
+    std::unique_ptr<WildcardNode> plus;
+
+    /* The wildcard topic ending at this level, and the one ending with '#' right after it */
+    Topic *terminal = nullptr;
+    Topic *hash = nullptr;
+
+    bool empty() {
+        return children.empty() && !plus && !terminal && !hash;
+    }
 };
 
 struct Subscriber {
@@ -56,26 +284,61 @@ private:
     /* State of prev, next does not matter unless we are needsDrainage() since we are not in the list */
     Subscriber *prev, *next;
 
-    /* Any one subscriber can be part of at most 32 publishes before it needs a drain,
-     * or whatever encoding of runs or whatever we might do in the future */
-    uint16_t messageIndices[32];
+    /* Pending messages are indices into outgoingMessages, always increasing, kept as runs of consecutive
+     * indices. Most bursts are one run, which needs no allocation, and there is no limit on how many we hold */
+    struct MessageRun {
+        uint32_t first, count;
+    };
+
+    /* This one matters the most, if its count is 0 we are not in the list of drainableSubscribers */
+    MessageRun firstRun = {0, 0};
+    std::vector<MessageRun> moreRuns;
+
+    /* The last publish that reached us, so that matching many topics still delivers once */
+    uint32_t publishEpoch = 0;
+
+    /* Returns true if this was our first pending message */
+    bool addMessage(uint32_t index) {
+        MessageRun &last = moreRuns.size() ? moreRuns.back() : firstRun;
+        if (!firstRun.count) {
+            firstRun = {index, 1};
+            return true;
+        }
+        if (last.first + last.count == index) {
+            last.count++;
+        } else {
+            moreRuns.push_back({index, 1});
+        }
+        return false;
+    }
 
-    /* This one matters the most, if it is 0 we are not in the list of drainableSubscribers */
-    unsigned char numMessageIndices = 0;
+    /* The latest messages of conflated topics held back while we were backlogged, owned by the TopicTree
+     * which knows their type */
+    std::unique_ptr<void, void (*)(void *)> conflatedMessages{nullptr, nullptr};
 
 public:
 
-    /* We have a list of topics we subscribe to (read by WebSocket::iterateTopics) */
-    std::set<Topic *> topics;
+    /* We have a list of topics we subscribe to (read by WebSocket::iterateTopics), sorted by address */
+    std::vector<Topic *> topics;
 
     /* User data */
     void *user;
 
     bool needsDrainage() {
-        return numMessageIndices;
+        return firstRun.count;
     }
 };
 
+/* Messages published to a coalesced topic within window milliseconds (0 for within the loop iteration) go out as one,
+ * each preceded by its length (4 bytes, little endian) if lengthPrefixed, else with joiner in between. A batch
+ * reaching maxBytes goes out right away */
+struct CoalescingOptions {
+    unsigned int window = 0;
+    size_t maxBytes = 16 * 1024;
+    std::string joiner = "\n";
+    bool lengthPrefixed = false;
+};
+
 template <typename T, typename B>
 struct TopicTree {
 
@@ -93,8 +356,262 @@ private:
      * It must only cork, uncork, send, write */
     std::function<bool(Subscriber *, T &, IteratorFlags)> cb;
 
-    /* The topics */
-    std::unordered_map<std::string_view, std::unique_ptr<Topic>> topics;
+    /* The topics, owned by us */
+    FlatPointerSet<Topic, TopicHasher> topics;
+
+    /* The wildcard topics are in both */
+    WildcardNode wildcardRoot;
+    size_t numWildcardTopics = 0;
+    uint32_t publishEpoch = 0;
+    /* Changes whenever a topic is created or removed */
+    unsigned int topicsVersion = 0;
+
+    /* Topics of which backlogged subscribers only get the latest message */
+    std::set<std::string, std::less<>> conflatedTopics;
+
+    /* How many messages to retain, by topic or wildcard topic, and the messages retained by topic */
+    std::map<std::string, unsigned int, std::less<>> retentionRules;
+    size_t numWildcardRetentionRules = 0;
+    std::map<std::string, std::deque<T>, std::less<>> retainedMessages;
+
+    /* How to coalesce, by topic or wildcard topic, and what is being coalesced by topic. Batches with a window
+     * are let go of by their timer, the others by flushImmediateBatches */
+    struct Batch {
+        TopicTree *topicTree;
+        std::string topic;
+        int kind;
+        std::string payload;
+        TimingWheel::Timer timer;
+    };
+    std::map<std::string, CoalescingOptions, std::less<>> coalescingRules;
+    size_t numWildcardCoalescingRules = 0;
+    std::map<std::string, std::unique_ptr<Batch>, std::less<>> timedBatches, immediateBatches;
+
+    const CoalescingOptions *findCoalescingRule(std::string_view topic) {
+        if (auto it = coalescingRules.find(topic); it != coalescingRules.end()) {
+            return &it->second;
+        }
+        if (numWildcardCoalescingRules) {
+            for (auto &[pattern, options] : coalescingRules) {
+                if (isWildcard(pattern) && matches(pattern, topic)) {
+                    return &options;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    /* Hands the batch to batchHandler, it is no longer ours */
+    void flushBatch(std::map<std::string, std::unique_ptr<Batch>, std::less<>> &batches, typename std::map<std::string, std::unique_ptr<Batch>, std::less<>>::iterator it) {
+        std::unique_ptr<Batch> batch = std::move(it->second);
+        batches.erase(it);
+        batch->timer.cancel();
+        batchHandler(batch->topic, std::move(batch->payload), batch->kind);
+    }
+
+    /* Held back for one subscriber, in the order their topics first were */
+    struct ConflatedMessages {
+        std::unordered_map<std::string, size_t> indices;
+        std::vector<std::optional<T>> messages;
+    };
+
+    /* Keeps a copy of what was published to topic if a rule says so, dropping the oldest over its count */
+    void retain(std::string_view topic, T &&message) {
+        unsigned int count = 0;
+        if (auto it = retentionRules.find(topic); it != retentionRules.end()) {
+            count = it->second;
+        } else if (numWildcardRetentionRules) {
+            for (auto &[pattern, patternCount] : retentionRules) {
+                if (isWildcard(pattern) && matches(pattern, topic)) {
+                    count = patternCount;
+                    break;
+                }
+            }
+        }
+        if (!count) {
+            return;
+        }
+
+        auto it = retainedMessages.find(topic);
+        if (it == retainedMessages.end()) {
+            it = retainedMessages.emplace(std::string(topic), std::deque<T>()).first;
+        }
+        while (it->second.size() >= count) {
+            it->second.pop_front();
+        }
+        it->second.push_back(std::move(message));
+    }
+
+    /* Calls cb(level, last) for every level of topic, "" has one empty level */
+    template <typename F>
+    static void forEachLevel(std::string_view topic, F cb) {
+        for (size_t start = 0; ; ) {
+            size_t end = topic.find('/', start);
+            bool last = end == std::string_view::npos;
+            cb(topic.substr(start, last ? std::string_view::npos : end - start), last);
+            if (last) {
+                break;
+            }
+            start = end + 1;
+        }
+    }
+
+    static bool isWildcard(std::string_view topic) {
+        bool wildcard = false;
+        forEachLevel(topic, [&wildcard](std::string_view level, bool last) {
+            wildcard |= level == "+" || (last && level == "#");
+        });
+        return wildcard;
+    }
+
+    /* Returns the slot of the wildcard topic in the trie, creating the path there and then */
+    Topic **wildcardSlot(std::string_view topic) {
+        WildcardNode *node = &wildcardRoot;
+        Topic **slot = nullptr;
+        forEachLevel(topic, [&node, &slot](std::string_view level, bool last) {
+            if (last && level == "#") {
+                slot = &node->hash;
+                return;
+            }
+            if (level == "+") {
+                if (!node->plus) {
+                    node->plus.reset(new WildcardNode);
+                }
+                node = node->plus.get();
+            } else {
+                auto it = node->children.find(level);
+                if (it == node->children.end()) {
+                    it = node->children.emplace(std::string(level), std::unique_ptr<WildcardNode>(new WildcardNode)).first;
+                }
+                node = it->second.get();
+            }
+            if (last) {
+                slot = &node->terminal;
+            }
+        });
+        return slot;
+    }
+
+    /* Clears the slot of the wildcard topic, pruning what becomes empty. Returns true if node became empty */
+    static bool removeWildcard(WildcardNode *node, std::string_view topic) {
+        size_t end = topic.find('/');
+        std::string_view level = topic.substr(0, end);
+        if (end == std::string_view::npos && level == "#") {
+            node->hash = nullptr;
+            return node->empty();
+        }
+
+        WildcardNode *child;
+        if (level == "+") {
+            child = node->plus.get();
+        } else {
+            auto it = node->children.find(level);
+            child = it == node->children.end() ? nullptr : it->second.get();
+        }
+
+        bool childEmpty;
+        if (end == std::string_view::npos) {
+            child->terminal = nullptr;
+            childEmpty = child->empty();
+        } else {
+            childEmpty = removeWildcard(child, topic.substr(end + 1));
+        }
+
+        if (childEmpty) {
+            if (level == "+") {
+                node->plus.reset();
+            } else {
+                node->children.erase(node->children.find(level));
+            }
+        }
+        return node->empty();
+    }
+
+    /* Calls cb for every wildcard topic matching the levels of topic from start on. Wildcards never
+     * match a first level beginning with '$', just like in MQTT */
+    template <typename F>
+    static void matchWildcards(WildcardNode *node, std::string_view topic, size_t start, F &cb) {
+        if (start == std::string_view::npos) {
+            if (node->terminal) {
+                cb(node->terminal);
+            }
+            /* "sport/#" also matches "sport" */
+            if (node->hash) {
+                cb(node->hash);
+            }
+            return;
+        }
+
+        size_t end = topic.find('/', start);
+        std::string_view level = topic.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        size_t next = end == std::string_view::npos ? std::string_view::npos : end + 1;
+        bool system = !start && level.length() && level[0] == '$';
+
+        if (node->hash && !system) {
+            cb(node->hash);
+        }
+        if (node->plus && !system) {
+            matchWildcards(node->plus.get(), topic, next, cb);
+        }
+        if (node->children.size()) {
+            auto it = node->children.find(level);
+            if (it != node->children.end()) {
+                matchWildcards(it->second.get(), topic, next, cb);
+            }
+        }
+    }
+
+    /* Calls cb once for every subscriber of any topic matching any of topicNames, returns false if no topic matched */
+    template <typename F>
+    bool forEachSubscriber(const std::string_view *topicNames, size_t numTopics, F cb) {
+        /* Without wildcards one name is at most one topic and there is nothing to deduplicate */
+        if (!numWildcardTopics && numTopics == 1) {
+            Topic *topicPtr = lookupTopic(topicNames[0]);
+            if (!topicPtr) {
+                return false;
+            }
+            for (Subscriber *s : *topicPtr) {
+                cb(s);
+            }
+            return true;
+        }
+
+        /* Start over before the epoch wraps around and old marks turn valid again */
+        if (++publishEpoch == 0) {
+            for (Topic *t : topics) {
+                for (Subscriber *s : *t) {
+                    s->publishEpoch = 0;
+                }
+            }
+            publishEpoch = 1;
+        }
+
+        bool matched = false;
+        auto visitTopic = [this, &matched, &cb](Topic *t) {
+            matched = true;
+            for (Subscriber *s : *t) {
+                if (s->publishEpoch != publishEpoch) {
+                    s->publishEpoch = publishEpoch;
+                    cb(s);
+                }
+            }
+        };
+
+        for (size_t i = 0; i < numTopics; i++) {
+            if (Topic *topicPtr = lookupTopic(topicNames[i])) {
+                visitTopic(topicPtr);
+            }
+            if (numWildcardTopics) {
+                matchWildcards(&wildcardRoot, topicNames[i], 0, visitTopic);
+            }
+        }
+        return matched;
+    }
+
+    template <typename F>
+    bool forEachSubscriber(std::string_view topic, F cb) {
+        return forEachSubscriber(&topic, 1, std::move(cb));
+    }
 
     /* List of subscribers that needs drainage */
     Subscriber *drainableSubscribers = nullptr;
@@ -114,20 +631,39 @@ private:
     void drainImpl(Subscriber *s) {
         /* Before we call cb we need to make sure this subscriber will not report needsDrainage()
          * since WebSocket::send will call drain from within the cb in that case.*/
-        int numMessageIndices = s->numMessageIndices;
-        s->numMessageIndices = 0;
+        Subscriber::MessageRun firstRun = s->firstRun;
+        s->firstRun.count = 0;
+        /* Borrow the runs and give them back after, to keep their allocation */
+        std::vector<Subscriber::MessageRun> moreRuns;
+        moreRuns.swap(s->moreRuns);
 
         /* Then we emit cb */
-        for (int i = 0; i < numMessageIndices; i++) {
-            T &outgoingMessage = outgoingMessages[s->messageIndices[i]];
-
-            int flags = (i == numMessageIndices - 1) ? LAST : 0;
-
-            /* Returning true will stop drainage short (such as when backpressure is too high) */
-            if (cb(s, outgoingMessage, (IteratorFlags)(flags | (i == 0 ? FIRST : 0)))) {
+        size_t numRuns = moreRuns.size() + 1;
+        bool first = true;
+        for (size_t r = 0; r < numRuns; r++) {
+            Subscriber::MessageRun run = r ? moreRuns[r - 1] : firstRun;
+            bool stop = false;
+            for (uint32_t i = run.first; i < run.first + run.count; i++) {
+                T &outgoingMessage = outgoingMessages[i];
+
+                int flags = (r == numRuns - 1 && i == run.first + run.count - 1) ? LAST : 0;
+
+                /* Returning true will stop drainage short (such as when backpressure is too high) */
+                if (cb(s, outgoingMessage, (IteratorFlags)(flags | (first ? FIRST : 0)))) {
+                    stop = true;
+                    break;
+                }
+                first = false;
+            }
+            if (stop) {
                 break;
             }
         }
+
+        moreRuns.clear();
+        if (s->moreRuns.empty()) {
+            s->moreRuns.swap(moreRuns);
+        }
     }
 
     void unlinkDrainableSubscriber(Subscriber *s) {
@@ -145,17 +681,301 @@ private:
 
 public:
 
+    void removeTopic(Topic *topicPtr) {
+        if (isWildcard(topicPtr->name)) {
+            removeWildcard(&wildcardRoot, topicPtr->name);
+            numWildcardTopics--;
+        }
+        topics.erase(topicPtr);
+        Topic::destroy(topicPtr);
+        topicsVersion++;
+    }
+
+    unsigned int getTopicsVersion() {
+        return topicsVersion;
+    }
+
+    /* Compression statistics of topic, or null if nobody subscribes to it. Valid as long as getTopicsVersion() is */
+    CompressionStats *getCompressionStats(std::string_view topic) {
+        Topic *topicPtr = lookupTopic(topic);
+        return topicPtr ? &topicPtr->compressionStats : nullptr;
+    }
+
+    bool hasWildcardTopics() {
+        return numWildcardTopics;
+    }
+
+    template <typename F>
+    void forEachTopic(F cb) {
+        for (Topic *topicPtr : topics) {
+            cb(topicPtr->name);
+        }
+    }
+
     TopicTree(std::function<bool(Subscriber *, T &, IteratorFlags)> cb) : cb(cb) {
 
     }
 
+    ~TopicTree() {
+        /* Subscribers are freed by their owners, but topics are ours */
+        std::vector<Topic *> remaining;
+        for (Topic *topicPtr : topics) {
+            remaining.push_back(topicPtr);
+        }
+        for (Topic *topicPtr : remaining) {
+            removeTopic(topicPtr);
+        }
+    }
+
+    /* Ends every subscription at once, such as when closing everything: what was published goes out first, then
+     * every topic goes as a whole rather than one subscriber at a time. Subscribers are still freed by their owners,
+     * which is then cheap. Subscription handlers are not told. Rules, retained messages and batches stay */
+    void clear() {
+        drain();
+        for (Topic *topicPtr : topics) {
+            for (Subscriber *s : *topicPtr) {
+                s->topics.clear();
+            }
+            Topic::destroy(topicPtr);
+        }
+        topics.clear();
+        wildcardRoot = {};
+        numWildcardTopics = 0;
+        topicsVersion++;
+    }
+
+    /* Backlogged subscribers (as the callback decides) get only the latest message of a conflated topic, the
+     * rest is replaced while they are backlogged */
+    void setConflated(std::string_view topic, bool conflated) {
+        /* Messages still to be drained point to the name */
+        drain();
+        if (conflated) {
+            conflatedTopics.emplace(topic);
+        } else if (auto it = conflatedTopics.find(topic); it != conflatedTopics.end()) {
+            conflatedTopics.erase(it);
+        }
+    }
+
+    /* Returns the name of topic if conflated (for as long as it is), nullptr otherwise */
+    const std::string *getConflatedTopic(std::string_view topic) {
+        if (conflatedTopics.empty()) {
+            return nullptr;
+        }
+        auto it = conflatedTopics.find(topic);
+        return it == conflatedTopics.end() ? nullptr : &*it;
+    }
+
+    /* Whether s holds back a message of topic, which newer ones must replace rather than overtake */
+    static bool isConflating(Subscriber *s, const std::string &topic) {
+        return s->conflatedMessages && ((ConflatedMessages *) s->conflatedMessages.get())->indices.count(topic);
+    }
+
+    /* Holds a copy of message back for s, replacing the one of the same topic. Returns the copy */
+    static T &conflate(Subscriber *s, const std::string &topic, T &message) {
+        if (!s->conflatedMessages) {
+            s->conflatedMessages = {new ConflatedMessages, [](void *conflatedMessages) {
+                delete (ConflatedMessages *) conflatedMessages;
+            }};
+        }
+        ConflatedMessages *conflatedMessages = (ConflatedMessages *) s->conflatedMessages.get();
+        auto [it, inserted] = conflatedMessages->indices.try_emplace(topic, conflatedMessages->messages.size());
+        if (inserted) {
+            conflatedMessages->messages.emplace_back();
+        }
+        return conflatedMessages->messages[it->second].emplace(message);
+    }
+
+    /* Passes what s held back to the callback, once s has drained */
+    void flushConflated(Subscriber *s) {
+        if (!s || !s->conflatedMessages) {
+            return;
+        }
+
+        /* Anything held back again while flushing starts over */
+        std::unique_ptr<void, void (*)(void *)> conflatedMessages = std::move(s->conflatedMessages);
+        std::vector<std::optional<T>> &messages = ((ConflatedMessages *) conflatedMessages.get())->messages;
+        for (size_t i = 0; i < messages.size(); i++) {
+            int flags = (i ? 0 : FIRST) | (i == messages.size() - 1 ? LAST : 0);
+            cb(s, *messages[i], (IteratorFlags) flags);
+        }
+    }
+
+    /* Whether topic matches the wildcard topic pattern, by the same rules as publish */
+    static bool matches(std::string_view pattern, std::string_view topic) {
+        size_t p = 0, t = 0;
+        for (bool first = true; ; first = false) {
+            size_t patternEnd = pattern.find('/', p);
+            std::string_view patternLevel = pattern.substr(p, patternEnd == std::string_view::npos ? std::string_view::npos : patternEnd - p);
+            bool system = first && topic.length() && topic[0] == '$';
+            if (patternEnd == std::string_view::npos && patternLevel == "#") {
+                return !system;
+            }
+            if (t == std::string_view::npos) {
+                return false;
+            }
+
+            size_t topicEnd = topic.find('/', t);
+            std::string_view topicLevel = topic.substr(t, topicEnd == std::string_view::npos ? std::string_view::npos : topicEnd - t);
+            if (patternLevel == "+" ? system : patternLevel != topicLevel) {
+                return false;
+            }
+            if (patternEnd == std::string_view::npos) {
+                return topicEnd == std::string_view::npos;
+            }
+            p = patternEnd + 1;
+            t = topicEnd == std::string_view::npos ? std::string_view::npos : topicEnd + 1;
+        }
+    }
+
+    /* Keeps the last count messages published to topic, or to every topic matching it if a wildcard topic, for
+     * those subscribing later. 0 stops and forgets them */
+    void setRetained(std::string_view topic, unsigned int count) {
+        auto it = retentionRules.find(topic);
+        if (it != retentionRules.end()) {
+            numWildcardRetentionRules -= isWildcard(topic);
+            retentionRules.erase(it);
+        }
+        if (count) {
+            retentionRules.emplace(std::string(topic), count);
+            numWildcardRetentionRules += isWildcard(topic);
+            return;
+        }
+
+        bool wildcard = isWildcard(topic);
+        for (auto retained = retainedMessages.begin(); retained != retainedMessages.end(); ) {
+            if (wildcard ? matches(topic, retained->first) : retained->first == topic) {
+                retained = retainedMessages.erase(retained);
+            } else {
+                retained++;
+            }
+        }
+    }
+
+    /* Where batches of coalesced topics go, to be published as one message of their kind. Must not coalesce */
+    std::function<void(std::string_view topic, std::string &&payload, int kind)> batchHandler;
+    /* Arms the timer of a new batch to fire after its window */
+    std::function<void(TimingWheel::Timer *, unsigned int ms)> armBatchTimer;
+
+    /* Coalesces what is published to topic, or to every topic matching it if a wildcard topic, by options, or stops
+     * coalescing it if none. What was coalesced so far goes out first */
+    void setCoalesced(std::string_view topic, std::optional<CoalescingOptions> options) {
+        bool wildcard = isWildcard(topic);
+        for (auto *batches : {&timedBatches, &immediateBatches}) {
+            for (auto it = batches->begin(); it != batches->end(); ) {
+                auto next = std::next(it);
+                if (wildcard ? matches(topic, it->first) : it->first == topic) {
+                    flushBatch(*batches, it);
+                }
+                it = next;
+            }
+        }
+
+        auto it = coalescingRules.find(topic);
+        if (it != coalescingRules.end()) {
+            numWildcardCoalescingRules -= wildcard;
+            coalescingRules.erase(it);
+        }
+        if (options) {
+            coalescingRules.emplace(std::string(topic), std::move(*options));
+            numWildcardCoalescingRules += wildcard;
+        }
+    }
+
+    /* Adds message to the batch of topic if coalesced, returns false if not. A batch goes out once it reaches
+     * maxBytes, before a message of another kind, or after its window */
+    bool coalesce(std::string_view topic, std::string_view message, int kind) {
+        if (coalescingRules.empty()) {
+            return false;
+        }
+        const CoalescingOptions *options = findCoalescingRule(topic);
+        if (!options) {
+            return false;
+        }
+
+        auto &batches = options->window ? timedBatches : immediateBatches;
+        auto it = batches.find(topic);
+        if (it != batches.end() && it->second->kind != kind) {
+            flushBatch(batches, it);
+            it = batches.end();
+        }
+        if (it == batches.end()) {
+            it = batches.emplace(std::string(topic), std::unique_ptr<Batch>(new Batch{this, std::string(topic), kind, {}, {}})).first;
+            if (options->window) {
+                Batch *batch = it->second.get();
+                batch->timer.user = batch;
+                batch->timer.cb = [](void *user) {
+                    Batch *batch = (Batch *) user;
+                    TopicTree *topicTree = batch->topicTree;
+                    topicTree->flushBatch(topicTree->timedBatches, topicTree->timedBatches.find(batch->topic));
+                };
+                armBatchTimer(&batch->timer, options->window);
+            }
+        } else if (!options->lengthPrefixed) {
+            it->second->payload.append(options->joiner);
+        }
+
+        std::string &payload = it->second->payload;
+        if (options->lengthPrefixed) {
+            for (unsigned int i = 0; i < 4; i++) {
+                payload.push_back((char) (message.length() >> (i * 8)));
+            }
+        }
+        payload.append(message);
+        if (payload.length() >= options->maxBytes) {
+            flushBatch(batches, it);
+        }
+        return true;
+    }
+
+    /* Lets go of the batches of topics coalesced within the loop iteration */
+    void flushImmediateBatches() {
+        while (!immediateBatches.empty()) {
+            flushBatch(immediateBatches, immediateBatches.begin());
+        }
+    }
+
+    /* Calls cb with every message retained by topic, or by every topic matching it if a wildcard topic, oldest first */
+    template <typename F>
+    void forEachRetained(std::string_view topic, F cb) {
+        if (retainedMessages.empty()) {
+            return;
+        }
+        if (!isWildcard(topic)) {
+            if (auto it = retainedMessages.find(topic); it != retainedMessages.end()) {
+                for (T &message : it->second) {
+                    cb(message);
+                }
+            }
+            return;
+        }
+        for (auto &[retainedTopic, messages] : retainedMessages) {
+            if (matches(topic, retainedTopic)) {
+                for (T &message : messages) {
+                    cb(message);
+                }
+            }
+        }
+    }
+
     /* Returns nullptr if not found */
     Topic *lookupTopic(std::string_view topic) {
-        auto it = topics.find(topic);
-        if (it == topics.end()) {
-            return nullptr;
+        return topics.find(Topic::hashName(topic), [topic](Topic *topicPtr) {
+            return topicPtr->name == topic;
+        });
+    }
+
+    Topic *lookupOrCreateTopic(std::string_view topic) {
+        Topic *topicPtr = lookupTopic(topic);
+        if (!topicPtr) {
+            topicPtr = Topic::create(topic);
+            topics.insert(topicPtr);
+            topicsVersion++;
+            if (isWildcard(topic)) {
+                *wildcardSlot(topic) = topicPtr;
+                numWildcardTopics++;
+            }
         }
-        return it->second.get();
+        return topicPtr;
     }
 
     /* Subscribe fails if we already are subscribed */
@@ -164,18 +984,14 @@ public:
         checkIteratingSubscriber(s);
 
         /* Lookup or create new topic */
-        Topic *topicPtr = lookupTopic(topic);
-        if (!topicPtr) {
-            Topic *newTopic = new Topic(topic);
-            topics.insert({std::string_view(newTopic->name.data(), newTopic->name.length()), std::unique_ptr<Topic>(newTopic)});
-            topicPtr = newTopic;
-        }
+        Topic *topicPtr = lookupOrCreateTopic(topic);
 
         /* Insert us in topic, insert topic in us */
-        auto [it, inserted] = s->topics.insert(topicPtr);
-        if (!inserted) {
+        auto it = std::lower_bound(s->topics.begin(), s->topics.end(), topicPtr);
+        if (it != s->topics.end() && *it == topicPtr) {
             return nullptr;
         }
+        s->topics.insert(it, topicPtr);
         topicPtr->insert(s);
 
         /* Success */
@@ -195,9 +1011,11 @@ public:
         }
 
         /* Erase from our list first */
-        if (s->topics.erase(topicPtr) == 0) {
+        auto it = std::lower_bound(s->topics.begin(), s->topics.end(), topicPtr);
+        if (it == s->topics.end() || *it != topicPtr) {
             return {false, false, -1};
         }
+        s->topics.erase(it);
 
         /* Remove us from topic */
         topicPtr->erase(s);
@@ -206,14 +1024,66 @@ public:
 
         /* If there is no subscriber to this topic, remove it */
         if (!topicPtr->size()) {
-            /* Unique_ptr deletes the topic */
-            topics.erase(topic);
+            removeTopic(topicPtr);
         }
 
         /* If we don't hold any topics we are to be freed altogether */
         return {true, s->topics.size() == 0, newCount};
     }
 
+    /* Subscribes to many topics at once, merging them into our sorted list in one pass rather than one insert each.
+     * Returns the index in topicNames of every topic we were not already subscribed to, in order, and its topic */
+    std::vector<std::pair<size_t, Topic *>> subscribe(Subscriber *s, const std::string_view *topicNames, size_t numTopics) {
+        checkIteratingSubscriber(s);
+
+        std::vector<std::pair<size_t, Topic *>> subscribed;
+        subscribed.reserve(numTopics);
+        for (size_t i = 0; i < numTopics; i++) {
+            Topic *topicPtr = lookupOrCreateTopic(topicNames[i]);
+            /* We are in a topic if and only if it is in our list, which also skips duplicates of this batch */
+            if (topicPtr->insert(s)) {
+                subscribed.push_back({i, topicPtr});
+            }
+        }
+
+        size_t numOld = s->topics.size();
+        s->topics.reserve(numOld + subscribed.size());
+        for (auto [i, topicPtr] : subscribed) {
+            s->topics.push_back(topicPtr);
+        }
+        std::sort(s->topics.begin() + (ptrdiff_t) numOld, s->topics.end());
+        std::inplace_merge(s->topics.begin(), s->topics.begin() + (ptrdiff_t) numOld, s->topics.end());
+        return subscribed;
+    }
+
+    /* Unsubscribes from many topics at once, the same way. Returns the index in topicNames of every topic we were
+     * subscribed to, in order, and how many subscribers it has left */
+    std::vector<std::pair<size_t, int>> unsubscribe(Subscriber *s, const std::string_view *topicNames, size_t numTopics) {
+        checkIteratingSubscriber(s);
+
+        std::vector<std::pair<size_t, int>> unsubscribed;
+        std::vector<Topic *> removed;
+        for (size_t i = 0; i < numTopics; i++) {
+            Topic *topicPtr = lookupTopic(topicNames[i]);
+            if (topicPtr && topicPtr->erase(s)) {
+                unsubscribed.push_back({i, (int) topicPtr->size()});
+                removed.push_back(topicPtr);
+            }
+        }
+
+        /* Topics left without subscribers go only after, as later duplicates of this batch still look them up */
+        std::sort(removed.begin(), removed.end());
+        s->topics.erase(std::remove_if(s->topics.begin(), s->topics.end(), [&removed](Topic *topicPtr) {
+            return std::binary_search(removed.begin(), removed.end(), topicPtr);
+        }), s->topics.end());
+        for (Topic *topicPtr : removed) {
+            if (!topicPtr->size()) {
+                removeTopic(topicPtr);
+            }
+        }
+        return unsubscribed;
+    }
+
     /* Factory function for creating a Subscriber */
     Subscriber *createSubscriber() {
         return new Subscriber();
@@ -231,7 +1101,7 @@ public:
         for (Topic *topicPtr : s->topics) {
             /* If we are the last subscriber, simply remove the whole topic */
             if (topicPtr->size() == 1) {
-                topics.erase(topicPtr->name);
+                removeTopic(topicPtr);
             } else {
                 /* Otherwise just remove us */
                 topicPtr->erase(s);
@@ -283,30 +1153,47 @@ public:
     /* Big messages bypass all buffering and land directly in backpressure */
     template <typename F>
     bool publishBig(Subscriber *sender, std::string_view topic, B &&bigMessage, F cb) {
-        /* Do we even have this topic? */
-        auto it = topics.find(topic);
-        if (it == topics.end()) {
-            return false;
+        return publishBig(sender, &topic, 1, std::move(bigMessage), std::move(cb));
+    }
+
+    /* Same, for a message published to several topics at once, which reaches every subscriber of them once */
+    template <typename F>
+    bool publishBig(Subscriber *sender, const std::string_view *topicNames, size_t numTopics, B &&bigMessage, F cb) {
+        for (size_t i = 0; i < numTopics; i++) {
+            UWS_PROBE2(ws__publish, topicNames[i].data(), topicNames[i].length());
+
+            /* Prepared messages (TemplatedApp::publishPrepared) are not retained */
+            if constexpr (std::is_constructible_v<T, B &>) {
+                if (retentionRules.size()) {
+                    retain(topicNames[i], T(bigMessage));
+                }
+            }
         }
 
-        /* For all subscribers in topic */
-        for (Subscriber *s : *it->second) {
+        /* For all subscribers of matching topics, false if there are none */
+        return forEachSubscriber(topicNames, numTopics, [sender, &bigMessage, &cb](Subscriber *s) {
 
             /* If we are sender then ignore us */
             if (sender != s) {
                 cb(s, bigMessage);
             }
-        }
-
-        return true;
+        });
     }
 
     /* Linear in number of affected subscribers */
     bool publish(Subscriber *sender, std::string_view topic, T &&message) {
-        /* Do we even have this topic? */
-        auto it = topics.find(topic);
-        if (it == topics.end()) {
-            return false;
+        return publish(sender, &topic, 1, std::move(message));
+    }
+
+    /* Same, for a message published to several topics at once. It is stored once and reaches every subscriber of
+     * them once, no matter how many of them it subscribes to */
+    bool publish(Subscriber *sender, const std::string_view *topicNames, size_t numTopics, T &&message) {
+        for (size_t i = 0; i < numTopics; i++) {
+            UWS_PROBE2(ws__publish, topicNames[i].data(), topicNames[i].length());
+
+            if (retentionRules.size()) {
+                retain(topicNames[i], T(message));
+            }
         }
 
         /* If we have more than 65k messages we need to drain every socket. */
@@ -319,8 +1206,8 @@ public:
         /* If nobody references this message, don't buffer it */
         bool referencedMessage = false;
 
-        /* For all subscribers in topic */
-        for (Subscriber *s : *it->second) {
+        /* For all subscribers of matching topics */
+        forEachSubscriber(topicNames, numTopics, [this, sender, &referencedMessage](Subscriber *s) {
 
             /* If we are sender then ignore us */
             if (sender != s) {
@@ -328,16 +1215,8 @@ public:
                 /* At least one subscriber wants this message */
                 referencedMessage = true;
 
-                /* If we already have too many outgoing messages on this subscriber, drain it now */
-                if (s->numMessageIndices == 32) {
-                    /* This one does not need to check needsDrainage here but still does. */
-                    drain(s);
-                }
-
-                /* Finally we can continue */
-                s->messageIndices[s->numMessageIndices++] = (uint16_t)outgoingMessages.size();
                 /* First message adds subscriber to list of drainable subscribers */
-                if (s->numMessageIndices == 1) {
+                if (s->addMessage((uint32_t) outgoingMessages.size())) {
                     /* Insert us in the head of drainable subscribers */
                     s->next = drainableSubscribers;
                     s->prev = nullptr;
@@ -347,7 +1226,7 @@ public:
                     drainableSubscribers = s;
                 }
             }
-        }
+        });
 
         /* Push this message and return with success */
         if (referencedMessage) {
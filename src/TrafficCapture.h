@@ -0,0 +1,175 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_TRAFFICCAPTURE_H
+#define UWS_TRAFFICCAPTURE_H
+
+/* What clients send, as the loop reads it, for benchmarks to replay (see libEpollBenchmarker and
+ * benchmarks/replay.cpp). Built with UWS_WITH_CAPTURE (WITH_CAPTURE=1) and started with Loop::startCapture.
+ *
+ * A capture is the 8 bytes "uWScap01" followed by records of a type byte, the microseconds since the record before
+ * it, the connection and, for DATA, the length followed by the bytes read. Numbers are LEB128 varints. Connections
+ * are numbered from 0 as they open, only those opened while capturing are captured, TLS ones decrypted */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+#ifdef UWS_WITH_CAPTURE
+#define UWS_CAPTURE(loopData, call) do { if ((loopData)->capture) { (loopData)->capture->call; } } while (0)
+#else
+#define UWS_CAPTURE(loopData, call) ((void) 0)
+#endif
+
+namespace uWS {
+
+struct TrafficCapture {
+    static constexpr std::string_view MAGIC = "uWScap01";
+
+    enum Type : unsigned char {
+        OPEN,
+        DATA,
+        CLOSE
+    };
+
+    struct Record {
+        Type type;
+        /* Microseconds since the capture began */
+        uint64_t time;
+        uint64_t connection;
+        std::string_view data;
+    };
+
+private:
+    FILE *file;
+    /* Stops capturing past this many bytes, 0 for no limit */
+    uint64_t maxBytes;
+    uint64_t written = 0;
+    std::unordered_map<void *, uint64_t> connections;
+    uint64_t nextConnection = 0;
+    std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+    uint64_t lastTime = 0;
+
+    static char *writeVarint(char *out, uint64_t value) {
+        while (value >= 0x80) {
+            *out++ = (char) (value | 0x80);
+            value >>= 7;
+        }
+        *out++ = (char) value;
+        return out;
+    }
+
+    static bool readVarint(std::string_view &in, uint64_t &value) {
+        value = 0;
+        for (unsigned int shift = 0; shift < 64 && in.length(); shift += 7) {
+            unsigned char byte = (unsigned char) in[0];
+            in.remove_prefix(1);
+            value |= (uint64_t) (byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void write(Type type, uint64_t connection, std::string_view data = {}) {
+        if (maxBytes && written >= maxBytes) {
+            return;
+        }
+        uint64_t time = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - began).count();
+        char header[31] = {(char) type};
+        char *end = writeVarint(writeVarint(header + 1, time - lastTime), connection);
+        if (type == DATA) {
+            end = writeVarint(end, data.length());
+        }
+        lastTime = time;
+        fwrite(header, 1, (size_t) (end - header), file);
+        fwrite(data.data(), 1, data.length(), file);
+        written += (uint64_t) (end - header) + data.length();
+    }
+
+    TrafficCapture(FILE *file, uint64_t maxBytes) : file(file), maxBytes(maxBytes) {
+        fwrite(MAGIC.data(), 1, MAGIC.length(), file);
+    }
+
+public:
+    /* Returns nullptr if path cannot be written */
+    static TrafficCapture *create(const char *path, uint64_t maxBytes = 0) {
+        FILE *file = fopen(path, "wb");
+        return file ? new TrafficCapture(file, maxBytes) : nullptr;
+    }
+
+    ~TrafficCapture() {
+        fclose(file);
+    }
+
+    void open(void *socket) {
+        if (maxBytes && written >= maxBytes) {
+            return;
+        }
+        connections[socket] = nextConnection;
+        write(OPEN, nextConnection++);
+    }
+
+    void data(void *socket, const char *data, int length) {
+        if (auto it = connections.find(socket); it != connections.end()) {
+            write(DATA, it->second, {data, (size_t) length});
+        }
+    }
+
+    void close(void *socket) {
+        if (auto it = connections.find(socket); it != connections.end()) {
+            write(CLOSE, it->second);
+            connections.erase(it);
+        }
+    }
+
+    /* Adopting a socket into another context, as upgrading to WebSocket does, may move it */
+    void move(void *from, void *to) {
+        if (auto it = connections.find(from); it != connections.end()) {
+            uint64_t connection = it->second;
+            connections.erase(it);
+            connections[to] = connection;
+        }
+    }
+
+    /* Takes the next record off the front of capture (past MAGIC) into record, which holds the one before it (or
+     * zeros). False at the end, or if cut short */
+    static bool read(std::string_view &capture, Record &record) {
+        if (capture.empty() || (unsigned char) capture[0] > CLOSE) {
+            return false;
+        }
+        record.type = (Type) capture[0];
+        capture.remove_prefix(1);
+
+        uint64_t delta, length = 0;
+        if (!readVarint(capture, delta) || !readVarint(capture, record.connection) || (record.type == DATA && !readVarint(capture, length)) || length > capture.length()) {
+            return false;
+        }
+        record.time += delta;
+        record.data = capture.substr(0, length);
+        capture.remove_prefix(length);
+        return true;
+    }
+};
+
+}
+
+#endif // UWS_TRAFFICCAPTURE_H
@@ -21,10 +21,38 @@
 /* Various common utilities */
 
 #include <cstdint>
+#ifdef _MSC_VER
+#include <cstdlib>
+#endif
 
 namespace uWS {
 namespace utils {
 
+/* Network byte order to host byte order and back. One instruction on little-endian systems, nothing on big-endian */
+template <typename T>
+inline T cond_byte_swap(T value) {
+    static_assert(sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8, "Only 16, 32 and 64 bit values swap");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return value;
+#elif defined(_MSC_VER)
+    if constexpr (sizeof(T) == 2) {
+        return (T) _byteswap_ushort((unsigned short) value);
+    } else if constexpr (sizeof(T) == 4) {
+        return (T) _byteswap_ulong((unsigned long) value);
+    } else {
+        return (T) _byteswap_uint64((unsigned long long) value);
+    }
+#else
+    if constexpr (sizeof(T) == 2) {
+        return (T) __builtin_bswap16((uint16_t) value);
+    } else if constexpr (sizeof(T) == 4) {
+        return (T) __builtin_bswap32((uint32_t) value);
+    } else {
+        return (T) __builtin_bswap64((uint64_t) value);
+    }
+#endif
+}
+
 inline int u32toaHex(uint32_t value, char *dst) {
     char palette[] = "0123456789abcdef";
     char temp[10];
@@ -22,6 +22,9 @@
 #include "WebSocketProtocol.h"
 #include "AsyncSocket.h"
 #include "WebSocketContextData.h"
+#include "CompressionPool.h"
+#include "Coroutine.h"
+#include "Probes.h"
 
 #include <string_view>
 
@@ -37,12 +40,14 @@ enum CompressFlags : int {
 template <bool SSL, bool isServer, typename USERDATA>
 struct WebSocket : AsyncSocket<SSL> {
     template <bool> friend struct TemplatedApp;
+    template <bool, typename> friend struct TemplatedClientApp;
     template <bool> friend struct HttpResponse;
+    template <bool, bool, typename> friend struct WebSocketContext;
 private:
     typedef AsyncSocket<SSL> Super;
 
-    void *init(bool perMessageDeflate, CompressOptions compressOptions, BackPressure &&backpressure) {
-        new (us_socket_ext(SSL, (us_socket_t *) this)) WebSocketData(perMessageDeflate, compressOptions, std::move(backpressure));
+    void *init(bool perMessageDeflate, CompressOptions compressOptions, BackPressure &&backpressure, bool dictionary = false) {
+        new (us_socket_ext(SSL, (us_socket_t *) this)) WebSocketData(perMessageDeflate, compressOptions, std::move(backpressure), dictionary);
         return this;
     }
 public:
@@ -54,6 +59,12 @@ public:
         return (USERDATA *) (webSocketData + 1);
     }
 
+    /* Memory for the temporaries of the message being handled, given back all at once when its handler returns */
+    RequestArena *arena() {
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) this);
+        return &webSocketData->getExtension()->messageArena;
+    }
+
     /* See AsyncSocket */
     using Super::getBufferedAmount;
     using Super::getRemoteAddress;
@@ -108,17 +119,33 @@ public:
         return send({preparedMessage.originalMessage.data(), preparedMessage.originalMessage.length()}, (OpCode) preparedMessage.opCode);
     }
 
-    /* Send or buffer a WebSocket frame, compressed or not. Returns BACKPRESSURE on increased user space backpressure,
-     * DROPPED on dropped message (due to backpressure) or SUCCCESS if you are free to send even more now. */
-    SendStatus send(std::string_view message, OpCode opCode = OpCode::BINARY, int compress = false, bool fin = true) {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
-            (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
-        );
+private:
+    /* Sends reset the idle timeout once per iteration, or right away when waiting for a pong */
+    void resetIdleTimeout(WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData) {
+        WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+        unsigned int iteration = Super::getLoopData()->iteration;
+        /* Alive after all, and our iteration is kept where our place among the pending pings was */
+        if (webSocketData->pingPending) {
+            webSocketContextData->unqueuePing(webSocketData);
+        }
+        if (webSocketData->idleTimeoutIteration != iteration || webSocketData->hasTimedOut) {
+            Super::timeout(webSocketContextData->idleTimeoutComponents.first);
+            webSocketData->idleTimeoutIteration = iteration;
+            webSocketData->hasTimedOut = false;
+        }
+    }
+
+    /* Returns true if we are over maxBackpressure, or the loop over its backpressure budget, in which case the message is dropped */
+    bool dropIfOverBackpressureLimit(WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData, std::string_view message, OpCode opCode, bool published = false) {
+        bool overLimit = webSocketContextData->maxBackpressure && webSocketContextData->maxBackpressure < getBufferedAmount();
+        if (overLimit || (getBufferedAmount() && dropIfOverBackpressureBudget(published))) {
+            if (overLimit) {
+                UWS_METRIC(Super::getLoopData(), droppedMessages, 1);
+                UWS_PROBE2(backpressure__limit, this, getBufferedAmount());
+            }
 
-        /* Skip sending and report success if we are over the limit of maxBackpressure */
-        if (webSocketContextData->maxBackpressure && webSocketContextData->maxBackpressure < getBufferedAmount()) {
             /* Also defer a close if we should */
-            if (webSocketContextData->closeOnBackpressureLimit) {
+            if (overLimit && webSocketContextData->closeOnBackpressureLimit) {
                 us_socket_shutdown_read(SSL, (us_socket_t *) this);
             }
 
@@ -127,72 +154,443 @@ public:
                 webSocketContextData->droppedHandler(this, message, opCode);
             }
 
-            return DROPPED;
+            return true;
         }
+        return false;
+    }
 
-        /* If we are subscribers and have messages to drain we need to drain them here to stay synced */
+    /* Sheds what the policies of a loop over its backpressure budget say we should, we already holding some */
+    bool dropIfOverBackpressureBudget(bool published) {
+        LoopData *loopData = Super::getLoopData();
+        if (!loopData->backpressurePolicies || !loopData->overBackpressureBudget()) {
+            return false;
+        }
+
+        /* The largest holders go first, which are those over several times the average */
+        if (loopData->backpressurePolicies & CLOSE_LARGEST) {
+            size_t average = BackPressurePool::get().held / std::max<size_t>(loopData->numSockets.load(std::memory_order_relaxed), 1);
+            if (getBufferedAmount() > 4 * average) {
+                UWS_METRIC(loopData, budgetClosedSockets, 1);
+                /* The deferred close needs us reading */
+                if (Super::forgetPausedReads()) {
+                    Super::resumePausedReads(this);
+                }
+                us_socket_shutdown_read(SSL, (us_socket_t *) this);
+                return true;
+            }
+        }
+
+        if (published && (loopData->backpressurePolicies & DROP_PUBLISHES)) {
+            UWS_METRIC(loopData, budgetDroppedMessages, 1);
+            return true;
+        }
+        return false;
+    }
+
+    /* Hands message to a worker for compression, holding back everything sent after it until it is done */
+    void sendCompressedAsync(WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData, std::string_view message, OpCode opCode) {
         WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+        if (!webSocketData->getAsyncSendQueue()) {
+            webSocketData->getExtension()->asyncSendQueue = new AsyncSendQueue(this);
+        }
+        AsyncSendQueue *asyncSendQueue = webSocketData->getAsyncSendQueue();
 
-        /* Special path for long sends of non-compressed, non-SSL messages */
-        if (message.length() >= 16 * 1024 && !compress && !SSL && !webSocketData->subscriber && getBufferedAmount() == 0 && Super::getLoopData()->corkOffset == 0) {
-            char header[10];
-            int header_length = (int) protocol::formatMessage<isServer>(header, "", 0, opCode, message.length(), compress, fin);
-            int written = us_socket_write2(0, (struct us_socket_t *)this, header, header_length, message.data(), (int) message.length());
-        
-            if (written != header_length + (int) message.length()) {
-                /* Buffer up backpressure */
-                if (written > header_length) {
-                    webSocketData->buffer.append(message.data() + written - header_length, message.length() - (size_t) (written - header_length));
+        /* Whatever our sliding window holds, the peer's will also hold this message, so it must go */
+        if (DeflationStream *deflationStream = webSocketData->getDeflationStream()) {
+            deflationStream->reset();
+        } else if (webSocketData->getDeflationLease()) {
+            webSocketContextData->deflationStreamPool->release(webSocketData, webSocketData->getDeflationLease());
+        }
+
+        /* A send made while flushing was at the front of the queue and so goes back there */
+        AsyncSendQueue::Entry entry = {{}, opCode, CompressFlags::ALREADY_COMPRESSED, true, true};
+        if (asyncSendQueue->flushing) {
+            asyncSendQueue->entries.emplace_front(std::move(entry));
+        } else {
+            asyncSendQueue->entries.emplace_back(std::move(entry));
+        }
+        AsyncSendQueue::Entry *queued = asyncSendQueue->flushing ? &asyncSendQueue->entries.front() : &asyncSendQueue->entries.back();
+        asyncSendQueue->jobs++;
+
+        Loop *loop = (Loop *) us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) this));
+        CompressionPool::get().post([loop, asyncSendQueue, queued, raw = std::string(message), level = webSocketContextData->compressionLevel](ZlibContext *zlibContext, DeflationStream *deflationStream) mutable {
+            deflationStream->setLevel(level);
+            std::string compressed(deflationStream->deflate(zlibContext, raw, true));
+
+            loop->defer([asyncSendQueue, queued, compressed = std::move(compressed)]() mutable {
+                asyncSendQueue->jobs--;
+                if (!asyncSendQueue->socket) {
+                    if (!asyncSendQueue->jobs) {
+                        delete asyncSendQueue;
+                    }
+                    return;
+                }
+
+                queued->message = std::move(compressed);
+                queued->compressing = false;
+                ((WebSocket *) asyncSendQueue->socket)->flushAsyncSends();
+            });
+        });
+    }
+
+    /* Sends everything up to the next message still compressing */
+    void flushAsyncSends() {
+        WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+        AsyncSendQueue *asyncSendQueue = webSocketData->getAsyncSendQueue();
+
+        asyncSendQueue->flushing = true;
+        while (asyncSendQueue->entries.size() && !asyncSendQueue->entries.front().compressing) {
+            AsyncSendQueue::Entry entry = std::move(asyncSendQueue->entries.front());
+            asyncSendQueue->entries.pop_front();
+            send(entry.message, entry.opCode, entry.compress, entry.fin);
+        }
+        asyncSendQueue->flushing = false;
+
+        /* A close frame we held back was the last thing to go, end() left the FIN to us */
+        if (asyncSendQueue->entries.empty() && webSocketData->isShuttingDown && !getBufferedAmount() && !this->isCorked()) {
+            this->shutdown();
+        }
+    }
+
+    /* With batchSends, what we send while another socket holds the cork (such as replies fanned out from its
+     * message handler) is left in our backpressure and drained at the end of the iteration, rather than
+     * taking one syscall per send. The backpressure is made of pooled chunks, so this is the same as corking us */
+    bool deferSend(WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData) {
+        if (!webSocketContextData->batchSends || Super::canCork() || Super::isCorked()) {
+            return false;
+        }
+
+        WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+        if (!webSocketData->sendsDeferred) {
+            webSocketData->sendsDeferred = true;
+            Super::getLoopData()->deferredFlushes.push_back({this, [](void *s) {
+                ((WebSocket *) s)->flushDeferredSends();
+            }});
+        }
+        return true;
+    }
+
+    /* Whatever we cannot drain now is left to the writable handler like any other backpressure */
+    void flushDeferredSends() {
+        WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+        webSocketData->sendsDeferred = false;
+
+        Super::write(nullptr, 0);
+
+        /* A close frame was deferred with the rest, end() left the FIN to us */
+        if (webSocketData->isShuttingDown && !getBufferedAmount() && !us_socket_is_shut_down(SSL, (us_socket_t *) this)) {
+            bool asyncSendsPending = webSocketData->getAsyncSendQueue() && webSocketData->getAsyncSendQueue()->entries.size();
+            if (!asyncSendsPending) {
+                Super::shutdown();
+            }
+        } else if (!webSocketData->isShuttingDown && !getBufferedAmount()) {
+            /* Drained without ever becoming writable */
+            webSocketData->resumeDrainedAwaiter(true);
+        }
+    }
+
+public:
+    /* Sends a published message (TopicTreeMessage or TopicTreeBigMessage), framing it only once for every subscriber.
+     * Whatever the socket cannot take right away is referenced by its backpressure, not copied. Only used
+     * from within pub/sub drainage, which is why this does not drain the subscriber like send does. */
+    template <typename MESSAGE>
+    SendStatus sendShared(MESSAGE &message) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
+            (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
+        );
+        WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+
+        /* Sends held back behind compression on a worker have to wait their turn as copies,
+         * and clients mask every frame with a key of its own so there is nothing to share */
+        if (!isServer || (webSocketData->getAsyncSendQueue() && webSocketData->getAsyncSendQueue()->holdsBack())) {
+            return send(message.message, (OpCode) message.opCode, message.compress);
+        }
+
+#ifdef UWS_NO_ZLIB
+        bool compress = false;
+#else
+        /* Same compress hint correction as in send */
+        bool compress = message.compress && message.message.length() && message.opCode < 3 && webSocketData->compressionStatus == WebSocketData::ENABLED;
+#endif
+
+        /* Dedicated compressors have their own sliding window, so there is nothing to share */
+        if (compress && webSocketData->hasDedicatedCompressor()) {
+            return send(message.message, (OpCode) message.opCode, true);
+        }
+
+        if (dropIfOverBackpressureLimit(webSocketContextData, message.message, (OpCode) message.opCode, true)) {
+            return DROPPED;
+        }
+
+        /* The first subscriber frames it, plain or compressed with the shared compressor */
+        SharedFrame *&frame = message.frames[compress];
+        if (!frame) {
+            UWS_PHASE(Super::getLoopData(), formatCycles);
+            std::string_view payload = message.message;
+            bool compressed = false;
+            if (compress) {
+                LoopData *loopData = Super::getLoopData();
+                CompressionStats *topicStats = (message.topicStats && message.topicsVersion == webSocketContextData->topicTree->getTopicsVersion()) ? message.topicStats : nullptr;
+                if ((topicStats && !topicStats->shouldCompress()) || !CompressionStats::looksCompressible(payload)) {
+                    UWS_METRIC(loopData, deflationsSkipped, 1);
                 } else {
-                    webSocketData->buffer.append(header + written, (size_t) header_length - (size_t) written);
-                    webSocketData->buffer.append(message.data(), message.length());
+                    UWS_METRIC(loopData, deflations, 1);
+                    UWS_METRIC_TIMED(loopData, deflateNanoseconds);
+                    UWS_PHASE(loopData, compressCycles);
+                    loopData->deflationStream->setLevel(webSocketContextData->compressionLevel);
+                    std::string_view deflated = loopData->deflationStream->deflate(loopData->zlibContext, payload, true);
+                    if (topicStats) {
+                        topicStats->report(payload.length(), deflated.length());
+                    }
+                    /* The shared compressor starts over for every message, so what did not shrink can go as it was */
+                    if (deflated.length() < payload.length()) {
+                        payload = deflated;
+                        compressed = true;
+                    }
                 }
-                /* We cannot still be corked if we have backpressure.
-                 * We also cannot uncork normally since it will re-write the already buffered
-                 * up backpressure again. */
-                Super::uncorkWithoutSending();
-                return BACKPRESSURE;
             }
+            frame = SharedFrame::create(protocol::messageFrameSize<isServer>(payload.length()));
+            frame->length = protocol::formatMessage<isServer>(frame->data(), payload.data(), payload.length(), (OpCode) message.opCode, payload.length(), compressed, true);
+        }
+
+        bool written = true;
+        if (deferSend(webSocketContextData)) {
+            Super::getAsyncSocketData()->buffer.appendShared(frame, 0);
         } else {
+            written = Super::writeShared(frame);
+        }
+
+        /* Whatever we hold ends with a whole message now, see sendAhead */
+        Super::getAsyncSocketData()->buffer.markBoundary();
+        if (!written) {
+            return BACKPRESSURE;
+        }
+
+        /* Every successful send resets the timeout */
+        if (webSocketContextData->resetIdleTimeoutOnSend) {
+            resetIdleTimeout(webSocketContextData);
+        }
+
+        return SUCCESS;
+    }
+
+    /* Send or buffer a WebSocket frame, compressed or not. Returns BACKPRESSURE on increased user space backpressure,
+     * DROPPED on dropped message (due to backpressure) or SUCCCESS if you are free to send even more now.
+     * A whole message sent with priority goes ahead of the messages waiting in backpressure, uncompressed,
+     * like pings and pongs always do */
+    SendStatus send(std::string_view message, OpCode opCode = OpCode::BINARY, int compress = false, bool fin = true, bool priority = false) {
+        return internalSend(message, opCode, compress, fin, nullptr, priority);
+    }
+
+    /* Same as above, but whatever of a long message the socket does not take right away is moved into
+     * its backpressure instead of copied */
+    template <typename STRING, typename = std::enable_if_t<std::is_same_v<STRING, std::string>>>
+    SendStatus send(STRING &&message, OpCode opCode = OpCode::BINARY, int compress = false, bool fin = true) {
+        if (!isServer || compress || message.length() < SCATTER_THRESHOLD) {
+            return internalSend(message, opCode, compress, fin, nullptr);
+        }
+        return send(SharedBuffer(std::move(message)), opCode, compress, fin);
+    }
+
+    /* Same as above, for a buffer sent to many sockets. Backpressure references it instead of copying it */
+    SendStatus send(const SharedBuffer &message, OpCode opCode = OpCode::BINARY, int compress = false, bool fin = true) {
+        return internalSend(message.view(), opCode, compress, fin, message.getFrame());
+    }
+
+    /* Sends message uncompressed with descriptor fd attached to its frame (see AsyncSocket::writeWithDescriptor), for
+     * peers on the same host over a Unix socket, such as a memfd holding a payload too large to copy. fd stays yours.
+     * DROPPED, with nothing sent, unless the frame can go first (nothing waiting in backpressure nor corked) */
+    SendStatus sendWithDescriptor(int fd, std::string_view message, OpCode opCode = OpCode::BINARY) {
+        if (((WebSocketData *) Super::getAsyncSocketData())->isShuttingDown) {
+            return DROPPED;
+        }
+
+        std::string frame(protocol::messageFrameSize<isServer>(message.length()), '\0');
+        size_t frameLength = protocol::formatMessage<isServer>(frame.data(), message.data(), message.length(), opCode, message.length(), false, true);
+        if (!Super::writeWithDescriptor(frame.data(), (int) frameLength, fd)) {
+            return DROPPED;
+        }
+        if (getBufferedAmount()) {
+            Super::getAsyncSocketData()->buffer.markBoundary();
+            return BACKPRESSURE;
+        }
+        return SUCCESS;
+    }
+
+private:
+    /* Messages at least this long are written straight from where they are, behind their header */
+    static constexpr size_t SCATTER_THRESHOLD = 16 * 1024;
+
+    /* Puts a whole uncompressed frame in our backpressure at the first message boundary not yet sent, ahead of the
+     * messages after it, so that pings and pongs do not wait for megabytes of them. Returns false if we know no
+     * such boundary, for the frame to be sent like any other. Boundaries are marked after whole messages only,
+     * never inside fragmented ones, and only the last of every chunk is known */
+    bool sendAhead(std::string_view message, OpCode opCode) {
+        BackPressure &buffer = Super::getAsyncSocketData()->buffer;
+        if (!buffer.length()) {
+            return false;
+        }
+
+        char *frame = buffer.insertUninitialized(protocol::messageFrameSize<isServer>(message.length()));
+        if (!frame) {
+            return false;
+        }
+        protocol::formatMessage<isServer>(frame, message.data(), message.length(), opCode, message.length(), false, true);
+        return true;
+    }
+
+    SendStatus internalSend(std::string_view message, OpCode opCode, int compress, bool fin, SharedFrame *frame, bool priority = false) {
+        SendStatus sendStatus = writeMessage(message, opCode, compress, fin, frame, priority);
+
+        /* Whatever we hold ends with a whole message now, unless that was a close frame, after which nothing goes,
+         * or the message ended in the cork buffer */
+        if (fin && opCode < OpCode::CLOSE && !(Super::isCorked() && Super::getLoopData()->corkOffset)) {
+            Super::getAsyncSocketData()->buffer.markBoundary();
+        }
+        return sendStatus;
+    }
+
+    /* Message lies within frame, if given, for backpressure to reference */
+    SendStatus writeMessage(std::string_view message, OpCode opCode, int compress, bool fin, SharedFrame *frame, bool priority) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
+            (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
+        );
+
+        /* Skip sending and report success if we are over the limit of maxBackpressure */
+        if (dropIfOverBackpressureLimit(webSocketContextData, message, opCode)) {
+            return DROPPED;
+        }
+        UWS_PHASE(Super::getLoopData(), formatCycles);
+
+        /* Pings, pongs and priority messages skip the line, if there is one */
+        if (((priority && fin) || opCode == OpCode::PING || opCode == OpCode::PONG) && sendAhead(message, opCode)) {
+            if (webSocketContextData->resetIdleTimeoutOnSend) {
+                resetIdleTimeout(webSocketContextData);
+            }
+            return BACKPRESSURE;
+        }
+
+        /* If we are subscribers and have messages to drain we need to drain them here to stay synced */
+        WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
 
+#ifndef UWS_NO_ZLIB
+        /* Behind a message compressing on a worker, we wait our turn (in order with published messages) */
+        if (webSocketData->getAsyncSendQueue() && webSocketData->getAsyncSendQueue()->holdsBack()) {
+#ifndef UWS_NO_PUBSUB
             if (webSocketData->subscriber) {
-                /* This will call back into us, send. */
                 webSocketContextData->topicTree->drain(webSocketData->subscriber);
             }
+#endif
+            webSocketData->getAsyncSendQueue()->entries.push_back({std::string(message), opCode, compress, fin, false});
+            return SUCCESS;
+        }
+#endif
 
-            /* Transform the message to compressed domain if requested */
-            if (compress) {
-                WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
-
-                /* Check and correct the compress hint. It is never valid to compress 0 bytes */
-                if (message.length() && opCode < 3 && webSocketData->compressionStatus == WebSocketData::ENABLED) {
-                    /* If compress is 2 (IS_PRE_COMPRESSED), skip this step (experimental) */
-                    if (compress != CompressFlags::ALREADY_COMPRESSED) {
-                        LoopData *loopData = Super::getLoopData();
-                        /* Compress using either shared or dedicated deflationStream */
-                        if (webSocketData->deflationStream) {
-                            message = webSocketData->deflationStream->deflate(loopData->zlibContext, message, false);
-                        } else {
-                            message = loopData->deflationStream->deflate(loopData->zlibContext, message, true);
+#ifndef UWS_NO_PUBSUB
+        /* Not while flushing held back sends, whatever was published since goes after them */
+        if (webSocketData->subscriber && !(webSocketData->getAsyncSendQueue() && webSocketData->getAsyncSendQueue()->flushing)) {
+            /* This will call back into us, send. */
+            webSocketContextData->topicTree->drain(webSocketData->subscriber);
+        }
+#endif
+
+#ifdef UWS_NO_ZLIB
+        /* Compression is never negotiated, so nothing goes out compressed */
+        compress = false;
+#else
+        /* Transform the message to compressed domain if requested */
+        if (compress) {
+            WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
+
+            /* Check and correct the compress hint. It is never valid to compress 0 bytes */
+            if (message.length() && opCode < 3 && webSocketData->compressionStatus == WebSocketData::ENABLED) {
+                /* Whole messages unlikely to shrink go as they are, fragments as the message they are part of */
+                bool wholeMessage = fin && opCode != OpCode::CONTINUATION;
+                if (compress != CompressFlags::ALREADY_COMPRESSED && wholeMessage && !(webSocketData->compressionStats.shouldCompress() && CompressionStats::looksCompressible(message))) {
+                    UWS_METRIC(Super::getLoopData(), deflationsSkipped, 1);
+                    compress = false;
+                }
+
+                /* If compress is 2 (IS_PRE_COMPRESSED), skip this step (experimental) */
+                if (compress && compress != CompressFlags::ALREADY_COMPRESSED) {
+                    /* Big enough to stall the loop, so leave it to a worker */
+                    if (webSocketContextData->asyncCompressionThreshold && message.length() >= webSocketContextData->asyncCompressionThreshold && fin) {
+                        sendCompressedAsync(webSocketContextData, message, opCode);
+                        return SUCCESS;
+                    }
+
+                    LoopData *loopData = Super::getLoopData();
+                    UWS_METRIC(loopData, deflations, 1);
+                    UWS_METRIC_TIMED(loopData, deflateNanoseconds);
+                    UWS_PHASE(loopData, compressCycles);
+                    std::string_view original = message;
+                    /* Compress using either shared or dedicated deflationStream. Only those starting over for every
+                     * message can send what did not shrink as it was, sliding windows already hold it */
+                    bool startsOver = false;
+                    if (webSocketData->hasDedicatedCompressor()) {
+                        DeflationStream *deflationStream = webSocketData->makeDeflationStream(webSocketContextData->getDictionary(webSocketData), webSocketContextData->compressionLevel);
+                        webSocketContextData->touchCompressor(webSocketData->extension);
+                        message = deflationStream->deflate(loopData->zlibContext, message, false);
+                    } else if (webSocketData->pooledCompression) {
+                        DeflationStream *deflationStream = webSocketContextData->deflationStreamPool->acquire(webSocketData, webSocketData->getDeflationLease());
+                        message = deflationStream->deflate(loopData->zlibContext, message, false);
+                    } else if (webSocketData->compressionDictionary) {
+                        message = webSocketContextData->dictionaryDeflationStream->deflate(loopData->zlibContext, message, true);
+                        startsOver = true;
+                    } else {
+                        loopData->deflationStream->setLevel(webSocketContextData->compressionLevel);
+                        message = loopData->deflationStream->deflate(loopData->zlibContext, message, true);
+                        startsOver = true;
+                    }
+
+                    if (wholeMessage) {
+                        webSocketData->compressionStats.report(original.length(), message.length());
+                        if (startsOver && message.length() >= original.length()) {
+                            message = original;
+                            compress = false;
                         }
                     }
-                } else {
-                    compress = false;
                 }
+            } else {
+                compress = false;
             }
+        }
 
-            /* Get size, allocate size, write if needed */
-            size_t messageFrameSize = protocol::messageFrameSize(message.length());
+        /* A deflated message is not where it was */
+        if (compress && compress != CompressFlags::ALREADY_COMPRESSED) {
+            frame = nullptr;
+        }
+#endif
+
+        /* Long messages that do not fit what is left of the cork buffer go out behind their header straight from
+         * where they are (clients have to mask them in a copy) */
+        LoopData *loopData = Super::getLoopData();
+        size_t messageFrameSize = protocol::messageFrameSize<isServer>(message.length());
+        if (isServer && message.length() >= SCATTER_THRESHOLD && messageFrameSize >= loopData->corkBufferSize - loopData->corkOffset) {
+            if (Super::isCorked() || Super::canCork()) {
+                loopData->corkOverflow(loopData->corkOffset + messageFrameSize);
+            }
+            char header[10];
+            int headerLength = (int) protocol::formatMessage<isServer>(header, "", 0, opCode, message.length(), compress, fin);
+            auto [written, failed] = Super::writeScattered(header, headerLength, message.data(), (int) message.length(), false, frame);
+            if (failed) {
+                return BACKPRESSURE;
+            }
+        } else {
+            /* Allocate size, write if needed */
             auto [sendBuffer, sendBufferAttribute] = Super::getSendBuffer(messageFrameSize);
             protocol::formatMessage<isServer>(sendBuffer, message.data(), message.length(), opCode, message.length(), compress, fin);
 
             /* Depending on size of message we have different paths */
             if (sendBufferAttribute == SendBufferAttribute::NEEDS_DRAIN) {
-                /* This is a drain */
-                auto[written, failed] = Super::write(nullptr, 0);
-                if (failed) {
-                    /* Return false for failure, skipping to reset the timeout below */
-                    return BACKPRESSURE;
+                /* Already in our backpressure, which might as well wait for the end of the iteration */
+                if (!deferSend(webSocketContextData)) {
+                    /* This is a drain */
+                    auto[written, failed] = Super::write(nullptr, 0);
+                    if (failed) {
+                        /* Return false for failure, skipping to reset the timeout below */
+                        return BACKPRESSURE;
+                    }
                 }
             } else if (sendBufferAttribute == SendBufferAttribute::NEEDS_UNCORK) {
                 /* Uncork if we came here uncorked */
@@ -201,20 +599,18 @@ public:
                     return BACKPRESSURE;
                 }
             }
-
         }
 
         /* Every successful send resets the timeout */
         if (webSocketContextData->resetIdleTimeoutOnSend) {
-            Super::timeout(webSocketContextData->idleTimeoutComponents.first);
-            WebSocketData *webSocketData = (WebSocketData *) Super::getAsyncSocketData();
-            webSocketData->hasTimedOut = false;
+            resetIdleTimeout(webSocketContextData);
         }
 
         /* Return success */
         return SUCCESS;
     }
 
+public:
     /* Send websocket close frame, emit close event, send FIN if successful.
      * Will not append a close reason if code is 0 or 1005. */
     void end(int code = 0, std::string_view message = {}) {
@@ -234,8 +630,8 @@ public:
         size_t closePayloadLength = protocol::formatClosePayload(closePayload, (uint16_t) code, message.data(), length);
         bool ok = send(std::string_view(closePayload, closePayloadLength), OpCode::CLOSE);
 
-        /* FIN if we are ok and not corked */
-        if (!this->isCorked()) {
+        /* FIN if we are ok and not corked, or leave it to whoever sends the close frame we held back */
+        if (!this->isCorked() && !(webSocketData->getAsyncSendQueue() && webSocketData->getAsyncSendQueue()->entries.size())) {
             if (ok) {
                 /* If we are not corked, and we just sent off everything, we need to FIN right here.
                  * In all other cases, we need to fin either if uncork was successful, or when drainage is complete. */
@@ -243,7 +639,7 @@ public:
             }
         }
 
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
             (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
         );
 
@@ -251,15 +647,20 @@ public:
         Super::timeout(webSocketContextData->idleTimeoutComponents.second);
 
         /* At this point we iterate all currently held subscriptions and emit an event for all of them */
-        if (webSocketData->subscriber && webSocketContextData->subscriptionHandler) {
+        if (webSocketData->subscriber && webSocketContextData->hasSubscriptionHandler()) {
+            std::vector<WebSocketSubscription> subscriptions;
+            subscriptions.reserve(webSocketData->subscriber->topics.size());
             for (Topic *t : webSocketData->subscriber->topics) {
-                webSocketContextData->subscriptionHandler(this, t->name, (int) t->size() - 1, (int) t->size());
+                subscriptions.push_back({t->name, (int) t->size() - 1, (int) t->size()});
             }
+            webSocketContextData->emitSubscriptions(this, subscriptions);
         }
 
-        /* Make sure to unsubscribe from any pub/sub node at exit */
-        webSocketContextData->topicTree->freeSubscriber(webSocketData->subscriber);
-        webSocketData->subscriber = nullptr;
+        /* Make sure to unsubscribe from any pub/sub node at exit (clients have no TopicTree) */
+        if (webSocketData->subscriber) {
+            webSocketContextData->topicTree->freeSubscriber(webSocketData->subscriber);
+            webSocketData->subscriber = nullptr;
+        }
 
         /* Emit close event */
         if (webSocketContextData->closeHandler) {
@@ -268,8 +669,27 @@ public:
         ((USERDATA *) this->getUserData())->~USERDATA();
     }
 
+    /* Runs work() on a worker thread, then then(ws, result) corked on this loop, unless we closed in the meantime */
+    template <typename WORK, typename THEN>
+    void offload(WORK &&work, THEN &&then) {
+        WebSocketDataExtension *extension = ((WebSocketData *) us_socket_ext(SSL, (us_socket_t *) this))->getExtension();
+        if (!extension->offloadGuard) {
+            extension->offloadGuard = new OffloadGuard;
+        }
+
+        ((Loop *) us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) this)))->offload(std::forward<WORK>(work),
+            [ws = this, guard = extension->offloadGuard->retain(), then = std::forward<THEN>(then)](auto &&... result) mutable {
+            if (guard->alive) {
+                ws->cork([&]() {
+                    then(ws, std::move(result)...);
+                });
+            }
+            guard->release();
+        });
+    }
+
     /* Corks the response if possible. Leaves already corked socket be. */
-    void cork(MoveOnlyFunction<void()> &&handler) {
+    void cork(MoveOnlyFunction<void(), CALLBACK_INLINE_SIZE> &&handler) {
         if (!Super::isCorked() && Super::canCork()) {
             Super::cork();
             handler();
@@ -285,12 +705,50 @@ public:
         }
     }
 
-    /* Subscribe to a topic according to MQTT rules and syntax. Returns success */
+#ifdef UWS_HAS_COROUTINES
+    /* Awaits all backpressure being written, returning true, or the socket closing, returning false.
+     * One coroutine at a time may await this per socket. Closed sockets must not be touched */
+    struct DrainedAwaiter {
+        WebSocket *ws;
+        bool drained = true;
+        std::coroutine_handle<> handle = nullptr;
+
+        bool await_ready() {
+            return !ws->getBufferedAmount();
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            handle = h;
+            WebSocketData *webSocketData = (WebSocketData *) ws->getAsyncSocketData();
+            webSocketData->getExtension()->drainedAwaiter = this;
+            webSocketData->getExtension()->resumeDrained = [](void *awaiter, bool drained) {
+                ((DrainedAwaiter *) awaiter)->drained = drained;
+                ((DrainedAwaiter *) awaiter)->handle.resume();
+            };
+        }
+
+        bool await_resume() {
+            return drained;
+        }
+    };
+
+    DrainedAwaiter drained() {
+        return {this};
+    }
+#endif
+
+#ifndef UWS_NO_PUBSUB
+    /* Subscribe to a topic according to MQTT rules and syntax, "+" matches one level and a trailing "#" any number of levels. Returns success */
     bool subscribe(std::string_view topic, bool = false) {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
             (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
         );
 
+        /* Clients of ClientApp have no pub/sub */
+        if (!webSocketContextData->topicTree) {
+            return false;
+        }
+
         /* Make us a subscriber if we aren't yet */
         WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) this);
         if (!webSocketData->subscriber) {
@@ -300,9 +758,25 @@ public:
 
         /* Cannot return numSubscribers as this is only for this particular websocket context */
         Topic *topicOrNull = webSocketContextData->topicTree->subscribe(webSocketData->subscriber, topic);
-        if (topicOrNull && webSocketContextData->subscriptionHandler) {
+        if (topicOrNull && webSocketContextData->hasSubscriptionHandler()) {
             /* Emit this socket, the topic, new count, old count */
-            webSocketContextData->subscriptionHandler(this, topic, (int) topicOrNull->size(), (int) topicOrNull->size() - 1);
+            WebSocketSubscription subscription = {topic, (int) topicOrNull->size(), (int) topicOrNull->size() - 1};
+            webSocketContextData->emitSubscriptions(this, {&subscription, 1});
+        }
+
+        /* What the topic retained goes out before anything live can, in one corked write */
+        if (topicOrNull && !us_socket_is_closed(SSL, (us_socket_t *) this)) {
+            bool needsUncork = false;
+            webSocketContextData->topicTree->forEachRetained(topic, [this, &needsUncork](TopicTreeMessage &message) {
+                if (!needsUncork && this->canCork() && !this->isCorked()) {
+                    Super::cork();
+                    needsUncork = true;
+                }
+                sendShared(message);
+            });
+            if (needsUncork) {
+                Super::uncork();
+            }
         }
 
         /* Subscribe always succeeds */
@@ -311,7 +785,7 @@ public:
 
     /* Unsubscribe from a topic, returns true if we were subscribed. */
     bool unsubscribe(std::string_view topic, bool = false) {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
             (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
         );
 
@@ -322,8 +796,9 @@ public:
         /* Cannot return numSubscribers as this is only for this particular websocket context */
         auto [ok, last, newCount] = webSocketContextData->topicTree->unsubscribe(webSocketData->subscriber, topic);
         /* Emit subscription event if last */
-        if (ok && webSocketContextData->subscriptionHandler) {
-            webSocketContextData->subscriptionHandler(this, topic, newCount, newCount + 1);
+        if (ok && webSocketContextData->hasSubscriptionHandler()) {
+            WebSocketSubscription subscription = {topic, newCount, newCount + 1};
+            webSocketContextData->emitSubscriptions(this, {&subscription, 1});
         }
 
         /* Leave us as subscribers even if we subscribe to nothing (last unsubscribed topic might miss its message otherwise) */
@@ -331,9 +806,80 @@ public:
         return ok;
     }
 
+    /* Subscribes to many topics at once, such as right after connecting. Cheaper than subscribing to them one by one,
+     * and the subscriptions handler gets all of them in one call. Returns how many we were not subscribed to yet */
+    size_t subscribe(std::span<const std::string_view> topics) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
+            (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
+        );
+
+        if (!webSocketContextData->topicTree || topics.empty()) {
+            return 0;
+        }
+
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) this);
+        if (!webSocketData->subscriber) {
+            webSocketData->subscriber = webSocketContextData->topicTree->createSubscriber();
+            webSocketData->subscriber->user = this;
+        }
+
+        auto subscribed = webSocketContextData->topicTree->subscribe(webSocketData->subscriber, topics.data(), topics.size());
+        if (webSocketContextData->hasSubscriptionHandler()) {
+            std::vector<WebSocketSubscription> subscriptions;
+            subscriptions.reserve(subscribed.size());
+            for (auto [i, topicPtr] : subscribed) {
+                subscriptions.push_back({topics[i], (int) topicPtr->size(), (int) topicPtr->size() - 1});
+            }
+            webSocketContextData->emitSubscriptions(this, subscriptions);
+        }
+
+        /* Same as above, with everything retained by any of them in one corked write */
+        if (subscribed.size() && !us_socket_is_closed(SSL, (us_socket_t *) this)) {
+            bool needsUncork = false;
+            for (auto [i, topicPtr] : subscribed) {
+                webSocketContextData->topicTree->forEachRetained(topics[i], [this, &needsUncork](TopicTreeMessage &message) {
+                    if (!needsUncork && this->canCork() && !this->isCorked()) {
+                        Super::cork();
+                        needsUncork = true;
+                    }
+                    sendShared(message);
+                });
+            }
+            if (needsUncork) {
+                Super::uncork();
+            }
+        }
+
+        return subscribed.size();
+    }
+
+    /* Unsubscribes from many topics at once, the same way. Returns how many we were subscribed to */
+    size_t unsubscribe(std::span<const std::string_view> topics) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
+            (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
+        );
+
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) this);
+        if (!webSocketData->subscriber) {
+            return 0;
+        }
+
+        auto unsubscribed = webSocketContextData->topicTree->unsubscribe(webSocketData->subscriber, topics.data(), topics.size());
+        if (webSocketContextData->hasSubscriptionHandler()) {
+            std::vector<WebSocketSubscription> subscriptions;
+            subscriptions.reserve(unsubscribed.size());
+            for (auto [i, newCount] : unsubscribed) {
+                subscriptions.push_back({topics[i], newCount, newCount + 1});
+            }
+            webSocketContextData->emitSubscriptions(this, subscriptions);
+        }
+
+        return unsubscribed.size();
+    }
+
     /* Returns whether this socket is subscribed to the specified topic */
     bool isSubscribed(std::string_view topic) {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
             (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
         );
 
@@ -355,7 +901,7 @@ public:
      * inside the callback ONLY IF not modifying the topic passed to the callback.
      * Topic names are valid only for the duration of the callback. */
     void iterateTopics(MoveOnlyFunction<void(std::string_view)> cb) {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
             (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
         );
 
@@ -377,7 +923,7 @@ public:
      * We, the WebSocket, must be subscribed to the topic itself and if so - no message will be sent to ourselves.
      * Use App::publish for an unconditional publish that simply publishes to whomever might be subscribed. */
     bool publish(std::string_view topic, std::string_view message, OpCode opCode = OpCode::TEXT, bool compress = false) {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL,
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL,
             (us_socket_context_t *) us_socket_context(SSL, (us_socket_t *) this)
         );
 
@@ -389,16 +935,27 @@ public:
         }
 
         /* Publish as sender, does not receive its own messages even if subscribed to relevant topics */
-        if (message.length() >= LoopData::CORK_BUFFER_SIZE) {
-            return webSocketContextData->topicTree->publishBig(webSocketData->subscriber, topic, {message, opCode, compress}, [](Subscriber *s, TopicTreeBigMessage &message) {
+        LoopData *loopData = Super::getLoopData();
+        auto *topicTree = webSocketContextData->topicTree;
+        CompressionStats *topicStats = compress ? topicTree->getCompressionStats(topic) : nullptr;
+        if (message.length() >= loopData->corkBufferSize) {
+            loopData->corkOverflow(message.length());
+            TopicTreeBigMessage bigMessage(message, opCode, compress);
+            bigMessage.topicStats = topicStats;
+            bigMessage.topicsVersion = topicTree->getTopicsVersion();
+            return topicTree->publishBig(webSocketData->subscriber, topic, std::move(bigMessage), [](Subscriber *s, TopicTreeBigMessage &message) {
                 auto *ws = (WebSocket<SSL, true, int> *) s->user;
 
-                ws->send(message.message, (OpCode)message.opCode, message.compress);
+                ws->sendShared(message);
             });
         } else {
-            return webSocketContextData->topicTree->publish(webSocketData->subscriber, topic, {std::string(message), opCode, compress});
+            TopicTreeMessage topicTreeMessage(std::string(message), opCode, compress, topicTree->getConflatedTopic(topic));
+            topicTreeMessage.topicStats = topicStats;
+            topicTreeMessage.topicsVersion = topicTree->getTopicsVersion();
+            return topicTree->publish(webSocketData->subscriber, topic, std::move(topicTreeMessage));
         }
     }
+#endif
 };
 
 }
@@ -22,12 +22,28 @@
 #include "WebSocketProtocol.h"
 #include "WebSocketData.h"
 #include "WebSocket.h"
+#include "Probes.h"
+#include "Handoff.h"
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 namespace uWS {
 
 template <bool SSL, bool isServer, typename USERDATA>
 struct WebSocketContext {
+    /* Like HttpParser, we consume in place, spilling headers in front of the data and unmasking past its end */
+    static_assert(LIBUS_RECV_BUFFER_PADDING >= WebSocketProtocol<isServer, WebSocketContext>::CONSUME_PRE_PADDING
+        && LIBUS_RECV_BUFFER_PADDING >= WebSocketProtocol<isServer, WebSocketContext>::CONSUME_POST_PADDING, "uSockets must pad receive buffers for WebSocketProtocol");
+
     template <bool> friend struct TemplatedApp;
+    template <bool, typename> friend struct TemplatedClientApp;
     template <bool, typename> friend struct WebSocketProtocol;
 private:
     WebSocketContext() = delete;
@@ -36,8 +52,8 @@ private:
         return (us_socket_context_t *) this;
     }
 
-    WebSocketContextData<SSL, USERDATA> *getExt() {
-        return (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, (us_socket_context_t *) this);
+    WebSocketContextData<SSL, USERDATA, isServer> *getExt() {
+        return (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, (us_socket_context_t *) this);
     }
 
     /* If we have negotiated compression, set this frame compressed */
@@ -53,31 +69,185 @@ private:
     }
 
     static void forceClose(WebSocketState<isServer> */*wState*/, void *s, std::string_view reason = {}) {
+        /* What came before the error is not lost */
+        deliverMessages(s);
         us_socket_close(SSL, (us_socket_t *) s, (int) reason.length(), (void *) reason.data());
     }
 
+    /* Hands a whole message to messageHandler, or holds it for messagesHandler, copying it unless it points into
+     * the read. Returns true if we closed or shut down */
+    static bool emitMessage(std::string_view message, int opCode, bool inRead, void *s) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) s);
+
+        UWS_PROBE3(ws__message, s, message.length(), opCode);
+        if (webSocketContextData->messagesHandler) {
+            if (!inRead) {
+                message = webSocketContextData->pendingMessageCopies.emplace_back(message);
+            }
+            webSocketContextData->pendingMessages.push_back({message, (OpCode) opCode});
+        } else if (webSocketContextData->messageHandler) {
+            {
+                UWS_PHASE(((AsyncSocket<SSL> *) s)->getLoopData(), handlerCycles);
+                webSocketContextData->messageHandler((WebSocket<SSL, isServer, USERDATA> *) s, message, (OpCode) opCode);
+            }
+            if (us_socket_is_closed(SSL, (us_socket_t *) s)) {
+                return true;
+            }
+            webSocketData->resetMessageArena();
+            return webSocketData->isShuttingDown;
+        }
+        return false;
+    }
+
+    /* Hands every message held so far to messagesHandler at once, before anything else is handled and at the end
+     * of the read (unless closed by then). Returns true if we closed or shut down */
+    static bool deliverMessages(void *s) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+        if (webSocketContextData->pendingMessages.empty()) {
+            return false;
+        }
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) s);
+
+        if (!us_socket_is_closed(SSL, (us_socket_t *) s)) {
+            {
+                UWS_PHASE(((AsyncSocket<SSL> *) s)->getLoopData(), handlerCycles);
+                webSocketContextData->messagesHandler((WebSocket<SSL, isServer, USERDATA> *) s, webSocketContextData->pendingMessages);
+            }
+            if (!us_socket_is_closed(SSL, (us_socket_t *) s)) {
+                webSocketData->resetMessageArena();
+            }
+        }
+        webSocketContextData->pendingMessages.clear();
+        webSocketContextData->pendingMessageCopies.clear();
+        return us_socket_is_closed(SSL, (us_socket_t *) s) || webSocketData->isShuttingDown;
+    }
+
+    /* With messageChunk, data messages are handed over piece by piece as they are unmasked (or inflated), so that
+     * nothing is ever reassembled. Returns true on breakage */
+    static bool handleMessageChunk(char *data, size_t length, unsigned int remainingBytes, int opCode, bool fin, WebSocketState<isServer> *webSocketState, void *s) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) s);
+        bool last = !remainingBytes && fin;
+        bool broke = false;
+
+        auto emit = [&](std::string_view chunk, bool lastChunk) {
+            /* Text is validated piece by piece, holding back any code point split between pieces */
+            if (opCode == 1) {
+                unsigned char tail[3];
+                unsigned char tailLength = 0;
+                if (webSocketData->extension) {
+                    tailLength = webSocketData->extension->utf8TailLength;
+                    memcpy(tail, webSocketData->extension->utf8Tail, tailLength);
+                }
+                if (!protocol::isValidUtf8Chunk((unsigned char *) chunk.data(), chunk.length(), tail, tailLength, lastChunk)) {
+                    forceClose(webSocketState, s, ERR_INVALID_TEXT);
+                    return broke = true;
+                }
+                if (tailLength || webSocketData->extension) {
+                    memcpy(webSocketData->getExtension()->utf8Tail, tail, tailLength);
+                    webSocketData->extension->utf8TailLength = tailLength;
+                }
+            }
+
+            if (lastChunk) {
+                UWS_PROBE3(ws__message, s, chunk.length(), opCode);
+            }
+            {
+                UWS_PHASE(((AsyncSocket<SSL> *) s)->getLoopData(), handlerCycles);
+                webSocketContextData->messageChunkHandler((WebSocket<SSL, isServer, USERDATA> *) s, chunk, (OpCode) opCode, lastChunk);
+            }
+            if (us_socket_is_closed(SSL, (us_socket_t *) s)) {
+                return broke = true;
+            }
+            if (lastChunk) {
+                webSocketData->resetMessageArena();
+            }
+            return broke = webSocketData->isShuttingDown;
+        };
+
+        if (webSocketData->compressionStatus == WebSocketData::CompressionStatus::COMPRESSED_FRAME) {
+            LoopData *loopData = (LoopData *) us_loop_ext(us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) s)));
+
+            /* A dedicated decompressor keeps its window, a shared one can only take whole messages */
+            InflationStream *inflationStream = webSocketData->getInflationStream(webSocketContextData->getDictionary(webSocketData));
+            bool reset = false;
+            if (!inflationStream) {
+                if (webSocketData->extension && webSocketData->extension->messageInflationStream) {
+                    inflationStream = webSocketData->extension->messageInflationStream;
+                } else if (last) {
+                    inflationStream = webSocketData->compressionDictionary ? webSocketContextData->dictionaryInflationStream : loopData->inflationStream;
+                    reset = true;
+                } else {
+                    inflationStream = webSocketData->getExtension()->messageInflationStream = new InflationStream(CompressOptions::DEDICATED_DECOMPRESSOR, webSocketContextData->getDictionary(webSocketData));
+                }
+            }
+
+            if (last) {
+                webSocketData->compressionStatus = WebSocketData::CompressionStatus::ENABLED;
+                UWS_METRIC(loopData, inflations, 1);
+            }
+
+            bool ok = inflationStream->inflateChunks(loopData->zlibContext, {data, length}, last, reset, [&](std::string_view inflated, bool final) {
+                /* Only the end of the last part ends the message, empty pieces before it say nothing */
+                if (!inflated.length() && !(final && last)) {
+                    return false;
+                }
+                return emit(inflated, final && last);
+            });
+
+            if (last && webSocketData->extension && webSocketData->extension->messageInflationStream) {
+                delete webSocketData->extension->messageInflationStream;
+                webSocketData->extension->messageInflationStream = nullptr;
+            }
+
+            if (!ok && !broke) {
+                forceClose(webSocketState, s, ERR_TOO_BIG_MESSAGE_INFLATION);
+                return true;
+            }
+            return broke;
+        }
+
+        if (length || last) {
+            emit({data, length}, last);
+        }
+        return broke;
+    }
+
     /* Returns true on breakage */
     static bool handleFragment(char *data, size_t length, unsigned int remainingBytes, int opCode, bool fin, WebSocketState<isServer> *webSocketState, void *s) {
         /* WebSocketData and WebSocketContextData */
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
         WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) s);
 
         /* Is this a non-control frame? */
         if (opCode < 3) {
+            /* Streamed, not reassembled */
+            if (webSocketContextData->messageChunkHandler) {
+                return handleMessageChunk(data, length, remainingBytes, opCode, fin, webSocketState, s);
+            }
+
             /* Did we get everything in one go? */
-            if (!remainingBytes && fin && !webSocketData->fragmentBuffer.length()) {
+            if (!remainingBytes && fin && !webSocketData->hasFragmentBuffer()) {
 
                 /* Handle compressed frame */
-                if (webSocketData->compressionStatus == WebSocketData::CompressionStatus::COMPRESSED_FRAME) {
+                bool inflated = webSocketData->compressionStatus == WebSocketData::CompressionStatus::COMPRESSED_FRAME;
+                if (inflated) {
                         webSocketData->compressionStatus = WebSocketData::CompressionStatus::ENABLED;
 
                         LoopData *loopData = (LoopData *) us_loop_ext(us_socket_context_loop(SSL, us_socket_context(SSL, (us_socket_t *) s)));
                         /* Decompress using shared or dedicated decompressor */
                         std::optional<std::string_view> inflatedFrame;
-                        if (webSocketData->inflationStream) {
-                            inflatedFrame = webSocketData->inflationStream->inflate(loopData->zlibContext, {data, length}, webSocketContextData->maxPayloadLength, false);
-                        } else {
-                            inflatedFrame = loopData->inflationStream->inflate(loopData->zlibContext, {data, length}, webSocketContextData->maxPayloadLength, true);
+                        UWS_METRIC(loopData, inflations, 1);
+                        {
+                            UWS_METRIC_TIMED(loopData, inflateNanoseconds);
+                            UWS_PHASE(loopData, compressCycles);
+                            if (InflationStream *inflationStream = webSocketData->getInflationStream(webSocketContextData->getDictionary(webSocketData))) {
+                                inflatedFrame = inflationStream->inflate(loopData->zlibContext, {data, length}, webSocketContextData->maxPayloadLength, false);
+                            } else {
+                                InflationStream *sharedInflationStream = webSocketData->compressionDictionary ? webSocketContextData->dictionaryInflationStream : loopData->inflationStream;
+                                inflatedFrame = sharedInflationStream->inflate(loopData->zlibContext, {data, length}, webSocketContextData->maxPayloadLength, true);
+                            }
                         }
 
                         if (!inflatedFrame.has_value()) {
@@ -96,23 +266,22 @@ private:
                 }
 
                 /* Emit message event & break if we are closed or shut down when returning */
-                if (webSocketContextData->messageHandler) {
-                    webSocketContextData->messageHandler((WebSocket<SSL, isServer, USERDATA> *) s, std::string_view(data, length), (OpCode) opCode);
-                    if (us_socket_is_closed(SSL, (us_socket_t *) s) || webSocketData->isShuttingDown) {
-                        return true;
-                    }
+                if (emitMessage(std::string_view(data, length), opCode, !inflated, s)) {
+                    return true;
                 }
             } else {
+                std::string &fragmentBuffer = webSocketData->getFragmentBuffer();
+
                 /* Allocate fragment buffer up front first time */
-                if (!webSocketData->fragmentBuffer.length()) {
-                    webSocketData->fragmentBuffer.reserve(length + remainingBytes);
+                if (!fragmentBuffer.length()) {
+                    fragmentBuffer.reserve(length + remainingBytes);
                 }
                 /* Fragments forming a big message are not caught until appending them */
-                if (refusePayloadLength(length + webSocketData->fragmentBuffer.length(), webSocketState, s)) {
+                if (refusePayloadLength(length + fragmentBuffer.length(), webSocketState, s)) {
                     forceClose(webSocketState, s, ERR_TOO_BIG_MESSAGE);
                     return true;
                 }
-                webSocketData->fragmentBuffer.append(data, length);
+                fragmentBuffer.append(data, length);
 
                 /* Are we done now? */
                 // todo: what if we don't have any remaining bytes yet we are not fin? forceclose!
@@ -123,7 +292,7 @@ private:
                             webSocketData->compressionStatus = WebSocketData::CompressionStatus::ENABLED;
 
                             /* 9 bytes of padding for libdeflate, 4 for zlib */
-                            webSocketData->fragmentBuffer.append("123456789");
+                            fragmentBuffer.append("123456789");
 
                             LoopData *loopData = (LoopData *) us_loop_ext(
                                 us_socket_context_loop(SSL,
@@ -133,10 +302,16 @@ private:
 
                             /* Decompress using shared or dedicated decompressor */
                             std::optional<std::string_view> inflatedFrame;
-                            if (webSocketData->inflationStream) {
-                                inflatedFrame = webSocketData->inflationStream->inflate(loopData->zlibContext, {webSocketData->fragmentBuffer.data(), webSocketData->fragmentBuffer.length() - 9}, webSocketContextData->maxPayloadLength, false);
-                            } else {
-                                inflatedFrame = loopData->inflationStream->inflate(loopData->zlibContext, {webSocketData->fragmentBuffer.data(), webSocketData->fragmentBuffer.length() - 9}, webSocketContextData->maxPayloadLength, true);
+                            UWS_METRIC(loopData, inflations, 1);
+                            {
+                                UWS_METRIC_TIMED(loopData, inflateNanoseconds);
+                                UWS_PHASE(loopData, compressCycles);
+                                if (InflationStream *inflationStream = webSocketData->getInflationStream(webSocketContextData->getDictionary(webSocketData))) {
+                                    inflatedFrame = inflationStream->inflate(loopData->zlibContext, {fragmentBuffer.data(), fragmentBuffer.length() - 9}, webSocketContextData->maxPayloadLength, false);
+                                } else {
+                                    InflationStream *sharedInflationStream = webSocketData->compressionDictionary ? webSocketContextData->dictionaryInflationStream : loopData->inflationStream;
+                                    inflatedFrame = sharedInflationStream->inflate(loopData->zlibContext, {fragmentBuffer.data(), fragmentBuffer.length() - 9}, webSocketContextData->maxPayloadLength, true);
+                                }
                             }
 
                             if (!inflatedFrame.has_value()) {
@@ -150,8 +325,8 @@ private:
 
                     } else {
                         // reset length and data ptrs
-                        length = webSocketData->fragmentBuffer.length();
-                        data = webSocketData->fragmentBuffer.data();
+                        length = fragmentBuffer.length();
+                        data = fragmentBuffer.data();
                     }
 
                     /* Check text messages for Utf-8 validity */
@@ -161,19 +336,19 @@ private:
                     }
 
                     /* Emit message and check for shutdown or close */
-                    if (webSocketContextData->messageHandler) {
-                        webSocketContextData->messageHandler((WebSocket<SSL, isServer, USERDATA> *) s, std::string_view(data, length), (OpCode) opCode);
-                        if (us_socket_is_closed(SSL, (us_socket_t *) s) || webSocketData->isShuttingDown) {
-                            return true;
-                        }
+                    if (emitMessage(std::string_view(data, length), opCode, false, s)) {
+                        return true;
                     }
 
                     /* If we shutdown or closed, this will be taken care of elsewhere */
-                    webSocketData->fragmentBuffer.clear();
+                    fragmentBuffer.clear();
                 }
             }
         } else {
-            /* Control frames need the websocket to send pings, pongs and close */
+            /* Control frames need the websocket to send pings, pongs and close, after the messages before them */
+            if (deliverMessages(s)) {
+                return true;
+            }
             WebSocket<SSL, isServer, USERDATA> *webSocket = (WebSocket<SSL, isServer, USERDATA> *) s;
 
             if (!remainingBytes && fin && !webSocketData->controlTipLength) {
@@ -191,7 +366,7 @@ private:
                             }
                         }
                     } else if (opCode == PONG) {
-                        if (webSocketContextData->pongHandler) {
+                        if (emitsPong(webSocketContextData, webSocketData, length)) {
                             webSocketContextData->pongHandler(webSocket, {data, length});
                             if (us_socket_is_closed(SSL, (us_socket_t *) s) || webSocketData->isShuttingDown) {
                                 return true;
@@ -201,11 +376,12 @@ private:
                 }
             } else {
                 /* Here we never mind any size optimizations as we are in the worst possible path */
-                webSocketData->fragmentBuffer.append(data, length);
-                webSocketData->controlTipLength += (unsigned int) length;
+                std::string &fragmentBuffer = webSocketData->getFragmentBuffer();
+                fragmentBuffer.append(data, length);
+                webSocketData->controlTipLength = (unsigned char) (webSocketData->controlTipLength + length);
 
                 if (!remainingBytes && fin) {
-                    char *controlBuffer = (char *) webSocketData->fragmentBuffer.data() + webSocketData->fragmentBuffer.length() - webSocketData->controlTipLength;
+                    char *controlBuffer = (char *) fragmentBuffer.data() + fragmentBuffer.length() - webSocketData->controlTipLength;
                     if (opCode == CLOSE) {
                         protocol::CloseFrame closeFrame = protocol::parseClosePayload(controlBuffer, webSocketData->controlTipLength);
                         webSocket->end(closeFrame.code, std::string_view(closeFrame.message, closeFrame.length));
@@ -220,7 +396,7 @@ private:
                                 }
                             }
                         } else if (opCode == PONG) {
-                            if (webSocketContextData->pongHandler) {
+                            if (emitsPong(webSocketContextData, webSocketData, webSocketData->controlTipLength)) {
                                 webSocketContextData->pongHandler(webSocket, std::string_view(controlBuffer, webSocketData->controlTipLength));
                                 if (us_socket_is_closed(SSL, (us_socket_t *) s) || webSocketData->isShuttingDown) {
                                     return true;
@@ -230,7 +406,7 @@ private:
                     }
 
                     /* Same here, we do not care for any particular smart allocation scheme */
-                    webSocketData->fragmentBuffer.resize((unsigned int) webSocketData->fragmentBuffer.length() - webSocketData->controlTipLength);
+                    fragmentBuffer.resize((unsigned int) fragmentBuffer.length() - webSocketData->controlTipLength);
                     webSocketData->controlTipLength = 0;
                 }
             }
@@ -238,36 +414,500 @@ private:
         return false;
     }
 
+    /* Pongs (empty) answering our automatic pings only keep us alive, as all data does, unless asked for */
+    static bool emitsPong(WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData, WebSocketData *webSocketData, size_t length) {
+        bool automatic = webSocketData->awaitingPong && !length;
+        if (automatic) {
+            webSocketData->awaitingPong = false;
+        }
+        return webSocketContextData->pongHandler && (!automatic || webSocketContextData->emitAutomaticPongs);
+    }
+
+    /* Timed out sockets wait for their automatic ping in pendingPings, a slice of them is pinged every PING_SLICE_MS */
+    static void sendPendingPings(void *user) {
+        auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) user;
+        std::vector<void *> &pendingPings = webSocketContextData->pendingPings;
+
+        size_t slice = (pendingPings.size() + webSocketContextData->pingSlicesLeft - 1) / webSocketContextData->pingSlicesLeft;
+        for (; slice && pendingPings.size(); slice--) {
+            auto *ws = (WebSocket<SSL, isServer, USERDATA> *) pendingPings.back();
+            WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) ws);
+            webSocketContextData->unqueuePing(webSocketData);
+
+            /* Anything since it timed out kept it alive */
+            if (!webSocketData->hasTimedOut || webSocketData->isShuttingDown) {
+                continue;
+            }
+
+            us_socket_timeout(SSL, (us_socket_t *) ws, webSocketContextData->idleTimeoutComponents.second);
+            webSocketData->awaitingPong = true;
+            /* Send ping without being corked, ahead of what backpressure we can */
+            if (!ws->sendAhead({}, OpCode::PING)) {
+                ((AsyncSocket<SSL> *) ws)->write("\x89\x00", 2);
+            }
+        }
+
+        if (webSocketContextData->pingSlicesLeft > 1) {
+            webSocketContextData->pingSlicesLeft--;
+        }
+        if (pendingPings.size()) {
+            Loop::get()->armTimer(&webSocketContextData->pingTimer, WebSocketContextData<SSL, USERDATA, isServer>::PING_SLICE_MS);
+        }
+    }
+
     static bool refusePayloadLength(uint64_t length, WebSocketState<isServer> */*wState*/, void *s) {
-        auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+        auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
 
         /* Return true for refuse, false for accept */
         return webSocketContextData->maxPayloadLength < length;
     }
 
+    /* Data of a WebSocket, also what a client got right behind the 101 response of its handshake */
+    static us_socket_t *handleData(us_socket_t *s, char *data, int length) {
+
+        /* We need the websocket data */
+        WebSocketData *webSocketData = (WebSocketData *) (us_socket_ext(SSL, s));
+
+        UWS_METRIC(((AsyncSocket<SSL> *) s)->getLoopData(), readSyscalls, 1);
+        UWS_METRIC(((AsyncSocket<SSL> *) s)->getLoopData(), bytesRead, length);
+        ((AsyncSocket<SSL> *) s)->getLoopData()->dataRead = true;
+
+        /* When in websocket shutdown mode, we do not care for ANY message, whether responding close frame or not.
+         * We only care for the TCP FIN really, not emitting any message after closing is key */
+        if (webSocketData->isShuttingDown) {
+            return s;
+        }
+
+        auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+        auto *asyncSocket = (AsyncSocket<SSL> *) s;
+
+        /* Every time we get data and not in shutdown state we simply reset the timeout */
+        asyncSocket->timeout(webSocketContextData->idleTimeoutComponents.first);
+        webSocketData->hasTimedOut = false;
+
+        /* We always cork on data */
+        asyncSocket->cork();
+
+        /* This parser has virtually no overhead. WebSocketData holds the larger state of servers, clients use its beginning */
+        {
+            UWS_PHASE(asyncSocket->getLoopData(), parseCycles);
+            WebSocketProtocol<isServer, WebSocketContext<SSL, isServer, USERDATA>>::consume(data, (unsigned int) length, (WebSocketState<isServer> *) (WebSocketState<true> *) webSocketData, s);
+            deliverMessages(s);
+        }
+
+        /* Uncorking a closed socekt is fine, in fact it is needed */
+        asyncSocket->uncork();
+
+        /* If uncorking was successful and we are in shutdown state then send TCP FIN */
+        if (asyncSocket->getBufferedAmount() == 0) {
+            /* We can now be in shutdown state */
+            if (webSocketData->isShuttingDown) {
+                /* Shutting down a closed socket is handled by uSockets and just fine */
+                asyncSocket->shutdown();
+            }
+        }
+
+        /* Closed sockets are forgotten by now, so they must not be remembered below */
+        if (us_socket_is_closed(SSL, (us_socket_t *) s)) {
+            return s;
+        }
+
+        /* The sockets that keep a loop busy are those worth moving when it has to shed some */
+        LoopData *loopData = asyncSocket->getLoopData();
+        if (auto move = loopData->handoffChannel != -1 ? webSocketContextData->handOff : webSocketContextData->migrate;
+            move && loopData->migrationCandidates.size() < loopData->migrationsWanted) {
+            loopData->migrationCandidates.push_back({s, move});
+        }
+
+        /* No more messages while the loop holds too much backpressure */
+        asyncSocket->pauseReadsOverBudget();
+
+        return s;
+    }
+
+    /* Everything a server WebSocket is, on its way from one loop to another */
+    struct MigratingSocket {
+        LIBUS_SOCKET_DESCRIPTOR fd;
+        /* Backpressure chunks belong to the pool of their loop, so it goes as one copy */
+        std::string backpressure;
+        WebSocketState<true> state;
+        WebSocketDataExtension *extension;
+        unsigned char controlTipLength;
+        typename WebSocketData::CompressionStatus compressionStatus;
+        bool pooledCompression;
+        bool compressionDictionary;
+        std::vector<std::string> topics;
+        USERDATA userData;
+    };
+
+    /* Takes a plain TCP server socket apart, closing it here but not its connection. Not from within its own
+     * handlers (corked), nor while it has a worker or a coroutine busy with it, then nullptr and s is left be */
+    static MigratingSocket *detach(us_socket_t *s) {
+#ifndef _WIN32
+        if constexpr (!SSL && isServer) {
+            auto *ws = (WebSocket<SSL, isServer, USERDATA> *) s;
+            WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, s);
+            auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, s));
+
+            auto leaving = [&]() {
+                return !us_socket_is_closed(SSL, s) && !webSocketData->isShuttingDown && !ws->isCorked();
+            };
+            if (!leaving()) {
+                return nullptr;
+            }
+            if (WebSocketDataExtension *extension = webSocketData->extension) {
+                if (extension->drainedAwaiter || (extension->offloadGuard && extension->offloadGuard->refs > 1)
+                    || (extension->asyncSendQueue && (extension->asyncSendQueue->jobs || extension->asyncSendQueue->entries.size()))) {
+                    return nullptr;
+                }
+            }
+
+            /* Messages published to us so far go out from here, then we leave every topic (as if closed) */
+            if (webSocketData->subscriber) {
+                webSocketContextData->topicTree->drain();
+                if (!leaving()) {
+                    return nullptr;
+                }
+            }
+            std::vector<std::string> topics;
+            if (webSocketData->subscriber) {
+                std::vector<WebSocketSubscription> subscriptions;
+                for (Topic *t : webSocketData->subscriber->topics) {
+                    topics.emplace_back(t->name);
+                    subscriptions.push_back({t->name, (int) t->size() - 1, (int) t->size()});
+                }
+                webSocketContextData->emitSubscriptions(ws, subscriptions);
+                webSocketContextData->topicTree->freeSubscriber(webSocketData->subscriber);
+                webSocketData->subscriber = nullptr;
+            }
+
+            if (webSocketContextData->leaveHandler) {
+                webSocketContextData->leaveHandler(ws);
+            }
+            if (!leaving()) {
+                return nullptr;
+            }
+
+            /* Closing our descriptor leaves the connection open on this one */
+            LIBUS_SOCKET_DESCRIPTOR fd = dup((int) (intptr_t) us_socket_get_native_handle(SSL, s));
+            if (fd == -1) {
+                /* Left every topic already, so this is as good as closed */
+                ws->end(1011, "could not migrate");
+                return nullptr;
+            }
+
+            MigratingSocket *migratingSocket = new MigratingSocket{fd, {}, *(WebSocketState<true> *) webSocketData, webSocketData->extension,
+                webSocketData->controlTipLength, webSocketData->compressionStatus, webSocketData->pooledCompression,
+                webSocketData->compressionDictionary, std::move(topics), std::move(*ws->getUserData())};
+            ws->getUserData()->~USERDATA();
+
+            while (webSocketData->buffer.length()) {
+                std::string_view front = webSocketData->buffer.front();
+                migratingSocket->backpressure.append(front);
+                webSocketData->buffer.erase(front.length());
+            }
+
+            /* What is tied to this loop stays with it */
+            if (WebSocketDataExtension *extension = webSocketData->extension) {
+                /* Any pooled sliding window goes back, the peer copes with us starting over (not the other way around) */
+                if (extension->deflationLease) {
+                    webSocketContextData->deflationStreamPool->release(webSocketData, extension->deflationLease);
+                }
+                /* As is the place of a dedicated one in the list of compressors that may be freed */
+                webSocketContextData->forgetCompressor(extension);
+                extension->messageArena.reset();
+                OffloadGuard::invalidate(extension->offloadGuard);
+                delete extension->asyncSendQueue;
+                extension->asyncSendQueue = nullptr;
+                webSocketData->extension = nullptr;
+            }
+
+            /* Shutting down skips the close handler */
+            webSocketData->isShuttingDown = true;
+            us_socket_close(SSL, s, 0, nullptr);
+            return migratingSocket;
+        }
+#endif
+        (void) s;
+        return nullptr;
+    }
+
+    /* Puts a socket taken apart by detach (on another loop, by a context of the same route) back together here */
+    WebSocket<SSL, isServer, USERDATA> *attach(MigratingSocket *migratingSocket) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = getExt();
+
+        auto *ws = (WebSocket<SSL, isServer, USERDATA> *) us_adopt_accepted_socket(SSL, getSocketContext(), migratingSocket->fd,
+            sizeof(WebSocketData) + sizeof(USERDATA), nullptr, 0);
+        if (!ws) {
+            delete migratingSocket;
+            return nullptr;
+        }
+
+        BackPressure backpressure;
+        if (migratingSocket->backpressure.length()) {
+            backpressure.append(migratingSocket->backpressure.data(), migratingSocket->backpressure.length());
+        }
+        ws->init(false, CompressOptions::DISABLED, std::move(backpressure));
+
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) ws);
+        *(WebSocketState<true> *) webSocketData = migratingSocket->state;
+        webSocketData->extension = migratingSocket->extension;
+        webSocketData->controlTipLength = migratingSocket->controlTipLength;
+        webSocketData->compressionStatus = migratingSocket->compressionStatus;
+        webSocketData->pooledCompression = migratingSocket->pooledCompression;
+        webSocketData->compressionDictionary = migratingSocket->compressionDictionary;
+
+#if !defined(UWS_NO_ZLIB) && !defined(UWS_MOCK_ZLIB)
+        /* Streams of our own prime the dictionary of our context from now on */
+        if (webSocketData->compressionDictionary && webSocketData->extension) {
+            for (InflationStream *inflationStream : {webSocketData->extension->inflationStream, webSocketData->extension->messageInflationStream}) {
+                if (inflationStream) {
+                    inflationStream->dictionary = webSocketContextData->compressionDictionary;
+                }
+            }
+            if (webSocketData->extension->deflationStream) {
+                webSocketData->extension->deflationStream->dictionary = webSocketContextData->compressionDictionary;
+            }
+        }
+#endif
+
+        /* Counted like any socket opened here */
+        ((AsyncSocket<SSL> *) ws)->getLoopData()->numSockets.fetch_add(1, std::memory_order_relaxed);
+        us_socket_long_timeout(SSL, (us_socket_t *) ws, webSocketContextData->maxLifetime);
+        us_socket_timeout(SSL, (us_socket_t *) ws, webSocketContextData->idleTimeoutComponents.first);
+
+        new (ws->getUserData()) USERDATA(std::move(migratingSocket->userData));
+        webSocketContextData->openSockets.insert((us_socket_t *) ws);
+        std::vector<std::string> topics = std::move(migratingSocket->topics);
+        delete migratingSocket;
+
+        /* Whatever was waiting to be sent goes first */
+        if (ws->getBufferedAmount()) {
+            ((AsyncSocket<SSL> *) ws)->write(nullptr, 0);
+        }
+
+        /* Retained messages were sent already, so we subscribe past them */
+        if (topics.size()) {
+            webSocketData->subscriber = webSocketContextData->topicTree->createSubscriber();
+            webSocketData->subscriber->user = ws;
+            std::vector<std::string_view> topicNames(topics.begin(), topics.end());
+            auto subscribed = webSocketContextData->topicTree->subscribe(webSocketData->subscriber, topicNames.data(), topicNames.size());
+            if (webSocketContextData->hasSubscriptionHandler()) {
+                std::vector<WebSocketSubscription> subscriptions;
+                for (auto [i, topicPtr] : subscribed) {
+                    subscriptions.push_back({topicNames[i], (int) topicPtr->size(), (int) topicPtr->size() - 1});
+                }
+                webSocketContextData->emitSubscriptions(ws, subscriptions);
+            }
+        }
+
+        if (webSocketContextData->arriveHandler) {
+            webSocketContextData->arriveHandler(ws);
+        }
+        return ws;
+    }
+
+    /* Hands a plain TCP server socket over channel to a process taking over (see TemplatedApp::handOff), taken apart as
+     * by detach. One with a compressor or decompressor of its own made, or user data not trivially copyable, cannot go
+     * and is closed with 1012 (Service Restart) instead. False while detach leaves it be */
+    static bool handOff(us_socket_t *s, int channel) {
+#ifndef _WIN32
+        if constexpr (!SSL && isServer) {
+            auto *ws = (WebSocket<SSL, isServer, USERDATA> *) s;
+
+            if constexpr (!std::is_trivially_copyable_v<USERDATA> || !std::is_default_constructible_v<USERDATA>) {
+                ws->end(1012, "Service Restart");
+                return true;
+            } else {
+                WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, s);
+                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, s));
+                if (WebSocketDataExtension *extension = webSocketData->extension;
+                    extension && (extension->deflationStream || extension->inflationStream || extension->messageInflationStream)) {
+                    ws->end(1012, "Service Restart");
+                    return true;
+                }
+
+                unsigned int routeIndex = webSocketContextData->routeIndex;
+                MigratingSocket *migratingSocket = detach(s);
+                if (!migratingSocket) {
+                    return false;
+                }
+
+                /* The route comes first, for TemplatedApp::takeOver to find our counterpart by */
+                Handoff::Writer writer;
+                writer.number(routeIndex);
+                writer.bytes({(char *) &migratingSocket->state, sizeof(WebSocketState<true>)});
+                writer.number(migratingSocket->controlTipLength);
+                writer.number(migratingSocket->compressionStatus);
+                writer.number(migratingSocket->pooledCompression);
+                writer.number(migratingSocket->compressionDictionary);
+                writer.bytes(migratingSocket->backpressure);
+                writer.number(migratingSocket->topics.size());
+                for (std::string &topic : migratingSocket->topics) {
+                    writer.bytes(topic);
+                }
+                writer.bytes({(char *) &migratingSocket->userData, sizeof(USERDATA)});
+                if (WebSocketDataExtension *extension = migratingSocket->extension) {
+                    writer.number(1);
+                    writer.number(extension->dedicatedStreams);
+                    writer.bytes(extension->fragmentBuffer);
+                    writer.bytes({(char *) extension->utf8Tail, extension->utf8TailLength});
+                    delete extension;
+                } else {
+                    writer.number(0);
+                }
+
+                /* Gone from here either way, with nobody to take it the connection goes with our descriptor */
+                Handoff::send(channel, Handoff::WEBSOCKET, writer.out, migratingSocket->fd);
+                close(migratingSocket->fd);
+                delete migratingSocket;
+                return true;
+            }
+        }
+#endif
+        (void) s;
+        (void) channel;
+        return false;
+    }
+
+    /* Puts a socket handed over by another process (by a context of the same route) back together here, taking fd.
+     * One that does not add up is closed */
+    WebSocket<SSL, isServer, USERDATA> *takeOver(int fd, std::string_view payload) {
+#ifndef _WIN32
+        if constexpr (!SSL && isServer && std::is_trivially_copyable_v<USERDATA> && std::is_default_constructible_v<USERDATA>) {
+            Handoff::Reader reader{payload};
+            reader.number();
+            std::string_view state = reader.bytes();
+            unsigned char controlTipLength = (unsigned char) reader.number();
+            auto compressionStatus = (typename WebSocketData::CompressionStatus) reader.number();
+            bool pooledCompression = reader.number();
+            bool compressionDictionary = reader.number();
+            std::string_view backpressure = reader.bytes();
+            std::vector<std::string> topics;
+            for (uint64_t i = 0, count = reader.number(); reader.ok && i < count; i++) {
+                topics.emplace_back(reader.bytes());
+            }
+            std::string_view userData = reader.bytes();
+
+            WebSocketDataExtension *extension = nullptr;
+            if (reader.number()) {
+                CompressOptions dedicatedStreams = (CompressOptions) reader.number();
+                std::string_view fragmentBuffer = reader.bytes();
+                std::string_view utf8Tail = reader.bytes();
+                if (reader.ok && utf8Tail.length() <= sizeof(extension->utf8Tail)) {
+                    extension = new WebSocketDataExtension;
+                    extension->dedicatedStreams = dedicatedStreams;
+                    extension->fragmentBuffer = fragmentBuffer;
+                    memcpy(extension->utf8Tail, utf8Tail.data(), utf8Tail.length());
+                    extension->utf8TailLength = (unsigned char) utf8Tail.length();
+                } else {
+                    reader.ok = false;
+                }
+            }
+
+            if (!reader.ok || reader.in.length() || state.length() != sizeof(WebSocketState<true>) || userData.length() != sizeof(USERDATA)) {
+                delete extension;
+                close(fd);
+                return nullptr;
+            }
+
+            MigratingSocket *migratingSocket = new MigratingSocket{fd, std::string(backpressure), {}, extension, controlTipLength,
+                compressionStatus, pooledCompression, compressionDictionary, std::move(topics), {}};
+            memcpy((void *) &migratingSocket->state, state.data(), state.length());
+            memcpy((void *) &migratingSocket->userData, userData.data(), userData.length());
+            return attach(migratingSocket);
+        }
+        close(fd);
+#endif
+        (void) fd;
+        (void) payload;
+        return nullptr;
+    }
+
+    /* Closes every open WebSocket of ours with 1001 (Going Away), see TemplatedApp::closeAll. The close frame is the
+     * same for everyone so it is formatted once, and is written straight out to sockets with nothing buffered (never
+     * queued, never waited on) right before they are closed. Pub/sub should be cleared first, leaving topics is then free */
+    void closeAll(bool callCloseHandlers) {
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = getExt();
+
+        char closePayload[2];
+        protocol::formatClosePayload(closePayload, 1001, nullptr, 0);
+        char closeFrame[16];
+        int closeFrameLength = (int) protocol::formatMessage<isServer>(closeFrame, closePayload, sizeof(closePayload), OpCode::CLOSE, sizeof(closePayload), false, true);
+
+        /* Handlers may close others of these, which then are left be */
+        std::vector<us_socket_t *> openSockets;
+        openSockets.reserve(webSocketContextData->openSockets.size());
+        for (us_socket_t *s : webSocketContextData->openSockets) {
+            openSockets.push_back(s);
+        }
+        webSocketContextData->openSockets.clear();
+
+        for (us_socket_t *s : openSockets) {
+            if (us_socket_is_closed(SSL, s)) {
+                continue;
+            }
+            auto *ws = (WebSocket<SSL, isServer, USERDATA> *) s;
+            WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, s);
+
+            /* Those already ending had their close event */
+            if (!webSocketData->isShuttingDown) {
+                webSocketData->isShuttingDown = true;
+                if (!webSocketData->buffer.length()) {
+                    us_socket_write(SSL, s, closeFrame, closeFrameLength, 0);
+                }
+                if (webSocketData->subscriber) {
+                    webSocketContextData->topicTree->freeSubscriber(webSocketData->subscriber);
+                    webSocketData->subscriber = nullptr;
+                }
+                if (callCloseHandlers && webSocketContextData->closeHandler) {
+                    webSocketContextData->closeHandler(ws, 1001, {});
+                }
+                ((USERDATA *) ws->getUserData())->~USERDATA();
+            }
+            us_socket_close(SSL, s, 0, nullptr);
+        }
+    }
+
     WebSocketContext<SSL, isServer, USERDATA> *init() {
+        /* Sockets migrating from other loops are adopted as accepted, all else is adopted from HTTP */
+        us_socket_context_on_open(SSL, getSocketContext(), [](us_socket_t *s, int /*is_client*/, char */*ip*/, int /*ip_length*/) {
+            return s;
+        });
+
         /* Adopting a socket does not trigger open event.
          * We arreive as WebSocket with timeout set and
          * any backpressure from HTTP state kept. */
 
         /* Handle socket disconnections */
         us_socket_context_on_close(SSL, getSocketContext(), [](auto *s, int code, void *reason) {
+            UWS_PROBE2(socket__close, s, code);
+
             /* For whatever reason, if we already have emitted close event, do not emit it again */
             WebSocketData *webSocketData = (WebSocketData *) (us_socket_ext(SSL, s));
+
+            /* A coroutine awaiting drained() learns we are closing while the socket is still valid */
+            webSocketData->resumeDrainedAwaiter(false);
+
             if (!webSocketData->isShuttingDown) {
                 /* Emit close event */
-                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
 
                 /* At this point we iterate all currently held subscriptions and emit an event for all of them */
-                if (webSocketData->subscriber && webSocketContextData->subscriptionHandler) {
+                if (webSocketData->subscriber && webSocketContextData->hasSubscriptionHandler()) {
+                    std::vector<WebSocketSubscription> subscriptions;
+                    subscriptions.reserve(webSocketData->subscriber->topics.size());
                     for (Topic *t : webSocketData->subscriber->topics) {
-                        webSocketContextData->subscriptionHandler((WebSocket<SSL, isServer, USERDATA> *) s, t->name, (int) t->size() - 1, (int) t->size());
+                        subscriptions.push_back({t->name, (int) t->size() - 1, (int) t->size()});
                     }
+                    webSocketContextData->emitSubscriptions((WebSocket<SSL, isServer, USERDATA> *) s, subscriptions);
                 }
 
-                /* Make sure to unsubscribe from any pub/sub node at exit */
-                webSocketContextData->topicTree->freeSubscriber(webSocketData->subscriber);
-                webSocketData->subscriber = nullptr;
+                /* Make sure to unsubscribe from any pub/sub node at exit (clients have no TopicTree) */
+                if (webSocketData->subscriber) {
+                    webSocketContextData->topicTree->freeSubscriber(webSocketData->subscriber);
+                    webSocketData->subscriber = nullptr;
+                }
 
                 auto *ws = (WebSocket<SSL, isServer, USERDATA> *) s;
                 if (webSocketContextData->closeHandler) {
@@ -276,52 +916,60 @@ private:
                 ((USERDATA *) ws->getUserData())->~USERDATA();
             }
 
-            /* Destruct in-placed data struct */
-            webSocketData->~WebSocketData();
-
-            return s;
-        });
-
-        /* Handle WebSocket data streams */
-        us_socket_context_on_data(SSL, getSocketContext(), [](auto *s, char *data, int length) {
-
-            /* We need the websocket data */
-            WebSocketData *webSocketData = (WebSocketData *) (us_socket_ext(SSL, s));
-
-            /* When in websocket shutdown mode, we do not care for ANY message, whether responding close frame or not.
-             * We only care for the TCP FIN really, not emitting any message after closing is key */
-            if (webSocketData->isShuttingDown) {
-                return s;
+            /* We were counted when opened as HTTP socket */
+            ((AsyncSocket<SSL> *) s)->getLoopData()->numSockets.fetch_sub(1, std::memory_order_relaxed);
+            UWS_CAPTURE(((AsyncSocket<SSL> *) s)->getLoopData(), close(s));
+
+            /* Closed sockets are freed before the iteration ends, so we cannot be flushed then */
+            if (webSocketData->sendsDeferred) {
+                std::vector<LoopData::DeferredFlush> &deferredFlushes = ((AsyncSocket<SSL> *) s)->getLoopData()->deferredFlushes;
+                for (size_t i = 0; i < deferredFlushes.size(); i++) {
+                    if (deferredFlushes[i].socket == s) {
+                        deferredFlushes[i] = deferredFlushes.back();
+                        deferredFlushes.pop_back();
+                        break;
+                    }
+                }
             }
 
-            auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
-            auto *asyncSocket = (AsyncSocket<SSL> *) s;
-
-            /* Every time we get data and not in shutdown state we simply reset the timeout */
-            asyncSocket->timeout(webSocketContextData->idleTimeoutComponents.first);
-            webSocketData->hasTimedOut = false;
+            /* Nor resumed */
+            ((AsyncSocket<SSL> *) s)->forgetPausedReads();
 
-            /* We always cork on data */
-            asyncSocket->cork();
+            /* Nor pinged */
+            if (webSocketData->pingPending) {
+                ((WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s)))->unqueuePing(webSocketData);
+            }
 
-            /* This parser has virtually no overhead */
-            WebSocketProtocol<isServer, WebSocketContext<SSL, isServer, USERDATA>>::consume(data, (unsigned int) length, (WebSocketState<isServer> *) webSocketData, s);
+            /* Nor closed by closeAll */
+            ((WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s)))->openSockets.erase((us_socket_t *) s);
 
-            /* Uncorking a closed socekt is fine, in fact it is needed */
-            asyncSocket->uncork();
+            /* Nor moved to another loop */
+            std::vector<LoopData::MigrationCandidate> &migrationCandidates = ((AsyncSocket<SSL> *) s)->getLoopData()->migrationCandidates;
+            migrationCandidates.erase(std::remove_if(migrationCandidates.begin(), migrationCandidates.end(), [s](LoopData::MigrationCandidate &migrationCandidate) {
+                return migrationCandidate.socket == s;
+            }), migrationCandidates.end());
 
-            /* If uncorking was successful and we are in shutdown state then send TCP FIN */
-            if (asyncSocket->getBufferedAmount() == 0) {
-                /* We can now be in shutdown state */
-                if (webSocketData->isShuttingDown) {
-                    /* Shutting down a closed socket is handled by uSockets and just fine */
-                    asyncSocket->shutdown();
+            /* Give back any pooled sliding window, or stop keeping track of a dedicated one */
+            if (webSocketData->extension) {
+                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+                if (webSocketData->extension->deflationLease) {
+                    webSocketContextData->deflationStreamPool->release(webSocketData, webSocketData->extension->deflationLease);
                 }
+                webSocketContextData->forgetCompressor(webSocketData->extension);
             }
 
+            /* Destruct in-placed data struct */
+            webSocketData->~WebSocketData();
+
             return s;
         });
 
+        /* Handle WebSocket data streams */
+        us_socket_context_on_data(SSL, getSocketContext(), [](auto *s, char *data, int length) {
+            UWS_CAPTURE(((AsyncSocket<SSL> *) s)->getLoopData(), data(s, data, length));
+            return handleData(s, data, length);
+        });
+
         /* Handle HTTP write out (note: SSL_read may trigger this spuriously, the app need to handle spurious calls) */
         us_socket_context_on_writable(SSL, getSocketContext(), [](auto *s) {
 
@@ -347,7 +995,7 @@ private:
             /* Behavior: if we actively drain backpressure, always reset timeout (even if we are in shutdown) */
             /* Also reset timeout if we came here with 0 backpressure */
             if (!backpressure || backpressure > asyncSocket->getBufferedAmount()) {
-                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
                 asyncSocket->timeout(webSocketContextData->idleTimeoutComponents.first);
                 webSocketData->hasTimedOut = false;
             }
@@ -360,8 +1008,22 @@ private:
                     asyncSocket->shutdown();
                 }
             } else if (!backpressure || backpressure > asyncSocket->getBufferedAmount()) {
+                /* A coroutine awaiting drained() goes first, it might close us */
+                if (!asyncSocket->getBufferedAmount()) {
+                    webSocketData->resumeDrainedAwaiter(true);
+                    if (us_socket_is_closed(SSL, (us_socket_t *) s)) {
+                        return s;
+                    }
+                }
+
                 /* Only call drain if we actually drained backpressure or if we came here with 0 backpressure */
-                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+                auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+
+                /* Whatever conflated topics held back goes out once we drained completely */
+                if (!asyncSocket->getBufferedAmount() && webSocketData->subscriber && webSocketContextData->topicTree) {
+                    webSocketContextData->topicTree->flushConflated(webSocketData->subscriber);
+                }
+
                 if (webSocketContextData->drainHandler) {
                     webSocketContextData->drainHandler((WebSocket<SSL, isServer, USERDATA> *) s);
                 }
@@ -390,13 +1052,12 @@ private:
         us_socket_context_on_timeout(SSL, getSocketContext(), [](auto *s) {
 
             auto *webSocketData = (WebSocketData *)(us_socket_ext(SSL, s));
-            auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
+            auto *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, us_socket_context(SSL, (us_socket_t *) s));
 
             if (webSocketContextData->sendPingsAutomatically && !webSocketData->isShuttingDown && !webSocketData->hasTimedOut) {
+                /* Pinged along with the rest of this sweep, then given the ping-timeout to answer */
                 webSocketData->hasTimedOut = true;
-                us_socket_timeout(SSL, s, webSocketContextData->idleTimeoutComponents.second);
-                /* Send ping without being corked */
-                ((AsyncSocket<SSL> *) s)->write("\x89\x00", 2);
+                webSocketContextData->queuePing(s, sendPendingPings);
                 return s;
             }
 
@@ -411,7 +1072,7 @@ private:
     }
 
     void free() {
-        WebSocketContextData<SSL, USERDATA> *webSocketContextData = (WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, (us_socket_context_t *) this);
+        WebSocketContextData<SSL, USERDATA, isServer> *webSocketContextData = (WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, (us_socket_context_t *) this);
         webSocketContextData->~WebSocketContextData();
 
         us_socket_context_free(SSL, (us_socket_context_t *) this);
@@ -420,13 +1081,13 @@ private:
 public:
     /* WebSocket contexts are always child contexts to a HTTP context so no SSL options are needed as they are inherited */
     static WebSocketContext *create(Loop */*loop*/, us_socket_context_t *parentSocketContext, TopicTree<TopicTreeMessage, TopicTreeBigMessage> *topicTree) {
-        WebSocketContext *webSocketContext = (WebSocketContext *) us_create_child_socket_context(SSL, parentSocketContext, sizeof(WebSocketContextData<SSL, USERDATA>));
+        WebSocketContext *webSocketContext = (WebSocketContext *) us_create_child_socket_context(SSL, parentSocketContext, sizeof(WebSocketContextData<SSL, USERDATA, isServer>));
         if (!webSocketContext) {
             return nullptr;
         }
 
         /* Init socket context data */
-        new ((WebSocketContextData<SSL, USERDATA> *) us_socket_context_ext(SSL, (us_socket_context_t *)webSocketContext)) WebSocketContextData<SSL, USERDATA>(topicTree);
+        new ((WebSocketContextData<SSL, USERDATA, isServer> *) us_socket_context_ext(SSL, (us_socket_context_t *)webSocketContext)) WebSocketContextData<SSL, USERDATA, isServer>(topicTree);
         return webSocketContext->init();
     }
 };
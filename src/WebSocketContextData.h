@@ -22,7 +22,10 @@
 #include "AsyncSocket.h"
 
 #include "MoveOnlyFunction.h"
+#include <deque>
+#include <span>
 #include <string_view>
+#include <string>
 #include <vector>
 
 #include "WebSocketProtocol.h"
@@ -31,23 +34,90 @@
 
 namespace uWS {
 
-/* Type queued up when publishing */
+struct TopicTreeBigMessage;
+
+/* One whole data message, as handed to the messages handler */
+struct WebSocketMessage {
+    std::string_view message;
+    OpCode opCode;
+};
+
+/* One topic a socket subscribed to or unsubscribed from, with its subscribers after and before, as handed to the
+ * subscriptions handler */
+struct WebSocketSubscription {
+    std::string_view topic;
+    int newCount, oldCount;
+};
+
+/* Type queued up when publishing. Frames are made by the first subscriber sending it (plain at 0,
+ * compressed at 1) and shared by the rest, as well as by backpressure that still holds them */
 struct TopicTreeMessage {
     std::string message;
     /*OpCode*/ int opCode;
     bool compress;
+    SharedFrame *frames[2] = {nullptr, nullptr};
+    /* Set if published to a conflated topic, owned by the TopicTree */
+    const std::string *conflatedTopic = nullptr;
+    /* Set if published compressed to one topic, valid while the TopicTree is at topicsVersion */
+    CompressionStats *topicStats = nullptr;
+    unsigned int topicsVersion = 0;
+
+    TopicTreeMessage(std::string message, int opCode, bool compress, const std::string *conflatedTopic = nullptr) : message(std::move(message)), opCode(opCode), compress(compress), conflatedTopic(conflatedTopic) {}
+
+    TopicTreeMessage(const TopicTreeMessage &other) : message(other.message), opCode(other.opCode), compress(other.compress), conflatedTopic(other.conflatedTopic), topicStats(other.topicStats), topicsVersion(other.topicsVersion) {
+        for (int i = 0; i < 2; i++) {
+            if ((frames[i] = other.frames[i])) {
+                frames[i]->ref();
+            }
+        }
+    }
+
+    /* Retained copies of big messages */
+    explicit TopicTreeMessage(const TopicTreeBigMessage &other);
+
+    TopicTreeMessage(TopicTreeMessage &&other) noexcept : message(std::move(other.message)), opCode(other.opCode), compress(other.compress), conflatedTopic(other.conflatedTopic), topicStats(other.topicStats), topicsVersion(other.topicsVersion) {
+        for (int i = 0; i < 2; i++) {
+            frames[i] = other.frames[i];
+            other.frames[i] = nullptr;
+        }
+    }
+
+    ~TopicTreeMessage() {
+        for (SharedFrame *frame : frames) {
+            if (frame) {
+                frame->release();
+            }
+        }
+    }
 };
 struct TopicTreeBigMessage {
     std::string_view message;
     /*OpCode*/ int opCode;
     bool compress;
+    SharedFrame *frames[2] = {nullptr, nullptr};
+    CompressionStats *topicStats = nullptr;
+    unsigned int topicsVersion = 0;
+
+    TopicTreeBigMessage(std::string_view message, int opCode, bool compress) : message(message), opCode(opCode), compress(compress) {}
+
+    TopicTreeBigMessage(const TopicTreeBigMessage &) = delete;
+
+    ~TopicTreeBigMessage() {
+        for (SharedFrame *frame : frames) {
+            if (frame) {
+                frame->release();
+            }
+        }
+    }
 };
 
+inline TopicTreeMessage::TopicTreeMessage(const TopicTreeBigMessage &other) : message(other.message), opCode(other.opCode), compress(other.compress), topicStats(other.topicStats), topicsVersion(other.topicsVersion) {}
+
 template <bool, bool, typename> struct WebSocket;
 
 /* todo: this looks identical to WebSocketBehavior, why not just std::move that entire thing in? */
 
-template <bool SSL, typename USERDATA>
+template <bool SSL, typename USERDATA, bool isServer = true>
 struct WebSocketContextData {
 private:
 
@@ -57,14 +127,31 @@ public:
     TopicTree<TopicTreeMessage, TopicTreeBigMessage> *topicTree;
 
     /* The callbacks for this context */
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *)> openHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *, std::string_view, OpCode)> messageHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *, std::string_view, OpCode)> droppedHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *)> drainHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *, std::string_view, int, int)> subscriptionHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *, int, std::string_view)> closeHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *, std::string_view)> pingHandler = nullptr;
-    MoveOnlyFunction<void(WebSocket<SSL, true, USERDATA> *, std::string_view)> pongHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *)> openHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::string_view, OpCode)> messageHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::string_view, OpCode, bool)> messageChunkHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::span<const WebSocketMessage>)> messagesHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::string_view, OpCode)> droppedHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *)> drainHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::string_view, int, int)> subscriptionHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::span<const WebSocketSubscription>)> subscriptionsHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, int, std::string_view)> closeHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::string_view)> pingHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *, std::string_view)> pongHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *)> leaveHandler = nullptr;
+    MoveOnlyFunction<void(WebSocket<SSL, isServer, USERDATA> *)> arriveHandler = nullptr;
+
+    /* Our place among the ws routes of our app, which is the same in any app set up like it. Those of plain
+     * TCP apps can move their sockets to the same route of such an app on another loop, see TemplatedApp::migrate,
+     * or hand them to such an app of another process, see TemplatedApp::handOff */
+    unsigned int routeIndex = 0;
+    bool (*migrate)(void *ws, void *targetApp) = nullptr;
+    bool (*handOff)(void *ws, void *channel) = nullptr;
+
+    /* Messages of the read being parsed, for messagesHandler. Those not pointing into the read (inflated or
+     * reassembled) point to copies of their own */
+    std::vector<WebSocketMessage> pendingMessages;
+    std::deque<std::string> pendingMessageCopies;
 
     /* Settings for this context */
     size_t maxPayloadLength = 0;
@@ -72,13 +159,148 @@ public:
     /* We do need these for async upgrade */
     CompressOptions compression;
 
+    /* Level every compressor of ours runs at, the shared one is set to it before use */
+    int compressionLevel = DEFAULT_COMPRESSION_LEVEL;
+
+    /* Sliding windows leased to sockets, with POOLED_COMPRESSOR */
+    DeflationStreamPool *deflationStreamPool = nullptr;
+
+    /* Dedicated compressors unused for this many seconds are freed, 0 keeps them. The peer copes with us starting
+     * over, so they are kept in a list, most recently used first, of which idleCompressorTimer frees the tail */
+    unsigned short compressorIdleTimeout = 0;
+    WebSocketDataExtension *usedCompressors = nullptr, *idleCompressors = nullptr;
+    TimingWheel::Timer idleCompressorTimer;
+
+    /* A socket compressed with its dedicated compressor just now */
+    void touchCompressor(WebSocketDataExtension *extension) {
+        if (!compressorIdleTimeout) {
+            return;
+        }
+        if (extension->prevCompressor || usedCompressors == extension) {
+            forgetCompressor(extension);
+        } else if (!usedCompressors) {
+            idleCompressorTimer.cb = freeIdleCompressors;
+            idleCompressorTimer.user = this;
+            Loop::get()->armTimer(&idleCompressorTimer, compressorIdleTimeout * 1000ull);
+        }
+        extension->compressorUsed = ((LoopData *) us_loop_ext((us_loop_t *) Loop::get()))->getTimingWheelTime();
+        extension->nextCompressor = usedCompressors;
+        (usedCompressors ? usedCompressors->prevCompressor : idleCompressors) = extension;
+        usedCompressors = extension;
+    }
+
+    /* Takes a socket off the list, before it closes or leaves for another loop */
+    void forgetCompressor(WebSocketDataExtension *extension) {
+        if (extension->prevCompressor || usedCompressors == extension) {
+            (extension->prevCompressor ? extension->prevCompressor->nextCompressor : usedCompressors) = extension->nextCompressor;
+            (extension->nextCompressor ? extension->nextCompressor->prevCompressor : idleCompressors) = extension->prevCompressor;
+            extension->prevCompressor = extension->nextCompressor = nullptr;
+        }
+    }
+
+    static void freeIdleCompressors(void *user) {
+        WebSocketContextData *webSocketContextData = (WebSocketContextData *) user;
+        uint64_t now = ((LoopData *) us_loop_ext((us_loop_t *) Loop::get()))->getTimingWheelTime();
+        uint64_t idleTimeout = webSocketContextData->compressorIdleTimeout * 1000ull;
+
+        while (WebSocketDataExtension *extension = webSocketContextData->idleCompressors) {
+            if (extension->compressorUsed + idleTimeout > now) {
+                Loop::get()->armTimer(&webSocketContextData->idleCompressorTimer, extension->compressorUsed + idleTimeout - now);
+                break;
+            }
+            webSocketContextData->forgetCompressor(extension);
+            delete extension->deflationStream;
+            extension->deflationStream = nullptr;
+        }
+    }
+
+    /* Sends made while another socket is corked wait for the end of the iteration */
+    bool batchSends = false;
+
+    /* Compressed messages at least this big are compressed on a worker, 0 is never */
+    size_t asyncCompressionThreshold = 0;
+
+    /* Preset dictionary offered as x_uws_dictionary=id, with the shared streams of the sockets that took it */
+    std::string compressionDictionary;
+    int compressionDictionaryId = 0;
+    DeflationStream *dictionaryDeflationStream = nullptr;
+    InflationStream *dictionaryInflationStream = nullptr;
+
+    /* What the streams of a socket are primed with, nothing unless it took our dictionary */
+    std::string_view getDictionary(WebSocketData *webSocketData) {
+        return webSocketData->compressionDictionary ? std::string_view(compressionDictionary) : std::string_view();
+    }
+
     /* There needs to be a maxBackpressure which will force close everything over that limit */
     size_t maxBackpressure = 0;
     bool closeOnBackpressureLimit;
     bool resetIdleTimeoutOnSend;
     bool sendPingsAutomatically;
+    bool emitAutomaticPongs = false;
     unsigned short maxLifetime;
 
+    /* Idle timeouts expire in sweeps of many sockets at once. Instead of pinging a whole sweep in one go, its
+     * sockets wait here and are pinged in slices every PING_SLICE_MS, evenly over PING_WINDOW_MS */
+    static constexpr unsigned int PING_SLICE_MS = 16;
+    static constexpr unsigned int PING_WINDOW_MS = 4000;
+    std::vector<void *> pendingPings;
+    unsigned int pingSlicesLeft = 0;
+    unsigned int pingSweepIteration = 0;
+    TimingWheel::Timer pingTimer;
+
+    void queuePing(void *s, void (*sendPendingPings)(void *)) {
+        WebSocketData *webSocketData = (WebSocketData *) us_socket_ext(SSL, (us_socket_t *) s);
+        if (webSocketData->pingPending) {
+            return;
+        }
+
+        /* A new sweep is spread over a window of its own, along with what is left of the last one */
+        unsigned int iteration = ((AsyncSocket<SSL> *) s)->getLoopData()->iteration;
+        if (pendingPings.empty() || pingSweepIteration != iteration) {
+            pingSweepIteration = iteration;
+            pingSlicesLeft = PING_WINDOW_MS / PING_SLICE_MS;
+        }
+
+        webSocketData->pingPending = true;
+        webSocketData->pendingPingIndex = (unsigned int) pendingPings.size();
+        pendingPings.push_back(s);
+
+        if (!pingTimer.isArmed()) {
+            pingTimer.cb = sendPendingPings;
+            pingTimer.user = this;
+            Loop::get()->armTimer(&pingTimer, PING_SLICE_MS);
+        }
+    }
+
+    void unqueuePing(WebSocketData *webSocketData) {
+        unsigned int index = webSocketData->pendingPingIndex;
+        pendingPings[index] = pendingPings.back();
+        ((WebSocketData *) us_socket_ext(SSL, (us_socket_t *) pendingPings[index]))->pendingPingIndex = index;
+        pendingPings.pop_back();
+        webSocketData->pingPending = false;
+        webSocketData->idleTimeoutIteration = 0;
+    }
+
+    /* Every open server WebSocket of ours, so that TemplatedApp::closeAll reaches them (uSockets does not walk them) */
+    FlatPointerSet<us_socket_t, PointerHasher> openSockets;
+
+    bool hasSubscriptionHandler() {
+        return subscriptionHandler || subscriptionsHandler;
+    }
+
+    /* Changes go to subscriptionsHandler all at once, or else one by one to subscriptionHandler */
+    void emitSubscriptions(WebSocket<SSL, isServer, USERDATA> *ws, std::span<const WebSocketSubscription> subscriptions) {
+        if (subscriptionsHandler) {
+            if (subscriptions.size()) {
+                subscriptionsHandler(ws, subscriptions);
+            }
+        } else if (subscriptionHandler) {
+            for (const WebSocketSubscription &subscription : subscriptions) {
+                subscriptionHandler(ws, subscription.topic, subscription.newCount, subscription.oldCount);
+            }
+        }
+    }
+
     /* These are calculated on creation */
     std::pair<unsigned short, unsigned short> idleTimeoutComponents;
 
@@ -96,7 +318,9 @@ public:
     }
 
     ~WebSocketContextData() {
-
+        delete deflationStreamPool;
+        delete dictionaryDeflationStream;
+        delete dictionaryInflationStream;
     }
 
     WebSocketContextData(TopicTree<TopicTreeMessage, TopicTreeBigMessage> *topicTree) : topicTree(topicTree) {
@@ -22,65 +22,257 @@
 #include "AsyncSocketData.h"
 #include "PerMessageDeflate.h"
 #include "TopicTree.h"
+#include "RequestArena.h"
+#include "WorkerPool.h"
 
 #include <string>
+#include <deque>
 
 namespace uWS {
 
+/* Sends held back behind a message being compressed on a worker, sent in order once it is done.
+ * Outlives its socket for as long as it has jobs out */
+struct AsyncSendQueue {
+    struct Entry {
+        std::string message;
+        OpCode opCode;
+        int compress;
+        bool fin;
+        /* On a worker, message becomes the compressed payload when done */
+        bool compressing;
+    };
+
+    std::deque<Entry> entries;
+    void *socket;
+    unsigned int jobs = 0;
+    bool flushing = false;
+
+    AsyncSendQueue(void *socket) : socket(socket) {}
+
+    bool holdsBack() {
+        return entries.size() && !flushing;
+    }
+};
+
+/* What only some sockets ever need: compression, fragmented messages, compression on workers and coroutines.
+ * Allocated on first need so that an idle socket is no more than WebSocketData */
+struct WebSocketDataExtension {
+    std::string fragmentBuffer;
+
+    /* The dedicated compressor and / or decompressor we negotiated, each made on first use */
+    CompressOptions dedicatedStreams = CompressOptions::DISABLED;
+    /* We might have a dedicated compressor */
+    DeflationStream *deflationStream = nullptr;
+    /* Or hold a sliding window from the pool of our context, if we are pooled */
+    DeflationStreamPool::Entry *deflationLease = nullptr;
+    /* And / or a dedicated decompressor */
+    InflationStream *inflationStream = nullptr;
+
+    /* With compressorIdleTimeout, while we have a dedicated compressor, when we last used it and where we are in
+     * the list of WebSocketContextData::idleCompressors */
+    uint64_t compressorUsed = 0;
+    WebSocketDataExtension *prevCompressor = nullptr, *nextCompressor = nullptr;
+
+    /* Only if something of ours was ever compressed on a worker */
+    AsyncSendQueue *asyncSendQueue = nullptr;
+
+    /* With messageChunk, a compressed message streaming in over many reads has a decompressor of its own while
+     * it lasts, unless we have a dedicated one, and text holds back a code point split between pieces */
+    InflationStream *messageInflationStream = nullptr;
+    unsigned char utf8Tail[3];
+    unsigned char utf8TailLength = 0;
+
+    /* A coroutine awaiting WebSocket::drained(), resumed with whether we drained or closed */
+    void *drainedAwaiter = nullptr;
+    void (*resumeDrained)(void *awaiter, bool drained) = nullptr;
+
+    /* WebSocket::arena(), reset after each message handler returns */
+    RequestArena messageArena;
+
+    /* Made by the first WebSocket::offload */
+    OffloadGuard *offloadGuard = nullptr;
+};
+
 struct WebSocketData : AsyncSocketData<false>, WebSocketState<true> {
     /* This guy has a lot of friends - why? */
     template <bool, bool, typename> friend struct WebSocketContext;
-    template <bool, typename> friend struct WebSocketContextData;
+    template <bool, typename, bool> friend struct WebSocketContextData;
     template <bool, bool, typename> friend struct WebSocket;
     template <bool> friend struct HttpContext;
 private:
-    std::string fragmentBuffer;
-    unsigned int controlTipLength = 0;
-    bool isShuttingDown = 0;
-    bool hasTimedOut = false;
-    enum CompressionStatus : char {
+    WebSocketDataExtension *extension = nullptr;
+
+    /* We could be a subscriber */
+    Subscriber *subscriber = nullptr;
+
+    union {
+        /* Loop iteration our idle timeout was last reset by a send */
+        unsigned int idleTimeoutIteration = 0;
+        /* While pingPending, where we are in WebSocketContextData::pendingPings */
+        unsigned int pendingPingIndex;
+    };
+    /* Control frames are at most 125 bytes */
+    unsigned char controlTipLength = 0;
+
+    enum CompressionStatus : unsigned char {
         DISABLED,
         ENABLED,
         COMPRESSED_FRAME
-    } compressionStatus;
+    };
+    CompressionStatus compressionStatus : 2;
+    bool isShuttingDown : 1;
+    bool hasTimedOut : 1;
+    /* We wait for our automatic ping in WebSocketContextData::pendingPings */
+    bool pingPending : 1;
+    /* We sent an automatic ping that was not answered yet */
+    bool awaitingPong : 1;
+    /* We are in LoopData::deferredFlushes */
+    bool sendsDeferred : 1;
+    /* We compress with a sliding window from the pool of our context */
+    bool pooledCompression : 1;
+    /* Both ends prime their streams with the preset dictionary of our context */
+    bool compressionDictionary : 1;
+    /* Of whole messages we send compressed */
+    CompressionStats compressionStats;
 
-    /* We might have a dedicated compressor */
-    DeflationStream *deflationStream = nullptr;
-    /* And / or a dedicated decompressor */
-    InflationStream *inflationStream = nullptr;
+    WebSocketDataExtension *getExtension() {
+        if (!extension) {
+            extension = new WebSocketDataExtension;
+        }
+        return extension;
+    }
 
-    /* We could be a subscriber */
-    Subscriber *subscriber = nullptr;
+    /* Part of a fragmented message, or of a control frame, is buffered */
+    bool hasFragmentBuffer() {
+        return extension && extension->fragmentBuffer.length();
+    }
+
+    std::string &getFragmentBuffer() {
+        return getExtension()->fragmentBuffer;
+    }
+
+    /* We compress with a dedicated compressor, which may not be made yet */
+    bool hasDedicatedCompressor() {
+        return extension && (extension->dedicatedStreams & CompressOptions::_COMPRESSOR_MASK);
+    }
+
+    /* Our dedicated compressor, if made */
+    DeflationStream *getDeflationStream() {
+        return extension ? extension->deflationStream : nullptr;
+    }
+
+    /* Our dedicated compressor, made now if it was not */
+    DeflationStream *makeDeflationStream(std::string_view dictionary, int compressionLevel) {
+        if (!extension->deflationStream) {
+            extension->deflationStream = new DeflationStream(extension->dedicatedStreams, dictionary, compressionLevel);
+        }
+        return extension->deflationStream;
+    }
+
+    /* Our dedicated decompressor, made now if it was not, or null if we inflate with a shared one */
+    InflationStream *getInflationStream(std::string_view dictionary) {
+        if (!extension || !(extension->dedicatedStreams & CompressOptions::_DECOMPRESSOR_MASK)) {
+            return nullptr;
+        }
+        if (!extension->inflationStream) {
+            extension->inflationStream = new InflationStream(extension->dedicatedStreams, dictionary);
+        }
+        return extension->inflationStream;
+    }
+
+    DeflationStreamPool::Entry *&getDeflationLease() {
+        return getExtension()->deflationLease;
+    }
+
+    AsyncSendQueue *getAsyncSendQueue() {
+        return extension ? extension->asyncSendQueue : nullptr;
+    }
+
+    /* The message handler returned (without closing us), what it made in the arena is over */
+    void resetMessageArena() {
+        if (extension) {
+            extension->messageArena.reset();
+        }
+    }
+
+    void resumeDrainedAwaiter(bool drained) {
+        if (extension && extension->drainedAwaiter) {
+            void *awaiter = extension->drainedAwaiter;
+            extension->drainedAwaiter = nullptr;
+            extension->resumeDrained(awaiter, drained);
+        }
+    }
 public:
-    WebSocketData(bool perMessageDeflate, CompressOptions compressOptions, BackPressure &&backpressure) : AsyncSocketData<false>(std::move(backpressure)), WebSocketState<true>() {
+    WebSocketData(bool perMessageDeflate, CompressOptions compressOptions, BackPressure &&backpressure, bool dictionary = false) : AsyncSocketData<false>(std::move(backpressure)), WebSocketState<true>() {
         compressionStatus = perMessageDeflate ? ENABLED : DISABLED;
+        isShuttingDown = false;
+        hasTimedOut = false;
+        pingPending = false;
+        awaitingPong = false;
+        sendsDeferred = false;
+        pooledCompression = false;
+        compressionDictionary = dictionary;
 
-        /* Initialize the dedicated sliding window(s) */
+        /* Dedicated sliding windows are only made once something is compressed or inflated with them, sockets
+         * that never do so cost no zlib state */
         if (perMessageDeflate) {
-            if ((compressOptions & CompressOptions::_COMPRESSOR_MASK) != CompressOptions::SHARED_COMPRESSOR) {
-                deflationStream = new DeflationStream(compressOptions);
+            unsigned int dedicatedStreams = 0;
+            if (compressOptions & CompressOptions::POOLED_COMPRESSOR) {
+                pooledCompression = true;
+            } else if ((compressOptions & CompressOptions::_COMPRESSOR_MASK) != CompressOptions::SHARED_COMPRESSOR) {
+                dedicatedStreams |= compressOptions & CompressOptions::_COMPRESSOR_MASK;
             }
             if ((compressOptions & CompressOptions::_DECOMPRESSOR_MASK) != CompressOptions::SHARED_DECOMPRESSOR) {
-                inflationStream = new InflationStream(compressOptions);
+                dedicatedStreams |= compressOptions & CompressOptions::_DECOMPRESSOR_MASK;
+            }
+            if (dedicatedStreams) {
+                getExtension()->dedicatedStreams = (CompressOptions) dedicatedStreams;
             }
         }
     }
 
     ~WebSocketData() {
-        if (deflationStream) {
-            delete deflationStream;
+        if (subscriber) {
+            delete subscriber;
         }
 
-        if (inflationStream) {
-            delete inflationStream;
-        }
+        if (extension) {
+            if (extension->deflationStream) {
+                delete extension->deflationStream;
+            }
 
-        if (subscriber) {
-            delete subscriber;
+            if (extension->inflationStream) {
+                delete extension->inflationStream;
+            }
+
+            if (extension->messageInflationStream) {
+                delete extension->messageInflationStream;
+            }
+
+            OffloadGuard::invalidate(extension->offloadGuard);
+
+            /* Jobs still out will find us gone */
+            if (AsyncSendQueue *asyncSendQueue = extension->asyncSendQueue) {
+                asyncSendQueue->socket = nullptr;
+                asyncSendQueue->entries.clear();
+                if (!asyncSendQueue->jobs) {
+                    delete asyncSendQueue;
+                }
+            }
+
+            delete extension;
         }
     }
 };
 
+/* An idle WebSocket without compression is this plus its user data, see the footprint of benchmarks/suite.cpp.
+ * The flags of kTLS take 8 bytes more */
+#ifdef UWS_WITH_KTLS
+static_assert(sizeof(void *) != 8 || sizeof(WebSocketData) <= 72, "WebSocketData grew past 72 bytes");
+#else
+static_assert(sizeof(void *) != 8 || sizeof(WebSocketData) <= 64, "WebSocketData grew past 64 bytes");
+#endif
+
 }
 
 #endif // UWS_WEBSOCKETDATA_H
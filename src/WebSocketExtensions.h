@@ -29,6 +29,7 @@
 
 #include <climits>
 #include <cctype>
+#include <cstring>
 #include <string>
 #include <string_view>
 #include <tuple>
@@ -45,7 +46,9 @@ enum ExtensionTokens {
     /* Non-standard alias for Safari */
     TOK_X_WEBKIT_DEFLATE_FRAME = 2149,
     TOK_NO_CONTEXT_TAKEOVER = 2049,
-    TOK_MAX_WINDOW_BITS = 1614
+    TOK_MAX_WINDOW_BITS = 1614,
+    /* Our own permessage-deflate parameter, selecting a preset dictionary by id */
+    TOK_X_UWS_DICTIONARY = 1739
 
 };
 
@@ -66,6 +69,9 @@ public:
     bool noContextTakeover = false;
     int maxWindowBits = 0;
 
+    /* Non-standard uWS */
+    int dictionary = 0;
+
     int getToken(const char *&in, const char *stop) {
         while (in != stop && !isalnum(*in)) {
             in++;
@@ -130,6 +136,11 @@ public:
                 clientMaxWindowBits = 1;
                 lastInteger = &clientMaxWindowBits;
                 break;
+            case TOK_X_UWS_DICTIONARY:
+                /* Without an id it matches nothing */
+                dictionary = -1;
+                lastInteger = &dictionary;
+                break;
             default:
                 if (token < 0 && lastInteger) {
                     *lastInteger = -token;
@@ -140,22 +151,57 @@ public:
     }
 };
 
-/* Takes what we (the server) wants, returns what we got */
-static inline std::tuple<bool, int, int, std::string_view> negotiateCompression(bool wantCompression, int wantedCompressionWindow, int wantedInflationWindow, std::string_view offer) {
+/* The Sec-WebSocket-Extensions we respond with, built without allocating. Long enough for every parameter at once */
+struct ExtensionsResponse {
+    char data[128];
+    size_t length = 0;
+
+    void operator=(std::string_view text) {
+        length = 0;
+        *this += text;
+    }
+
+    void operator+=(std::string_view text) {
+        memcpy(data + length, text.data(), text.length());
+        length += text.length();
+    }
+
+    /* Window bits and dictionary ids, which are never negative */
+    void operator+=(int value) {
+        char digits[12];
+        int numDigits = 0;
+        do {
+            digits[numDigits++] = (char) ('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (numDigits) {
+            data[length++] = digits[--numDigits];
+        }
+    }
+
+    operator std::string_view() const {
+        return {data, length};
+    }
+};
+
+/* Takes what we (the server) wants, returns what we got. A preset dictionary is only used with permessage-deflate
+ * if the peer offers x_uws_dictionary with the id of ours, which is then echoed back */
+static inline std::tuple<bool, int, int, std::string_view, bool> negotiateCompression(bool wantCompression, int wantedCompressionWindow, int wantedInflationWindow, std::string_view offer, int wantedDictionary = 0) {
 
     /* If we don't want compression then we are done here */
     if (!wantCompression) {
-        return {false, 0, 0, ""};
+        return {false, 0, 0, "", false};
     }
 
     ExtensionsParser ep(offer.data(), offer.length());
 
-    static thread_local std::string response;
+    static thread_local ExtensionsResponse response;
     response = "";
 
     int compressionWindow = wantedCompressionWindow;
     int inflationWindow = wantedInflationWindow;
     bool compression = false;
+    bool dictionary = false;
 
     if (ep.xWebKitDeflateFrame) {
         /* We now have compression */
@@ -168,7 +214,7 @@ static inline std::tuple<bool, int, int, std::string_view> negotiateCompression(
             /* We must fail here right now (fix pub/sub) */
 #ifndef UWS_ALLOW_SHARED_AND_DEDICATED_COMPRESSOR_MIX
             if (wantedCompressionWindow != 0) {
-                return {false, 0, 0, ""};
+                return {false, 0, 0, "", false};
             }
 #endif
 
@@ -182,7 +228,7 @@ static inline std::tuple<bool, int, int, std::string_view> negotiateCompression(
 #ifndef UWS_ALLOW_8_WINDOW_BITS
             /* We cannot really deny this, so we have to disable compression in this case */
             if (compressionWindow == 8) {
-                return {false, 0, 0, ""};
+                return {false, 0, 0, "", false};
             }
 #endif
         }
@@ -192,7 +238,8 @@ static inline std::tuple<bool, int, int, std::string_view> negotiateCompression(
             if (!wantedInflationWindow) {
                 response += "; no_context_takeover";
             } else {
-                response += "; max_window_bits=" + std::to_string(wantedInflationWindow);
+                response += "; max_window_bits=";
+                response += wantedInflationWindow;
             }
         }
     } else if (ep.perMessageDeflate) {
@@ -212,7 +259,8 @@ static inline std::tuple<bool, int, int, std::string_view> negotiateCompression(
                 response += "; client_no_context_takeover";
                 inflationWindow = 0;
             } else {
-                response += "; client_max_window_bits=" + std::to_string(inflationWindow);
+                response += "; client_max_window_bits=";
+                response += inflationWindow;
             }
         }
 
@@ -238,17 +286,25 @@ static inline std::tuple<bool, int, int, std::string_view> negotiateCompression(
             if (!compressionWindow) {
                 response += "; server_no_context_takeover";
             } else {
-                response += "; server_max_window_bits=" + std::to_string(compressionWindow);
+                response += "; server_max_window_bits=";
+                response += compressionWindow;
             }
         }
+
+        /* Both of us have the same dictionary */
+        if (wantedDictionary && ep.dictionary == wantedDictionary) {
+            dictionary = true;
+            response += "; x_uws_dictionary=";
+            response += wantedDictionary;
+        }
     }
 
     /* A final sanity check (this check does not actually catch too high values!) */
     if ((compressionWindow && compressionWindow < 8) || compressionWindow > 15 || (inflationWindow && inflationWindow < 8) || inflationWindow > 15) {
-        return {false, 0, 0, ""};
+        return {false, 0, 0, "", false};
     }
 
-    return {compression, compressionWindow, inflationWindow, response};
+    return {compression, compressionWindow, inflationWindow, response, dictionary};
 }
 
 }
@@ -21,6 +21,17 @@
 #include <cstdint>
 #include <cstddef>
 
+/* SHA-1 runs on the SHA extensions of x86 (checked for at runtime) and ARMv8 (when the compiler targets them),
+ * base64 on SSSE3 (checked for at runtime). Define UWS_NO_SIMD to keep to the portable code */
+#if !defined(UWS_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#include "CpuFeatures.h"
+#define UWS_HANDSHAKE_X86
+#elif !defined(UWS_NO_SIMD) && defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define UWS_HANDSHAKE_ARM
+#endif
+
 namespace uWS {
 
 struct WebSocketHandshake {
@@ -98,9 +109,11 @@ struct WebSocketHandshake {
         static_for<5, Sha1Loop6>()(a, hash);
     }
 
-    static inline void base64(unsigned char *src, char *dst) {
+    /* From byte from (a multiple of 3) of the 20 */
+    static inline void base64(unsigned char *src, char *dst, int from = 0) {
         const char *b64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-        for (int i = 0; i < 18; i += 3) {
+        dst += from / 3 * 4;
+        for (int i = from; i < 18; i += 3) {
             *dst++ = b64[(src[i] >> 2) & 63];
             *dst++ = b64[((src[i] & 3) << 4) | ((src[i + 1] & 240) >> 4)];
             *dst++ = b64[((src[i + 1] & 15) << 2) | ((src[i + 2] & 192) >> 6)];
@@ -112,6 +125,105 @@ struct WebSocketHandshake {
         *dst++ = '=';
     }
 
+#ifdef UWS_HANDSHAKE_X86
+    /* Whether the SHA extensions (and the SSE they come with) are there */
+    static inline bool hasShaExtensions() {
+        const CpuFeatures &features = CpuFeatures::get();
+        return features.sha && features.sse41 && features.ssse3;
+    }
+
+    /* One block, four rounds at a time. Message words are already in host order */
+    __attribute__((target("sha,sse4.1,ssse3")))
+    static inline void sha1Extensions(uint32_t hash[5], uint32_t b[16]) {
+        __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *) hash), 0x1b);
+        __m128i e[2] = {_mm_set_epi32((int) hash[4], 0, 0, 0), abcd};
+        __m128i abcdSaved = abcd, eSaved = e[0];
+        __m128i msg[4];
+
+        for (int i = 0; i < 4; i++) {
+            msg[i] = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *) (b + 4 * i)), 0x1b);
+        }
+
+        /* Rounds 0-3 take e as it is, the rest the one rotated out of the four rounds before */
+        e[0] = _mm_add_epi32(e[0], msg[0]);
+        e[1] = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e[0], 0);
+        sha1ExtensionsRounds<1>(abcd, e, msg);
+
+        e[0] = _mm_sha1nexte_epu32(e[0], eSaved);
+        abcd = _mm_add_epi32(abcd, abcdSaved);
+        _mm_storeu_si128((__m128i *) hash, _mm_shuffle_epi32(abcd, 0x1b));
+        hash[4] = (uint32_t) _mm_extract_epi32(e[0], 3);
+    }
+
+    /* Rounds 4 * i to 4 * i + 3, scheduling the message of the rounds to come on the way */
+    template <int i>
+    __attribute__((target("sha,sse4.1,ssse3")))
+    static inline void sha1ExtensionsRounds(__m128i &abcd, __m128i e[2], __m128i msg[4]) {
+        if constexpr (i < 20) {
+            __m128i &m = msg[i % 4];
+            e[i % 2] = _mm_sha1nexte_epu32(e[i % 2], m);
+            e[(i + 1) % 2] = abcd;
+            if constexpr (i >= 3 && i <= 18) {
+                msg[(i + 1) % 4] = _mm_sha1msg2_epu32(msg[(i + 1) % 4], m);
+            }
+            abcd = _mm_sha1rnds4_epu32(abcd, e[i % 2], i / 5);
+            if constexpr (i <= 16) {
+                msg[(i + 3) % 4] = _mm_sha1msg1_epu32(msg[(i + 3) % 4], m);
+            }
+            if constexpr (i >= 2 && i <= 17) {
+                msg[(i + 2) % 4] = _mm_xor_si128(msg[(i + 2) % 4], m);
+            }
+            sha1ExtensionsRounds<i + 1>(abcd, e, msg);
+        }
+    }
+
+    /* The first 12 bytes to 16 letters in one go (Wojciech Mula's method), the rest like base64 */
+    __attribute__((target("ssse3")))
+    static inline void base64Ssse3(unsigned char *src, char *dst) {
+        __m128i in = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) src), _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+        __m128i indices = _mm_or_si128(_mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040)),
+            _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010)));
+
+        /* 0-25 to 'A'-'Z', 26-51 to 'a'-'z', 52-61 to '0'-'9', 62 to '+' and 63 to '/', by what to add */
+        __m128i range = _mm_or_si128(_mm_subs_epu8(indices, _mm_set1_epi8(51)), _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+        __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        _mm_storeu_si128((__m128i *) dst, _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices));
+        base64(src, dst, 12);
+    }
+#endif
+
+#ifdef UWS_HANDSHAKE_ARM
+    /* One block, four rounds at a time */
+    static inline void sha1Extensions(uint32_t hash[5], uint32_t b[16]) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = b[i];
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        const uint32_t k[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+        uint32x4_t abcd = vld1q_u32(hash);
+        uint32_t e = hash[4];
+        for (int i = 0; i < 20; i++) {
+            uint32x4_t wk = vaddq_u32(vld1q_u32(w + 4 * i), vdupq_n_u32(k[i / 5]));
+            uint32_t nextE = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (i < 5) {
+                abcd = vsha1cq_u32(abcd, e, wk);
+            } else if (i >= 10 && i < 15) {
+                abcd = vsha1mq_u32(abcd, e, wk);
+            } else {
+                abcd = vsha1pq_u32(abcd, e, wk);
+            }
+            e = nextE;
+        }
+        vst1q_u32(hash, vaddq_u32(vld1q_u32(hash), abcd));
+        hash[4] += e;
+    }
+#endif
+
 public:
     static inline void generate(const char input[24], char output[28]) {
         uint32_t b_output[5] = {
@@ -125,9 +237,22 @@ public:
         for (int i = 0; i < 6; i++) {
             b_input[i] = (uint32_t) ((input[4 * i + 3] & 0xff) | (input[4 * i + 2] & 0xff) << 8 | (input[4 * i + 1] & 0xff) << 16 | (input[4 * i + 0] & 0xff) << 24);
         }
-        sha1(b_output, b_input);
         uint32_t last_b[16] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 480};
+#if defined(UWS_HANDSHAKE_X86)
+        if (hasShaExtensions()) {
+            sha1Extensions(b_output, b_input);
+            sha1Extensions(b_output, last_b);
+        } else {
+            sha1(b_output, b_input);
+            sha1(b_output, last_b);
+        }
+#elif defined(UWS_HANDSHAKE_ARM)
+        sha1Extensions(b_output, b_input);
+        sha1Extensions(b_output, last_b);
+#else
+        sha1(b_output, b_input);
         sha1(b_output, last_b);
+#endif
         for (int i = 0; i < 5; i++) {
             uint32_t tmp = b_output[i];
             char *bytes = (char *) &b_output[i];
@@ -136,8 +261,29 @@ public:
             bytes[1] = (char) ((tmp >> 16) & 0xff);
             bytes[0] = (char) ((tmp >> 24) & 0xff);
         }
+#ifdef UWS_HANDSHAKE_X86
+        if (hasShaExtensions()) {
+            base64Ssse3((unsigned char *) b_output, output);
+            return;
+        }
+#endif
         base64((unsigned char *) b_output, output);
     }
+
+    /* Sec-WebSocket-Key of a client, the base64 of 16 random bytes */
+    static inline void generateKey(const unsigned char random[16], char output[24]) {
+        const char *b64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 15; i += 3) {
+            *output++ = b64[(random[i] >> 2) & 63];
+            *output++ = b64[((random[i] & 3) << 4) | ((random[i + 1] & 240) >> 4)];
+            *output++ = b64[((random[i + 1] & 15) << 2) | ((random[i + 2] & 192) >> 6)];
+            *output++ = b64[random[i + 2] & 63];
+        }
+        *output++ = b64[(random[15] >> 2) & 63];
+        *output++ = b64[(random[15] & 3) << 4];
+        *output++ = '=';
+        *output++ = '=';
+    }
 };
 
 }
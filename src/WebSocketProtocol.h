@@ -23,7 +23,39 @@
 #include <cstdint>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include <string_view>
+#include <algorithm>
+
+#include "Utilities.h"
+
+/* Unmasking is vectorized with SSE2 or NEON, and with AVX2 or AVX-512 when the compiler targets them or else when
+ * the CPU has them (checked once at startup, see CpuFeatures). UWS_UNMASK_SIMD_WIDTH is the smallest block any of
+ * them takes. Define UWS_NO_SIMD to leave it to the portable 8-byte paths. */
+#if !defined(UWS_NO_SIMD)
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define UWS_UNMASK_SIMD_WIDTH 16
+#include "CpuFeatures.h"
+#ifndef __AVX512F__
+#define UWS_UNMASK_DISPATCH
+#endif
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define UWS_UNMASK_SIMD_WIDTH 16
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UWS_UNMASK_SIMD_WIDTH 16
+#endif
+/* UTF-8 validation needs byte shuffles, SSSE3 or AVX2 picked like the unmasking kernels, or AArch64 table lookups.
+ * UWS_UTF8_SIMD_WIDTH is the shortest string worth them */
+#if defined(__SSE2__) && defined(__GNUC__)
+#define UWS_UTF8_SIMD_X86
+#define UWS_UTF8_SIMD_WIDTH 16
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define UWS_UTF8_SIMD_WIDTH 16
+#endif
+#endif
 
 namespace uWS {
 
@@ -93,30 +125,14 @@ T bit_cast(char *c) {
 }
 
 /* Byte swap for little-endian systems */
-template <typename T>
-T cond_byte_swap(T value) {
-    uint32_t endian_test = 1;
-    if (*((char *)&endian_test)) {
-        union {
-            T i;
-            uint8_t b[sizeof(T)];
-        } src = { value }, dst;
-
-        for (unsigned int i = 0; i < sizeof(value); i++) {
-            dst.b[i] = src.b[sizeof(value) - 1 - i];
-        }
-
-        return dst.i;
-    }
-    return value;
-}
+using utils::cond_byte_swap;
 
 // Based on utf8_check.c by Markus Kuhn, 2005
 // https://www.cl.cam.ac.uk/~mgk25/ucs/utf8_check.c
 // Optimized for predominantly 7-bit content by Alex Hultman, 2016
 // Licensed as Zlib, like the rest of this project
 // This runs about 40% faster than simdutf with g++ -mavx
-static bool isValidUtf8(unsigned char *s, size_t length)
+static bool isValidUtf8Scalar(unsigned char *s, size_t length)
 {
     for (unsigned char *e = s + length; s != e; ) {
         if (s + 16 <= e) {
@@ -158,6 +174,251 @@ static bool isValidUtf8(unsigned char *s, size_t length)
     return true;
 }
 
+#ifdef UWS_UTF8_SIMD_WIDTH
+// Based on the lookup algorithm by John Keiser and Daniel Lemire, 2020
+// "Validating UTF-8 In Less Than One Instruction Per Byte" (as used in simdjson and simdutf)
+// Every pair of adjacent bytes is classified by three 16-entry tables, the AND of which is
+// non-zero for any invalid pair. Only 3 and 4 byte sequences need another look further back.
+#ifdef UWS_UTF8_SIMD_X86
+struct Utf8Block32 {
+    typedef __m256i V;
+    static const unsigned int WIDTH = 32;
+    __attribute__((target("avx2"))) static V load(const unsigned char *s) {return _mm256_loadu_si256((const __m256i *) s);}
+    __attribute__((target("avx2"))) static V splat(unsigned char c) {return _mm256_set1_epi8((char) c);}
+    __attribute__((target("avx2"))) static V table(const unsigned char *t) {return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) t));}
+    __attribute__((target("avx2"))) static V lookup(V table, V nibbles) {return _mm256_shuffle_epi8(table, nibbles);}
+    __attribute__((target("avx2"))) static V high(V v) {return _mm256_and_si256(_mm256_srli_epi16(v, 4), splat(0x0f));}
+    __attribute__((target("avx2"))) static V low(V v) {return _mm256_and_si256(v, splat(0x0f));}
+    __attribute__((target("avx2"))) static V band(V a, V b) {return _mm256_and_si256(a, b);}
+    __attribute__((target("avx2"))) static V bor(V a, V b) {return _mm256_or_si256(a, b);}
+    __attribute__((target("avx2"))) static V bxor(V a, V b) {return _mm256_xor_si256(a, b);}
+    __attribute__((target("avx2"))) static V subs(V a, V b) {return _mm256_subs_epu8(a, b);}
+    __attribute__((target("avx2"))) static bool isAscii(V v) {return !_mm256_movemask_epi8(v);}
+    __attribute__((target("avx2"))) static bool any(V v) {return !_mm256_testz_si256(v, v);}
+    /* Input shifted N bytes later, pulling in the last bytes of the previous block */
+    template <int N>
+    __attribute__((target("avx2"))) static V prev(V input, V previous) {return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);}
+};
+
+struct Utf8Block16 {
+    typedef __m128i V;
+    static const unsigned int WIDTH = 16;
+    __attribute__((target("ssse3"))) static V load(const unsigned char *s) {return _mm_loadu_si128((const __m128i *) s);}
+    __attribute__((target("ssse3"))) static V splat(unsigned char c) {return _mm_set1_epi8((char) c);}
+    __attribute__((target("ssse3"))) static V table(const unsigned char *t) {return _mm_loadu_si128((const __m128i *) t);}
+    __attribute__((target("ssse3"))) static V lookup(V table, V nibbles) {return _mm_shuffle_epi8(table, nibbles);}
+    __attribute__((target("ssse3"))) static V high(V v) {return _mm_and_si128(_mm_srli_epi16(v, 4), splat(0x0f));}
+    __attribute__((target("ssse3"))) static V low(V v) {return _mm_and_si128(v, splat(0x0f));}
+    __attribute__((target("ssse3"))) static V band(V a, V b) {return _mm_and_si128(a, b);}
+    __attribute__((target("ssse3"))) static V bor(V a, V b) {return _mm_or_si128(a, b);}
+    __attribute__((target("ssse3"))) static V bxor(V a, V b) {return _mm_xor_si128(a, b);}
+    __attribute__((target("ssse3"))) static V subs(V a, V b) {return _mm_subs_epu8(a, b);}
+    __attribute__((target("ssse3"))) static bool isAscii(V v) {return !_mm_movemask_epi8(v);}
+    __attribute__((target("ssse3"))) static bool any(V v) {return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff;}
+    template <int N>
+    __attribute__((target("ssse3"))) static V prev(V input, V previous) {return _mm_alignr_epi8(input, previous, 16 - N);}
+};
+#else
+struct Utf8Block16 {
+    typedef uint8x16_t V;
+    static const unsigned int WIDTH = 16;
+    static V load(const unsigned char *s) {return vld1q_u8(s);}
+    static V splat(unsigned char c) {return vdupq_n_u8(c);}
+    static V table(const unsigned char *t) {return vld1q_u8(t);}
+    static V lookup(V table, V nibbles) {return vqtbl1q_u8(table, nibbles);}
+    static V high(V v) {return vshrq_n_u8(v, 4);}
+    static V low(V v) {return vandq_u8(v, splat(0x0f));}
+    static V band(V a, V b) {return vandq_u8(a, b);}
+    static V bor(V a, V b) {return vorrq_u8(a, b);}
+    static V bxor(V a, V b) {return veorq_u8(a, b);}
+    static V subs(V a, V b) {return vqsubq_u8(a, b);}
+    static bool isAscii(V v) {return vmaxvq_u8(v) < 0x80;}
+    static bool any(V v) {return vmaxvq_u8(v) != 0;}
+    template <int N>
+    static V prev(V input, V previous) {return vextq_u8(previous, input, 16 - N);}
+};
+#endif
+
+/* Always inlined so that the blocks inline as well, into the callers built for what they need. Which is also why
+ * GCC warning us about passing AVX vectors without AVX (-Wpsabi) does not apply */
+#if defined(UWS_UTF8_SIMD_X86) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+template <typename B>
+__attribute__((always_inline))
+static inline bool isValidUtf8Blocks(unsigned char *s, size_t length) {
+    const unsigned int W = B::WIDTH;
+
+    /* Error classes of a (first, second) byte pair */
+    const unsigned char TOO_SHORT = 1 << 0, TOO_LONG = 1 << 1, OVERLONG_3 = 1 << 2, TOO_LARGE = 1 << 3,
+        SURROGATE = 1 << 4, OVERLONG_2 = 1 << 5, TOO_LARGE_1000 = 1 << 6, OVERLONG_4 = 1 << 6, TWO_CONTS = 1 << 7;
+    const unsigned char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    /* Indexed by high nibble of the first byte */
+    static const unsigned char firstHigh[16] = {
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+    };
+
+    /* Indexed by low nibble of the first byte */
+    static const unsigned char firstLow[16] = {
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000
+    };
+
+    /* Indexed by high nibble of the second byte */
+    static const unsigned char secondHigh[16] = {
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+    };
+
+    /* A block ending in the lead byte of a sequence that needs more bytes than are left in it */
+    static const unsigned char incompleteLimits[32] = {
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+        255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+    };
+
+    typename B::V firstHighTable = B::table(firstHigh), firstLowTable = B::table(firstLow), secondHighTable = B::table(secondHigh);
+    typename B::V limits = B::load(incompleteLimits + 32 - W);
+
+    typename B::V error = B::splat(0), previous = B::splat(0), previousIncomplete = B::splat(0);
+
+    /* The tail is padded with ASCII which closes (and fails) any open sequence */
+    unsigned char tail[B::WIDTH] = {};
+    while (length) {
+        typename B::V input;
+        if (length >= W) {
+            input = B::load(s);
+            s += W;
+            length -= W;
+        } else {
+            memcpy(tail, s, length);
+            input = B::load(tail);
+            length = 0;
+        }
+
+        if (B::isAscii(input)) {
+            /* An ASCII block is only wrong if the previous one left a sequence open */
+            error = B::bor(error, previousIncomplete);
+        } else {
+            typename B::V prev1 = B::template prev<1>(input, previous);
+            typename B::V special = B::band(B::band(B::lookup(firstHighTable, B::high(prev1)), B::lookup(firstLowTable, B::low(prev1))), B::lookup(secondHighTable, B::high(input)));
+
+            /* Bytes 2 and 3 back being 3 and 4 byte leads means we must be a continuation (which is marked as TWO_CONTS) */
+            typename B::V must23 = B::bor(B::subs(B::template prev<2>(input, previous), B::splat(0xe0 - 0x80)), B::subs(B::template prev<3>(input, previous), B::splat(0xf0 - 0x80)));
+            error = B::bor(error, B::bxor(B::band(must23, B::splat(0x80)), special));
+
+            previousIncomplete = B::subs(input, limits);
+        }
+        previous = input;
+    }
+
+    return !B::any(B::bor(error, previousIncomplete));
+}
+#if defined(UWS_UTF8_SIMD_X86) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef UWS_UTF8_SIMD_X86
+__attribute__((target("avx2")))
+static bool isValidUtf8Avx2(unsigned char *s, size_t length) {
+    return isValidUtf8Blocks<Utf8Block32>(s, length);
+}
+
+#ifndef __AVX2__
+__attribute__((target("ssse3")))
+static bool isValidUtf8Ssse3(unsigned char *s, size_t length) {
+    return isValidUtf8Blocks<Utf8Block16>(s, length);
+}
+
+/* Resolved once at startup, from the same CpuFeatures as xorBlocks */
+static bool (*const isValidUtf8Resolved)(unsigned char *, size_t) =
+    CpuFeatures::get().avx2 ? isValidUtf8Avx2 : (CpuFeatures::get().ssse3 ? isValidUtf8Ssse3 : isValidUtf8Scalar);
+#endif
+#endif
+#endif
+
+/* Validates Utf-8 with whatever vector unit we have, falling back to the scalar version for short strings */
+static inline bool isValidUtf8(unsigned char *s, size_t length)
+{
+#ifdef UWS_UTF8_SIMD_WIDTH
+    if (length >= UWS_UTF8_SIMD_WIDTH) {
+#if defined(__AVX2__)
+        return isValidUtf8Avx2(s, length);
+#elif defined(UWS_UTF8_SIMD_X86)
+        return isValidUtf8Resolved(s, length);
+#else
+        return isValidUtf8Blocks<Utf8Block16>(s, length);
+#endif
+    }
+#endif
+    return isValidUtf8Scalar(s, length);
+}
+
+/* Validates a message piece by piece. A code point split between pieces is held back in tail (at most 3 bytes)
+ * and validated once completed by the next piece. The last piece must leave nothing behind */
+static inline bool isValidUtf8Chunk(unsigned char *s, size_t length, unsigned char tail[3], unsigned char &tailLength, bool last) {
+    if (tailLength) {
+        unsigned char codePoint[4];
+        memcpy(codePoint, tail, tailLength);
+        size_t needed = tail[0] >= 0xF0 ? 4 : (tail[0] >= 0xE0 ? 3 : 2);
+        size_t taken = std::min(needed - tailLength, length);
+        memcpy(codePoint + tailLength, s, taken);
+        s += taken;
+        length -= taken;
+        if (tailLength + taken < needed) {
+            memcpy(tail, codePoint, tailLength + taken);
+            tailLength = (unsigned char) (tailLength + taken);
+            return !last;
+        }
+        tailLength = 0;
+        if (!isValidUtf8Scalar(codePoint, needed)) {
+            return false;
+        }
+    }
+
+    /* Look back at most 3 bytes for a leading byte missing some of its continuation bytes */
+    if (!last) {
+        for (size_t i = 1; i <= std::min<size_t>(3, length); i++) {
+            unsigned char c = s[length - i];
+            if ((c & 0xC0) == 0x80) {
+                continue;
+            }
+            if (c >= 0xC0 && (c >= 0xF0 ? 4u : (c >= 0xE0 ? 3u : 2u)) > i) {
+                memcpy(tail, s + length - i, i);
+                tailLength = (unsigned char) i;
+                length -= i;
+            }
+            break;
+        }
+    }
+
+    return isValidUtf8(s, length);
+}
+
 struct CloseFrame {
     uint16_t code;
     char *message;
@@ -193,13 +454,127 @@ static inline size_t formatClosePayload(char *dst, uint16_t code, const char *me
     return 0;
 }
 
+/* Clients mask, which takes 4 more bytes */
+template <bool isServer = true>
 static inline size_t messageFrameSize(size_t messageSize) {
+    const size_t maskLength = isServer ? 0 : 4;
     if (messageSize < 126) {
-        return 2 + messageSize;
+        return 2 + maskLength + messageSize;
     } else if (messageSize <= UINT16_MAX) {
-        return 4 + messageSize;
+        return 4 + maskLength + messageSize;
+    }
+    return 10 + maskLength + messageSize;
+}
+
+/* Masking keys of clients, xorshift64* per thread seeded from the clock and thread. This is not cryptographic:
+ * masking keeps untrusted scripts in browsers from choosing the bytes proxies see, and we run no such scripts */
+static inline uint32_t maskingKey() {
+    static thread_local uint64_t state = 0;
+    if (!state) {
+        state = ((uint64_t) time(nullptr) << 32) ^ (uint64_t) (uintptr_t) &state ^ (uint64_t) clock() ^ 0x9e3779b97f4a7c15ull;
+    }
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t) ((state * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+#ifdef UWS_UNMASK_SIMD_WIDTH
+/* dst = src ^ mask for whole blocks of 16 bytes, returning how many bytes that was. In place and moving down
+ * (dst below src) are both fine since every block is loaded before anything overlapping it is stored */
+static inline size_t xorBlocks16(char *dst, const char *src, uint64_t mask, size_t length) {
+    size_t blocks = length / 16;
+#if defined(__SSE2__)
+    __m128i wideMask = _mm_set1_epi64x((long long) mask);
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < blocks; i++) {
+        __m128i loaded = _mm_loadu_si128((__m128i *) (src + i * 16));
+        _mm_storeu_si128((__m128i *) (dst + i * 16), _mm_xor_si128(loaded, wideMask));
+    }
+#else
+    uint8x16_t wideMask = vreinterpretq_u8_u64(vdupq_n_u64(mask));
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < blocks; i++) {
+        uint8x16_t loaded = vld1q_u8((uint8_t *) (src + i * 16));
+        vst1q_u8((uint8_t *) (dst + i * 16), veorq_u8(loaded, wideMask));
+    }
+#endif
+    return blocks * 16;
+}
+
+#if defined(__SSE2__) && defined(__GNUC__)
+/* The same 32 and 64 bytes at a time, ending in 16 byte blocks */
+__attribute__((target("avx2")))
+static inline size_t xorBlocks32(char *dst, const char *src, uint64_t mask, size_t length) {
+    size_t blocks = length / 32;
+    __m256i wideMask = _mm256_set1_epi64x((long long) mask);
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < blocks; i++) {
+        __m256i loaded = _mm256_loadu_si256((__m256i *) (src + i * 32));
+        _mm256_storeu_si256((__m256i *) (dst + i * 32), _mm256_xor_si256(loaded, wideMask));
+    }
+    size_t done = blocks * 32;
+    return done + xorBlocks16(dst + done, src + done, mask, length - done);
+}
+
+__attribute__((target("avx512f")))
+static inline size_t xorBlocks64(char *dst, const char *src, uint64_t mask, size_t length) {
+    size_t blocks = length / 64;
+    __m512i wideMask = _mm512_set1_epi64((long long) mask);
+    #pragma GCC unroll 4
+    for (size_t i = 0; i < blocks; i++) {
+        __m512i loaded = _mm512_loadu_si512((void *) (src + i * 64));
+        _mm512_storeu_si512((void *) (dst + i * 64), _mm512_xor_si512(loaded, wideMask));
+    }
+    size_t done = blocks * 64;
+    return done + xorBlocks16(dst + done, src + done, mask, length - done);
+}
+#endif
+
+#ifdef UWS_UNMASK_DISPATCH
+/* Resolved once at startup */
+static size_t (*const xorBlocksResolved)(char *, const char *, uint64_t, size_t) =
+    CpuFeatures::get().avx512f ? xorBlocks64 : (CpuFeatures::get().avx2 ? xorBlocks32 : xorBlocks16);
+#endif
+#endif
+
+/* dst = src ^ mask for whole blocks of the widest vectors we have, returning how many bytes that was (a multiple of
+ * UWS_UNMASK_SIMD_WIDTH). In place and moving down (dst below src) are both fine */
+static inline size_t xorBlocks(char *dst, const char *src, uint64_t mask, size_t length) {
+#if defined(UWS_UNMASK_DISPATCH)
+    /* Short messages are not worth the indirect call */
+    if (length < UWS_UNMASK_SIMD_WIDTH) {
+        return 0;
+    }
+    return xorBlocksResolved(dst, src, mask, length);
+#elif defined(__AVX512F__)
+    return xorBlocks64(dst, src, mask, length);
+#elif defined(UWS_UNMASK_SIMD_WIDTH)
+    return xorBlocks16(dst, src, mask, length);
+#else
+    (void) dst;
+    (void) src;
+    (void) mask;
+    (void) length;
+    return 0;
+#endif
+}
+
+/* Copies length bytes masked, exactly (unlike the imprecise unmasking of the parser) */
+static inline void maskCopy(char *dst, const char *src, size_t length, uint32_t mask) {
+    uint64_t wideMask = (uint64_t) mask << 32 | mask;
+    size_t i = xorBlocks(dst, src, wideMask, length);
+    for (; i + 8 <= length; i += 8) {
+        uint64_t loaded;
+        memcpy(&loaded, src + i, 8);
+        loaded ^= wideMask;
+        memcpy(dst + i, &loaded, 8);
+    }
+    /* Blocks and words are multiples of 4 so the mask is still in phase */
+    const char *maskBytes = (const char *) &wideMask;
+    for (; i < length; i++) {
+        dst[i] = (char) (src[i] ^ maskBytes[i % 4]);
     }
-    return 10 + messageSize;
 }
 
 enum {
@@ -231,31 +606,19 @@ static inline size_t formatMessage(char *dst, const char *src, size_t length, Op
 
     //printf("%d\n", (int)dst[0]);
 
-    char mask[4];
-    if (!isServer) {
-        dst[1] |= 0x80;
-        uint32_t random = (uint32_t) rand();
-        memcpy(mask, &random, 4);
-        memcpy(dst + headerLength, &random, 4);
+    if constexpr (!isServer) {
+        dst[1] |= (char) 0x80;
+        uint32_t mask = maskingKey();
+        memcpy(dst + headerLength, &mask, 4);
         headerLength += 4;
+
+        /* Masking is the copy */
+        maskCopy(dst + headerLength, src, length, mask);
+    } else {
+        memcpy(dst + headerLength, src, length);
     }
 
     messageLength = headerLength + length;
-    memcpy(dst + headerLength, src, length);
-
-    if (!isServer) {
-
-        // overwrites up to 3 bytes outside of the given buffer!
-        //WebSocketProtocol<isServer>::unmaskInplace(dst + headerLength, dst + headerLength + length, mask);
-
-        // this is not optimal
-        char *start = dst + headerLength;
-        char *stop = start + length;
-        int i = 0;
-        while (start != stop) {
-            (*start++) ^= mask[i++ % 4];
-        }
-    }
     return messageLength;
 }
 
@@ -284,8 +647,23 @@ protected:
         data[N - 1] ^= mask[(N - 1) % 4];
     }
 
+#ifdef UWS_UNMASK_SIMD_WIDTH
+    /* Unmasks whole blocks only (and moves them DESTINATION bytes down), returning how many bytes that was.
+     * Moving down block by block is fine since every block is loaded before anything overlapping it is stored. */
+    template <int DESTINATION>
+    static inline unsigned int unmaskBlocks(char *src, uint64_t mask, unsigned int length) {
+        return (unsigned int) protocol::xorBlocks(src - DESTINATION, src, mask, length);
+    }
+#endif
+
     template <int DESTINATION>
     static inline void unmaskImprecise8(char *src, uint64_t mask, unsigned int length) {
+#ifdef UWS_UNMASK_SIMD_WIDTH
+        /* Blocks are multiples of 4 so the mask stays in phase for the imprecise tail */
+        unsigned int unmasked = unmaskBlocks<DESTINATION>(src, mask, length);
+        src += unmasked;
+        length -= unmasked;
+#endif
         for (unsigned int n = (length >> 3) + 1; n; n--) {
             uint64_t loaded;
             memcpy(&loaded, src, 8);
@@ -331,6 +709,14 @@ protected:
     }
 
     static inline void unmaskInplace(char *data, char *stop, char *mask) {
+#ifdef UWS_UNMASK_SIMD_WIDTH
+        if (stop - data >= UWS_UNMASK_SIMD_WIDTH) {
+            char doubleMask[8] = {mask[0], mask[1], mask[2], mask[3], mask[0], mask[1], mask[2], mask[3]};
+            uint64_t maskInt;
+            memcpy(&maskInt, doubleMask, 8);
+            data += unmaskBlocks<0>(data, maskInt, (unsigned int) (stop - data));
+        }
+#endif
         while (data < stop) {
             *(data++) ^= mask[0];
             *(data++) ^= mask[1];
@@ -400,9 +786,14 @@ protected:
 
     /* This one is nicely vectorized on both ARM64 and X64 - especially with -mavx */
     static inline void unmaskAll(char * __restrict data, char * __restrict mask) {
+#ifdef UWS_UNMASK_SIMD_WIDTH
+        /* The receive buffer is a multiple of any block width so this takes no tail */
+        unmaskInplace(data, data + LIBUS_RECV_BUFFER_LENGTH, mask);
+#else
         for (int i = 0; i < LIBUS_RECV_BUFFER_LENGTH; i += 16) {
             UnrolledXor<16>(data + i, mask);
         }
+#endif
     }
 
     static inline bool consumeContinuation(char *&src, unsigned int &length, WebSocketState<isServer> *wState, void *user) {
@@ -0,0 +1,186 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_WEBTRANSPORT_H
+#define UWS_WEBTRANSPORT_H
+
+extern "C" {
+#include "quic.h"
+}
+
+#include "Http3Response.h"
+#include "WebTransportData.h"
+#include "WebTransportContextData.h"
+
+#include <string>
+#include <string_view>
+
+namespace uWS {
+
+/* A WebTransport session, is the quic stream of its extended CONNECT. Messages are DATAGRAM capsules on that stream,
+ * so they arrive reliably and in order like those of a WebSocket: QUIC DATAGRAM frames (unreliable, unordered) are not
+ * something our quic layer sends or receives. Messages are dropped rather than queued once the stream is backed up,
+ * so a slow peer gets the latest state instead of an ever longer backlog */
+template <typename USERDATA>
+struct WebTransport {
+    friend struct Http3Response;
+private:
+    Http3ResponseData *getResponseData() {
+        return (Http3ResponseData *) us_quic_stream_ext((us_quic_stream_t *) this);
+    }
+
+    WebTransportData *getWebTransportData() {
+        return getResponseData()->webTransport;
+    }
+
+    WebTransportContextData<USERDATA> *getContextData() {
+        return (WebTransportContextData<USERDATA> *) getWebTransportData()->contextData;
+    }
+
+    /* Takes one capsule of the peer, returns false if the session is over */
+    bool handleCapsule(uint64_t type, std::string_view payload) {
+        WebTransportData *webTransportData = getWebTransportData();
+
+        switch (type) {
+        case webtransport::DATAGRAM:
+            if (!webTransportData->isShuttingDown && getContextData()->messageHandler) {
+                getContextData()->messageHandler(this, payload);
+            }
+            return true;
+        case webtransport::CLOSE_WEBTRANSPORT_SESSION:
+            if (payload.length() < 4 || payload.length() > 4 + webtransport::MAX_CLOSE_REASON_LENGTH) {
+                close();
+                return false;
+            }
+            if (!webTransportData->isShuttingDown) {
+                webTransportData->closeCode = (uint32_t) (unsigned char) payload[0] << 24 | (uint32_t) (unsigned char) payload[1] << 16
+                    | (uint32_t) (unsigned char) payload[2] << 8 | (uint32_t) (unsigned char) payload[3];
+                webTransportData->closeReason = payload.substr(4);
+                shutdown();
+            }
+            return false;
+        default:
+            /* DRAIN_WEBTRANSPORT_SESSION asks us to wrap up, which is up to the application. Unknown ones are ignored */
+            return true;
+        }
+    }
+
+    /* Our side of the stream ends once what is buffered went out */
+    void shutdown() {
+        getWebTransportData()->isShuttingDown = true;
+        ((Http3Response *) this)->end();
+    }
+
+public:
+    enum SendStatus : int {
+        SUCCESS,
+        /* Not sent, the stream holds more than maxBackpressure or the session is closing */
+        DROPPED
+    };
+
+    /* Returns pointer to the per session user data */
+    USERDATA *getUserData() {
+        return &((WebTransportSessionData<USERDATA> *) getWebTransportData())->userData;
+    }
+
+    /* What the stream holds, not yet taken by QUIC */
+    unsigned int getBufferedAmount() {
+        return (unsigned int) getResponseData()->backpressure.length();
+    }
+
+    /* Sends one message, as a capsule on the stream of the session */
+    SendStatus send(std::string_view message) {
+        if (getWebTransportData()->isShuttingDown || getBufferedAmount() + message.length() > getContextData()->maxBackpressure) {
+            return DROPPED;
+        }
+
+        /* The capsule header fits a small string, the message is not copied into it */
+        std::string header;
+        webtransport::writeVarint(header, webtransport::DATAGRAM);
+        webtransport::writeVarint(header, message.length());
+        ((Http3Response *) this)->write(header);
+        ((Http3Response *) this)->write(message);
+        return SUCCESS;
+    }
+
+    /* Closes the session with CLOSE_WEBTRANSPORT_SESSION, then ends the stream. The close handler follows when the
+     * stream is closed */
+    void end(int code = 0, std::string_view message = {}) {
+        WebTransportData *webTransportData = getWebTransportData();
+        if (webTransportData->isShuttingDown) {
+            return;
+        }
+        webTransportData->closeCode = (uint32_t) code;
+        webTransportData->closeReason = message.substr(0, webtransport::MAX_CLOSE_REASON_LENGTH);
+
+        std::string capsule;
+        webtransport::formatClose(capsule, (uint32_t) code, message);
+        ((Http3Response *) this)->write(capsule);
+        shutdown();
+    }
+
+    /* Resets the stream right away, nothing buffered is sent */
+    void close() {
+        getWebTransportData()->isShuttingDown = true;
+        us_quic_stream_close((us_quic_stream_t *) this);
+    }
+
+    /* Subscribe to a topic of the H3App, like WebSocket::subscribe. Its messages are sent as with send */
+    bool subscribe(std::string_view topic) {
+        WebTransportData *webTransportData = getWebTransportData();
+        WebTransportTopicTree *topicTree = getContextData()->topicTree;
+
+        if (!webTransportData->subscriber) {
+            webTransportData->subscriber = topicTree->createSubscriber();
+            webTransportData->subscriber->user = this;
+        }
+
+        if (topicTree->subscribe(webTransportData->subscriber, topic)) {
+            topicTree->forEachRetained(topic, [this](std::string &message) {
+                send(message);
+            });
+        }
+        return true;
+    }
+
+    /* Unsubscribe from a topic, returns true if we were subscribed */
+    bool unsubscribe(std::string_view topic) {
+        WebTransportData *webTransportData = getWebTransportData();
+        if (!webTransportData->subscriber) {
+            return false;
+        }
+        return std::get<0>(getContextData()->topicTree->unsubscribe(webTransportData->subscriber, topic));
+    }
+
+    bool isSubscribed(std::string_view topic) {
+        WebTransportData *webTransportData = getWebTransportData();
+        if (!webTransportData->subscriber) {
+            return false;
+        }
+        Topic *topicPtr = getContextData()->topicTree->lookupTopic(topic);
+        return topicPtr && topicPtr->count(webTransportData->subscriber);
+    }
+
+    /* Publishes to everyone subscribing to topic but us, see H3App::publish */
+    bool publish(std::string_view topic, std::string_view message) {
+        return getContextData()->topicTree->publish(getWebTransportData()->subscriber, topic, std::string(message));
+    }
+};
+
+}
+
+#endif // UWS_WEBTRANSPORT_H
@@ -0,0 +1,49 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_WEBTRANSPORTCONTEXTDATA_H
+#define UWS_WEBTRANSPORTCONTEXTDATA_H
+
+#include "MoveOnlyFunction.h"
+#include "TopicTree.h"
+#include "WebTransportData.h"
+
+#include <string_view>
+
+namespace uWS {
+
+template <typename USERDATA> struct WebTransport;
+
+/* Topics of an H3App, messages of which go out to WebTransport sessions */
+using WebTransportTopicTree = TopicTree<std::string, std::string_view>;
+
+/* The behavior of one WebTransport route, like WebSocketContextData */
+template <typename USERDATA>
+struct WebTransportContextData {
+    MoveOnlyFunction<void(WebTransport<USERDATA> *)> openHandler = nullptr;
+    MoveOnlyFunction<void(WebTransport<USERDATA> *, std::string_view)> messageHandler = nullptr;
+    MoveOnlyFunction<void(WebTransport<USERDATA> *, int, std::string_view)> closeHandler = nullptr;
+
+    unsigned int maxPayloadLength;
+    unsigned int maxBackpressure;
+
+    WebTransportTopicTree *topicTree;
+};
+
+}
+
+#endif // UWS_WEBTRANSPORTCONTEXTDATA_H
@@ -0,0 +1,56 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_WEBTRANSPORTDATA_H
+#define UWS_WEBTRANSPORTDATA_H
+
+#include "WebTransportProtocol.h"
+#include "TopicTree.h"
+
+#include <string>
+
+namespace uWS {
+
+/* One WebTransport session, allocated on upgrade and freed when its stream closes. The user data follows,
+ * see WebTransportSessionData */
+struct WebTransportData {
+    /* The WebTransportContextData of its route */
+    void *contextData;
+
+    webtransport::CapsuleParser parser;
+    Subscriber *subscriber = nullptr;
+
+    /* We or the peer closed the session, nothing more is sent */
+    bool isShuttingDown = false;
+
+    /* From CLOSE_WEBTRANSPORT_SESSION, sent or received, for the close handler */
+    uint32_t closeCode = 0;
+    std::string closeReason;
+
+    WebTransportData(void *contextData) : contextData(contextData) {}
+};
+
+template <typename USERDATA>
+struct WebTransportSessionData : WebTransportData {
+    USERDATA userData;
+
+    WebTransportSessionData(void *contextData, USERDATA &&userData) : WebTransportData(contextData), userData(std::move(userData)) {}
+};
+
+}
+
+#endif // UWS_WEBTRANSPORTDATA_H
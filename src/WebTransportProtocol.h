@@ -0,0 +1,167 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_WEBTRANSPORTPROTOCOL_H
+#define UWS_WEBTRANSPORTPROTOCOL_H
+
+/* The capsule protocol (RFC 9297) spoken on the CONNECT stream of a WebTransport session */
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace uWS::webtransport {
+
+enum CapsuleType : uint64_t {
+    /* An HTTP datagram carried on the stream (RFC 9297 3.5), its payload is the message */
+    DATAGRAM = 0x00,
+    /* Error code (4 bytes) then reason */
+    CLOSE_WEBTRANSPORT_SESSION = 0x2843,
+    DRAIN_WEBTRANSPORT_SESSION = 0x78ae
+};
+
+/* What the extended CONNECT carries as :protocol */
+static constexpr std::string_view PROTOCOL = "webtransport";
+
+/* The reason of CLOSE_WEBTRANSPORT_SESSION is at most this long */
+static constexpr size_t MAX_CLOSE_REASON_LENGTH = 1024;
+
+/* QUIC variable length integers, RFC 9000 16. Returns false if data ends before the integer does */
+static inline bool readVarint(std::string_view data, size_t &pos, uint64_t &value) {
+    if (pos >= data.length()) {
+        return false;
+    }
+    size_t length = (size_t) 1 << ((unsigned char) data[pos] >> 6);
+    if (data.length() - pos < length) {
+        return false;
+    }
+    value = (unsigned char) data[pos] & 0x3f;
+    for (size_t i = 1; i < length; i++) {
+        value = value << 8 | (unsigned char) data[pos + i];
+    }
+    pos += length;
+    return true;
+}
+
+/* Shortest encoding, values must be below 2^62 */
+static inline void writeVarint(std::string &out, uint64_t value) {
+    int length = value < 0x40 ? 1 : value < 0x4000 ? 2 : value < 0x40000000 ? 4 : 8;
+    static constexpr unsigned char prefixes[9] = {0, 0x00, 0x40, 0, 0x80, 0, 0, 0, 0xc0};
+    for (int i = length - 1; i >= 0; i--) {
+        unsigned char byte = (unsigned char) (value >> (8 * i));
+        out.push_back((char) (i == length - 1 ? (byte | prefixes[length]) : byte));
+    }
+}
+
+static inline void formatCapsule(std::string &out, uint64_t type, std::string_view payload) {
+    writeVarint(out, type);
+    writeVarint(out, payload.length());
+    out.append(payload);
+}
+
+static inline void formatClose(std::string &out, uint32_t code, std::string_view reason) {
+    reason = reason.substr(0, MAX_CLOSE_REASON_LENGTH);
+    writeVarint(out, CLOSE_WEBTRANSPORT_SESSION);
+    writeVarint(out, 4 + reason.length());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back((char) (code >> shift));
+    }
+    out.append(reason);
+}
+
+/* Hands over whole capsules, buffering only the one split across reads (like http2::FrameParser) */
+struct CapsuleParser {
+    enum Result {
+        OK,
+        /* The callback returned false */
+        STOPPED,
+        /* A capsule longer than maxLength */
+        TOO_BIG
+    };
+
+private:
+    std::string buffer;
+
+    /* Length of the whole capsule starting at data, 0 if its header is not all there yet */
+    static size_t capsuleLength(std::string_view data, uint64_t &type, size_t &headerLength, uint64_t &payloadLength) {
+        size_t pos = 0;
+        if (!readVarint(data, pos, type) || !readVarint(data, pos, payloadLength)) {
+            return 0;
+        }
+        headerLength = pos;
+        return pos + payloadLength;
+    }
+
+public:
+    /* cb(type, payload) returns false to stop. Unknown types are handed over as well, to be ignored */
+    template <typename F>
+    Result consume(std::string_view data, size_t maxLength, F cb) {
+        /* Complete what was left over first, taking only as much as it needs */
+        while (buffer.length()) {
+            uint64_t type, payloadLength;
+            size_t headerLength;
+            size_t needed = capsuleLength(buffer, type, headerLength, payloadLength);
+            if (!needed) {
+                if (!data.length()) {
+                    return OK;
+                }
+                /* The header is at most 16 bytes, add a byte at a time until it is whole */
+                buffer.push_back(data[0]);
+                data.remove_prefix(1);
+                continue;
+            }
+            if (payloadLength > maxLength) {
+                return TOO_BIG;
+            }
+            size_t take = std::min<size_t>(needed - buffer.length(), data.length());
+            buffer.append(data.data(), take);
+            data.remove_prefix(take);
+            if (buffer.length() < needed) {
+                return OK;
+            }
+            bool proceed = cb(type, std::string_view(buffer).substr(headerLength));
+            buffer.clear();
+            if (!proceed) {
+                return STOPPED;
+            }
+        }
+
+        /* Capsules within data are handed over in place */
+        while (data.length()) {
+            uint64_t type, payloadLength;
+            size_t headerLength;
+            size_t needed = capsuleLength(data, type, headerLength, payloadLength);
+            if (needed && payloadLength > maxLength) {
+                return TOO_BIG;
+            }
+            if (!needed || needed > data.length()) {
+                buffer.assign(data.data(), data.length());
+                return OK;
+            }
+            if (!cb(type, data.substr(headerLength, payloadLength))) {
+                return STOPPED;
+            }
+            data.remove_prefix(needed);
+        }
+        return OK;
+    }
+};
+
+}
+
+#endif // UWS_WEBTRANSPORTPROTOCOL_H
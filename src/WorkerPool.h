@@ -0,0 +1,182 @@
+/*
+ * Authored by Alex Hultman, 2018-2026.
+ * Intellectual property of third-party.
+
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+
+ *     http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UWS_WORKERPOOL_H
+#define UWS_WORKERPOOL_H
+
+/* Worker threads for CPU heavy work off the event loops, see Loop::offload. Every worker has a queue of its own,
+ * jobs are posted to them in turn and a worker out of jobs steals the newest of another, so that one slow job
+ * does not hold up those queued behind it while others idle. */
+
+#include "MoveOnlyFunction.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+/* Number of worker threads, 0 is one per hardware thread */
+#ifndef UWS_WORKER_POOL_THREADS
+#define UWS_WORKER_POOL_THREADS 0
+#endif
+
+namespace uWS {
+
+struct WorkerPool {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<MoveOnlyFunction<void()>> jobs;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<unsigned int> nextWorker{0};
+    /* Posted and not yet taken, what sleeping workers wait for */
+    std::atomic<unsigned int> pending{0};
+    std::mutex sleepMutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    /* The oldest of our own jobs, else the newest of someone else's */
+    bool take(unsigned int index, MoveOnlyFunction<void()> &job) {
+        for (unsigned int i = 0; i < workers.size(); i++) {
+            Worker &worker = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.jobs.size()) {
+                if (!i) {
+                    job = std::move(worker.jobs.front());
+                    worker.jobs.pop_front();
+                } else {
+                    job = std::move(worker.jobs.back());
+                    worker.jobs.pop_back();
+                }
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(unsigned int index) {
+        while (true) {
+            MoveOnlyFunction<void()> job;
+            if (take(index, job)) {
+                job();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            condition.wait(lock, [this]() { return stopping || pending.load(std::memory_order_relaxed); });
+            if (stopping && !pending.load(std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+public:
+    WorkerPool(unsigned int numThreads = UWS_WORKER_POOL_THREADS) {
+        if (!numThreads) {
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (unsigned int i = 0; i < numThreads; i++) {
+            workers.emplace_back(new Worker);
+        }
+        for (unsigned int i = 0; i < numThreads; i++) {
+            threads.emplace_back([this, i]() {
+                run(i);
+            });
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    /* Finishes what was posted, then joins */
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+
+    /* Shared by all loops, started on first use */
+    static WorkerPool &get() {
+        static WorkerPool workerPool;
+        return workerPool;
+    }
+
+    /* Runs job on some worker, from any thread */
+    void post(MoveOnlyFunction<void()> &&job) {
+        Worker &worker = *workers[nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.jobs.emplace_back(std::move(job));
+        }
+        pending.fetch_add(1, std::memory_order_relaxed);
+
+        /* A worker about to sleep either sees pending or is already waiting when we notify */
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        condition.notify_one();
+    }
+
+    unsigned int size() {
+        return (unsigned int) threads.size();
+    }
+};
+
+/* Whether what offloaded work is for is still there when its result comes back. The socket holds one reference
+ * and clears alive when it is done with the request (or closes), every job out holds another. Only ever touched
+ * on the thread of the loop */
+struct OffloadGuard {
+    bool alive = true;
+    unsigned int refs = 1;
+
+    OffloadGuard *retain() {
+        refs++;
+        return this;
+    }
+
+    void release() {
+        if (!--refs) {
+            delete this;
+        }
+    }
+
+    /* The reference of the socket */
+    static void invalidate(OffloadGuard *&guard) {
+        if (guard) {
+            guard->alive = false;
+            guard->release();
+            guard = nullptr;
+        }
+    }
+};
+
+}
+
+#endif // UWS_WORKERPOOL_H
@@ -0,0 +1,226 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <random>
+#include <cstring>
+
+#include "../src/AsyncSocketData.h"
+
+/* Pops everything the way AsyncSocket drains it, segment by segment */
+std::string drain(uWS::BackPressure &backPressure, size_t maxPerWrite) {
+    std::string drained;
+    while (backPressure.length()) {
+        std::string_view front = backPressure.front();
+        size_t written = std::min(front.length(), maxPerWrite);
+        drained.append(front.data(), written);
+        backPressure.erase(written);
+    }
+    return drained;
+}
+
+int main() {
+    /* Empty */
+    uWS::BackPressure empty;
+    assert(empty.length() == 0 && empty.front().empty() && empty.second().empty());
+    empty.clear();
+
+    /* Random appends and partial drains against a plain string */
+    std::mt19937 rng(1234);
+    uWS::BackPressure backPressure;
+    std::string model;
+    for (int i = 0; i < 20000; i++) {
+        switch (rng() % 4) {
+        case 0:
+        case 1: {
+            /* Mostly small, sometimes bigger than a chunk or jumbo sized */
+            size_t length = rng() % 8 == 0 ? rng() % (200 * 1024) : rng() % 3000;
+            std::string data(length, (char) ('a' + rng() % 26));
+            backPressure.append(data.data(), data.length());
+            model.append(data);
+            break;
+        }
+        case 2: {
+            /* Contiguous room at the end, as getSendBuffer uses it */
+            size_t length = rng() % 30000;
+            char *room = backPressure.appendUninitialized(length);
+            for (size_t j = 0; j < length; j++) {
+                room[j] = (char) ('A' + (j % 26));
+                model.push_back((char) ('A' + (j % 26)));
+            }
+            break;
+        }
+        case 3: {
+            size_t length = model.length() ? rng() % (model.length() + 1) : 0;
+            std::string drained;
+            while (drained.length() < length) {
+                std::string_view front = backPressure.front();
+                assert(front.length());
+                size_t written = std::min(front.length(), length - drained.length());
+                drained.append(front.data(), written);
+                backPressure.erase(written);
+            }
+            assert(drained == model.substr(0, length));
+            model.erase(0, length);
+            break;
+        }
+        }
+        assert(backPressure.length() == model.length());
+
+        /* The second segment follows the first */
+        std::string_view front = backPressure.front(), second = backPressure.second();
+        assert(model.compare(0, front.length(), front) == 0);
+        assert(model.compare(front.length(), second.length(), second) == 0);
+
+        /* And so do all the others */
+        std::string_view segments[8];
+        size_t offset = 0, numSegments = backPressure.segments(segments, 8);
+        for (size_t i = 0; i < numSegments; i++) {
+            assert(model.compare(offset, segments[i].length(), segments[i]) == 0);
+            offset += segments[i].length();
+        }
+        assert(numSegments == 8 || offset == model.length());
+    }
+    assert(drain(backPressure, 1000) == model);
+
+    /* Moving hands over the chain */
+    backPressure.append("hello", 5);
+    uWS::BackPressure moved(std::move(backPressure));
+    assert(backPressure.length() == 0 && moved.length() == 5);
+    assert(drain(moved, 2) == "hello");
+
+    /* Shared frames are referenced, not copied, and live until every backpressure drained them */
+    uWS::SharedFrame *frame = uWS::SharedFrame::create(10);
+    memcpy(frame->data(), "0123456789", 10);
+    uWS::BackPressure first, second;
+    first.append("ab", 2);
+    first.appendShared(frame, 0);
+    first.append("cd", 2);
+    second.appendShared(frame, 4);
+    second.appendShared(frame, 10);
+    frame->release();
+    assert(frame->references == 2);
+    assert(first.front() == "ab" && first.second().data() == frame->data() && second.front().data() == frame->data() + 4);
+    assert(drain(first, 3) == "ab0123456789cd");
+    assert(frame->references == 1);
+    assert(drain(second, 100) == "456789");
+
+    /* Strings are moved into frames, never copied, and buffers share one frame */
+    std::string owned(100000, 'o');
+    const char *ownedData = owned.data();
+    {
+        uWS::SharedBuffer buffer(std::move(owned));
+        assert(buffer.view().data() == ownedData && buffer.view().length() == 100000);
+        uWS::SharedBuffer copy = buffer;
+        assert(copy.getFrame() == buffer.getFrame() && buffer.getFrame()->references == 2);
+        uWS::BackPressure referencing;
+        referencing.appendShared(buffer.getFrame(), 99990);
+        assert(buffer.getFrame()->references == 3);
+        assert(referencing.front().data() == ownedData + 99990);
+        assert(drain(referencing, 4) == std::string(10, 'o'));
+        assert(buffer.getFrame()->references == 2);
+
+        uWS::SharedBuffer copied(std::string_view("copied"));
+        copy = copied;
+        assert(buffer.getFrame()->references == 1 && copied.getFrame()->references == 2 && copy.view() == "copied");
+    }
+
+    /* Drained standard chunks are reused */
+    uWS::BackPressurePool::get().trim();
+    std::string big(100000, 'x');
+    for (int i = 0; i < 10; i++) {
+        uWS::BackPressure reused;
+        for (int j = 0; j < 50; j++) {
+            reused.append(big.data(), 1000);
+        }
+        reused.clear();
+    }
+    assert(uWS::BackPressurePool::get().numFreeChunks > 0 && uWS::BackPressurePool::get().numFreeChunks <= 4);
+
+    /* Only sockets holding backpressure pay for it, draining everything gives the queue back */
+    static_assert(sizeof(uWS::BackPressure) == sizeof(void *));
+    uWS::BackPressure lazy;
+    assert(lazy.appendUninitialized(0) == nullptr);
+    lazy.append("hello", 5);
+    lazy.erase(5);
+    assert(lazy.length() == 0 && lazy.front().empty() && lazy.appendUninitialized(0) == nullptr);
+    lazy.append("again", 5);
+    assert(lazy.length() == 5 && lazy.front() == "again");
+    lazy.clear();
+
+    /* Inserted bytes go in at the first boundary not yet drained, in the order they were inserted */
+    {
+        uWS::BackPressure boundaries;
+        assert(boundaries.insertUninitialized(1) == nullptr);
+        boundaries.append("aaaa", 4);
+        assert(boundaries.insertUninitialized(1) == nullptr);
+        boundaries.markBoundary();
+        boundaries.append("bbbb", 4);
+        boundaries.markBoundary();
+        boundaries.append("cc", 2);
+
+        /* Only the last boundary of a chunk is known, so this goes after bbbb */
+        memcpy(boundaries.insertUninitialized(1), "1", 1);
+        memcpy(boundaries.insertUninitialized(1), "2", 1);
+        boundaries.append("dd", 2);
+        assert(boundaries.length() == 14);
+        std::string drained = drain(boundaries, 3);
+        assert(drained == "aaaabbbb12ccdd");
+
+        /* Drained up to a boundary, it goes in front */
+        boundaries.append("eeee", 4);
+        boundaries.markBoundary();
+        boundaries.append("ff", 2);
+        boundaries.erase(4);
+        memcpy(boundaries.insertUninitialized(1), "3", 1);
+        assert(drain(boundaries, 100) == "3ff");
+
+        /* Drained past the boundary, no boundary is left */
+        boundaries.append("gggg", 4);
+        boundaries.markBoundary();
+        boundaries.append("hh", 2);
+        boundaries.erase(5);
+        assert(boundaries.insertUninitialized(1) == nullptr);
+        boundaries.clear();
+
+        /* Shared frames, and messages across chunks */
+        uWS::SharedBuffer frame(std::string_view("shared"));
+        boundaries.append(big.data(), 20000);
+        boundaries.markBoundary();
+        boundaries.appendShared(frame.getFrame(), 0);
+        boundaries.markBoundary();
+        boundaries.erase(19999);
+        memcpy(boundaries.insertUninitialized(1), "4", 1);
+        boundaries.appendShared(frame.getFrame(), 0);
+        memcpy(boundaries.insertUninitialized(1), "5", 1);
+        assert(drain(boundaries, 2) == "x45sharedshared");
+        assert(frame.getFrame()->references == 1);
+    }
+
+    /* The pool counts what its thread holds, shared frames once per reference, and reports it to the process */
+    {
+        uWS::BackPressurePool &pool = uWS::BackPressurePool::get();
+        pool.report();
+        size_t held = pool.held, total = uWS::BackPressurePool::processTotal().load();
+        uWS::BackPressure counted;
+        counted.append(big.data(), 50000);
+        memcpy(counted.appendUninitialized(100), big.data(), 100);
+        uWS::SharedBuffer shared(std::string_view(big.data(), 1000));
+        counted.appendShared(shared.getFrame(), 200);
+        uWS::BackPressure other;
+        other.appendShared(shared.getFrame(), 0);
+        assert(pool.held == held + 50000 + 100 + 800 + 1000);
+        assert(pool.processHeld() == total + 51900 && uWS::BackPressurePool::processTotal().load() == total);
+        pool.report();
+        assert(uWS::BackPressurePool::processTotal().load() == total + 51900);
+        counted.erase(30000);
+        other.clear();
+        assert(pool.held == held + 20900);
+        counted.clear();
+        pool.report();
+        assert(pool.held == held && uWS::BackPressurePool::processTotal().load() == total);
+    }
+
+    uWS::BackPressurePool::get().trim();
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <cassert>
+#include <vector>
+
+#include "../src/BlockPool.h"
+#include "../src/Coroutine.h"
+
+/* Suspends until resumed from the outside, like the awaiters of HttpResponse and WebSocket */
+struct Resumer {
+    std::coroutine_handle<> handle;
+
+    auto operator co_await() {
+        struct Awaiter {
+            Resumer *resumer;
+            bool await_ready() {
+                return false;
+            }
+            void await_suspend(std::coroutine_handle<> h) {
+                resumer->handle = h;
+            }
+            void await_resume() {}
+        };
+        return Awaiter{this};
+    }
+};
+
+uWS::Task count(Resumer &resumer, int &counter) {
+    counter++;
+    co_await resumer;
+    counter++;
+    co_await resumer;
+    counter++;
+}
+
+int main() {
+    uWS::BlockPool &pool = uWS::BlockPool::get();
+
+    /* Size classes are powers of two from 64 */
+    assert(uWS::BlockPool::sizeClass(1) == 0 && uWS::BlockPool::sizeClass(64) == 0);
+    assert(uWS::BlockPool::sizeClass(65) == 1 && uWS::BlockPool::sizeClass(4096) == 6);
+
+    /* Given back blocks are taken again, from their own size class */
+    void *a = pool.allocate(100);
+    pool.deallocate(a, 100);
+    assert(pool.allocate(128) == a);
+    void *b = pool.allocate(64);
+    assert(b != a);
+    pool.deallocate(a, 128);
+    pool.deallocate(b, 64);
+    assert(pool.allocate(20) == b);
+    pool.deallocate(b, 20);
+
+    /* Big ones are not pooled, and the pool only holds so many of a size class */
+    pool.deallocate(pool.allocate(100000), 100000);
+    std::vector<void *> blocks;
+    for (unsigned int i = 0; i < uWS::BlockPool::MAX_FREE_BLOCKS + 10; i++) {
+        blocks.push_back(pool.allocate(1000));
+    }
+    for (void *block : blocks) {
+        pool.deallocate(block, 1000);
+    }
+    assert(pool.numFreeBlocks[uWS::BlockPool::sizeClass(1000)] == uWS::BlockPool::MAX_FREE_BLOCKS);
+
+    /* Tasks start right away, and free their frame to the pool when done */
+    Resumer resumer;
+    int counter = 0;
+    count(resumer, counter);
+    assert(counter == 1);
+    resumer.handle.resume();
+    assert(counter == 2);
+    unsigned int freeBlocks = 0;
+    for (unsigned int c = 0; c < uWS::BlockPool::NUM_SIZE_CLASSES; c++) {
+        freeBlocks += pool.numFreeBlocks[c];
+    }
+    resumer.handle.resume();
+    assert(counter == 3);
+    unsigned int freeBlocksAfter = 0;
+    for (unsigned int c = 0; c < uWS::BlockPool::NUM_SIZE_CLASSES; c++) {
+        freeBlocksAfter += pool.numFreeBlocks[c];
+    }
+    assert(freeBlocksAfter == freeBlocks + 1);
+
+    /* Frames of the next task are taken from the pool */
+    count(resumer, counter);
+    for (int i = 0; i < 2; i++) {
+        resumer.handle.resume();
+    }
+    assert(counter == 6);
+
+    pool.trim();
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -211,9 +211,74 @@ void testWithoutTrailer() {
     }
 }
 
+void testCoalescing(unsigned int maxConsume) {
+    /* Many tiny chunks, like IoT gateways send */
+    std::string expected, buffer;
+    for (int i = 0; i < 200; i++) {
+        std::string chunk(1 + i % 17, (char) ('a' + i % 26));
+        expected += chunk;
+        std::stringstream ss;
+        ss << std::hex << chunk.length() << "\r\n" << chunk << "\r\n";
+        buffer += ss.str();
+    }
+    buffer += "0\r\n\r\n";
+
+    std::string received;
+    unsigned int calls = 0;
+    bool fin = false;
+    uint64_t state = uWS::STATE_IS_CHUNKED;
+    std::string_view chunkEncoded = buffer;
+    while (chunkEncoded.length()) {
+        std::string_view data = chunkEncoded.substr(0, std::min<size_t>(maxConsume, chunkEncoded.length()));
+        size_t lengthBefore = data.length();
+        for (auto chunk : uWS::ChunkIterator(&data, &state, false, true)) {
+            if (!chunk.length()) {
+                fin = true;
+            }
+            received.append(chunk);
+            calls++;
+        }
+        if (uWS::isParsingInvalidChunkedEncoding(state)) {
+            std::abort();
+        }
+        chunkEncoded.remove_prefix(lengthBefore - data.length());
+    }
+
+    if (!fin || state || received != expected || chunkEncoded.length()) {
+        std::cerr << "Coalescing failed with maxConsume " << maxConsume << std::endl;
+        std::abort();
+    }
+
+    /* Everything in one read is one call plus the end */
+    if (maxConsume >= buffer.length() && calls != 2) {
+        std::cerr << "Expected one coalesced chunk, got " << calls - 1 << std::endl;
+        std::abort();
+    }
+}
+
+void testInvalidSize() {
+    for (std::string_view invalid : {"g\r\n", "1:\r\n", "@\r\n", "ffffffffffffffffff\r\n"}) {
+        std::string buffer(invalid);
+        std::string_view data = buffer;
+        uint64_t state = uWS::STATE_IS_CHUNKED;
+        for (auto chunk : uWS::ChunkIterator(&data, &state)) {
+            (void) chunk;
+        }
+        if (!uWS::isParsingInvalidChunkedEncoding(state)) {
+            std::cerr << "Accepted invalid chunk size " << invalid << std::endl;
+            std::abort();
+        }
+    }
+}
+
 int main() {
 
     testWithoutTrailer();
+    testInvalidSize();
+
+    for (unsigned int i = 1; i < 4000; i += (i < 100 ? 1 : 97)) {
+        testCoalescing(i);
+    }
 
     for (int i = 1; i < 1000; i++) {
         runBetterTest(i);
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+
+#include <sched.h>
+#include <sys/wait.h>
+
+#include "../src/ClusterSegment.h"
+
+int main() {
+    /* Topics added are always there, others mostly not */
+    uWS::InterestDigest digest;
+    for (int i = 0; i < 200; i++) {
+        digest.add("room/" + std::to_string(i));
+    }
+    int falsePositives = 0;
+    for (int i = 0; i < 200; i++) {
+        assert(digest.mayContain(uWS::InterestDigest::hash("room/" + std::to_string(i))));
+        falsePositives += digest.mayContain(uWS::InterestDigest::hash("other/" + std::to_string(i)));
+    }
+    assert(falsePositives < 10);
+
+    /* Merged digests hold both, wildcards hold everything, and they come back whole off the wire */
+    uWS::InterestDigest other;
+    other.add("lobby");
+    other.merge(digest);
+    assert(other.mayContain(uWS::InterestDigest::hash("lobby")) && other.mayContain(uWS::InterestDigest::hash("room/7")));
+    uWS::InterestDigest wildcard;
+    wildcard.everything = true;
+    assert(wildcard.mayContain(uWS::InterestDigest::hash("anything")));
+
+    char serialized[uWS::InterestDigest::SERIALIZED_LENGTH];
+    other.serialize(serialized);
+    uWS::InterestDigest received;
+    assert(received.deserialize(std::string_view(serialized, sizeof(serialized))) && received == other);
+    assert(!received.deserialize(std::string_view(serialized, 10)));
+
+    /* Messages take apart the way they were put together */
+    char header[uWS::ClusterMessage::HEADER_LENGTH];
+    uWS::ClusterMessage::formatHeader(header, 5, 2, true);
+    std::string encoded = std::string(header, sizeof(header)) + "topic" + "message";
+    std::string_view topic, message;
+    int opCode;
+    bool compress;
+    assert(uWS::ClusterMessage::parse(encoded, topic, message, opCode, compress));
+    assert(topic == "topic" && message == "message" && opCode == 2 && compress);
+    assert(!uWS::ClusterMessage::parse(std::string_view(encoded.data(), 6), topic, message, opCode, compress));
+
+    /* Processes agreeing on the geometry share a segment, others are turned away */
+    std::string name = "uws-test-" + std::to_string(getpid());
+    uWS::ClusterSegment segment;
+    assert(segment.open(name, 2, 1000));
+    assert(segment.getRingCapacity() == 1024);
+    uWS::ClusterSegment mismatched;
+    assert(!mismatched.open(name, 3, 1000));
+
+    /* Rings refuse what does not fit and wrap around their end */
+    uWS::SharedRing *ring = segment.ring(0, 1);
+    std::string big(600, 'x');
+    assert(ring->push(1024, {big}));
+    assert(!ring->push(1024, {big}));
+    assert(ring->pop(1024, [&big](std::string_view record) { assert(record == big); }) == 1);
+    assert(ring->push(1024, {"a", big}));
+    assert(ring->pop(1024, [&big](std::string_view record) { assert(record == "a" + big); }) == 1);
+    assert(!ring->push(1024, {std::string(2000, 'y')}));
+    assert(ring->push(1024, {""}));
+    ring->discard();
+    assert(!ring->pop(1024, [](std::string_view) { assert(false); }));
+
+    /* Another process publishes interest and streams messages through the ring, in order */
+    uWS::SharedRing *shared = segment.ring(1, 0);
+    const int count = 100000;
+    pid_t child = fork();
+    if (!child) {
+        uWS::ClusterSegment childSegment;
+        assert(childSegment.open(name, 2, 1000));
+        uWS::InterestDigest childDigest;
+        childDigest.add("child");
+        childSegment.slot(1)->store(childDigest);
+        for (int i = 0; i < count; ) {
+            std::string record = std::to_string(i);
+            if (childSegment.ring(1, 0)->push(1024, {record, std::string((size_t) i % 100, 'z')})) {
+                i++;
+            } else {
+                sched_yield();
+            }
+        }
+        _exit(0);
+    }
+
+    int next = 0;
+    while (next < count) {
+        if (!shared->pop(1024, [&next](std::string_view record) {
+            std::string expected = std::to_string(next);
+            assert(record.substr(0, expected.length()) == expected);
+            assert(record.length() == expected.length() + (size_t) next % 100);
+            next++;
+        })) {
+            sched_yield();
+        }
+    }
+    int status;
+    waitpid(child, &status, 0);
+    assert(WIFEXITED(status) && !WEXITSTATUS(status));
+    assert(segment.slot(1)->mayContain(uWS::InterestDigest::hash("child")));
+    uWS::InterestDigest loaded;
+    segment.slot(1)->load(loaded);
+    assert(loaded.mayContain(uWS::InterestDigest::hash("child")));
+
+    uWS::ClusterSegment::remove(name);
+
+    std::cout << "ALL PASS" << std::endl;
+}
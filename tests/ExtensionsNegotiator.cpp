@@ -9,11 +9,11 @@
 #include <iostream>
 
 void testNegotiation(bool wantCompression, int wantedCompressionWindow, int wantedInflationWindow, std::string_view offer,
-                    bool negCompression, int negCompressionWindow, int negInflationWindow, std::string_view negResponse) {
+                    bool negCompression, int negCompressionWindow, int negInflationWindow, std::string_view negResponse, int wantedDictionary = 0, bool negDictionary = false) {
 
-    auto [compression, compressionWindow, inflationWindow, response] = uWS::negotiateCompression(wantCompression, wantedCompressionWindow, wantedInflationWindow, offer);
+    auto [compression, compressionWindow, inflationWindow, response, dictionary] = uWS::negotiateCompression(wantCompression, wantedCompressionWindow, wantedInflationWindow, offer, wantedDictionary);
 
-    if (compression == negCompression && compressionWindow == negCompressionWindow && inflationWindow == negInflationWindow && response == negResponse) {
+    if (compression == negCompression && compressionWindow == negCompressionWindow && inflationWindow == negInflationWindow && response == negResponse && dictionary == negDictionary) {
         std::cout << "PASS" << std::endl;
     } else {
         std::cout << "FAIL: <" << response << "> is not expected <" << negResponse << ">" << std::endl;
@@ -51,6 +51,13 @@ int main() {
     testNegotiation(true, 15, 15, "x-webkit-deflate-frame", true, 15, 15, "x-webkit-deflate-frame");
     testNegotiation(true, 15, 15, "permessage-deflate", true, 15, 15, "permessage-deflate");
 
+    /* Preset dictionaries are used only when both have the same one */
+    testNegotiation(true, 0, 0, "permessage-deflate; x_uws_dictionary=7", true, 0, 0, "permessage-deflate; client_no_context_takeover; server_no_context_takeover; x_uws_dictionary=7", 7, true);
+    testNegotiation(true, 15, 15, "permessage-deflate; x_uws_dictionary=7", true, 15, 15, "permessage-deflate", 8, false);
+    testNegotiation(true, 15, 15, "permessage-deflate; x_uws_dictionary", true, 15, 15, "permessage-deflate", 1, false);
+    testNegotiation(true, 15, 15, "permessage-deflate; x_uws_dictionary=7", true, 15, 15, "permessage-deflate", 0, false);
+    testNegotiation(true, 15, 15, "x-webkit-deflate-frame; x_uws_dictionary=7", true, 15, 15, "x-webkit-deflate-frame", 7, false);
+
     /* Fail on invalid values */
     testNegotiation(true, 15, 15, "x-webkit-deflate-frame; max_window_bits=3", false, 0, 0, "");
     /* This one doesn't fail, but at least ignores the too high value */
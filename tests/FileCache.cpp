@@ -0,0 +1,72 @@
+#include "../src/FileCache.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <cstdio>
+
+static std::string tmpPath(int i) {
+    return "/tmp/uws_filecache_test_" + std::to_string(i);
+}
+
+static void writeFile(const std::string &path, const std::string &content) {
+    FILE *f = fopen(path.c_str(), "wb");
+    fwrite(content.data(), 1, content.length(), f);
+    fclose(f);
+}
+
+int main() {
+    std::cout << "TestFileCache" << std::endl;
+
+    for (int i = 0; i < 4; i++) {
+        writeFile(tmpPath(i), std::string((size_t) i + 1, 'a'));
+    }
+
+    /* Always revalidate so that replacing a file is seen right away */
+    uWS::FileCache cache(2, 0);
+
+    /* Hits share the same open file */
+    uWS::FileCache::File *first = cache.acquire(tmpPath(0));
+    assert(first && first->size == 1);
+    uWS::FileCache::File *again = cache.acquire(tmpPath(0));
+    assert(again == first);
+
+    /* Not there or not a regular file */
+    assert(!cache.acquire("/tmp/uws_filecache_test_missing"));
+    assert(!cache.acquire("/tmp"));
+
+    /* Busy files are never evicted, even over the limit */
+    uWS::FileCache::File *second = cache.acquire(tmpPath(1));
+    uWS::FileCache::File *third = cache.acquire(tmpPath(2));
+    assert(second && third && cache.size() == 3);
+    second->release();
+    third->release();
+    assert(cache.size() == 2);
+
+    /* The least recently used idle one went, the file in use stayed */
+    assert(cache.acquire(tmpPath(0)) == first);
+    first->release();
+
+    /* Replaced while in use, the old file stays readable for whoever has it */
+    writeFile(tmpPath(3), "old");
+    uWS::FileCache::File *oldFile = cache.acquire(tmpPath(3));
+    remove(tmpPath(3).c_str());
+    writeFile(tmpPath(3), "brand new");
+    uWS::FileCache::File *newFile = cache.acquire(tmpPath(3));
+    assert(newFile && newFile != oldFile && newFile->size == 9 && oldFile->size == 3);
+
+    char buf[3];
+    assert(pread(oldFile->fd, buf, 3, 0) == 3 && std::string(buf, 3) == "old");
+    oldFile->release();
+    newFile->release();
+
+    /* Everything still acquired goes back before the cache goes */
+    first->release();
+    first->release();
+
+    for (int i = 0; i < 4; i++) {
+        remove(tmpPath(i).c_str());
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,125 @@
+#include "../src/Handoff.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <arpa/inet.h>
+
+static void waitFor(std::atomic<int> &counter, int value) {
+    for (int i = 0; counter < value && i < 5000; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(counter == value);
+}
+
+int main() {
+    std::cout << "TestHandoff" << std::endl;
+
+    /* Payloads */
+    uWS::Handoff::Writer writer;
+    writer.number(3);
+    writer.number(300);
+    writer.number(UINT64_MAX);
+    writer.bytes("topic");
+    writer.bytes({});
+    uWS::Handoff::Reader reader{writer.out};
+    assert(reader.number() == 3 && reader.number() == 300 && reader.number() == UINT64_MAX);
+    assert(reader.bytes() == "topic" && reader.bytes().empty() && reader.ok && reader.in.empty());
+    reader.number();
+    assert(!reader.ok);
+    uWS::Handoff::Reader truncated{std::string_view(writer.out).substr(0, writer.out.length() - 3)};
+    truncated.number(), truncated.number(), truncated.number();
+    assert(truncated.bytes().empty() && !truncated.ok);
+
+    /* Messages, with a descriptor along */
+    int pair[2], pipeFds[2];
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, pair) && !pipe(pipeFds));
+    std::string big(200000, 'x');
+    std::thread sender([&]() {
+        assert(uWS::Handoff::send(pair[0], uWS::Handoff::LISTEN_SOCKET, {}, pipeFds[1]));
+        assert(uWS::Handoff::send(pair[0], uWS::Handoff::WEBSOCKET, big));
+        assert(uWS::Handoff::send(pair[0], uWS::Handoff::LISTENING));
+    });
+    uWS::Handoff::Type type;
+    std::string payload;
+    int fd;
+    assert(uWS::Handoff::receive(pair[1], type, payload, fd) && type == uWS::Handoff::LISTEN_SOCKET && payload.empty() && fd != -1);
+    assert(write(fd, "!", 1) == 1);
+    char c;
+    assert(read(pipeFds[0], &c, 1) == 1 && c == '!');
+    close(fd);
+    assert(uWS::Handoff::receive(pair[1], type, payload, fd) && type == uWS::Handoff::WEBSOCKET && payload == big && fd == -1);
+    assert(uWS::Handoff::receive(pair[1], type, payload, fd) && type == uWS::Handoff::LISTENING && fd == -1);
+    sender.join();
+    close(pair[0]);
+    assert(!uWS::Handoff::receive(pair[1], type, payload, fd));
+    close(pair[1]);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+
+    /* Whoever connects at the path gets a channel */
+    const char *path = "/tmp/uws_handoff_test.sock";
+    int listener = uWS::Handoff::listen(path);
+    assert(listener != -1 && uWS::Handoff::accept(listener) == -1);
+    int connected = uWS::Handoff::connect(path);
+    int channel = uWS::Handoff::accept(listener);
+    assert(connected != -1 && channel != -1);
+    assert(uWS::Handoff::connect("/tmp/uws_handoff_nobody.sock") == -1);
+
+    /* Taking over a listen socket accepts on it, and WebSockets come with their payload */
+    int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    assert(!bind(listenSocket, (sockaddr *) &address, sizeof(address)) && !::listen(listenSocket, 16));
+    assert(!getsockname(listenSocket, (sockaddr *) &address, &addressLength));
+    fcntl(listenSocket, F_SETFL, O_NONBLOCK);
+
+    std::atomic<int> accepted = 0, webSockets = 0;
+    std::string webSocketPayload;
+    {
+        uWS::Handoff handoff(channel, {listenSocket}, [&](int fd, char *ip, int ipLength) {
+            assert(ipLength == 4 && !memcmp(ip, "\x7f\0\0\x01", 4));
+            close(fd);
+            accepted++;
+        }, [&](int fd, std::string &&payload) {
+            webSocketPayload = std::move(payload);
+            close(fd);
+            webSockets++;
+        });
+
+        int clients[2];
+        for (int &client : clients) {
+            client = socket(AF_INET, SOCK_STREAM, 0);
+            assert(!::connect(client, (sockaddr *) &address, sizeof(address)));
+        }
+        waitFor(accepted, 2);
+
+        int socketFds[2];
+        assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, socketFds));
+        assert(uWS::Handoff::send(connected, uWS::Handoff::WEBSOCKET, "state", socketFds[0]));
+        waitFor(webSockets, 1);
+        assert(webSocketPayload == "state");
+
+        /* Done handing off, still accepting */
+        close(connected);
+        close(clients[0]);
+        clients[0] = socket(AF_INET, SOCK_STREAM, 0);
+        assert(!::connect(clients[0], (sockaddr *) &address, sizeof(address)));
+        waitFor(accepted, 3);
+
+        for (int client : clients) {
+            close(client);
+        }
+        close(socketFds[0]);
+        close(socketFds[1]);
+    }
+    close(listener);
+    unlink(path);
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "../src/Hpack.h"
+#include "../src/Http2Protocol.h"
+
+/* Hex to bytes, spaces ignored */
+std::string bytes(std::string hex) {
+    std::string out;
+    for (size_t i = 0; i < hex.length(); ) {
+        if (hex[i] == ' ') {
+            i++;
+            continue;
+        }
+        out.push_back((char) std::stoi(hex.substr(i, 2), nullptr, 16));
+        i += 2;
+    }
+    return out;
+}
+
+/* Every header as name: value, one per line */
+std::string decode(uWS::HpackDecoder &decoder, std::string block) {
+    std::string scratch, headers;
+    assert(decoder.decode(block, scratch, [&headers](std::string_view name, std::string_view value) {
+        headers.append(name).append(": ").append(value).append("\n");
+        return true;
+    }));
+    return headers;
+}
+
+void testRequests() {
+    /* RFC 7541 C.3, requests without Huffman coding sharing one dynamic table */
+    uWS::HpackDecoder decoder;
+    assert(decode(decoder, bytes("8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"))
+        == ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n");
+    assert(decode(decoder, bytes("8286 84be 5808 6e6f 2d63 6163 6865"))
+        == ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n");
+    assert(decode(decoder, bytes("8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65"))
+        == ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n");
+
+    /* RFC 7541 C.4, the same with Huffman coding */
+    uWS::HpackDecoder huffmanDecoder;
+    assert(decode(huffmanDecoder, bytes("8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff"))
+        == ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n");
+    assert(decode(huffmanDecoder, bytes("8286 84be 5886 a8eb 1064 9cbf"))
+        == ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n");
+    assert(decode(huffmanDecoder, bytes("8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"))
+        == ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n");
+}
+
+void testEviction() {
+    /* RFC 7541 C.5, responses evicting from a table of 256 bytes (set by a size update here) */
+    uWS::HpackDecoder decoder;
+    assert(decode(decoder, bytes("3fe1 01 4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d"))
+        == ":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n");
+    assert(decode(decoder, bytes("4803 3330 37c1 c0bf"))
+        == ":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n");
+    assert(decode(decoder, bytes("88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d 54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49 553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e 3d31"))
+        == ":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\nlocation: https://www.example.com\ncontent-encoding: gzip\n"
+        "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n");
+
+    /* Far more than fits, wrapping around the ring many times. The newest entry is always index 62 */
+    uWS::HpackDecoder wrapping;
+    for (int i = 0; i < 1000; i++) {
+        std::string name = "x-header-" + std::to_string(i), value(std::to_string(i * 7) + std::string((size_t) i % 200, 'v'));
+        std::string block;
+        block.push_back(0x40);
+        uWS::hpack::encodeString(block, name);
+        uWS::hpack::encodeString(block, value);
+        assert(decode(wrapping, block) == name + ": " + value + "\n");
+        assert(decode(wrapping, bytes("be")) == name + ": " + value + "\n");
+        /* Its name indexed for a new value, inserted while the old one may be evicted */
+        block = bytes("7e");
+        uWS::hpack::encodeString(block, "new");
+        assert(decode(wrapping, block) == name + ": new\n");
+    }
+
+    /* Size updates only come first and only shrink below our limit */
+    std::string scratch;
+    assert(!wrapping.decode(bytes("82 3fe1 01"), scratch, [](std::string_view, std::string_view) { return true; }));
+    uWS::HpackDecoder tooBig;
+    assert(!tooBig.decode(bytes("3fe2 1f"), scratch, [](std::string_view, std::string_view) { return true; }));
+}
+
+void testBroken() {
+    std::string scratch;
+    auto accept = [](std::string_view, std::string_view) { return true; };
+
+    /* Index 0, an index past the tables, strings running past the end, EOS and too much padding */
+    for (std::string block : {"80", "ff00", "410a 6162", "4181 ff", "4183 ffff ff", "4182 ffff"}) {
+        uWS::HpackDecoder decoder;
+        assert(!decoder.decode(bytes(block), scratch, accept));
+    }
+
+    /* Integers too big to be reasonable */
+    uWS::HpackDecoder decoder;
+    assert(!decoder.decode(bytes("ffff ffff ffff ff"), scratch, accept));
+}
+
+void testEncoder() {
+    /* Statuses of the static table are one byte, others a literal */
+    std::string block;
+    uWS::hpack::encodeStatus(block, "200");
+    assert(block == bytes("88"));
+    uWS::hpack::encodeStatus(block, "418");
+    uWS::hpack::encodeHeader(block, "content-type", "text/html; charset=utf-8");
+    uWS::hpack::encodeHeader(block, "x-custom", "value");
+    uWS::hpack::encodeHeader(block, "set-cookie", std::string(300, '\x01'));
+
+    /* Nothing is ever indexed, so any decoder decodes it any number of times */
+    uWS::HpackDecoder decoder;
+    std::string expected = ":status: 200\n:status: 418\ncontent-type: text/html; charset=utf-8\nx-custom: value\nset-cookie: " + std::string(300, '\x01') + "\n";
+    assert(decode(decoder, block) == expected);
+    assert(decode(decoder, block) == expected);
+
+    /* Every static name is found by its hash, nothing else is */
+    for (uint32_t i = 1; i <= uWS::hpack::STATIC_TABLE_LENGTH; i++) {
+        uint32_t index = uWS::hpack::findStaticName(uWS::hpack::staticTable[i][0]);
+        assert(index <= i && uWS::hpack::staticTable[index][0] == uWS::hpack::staticTable[i][0]);
+    }
+    assert(!uWS::hpack::findStaticName("x-custom") && !uWS::hpack::findStaticName("") && !uWS::hpack::findStaticName("hosts"));
+
+    /* Huffman codes of every byte come back */
+    std::string all;
+    for (int i = 0; i < 256; i++) {
+        all.push_back((char) i);
+    }
+    std::string encoded, decoded;
+    uWS::hpack::huffmanEncode(all + all, encoded);
+    assert(uWS::hpack::huffmanLength(all + all) == encoded.length());
+    assert(uWS::hpack::huffmanDecode(encoded, decoded) && decoded == all + all);
+}
+
+void testFrameParser() {
+    /* Frames come whole, whether in one read or split anywhere */
+    std::string stream(uWS::http2::PREFACE);
+    for (int i = 0; i < 20; i++) {
+        char header[uWS::http2::FRAME_HEADER_LENGTH];
+        std::string payload((size_t) i * 100, (char) ('a' + i));
+        uWS::http2::formatFrameHeader(header, (uint32_t) payload.length(), uWS::http2::DATA, (unsigned char) i, (uint32_t) i * 2 + 1);
+        stream.append(header, sizeof(header)).append(payload);
+    }
+
+    for (size_t readSize : {stream.length(), (size_t) 1, (size_t) 7, (size_t) 1000}) {
+        uWS::http2::FrameParser parser;
+        int frames = 0;
+        for (size_t offset = 0; offset < stream.length(); offset += readSize) {
+            assert(parser.consume(std::string_view(stream).substr(offset, readSize), uWS::http2::DEFAULT_MAX_FRAME_SIZE,
+                [&frames](uWS::http2::FrameType type, unsigned char flags, uint32_t streamId, std::string_view payload) {
+                assert(type == uWS::http2::DATA && flags == frames && streamId == (uint32_t) frames * 2 + 1);
+                assert(payload == std::string((size_t) frames * 100, (char) ('a' + frames)));
+                frames++;
+                return true;
+            }) == uWS::http2::FrameParser::OK);
+        }
+        assert(frames == 20);
+    }
+
+    /* Not HTTP/2, and frames bigger than we take */
+    uWS::http2::FrameParser parser;
+    auto none = [](uWS::http2::FrameType, unsigned char, uint32_t, std::string_view) { return true; };
+    assert(parser.consume("GET / HTTP/1.1\r\n", uWS::http2::DEFAULT_MAX_FRAME_SIZE, none) == uWS::http2::FrameParser::BAD_PREFACE);
+    uWS::http2::FrameParser other;
+    char header[uWS::http2::FRAME_HEADER_LENGTH];
+    uWS::http2::formatFrameHeader(header, 20000, uWS::http2::DATA, 0, 1);
+    assert(other.consume(std::string(uWS::http2::PREFACE) + std::string(header, sizeof(header)), uWS::http2::DEFAULT_MAX_FRAME_SIZE, none)
+        == uWS::http2::FrameParser::FRAME_TOO_BIG);
+}
+
+int main() {
+    testRequests();
+    testEviction();
+    testBroken();
+    testEncoder();
+    testFrameParser();
+
+    std::cout << "ALL PASS" << std::endl;
+}
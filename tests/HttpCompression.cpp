@@ -0,0 +1,135 @@
+#include "../src/HttpCompression.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+/* Decodes gzip or zlib wrapped deflate the way a browser would, returns what it could */
+std::string inflateAll(std::string_view compressed, bool gzip) {
+    z_stream stream = {};
+    inflateInit2(&stream, gzip ? 15 + 16 : 15);
+    stream.next_in = (Bytef *) compressed.data();
+    stream.avail_in = (unsigned int) compressed.length();
+
+    std::string out;
+    char buffer[4096];
+    int err;
+    do {
+        stream.next_out = (Bytef *) buffer;
+        stream.avail_out = sizeof(buffer);
+        err = inflate(&stream, Z_SYNC_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    } while (err == Z_OK && (stream.avail_in || !stream.avail_out));
+    inflateEnd(&stream);
+    return out;
+}
+
+void testNegotiate() {
+    std::cout << "TestNegotiate" << std::endl;
+
+    unsigned int zlib = 1u << uWS::GZIP | 1u << uWS::DEFLATE;
+
+    assert(uWS::negotiateContentEncoding("", zlib) == uWS::IDENTITY);
+    assert(uWS::negotiateContentEncoding("gzip", zlib) == uWS::GZIP);
+    assert(uWS::negotiateContentEncoding("deflate", zlib) == uWS::DEFLATE);
+    assert(uWS::negotiateContentEncoding("x-gzip", zlib) == uWS::GZIP);
+    assert(uWS::negotiateContentEncoding("GZip", zlib) == uWS::GZIP);
+
+    /* Ties go to our preference, higher q-values win over it */
+    assert(uWS::negotiateContentEncoding("deflate, gzip", zlib) == uWS::GZIP);
+    assert(uWS::negotiateContentEncoding("gzip;q=0.5, deflate", zlib) == uWS::DEFLATE);
+    assert(uWS::negotiateContentEncoding("gzip ; q=0.8 , deflate;q=0.799", zlib) == uWS::GZIP);
+    assert(uWS::negotiateContentEncoding("gzip;q=1.0, deflate;q=1", zlib) == uWS::GZIP);
+
+    /* Zero means not acceptable, also through the wildcard */
+    assert(uWS::negotiateContentEncoding("gzip;q=0", zlib) == uWS::IDENTITY);
+    assert(uWS::negotiateContentEncoding("gzip;q=0.000, deflate;q=0.001", zlib) == uWS::DEFLATE);
+    assert(uWS::negotiateContentEncoding("*", zlib) == uWS::GZIP);
+    assert(uWS::negotiateContentEncoding("*;q=0.1, gzip;q=0", zlib) == uWS::DEFLATE);
+    assert(uWS::negotiateContentEncoding("identity, *;q=0", zlib) == uWS::IDENTITY);
+
+    /* Only what we offer, and what is built in */
+    assert(uWS::negotiateContentEncoding("gzip, deflate", 1u << uWS::DEFLATE) == uWS::DEFLATE);
+    assert(uWS::negotiateContentEncoding("gzip", 0) == uWS::IDENTITY);
+    assert(uWS::negotiateContentEncoding("br, gzip", uWS::AVAILABLE_CONTENT_ENCODINGS) == ((uWS::AVAILABLE_CONTENT_ENCODINGS & 1u << uWS::BROTLI) ? uWS::BROTLI : uWS::GZIP));
+
+    /* Garbage is ignored */
+    assert(uWS::negotiateContentEncoding(",,; ;q=, compress, gzip;q=x", zlib) == uWS::GZIP);
+    assert(uWS::negotiateContentEncoding("sdch, br", zlib) == uWS::IDENTITY);
+}
+
+void testWholeBody() {
+    std::cout << "TestWholeBody" << std::endl;
+
+    std::string body;
+    for (int i = 0; i < 2000; i++) {
+        body += "<li>item number " + std::to_string(i) + "</li>\n";
+    }
+
+    for (uWS::ContentEncoding encoding : {uWS::GZIP, uWS::DEFLATE}) {
+        uWS::HttpCompressor compressor(encoding, 6);
+
+        /* Reused for many bodies, like the loop does */
+        for (int i = 0; i < 3; i++) {
+            compressor.reset();
+            std::string compressed(compressor.compress(body.substr(0, body.length() / (size_t) (i + 1)), true));
+            assert(compressed.length() < body.length() / 4);
+            assert(inflateAll(compressed, encoding == uWS::GZIP) == body.substr(0, body.length() / (size_t) (i + 1)));
+        }
+
+        /* Gzip has its magic */
+        if (encoding == uWS::GZIP) {
+            compressor.reset();
+            std::string_view compressed = compressor.compress("x", true);
+            assert(compressed.length() > 2 && (unsigned char) compressed[0] == 0x1f && (unsigned char) compressed[1] == 0x8b);
+        }
+
+        /* Empty body still is a valid stream */
+        compressor.reset();
+        std::string empty(compressor.compress({}, true));
+        assert(empty.length() && inflateAll(empty, encoding == uWS::GZIP) == "");
+    }
+
+    /* Levels out of range are clamped */
+    uWS::HttpCompressor fastest(uWS::GZIP, -5), smallest(uWS::GZIP, 100);
+    assert(inflateAll(fastest.compress(body, true), true) == body);
+    assert(inflateAll(smallest.compress(body, true), true) == body);
+}
+
+void testStream() {
+    std::cout << "TestStream" << std::endl;
+
+    for (uWS::ContentEncoding encoding : {uWS::GZIP, uWS::DEFLATE}) {
+        uWS::HttpCompressor compressor(encoding, 6);
+
+        /* Every write is flushed, so what was sent so far decodes to what was written so far */
+        std::string sent, written;
+        for (int i = 0; i < 200; i++) {
+            std::string data = "event: tick\ndata: {\"n\":" + std::to_string(i) + "}\n\n";
+            written += data;
+            sent += compressor.compress(data, false);
+            assert(inflateAll(sent, encoding == uWS::GZIP) == written);
+        }
+
+        /* Large writes grow the buffer */
+        std::string large(300000, 'z');
+        for (size_t i = 0; i < large.length(); i += 7) {
+            large[i] = (char) ('a' + i % 26);
+        }
+        written += large;
+        sent += compressor.compress(large, false);
+        assert(inflateAll(sent, encoding == uWS::GZIP) == written);
+
+        sent += compressor.compress("the end", true);
+        written += "the end";
+        assert(inflateAll(sent, encoding == uWS::GZIP) == written);
+    }
+}
+
+int main() {
+    testNegotiate();
+    testWholeBody();
+    testStream();
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -1,12 +1,14 @@
 #include <iostream>
 #include <cassert>
+#include <vector>
 
 #include "../src/HttpParser.h"
 
 int main() {
-    /* Parser needs at least 8 bytes post padding */
-    unsigned char data[] = {0x47, 0x45, 0x54, 0x20, 0x2f, 0x20, 0x48, 0x54, 0x54, 0x50, 0x2f, 0x31, 0x2e, 0x31, 0xd, 0xa, 0x61, 0x73, 0x63, 0x69, 0x69, 0x3a, 0x20, 0x74, 0x65, 0x73, 0x74, 0xd, 0xa, 0x75, 0x74, 0x66, 0x38, 0x3a, 0x20, 0xd1, 0x82, 0xd0, 0xb5, 0xd1, 0x81, 0xd1, 0x82, 0xd, 0xa, 0x48, 0x6f, 0x73, 0x74, 0x3a, 0x20, 0x31, 0x32, 0x37, 0x2e, 0x30, 0x2e, 0x30, 0x2e, 0x31, 0xd, 0xa, 0x43, 0x6f, 0x6e, 0x6e, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x63, 0x6c, 0x6f, 0x73, 0x65, 0xd, 0xa, 0xd, 0xa, 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E'};
-    int size = sizeof(data) - 8;
+    /* Parser needs at least 32 bytes post padding (MINIMUM_HTTP_POST_PADDING) */
+    unsigned char data[] = {0x47, 0x45, 0x54, 0x20, 0x2f, 0x20, 0x48, 0x54, 0x54, 0x50, 0x2f, 0x31, 0x2e, 0x31, 0xd, 0xa, 0x61, 0x73, 0x63, 0x69, 0x69, 0x3a, 0x20, 0x74, 0x65, 0x73, 0x74, 0xd, 0xa, 0x75, 0x74, 0x66, 0x38, 0x3a, 0x20, 0xd1, 0x82, 0xd0, 0xb5, 0xd1, 0x81, 0xd1, 0x82, 0xd, 0xa, 0x48, 0x6f, 0x73, 0x74, 0x3a, 0x20, 0x31, 0x32, 0x37, 0x2e, 0x30, 0x2e, 0x30, 0x2e, 0x31, 0xd, 0xa, 0x43, 0x6f, 0x6e, 0x6e, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x63, 0x6c, 0x6f, 0x73, 0x65, 0xd, 0xa, 0xd, 0xa, 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E',
+        'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E', 'E'};
+    int size = sizeof(data) - 32;
     void *user = nullptr;
     void *reserved = nullptr;
 
@@ -14,7 +16,10 @@ int main() {
 
     auto [err, returnedUser] = httpParser.consumePostPadded((char *) data, size, user, reserved, [reserved](void *s, uWS::HttpRequest *httpRequest) -> void * {
 
+        /* Classified while parsing, lower casing by getMethod does not change it */
+        assert(httpRequest->getKnownMethod() == uWS::HTTP_GET);
         std::cout << httpRequest->getMethod() << std::endl;
+        assert(httpRequest->getKnownMethod() == uWS::HTTP_GET);
 
         for (auto [key, value] : *httpRequest) {
             std::cout << key << ": " << value << std::endl;
@@ -33,6 +38,187 @@ int main() {
 
     });
 
+    /* Long, mixed case field names and values span several SIMD blocks */
+    std::string request = "GET / HTTP/1.1\r\nHost: localhost\r\nX-Some-Very-Long-MIXED-Case-Header-Name_With.Unlikely~Bytes-0123456789: "
+        + std::string(100, 'v') + "\t\xd1\x82" + std::string(50, 'w')
+        + "\r\nCookie: " + std::string(1000, 'C') + "\r\n\r\n";
+    size = (int) request.length();
+    request.append(32, 'E');
+
+    bool emitted = false;
+    httpParser.consumePostPadded(request.data(), size, user, reserved, [&emitted](void *s, uWS::HttpRequest *httpRequest) -> void * {
+        assert(httpRequest->getHeader("x-some-very-long-mixed-case-header-name_with.unlikely~bytes-0123456789") == std::string(100, 'v') + "\t\xd1\x82" + std::string(50, 'w'));
+        /* Lower casing must stop at the colon */
+        assert(httpRequest->getHeader("cookie") == std::string(1000, 'C'));
+        emitted = true;
+        return s;
+    }, [](void *user, std::string_view, bool) -> void * {
+        return user;
+    });
+    assert(emitted);
+
+    /* Control characters in field values are rejected, wherever in the block they are */
+    for (int offset = 0; offset < 40; offset++) {
+        std::string invalid = "GET / HTTP/1.1\r\nHost: " + std::string(offset, 'h') + '\x01' + "\r\n\r\n";
+        size = (int) invalid.length();
+        invalid.append(32, 'E');
+
+        uWS::HttpParser invalidParser;
+        auto [invalidErr, invalidUser] = invalidParser.consumePostPadded(invalid.data(), size, user, reserved, [](void *s, uWS::HttpRequest *) -> void * {
+            assert(false);
+            return s;
+        }, [](void *user, std::string_view, bool) -> void * {
+            return user;
+        });
+        assert(invalidErr == uWS::HTTP_ERROR_400_BAD_REQUEST && invalidUser == uWS::FULLPTR);
+    }
+
+    /* Pipelined requests split at every possible point wait for their rest in the fallback */
+    std::string pipelined;
+    for (int i = 0; i < 16; i++) {
+        pipelined += "GET /" + std::to_string(i) + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    }
+    for (size_t split = 1; split < pipelined.length(); split += 7) {
+        uWS::HttpParser pipelinedParser;
+        int numRequests = 0;
+        for (size_t offset = 0; offset < pipelined.length(); offset += split) {
+            std::string read = pipelined.substr(offset, split);
+            size = (int) read.length();
+            read.append(32, 'E');
+
+            auto [pipelinedErr, pipelinedUser] = pipelinedParser.consumePostPadded(read.data(), size, user, reserved, [&numRequests](void *s, uWS::HttpRequest *httpRequest) -> void * {
+                assert(httpRequest->getUrl() == "/" + std::to_string(numRequests));
+                numRequests++;
+                return s;
+            }, [](void *user, std::string_view, bool) -> void * {
+                return user;
+            });
+            assert(pipelinedUser == user);
+        }
+        assert(numRequests == 16);
+    }
+
+    /* Every well-known header has a slot of its own, and others have none */
+    for (unsigned int i = 0; i < uWS::KnownHeaders::NUM_HEADERS; i++) {
+        assert(uWS::KnownHeaders::find(uWS::KnownHeaders::names[i]) == (int) i);
+    }
+    for (std::string_view other : {"hos", "hosts", "x-forwarded-fur", "cookie2", "t", "x"}) {
+        assert(uWS::KnownHeaders::find(other) == -1);
+    }
+
+    /* Well-known headers are found by slot, the first one of them if repeated, others by search */
+    std::string known = "GET / HTTP/1.1\r\nX-Custom: 1\r\nCookie: a\r\nHost: h\r\nAuthorization: Bearer t\r\nCookie: b\r\nX-Forwarded-For: 10.0.0.1\r\n\r\n";
+    size = (int) known.length();
+    known.append(32, 'E');
+    emitted = false;
+    httpParser.consumePostPadded(known.data(), size, user, reserved, [&emitted](void *s, uWS::HttpRequest *httpRequest) -> void * {
+        assert(httpRequest->getHeader("host") == "h");
+        assert(httpRequest->getHeader("authorization") == "Bearer t");
+        assert(httpRequest->getHeader("cookie") == "a");
+        assert(httpRequest->getHeader("x-forwarded-for") == "10.0.0.1");
+        assert(httpRequest->getHeader("x-custom") == "1");
+        assert(!httpRequest->getHeader("content-type").data());
+        assert(!httpRequest->getHeader("x-other").data());
+        emitted = true;
+        return s;
+    }, [](void *user, std::string_view, bool) -> void * {
+        return user;
+    });
+    assert(emitted);
+
+    /* Nothing of one request is left for the next one */
+    std::string next = "GET / HTTP/1.1\r\nHost: other\r\n\r\n";
+    size = (int) next.length();
+    next.append(32, 'E');
+    emitted = false;
+    httpParser.consumePostPadded(next.data(), size, user, reserved, [&emitted](void *s, uWS::HttpRequest *httpRequest) -> void * {
+        assert(httpRequest->getHeader("host") == "other");
+        assert(!httpRequest->getHeader("authorization").data());
+        assert(!httpRequest->getHeader("x-custom").data());
+        emitted = true;
+        return s;
+    }, [](void *user, std::string_view, bool) -> void * {
+        return user;
+    });
+    assert(emitted);
+
+    /* Host is not allowed twice */
+    std::string twice = "GET / HTTP/1.1\r\nHost: a\r\nHost: b\r\n\r\n";
+    size = (int) twice.length();
+    twice.append(32, 'E');
+    uWS::HttpParser twiceParser;
+    assert(twiceParser.consumePostPadded(twice.data(), size, user, reserved, [](void *s, uWS::HttpRequest *) -> void * {
+        assert(false);
+        return s;
+    }, [](void *user, std::string_view, bool) -> void * {
+        return user;
+    }).second == uWS::FULLPTR);
+
+    /* Pipelined responses of every kind, split at every possible point */
+    std::string responses = "HTTP/1.1 100 Continue\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-A: a\r\n\r\nhello"
+        "HTTP/1.1 404 Not Found\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n"
+        "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n"
+        "HTTP/1.1 301\r\nLocation: /x\r\nContent-Length: 0\r\n\r\n"
+        "HTTP/1.0 200 OK\r\n\r\nuntil close";
+    for (size_t split = 1; split <= responses.length(); split++) {
+        uWS::HttpResponseParser responseParser;
+        std::vector<std::pair<unsigned int, std::string>> parsed;
+        std::string body;
+        for (size_t offset = 0; offset < responses.length(); offset += split) {
+            std::string read = responses.substr(offset, split);
+            size = (int) read.length();
+            read.append(32, 'E');
+
+            assert(responseParser.consume(read.data(), (unsigned int) size, [&parsed](uWS::HttpResponseHead &head) {
+                parsed.push_back({head.status, ""});
+                if (head.status == 200 && parsed.size() == 1) {
+                    assert(head.reason == "OK" && head.getHeader("x-a") == "a" && !head.ancient);
+                }
+                if (head.status == 301) {
+                    assert(head.reason == "" && head.getHeader("location") == "/x");
+                }
+                /* The fifth answers a HEAD */
+                return parsed.size() == 4 ? uWS::HttpResponseParser::NO_BODY : uWS::HttpResponseParser::READ_BODY;
+            }, [&parsed, &body](std::string_view chunk, bool fin) {
+                body.append(chunk);
+                if (fin) {
+                    parsed.back().second = std::move(body);
+                    body.clear();
+                }
+                return true;
+            }));
+        }
+        assert(responseParser.end());
+        parsed.back().second = std::move(body);
+
+        assert(parsed.size() == 6);
+        assert(parsed[0] == std::make_pair(200u, std::string("hello")));
+        assert(parsed[1] == std::make_pair(404u, std::string("abcde")));
+        assert(parsed[2] == std::make_pair(204u, std::string("")));
+        assert(parsed[3] == std::make_pair(200u, std::string("")));
+        assert(parsed[4] == std::make_pair(301u, std::string("")));
+        assert(parsed[5] == std::make_pair(200u, std::string("until close")));
+    }
+
+    /* Broken responses stop the parser */
+    for (std::string broken : {"HTTP/2 200 OK\r\n\r\n", "HTTP/1.1 20 OK\r\n\r\n", "HTTP/1.1 200 OK\r\nBad Header: x\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n", "HTTP/1.1 200 OK\r\nContent-Length: x\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nz\r\n"}) {
+        size = (int) broken.length();
+        broken.append(32, 'E');
+        uWS::HttpResponseParser brokenParser;
+        assert(!brokenParser.consume(broken.data(), (unsigned int) size, [](uWS::HttpResponseHead &) {
+            return uWS::HttpResponseParser::READ_BODY;
+        }, [](std::string_view, bool) {
+            return true;
+        }));
+    }
+
+    /* Fallback chunks are pooled, give them back before leak checking */
+    uWS::BackPressurePool::get().trim();
+
     std::cout << "HTTP DONE" << std::endl;
 
 }
\ No newline at end of file
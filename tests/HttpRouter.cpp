@@ -439,6 +439,124 @@ void testParameters() {
     assert(result == "GLWGPW");
 }
 
+/* The frozen tree must route exactly like the tree it was built from */
+void testMethods() {
+    std::cout << "TestMethods" << std::endl;
+    uWS::HttpRouter<int> r;
+    std::string result;
+
+    r.add({"GET", "PURGE", "DELETE"}, "/a", [&result](auto *) {
+        result += "A";
+        return false;
+    });
+    r.add({"*"}, "/a", [&result](auto *) {
+        result += "*";
+        return true;
+    }, r.LOW_PRIORITY);
+
+    for (bool freeze : {false, true}) {
+        if (freeze) {
+            r.freeze();
+        }
+
+        /* Standard methods go by their index, custom ones by name, and methods are case sensitive */
+        result.clear();
+        assert(r.route(uWS::HTTP_GET, "GET", "/a") && result == "A*");
+        result.clear();
+        assert(r.route("PURGE", "/a") && result == "A*");
+        result.clear();
+        assert(r.route("get", "/a") && result == "*");
+        result.clear();
+        assert(r.route("POST", "/a") && result == "*");
+        result.clear();
+        assert(r.route("*", "/a") && result == "*");
+    }
+
+    /* Without any route of ANY_METHOD_TOKEN left, nothing is tried after the method */
+    assert(r.remove("*", "/a", r.LOW_PRIORITY));
+    result.clear();
+    assert(!r.route("DELETE", "/a") && result == "A");
+    result.clear();
+    assert(!r.route("PATCH", "/a") && result == "");
+
+    assert(uWS::classifyHttpMethod("OPTIONS") == uWS::HTTP_OPTIONS && uWS::classifyHttpMethod("CONNECT") == uWS::HTTP_CONNECT);
+    assert(uWS::classifyHttpMethod("GETS") == uWS::HTTP_OTHER && uWS::classifyHttpMethod("") == uWS::HTTP_OTHER);
+    for (unsigned int i = 0; i < uWS::NUM_HTTP_METHODS; i++) {
+        assert(uWS::classifyHttpMethod(uWS::HTTP_METHOD_NAMES[i]) == (uWS::HttpMethod) i);
+    }
+}
+
+void testFrozen() {
+    std::cout << "TestFrozen" << std::endl;
+    uWS::HttpRouter<int> tree, frozen;
+    std::string result;
+
+    std::vector<std::pair<std::string, std::string>> routes = {
+        {"GET", "/"}, {"GET", "/static/route"}, {"GET", "/static/:param"}, {"GET", "/static/*"},
+        {"GET", "/static/route/"}, {"GET", "/:a/:b"}, {"GET", "/:a/route"}, {"POST", "/static/route"},
+        {"*", "/static/route"}, {"*", "/*"}, {"GET", "/api/v1/users/:id"}, {"GET", "/api/v1/users/:id/posts"},
+        {"GET", "/api/v2/users/:id"}, {"GET", "/api/*"}, {"PUT", "/api/v1/users/:id"}, {"GET", "/a/*/b"},
+        {"PURGE", "/static/*"}
+    };
+    /* Plenty of static siblings for the perfect hash */
+    for (int i = 0; i < 300; i++) {
+        routes.push_back({"GET", "/many/" + std::to_string(i) + "/leaf"});
+    }
+
+    uint32_t priorities[] = {tree.HIGH_PRIORITY, tree.MEDIUM_PRIORITY, tree.LOW_PRIORITY};
+    for (uWS::HttpRouter<int> *r : {&tree, &frozen}) {
+        for (unsigned int i = 0; i < routes.size(); i++) {
+            std::string name = std::to_string(i);
+            r->add({routes[i].first}, routes[i].second, [&result, name](auto *h) {
+                auto [paramsTop, params] = h->getParameters();
+                result += "[" + name;
+                for (int i = 0; i <= paramsTop; i++) {
+                    result += "," + std::string(params[i]);
+                }
+                result += "]";
+                /* Keep going for some so that we see the full order */
+                return name.back() == '7';
+            }, priorities[i % 3]);
+        }
+    }
+    frozen.freeze();
+    assert(frozen.isFrozen() && !tree.isFrozen());
+
+    std::vector<std::string> urls = {
+        "", "/", "/static", "/static/", "/static/route", "/static/route/", "/static/other", "/x/route", "/x/y",
+        "/api/v1/users/5", "/api/v1/users/5/posts", "/api/v2/users/", "/api/v3", "/a/x/b", "/many/17/leaf",
+        "/many/299/leaf", "/many/300/leaf", "/many/1/leaf/", "//", "/static//route"
+    };
+
+    auto compare = [&]() {
+        for (std::string method : {"GET", "POST", "PUT", "DELETE", "*", "PURGE", "get"}) {
+            for (std::string &url : urls) {
+                result.clear();
+                bool treeRouted = tree.route(method, url);
+                std::string treeResult = result;
+
+                result.clear();
+                bool frozenRouted = frozen.route(method, url);
+                assert(treeRouted == frozenRouted && treeResult == result);
+            }
+        }
+    };
+    compare();
+
+    /* Changes after freezing rebuild on the next route */
+    for (uWS::HttpRouter<int> *r : {&tree, &frozen}) {
+        assert(r->remove("GET", "/static/:param", tree.LOW_PRIORITY));
+        r->add({"GET"}, "/static/late", [&result](auto *) {
+            result += "[late]";
+            return true;
+        });
+    }
+    assert(!frozen.isFrozen());
+    urls.push_back("/static/late");
+    compare();
+    assert(frozen.isFrozen());
+}
+
 #include <chrono>
 
 void testPerformance() {
@@ -471,5 +589,7 @@ int main() {
     testUpgrade();
     testBugReports();
     testParameters();
+    testMethods();
+    testFrozen();
     testPerformance();
 }
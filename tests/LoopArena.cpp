@@ -0,0 +1,59 @@
+#include "../src/LoopArena.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+struct Counted {
+    static inline int alive = 0;
+    int value;
+    Counted(int value) : value(value) {
+        alive++;
+    }
+    ~Counted() {
+        alive--;
+    }
+};
+
+int main() {
+    {
+        uWS::LoopArena arena;
+        assert(arena.size() == 0);
+
+        /* Alignment as asked, and writable memory that does not overlap */
+        std::vector<std::pair<char *, size_t>> allocations;
+        for (size_t i = 1; i < 3000; i++) {
+            size_t alignment = (size_t) 1 << (i % 7);
+            char *p = (char *) arena.allocate(i, alignment);
+            assert(((uintptr_t) p & (alignment - 1)) == 0);
+            memset(p, (int) (i & 0xff), i);
+            allocations.push_back({p, i});
+        }
+        for (auto &[p, length] : allocations) {
+            for (size_t j = 0; j < length; j++) {
+                assert((unsigned char) p[j] == (length & 0xff));
+            }
+        }
+        /* 2 MB regions, so 4.5 million bytes needed three */
+        assert(arena.size() == 3 * uWS::LoopArena::REGION_SIZE);
+
+        /* Big ones get their own region without giving up the current one */
+        char *before = (char *) arena.allocate(16);
+        char *big = (char *) arena.allocate(3 * 1024 * 1024, 64);
+        memset(big, 1, 3 * 1024 * 1024);
+        assert(arena.size() == 5 * uWS::LoopArena::REGION_SIZE);
+        char *after = (char *) arena.allocate(16);
+        assert(after == before + 16);
+
+        /* Objects are constructed and destroyed in place */
+        Counted *counted = arena.make<Counted>(42);
+        assert(counted->value == 42 && Counted::alive == 1);
+        arena.destroy(counted);
+        arena.destroy<Counted>(nullptr);
+        assert(Counted::alive == 0);
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,61 @@
+#define UWS_WITH_METRICS
+#include "../src/Metrics.h"
+
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+struct FakeLoopData {
+    uWS::LoopMetrics metrics;
+};
+
+int main() {
+    /* Every value lands in a bucket whose range holds it and bucket ranges are contiguous */
+    for (uint64_t value = 0; value < 100000; value++) {
+        unsigned int bucket = uWS::HistogramBuckets::index(value);
+        assert(uWS::HistogramBuckets::lowestValue(bucket) <= value);
+        assert(uWS::HistogramBuckets::lowestValue(bucket + 1) > value);
+    }
+    for (unsigned int bucket = 0; bucket < uWS::HistogramBuckets::NUM_BUCKETS; bucket++) {
+        assert(uWS::HistogramBuckets::index(uWS::HistogramBuckets::lowestValue(bucket)) == bucket);
+    }
+    assert(uWS::HistogramBuckets::index(UINT64_MAX) == uWS::HistogramBuckets::NUM_BUCKETS - 1);
+
+    /* Within 1/16 of the value */
+    for (uint64_t value = 16; value < (1ull << 40); value = value * 3 + 7) {
+        uint64_t low = uWS::HistogramBuckets::lowestValue(uWS::HistogramBuckets::index(value));
+        assert(value - low <= value / 16);
+    }
+
+    /* Counters and percentiles */
+    FakeLoopData *loopData = new FakeLoopData;
+    UWS_METRIC(loopData, bytesRead, 100);
+    UWS_METRIC(loopData, bytesRead, 23);
+    {
+        UWS_METRIC_TIMED(loopData, deflateNanoseconds);
+    }
+    for (int i = 0; i < 99; i++) {
+        uWS::LoopMetrics::add(loopData->metrics.iterationTime[uWS::HistogramBuckets::index(1000)], 1);
+    }
+    uWS::LoopMetrics::add(loopData->metrics.iterationTime[uWS::HistogramBuckets::index(1000000)], 1);
+
+    uWS::LoopMetricsSnapshot snapshot = loopData->metrics.snapshot();
+    assert(snapshot.bytesRead == 123);
+    assert(snapshot.bytesWritten == 0);
+    uint64_t p50 = snapshot.iterationTimePercentile(0.5);
+    assert(p50 > 1000 && p50 <= 1000 + 1000 / 16 + 1);
+    uint64_t p999 = snapshot.iterationTimePercentile(0.999);
+    assert(p999 > 1000000 && p999 <= 1000000 + 1000000 / 16 + 1);
+
+    /* Time between iterations is time waited */
+    loopData->metrics.beginIteration();
+    loopData->metrics.endIteration();
+    assert(loopData->metrics.waitNanoseconds == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    loopData->metrics.beginIteration();
+    loopData->metrics.endIteration();
+    assert(loopData->metrics.iterations == 2 && loopData->metrics.waitNanoseconds >= 2000000);
+    delete loopData;
+
+    std::cout << "ALL BUCKETS AND PERCENTILES PASS" << std::endl;
+}
@@ -0,0 +1,42 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <memory>
+
+#include "../src/MoveOnlyFunction.h"
+
+int main() {
+    {
+        /* Two pointers fit inline by default */
+        int a = 1, b = 2;
+        uWS::MoveOnlyFunction<int(int)> small = [&a, &b](int x) { return x + a + b; };
+        assert(small(1) == 4 && uWS::numSpilledFunctions == 0);
+
+        /* A string does not, unless we ask for the callback size */
+        std::string s(100, 'a');
+        uWS::MoveOnlyFunction<size_t()> spilled = [s, &a]() { return s.length() + (size_t) a; };
+        assert(spilled() == 101 && uWS::numSpilledFunctions == 1);
+        uWS::MoveOnlyFunction<size_t(), uWS::CALLBACK_INLINE_SIZE> callback = [s, &a]() { return s.length() + (size_t) a; };
+        assert(callback() == 101 && uWS::numSpilledFunctions == 1);
+
+        /* Spilled callables go back to the pool, and the next one takes the same block */
+        uWS::MoveOnlyFunction<size_t()> moved = std::move(spilled);
+        assert(!spilled && moved() == 101);
+        moved = nullptr;
+        unsigned int sizeClass = uWS::BlockPool::sizeClass(sizeof(std::string) + sizeof(int *));
+        assert(uWS::BlockPool::get().numFreeBlocks[sizeClass] == 1);
+        moved = [s, &b]() { return s.length() + (size_t) b; };
+        assert(moved() == 102 && uWS::BlockPool::get().numFreeBlocks[sizeClass] == 0);
+
+        /* Move only captures */
+        uWS::MoveOnlyFunction<int(), uWS::CALLBACK_INLINE_SIZE> unique = [p = std::make_unique<int>(5)]() { return *p; };
+        assert(unique() == 5);
+
+        /* Results are discarded for void */
+        uWS::MoveOnlyFunction<void()> discarding = []() { return 5; };
+        discarding();
+    }
+
+    uWS::BlockPool::get().trim();
+    std::cout << "ALL PASS" << std::endl;
+}
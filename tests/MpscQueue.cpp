@@ -0,0 +1,67 @@
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "../src/MpscQueue.h"
+
+int main() {
+    /* Capacity rounds up to a power of two */
+    uWS::BoundedMpscQueue<int> small(3);
+    for (int i = 0; i < 4; i++) {
+        assert(small.push(i));
+    }
+    assert(!small.push(4));
+
+    /* First in first out, and full queue wraps around after popping */
+    int value;
+    assert(small.pop(value) && value == 0);
+    assert(small.push(4));
+    for (int i = 1; i < 5; i++) {
+        assert(small.pop(value) && value == i);
+    }
+    assert(!small.pop(value));
+
+    /* Move-only values are moved in only once a cell is claimed, so a failed push leaves them intact */
+    uWS::BoundedMpscQueue<std::unique_ptr<int>> owning(2);
+    std::unique_ptr<int> owned(new int(1));
+    assert(owning.push(std::move(owned)) && !owned);
+    assert(owning.push(std::unique_ptr<int>(new int(2))));
+    owned.reset(new int(3));
+    assert(!owning.push(std::move(owned)) && owned && *owned == 3);
+    assert(owning.pop(owned) && *owned == 1);
+    assert(owning.pop(owned) && *owned == 2);
+
+    /* Many producers, one consumer, every value arrives exactly once and in order per producer */
+    const int PRODUCERS = 8, PER_PRODUCER = 100000;
+    uWS::BoundedMpscQueue<int> queue(64);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers.emplace_back([&queue, p]() {
+            for (int i = 0; i < PER_PRODUCER; i++) {
+                while (!queue.push(p * PER_PRODUCER + i)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    std::vector<int> last(PRODUCERS, -1);
+    for (int received = 0; received < PRODUCERS * PER_PRODUCER; ) {
+        if (queue.pop(value)) {
+            int p = value / PER_PRODUCER;
+            assert(value % PER_PRODUCER == last[p] + 1);
+            last[p] = value % PER_PRODUCER;
+            received++;
+        }
+    }
+    assert(!queue.pop(value));
+
+    for (auto &t : producers) {
+        t.join();
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,116 @@
+#include "../src/Multipart.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Part {
+    std::string name;
+    std::string data;
+    bool ended = false;
+};
+
+/* Parses body fed in chunks of chunkSize */
+std::vector<Part> parse(std::string_view contentType, std::string_view body, size_t chunkSize, bool &valid) {
+    std::vector<Part> parts;
+    uWS::MultipartStreamParser parser(contentType, [&parts](std::pair<std::string_view, std::string_view> *headers) {
+        Part part;
+        for (int i = 0; headers[i].first.length(); i++) {
+            if (headers[i].first == "content-disposition") {
+                uWS::ParameterParser pp(headers[i].second);
+                while (true) {
+                    auto [key, value] = pp.getKeyValue();
+                    if (!key.length()) {
+                        break;
+                    }
+                    if (key == "name") {
+                        part.name = value;
+                    }
+                }
+            }
+        }
+        parts.push_back(part);
+    }, [&parts](std::string_view data, bool last) {
+        assert(!parts.back().ended);
+        parts.back().data.append(data);
+        parts.back().ended = last;
+    });
+    assert(parser.isValid());
+
+    valid = true;
+    for (size_t i = 0; i < body.length(); i += chunkSize) {
+        valid = parser.consume(body.substr(i, chunkSize), i + chunkSize >= body.length()) && valid;
+    }
+    return parts;
+}
+
+int main() {
+    std::string contentType = "multipart/form-data; boundary=----WebKitFormBoundaryabc";
+    std::string delimiter = "------WebKitFormBoundaryabc";
+
+    /* Data that almost looks like the boundary, empty parts and parts without headers */
+    std::string big(100000, 'x');
+    for (size_t i = 0; i < big.length(); i += 997) {
+        big.replace(i, 20, "\r\n------WebKitFormBo");
+    }
+    std::vector<std::pair<std::string, std::string>> expected = {
+        {"first", "hello"},
+        {"empty", ""},
+        {"big", big},
+        {"crlf", "\r\n\r\n--\r"},
+        {"", "no headers"}
+    };
+
+    std::string body = "preamble is ignored\r\n";
+    for (auto &[name, data] : expected) {
+        body += delimiter + "\r\n";
+        if (name.length()) {
+            body += "Content-Disposition: form-data; name=\"" + name + "\"\r\nContent-Type: text/plain\r\n";
+        }
+        body += "\r\n" + data + "\r\n";
+    }
+    body.resize(body.length() - 2);
+    body += "\r\n" + delimiter + "--\r\nepilogue is ignored";
+
+    for (size_t chunkSize : std::initializer_list<size_t>{1, 2, 3, 5, 7, 13, 27, 28, 29, 64, 1000, 4096, 100000000}) {
+        bool valid;
+        std::vector<Part> parts = parse(contentType, body, chunkSize, valid);
+        assert(valid);
+        assert(parts.size() == expected.size());
+        for (size_t i = 0; i < parts.size(); i++) {
+            assert(parts[i].name == expected[i].first);
+            assert(parts[i].data == expected[i].second);
+            assert(parts[i].ended);
+        }
+    }
+
+    /* Boundary as the very first bytes, quoted boundary */
+    {
+        bool valid;
+        std::vector<Part> parts = parse("multipart/form-data; boundary=\"b\"", "--b\r\n\r\nabc\r\n--b--", 1, valid);
+        assert(valid && parts.size() == 1 && parts[0].data == "abc");
+    }
+
+    /* Truncated bodies and garbage after the boundary */
+    {
+        bool valid;
+        parse(contentType, body.substr(0, body.length() / 2), 100, valid);
+        assert(!valid);
+        parse("multipart/form-data; boundary=b", "--bxx\r\n\r\n--b--", 4, valid);
+        assert(!valid);
+    }
+
+    /* Headers larger than we take */
+    {
+        bool valid;
+        std::string huge = "--b\r\nX-Big: " + std::string(uWS::MultipartStreamParser::MAX_PART_HEADERS_SIZE, 'a') + "\r\n\r\n\r\n--b--";
+        parse("multipart/form-data; boundary=b", huge, 512, valid);
+        assert(!valid);
+    }
+
+    /* Not multipart */
+    assert(!uWS::MultipartStreamParser("text/plain", nullptr, nullptr).isValid());
+
+    std::cout << "ALL PASS" << std::endl;
+}
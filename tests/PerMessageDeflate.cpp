@@ -0,0 +1,254 @@
+#include "../src/PerMessageDeflate.h"
+#include "../src/CompressionPool.h"
+#include "../src/CompressionStats.h"
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+/* Compresses with context takeover the way WebSocket::send does, inflates like the peer would */
+void testDeflationStreamPool() {
+    std::cout << "TestDeflationStreamPool" << std::endl;
+
+    uWS::ZlibContext zlibContext;
+
+    /* Three sockets fighting over two sliding windows */
+    uWS::DeflationStreamPool pool(uWS::DEDICATED_COMPRESSOR_32KB, 2);
+    struct Peer {
+        uWS::DeflationStreamPool::Entry *lease = nullptr;
+        uWS::InflationStream inflationStream{uWS::DEDICATED_DECOMPRESSOR};
+    } peers[3];
+
+    srand(7);
+    for (int i = 0; i < 3000; i++) {
+        int p = (i % 7 == 0) ? rand() % 3 : (i / 50) % 3;
+        Peer &peer = peers[p];
+
+        /* Repetitive messages that reference each other across sends */
+        std::string message = "{\"peer\":" + std::to_string(p) + ",\"sequence\":" + std::to_string(i / 3) + ",\"payload\":\"" + std::string(20 + rand() % 200, (char) ('a' + p)) + "\"}";
+
+        uWS::DeflationStream *deflationStream = pool.acquire(&peer, peer.lease);
+        std::string compressed(deflationStream->deflate(&zlibContext, message, false));
+
+        /* Inflation needs 4 bytes of tail room */
+        compressed.append(16, '\0');
+        auto inflated = peer.inflationStream.inflate(&zlibContext, {compressed.data(), compressed.length() - 16}, 1024 * 1024, false);
+        assert(inflated && *inflated == message);
+
+        /* Every now and then someone leaves and comes back as a new socket */
+        if (rand() % 100 == 0) {
+            pool.release(&peer, peer.lease);
+            peer.inflationStream.~InflationStream();
+            new (&peer.inflationStream) uWS::InflationStream(uWS::DEDICATED_DECOMPRESSOR);
+        }
+    }
+
+    /* A peer holding on to its lease keeps its window, and so compresses repeats to almost nothing */
+    std::string message(1000, 'x');
+    for (int i = 0; i < 1000; i++) {
+        message[(size_t) i] = (char) ('a' + rand() % 26);
+    }
+    size_t first = pool.acquire(&peers[0], peers[0].lease)->deflate(&zlibContext, message, false).length();
+    size_t second = pool.acquire(&peers[0], peers[0].lease)->deflate(&zlibContext, message, false).length();
+    assert(second * 10 < first);
+}
+
+/* Worker results are valid no matter what came before them on the peer */
+void testCompressionPool() {
+    std::cout << "TestCompressionPool" << std::endl;
+
+    const int NUM_JOBS = 64;
+    std::mutex mutex;
+    std::vector<std::string> results(NUM_JOBS), messages(NUM_JOBS);
+    std::atomic<int> done{0};
+
+    for (int i = 0; i < NUM_JOBS; i++) {
+        messages[(size_t) i] = std::string(100000 + i * 1000, (char) ('a' + i % 26)) + std::to_string(i);
+        uWS::CompressionPool::get().post([&, i](uWS::ZlibContext *zlibContext, uWS::DeflationStream *deflationStream) {
+            std::string compressed(deflationStream->deflate(zlibContext, messages[(size_t) i], true));
+            std::lock_guard<std::mutex> lock(mutex);
+            results[(size_t) i] = std::move(compressed);
+            done++;
+        });
+    }
+
+    while (done != NUM_JOBS) {
+        std::this_thread::yield();
+    }
+
+    /* One peer with context takeover receiving them all in order */
+    uWS::ZlibContext zlibContext;
+    uWS::InflationStream inflationStream(uWS::DEDICATED_DECOMPRESSOR);
+    for (int i = 0; i < NUM_JOBS; i++) {
+        std::string &compressed = results[(size_t) i];
+        size_t length = compressed.length();
+        compressed.append(16, '\0');
+        auto inflated = inflationStream.inflate(&zlibContext, {compressed.data(), length}, 16 * 1024 * 1024, false);
+        assert(inflated && *inflated == messages[(size_t) i] && length * 50 < messages[(size_t) i].length());
+    }
+}
+
+/* Small messages of a known schema compress well without any sliding window of their own */
+void testDictionary() {
+    std::cout << "TestDictionary" << std::endl;
+
+    uWS::ZlibContext zlibContext;
+    std::string dictionary = "{\"type\":\"trade\",\"symbol\":\"\",\"price\":,\"quantity\":,\"side\":\"buy\",\"side\":\"sell\",\"exchange\":\"\",\"timestamp\":}";
+
+    uWS::DeflationStream plain(uWS::DEDICATED_COMPRESSOR);
+    uWS::DeflationStream primed(uWS::DEDICATED_COMPRESSOR, dictionary);
+    uWS::InflationStream inflationStream(uWS::DEDICATED_DECOMPRESSOR, dictionary);
+
+    size_t rawBytes = 0, plainBytes = 0, primedBytes = 0;
+    for (int i = 0; i < 100; i++) {
+        std::string message = "{\"type\":\"trade\",\"symbol\":\"SYM" + std::to_string(i % 7) + "\",\"price\":" + std::to_string(100 + i)
+            + ",\"quantity\":" + std::to_string(i * 3) + ",\"side\":\"" + (i % 2 ? "buy" : "sell") + "\",\"exchange\":\"X\",\"timestamp\":" + std::to_string(1700000000 + i) + "}";
+        rawBytes += message.length();
+        plainBytes += plain.deflate(&zlibContext, message, true).length();
+
+        /* Shared streams reset after every message, priming the dictionary again */
+        std::string compressed(primed.deflate(&zlibContext, message, true));
+        primedBytes += compressed.length();
+
+        size_t length = compressed.length();
+        compressed.append(16, '\0');
+        auto inflated = inflationStream.inflate(&zlibContext, {compressed.data(), length}, 1024, true);
+        assert(inflated && *inflated == message);
+    }
+
+    std::cout << "Raw: " << rawBytes << ", plain: " << plainBytes << ", with dictionary: " << primedBytes << std::endl;
+    assert(primedBytes * 2 < plainBytes && primedBytes * 3 < rawBytes);
+}
+
+/* The shared compressor switches levels between whole messages, for behaviors that want different ones */
+void testCompressionLevel() {
+    std::cout << "TestCompressionLevel" << std::endl;
+
+    uWS::ZlibContext zlibContext;
+    uWS::DeflationStream shared(uWS::DEDICATED_COMPRESSOR);
+    uWS::InflationStream inflationStream(uWS::DEDICATED_DECOMPRESSOR);
+
+    /* Bigger than any of the static buffers, and not too easy on the compressor */
+    std::string message;
+    srand(3);
+    while (message.length() < 100000) {
+        message += "{\"sequence\":" + std::to_string(message.length()) + ",\"value\":" + std::to_string(rand() % 1000) + "}";
+    }
+
+    size_t sizes[uWS::MAX_COMPRESSION_LEVEL + 1];
+    for (int round = 0; round < 2; round++) {
+        for (int level = 0; level <= uWS::MAX_COMPRESSION_LEVEL; level++) {
+            shared.setLevel(level);
+            std::string compressed(shared.deflate(&zlibContext, message, true));
+            sizes[level] = compressed.length();
+
+            size_t length = compressed.length();
+            compressed.append(16, '\0');
+            auto inflated = inflationStream.inflate(&zlibContext, {compressed.data(), length}, message.length(), true);
+            assert(inflated && *inflated == message);
+        }
+    }
+
+    std::cout << "Level 0: " << sizes[0] << ", level 1: " << sizes[1] << ", level 6: " << sizes[6] << ", level 9: " << sizes[9] << std::endl;
+    assert(sizes[0] > message.length() && sizes[1] < message.length() / 2 && sizes[9] <= sizes[6] && sizes[6] < sizes[1]);
+}
+
+/* A big message inflated part by part as it would arrive over many reads, in bounded slices */
+void testInflateChunks() {
+    std::cout << "TestInflateChunks" << std::endl;
+
+    uWS::ZlibContext zlibContext;
+    uWS::DeflationStream deflationStream(uWS::DEDICATED_COMPRESSOR);
+    uWS::InflationStream inflationStream(uWS::DEDICATED_DECOMPRESSOR);
+
+    std::string message;
+    srand(5);
+    while (message.length() < 1000000) {
+        message += "{\"sequence\":" + std::to_string(message.length()) + ",\"value\":" + std::to_string(rand()) + "}";
+    }
+
+    for (int round = 0; round < 2; round++) {
+        std::string compressed(deflationStream.deflate(&zlibContext, message, true));
+        size_t length = compressed.length();
+        compressed.append(16, '\0');
+
+        std::string inflated;
+        size_t slices = 0, finals = 0;
+        for (size_t offset = 0, part = 1000 + round * 3333; offset < length; offset += part) {
+            bool last = offset + part >= length;
+            bool ok = inflationStream.inflateChunks(&zlibContext, {compressed.data() + offset, std::min(part, length - offset)}, last, true, [&](std::string_view slice, bool final) {
+                assert(slice.length() <= LARGE_BUFFER_SIZE);
+                inflated.append(slice);
+                slices++;
+                finals += final && last;
+                return false;
+            });
+            assert(ok);
+        }
+        assert(inflated == message && finals == 1 && slices > message.length() / (LARGE_BUFFER_SIZE));
+
+        /* The tail bytes borrowed past the end are given back */
+        assert(compressed.substr(length) == std::string(16, '\0'));
+    }
+
+    /* Breaking out of emit fails the inflation */
+    std::string compressed(deflationStream.deflate(&zlibContext, message, true));
+    size_t length = compressed.length();
+    compressed.append(16, '\0');
+    assert(!inflationStream.inflateChunks(&zlibContext, {compressed.data(), length}, true, true, [](std::string_view, bool) {
+        return true;
+    }));
+}
+
+/* Random payloads are told apart from text by sampling, and a run of messages that do not shrink is mostly skipped */
+void testCompressionStats() {
+    std::cout << "TestCompressionStats" << std::endl;
+
+    uWS::ZlibContext zlibContext;
+    uWS::DeflationStream shared(uWS::DEDICATED_COMPRESSOR);
+
+    std::string random, text;
+    srand(7);
+    for (int i = 0; i < 1000; i++) {
+        random += (char) rand();
+    }
+    while (text.length() < 1000) {
+        text += "{\"sequence\":" + std::to_string(text.length()) + ",\"value\":" + std::to_string(rand() % 1000) + "}";
+    }
+    assert(!uWS::CompressionStats::looksCompressible(random));
+    assert(uWS::CompressionStats::looksCompressible(text));
+    assert(uWS::CompressionStats::looksCompressible(random.substr(0, 100)));
+
+    /* Short random messages pass the sampling but not deflate, most of them are then sent as they are */
+    uWS::CompressionStats stats;
+    int deflated = 0;
+    for (int i = 0; i < 200; i++) {
+        if (stats.shouldCompress()) {
+            std::string_view message = std::string_view(random).substr(i, 100);
+            stats.report(message.length(), shared.deflate(&zlibContext, message, true).length());
+            deflated++;
+        }
+    }
+    std::cout << "Deflated " << deflated << " of 200" << std::endl;
+    assert(deflated > 200 / 16 && deflated < 200 / 8);
+
+    /* Once messages shrink again, every one of them is deflated */
+    while (!stats.shouldCompress());
+    stats.report(text.length(), shared.deflate(&zlibContext, text, true).length());
+    for (int i = 0; i < 10; i++) {
+        assert(stats.shouldCompress());
+        stats.report(text.length(), shared.deflate(&zlibContext, text, true).length());
+    }
+    assert(sizeof(uWS::CompressionStats) == 1);
+}
+
+int main() {
+    testDeflationStreamPool();
+    testCompressionPool();
+    testDictionary();
+    testCompressionLevel();
+    testInflateChunks();
+    testCompressionStats();
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+
+#include "../src/ProxyParser.h"
+
+static std::string v2(unsigned char verCmd, unsigned char fam, std::string payload) {
+    std::string header("\x0D\x0A\x0D\x0A\x00\x0D\x0A\x51\x55\x49\x54\x0A", 12);
+    header += (char) verCmd;
+    header += (char) fam;
+    header += (char) (payload.length() >> 8);
+    header += (char) (payload.length() & 0xff);
+    return header + payload;
+}
+
+int main() {
+    /* HTTP is left alone, also when it starts like PROXY */
+    {
+        uWS::ProxyParser pp;
+        assert(pp.parse("GET / HTTP/1.1\r\n\r\n") == std::make_pair(true, 0u));
+        assert(pp.parse("PROXX / HTTP/1.1\r\n\r\n") == std::make_pair(true, 0u));
+        assert(pp.parse("PRO").first == false);
+        assert(pp.getSourceAddress().empty());
+    }
+
+    /* v1 over IPv4 */
+    {
+        uWS::ProxyParser pp;
+        std::string header = "PROXY TCP4 192.168.0.1 10.0.0.11 56324 443\r\n";
+        assert(pp.parse(header.substr(0, 20)).first == false);
+        assert(pp.parse(header + "GET / HTTP/1.1\r\n\r\n") == std::make_pair(true, (unsigned int) header.length()));
+        assert(pp.getSourceAddress() == std::string_view("\xc0\xa8\x00\x01", 4));
+    }
+
+    /* v1 over IPv6, compressed and with IPv4 in it */
+    {
+        uWS::ProxyParser pp;
+        assert(pp.parse("PROXY TCP6 2001:db8::ff00:42:8329 ::1 1 2\r\n").first);
+        assert(pp.getSourceAddress() == std::string_view("\x20\x01\x0d\xb8\x00\x00\x00\x00\x00\x00\xff\x00\x00\x42\x83\x29", 16));
+        assert(pp.parse("PROXY TCP6 ::ffff:1.2.3.4 :: 1 2\r\n").first);
+        assert(pp.getSourceAddress() == std::string_view("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xff\xff\x01\x02\x03\x04", 16));
+        assert(pp.parse("PROXY TCP6 1:2:3:4:5:6:7:8 1:: 1 2\r\n").first);
+        assert(pp.getSourceAddress() == std::string_view("\x00\x01\x00\x02\x00\x03\x00\x04\x00\x05\x00\x06\x00\x07\x00\x08", 16));
+    }
+
+    /* v1 that is broken, and UNKNOWN */
+    std::string tooLong = "PROXY " + std::string(120, '1');
+    for (std::string_view broken : {"PROXY TCP4 1.2.3 1.2.3.4 1 2\r\n", "PROXY TCP4 1.2.3.256 1.2.3.4 1 2\r\n", "PROXY TCP4 1.2.3.4 1.2.3.4 1 65536\r\n",
+        "PROXY TCP6 1:::2 ::1 1 2\r\n", "PROXY TCP6 1:2:3:4:5:6:7:8:9 ::1 1 2\r\n", "PROXY TCP6 1:2 ::1 1 2\r\n", "PROXY UDP4 1.2.3.4 1.2.3.4 1 2\r\n",
+        "PROXY TCP4 1.2.3.4 1.2.3.4 1\r\n", tooLong.c_str()}) {
+        uWS::ProxyParser pp;
+        assert(pp.parse(broken).first == false);
+    }
+    {
+        uWS::ProxyParser pp;
+        assert(pp.parse("PROXY UNKNOWN ffff::1 ffff::2 1 2\r\n") == std::make_pair(true, 35u));
+        assert(pp.parse("PROXY UNKNOWN\r\n") == std::make_pair(true, 15u));
+        assert(pp.getSourceAddress().empty());
+    }
+
+    /* v2 over IPv4, with type-length-values */
+    {
+        uWS::ProxyParser pp;
+        std::string address("\x01\x02\x03\x04\x05\x06\x07\x08\x00\x50\x01\xbb", 12);
+        std::string tlvs = std::string("\xea\x00\x05\x01vpce", 8) + std::string("\x04\x00\x00", 3);
+        std::string header = v2(0x21, 0x11, address + tlvs);
+        assert(pp.parse(header.substr(0, header.length() - 1)).first == false);
+        assert(pp.parse(header) == std::make_pair(true, (unsigned int) header.length()));
+        assert(pp.getSourceAddress() == "\x01\x02\x03\x04");
+        assert(pp.getTlv(0xea) == "\x01vpce");
+        assert(pp.getTlv(0x04).empty() && pp.getTlv(0x05).empty());
+
+        /* Too many of them are dropped, whole */
+        std::string many;
+        for (int i = 0; i < 20; i++) {
+            many += std::string("\x30\x00\x07", 3) + "1234567";
+        }
+        assert(pp.parse(v2(0x21, 0x11, address + many + tlvs)).first);
+        assert(pp.getTlv(0x30) == "1234567");
+        assert(pp.getTlv(0xea).empty());
+    }
+
+    /* v2 over IPv6, LOCAL and too short */
+    {
+        uWS::ProxyParser pp;
+        std::string address(36, 0);
+        address[0] = 0x20;
+        assert(pp.parse(v2(0x21, 0x21, address)).first);
+        assert(pp.getSourceAddress().length() == 16 && pp.getSourceAddress()[0] == 0x20);
+        assert(pp.parse(v2(0x20, 0x00, "")).first);
+        assert(pp.getSourceAddress().empty());
+        assert(pp.parse(v2(0x21, 0x21, std::string(12, 0))).first == false);
+        assert(pp.parse(v2(0x11, 0x11, std::string(12, 0))).first == false);
+    }
+
+    /* Nothing after the first request is PROXY, nor changes the address or its text */
+    {
+        uWS::ProxyParser pp;
+        assert(pp.parse("PROXY TCP4 1.2.3.4 1.2.3.4 1 2\r\n").first);
+        pp.setSourceAddressAsText("1.2.3.4");
+        pp.seal();
+        assert(pp.parse("PROXY TCP4 6.6.6.6 1.2.3.4 1 2\r\n") == std::make_pair(true, 0u));
+        assert(pp.getSourceAddress() == "\x01\x02\x03\x04");
+        assert(pp.getSourceAddressAsText() == "1.2.3.4");
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
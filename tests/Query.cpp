@@ -3,6 +3,8 @@
 
 #include "../src/QueryParser.h"
 
+#include <string>
+
 int main() {
 
     {
@@ -38,5 +40,80 @@ int main() {
         assert(uWS::getDecodedQueryValue("test2", (char *) buf.data()) == "some Value");
     }
 
+    /* One pass index */
+    {
+        std::string buf = "test1=&test2=some%20Value&a+b=c+d%2b&flag&&e=f=g&bad=%2&key%3D=%41";
+        uWS::QueryIndex index;
+        index.build(buf);
+        assert(index.get("test1") == "" && index.get("test1").data() != nullptr);
+        assert(index.get("test2") == "some Value");
+        assert(index.get("a b") == "c d+");
+        assert(index.get("flag").data() == nullptr);
+        assert(index.get("e") == "f=g");
+        assert(index.get("bad").data() == nullptr);
+        assert(index.get("key=") == "A");
+        assert(index.get("").data() == nullptr);
+
+        std::string keys;
+        for (auto &pair : index) {
+            keys += std::string(pair.key) + ",";
+        }
+        assert(keys == "test1,test2,a b,e,key=,");
+    }
+
+    /* Iteration and get agree on invalid percent-encoding */
+    {
+        std::string buf = "a=%zz&b=1&c%zz=2&a=3";
+        uWS::QueryIndex index;
+        index.build(buf);
+        assert(index.get("a") == "3");
+        assert(index.get("b") == "1");
+
+        std::string pairs;
+        for (auto &pair : index) {
+            pairs += std::string(pair.key) + "=" + std::string(pair.value) + ",";
+            assert(index.get(pair.key).data() != nullptr);
+        }
+        assert(pairs == "b=1,a=3,");
+    }
+    {
+        std::string buf = "a=%zz";
+        uWS::QueryIndex index;
+        index.build(buf);
+        assert(index.get("a").data() == nullptr && index.begin() == index.end());
+    }
+
+    /* Long values take the vectorized path */
+    {
+        std::string value(100, 'v');
+        std::string buf = "k=" + value + "%21&" + std::string(50, 'x') + "=1";
+        uWS::QueryIndex index;
+        index.build(buf);
+        assert(index.get("k") == value + "!");
+        assert(index.get(std::string(50, 'x')) == "1");
+    }
+
+    /* More pairs than we index are still found */
+    {
+        std::string buf;
+        for (int i = 0; i < UWS_QUERY_MAX_PAIRS + 10; i++) {
+            buf += "k" + std::to_string(i) + "=v%20" + std::to_string(i) + "&";
+        }
+        uWS::QueryIndex index;
+        index.build(buf);
+        assert(index.end() - index.begin() == UWS_QUERY_MAX_PAIRS);
+        assert(index.get("k0") == "v 0");
+        assert(index.get("k" + std::to_string(UWS_QUERY_MAX_PAIRS + 5)) == "v " + std::to_string(UWS_QUERY_MAX_PAIRS + 5));
+        assert(index.get("k1000").data() == nullptr);
+    }
+
+    /* No query at all */
+    {
+        uWS::QueryIndex index;
+        index.build({nullptr, 0});
+        assert(index.get("a").data() == nullptr && index.begin() == index.end());
+    }
+
+    std::cout << "ALL PASS" << std::endl;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "../src/RateLimiter.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+std::string ipv4(unsigned int i) {
+    return {(char) 10, (char) (i >> 16), (char) (i >> 8), (char) i};
+}
+
+std::string ipv6(unsigned char hostByte, unsigned char prefixByte = 0) {
+    std::string address(16, '\0');
+    address[0] = (char) 0x20;
+    address[1] = (char) 0x01;
+    address[7] = (char) prefixByte;
+    address[15] = (char) hostByte;
+    return address;
+}
+
+int main() {
+    /* A burst on top of the rate, then nothing until tokens drain back */
+    {
+        uWS::RateLimiter limiter({.connectionsPerSecond = 10, .connectionBurst = 5});
+        uint64_t key = limiter.key(ipv4(1));
+        for (int i = 0; i < 15; i++) {
+            assert(limiter.takeConnection(key, 1000));
+        }
+        assert(!limiter.takeConnection(key, 1000));
+        assert(!limiter.takeConnection(key, 1050));
+        /* 10 per second is one per 100 ms */
+        assert(limiter.takeConnection(key, 1100));
+        assert(!limiter.takeConnection(key, 1100));
+        assert(limiter.takeConnection(key, 1300));
+        assert(limiter.takeConnection(key, 1300));
+        assert(!limiter.takeConnection(key, 1300));
+
+        /* Others are not held back by it, and requests have no limit here */
+        assert(limiter.takeConnection(limiter.key(ipv4(2)), 1300));
+        assert(limiter.takeRequest(key, 1300));
+
+        /* Idle for long, even across the wrap of the clock, the bucket is full again */
+        for (int i = 0; i < 15; i++) {
+            assert(limiter.takeConnection(key, 1300 + 3600000u * 2000));
+        }
+        assert(!limiter.takeConnection(key, 1300 + 3600000u * 2000));
+    }
+
+    /* IPv6 by prefix, IPv4 mapped into IPv6 as IPv4, anything else never */
+    {
+        uWS::RateLimiter limiter({.requestsPerSecond = 1});
+        assert(limiter.key(ipv6(1)) == limiter.key(ipv6(2)));
+        assert(limiter.key(ipv6(1)) != limiter.key(ipv6(1, 1)));
+        assert(limiter.takeRequest(limiter.key(ipv6(1)), 0));
+        assert(!limiter.takeRequest(limiter.key(ipv6(2)), 0));
+        assert(limiter.takeRequest(limiter.key(ipv6(1, 1)), 0));
+
+        std::string mapped(10, '\0');
+        mapped += "\xff\xff" + ipv4(7);
+        assert(limiter.key(mapped) == limiter.key(ipv4(7)));
+        assert(limiter.key(ipv4(7)) != limiter.key(ipv4(8)));
+
+        assert(limiter.key("") == 0);
+        for (int i = 0; i < 10; i++) {
+            assert(limiter.takeRequest(limiter.key(""), 0));
+        }
+
+        uWS::RateLimiter hosts({.requestsPerSecond = 1, .ipv6PrefixLength = 128});
+        assert(hosts.key(ipv6(1)) != hosts.key(ipv6(2)));
+    }
+
+    /* Far more addresses than buckets, sharing them: the few heavy ones are held to their rate, and nearly all of
+     * the light ones are let through */
+    {
+        uWS::RateLimiter limiter({.requestsPerSecond = 5, .buckets = 1024});
+        unsigned int heavyTaken = 0, lightRefused = 0;
+        for (uint32_t now = 0; now < 10000; now += 10) {
+            for (unsigned int heavy = 0; heavy < 8; heavy++) {
+                heavyTaken += limiter.takeRequest(limiter.key(ipv4(heavy)), now);
+            }
+            for (unsigned int light = 0; light < 20; light++) {
+                /* 2000 addresses making a request a second each */
+                lightRefused += !limiter.takeRequest(limiter.key(ipv4(1000 + (now / 10 * 20 + light) % 2000)), now);
+            }
+        }
+        assert(heavyTaken <= 8 * (5 + 5 * 10));
+        assert(heavyTaken >= 8 * 5 * 10);
+        assert(lightRefused < 20);
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,69 @@
+#include "../src/RequestArena.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+int main() {
+    uWS::BlockPool::get().trim();
+    {
+        uWS::RequestArena arena;
+        assert(arena.empty());
+
+        /* Alignment as asked, and writable memory that does not overlap */
+        std::vector<std::pair<char *, size_t>> allocations;
+        for (size_t i = 1; i < 600; i++) {
+            size_t alignment = (size_t) 1 << (i % 7);
+            char *p = (char *) arena.allocate(i, alignment);
+            assert(((uintptr_t) p & (alignment - 1)) == 0);
+            memset(p, (int) (i & 0xff), i);
+            allocations.push_back({p, i});
+        }
+        for (auto &[p, length] : allocations) {
+            for (size_t j = 0; j < length; j++) {
+                assert((unsigned char) p[j] == (length & 0xff));
+            }
+        }
+
+        /* Big ones get their own block without giving up the current one */
+        char *before = (char *) arena.allocate(16);
+        char *big = (char *) arena.allocate(100000, 64);
+        memset(big, 1, 100000);
+        char *after = (char *) arena.allocate(16);
+        assert(after == before + 16);
+
+        /* Blocks go back to the pool, and the next request bumps the same memory */
+        arena.reset();
+        assert(arena.empty());
+        unsigned int pooled = uWS::BlockPool::get().numFreeBlocks[uWS::BlockPool::NUM_SIZE_CLASSES - 1];
+        assert(pooled > 1);
+        char *again = (char *) arena.allocate(16);
+        assert(uWS::BlockPool::get().numFreeBlocks[uWS::BlockPool::NUM_SIZE_CLASSES - 1] == pooled - 1);
+        (void) again;
+        arena.reset();
+
+        /* As a resource of std::pmr containers */
+        {
+            std::pmr::vector<std::pmr::string> strings(&arena);
+            for (int i = 0; i < 100; i++) {
+                strings.emplace_back(std::string(50, (char) ('a' + i % 26)));
+            }
+            assert(strings.get_allocator().resource() == &arena && strings[99].get_allocator().resource() == &arena);
+            assert(std::string_view(strings[27]) == std::string(50, 'b'));
+        }
+        assert(!arena.empty());
+
+        /* Objects are constructed in place */
+        int *value = arena.make<int>(42);
+        assert(*value == 42);
+    }
+    /* Destroyed arenas give their blocks back too */
+    assert(uWS::BlockPool::get().numFreeBlocks[uWS::BlockPool::NUM_SIZE_CLASSES - 1] > 1);
+    uWS::BlockPool::get().trim();
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,34 @@
+#include <iostream>
+#include <cassert>
+
+#include "../src/RoutePattern.h"
+
+using UserPost = uWS::Route<"/users/:id/posts/:post">;
+using Static = uWS::Route<"/static/route">;
+
+/* Indices are known at compile time, in the order onHttp records them */
+static_assert(UserPost::numParameters == 2);
+static_assert(UserPost::index<"id">() == 0);
+static_assert(UserPost::index<"post">() == 1);
+static_assert(Static::numParameters == 0);
+static_assert(uWS::Route<"/:a/:b/:c">::index<"c">() == 2);
+
+int main() {
+    assert(std::string_view(UserPost::pattern) == "/users/:id/posts/:post");
+
+    /* What the router would have set for "/users/15/posts/hello" */
+    std::string_view values[] = {"15", "hello"};
+    uWS::HttpRequest req;
+    req.setParameters({1, values});
+
+    auto params = UserPost::parameters(&req);
+    assert(params.get<"id">() == "15");
+    assert(params.get<"post">() == "hello");
+    assert(req.getParameter(UserPost::index<"post">()) == "hello");
+
+    /* Missing parameters read as empty, just like getParameter */
+    req.setParameters({0, values});
+    assert(UserPost::parameters(&req).get<"post">().empty());
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,110 @@
+#include "../src/StaticAssets.h"
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const std::string root = "/tmp/uws_staticassets_test";
+
+static void writeFile(const std::string &path, const std::string &content) {
+    FILE *f = fopen((root + "/" + path).c_str(), "wb");
+    fwrite(content.data(), 1, content.length(), f);
+    fclose(f);
+}
+
+int main() {
+    std::cout << "TestStaticAssets" << std::endl;
+
+    std::filesystem::remove_all(root);
+    std::filesystem::create_directories(root + "/css");
+    writeFile("index.html", "<h1>hi</h1>");
+    writeFile("css/site.css", "body{}");
+    writeFile("big.bin", std::string(100000, 'b'));
+
+    uWS::StaticAssetsOptions options;
+    options.cacheControl = "no-cache";
+    uWS::StaticAssets assets("/static/", root, options);
+    assert(assets.isOpen() && assets.size() == 3);
+
+    /* Urls under the prefix only, directories mean their index */
+    uWS::StaticAssets::Asset *index = assets.find("/static/");
+    assert(index && index == assets.find("/static/index.html"));
+    assert(!assets.find("/static") && !assets.find("/staticcss/site.css") && !assets.find("/static/missing") && !assets.find("/static/css"));
+    uWS::StaticAssets::Asset *css = assets.find("/static/css/site.css");
+    assert(css && css->size == 6 && css->etag.length() == 18 && css->etag != index->etag);
+    assert(css->headers.find("Content-Type: text/css; charset=utf-8\r\n") != std::string::npos);
+    assert(css->headers.find("Cache-Control: no-cache\r\n") != std::string::npos);
+
+    /* Small files are whole responses, large ones are held open for sendfile */
+    assert(css->body == "body{}" && css->ok.find("Content-Length: 6\r\n\r\nbody{}") != std::string::npos);
+    assert(css->ok.substr(css->okDate - 6, 6) == "Date: " && css->notModified.substr(css->notModifiedDate - 6, 6) == "Date: ");
+    assert(css->notModified.find("304 Not Modified") != std::string::npos && css->notModified.find("Content-Length") == std::string::npos);
+    uWS::StaticAssets::Asset *big = assets.find("/static/big.bin");
+    assert(big && big->ok.empty() && big->file && big->head.find("Content-Length: 100000\r\n") != std::string::npos);
+
+    /* Revalidation, If-None-Match over If-Modified-Since */
+    uintmax_t offset, length;
+    auto answer = [&](std::string_view ifNoneMatch, std::string_view ifModifiedSince, std::string_view range = {}, std::string_view ifRange = {}) {
+        return uWS::StaticAssets::answer(big, ifNoneMatch, ifModifiedSince, range, ifRange, offset, length);
+    };
+    assert(answer({}, {}) == uWS::StaticAssets::FULL && offset == 0 && length == 100000);
+    assert(answer(big->etag, {}) == uWS::StaticAssets::NOT_MODIFIED);
+    assert(answer("\"other\", W/" + big->etag, {}) == uWS::StaticAssets::NOT_MODIFIED);
+    assert(answer("*", {}) == uWS::StaticAssets::NOT_MODIFIED);
+    assert(answer("\"other\"", big->lastModifiedDate) == uWS::StaticAssets::FULL);
+    assert(answer({}, big->lastModifiedDate) == uWS::StaticAssets::NOT_MODIFIED);
+    assert(answer({}, "Thu, 01 Jan 1970 00:00:00 GMT") == uWS::StaticAssets::FULL);
+    assert(answer({}, "Fri, 01 Jan 2100 00:00:00 GMT") == uWS::StaticAssets::NOT_MODIFIED);
+    assert(answer({}, "yesterday") == uWS::StaticAssets::FULL);
+
+    /* Ranges */
+    assert(answer({}, {}, "bytes=0-99") == uWS::StaticAssets::PARTIAL && offset == 0 && length == 100);
+    assert(answer({}, {}, "bytes=99990-") == uWS::StaticAssets::PARTIAL && offset == 99990 && length == 10);
+    assert(answer({}, {}, "bytes=99990-200000") == uWS::StaticAssets::PARTIAL && offset == 99990 && length == 10);
+    assert(answer({}, {}, "bytes=-5") == uWS::StaticAssets::PARTIAL && offset == 99995 && length == 5);
+    assert(answer({}, {}, "bytes=-500000") == uWS::StaticAssets::PARTIAL && offset == 0 && length == 100000);
+    assert(answer({}, {}, "bytes=100000-") == uWS::StaticAssets::UNSATISFIABLE);
+    assert(answer({}, {}, "bytes=-0") == uWS::StaticAssets::UNSATISFIABLE);
+    assert(answer({}, {}, "bytes=0-1,5-6") == uWS::StaticAssets::FULL);
+    assert(answer({}, {}, "bytes=5-1") == uWS::StaticAssets::FULL);
+    assert(answer({}, {}, "bytes=x-1") == uWS::StaticAssets::FULL);
+    assert(answer({}, {}, "lines=0-1") == uWS::StaticAssets::FULL);
+    assert(answer({}, {}, "bytes=0-0", big->etag) == uWS::StaticAssets::PARTIAL && length == 1);
+    assert(answer({}, {}, "bytes=0-0", big->lastModifiedDate) == uWS::StaticAssets::PARTIAL);
+    assert(answer({}, {}, "bytes=0-0", "\"stale\"") == uWS::StaticAssets::FULL && length == 100000);
+    assert(answer({}, {}, "bytes=0-0", "W/" + big->etag) == uWS::StaticAssets::FULL);
+
+#ifdef __linux__
+    /* Changed, added and removed files, and whole directories, are picked up */
+    std::string oldEtag = css->etag;
+    writeFile("css/site.css", "body{color:red}");
+    writeFile("new.js", "1");
+    remove((root + "/index.html").c_str());
+    std::filesystem::create_directories(root + "/img/icons");
+    writeFile("img/icons/a.svg", "<svg/>");
+    assert(assets.update());
+    assert(!assets.update());
+    css = assets.find("/static/css/site.css");
+    assert(css && css->size == 15 && css->etag != oldEtag);
+    assert(assets.find("/static/new.js") && !assets.find("/static/"));
+
+    /* A directory created before its watch was added is scanned as it is seen */
+    assert(assets.find("/static/img/icons/a.svg"));
+    writeFile("img/icons/b.svg", "<svg/>");
+    assert(assets.update() && assets.find("/static/img/icons/b.svg"));
+
+    std::filesystem::rename(root + "/img", "/tmp/uws_staticassets_moved");
+    assert(assets.update() && !assets.find("/static/img/icons/a.svg") && assets.size() == 3);
+    writeFile("../uws_staticassets_moved/icons/c.svg", "<svg/>");
+    assets.update();
+    assert(assets.size() == 3);
+    std::filesystem::remove_all("/tmp/uws_staticassets_moved");
+#endif
+
+    std::filesystem::remove_all(root);
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,114 @@
+#include "../src/TimingWheel.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+struct TestTimer {
+    uWS::TimingWheel::Timer timer;
+    uint64_t expiry = 0;
+    uint64_t firedAt = 0;
+    unsigned int fired = 0;
+};
+
+uWS::TimingWheel *wheel;
+
+int main() {
+    /* Random timers over every level and beyond, advanced in random steps */
+    for (int round = 0; round < 20; round++) {
+        uWS::TimingWheel timingWheel(round * 1000003ull);
+        wheel = &timingWheel;
+
+        std::vector<TestTimer> timers(2000);
+        uint64_t now = timingWheel.getNow();
+        for (TestTimer &t : timers) {
+            uint64_t delay;
+            switch (rand() % 5) {
+            case 0: delay = (uint64_t) rand() % 64; break;
+            case 1: delay = (uint64_t) rand() % 4096; break;
+            case 2: delay = (uint64_t) rand() % 300000; break;
+            case 3: delay = (uint64_t) rand() % (1 << 24); break;
+            default: delay = (1 << 24) + (uint64_t) rand() % (1 << 25); break;
+            }
+            t.timer.user = &t;
+            t.timer.cb = [](void *user) {
+                TestTimer *t = (TestTimer *) user;
+                t->fired++;
+                t->firedAt = wheel->getNow();
+            };
+            timingWheel.arm(&t.timer, delay, now);
+            t.expiry = now + (delay ? delay : 1);
+        }
+
+        /* Cancel some, re-arm some */
+        for (size_t i = 0; i < timers.size(); i += 7) {
+            timers[i].timer.cancel();
+            timers[i].expiry = 0;
+        }
+        for (size_t i = 3; i < timers.size(); i += 11) {
+            timingWheel.arm(&timers[i].timer, 100, now);
+            timers[i].expiry = now + 100;
+        }
+
+        uint64_t end = now + (3ull << 24);
+        while (now < end) {
+            now += 1 + (uint64_t) rand() % (rand() % 2 ? 50 : 100000);
+            timingWheel.advance(now);
+            assert(timingWheel.getNow() == now);
+
+            /* Everything due has fired, exactly at its tick */
+            for (TestTimer &t : timers) {
+                if (!t.expiry) {
+                    assert(!t.fired);
+                } else if (t.expiry <= now) {
+                    assert(t.fired == 1 && t.firedAt == t.expiry && !t.timer.isArmed());
+                } else {
+                    assert(!t.fired && t.timer.isArmed());
+                }
+            }
+        }
+        assert(timingWheel.nextTick() == UINT64_MAX || timingWheel.nextTick() > now);
+    }
+
+    /* Callbacks may cancel and arm others while firing */
+    {
+        uWS::TimingWheel timingWheel;
+        struct Pair {
+            uWS::TimingWheel::Timer a, b;
+            uWS::TimingWheel *wheel;
+            unsigned int firedA = 0, firedB = 0;
+        } pair;
+        pair.wheel = &timingWheel;
+        pair.a.user = pair.b.user = &pair;
+        pair.a.cb = [](void *user) {
+            Pair *p = (Pair *) user;
+            p->firedA++;
+            p->b.cancel();
+            /* Re-arm ourselves */
+            if (p->firedA < 3) {
+                p->wheel->arm(&p->a, 10, p->wheel->getNow());
+            }
+        };
+        pair.b.cb = [](void *user) {
+            ((Pair *) user)->firedB++;
+        };
+        timingWheel.arm(&pair.a, 5, 0);
+        timingWheel.arm(&pair.b, 6, 0);
+        timingWheel.advance(1000);
+        assert(pair.firedA == 3 && pair.firedB == 0);
+    }
+
+    /* Timers outliving the wheel are disarmed */
+    {
+        uWS::TimingWheel::Timer timer;
+        {
+            uWS::TimingWheel timingWheel;
+            timingWheel.arm(&timer, 10, 0);
+            assert(timer.isArmed());
+        }
+        assert(!timer.isArmed());
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../src/TlsSessionCache.h"
+
+static void fill(unsigned char *out, size_t length) {
+    static std::mt19937 rng(42);
+    for (size_t i = 0; i < length; i++) {
+        out[i] = (unsigned char) rng();
+    }
+}
+
+int main() {
+    /* Without capacity nothing is kept */
+    uWS::SessionStore store;
+    store.put("id", "session", 100);
+    assert(store.get("id", 0).empty());
+
+    /* Sessions come back until they expire, then they are gone */
+    store.reserve(16 * 4);
+    store.put("id", "session", 100);
+    assert(store.get("id", 99) == "session");
+    assert(store.get("id", 100).empty());
+    assert(store.size() == 0);
+
+    /* Replacing keeps one, erasing keeps none */
+    store.put("id", "first", 100);
+    store.put("id", "second", 100);
+    assert(store.size() == 1 && store.get("id", 0) == "second");
+    store.erase("id");
+    assert(store.size() == 0 && store.get("id", 0).empty());
+
+    /* Full shards forget their oldest sessions first, the newest are always there */
+    for (int i = 0; i < 1000; i++) {
+        store.put(std::to_string(i), std::to_string(i * 2), 100);
+    }
+    assert(store.size() <= 16 * 4);
+    for (int i = 990; i < 1000; i++) {
+        assert(store.get(std::to_string(i), 0) == std::to_string(i * 2));
+    }
+    assert(store.get("0", 0).empty());
+
+    /* Asking for less never shrinks it */
+    store.reserve(16);
+    store.reserve(16 * 100);
+    for (int i = 0; i < 1000; i++) {
+        store.put(std::to_string(i), std::to_string(i), 100);
+    }
+    assert(store.size() > 16 * 4);
+
+    /* Many threads at once */
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&store, t]() {
+            for (int i = 0; i < 10000; i++) {
+                std::string id = std::to_string(t) + "-" + std::to_string(i % 500);
+                store.put(id, std::string(id), 100);
+                std::string session = store.get(id, 0);
+                assert(session.empty() || session == id);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    /* Keys rotate after their lifetime, the previous one still decrypts until the next rotation */
+    uWS::TicketKeyRing ring(fill);
+    ring.setLifetime(60);
+    ring.setLifetime(120);
+    uWS::TicketKeyRing::Keys first = ring.get(1000);
+    assert(!first.hasPrevious);
+    assert(ring.find(first, first.current.name) == &first.current);
+    assert(!memcmp(ring.get(1059).current.name, first.current.name, 16));
+
+    uWS::TicketKeyRing::Keys second = ring.get(1060);
+    assert(memcmp(second.current.name, first.current.name, 16) && second.hasPrevious);
+    assert(ring.find(second, first.current.name) == &second.previous);
+
+    uWS::TicketKeyRing::Keys third = ring.get(1120);
+    assert(!ring.find(third, first.current.name));
+    assert(ring.find(third, second.current.name) == &third.previous);
+
+    /* Every thread sees the same keys */
+    unsigned char name[16];
+    memcpy(name, third.current.name, 16);
+    std::thread([&ring, name]() {
+        assert(!memcmp(ring.get(1121).current.name, name, 16));
+    }).join();
+
+    /* Another ring has keys of its own, even on the same thread */
+    uWS::TicketKeyRing other(fill);
+    other.setLifetime(60);
+    assert(memcmp(other.get(1121).current.name, name, 16));
+    assert(!memcmp(ring.get(1121).current.name, name, 16));
+
+    std::cout << "ALL PASS" << std::endl;
+}
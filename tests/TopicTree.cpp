@@ -2,6 +2,8 @@
 
 #include <cassert>
 #include <iostream>
+#include <set>
+#include <cstdlib>
 
 /* Modifying the topicTree inside callback is not allowed, we had
  * tests for this before but we never need this to work anyways.
@@ -192,8 +194,498 @@ void testReorderingv19() {
     delete topicTree;
 }
 
+/* Subscribers hold any number of pending messages, in runs, drained in one go */
+void testManyPendingMessages() {
+    std::cout << "TestManyPendingMessages" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    std::map<void *, std::string> expectedResult;
+    std::map<void *, std::string> actualResult;
+    std::map<void *, int> firsts, lasts;
+
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([&](uWS::Subscriber *s, std::string &message, auto flags) {
+
+        actualResult[s] += message;
+        firsts[s] += (flags & uWS::TopicTree<std::string, std::string_view>::IteratorFlags::FIRST) ? 1 : 0;
+        lasts[s] += (flags & uWS::TopicTree<std::string, std::string_view>::IteratorFlags::LAST) ? 1 : 0;
+
+        /* Success */
+        return false;
+    });
+
+    uWS::Subscriber *s1 = topicTree->createSubscriber();
+    uWS::Subscriber *s2 = topicTree->createSubscriber();
+
+    /* s1 gets every message while s2 gets every third, as runs of one */
+    topicTree->subscribe(s1, "all");
+    topicTree->subscribe(s2, "all");
+    topicTree->subscribe(s1, "some");
+
+    for (int i = 0; i < 1000; i++) {
+        std::string message = std::to_string(i) + ",";
+        if (i % 3 == 0) {
+            topicTree->publish(nullptr, "all", std::string(message));
+            expectedResult[s2].append(message);
+        } else {
+            topicTree->publish(nullptr, "some", std::string(message));
+        }
+        expectedResult[s1].append(message);
+    }
+
+    /* Nothing may be drained before we ask for it */
+    assert(actualResult.empty());
+
+    topicTree->drain();
+    for (auto &p : expectedResult) {
+        std::cout << "Subscriber: " << p.first << std::endl;
+
+        if (p.second != actualResult[p.first] || firsts[p.first] != 1 || lasts[p.first] != 1) {
+            std::cout << "ERROR: <" << actualResult[p.first] << "> should be <" << p.second << ">" << std::endl;
+            exit(1);
+        }
+    }
+
+    /* Release resources */
+    topicTree->freeSubscriber(s1);
+    topicTree->freeSubscriber(s2);
+
+    delete topicTree;
+}
+
+/* The open addressing set against std::set, growing, shrinking and deleting across wrapped probes */
+void testFlatPointerSet() {
+    std::cout << "TestFlatPointerSet" << std::endl;
+
+    uWS::FlatPointerSet<uWS::Subscriber, uWS::SubscriberHasher> set;
+    std::set<uWS::Subscriber *> reference;
+
+    srand(5);
+    for (int i = 0; i < 200000; i++) {
+        /* Fake but aligned addresses, from a range small enough to collide a lot */
+        uWS::Subscriber *s = (uWS::Subscriber *) (uintptr_t) (16 * (1 + rand() % (i < 100000 ? 4000 : 300)));
+        if (rand() % 3) {
+            assert(set.insert(s) == reference.insert(s).second);
+        } else {
+            assert(set.erase(s) == reference.erase(s));
+        }
+        assert(set.size() == reference.size());
+        assert(set.count(s) == reference.count(s));
+    }
+
+    std::set<uWS::Subscriber *> iterated;
+    for (uWS::Subscriber *s : set) {
+        assert(iterated.insert(s).second);
+    }
+    assert(iterated == reference);
+}
+
+/* MQTT wildcards, delivering once per subscriber no matter how many of its topics match */
+void testWildcards() {
+    std::cout << "TestWildcards" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    std::map<void *, std::string> actualResult;
+
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([&actualResult](uWS::Subscriber *s, std::string &message, auto flags) {
+
+        actualResult[s] += message;
+
+        /* Success */
+        return false;
+    });
+
+    uWS::Subscriber *exact = topicTree->createSubscriber();
+    uWS::Subscriber *plus = topicTree->createSubscriber();
+    uWS::Subscriber *hash = topicTree->createSubscriber();
+    uWS::Subscriber *all = topicTree->createSubscriber();
+
+    topicTree->subscribe(exact, "sensor/1/temp");
+    topicTree->subscribe(plus, "sensor/+/temp");
+    topicTree->subscribe(hash, "sensor/#");
+    /* Matches everything at least twice */
+    topicTree->subscribe(all, "#");
+    topicTree->subscribe(all, "+/+/temp");
+    topicTree->subscribe(all, "sensor/1/temp");
+
+    topicTree->publish(nullptr, "sensor/1/temp", "a,");
+    topicTree->publish(nullptr, "sensor/2/temp", "b,");
+    topicTree->publish(nullptr, "sensor", "c,");
+    topicTree->publish(nullptr, "sensor/2/humidity", "d,");
+    topicTree->publish(nullptr, "sensor//temp", "e,");
+    /* Wildcards do not match system topics at the first level */
+    topicTree->publish(nullptr, "$SYS/1/temp", "f,");
+    assert(topicTree->publish(nullptr, "other", "g,"));
+    topicTree->drain();
+
+    assert(actualResult[exact] == "a,");
+    assert(actualResult[plus] == "a,b,e,");
+    assert(actualResult[hash] == "a,b,c,d,e,");
+    assert(actualResult[all] == "a,b,c,d,e,g,");
+
+    /* Unsubscribing prunes the trie, the rest keeps matching */
+    topicTree->unsubscribe(all, "#");
+    topicTree->unsubscribe(hash, "sensor/#");
+    actualResult.clear();
+    topicTree->publish(nullptr, "sensor/3/temp", "h,");
+    assert(!topicTree->publish(nullptr, "sensor", "i,"));
+    topicTree->drain();
+
+    assert(actualResult[plus] == "h," && actualResult[all] == "h," && actualResult[hash] == "");
+
+    /* Release resources */
+    topicTree->freeSubscriber(exact);
+    topicTree->freeSubscriber(plus);
+    topicTree->freeSubscriber(hash);
+    topicTree->freeSubscriber(all);
+
+    delete topicTree;
+}
+
+/* Subscribing and unsubscribing many topics at once does the same as one by one */
+void testBulkSubscriptions() {
+    std::cout << "TestBulkSubscriptions" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    std::map<void *, std::string> actualResult;
+
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([&actualResult](uWS::Subscriber *s, std::string &message, auto flags) {
+        actualResult[s] += message;
+        return false;
+    });
+
+    uWS::Subscriber *bulk = topicTree->createSubscriber();
+    uWS::Subscriber *other = topicTree->createSubscriber();
+    topicTree->subscribe(bulk, "old");
+    topicTree->subscribe(other, "shared");
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 300; i++) {
+        names.push_back("topic/" + std::to_string(i));
+    }
+    std::vector<std::string_view> topics(names.begin(), names.end());
+    topics.push_back("old");
+    topics.push_back("shared");
+    topics.push_back("sensor/+");
+    topics.push_back("topic/7");
+
+    /* Already held topics and duplicates of the batch are skipped */
+    auto subscribed = topicTree->subscribe(bulk, topics.data(), topics.size());
+    assert(subscribed.size() == 302 && subscribed[0].first == 0 && subscribed[299].first == 299);
+    assert(subscribed[300].first == 301 && subscribed[300].second->size() == 2 && subscribed[301].first == 302);
+    assert(bulk->topics.size() == 303 && std::is_sorted(bulk->topics.begin(), bulk->topics.end()));
+    assert(topicTree->subscribe(bulk, topics.data(), topics.size()).empty());
+
+    topicTree->publish(nullptr, "topic/42", "a,");
+    topicTree->publish(nullptr, "shared", "b,");
+    topicTree->publish(nullptr, "sensor/1", "c,");
+    topicTree->drain();
+    assert(actualResult[bulk] == "a,b,c," && actualResult[other] == "b,");
+
+    /* Unsubscribing removes topics nobody holds anymore, once */
+    std::vector<std::string_view> leaving = {"topic/1", "shared", "missing", "topic/1", "sensor/+", "old"};
+    auto unsubscribed = topicTree->unsubscribe(bulk, leaving.data(), leaving.size());
+    assert(unsubscribed.size() == 4);
+    assert(unsubscribed[0].first == 0 && unsubscribed[0].second == 0 && unsubscribed[1].first == 1 && unsubscribed[1].second == 1);
+    assert(unsubscribed[2].first == 4 && unsubscribed[2].second == 0 && unsubscribed[3].first == 5 && unsubscribed[3].second == 0);
+    assert(bulk->topics.size() == 299 && std::is_sorted(bulk->topics.begin(), bulk->topics.end()));
+    assert(!topicTree->lookupTopic("topic/1") && !topicTree->lookupTopic("old") && !topicTree->hasWildcardTopics());
+    assert(topicTree->lookupTopic("shared")->size() == 1);
+
+    actualResult.clear();
+    topicTree->publish(nullptr, "shared", "d,");
+    topicTree->publish(nullptr, "topic/2", "e,");
+    topicTree->drain();
+    assert(actualResult[bulk] == "e," && actualResult[other] == "d,");
+
+    topicTree->freeSubscriber(bulk);
+    topicTree->freeSubscriber(other);
+
+    delete topicTree;
+}
+
+/* One message published to several topics is stored once and reaches every subscriber once */
+void testMultiTopicPublish() {
+    std::cout << "TestMultiTopicPublish" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    std::map<void *, std::string> actualResult;
+
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([&actualResult](uWS::Subscriber *s, std::string &message, auto flags) {
+        actualResult[s] += message;
+        return false;
+    });
+
+    uWS::Subscriber *room = topicTree->createSubscriber();
+    uWS::Subscriber *user = topicTree->createSubscriber();
+    uWS::Subscriber *both = topicTree->createSubscriber();
+    topicTree->subscribe(room, "room/42");
+    topicTree->subscribe(user, "user/17");
+    topicTree->subscribe(both, "room/42");
+    topicTree->subscribe(both, "user/17");
+
+    std::string_view topics[] = {"room/42", "user/17", "nobody"};
+    assert(topicTree->publish(nullptr, topics, 3, "a,"));
+    /* The sender is skipped as usual */
+    assert(topicTree->publish(both, topics, 2, "b,"));
+    assert(!topicTree->publish(nullptr, topics + 2, 1, "c,"));
+    topicTree->drain();
+    assert(actualResult[room] == "a,b," && actualResult[user] == "a,b," && actualResult[both] == "a,");
+
+    /* Wildcards matching several of them as well */
+    uWS::Subscriber *all = topicTree->createSubscriber();
+    topicTree->subscribe(all, "#");
+    topicTree->subscribe(all, "room/+");
+    actualResult.clear();
+    assert(topicTree->publish(nullptr, topics, 3, "d,"));
+    topicTree->drain();
+    assert(actualResult[all] == "d," && actualResult[both] == "d,");
+
+    /* Big messages too */
+    std::map<void *, int> big;
+    assert(topicTree->publishBig(nullptr, topics, 3, "e", [&big](uWS::Subscriber *s, std::string_view) {
+        big[s]++;
+    }));
+    assert(big.size() == 4 && big[all] == 1 && big[both] == 1);
+
+    topicTree->freeSubscriber(room);
+    topicTree->freeSubscriber(user);
+    topicTree->freeSubscriber(both);
+    topicTree->freeSubscriber(all);
+
+    delete topicTree;
+}
+
+/* Backlogged subscribers of conflated topics keep only the latest message per topic until they drain */
+void testConflation() {
+    std::cout << "TestConflation" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    std::map<void *, std::string> actualResult;
+    std::set<uWS::Subscriber *> backlogged;
+
+    /* Messages are "topic=value," here, the way App decides on conflation */
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([&topicTree, &actualResult, &backlogged](uWS::Subscriber *s, std::string &message, auto /*flags*/) {
+        const std::string *conflatedTopic = topicTree->getConflatedTopic(message.substr(0, message.find('=')));
+        if (conflatedTopic && (backlogged.count(s) || topicTree->isConflating(s, *conflatedTopic))) {
+            topicTree->conflate(s, *conflatedTopic, message);
+        } else {
+            actualResult[s] += message;
+        }
+        return false;
+    });
+
+    uWS::Subscriber *fast = topicTree->createSubscriber();
+    uWS::Subscriber *slow = topicTree->createSubscriber();
+    for (uWS::Subscriber *s : {fast, slow}) {
+        topicTree->subscribe(s, "price");
+        topicTree->subscribe(s, "volume");
+        topicTree->subscribe(s, "news");
+    }
+    topicTree->setConflated("price", true);
+    topicTree->setConflated("volume", true);
+    assert(topicTree->getConflatedTopic("price") && !topicTree->getConflatedTopic("news"));
+
+    /* Only the backlogged one conflates, and never the topics that are not */
+    backlogged.insert(slow);
+    for (int i = 0; i < 3; i++) {
+        topicTree->publish(nullptr, "price", "price=" + std::to_string(i) + ",");
+        topicTree->publish(nullptr, "volume", "volume=" + std::to_string(i) + ",");
+        topicTree->publish(nullptr, "news", "news=" + std::to_string(i) + ",");
+    }
+    topicTree->drain();
+    assert(actualResult[fast] == "price=0,volume=0,news=0,price=1,volume=1,news=1,price=2,volume=2,news=2,");
+    assert(actualResult[slow] == "news=0,news=1,news=2,");
+
+    /* Draining hands over the latest of each, in the order their topics first came */
+    backlogged.clear();
+    topicTree->publish(nullptr, "price", "price=3,");
+    topicTree->drain();
+    assert(actualResult[slow] == "news=0,news=1,news=2,");
+    topicTree->flushConflated(slow);
+    assert(actualResult[slow] == "news=0,news=1,news=2,price=3,volume=2,");
+    assert(!topicTree->isConflating(slow, "price"));
+
+    /* Nothing held back, nothing to flush */
+    topicTree->flushConflated(slow);
+    topicTree->flushConflated(fast);
+    assert(actualResult[slow] == "news=0,news=1,news=2,price=3,volume=2,");
+
+    /* No longer conflated, every message goes */
+    topicTree->setConflated("price", false);
+    backlogged.insert(slow);
+    topicTree->publish(nullptr, "price", "price=4,");
+    topicTree->publish(nullptr, "price", "price=5,");
+    topicTree->publish(nullptr, "volume", "volume=3,");
+    topicTree->drain();
+    assert(actualResult[slow] == "news=0,news=1,news=2,price=3,volume=2,price=4,price=5,");
+
+    /* Whatever is still held back is freed with the subscriber */
+    topicTree->freeSubscriber(fast);
+    topicTree->freeSubscriber(slow);
+
+    delete topicTree;
+}
+
+/* Retained messages, by topic and by wildcard topic, replayed oldest first */
+void testRetained() {
+    std::cout << "TestRetained" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([](uWS::Subscriber *, std::string &, auto) {
+        return false;
+    });
+
+    auto retained = [&topicTree](std::string_view topic) {
+        std::string result;
+        topicTree->forEachRetained(topic, [&result](std::string &message) {
+            result += message;
+        });
+        return result;
+    };
+
+    /* Retained whether anyone subscribes or not, the oldest going first */
+    topicTree->setRetained("price", 2);
+    topicTree->setRetained("ticker/+", 1);
+    topicTree->publish(nullptr, "price", "1,");
+    topicTree->publish(nullptr, "price", "2,");
+    topicTree->publish(nullptr, "price", "3,");
+    topicTree->publish(nullptr, "news", "a,");
+    topicTree->publish(nullptr, "ticker/a", "a1,");
+    topicTree->publish(nullptr, "ticker/a", "a2,");
+    topicTree->publishBig(nullptr, "ticker/b", "b1,", [](uWS::Subscriber *, std::string_view) {});
+    topicTree->publish(nullptr, "ticker/a/deeper", "x,");
+    topicTree->drain();
+
+    assert(retained("price") == "2,3,");
+    assert(retained("news") == "");
+    assert(retained("ticker/a") == "a2," && retained("ticker/b") == "b1,");
+    assert(retained("ticker/a/deeper") == "");
+
+    /* Wildcard subscriptions get everything retained that they match */
+    assert(retained("ticker/+") == "a2,b1,");
+    assert(retained("#") == "2,3,a2,b1,");
+    assert(retained("+/b") == "b1,");
+
+    /* Same rules as publish: levels match whole, "#" matches the parent too, "$" topics only by name */
+    assert(topicTree->matches("sport/#", "sport") && topicTree->matches("sport/+/x", "sport//x"));
+    assert(!topicTree->matches("sport/+", "sport") && !topicTree->matches("sport", "sport/tennis"));
+    assert(!topicTree->matches("#", "$SYS/x") && !topicTree->matches("+/x", "$SYS/x") && topicTree->matches("$SYS/#", "$SYS/x"));
+
+    /* Stopping forgets what the rule kept */
+    topicTree->setRetained("ticker/+", 0);
+    topicTree->publish(nullptr, "ticker/c", "c1,");
+    assert(retained("ticker/#") == "");
+    topicTree->setRetained("price", 0);
+    assert(retained("price") == "");
+
+    delete topicTree;
+}
+
+void testCoalescing() {
+    std::cout << "TestCoalescing" << std::endl;
+
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([](uWS::Subscriber *, std::string &, auto) {
+        return false;
+    });
+
+    /* The loop arms timers and fires them, here we do */
+    std::vector<std::string> batches;
+    std::vector<uWS::TimingWheel::Timer *> timers;
+    topicTree->batchHandler = [&batches](std::string_view topic, std::string &&payload, int kind) {
+        batches.push_back(std::string(topic) + ":" + std::to_string(kind) + ":" + payload);
+    };
+    topicTree->armBatchTimer = [&timers](uWS::TimingWheel::Timer *timer, unsigned int ms) {
+        assert(ms == 5);
+        timers.push_back(timer);
+    };
+
+    /* Within the loop iteration, joined */
+    topicTree->setCoalesced("chat", uWS::CoalescingOptions{});
+    assert(topicTree->coalesce("chat", "a", 1) && topicTree->coalesce("chat", "b", 1));
+    assert(!topicTree->coalesce("other", "x", 1));
+    assert(batches.empty());
+    topicTree->flushImmediateBatches();
+    assert(batches.size() == 1 && batches[0] == "chat:1:a\nb");
+
+    /* Another kind ends the batch, as does reaching maxBytes */
+    topicTree->coalesce("chat", "a", 1);
+    topicTree->coalesce("chat", "b", 2);
+    assert(batches.size() == 2 && batches[1] == "chat:1:a");
+    topicTree->setCoalesced("chat", uWS::CoalescingOptions{0, 4, ",", false});
+    assert(batches.size() == 3 && batches[2] == "chat:2:b");
+    topicTree->coalesce("chat", "ab", 1);
+    topicTree->coalesce("chat", "c", 1);
+    assert(batches.size() == 4 && batches[3] == "chat:1:ab,c");
+
+    /* Windows are timed per topic, length prefixed batches take apart unambiguously */
+    topicTree->setCoalesced("ticker/+", uWS::CoalescingOptions{5, 1024, "", true});
+    topicTree->coalesce("ticker/a", "x", 1);
+    topicTree->coalesce("ticker/b", "yz", 1);
+    topicTree->coalesce("ticker/a", "", 1);
+    topicTree->flushImmediateBatches();
+    assert(batches.size() == 4 && timers.size() == 2);
+    timers[1]->cb(timers[1]->user);
+    assert(batches.size() == 5 && batches[4] == std::string("ticker/b:1:\2\0\0\0yz", 17));
+    timers[0]->cb(timers[0]->user);
+    assert(batches.size() == 6 && batches[5] == std::string("ticker/a:1:\1\0\0\0x\0\0\0\0", 20));
+
+    /* Stopping sends what was held */
+    topicTree->coalesce("ticker/c", "w", 1);
+    topicTree->setCoalesced("ticker/+", std::nullopt);
+    assert(batches.size() == 7 && batches[6] == std::string("ticker/c:1:\1\0\0\0w", 16));
+    assert(!topicTree->coalesce("ticker/c", "w", 1));
+
+    delete topicTree;
+}
+
+void testClear() {
+    std::cout << "TestClear" << std::endl;
+
+    std::map<uWS::Subscriber *, std::string> received;
+    uWS::TopicTree<std::string, std::string_view> *topicTree;
+    topicTree = new uWS::TopicTree<std::string, std::string_view>([&received](uWS::Subscriber *s, std::string &message, auto) {
+        received[s] += message;
+        return false;
+    });
+
+    uWS::Subscriber *s1 = topicTree->createSubscriber();
+    uWS::Subscriber *s2 = topicTree->createSubscriber();
+    topicTree->subscribe(s1, "a");
+    topicTree->subscribe(s1, "b/+");
+    topicTree->subscribe(s2, "a");
+    topicTree->publish(nullptr, "a", "1");
+
+    /* What was published goes out, then nobody subscribes to anything */
+    unsigned int topicsVersion = topicTree->getTopicsVersion();
+    topicTree->clear();
+    assert(received[s1] == "1" && received[s2] == "1");
+    assert(s1->topics.empty() && s2->topics.empty() && !s1->needsDrainage() && !s2->needsDrainage());
+    assert(!topicTree->lookupTopic("a") && !topicTree->hasWildcardTopics() && topicTree->getTopicsVersion() != topicsVersion);
+    assert(!topicTree->publish(nullptr, "a", "2") && !topicTree->publish(nullptr, "b/c", "2"));
+
+    /* Subscribers are still ours to free, and can subscribe again meanwhile */
+    topicTree->subscribe(s2, "b/#");
+    assert(topicTree->publish(nullptr, "b/c", "3"));
+    topicTree->freeSubscriber(s1);
+    topicTree->drain();
+    assert(received[s2] == "13");
+    topicTree->freeSubscriber(s2);
+
+    delete topicTree;
+}
+
 int main() {
     testCorrectness();
     testBugReport();
     testReorderingv19();
+    testManyPendingMessages();
+    testFlatPointerSet();
+    testWildcards();
+    testBulkSubscriptions();
+    testMultiTopicPublish();
+    testConflation();
+    testRetained();
+    testCoalescing();
+    testClear();
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "../src/TrafficCapture.h"
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+static std::string readFile(const char *path) {
+    std::string content;
+    FILE *file = fopen(path, "rb");
+    char buffer[4096];
+    for (size_t length; (length = fread(buffer, 1, sizeof(buffer), file)); ) {
+        content.append(buffer, length);
+    }
+    fclose(file);
+    return content;
+}
+
+int main() {
+    const char *path = "TrafficCapture.cap";
+    int a, b, c, upgraded, before;
+    std::string big(100000, 'x');
+
+    /* Sockets are told apart by address, moved ones keep their connection */
+    uWS::TrafficCapture *capture = uWS::TrafficCapture::create(path);
+    assert(capture);
+    capture->data(&before, "not captured", 12);
+    capture->open(&a);
+    capture->open(&b);
+    capture->data(&a, "GET / HTTP/1.1\r\n\r\n", 18);
+    capture->data(&b, big.data(), (int) big.length());
+    capture->move(&b, &upgraded);
+    capture->data(&upgraded, "\x81\x80", 2);
+    capture->close(&a);
+    capture->close(&before);
+    capture->open(&c);
+    capture->close(&upgraded);
+    delete capture;
+
+    std::string content = readFile(path);
+    std::string_view records = content;
+    assert(records.substr(0, 8) == uWS::TrafficCapture::MAGIC);
+    records.remove_prefix(8);
+
+    struct {
+        uWS::TrafficCapture::Type type;
+        uint64_t connection;
+        std::string_view data;
+    } expected[] = {
+        {uWS::TrafficCapture::OPEN, 0, {}},
+        {uWS::TrafficCapture::OPEN, 1, {}},
+        {uWS::TrafficCapture::DATA, 0, "GET / HTTP/1.1\r\n\r\n"},
+        {uWS::TrafficCapture::DATA, 1, big},
+        {uWS::TrafficCapture::DATA, 1, "\x81\x80"},
+        {uWS::TrafficCapture::CLOSE, 0, {}},
+        {uWS::TrafficCapture::OPEN, 2, {}},
+        {uWS::TrafficCapture::CLOSE, 1, {}}
+    };
+    uWS::TrafficCapture::Record record = {};
+    uint64_t lastTime = 0;
+    for (auto &e : expected) {
+        assert(uWS::TrafficCapture::read(records, record));
+        assert(record.type == e.type && record.connection == e.connection && record.data == e.data);
+        assert(record.time >= lastTime);
+        lastTime = record.time;
+    }
+    assert(!uWS::TrafficCapture::read(records, record));
+
+    /* Cut short anywhere, reading stops rather than going past the end */
+    for (size_t cut = 8; cut < content.length(); cut += 997) {
+        std::string_view truncated = std::string_view(content).substr(8, cut - 8);
+        record = {};
+        size_t count = 0;
+        while (uWS::TrafficCapture::read(truncated, record)) {
+            count++;
+        }
+        assert(count <= 8);
+    }
+
+    /* Nothing past maxBytes */
+    capture = uWS::TrafficCapture::create(path, 1000);
+    capture->open(&a);
+    capture->data(&a, big.data(), (int) big.length());
+    capture->data(&a, "more", 4);
+    capture->open(&b);
+    delete capture;
+    content = readFile(path);
+    records = std::string_view(content).substr(8);
+    record = {};
+    assert(uWS::TrafficCapture::read(records, record) && record.type == uWS::TrafficCapture::OPEN);
+    assert(uWS::TrafficCapture::read(records, record) && record.data.length() == big.length());
+    assert(!uWS::TrafficCapture::read(records, record));
+
+    remove(path);
+    std::cout << "ALL PASS" << std::endl;
+}
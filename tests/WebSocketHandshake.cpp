@@ -0,0 +1,54 @@
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <random>
+
+#include "../src/WebSocketHandshake.h"
+
+int main() {
+    /* The example of RFC 6455 */
+    char accept[29] = {};
+    uWS::WebSocketHandshake::generate("dGhlIHNhbXBsZSBub25jZQ==", accept);
+    assert(!strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="));
+
+    /* Whatever this machine accelerates agrees with the portable code */
+    std::mt19937 rng(42);
+    for (int i = 0; i < 10000; i++) {
+        uint32_t block[16], hash[5], expected[5];
+        for (uint32_t &word : block) {
+            word = (uint32_t) rng();
+        }
+        for (int j = 0; j < 5; j++) {
+            hash[j] = expected[j] = (uint32_t) rng();
+        }
+        uint32_t scratch[16];
+        memcpy(scratch, block, sizeof(block));
+        uWS::WebSocketHandshake::sha1(expected, scratch);
+
+#if defined(UWS_HANDSHAKE_X86)
+        if (uWS::WebSocketHandshake::hasShaExtensions()) {
+            uWS::WebSocketHandshake::sha1Extensions(hash, block);
+            assert(!memcmp(hash, expected, sizeof(hash)));
+        }
+#elif defined(UWS_HANDSHAKE_ARM)
+        uWS::WebSocketHandshake::sha1Extensions(hash, block);
+        assert(!memcmp(hash, expected, sizeof(hash)));
+#endif
+
+        unsigned char bytes[20];
+        for (unsigned char &byte : bytes) {
+            byte = (unsigned char) rng();
+        }
+        char encoded[29] = {}, expectedEncoded[29] = {};
+        uWS::WebSocketHandshake::base64(bytes, expectedEncoded);
+        assert(strlen(expectedEncoded) == 28 && expectedEncoded[27] == '=');
+#if defined(UWS_HANDSHAKE_X86)
+        if (uWS::WebSocketHandshake::hasShaExtensions()) {
+            uWS::WebSocketHandshake::base64Ssse3(bytes, encoded);
+            assert(!strcmp(encoded, expectedEncoded));
+        }
+#endif
+    }
+
+    std::cout << "ALL PASS" << std::endl;
+}
@@ -0,0 +1,135 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstring>
+
+#include "../src/WebSocketProtocol.h"
+
+/* Collects whole messages the way WebSocketContext does, fragment by fragment */
+template <bool isServer>
+struct Impl {
+    static inline std::vector<std::pair<int, std::string>> messages;
+    static inline std::string fragments;
+
+    static bool refusePayloadLength(uint64_t length, uWS::WebSocketState<isServer> *, void *) {
+        return length > 1024 * 1024;
+    }
+
+    static bool setCompressed(uWS::WebSocketState<isServer> *, void *) {
+        return false;
+    }
+
+    static void forceClose(uWS::WebSocketState<isServer> *, void *, std::string_view = {}) {
+        assert(false);
+    }
+
+    static bool handleFragment(char *data, size_t length, unsigned int remainingBytes, int opCode, bool fin, uWS::WebSocketState<isServer> *, void *) {
+        fragments.append(data, length);
+        if (!remainingBytes && fin) {
+            messages.emplace_back(opCode, std::move(fragments));
+            fragments.clear();
+        }
+        return false;
+    }
+};
+
+/* Feeds everything in reads of at most maxRead bytes, padded in front and behind like uSockets does */
+template <bool isServer>
+void consume(std::string &stream, size_t maxRead) {
+    std::vector<char> buffer(32 + maxRead + 32);
+    uWS::WebSocketState<isServer> state;
+    for (size_t offset = 0; offset < stream.length(); offset += maxRead) {
+        size_t length = std::min(maxRead, stream.length() - offset);
+        memcpy(buffer.data() + 32, stream.data() + offset, length);
+        uWS::WebSocketProtocol<isServer, Impl<isServer>>::consume(buffer.data() + 32, (unsigned int) length, &state, nullptr);
+    }
+}
+
+int main() {
+    std::mt19937 rng(42);
+
+    /* Sizes around every header length boundary and around every width of the mask kernels */
+    std::vector<size_t> sizes = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 125, 126, 127, 1000, 65535, 65536, 100000};
+    std::vector<std::string> payloads;
+    std::string stream;
+    for (size_t size : sizes) {
+        std::string payload(size, 0);
+        for (char &c : payload) {
+            c = (char) rng();
+        }
+
+        /* Clients mask, taking exactly the 4 bytes more of messageFrameSize */
+        std::vector<char> frame(uWS::protocol::messageFrameSize<false>(size));
+        size_t frameLength = uWS::protocol::formatMessage<false>(frame.data(), payload.data(), payload.length(), uWS::BINARY, payload.length(), false, true);
+        assert(frameLength == frame.size());
+        assert(frameLength == uWS::protocol::messageFrameSize<true>(size) + 4);
+        assert(frame[1] & 0x80);
+
+        /* Something non-trivial was masked in */
+        if (size >= 16) {
+            assert(memcmp(frame.data() + frameLength - size, payload.data(), size) != 0);
+        }
+
+        stream.append(frame.data(), frameLength);
+        payloads.push_back(std::move(payload));
+    }
+
+    /* Servers unmask all of it, whole and in small pieces */
+    for (size_t maxRead : {(size_t) 1, (size_t) 7, (size_t) 1000, stream.length()}) {
+        Impl<true>::messages.clear();
+        consume<true>(stream, maxRead);
+        assert(Impl<true>::messages.size() == payloads.size());
+        for (size_t i = 0; i < payloads.size(); i++) {
+            assert(Impl<true>::messages[i].first == uWS::BINARY);
+            assert(Impl<true>::messages[i].second == payloads[i]);
+        }
+    }
+
+    /* And clients read the unmasked frames of servers */
+    std::string serverStream;
+    for (std::string &payload : payloads) {
+        std::vector<char> frame(uWS::protocol::messageFrameSize<true>(payload.length()));
+        serverStream.append(frame.data(), uWS::protocol::formatMessage<true>(frame.data(), payload.data(), payload.length(), uWS::BINARY, payload.length(), false, true));
+    }
+    for (size_t maxRead : {(size_t) 3, (size_t) 4096}) {
+        Impl<false>::messages.clear();
+        consume<false>(serverStream, maxRead);
+        assert(Impl<false>::messages.size() == payloads.size());
+        for (size_t i = 0; i < payloads.size(); i++) {
+            assert(Impl<false>::messages[i].second == payloads[i]);
+        }
+    }
+
+    /* Text validated piece by piece, however the pieces split its code points */
+    std::string text = "ascii, \xc3\xa5\xc3\xa4\xc3\xb6, \xe2\x82\xac uro, \xf0\x9f\x98\x80 and more ascii to get past the vector widths of validation";
+    for (size_t piece = 1; piece <= text.length(); piece++) {
+        unsigned char tail[3];
+        unsigned char tailLength = 0;
+        for (size_t offset = 0; offset < text.length(); offset += piece) {
+            bool last = offset + piece >= text.length();
+            assert(uWS::protocol::isValidUtf8Chunk((unsigned char *) text.data() + offset, std::min(piece, text.length() - offset), tail, tailLength, last));
+        }
+        assert(!tailLength);
+    }
+
+    /* Truncated or broken code points fail, however split */
+    for (std::string broken : {std::string("abc\xe2\x82"), std::string("abc\xe2\x28\xa1 def"), std::string("\xf0\x9f\x98")}) {
+        for (size_t piece = 1; piece <= broken.length(); piece++) {
+            unsigned char tail[3];
+            unsigned char tailLength = 0;
+            bool valid = true;
+            for (size_t offset = 0; offset < broken.length() && valid; offset += piece) {
+                bool last = offset + piece >= broken.length();
+                valid = uWS::protocol::isValidUtf8Chunk((unsigned char *) broken.data() + offset, std::min(piece, broken.length() - offset), tail, tailLength, last);
+            }
+            assert(!valid);
+        }
+    }
+
+    /* Masking keys differ from frame to frame */
+    assert(uWS::protocol::maskingKey() != uWS::protocol::maskingKey());
+
+    std::cout << "ALL BRANCHES COVERED!" << std::endl;
+}
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "../src/WebTransportProtocol.h"
+
+void testVarints() {
+    /* RFC 9000 A.1 */
+    std::pair<std::string, uint64_t> examples[] = {
+        {"\xc2\x19\x7c\x5e\xff\x14\xe8\x8c", 151288809941952652ull},
+        {"\x9d\x7f\x3e\x7d", 494878333},
+        {"\x7b\xbd", 15293},
+        {"\x25", 37},
+        {"\x40\x25", 37}
+    };
+    for (auto &[encoded, value] : examples) {
+        size_t pos = 0;
+        uint64_t decoded;
+        assert(uWS::webtransport::readVarint(encoded, pos, decoded) && decoded == value && pos == encoded.length());
+
+        /* Cut short */
+        pos = 0;
+        assert(!uWS::webtransport::readVarint(encoded.substr(0, encoded.length() - 1), pos, decoded));
+    }
+
+    /* Shortest encodings come back, at every length */
+    for (uint64_t value : {0ull, 63ull, 64ull, 16383ull, 16384ull, 1073741823ull, 1073741824ull, 4611686018427387903ull}) {
+        std::string encoded;
+        uWS::webtransport::writeVarint(encoded, value);
+        assert(encoded.length() == (value < 64 ? 1u : value < 16384 ? 2u : value < 1073741824 ? 4u : 8u));
+        size_t pos = 0;
+        uint64_t decoded;
+        assert(uWS::webtransport::readVarint(encoded, pos, decoded) && decoded == value);
+    }
+}
+
+void testCapsules() {
+    /* Datagrams of all sizes, one unknown capsule and a close */
+    std::string stream;
+    std::vector<std::pair<uint64_t, std::string>> expected;
+    for (int i = 0; i < 20; i++) {
+        std::string payload((size_t) i * 37, (char) ('a' + i));
+        uWS::webtransport::formatCapsule(stream, uWS::webtransport::DATAGRAM, payload);
+        expected.push_back({uWS::webtransport::DATAGRAM, payload});
+    }
+    uWS::webtransport::formatCapsule(stream, 0x1234567, "ignored");
+    expected.push_back({0x1234567, "ignored"});
+    uWS::webtransport::formatClose(stream, 0xdeadbeef, "bye");
+    expected.push_back({uWS::webtransport::CLOSE_WEBTRANSPORT_SESSION, std::string("\xde\xad\xbe\xef", 4) + "bye"});
+
+    /* Whole, whether in one read or split anywhere */
+    for (size_t readSize : {stream.length(), (size_t) 1, (size_t) 2, (size_t) 7, (size_t) 100}) {
+        uWS::webtransport::CapsuleParser parser;
+        size_t capsules = 0;
+        for (size_t offset = 0; offset < stream.length(); offset += readSize) {
+            assert(parser.consume(std::string_view(stream).substr(offset, readSize), 1024, [&](uint64_t type, std::string_view payload) {
+                assert(type == expected[capsules].first && payload == expected[capsules].second);
+                capsules++;
+                return true;
+            }) == uWS::webtransport::CapsuleParser::OK);
+        }
+        assert(capsules == expected.size());
+    }
+
+    /* Stopping leaves the rest */
+    uWS::webtransport::CapsuleParser parser;
+    int calls = 0;
+    assert(parser.consume(stream, 1024, [&calls](uint64_t, std::string_view) {
+        return ++calls < 3;
+    }) == uWS::webtransport::CapsuleParser::STOPPED && calls == 3);
+
+    /* Longer than we take, known from its header alone */
+    std::string big;
+    uWS::webtransport::formatCapsule(big, uWS::webtransport::DATAGRAM, std::string(2000, 'x'));
+    uWS::webtransport::CapsuleParser bigParser;
+    auto none = [](uint64_t, std::string_view) { return true; };
+    assert(bigParser.consume(big.substr(0, 1), 1024, none) == uWS::webtransport::CapsuleParser::OK);
+    assert(bigParser.consume(big.substr(1, 2), 1024, none) == uWS::webtransport::CapsuleParser::TOO_BIG);
+
+    /* Close reasons are capped */
+    std::string close;
+    uWS::webtransport::formatClose(close, 1, std::string(5000, 'r'));
+    uWS::webtransport::CapsuleParser closeParser;
+    assert(closeParser.consume(close, 2000, [](uint64_t type, std::string_view payload) {
+        return type == uWS::webtransport::CLOSE_WEBTRANSPORT_SESSION && payload.length() == 4 + uWS::webtransport::MAX_CLOSE_REASON_LENGTH;
+    }) == uWS::webtransport::CapsuleParser::OK);
+}
+
+int main() {
+    testVarints();
+    testCapsules();
+
+    std::cout << "ALL PASS" << std::endl;
+}
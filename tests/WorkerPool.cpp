@@ -0,0 +1,81 @@
+#include "../src/WorkerPool.h"
+
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <mutex>
+
+int main() {
+    /* Every job runs exactly once, and the destructor finishes what was posted */
+    std::atomic<int> sum{0};
+    std::set<std::thread::id> threads;
+    std::mutex threadsMutex;
+    {
+        uWS::WorkerPool pool(4);
+        assert(pool.size() == 4);
+        for (int i = 1; i <= 10000; i++) {
+            pool.post([i, &sum, &threads, &threadsMutex]() {
+                sum += i;
+                std::lock_guard<std::mutex> lock(threadsMutex);
+                threads.insert(std::this_thread::get_id());
+            });
+        }
+    }
+    assert(sum == 10000 * 10001 / 2);
+    assert(threads.size() >= 1 && threads.size() <= 4);
+
+    /* A slow job does not hold up what was queued behind it on the same worker */
+    {
+        uWS::WorkerPool pool(2);
+        std::atomic<bool> release{false};
+        std::atomic<int> done{0};
+        /* Worker 0 gets the slow one and every other job after it */
+        pool.post([&release]() {
+            while (!release) {
+                std::this_thread::yield();
+            }
+        });
+        for (int i = 0; i < 100; i++) {
+            pool.post([&done]() {
+                done++;
+            });
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (done < 100 && std::chrono::steady_clock::now() - start < std::chrono::seconds(10)) {
+            std::this_thread::yield();
+        }
+        assert(done == 100);
+        release = true;
+    }
+
+    /* Posting from many threads at once */
+    sum = 0;
+    {
+        uWS::WorkerPool pool(3);
+        std::vector<std::thread> posters;
+        for (int t = 0; t < 4; t++) {
+            posters.emplace_back([&pool, &sum]() {
+                for (int i = 0; i < 1000; i++) {
+                    pool.post([&sum]() {
+                        sum++;
+                    });
+                }
+            });
+        }
+        for (std::thread &poster : posters) {
+            poster.join();
+        }
+    }
+    assert(sum == 4000);
+
+    /* Guards outlive whichever of the socket and the job lets go last */
+    uWS::OffloadGuard *guard = new uWS::OffloadGuard;
+    uWS::OffloadGuard *job = guard->retain();
+    uWS::OffloadGuard::invalidate(guard);
+    assert(!guard && !job->alive);
+    job->release();
+
+    std::cout << "ALL PASS" << std::endl;
+}